@@ -0,0 +1,152 @@
+/* Include guard */
+#if !defined(ASSET_PACK_H)
+#define ASSET_PACK_H
+
+/* Includes */
+#include <base.h>
+
+/*
+ * Asset pack file layout (little endian):
+ *
+ *   asset_pack_header_t             - at offset 0
+ *   chunk payloads                  - each at a multiple of
+ *                                     ASSET_PACK_ALIGNMENT
+ *   asset_chunk_t[chunk_count]      - table of contents at toc_offset
+ *
+ * Meshlet chunks hold mesh_meshlet_t[meshlet count], then the uint32_t
+ * meshlet vertex indices, then 3 uint8_t local indices per triangle.
+ * Shader chunks hold SPIR-V, so they're found by name and mapped directly.
+ *
+ * The file size is padded to a multiple of ASSET_PACK_ALIGNMENT so the whole
+ * mapping can be imported as host memory. Payloads are stored in their GPU
+ * layout, so loading is a mmap plus a copy (or no copy at all when imported).
+ */
+
+/* Magic number ("VKPK") */
+#define ASSET_PACK_MAGIC 0x4B504B56u
+/* Format version */
+#define ASSET_PACK_VERSION 2u
+/* Alignment of payloads and of the file size */
+#define ASSET_PACK_ALIGNMENT 4096u
+/* Maximum chunk name length (including terminator) */
+#define ASSET_CHUNK_NAME_MAX 48
+/* Number of type specific metadata words per chunk */
+#define ASSET_CHUNK_META_COUNT 16
+
+/* Types */
+/* Chunk payload types */
+typedef enum {
+  ASSET_CHUNK_VERTEX,
+  ASSET_CHUNK_INDEX,
+  ASSET_CHUNK_MESHLET,
+  ASSET_CHUNK_TEXTURE,
+  ASSET_CHUNK_RAW,
+  ASSET_CHUNK_SHADER
+} asset_chunk_type_t;
+/* Type specific metadata slots */
+enum {
+  /* ASSET_CHUNK_VERTEX */
+  ASSET_META_VERTEX_STRIDE = 0,
+  ASSET_META_VERTEX_COUNT = 1,
+  ASSET_META_VERTEX_FORMAT = 2,       /* asset_vertex_format_t */
+  ASSET_META_VERTEX_QUANT = 3,        /* 8 floats, mesh_quant_params_t */
+  /* ASSET_CHUNK_INDEX */
+  ASSET_META_INDEX_SIZE = 0,
+  ASSET_META_INDEX_COUNT = 1,
+  /* ASSET_CHUNK_MESHLET */
+  ASSET_META_MESHLET_COUNT = 0,
+  ASSET_META_MESHLET_VERTEX_COUNT = 1,
+  ASSET_META_MESHLET_TRIANGLE_COUNT = 2,
+  /* ASSET_CHUNK_TEXTURE */
+  ASSET_META_TEXTURE_FORMAT = 0,
+  ASSET_META_TEXTURE_WIDTH = 1,
+  ASSET_META_TEXTURE_HEIGHT = 2,
+  ASSET_META_TEXTURE_MIPS = 3,
+  /* ASSET_CHUNK_SHADER */
+  ASSET_META_SHADER_STAGE = 0         /* VkShaderStageFlagBits */
+};
+/* Vertex layouts (see mesh_opt.h) */
+typedef enum {
+  ASSET_VERTEX_FORMAT_RAW,        /* Defined by whoever packed it */
+  ASSET_VERTEX_FORMAT_FLOAT,      /* mesh_vertex_t */
+  ASSET_VERTEX_FORMAT_QUANTIZED   /* mesh_quant_vertex_t */
+} asset_vertex_format_t;
+/* File header */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunk_count;
+  uint32_t flags;
+  uint64_t toc_offset;
+  uint64_t file_size;
+  uint64_t toc_hash;
+} asset_pack_header_t;
+/* Table of contents entry */
+typedef struct {
+  char name[ASSET_CHUNK_NAME_MAX];
+  uint32_t type;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t hash;
+  uint32_t meta[ASSET_CHUNK_META_COUNT];
+} asset_chunk_t;
+/* Memory mapped asset pack */
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  const asset_pack_header_t *header;
+  const asset_chunk_t *chunks;
+  uint32_t chunk_count;
+} asset_pack_t;
+/* Asset pack writer */
+typedef struct {
+  FILE *file;
+  asset_chunk_t *chunks;
+  uint32_t chunk_count;
+  uint64_t offset;
+} asset_pack_writer_t;
+
+/* Map an asset pack (false on failure) */
+extern bool asset_pack_open(asset_pack_t *pack, const char *path);
+/* Unmap an asset pack */
+extern void asset_pack_close(asset_pack_t *pack);
+/* Find a chunk by name (NULL if not present) */
+extern const asset_chunk_t *asset_pack_find(
+    const asset_pack_t *pack,
+    const char *name
+);
+/* Get a pointer to a chunk's payload */
+extern const void *asset_pack_chunk_data(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+);
+/* Check a chunk's payload against its hash */
+extern bool asset_pack_verify_chunk(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+);
+/* Hint that a chunk will be read soon */
+extern void asset_pack_prefetch(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+);
+
+/* Start writing an asset pack (false on failure) */
+extern bool asset_pack_writer_begin(
+    asset_pack_writer_t *writer,
+    const char *path
+);
+/* Append a chunk (meta may be NULL, false on failure) */
+extern bool asset_pack_writer_add(
+    asset_pack_writer_t *writer,
+    const char *name,
+    asset_chunk_type_t type,
+    const uint32_t *meta,
+    const void *data,
+    uint64_t size
+);
+/* Write the table of contents and close the file (false on failure) */
+extern bool asset_pack_writer_end(asset_pack_writer_t *writer);
+
+#endif /* ASSET_PACK_H */
@@ -53,5 +53,9 @@ extern size_t get_option(
     const char *prompt,
     size_t default_option
 );
+/* Get a monotonic time in seconds */
+extern double time_now(void);
+/* Read a whole file into memory (NULL on failure, free with free()) */
+extern void *read_file(const char *path, size_t *size);
 
 #endif /* BASE_H */
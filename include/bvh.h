@@ -0,0 +1,141 @@
+/* Include guard */
+#if !defined(BVH_H)
+#define BVH_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Bounding volume hierarchy over object bounds, for culling on the CPU
+ * (devices or passes without GPU culling), picking and streaming queries.
+ *
+ * Nodes have four children stored as structure of arrays, so one node is
+ * tested against a plane or a ray with one 4-wide SIMD operation (SSE or
+ * NEON, whichever the build targets). Each child is either another node or
+ * a single object, and every subtree covers a contiguous run of bvh_t.order,
+ * so subtrees found entirely inside a frustum are copied out without being
+ * walked. Nodes are built top down by median splits on the longest centroid
+ * axis, parents before children.
+ *
+ * Changes take effect in bvh_commit: moved objects are refit bottom up,
+ * touching only their ancestors, while inserting or removing objects, or
+ * refits that have grown the tree's surface area past BVH_REBUILD_RATIO of
+ * what the last build had, rebuild it. Queries need a committed tree.
+ *
+ * bvh_cull writes the visible objects as a compact list (visible must hold
+ * bvh_t.order_count). Given a job system, it opens the top of the tree
+ * until there are BVH_CULL_TASKS subtrees and walks them in parallel, each
+ * into the part of the output its run of bvh_t.order would occupy, then
+ * packs the results together.
+ * A box query is a cull against the frustum from bvh_frustum_from_box.
+ * bvh_pick walks the children a ray hits nearest first, testing objects
+ * with the hit function given (or their bounds without one).
+ *
+ * Not thread safe: queries may run concurrently, changes may not.
+ */
+
+/* No object */
+#define BVH_NONE UINT32_MAX
+/* Surface area growth (over the last build) that makes a refit rebuild */
+#define BVH_REBUILD_RATIO 1.5f
+/* Subtrees bvh_cull aims to split the tree into for the job system */
+#define BVH_CULL_TASKS 64u
+/* Objects below which bvh_cull runs on the calling thread */
+#define BVH_CULL_PARALLEL_OBJECTS 16384u
+/* Deepest traversal stack (median splits stay far below it) */
+#define BVH_MAX_STACK 256u
+
+/* Types */
+/* Node of four children */
+typedef struct {
+  float min_x[4];
+  float min_y[4];
+  float min_z[4];
+  float max_x[4];
+  float max_y[4];
+  float max_z[4];
+  uint32_t child[4];              /* Node index, or object if count is 1 */
+  uint32_t first[4];              /* Start of the subtree in bvh_t.order */
+  uint32_t count[4];              /* Objects in the subtree (0: empty) */
+} bvh_node_t;
+/* Frustum, as planes whose inside has dot(xyz, p) + w >= 0 */
+typedef struct {
+  float planes[6][4];
+} bvh_frustum_t;
+/* Exact hit test for picking (returns the distance along dir, or < 0) */
+typedef float (*bvh_hit_fn_t)(
+    void *arg,
+    uint32_t object,
+    const float *origin,
+    const float *dir
+);
+/* Bounding volume hierarchy */
+typedef struct {
+  bvh_node_t *nodes;
+  uint32_t node_count;
+  uint32_t node_capacity;
+  uint32_t *parent;               /* Parent slot (node * 4 + child) */
+  float *bounds;                  /* Min and max corner per object */
+  uint32_t *slot_of;              /* Leaf slot (node * 4 + child) */
+  uint8_t *live;
+  uint32_t object_count;          /* Object ids handed out */
+  uint32_t object_capacity;
+  uint32_t *free_objects;
+  uint32_t free_object_count;
+  uint32_t *order;                /* Live objects, in leaf order */
+  uint32_t order_count;
+  uint32_t *dirty;                /* Nodes with moved children */
+  uint32_t dirty_count;
+  uint8_t *node_dirty;
+  bool rebuild;                   /* Objects added or removed */
+  double area;                    /* Surface area of every node's bounds */
+  double build_area;              /* Area after the last build */
+} bvh_t;
+
+/* Create an empty bounding volume hierarchy */
+extern void bvh_create(bvh_t *bvh);
+/* Add an object, returning its id */
+extern uint32_t bvh_insert(bvh_t *bvh, const float *min, const float *max);
+/* Remove an object */
+extern void bvh_remove(bvh_t *bvh, uint32_t object);
+/* Move an object */
+extern void bvh_update(
+    bvh_t *bvh,
+    uint32_t object,
+    const float *min,
+    const float *max
+);
+/* Apply changes, refitting or rebuilding */
+extern void bvh_commit(bvh_t *bvh);
+/* Get the frustum of a column major view projection matrix (depth 0 to w) */
+extern void bvh_frustum_from_matrix(
+    bvh_frustum_t *frustum,
+    const float *view_proj
+);
+/* Get the frustum that selects objects overlapping a box */
+extern void bvh_frustum_from_box(
+    bvh_frustum_t *frustum,
+    const float *min,
+    const float *max
+);
+/* Write the objects in a frustum, returning their count (jobs may be NULL) */
+extern uint32_t bvh_cull(
+    const bvh_t *bvh,
+    jobs_t *jobs,
+    const bvh_frustum_t *frustum,
+    uint32_t *visible
+);
+/* Get the nearest object along a ray, or BVH_NONE (hit may be NULL) */
+extern uint32_t bvh_pick(
+    const bvh_t *bvh,
+    const float *origin,
+    const float *dir,
+    bvh_hit_fn_t hit,
+    void *arg,
+    float *distance
+);
+/* Destroy a bounding volume hierarchy */
+extern void bvh_destroy(bvh_t *bvh);
+
+#endif /* BVH_H */
@@ -0,0 +1,13 @@
+/* Include guard */
+#if !defined(HASH_H)
+#define HASH_H
+
+/* Includes */
+#include <base.h>
+
+/* Hash a block of memory (XXH64) */
+extern uint64_t hash64(const void *data, size_t size, uint64_t seed);
+/* Combine two hashes */
+extern uint64_t hash64_combine(uint64_t hash, uint64_t value);
+
+#endif /* HASH_H */
@@ -0,0 +1,46 @@
+/* Include guard */
+#if !defined(IMAGE_WRITE_H)
+#define IMAGE_WRITE_H
+
+/* Includes */
+#include <base.h>
+
+/*
+ * Image file encoders for rendered frames, streaming straight from the
+ * pixels (usually mapped readback memory) to a buffered file.
+ *
+ * PNG is 8 bit RGBA, stored uncompressed inside the deflate stream: frames
+ * are encoded faster than they render, and any PNG tool can recompress
+ * them afterwards. EXR is an uncompressed scanline OpenEXR file with half
+ * float RGBA channels. Raw is the pixels as they are, rows packed.
+ *
+ * Strides are in bytes. Every function is thread safe, and expects a little
+ * endian host.
+ */
+
+/* Write 8 bit RGBA pixels as a PNG (false on failure) */
+extern bool image_write_png(
+    const char *path,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *pixels,
+    size_t stride
+);
+/* Write half float RGBA pixels as an OpenEXR file (false on failure) */
+extern bool image_write_exr(
+    const char *path,
+    uint32_t width,
+    uint32_t height,
+    const uint16_t *pixels,
+    size_t stride
+);
+/* Write rows of pixels as they are (false on failure) */
+extern bool image_write_raw(
+    const char *path,
+    uint32_t height,
+    const void *pixels,
+    size_t row_size,
+    size_t stride
+);
+
+#endif /* IMAGE_WRITE_H */
@@ -0,0 +1,71 @@
+/* Include guard */
+#if !defined(INIT_GRAPH_H)
+#define INIT_GRAPH_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Startup dependency graph.
+ *
+ * Stages are added with the stages they depend on, then run as soon as
+ * their dependencies finish: worker stages as jobs, main thread stages (for
+ * APIs that must be called from the main thread, like SDL video) on the
+ * caller. A failed stage stops any further stages from starting. Each
+ * stage's start and end time is recorded for the timeline report.
+ */
+
+/* Maximum number of stages */
+#define INIT_GRAPH_MAX_STAGES 64
+
+/* Types */
+/* Stage function (false on failure) */
+typedef bool (*init_stage_fn_t)(void *arg);
+/* Stage */
+typedef struct {
+  const char *name;
+  init_stage_fn_t fn;
+  void *arg;
+  uint64_t dependencies;
+  bool main_thread;
+  bool launched;
+  bool ok;
+  double start, end;
+  uint32_t worker;
+  job_t job;
+  struct init_graph_s *graph;
+} init_stage_t;
+/* Graph */
+typedef struct init_graph_s {
+  init_stage_t stages[INIT_GRAPH_MAX_STAGES];
+  uint32_t stage_count;
+  atomic_uint_fast64_t done;
+  atomic_bool failed;
+  job_counter_t in_flight;
+  jobs_t *jobs;
+  double start_time, end_time;
+} init_graph_t;
+
+/* Create an empty graph */
+extern void init_graph_create(init_graph_t *graph);
+/* Add a stage, returning its index */
+extern uint32_t init_graph_add(
+    init_graph_t *graph,
+    const char *name,
+    init_stage_fn_t fn,
+    void *arg,
+    bool main_thread
+);
+/* Make a stage wait for another */
+extern void init_graph_depend(
+    init_graph_t *graph,
+    uint32_t stage,
+    uint32_t dependency
+);
+/* Run every stage (false if any failed) */
+extern bool init_graph_run(init_graph_t *graph, jobs_t *jobs);
+/* Log the stage timeline and report it as telemetry */
+extern void init_graph_report(const init_graph_t *graph);
+
+#endif /* INIT_GRAPH_H */
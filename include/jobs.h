@@ -0,0 +1,105 @@
+/* Include guard */
+#if !defined(JOBS_H)
+#define JOBS_H
+
+/* Includes */
+#include <base.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Work stealing job system.
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops jobs at the
+ * bottom, and idle workers steal from the top of others'. Workers are
+ * threads of their own (the creating thread isn't one), pinned one per
+ * physical core; other threads submit through a shared queue and run jobs
+ * while they wait.
+ *
+ * Dependencies are expressed with counters: submitting a job increments its
+ * counter and finishing it decrements it, and jobs_wait runs other jobs (or
+ * parks when there are none) until a counter reaches zero, so jobs can wait
+ * on the jobs they spawn.
+ * Job storage belongs to the caller and must outlive the job.
+ */
+
+/* Jobs each deque can hold (jobs beyond it run inline) */
+#define JOBS_DEQUE_CAPACITY 4096
+/* Not a worker thread */
+#define JOBS_NOT_WORKER UINT32_MAX
+
+/* Types */
+/* Job function */
+typedef void (*job_fn_t)(void *arg);
+/* Outstanding job count */
+typedef struct {
+  atomic_uint value;
+} job_counter_t;
+/* Job */
+typedef struct {
+  job_fn_t fn;
+  void *arg;
+  job_counter_t *counter;
+} job_t;
+/* Per deque statistics */
+typedef struct {
+  uint64_t executed;    /* Jobs run by the owner */
+  uint64_t stolen;      /* Jobs taken from this deque by other workers */
+  uint64_t contention;  /* Lost races for this deque's top */
+} job_stats_t;
+/* Chase-Lev deque (top and bottom on separate cache lines) */
+typedef struct {
+  _Alignas(64) _Atomic int64_t top;
+  _Alignas(64) _Atomic int64_t bottom;
+  _Atomic(job_t *) *buffer;
+  _Alignas(64) atomic_uint_fast64_t executed;
+  atomic_uint_fast64_t stolen;
+  atomic_uint_fast64_t contention;
+} job_deque_t;
+/* Job system */
+typedef struct {
+  uint32_t worker_count;
+  pthread_t *threads;
+  job_deque_t *deques;
+  int32_t *cpus;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake_cond;
+  atomic_uint sleeping;
+  atomic_uint waiting;
+  atomic_bool stopping;
+  job_t **injected;
+  uint32_t injected_head;
+  uint32_t injected_capacity;
+  atomic_uint injected_count;
+} jobs_t;
+/* Parallel for body, over [begin, end) */
+typedef void (*jobs_for_fn_t)(void *arg, uint32_t begin, uint32_t end);
+
+/* Get the number of physical cores */
+extern uint32_t jobs_physical_cores(void);
+/* Create a job system (0 workers for one per physical core) */
+extern void jobs_create(jobs_t *jobs, uint32_t worker_count, bool pin);
+/* Queue a job (incrementing its counter) */
+extern void jobs_submit(jobs_t *jobs, job_t *job);
+/* Run jobs until a counter reaches zero */
+extern void jobs_wait(jobs_t *jobs, job_counter_t *counter);
+/* Run one queued job if there is one (false if none was found) */
+extern bool jobs_run_one(jobs_t *jobs);
+/* Check if a counter has reached zero */
+extern bool jobs_done(const job_counter_t *counter);
+/* Split [0, count) into ranges of at least grain and run them in parallel */
+extern void jobs_parallel_for(
+    jobs_t *jobs,
+    jobs_for_fn_t fn,
+    void *arg,
+    uint32_t count,
+    uint32_t grain
+);
+/* Get the calling thread's worker index (JOBS_NOT_WORKER if none) */
+extern uint32_t jobs_worker_index(const jobs_t *jobs);
+/* Get a deque's statistics */
+extern job_stats_t jobs_stats(const jobs_t *jobs, uint32_t worker);
+/* Destroy a job system (finishing queued jobs) */
+extern void jobs_destroy(jobs_t *jobs);
+
+#endif /* JOBS_H */
@@ -0,0 +1,106 @@
+/* Include guard */
+#if !defined(MESH_OPT_H)
+#define MESH_OPT_H
+
+/* Includes */
+#include <base.h>
+
+/*
+ * Offline mesh processing: post-transform cache ordering (Tipsify), vertex
+ * fetch ordering, attribute quantization and meshlet building.
+ */
+
+/* Post-transform cache size the index order is optimized for */
+#define MESH_OPT_CACHE_SIZE 16
+/* Meshlet limits */
+#define MESH_MESHLET_MAX_VERTICES 64
+#define MESH_MESHLET_MAX_TRIANGLES 124
+
+/* Types */
+/* Unquantized vertex */
+typedef struct {
+  float position[3];
+  float normal[3];
+  float uv[2];
+} mesh_vertex_t;
+/* Quantized vertex */
+typedef struct {
+  uint16_t position[4]; /* Half floats, (position - offset) / scale */
+  int16_t normal[2];    /* Octahedral, snorm */
+  uint16_t uv[2];       /* Unorm, (uv - offset) / scale */
+} mesh_quant_vertex_t;
+/* Dequantization parameters */
+typedef struct {
+  float position_offset[3];
+  float position_scale;
+  float uv_offset[2];
+  float uv_scale[2];
+} mesh_quant_params_t;
+/*
+ * Meshlet with culling bounds. Every triangle faces away from an eye at
+ * position e if dot(normalize(cone_apex - e), cone_axis) >= cone_cutoff.
+ */
+typedef struct {
+  uint32_t vertex_offset;
+  uint32_t triangle_offset;
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+  float center[3];
+  float radius;
+  float cone_apex[3];
+  float cone_cutoff;
+  float cone_axis[3];
+  float padding;
+} mesh_meshlet_t;
+/* Meshlets of a mesh */
+typedef struct {
+  mesh_meshlet_t *meshlets;
+  uint32_t meshlet_count;
+  uint32_t *vertices;     /* Mesh vertex indices */
+  uint32_t vertex_count;
+  uint8_t *triangles;     /* Meshlet local indices, 3 per triangle */
+  uint32_t triangle_count;
+} mesh_meshlets_t;
+/* Post-transform cache statistics */
+typedef struct {
+  double acmr;  /* Cache misses per triangle */
+  double atvr;  /* Cache misses per referenced vertex */
+} mesh_cache_stats_t;
+
+/* Reorder triangles for the post-transform cache (Tipsify) */
+extern void mesh_opt_reorder_indices(
+    uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count,
+    uint32_t cache_size
+);
+/* Reorder vertices by first use, dropping unused ones (returns new count) */
+extern size_t mesh_opt_reorder_vertices(
+    mesh_vertex_t *vertices,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count
+);
+/* Simulate a FIFO post-transform cache */
+extern mesh_cache_stats_t mesh_opt_cache_stats(
+    const uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count,
+    uint32_t cache_size
+);
+/* Quantize vertices */
+extern mesh_quant_params_t mesh_opt_quantize(
+    const mesh_vertex_t *vertices,
+    size_t vertex_count,
+    mesh_quant_vertex_t *out
+);
+/* Split a mesh into meshlets */
+extern mesh_meshlets_t mesh_opt_build_meshlets(
+    const mesh_vertex_t *vertices,
+    const uint32_t *indices,
+    size_t index_count
+);
+/* Free meshlets */
+extern void mesh_opt_meshlets_free(mesh_meshlets_t *meshlets);
+
+#endif /* MESH_OPT_H */
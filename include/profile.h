@@ -0,0 +1,167 @@
+/* Include guard */
+#if !defined(PROFILE_H)
+#define PROFILE_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <stdatomic.h>
+
+/*
+ * Hierarchical CPU and GPU scope profiler, exported as Chrome trace JSON
+ * (loadable by chrome://tracing and the Perfetto UI).
+ *
+ * CPU scopes nest per thread and are timed with CLOCK_MONOTONIC into a
+ * buffer owned by the thread, so recording takes no locks. GPU scopes nest
+ * per command buffer as timestamp query pairs (the outermost ones also
+ * gather pipeline statistics, if enabled), recorded into one query pool per
+ * frame in flight and read back when that frame slot is reused. GPU times
+ * are put on the CPU clock with VK_EXT_calibrated_timestamps where the
+ * device has it and can calibrate its clock against CLOCK_MONOTONIC, and
+ * otherwise roughly, by lining the first scope of a
+ * frame up with when the frame began.
+ *
+ * Scope names must be string literals (or otherwise outlive the profiler).
+ * Full buffers drop further scopes (counted in profile.dropped).
+ *
+ * Release builds (make RELEASE=1) compile the profiler out: the macros
+ * below expand to nothing, and nothing else here is defined.
+ */
+
+#if defined(RELEASE)
+#define PROFILE_ENABLED 0
+#else
+#define PROFILE_ENABLED 1
+#endif
+
+#if PROFILE_ENABLED
+
+/* Scopes stored per thread */
+#define PROFILE_THREAD_EVENTS 65536u
+/* Deepest scope nesting */
+#define PROFILE_MAX_DEPTH 32u
+/* Most threads recording */
+#define PROFILE_MAX_THREADS 64u
+/* Longest thread name (including terminator) */
+#define PROFILE_MAX_NAME 32u
+/* Most GPU scopes per frame */
+#define PROFILE_GPU_SCOPES 256u
+/* GPU scopes stored */
+#define PROFILE_GPU_EVENTS 65536u
+/* Most frames in flight */
+#define PROFILE_MAX_FRAMES 4u
+/* Pipeline statistics gathered (see profile.c) */
+#define PROFILE_STATISTICS 5u
+
+/* Types */
+/* Completed scope */
+typedef struct {
+  const char *name;
+  uint64_t begin, end;            /* CLOCK_MONOTONIC nanoseconds */
+  uint32_t depth;
+} profile_event_t;
+/* Thread's scopes (written only by the thread) */
+typedef struct {
+  char name[PROFILE_MAX_NAME];
+  uint32_t id;
+  profile_event_t *events;
+  atomic_uint count;              /* Events published */
+  const char *stack_names[PROFILE_MAX_DEPTH];
+  uint64_t stack_begins[PROFILE_MAX_DEPTH];
+  uint32_t depth;
+} profile_thread_t;
+/* Completed GPU scope */
+typedef struct {
+  profile_event_t event;
+  bool has_statistics;
+  uint64_t statistics[PROFILE_STATISTICS];
+} profile_gpu_event_t;
+/* GPU scope being recorded */
+typedef struct {
+  const char *name;
+  uint32_t depth;
+  uint32_t statistics_query;      /* UINT32_MAX if none */
+} profile_gpu_scope_t;
+/* Frame slot's queries */
+typedef struct {
+  VkQueryPool timestamps;         /* Begin and end per scope */
+  VkQueryPool statistics;         /* One per outermost scope */
+  profile_gpu_scope_t scopes[PROFILE_GPU_SCOPES];
+  uint32_t scope_count, statistics_count;
+  uint32_t stack[PROFILE_MAX_DEPTH];
+  uint32_t depth;
+  uint64_t cpu_begin;             /* When the frame began recording */
+} profile_gpu_frame_t;
+/* GPU profiler (recorded from one thread at a time) */
+typedef struct {
+  vk_dev_t *dev;
+  double period;                  /* Nanoseconds per tick (0 if disabled) */
+  bool statistics;
+  PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+  bool calibrated;
+  uint64_t gpu_base, cpu_base;    /* Matching ticks and nanoseconds */
+  uint32_t frames, frame;
+  profile_gpu_frame_t slots[PROFILE_MAX_FRAMES];
+  profile_gpu_event_t *events;
+  uint32_t event_count;
+} profile_gpu_t;
+
+/* Get the profiler clock (CLOCK_MONOTONIC nanoseconds) */
+extern uint64_t profile_now(void);
+/* Name the calling thread in traces */
+extern void profile_thread_name(const char *name);
+/* Open a CPU scope on the calling thread */
+extern void profile_begin(const char *name);
+/* Close the calling thread's innermost CPU scope */
+extern void profile_end(void);
+/* Create a GPU profiler (statistics needs pipelineStatisticsQuery enabled) */
+extern void profile_gpu_create(
+    profile_gpu_t *gpu,
+    const vk_inst_t *inst,
+    vk_phys_dev_t phys_dev,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    uint32_t frames,
+    bool statistics
+);
+/* Read back a frame slot's last scopes and reset its queries in cmd */
+extern void profile_gpu_frame(
+    profile_gpu_t *gpu,
+    VkCommandBuffer cmd,
+    uint32_t frame
+);
+/* Open a GPU scope in cmd (outside or wholly inside a render pass) */
+extern void profile_gpu_begin(
+    profile_gpu_t *gpu,
+    VkCommandBuffer cmd,
+    const char *name
+);
+/* Close the innermost GPU scope in cmd */
+extern void profile_gpu_end(profile_gpu_t *gpu, VkCommandBuffer cmd);
+/* Destroy a GPU profiler */
+extern void profile_gpu_destroy(profile_gpu_t *gpu);
+/* Write every scope so far as Chrome trace JSON (gpu may be NULL) */
+extern bool profile_write_trace(const char *path, const profile_gpu_t *gpu);
+/* Free every thread's scopes (no thread may still be recording) */
+extern void profile_shutdown(void);
+
+/* Instrumentation */
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END() profile_end()
+#define PROFILE_GPU_FRAME(gpu, cmd, frame) profile_gpu_frame(gpu, cmd, frame)
+#define PROFILE_GPU_BEGIN(gpu, cmd, name) profile_gpu_begin(gpu, cmd, name)
+#define PROFILE_GPU_END(gpu, cmd) profile_gpu_end(gpu, cmd)
+
+#else
+
+/* Instrumentation (compiled out) */
+#define PROFILE_BEGIN(name) ((void)0)
+#define PROFILE_END() ((void)0)
+#define PROFILE_GPU_FRAME(gpu, cmd, frame) ((void)0)
+#define PROFILE_GPU_BEGIN(gpu, cmd, name) ((void)0)
+#define PROFILE_GPU_END(gpu, cmd) ((void)0)
+
+#endif /* PROFILE_ENABLED */
+
+#endif /* PROFILE_H */
@@ -0,0 +1,43 @@
+/* Include guard */
+#if !defined(RADIX_SORT_H)
+#define RADIX_SORT_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Stable least significant digit radix sort of 64 bit keys with a 32 bit
+ * value each.
+ *
+ * Keys are sorted a byte at a time. One read of the input counts every
+ * byte's histogram up front, so bytes that are the same in every key (the
+ * high bits of small ids, usually) are skipped. Each remaining pass counts
+ * the byte per chunk of the input in parallel, turns the counts into a
+ * start per chunk and byte value, then scatters every chunk in parallel,
+ * which keeps the sort stable. Inputs under RADIX_SORT_PARALLEL_ITEMS, or
+ * without a job system, sort as one chunk on the calling thread.
+ */
+
+/* Items below which the sort runs on the calling thread */
+#define RADIX_SORT_PARALLEL_ITEMS 16384u
+/* Most chunks the input is split into */
+#define RADIX_SORT_MAX_CHUNKS 64u
+
+/* Types */
+/* Item to sort */
+typedef struct {
+  uint64_t key;
+  uint32_t value;
+  uint32_t padding;
+} radix_item_t;
+
+/* Sort items by key (scratch holds count), returning the sorted array */
+extern radix_item_t *radix_sort(
+    jobs_t *jobs,
+    radix_item_t *items,
+    radix_item_t *scratch,
+    uint32_t count
+);
+
+#endif /* RADIX_SORT_H */
@@ -0,0 +1,121 @@
+/* Include guard */
+#if !defined(SCENE_H)
+#define SCENE_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Transform hierarchy stored as structure of arrays.
+ *
+ * Nodes are kept in depth first order, so every parent comes before its
+ * children and every subtree is a contiguous run of indices ending at
+ * subtree_end. Local and world matrices are column major 4x4 floats (as
+ * GLSL reads them), in 64 byte aligned arrays indexed like the rest.
+ * Nodes are named by handles that survive reordering; their index, which
+ * is also their world matrix's place in the GPU copy, changes whenever the
+ * order is rebuilt.
+ *
+ * Adding a node under the last subtree (or as a root) keeps the order;
+ * adding one anywhere else rebuilds it before the next update, which then
+ * marks every node changed and sets scene_t.reordered. Removed nodes leave
+ * holes that the order skips until a quarter of the nodes are holes.
+ *
+ * Setting a local matrix marks the node dirty. scene_prepare merges dirty
+ * nodes into the disjoint subtrees under them, splitting subtrees larger
+ * than SCENE_SPLIT_NODES at their roots (computed serially) so the rest
+ * are independent, and returns how many world matrices will change.
+ * scene_update recomputes them, in parallel over the subtrees on the job
+ * system, with SIMD kernels (AVX, SSE or NEON, whichever the build
+ * targets) that run over each batch of siblings sharing a parent's
+ * columns. Changed matrices are written to the upload memory given (a
+ * frame allocation) in order, and scene_upload_regions gives the
+ * vkCmdCopyBuffer regions that move them into the GPU copy.
+ *
+ * Not thread safe: use it from one thread (update runs jobs itself).
+ */
+
+/* Invalid handle, and no parent */
+#define SCENE_NONE UINT32_MAX
+/* Largest subtree recomputed as one unit */
+#define SCENE_SPLIT_NODES 4096u
+/* Nodes per job scene_update aims for */
+#define SCENE_JOB_NODES 2048u
+/* Size of a matrix (bytes) */
+#define SCENE_MATRIX_SIZE (16u * sizeof(float))
+
+/* Types */
+/* Run of nodes updated together */
+typedef struct {
+  uint32_t first;                 /* Node index */
+  uint32_t count;
+  uint32_t upload;                /* Matrix offset in the upload */
+  bool serial;                    /* Split root, computed before the jobs */
+} scene_range_t;
+/* Scene graph */
+typedef struct {
+  uint32_t count;                 /* Nodes, including removed ones */
+  uint32_t capacity;
+  float *local;                   /* 16 per node */
+  float *world;                   /* 16 per node */
+  uint32_t *parent;               /* Index, SCENE_NONE for roots */
+  uint32_t *subtree_end;          /* One past the last descendant */
+  uint32_t *handle_of;            /* Handle per index */
+  uint8_t *flags;
+  uint32_t *index_of;             /* Index per handle (SCENE_NONE if free) */
+  uint32_t handle_count;
+  uint32_t handle_capacity;
+  uint32_t *free_handles;
+  uint32_t free_handle_count;
+  uint32_t *dirty;                /* Dirty indices */
+  uint32_t dirty_count;
+  uint32_t removed_count;         /* Removed nodes still in the arrays */
+  bool order_stale;               /* Depth first order must be rebuilt */
+  bool invalid;                   /* Every node must be recomputed */
+  bool reordered;                 /* Order rebuilt since the last update */
+  bool prepared;
+  scene_range_t *ranges;
+  uint32_t range_count;
+  uint32_t range_capacity;
+  uint32_t upload_count;          /* Matrices in the prepared update */
+  uint32_t *stack;                /* Subtree walk cursors */
+  uint32_t *stack_end;
+} scene_t;
+
+/* Create an empty scene */
+extern void scene_create(scene_t *scene);
+/* Add a node under a parent (SCENE_NONE for a root), returning its handle */
+extern uint32_t scene_add(
+    scene_t *scene,
+    uint32_t parent,
+    const float *local
+);
+/* Remove a node and its descendants */
+extern void scene_remove(scene_t *scene, uint32_t handle);
+/* Set a node's local matrix */
+extern void scene_set_local(
+    scene_t *scene,
+    uint32_t handle,
+    const float *local
+);
+/* Get a node's world matrix (as of the last update) */
+extern const float *scene_world(const scene_t *scene, uint32_t handle);
+/* Get a node's index (its world matrix's place in the GPU copy) */
+extern uint32_t scene_index(const scene_t *scene, uint32_t handle);
+/* Mark every node changed */
+extern void scene_invalidate(scene_t *scene);
+/* Plan the next update, returning the matrices it will upload */
+extern uint32_t scene_prepare(scene_t *scene);
+/* Recompute changed world matrices (jobs and upload may be NULL) */
+extern void scene_update(scene_t *scene, jobs_t *jobs, void *upload);
+/* Get the copies from an upload into the GPU copy (range_count at most) */
+extern uint32_t scene_upload_regions(
+    const scene_t *scene,
+    VkDeviceSize src_offset,
+    VkBufferCopy *regions
+);
+/* Destroy a scene */
+extern void scene_destroy(scene_t *scene);
+
+#endif /* SCENE_H */
@@ -0,0 +1,37 @@
+/* Include guard */
+#if !defined(SPSC_QUEUE_H)
+#define SPSC_QUEUE_H
+
+/* Includes */
+#include <base.h>
+#include <stdatomic.h>
+
+/*
+ * Lock-free single producer, single consumer ring buffer of fixed size
+ * elements. One thread pushes and one thread pops; neither ever blocks.
+ */
+
+/* Types */
+/* Queue (head and tail on separate cache lines) */
+typedef struct {
+  _Alignas(64) atomic_uint head;  /* Next slot to pop */
+  _Alignas(64) atomic_uint tail;  /* Next slot to push */
+  _Alignas(64) uint8_t *data;
+  uint32_t element_size;
+  uint32_t mask;
+} spsc_queue_t;
+
+/* Create a queue (capacity is rounded up to a power of two) */
+extern void spsc_queue_create(
+    spsc_queue_t *queue,
+    uint32_t element_size,
+    uint32_t capacity
+);
+/* Push an element (producer only, false if full) */
+extern bool spsc_queue_push(spsc_queue_t *queue, const void *element);
+/* Pop an element (consumer only, false if empty) */
+extern bool spsc_queue_pop(spsc_queue_t *queue, void *element);
+/* Destroy a queue */
+extern void spsc_queue_destroy(spsc_queue_t *queue);
+
+#endif /* SPSC_QUEUE_H */
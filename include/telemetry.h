@@ -0,0 +1,44 @@
+/* Include guard */
+#if !defined(TELEMETRY_H)
+#define TELEMETRY_H
+
+/* Includes */
+#include <base.h>
+
+/* Maximum number of distinct telemetry entries */
+#define TELEMETRY_MAX_ENTRIES 128
+/* Maximum telemetry entry name length (including terminator) */
+#define TELEMETRY_MAX_NAME 64
+
+/* Types */
+/* Telemetry entry kinds */
+typedef enum {
+  TELEMETRY_COUNTER,  /* Accumulated count */
+  TELEMETRY_GAUGE,    /* Last reported value */
+  TELEMETRY_TIMING    /* Milliseconds, with min/average/max */
+} telemetry_kind_t;
+/* Telemetry entry */
+typedef struct {
+  char name[TELEMETRY_MAX_NAME];
+  telemetry_kind_t kind;
+  double value;
+  double min;
+  double max;
+  double sum;
+  uint64_t samples;
+} telemetry_entry_t;
+
+/* Report a telemetry value (thread safe) */
+extern void telemetry_report(
+    const char *name,
+    telemetry_kind_t kind,
+    double value
+);
+/* Copy a telemetry entry out by name (false if never reported) */
+extern bool telemetry_get(const char *name, telemetry_entry_t *entry);
+/* Log every telemetry entry */
+extern void telemetry_dump(void);
+/* Clear all telemetry entries */
+extern void telemetry_reset(void);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,101 @@
+/* Include guard */
+#if !defined(TRANSCODE_H)
+#define TRANSCODE_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Universal texture blocks and transcoding to device formats.
+ *
+ * A universal block covers 4x4 texels in 12 bytes: two RGBA8 endpoints and
+ * a 2 bit selector per texel (texel i at bits 2i of the little endian
+ * selector word), choosing between the endpoints and the colours 21/64 and
+ * 43/64 of the way between them. ASTC 4x4 with 8 bit endpoints and 2 bit
+ * weights represents that palette exactly; BC7 mode 6 uses the same weights
+ * but stores endpoints as 7 bits plus a shared p bit, so there it is
+ * approximated (each endpoint channel within 1 of the original). Transcoding
+ * to either is bit repacking, and RGBA8 is a table lookup per texel.
+ *
+ * Levels are transcoded one block row at a time straight into the
+ * destination (usually staging memory), so no full resolution RGBA copy is
+ * ever made.
+ */
+
+/* Bytes per universal block */
+#define TRANSCODE_BLOCK_BYTES 12
+/* Asset pack texture formats of universal block chunks */
+#define TRANSCODE_FORMAT_UNIVERSAL_UNORM 0x55424b00u
+#define TRANSCODE_FORMAT_UNIVERSAL_SRGB 0x55424b01u
+
+/* Types */
+/* Transcode target */
+typedef enum {
+  TRANSCODE_TARGET_RGBA8,
+  TRANSCODE_TARGET_BC7,
+  TRANSCODE_TARGET_ASTC_4x4,
+  TRANSCODE_TARGET_COUNT
+} transcode_target_t;
+/* Transcode kernel instruction set */
+typedef enum {
+  TRANSCODE_KERNEL_SCALAR,
+  TRANSCODE_KERNEL_SSE41,
+  TRANSCODE_KERNEL_AVX2,
+  TRANSCODE_KERNEL_NEON,
+  TRANSCODE_KERNEL_COUNT
+} transcode_kernel_t;
+
+/* Check if a texture format is a universal block format */
+extern bool transcode_is_universal(uint32_t format);
+/* Get the bytes a level takes in universal blocks */
+extern size_t transcode_universal_size(uint32_t width, uint32_t height);
+/* Get the bytes a level takes in a target format */
+extern size_t transcode_target_size(
+    transcode_target_t target,
+    uint32_t width,
+    uint32_t height
+);
+/* Get the Vulkan format of a target */
+extern VkFormat transcode_target_format(transcode_target_t target, bool srgb);
+/* Get a target's name */
+extern const char *transcode_target_name(transcode_target_t target);
+/* Choose the smallest target the device can sample (BC7, ASTC, RGBA8) */
+extern transcode_target_t transcode_choose_target(
+    VkPhysicalDevice phys_dev,
+    bool srgb
+);
+/* Get the kernel in use (the best the CPU supports unless overridden) */
+extern transcode_kernel_t transcode_get_kernel(void);
+/* Use a kernel (false if the CPU doesn't support it) */
+extern bool transcode_set_kernel(transcode_kernel_t kernel);
+/* Get a kernel's name */
+extern const char *transcode_kernel_name(transcode_kernel_t kernel);
+/* Transcode block rows [first_row, first_row + row_count) of a level */
+extern void transcode_rows(
+    transcode_target_t target,
+    const uint8_t *src,
+    uint32_t width,
+    uint32_t height,
+    uint32_t first_row,
+    uint32_t row_count,
+    uint8_t *dst
+);
+/* Transcode a level, split across a job system if given */
+extern void transcode_level(
+    transcode_target_t target,
+    const uint8_t *src,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst,
+    jobs_t *job_system
+);
+/* Encode an RGBA8 level into universal blocks (offline, slow) */
+extern void transcode_encode(
+    const uint8_t *rgba,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst
+);
+
+#endif /* TRANSCODE_H */
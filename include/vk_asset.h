@@ -0,0 +1,51 @@
+/* Include guard */
+#if !defined(VK_ASSET_H)
+#define VK_ASSET_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_staging.h>
+#include <asset_pack.h>
+
+/*
+ * Uploading asset pack chunks. Where VK_EXT_external_memory_host is enabled
+ * the pack's mapping is imported and chunks are copied by the GPU straight
+ * out of the page cache; otherwise they are copied from the mapping into the
+ * staging ring.
+ */
+
+/* Types */
+/* Asset pack imported as host memory */
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+} vk_asset_import_t;
+
+/* Import an asset pack as host memory (false if unsupported) */
+extern bool vk_asset_import(
+    vk_asset_import_t *import,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const asset_pack_t *pack
+);
+/* Release an imported asset pack (before closing the pack) */
+extern void vk_asset_import_destroy(vk_asset_import_t *import, vk_dev_t *dev);
+/*
+ * Record a copy of a chunk from chunk_offset onwards into a buffer, using the
+ * import if it isn't NULL and the staging ring otherwise (returns bytes
+ * recorded, which is less than requested when the ring fills up)
+ */
+extern VkDeviceSize vk_asset_cmd_upload(
+    const vk_asset_import_t *import,
+    vk_staging_t *ring,
+    VkCommandBuffer cmd,
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk,
+    VkDeviceSize chunk_offset,
+    VkBuffer dst,
+    VkDeviceSize dst_offset
+);
+
+#endif /* VK_ASSET_H */
@@ -0,0 +1,106 @@
+/* Include guard */
+#if !defined(VK_BATCH_H)
+#define VK_BATCH_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <vk_submit.h>
+#include <jobs.h>
+
+/*
+ * Offline batch rendering of frame ranges to image files.
+ *
+ * Frames go round a ring of slots, each with an offscreen target and a
+ * host visible readback buffer. A frame is rendered into its slot's target
+ * on the graphics queue, copied into the readback buffer on the transfer
+ * queue (waiting on the render's timeline value, not the CPU), and encoded
+ * from the mapped buffer by a job once the copy is seen to be done. A slot
+ * is only waited for when the ring comes back round to it, so rendering,
+ * readback and encoding of different frames all overlap and the device is
+ * never waited idle.
+ *
+ * Targets are VK_FORMAT_R8G8B8A8_UNORM for PNG and raw output, and
+ * VK_FORMAT_R16G16B16A16_SFLOAT for EXR. They are shared by the graphics
+ * and transfer queue families, so no ownership transfers are needed.
+ *
+ * vk_batch_render must be called from the thread that created the job
+ * system, as it waits on encode jobs.
+ */
+
+/* Most slots in the ring */
+#define VK_BATCH_MAX_SLOTS 8
+/* Longest output prefix (including terminator) */
+#define VK_BATCH_MAX_PATH 256
+
+/* Types */
+/* Output file format */
+typedef enum {
+  VK_BATCH_PNG,
+  VK_BATCH_EXR,
+  VK_BATCH_RAW
+} vk_batch_format_t;
+/* Render a frame into target, which is in and must be left in GENERAL */
+typedef void (*vk_batch_record_fn_t)(
+    void *user,
+    VkCommandBuffer cmd,
+    VkImage target,
+    uint64_t frame
+);
+/* Slot in the ring */
+typedef struct {
+  struct vk_batch_s *batch;
+  VkImage target;
+  VkDeviceMemory target_memory;
+  vk_buf_t readback;
+  VkCommandBuffer render_cmd, copy_cmd;
+  vk_sync_point_t copied;
+  uint64_t frame;
+  double submitted;               /* When the frame was submitted */
+  bool pending;                   /* Copy submitted, not yet encoding */
+  bool failed;                    /* Written by the encode job */
+  job_t job;
+  job_counter_t counter;
+} vk_batch_slot_t;
+/* Batch renderer */
+typedef struct vk_batch_s {
+  vk_dev_t *dev;
+  vk_submit_t *submit;
+  jobs_t *jobs;
+  uint32_t width, height;
+  VkFormat format;
+  uint32_t pixel_size;
+  vk_batch_format_t output;
+  char prefix[VK_BATCH_MAX_PATH];
+  VkCommandPool render_pool, copy_pool;
+  vk_batch_slot_t slots[VK_BATCH_MAX_SLOTS];
+  uint32_t slot_count;
+} vk_batch_t;
+
+/* Create a batch renderer writing <prefix><frame>.<extension> files */
+extern void vk_batch_create(
+    vk_batch_t *batch,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_submit_t *submit,
+    jobs_t *jobs,
+    uint32_t width,
+    uint32_t height,
+    vk_batch_format_t output,
+    uint32_t slot_count,
+    const char *prefix
+);
+/* Render and write frames first to last (false if any failed to write) */
+extern bool vk_batch_render(
+    vk_batch_t *batch,
+    uint64_t first,
+    uint64_t last,
+    vk_batch_record_fn_t record,
+    void *user
+);
+/* Destroy a batch renderer */
+extern void vk_batch_destroy(vk_batch_t *batch);
+
+#endif /* VK_BATCH_H */
@@ -0,0 +1,32 @@
+/* Include guard */
+#if !defined(VK_BUF_H)
+#define VK_BUF_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+
+/* Types */
+/* Vulkan buffer with its own memory allocation */
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+  VkMemoryPropertyFlags memory_flags;
+  void *mapped;
+} vk_buf_t;
+
+/* Create a Vulkan buffer (persistently mapped if host visible) */
+extern vk_buf_t vk_buf_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+);
+/* Destroy a Vulkan buffer */
+extern void vk_buf_destroy(vk_buf_t *buf, vk_dev_t *dev);
+
+#endif /* VK_BUF_H */
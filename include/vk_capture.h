@@ -0,0 +1,201 @@
+/* Include guard */
+#if !defined(VK_CAPTURE_H)
+#define VK_CAPTURE_H
+
+/* Includes */
+#include <base.h>
+#include <vk_submit.h>
+
+/*
+ * Vulkan call stream capture, for replay by tools/vk_replay.c.
+ *
+ * While a capture is running, the renderer's buffers and swapchain images,
+ * the commands recorded through the vk_capture_cmd_* wrappers, every
+ * vk_submit_enqueue and every frame presented are written to a compact
+ * binary stream. Handles are remapped to small ids in order of first use
+ * (a handle the driver reuses after a destroy gets a fresh id when it is
+ * registered again), so the stream doesn't depend on the driver it came
+ * from. Mapped buffer contents are snapshotted where the renderer makes
+ * them visible to the device (vk_frame_alloc_flush), so replay sees the
+ * same data without any app logic.
+ *
+ * Commands recorded without a wrapper (profiler queries, staging copies)
+ * are not captured. Capture must begin before the device's resources are
+ * created, and may be used from any thread.
+ *
+ * The stream is a vk_capture_header_t, then records: a vk_capture_record_t
+ * giving the opcode and payload size, then the payload, which is one of
+ * the structs below followed by its arrays. Everything is native endian.
+ */
+
+/* Stream magic ("VKCP") */
+#define VK_CAPTURE_MAGIC 0x50434b56u
+/* Stream version */
+#define VK_CAPTURE_VERSION 1u
+
+/* Types */
+/* Record opcodes */
+typedef enum {
+  VK_CAPTURE_OP_BUFFER = 1,       /* vk_capture_buffer_op_t */
+  VK_CAPTURE_OP_IMAGE,            /* vk_capture_image_op_t */
+  VK_CAPTURE_OP_BUFFER_DATA,      /* vk_capture_data_op_t, bytes */
+  VK_CAPTURE_OP_CMD_BEGIN,        /* vk_capture_cmd_op_t */
+  VK_CAPTURE_OP_CMD_END,          /* vk_capture_cmd_op_t */
+  VK_CAPTURE_OP_PIPELINE_BARRIER, /* vk_capture_barrier_op_t, barriers */
+  VK_CAPTURE_OP_COPY_BUFFER,      /* vk_capture_copy_op_t, regions */
+  VK_CAPTURE_OP_SUBMIT,           /* vk_capture_submit_op_t, ids, waits... */
+  VK_CAPTURE_OP_FRAME             /* No payload */
+} vk_capture_op_t;
+/* Stream header */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+} vk_capture_header_t;
+/* Record header */
+typedef struct {
+  uint32_t op;
+  uint32_t size;                  /* Payload bytes */
+} vk_capture_record_t;
+/* Buffer created */
+typedef struct {
+  uint32_t id;
+  uint32_t usage;
+  uint64_t size;
+} vk_capture_buffer_op_t;
+/* Image created */
+typedef struct {
+  uint32_t id;
+  uint32_t format;
+  uint32_t width, height;
+  uint32_t usage;
+} vk_capture_image_op_t;
+/* Buffer contents */
+typedef struct {
+  uint32_t id;
+  uint32_t pad;
+  uint64_t offset;
+  uint64_t size;                  /* Followed by size bytes */
+} vk_capture_data_op_t;
+/* Command buffer begun or ended */
+typedef struct {
+  uint32_t cmd;
+  uint32_t flags;                 /* Usage flags (begin only) */
+} vk_capture_cmd_op_t;
+/* Pipeline barrier (followed by each kind of barrier, in order) */
+typedef struct {
+  uint32_t cmd;
+  uint32_t src_stages, dst_stages;
+  uint32_t dependency_flags;
+  uint32_t memory_count, buffer_count, image_count;
+} vk_capture_barrier_op_t;
+/* Memory barrier */
+typedef struct {
+  uint32_t src_access, dst_access;
+} vk_capture_memory_barrier_t;
+/* Buffer barrier */
+typedef struct {
+  uint32_t src_access, dst_access;
+  uint32_t src_family, dst_family;
+  uint32_t buffer;
+  uint32_t pad;
+  uint64_t offset, size;
+} vk_capture_buffer_barrier_t;
+/* Image barrier */
+typedef struct {
+  uint32_t src_access, dst_access;
+  uint32_t old_layout, new_layout;
+  uint32_t src_family, dst_family;
+  uint32_t image;
+  uint32_t aspect;
+  uint32_t base_mip, mip_count;
+  uint32_t base_layer, layer_count;
+} vk_capture_image_barrier_t;
+/* Buffer copy (followed by the regions) */
+typedef struct {
+  uint32_t cmd;
+  uint32_t src, dst;
+  uint32_t region_count;
+} vk_capture_copy_op_t;
+/* Buffer copy region */
+typedef struct {
+  uint64_t src_offset, dst_offset, size;
+} vk_capture_region_t;
+/* Submission (followed by command buffer ids, then waits, then signals) */
+typedef struct {
+  uint32_t kind;                  /* vk_submit_kind_t */
+  uint32_t command_buffer_count;
+  uint32_t wait_count, signal_count;
+} vk_capture_submit_op_t;
+/* Semaphore wait or signal */
+typedef struct {
+  uint32_t semaphore;
+  uint32_t pad;
+  uint64_t value;                 /* 0 if binary */
+  uint64_t stages;
+} vk_capture_semaphore_t;
+
+/* Start capturing to a file (false if it can't be created) */
+extern bool vk_capture_begin(const char *path);
+/* Stop capturing, closing the file */
+extern void vk_capture_end(void);
+/* Check if a capture is running */
+extern bool vk_capture_active(void);
+
+/* Register a buffer */
+extern void vk_capture_buffer(
+    VkBuffer buffer,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage
+);
+/* Register an image (2D, single mip and layer) */
+extern void vk_capture_image(
+    VkImage image,
+    VkFormat format,
+    VkExtent2D extent,
+    VkImageUsageFlags usage
+);
+/* Snapshot a range of a buffer's mapped contents */
+extern void vk_capture_buffer_data(
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize size,
+    const void *data
+);
+/* Record a submission */
+extern void vk_capture_submit(
+    vk_submit_kind_t kind,
+    const vk_submission_t *submission
+);
+/* Record the end of a frame */
+extern void vk_capture_frame(void);
+
+/* vkBeginCommandBuffer, captured */
+extern VkResult vk_capture_cmd_begin(
+    VkCommandBuffer cmd,
+    const VkCommandBufferBeginInfo *begin_info
+);
+/* vkEndCommandBuffer, captured */
+extern VkResult vk_capture_cmd_end(VkCommandBuffer cmd);
+/* vkCmdPipelineBarrier, captured */
+extern void vk_capture_cmd_pipeline_barrier(
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags src_stages,
+    VkPipelineStageFlags dst_stages,
+    VkDependencyFlags dependency_flags,
+    uint32_t memory_count,
+    const VkMemoryBarrier *memory_barriers,
+    uint32_t buffer_count,
+    const VkBufferMemoryBarrier *buffer_barriers,
+    uint32_t image_count,
+    const VkImageMemoryBarrier *image_barriers
+);
+/* vkCmdCopyBuffer, captured */
+extern void vk_capture_cmd_copy_buffer(
+    VkCommandBuffer cmd,
+    VkBuffer src,
+    VkBuffer dst,
+    uint32_t region_count,
+    const VkBufferCopy *regions
+);
+
+#endif /* VK_CAPTURE_H */
@@ -22,6 +22,10 @@ typedef struct {
   uint32_t transfer_queues;
   float *transfer_queue_priorities;
   VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceVulkan12Features features12;
+  VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library;
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5;
 } vk_dev_builder_t;
 /* Vulkan device */
 typedef struct {
@@ -34,6 +38,9 @@ typedef struct {
   uint32_t compute_queue_count;
   VkQueue *transfer_queues;
   uint32_t transfer_queue_count;
+  const char **extensions;
+  uint32_t extension_count;
+  struct vk_dev_cache_s *cache;  /* Shared samplers and layouts */
 } vk_dev_t;
 
 /* Create a Vulkan device builder */
@@ -73,12 +80,27 @@ extern void vk_dev_builder_add_features(
     vk_dev_builder_t *builder,
     VkPhysicalDeviceFeatures features
 );
+/* Add Vulkan 1.2 device features */
+extern void vk_dev_builder_add_features12(
+    vk_dev_builder_t *builder,
+    VkPhysicalDeviceVulkan12Features features
+);
+/* Enable VK_KHR_synchronization2 (vkQueueSubmit2KHR and friends) */
+extern void vk_dev_builder_add_synchronization2(vk_dev_builder_t *builder);
+/* Enable VK_EXT_graphics_pipeline_library (and VK_KHR_pipeline_library) */
+extern void vk_dev_builder_add_graphics_pipeline_library(
+    vk_dev_builder_t *builder
+);
+/* Enable VK_KHR_maintenance5 (shader code inlined into pipeline stages) */
+extern void vk_dev_builder_add_maintenance5(vk_dev_builder_t *builder);
 /* Create a Vulkan device (and free builder) */
 extern vk_dev_t vk_dev_create(
     vk_phys_dev_t *phys_dev,
     vk_phys_dev_info_t *phys_dev_info,
     vk_dev_builder_t *builder
 );
+/* Check if a Vulkan device extension was enabled */
+extern bool vk_dev_has_ext(const vk_dev_t *dev, const char *ext);
 /* Destroy a Vulkan device */
 extern void vk_dev_destroy(vk_dev_t *dev);
 
@@ -0,0 +1,124 @@
+/* Include guard */
+#if !defined(VK_DEV_CACHE_H)
+#define VK_DEV_CACHE_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Deduplicating caches for samplers, descriptor set layouts, pipeline
+ * layouts and shader modules, owned by the device (vk_dev_t.cache).
+ *
+ * A create info is reduced to a canonical key (fields that don't affect the
+ * object are normalized, bindings and push constant ranges sorted) and equal
+ * keys share one object, so object counts stay flat however many materials
+ * ask for the same thing. Lookups of existing objects take no locks; misses
+ * take one of several shard locks while the object is created. Every lookup
+ * adds a reference, dropped again with the matching release.
+ *
+ * Unreferenced objects stay cached until vk_dev_cache_trim, which must not
+ * overlap any other use of the cache. Cached pipeline layouts reference the
+ * cached set layouts they use, and cached set layouts their immutable
+ * samplers, so those are kept alive as long as needed.
+ *
+ * Only the pNext structures the key understands are accepted:
+ * VkSamplerReductionModeCreateInfo and
+ * VkDescriptorSetLayoutBindingFlagsCreateInfo.
+ */
+
+/* Number of independently locked shards (power of two) */
+#define VK_DEV_CACHE_SHARDS 16u
+
+/* Types */
+/* Cached object kinds */
+typedef enum {
+  VK_DEV_CACHE_SAMPLER,
+  VK_DEV_CACHE_SET_LAYOUT,
+  VK_DEV_CACHE_PIPELINE_LAYOUT,
+  VK_DEV_CACHE_SHADER_MODULE,
+  VK_DEV_CACHE_KIND_COUNT
+} vk_dev_cache_kind_t;
+/* Cached object */
+typedef struct vk_dev_cache_entry_s {
+  uint64_t hash;
+  uint64_t handle;                     /* Handle bits */
+  vk_dev_cache_kind_t kind;
+  atomic_uint refs;
+  uint64_t *dependencies;              /* Cached handles referenced */
+  uint32_t dependency_count;
+  uint32_t key_size;                   /* Words */
+  uint32_t *key;
+} vk_dev_cache_entry_t;
+/* Open addressed table of entries */
+typedef struct vk_dev_cache_table_s {
+  struct vk_dev_cache_table_s *retired;  /* Older table, freed on trim */
+  uint32_t capacity;                     /* Power of two */
+  _Atomic(vk_dev_cache_entry_t *) *slots;
+} vk_dev_cache_table_t;
+/* Cache shard */
+typedef struct {
+  _Alignas(64) _Atomic(vk_dev_cache_table_t *) table;  /* Read lock free */
+  pthread_mutex_t mutex;          /* Held to insert into table */
+  uint32_t count;
+  pthread_mutex_t handle_mutex;   /* Held for the handle map */
+  vk_dev_cache_entry_t **handles; /* Entries by handle (open addressed) */
+  uint32_t handle_count, handle_capacity;
+} vk_dev_cache_shard_t;
+/* Device object cache */
+typedef struct vk_dev_cache_s {
+  vk_dev_cache_shard_t shards[VK_DEV_CACHE_SHARDS];
+  atomic_uint counts[VK_DEV_CACHE_KIND_COUNT];
+  uint32_t max_samplers;
+} vk_dev_cache_t;
+
+/* Create a device object cache */
+extern vk_dev_cache_t *vk_dev_cache_create(
+    const vk_phys_dev_info_t *phys_dev_info
+);
+/* Get a cached sampler (referenced until released) */
+extern VkSampler vk_dev_cache_sampler(
+    vk_dev_t *dev,
+    const VkSamplerCreateInfo *info
+);
+/* Get a cached descriptor set layout (referenced until released) */
+extern VkDescriptorSetLayout vk_dev_cache_set_layout(
+    vk_dev_t *dev,
+    const VkDescriptorSetLayoutCreateInfo *info
+);
+/* Get a cached pipeline layout (referenced until released) */
+extern VkPipelineLayout vk_dev_cache_pipeline_layout(
+    vk_dev_t *dev,
+    const VkPipelineLayoutCreateInfo *info
+);
+/* Get a cached shader module (keyed by a hash of the code) */
+extern VkShaderModule vk_dev_cache_shader_module(
+    vk_dev_t *dev,
+    const VkShaderModuleCreateInfo *info
+);
+/* Release a cached sampler */
+extern void vk_dev_cache_release_sampler(vk_dev_t *dev, VkSampler sampler);
+/* Release a cached descriptor set layout */
+extern void vk_dev_cache_release_set_layout(
+    vk_dev_t *dev,
+    VkDescriptorSetLayout layout
+);
+/* Release a cached pipeline layout */
+extern void vk_dev_cache_release_pipeline_layout(
+    vk_dev_t *dev,
+    VkPipelineLayout layout
+);
+/* Release a cached shader module */
+extern void vk_dev_cache_release_shader_module(
+    vk_dev_t *dev,
+    VkShaderModule module
+);
+/* Destroy unreferenced objects (no other use of the cache may overlap) */
+extern void vk_dev_cache_trim(vk_dev_t *dev);
+/* Destroy a device object cache and every object in it */
+extern void vk_dev_cache_destroy(vk_dev_cache_t *cache, VkDevice device);
+
+#endif /* VK_DEV_CACHE_H */
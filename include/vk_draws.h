@@ -0,0 +1,146 @@
+/* Include guard */
+#if !defined(VK_DRAWS_H)
+#define VK_DRAWS_H
+
+/* Includes */
+#include <base.h>
+#include <jobs.h>
+#include <radix_sort.h>
+#include <stdatomic.h>
+
+/*
+ * Draw packets, sorted by state and merged into instanced draws.
+ *
+ * Pipelines, materials (a descriptor set) and meshes (vertex and index
+ * buffer ranges) are registered once and named by small ids. Each frame,
+ * every visible instance pushes a packet (from any thread) with a 64 bit
+ * sort key:
+ *   pass | pipeline | material | mesh | depth       (front to back passes)
+ *   pass | far to near depth | pipeline | material | mesh  (back to front)
+ * vk_draws_sort orders the keys with a parallel radix sort, writes the
+ * packets' instance ids in draw order to vk_draws_t.instances, and merges
+ * runs with the same pass, pipeline, material and mesh into one instanced
+ * draw whose firstInstance is the run's start. The caller uploads
+ * instances for the shaders to read at gl_InstanceIndex, then
+ * vk_draws_record records a pass's draws, binding state only where it
+ * changes. Materials are bound at set VK_DRAWS_MATERIAL_SET, leaving the
+ * sets below it to the caller.
+ *
+ * vk_draws_sort also counts the state changes, and draws, that recording
+ * each packet in the order it was pushed would have taken, and those the
+ * sorted, merged draws take, and reports both to telemetry.
+ */
+
+/* Bits of the sort key per field */
+#define VK_DRAWS_PASS_BITS 6
+#define VK_DRAWS_PIPELINE_BITS 10
+#define VK_DRAWS_MATERIAL_BITS 14
+#define VK_DRAWS_MESH_BITS 16
+#define VK_DRAWS_DEPTH_BITS 18
+/* Most passes */
+#define VK_DRAWS_MAX_PASSES (1u << VK_DRAWS_PASS_BITS)
+/* Descriptor set materials are bound at */
+#define VK_DRAWS_MATERIAL_SET 1
+
+/* Types */
+/* Pipeline */
+typedef struct {
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+} vk_draws_pipeline_t;
+/* Mesh */
+typedef struct {
+  VkBuffer vertex_buffer;
+  VkDeviceSize vertex_buffer_offset;
+  VkBuffer index_buffer;
+  VkDeviceSize index_buffer_offset;
+  VkIndexType index_type;
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+} vk_draws_mesh_t;
+/* Draw packet */
+typedef struct {
+  uint32_t pass;
+  uint32_t pipeline;
+  uint32_t material;
+  uint32_t mesh;
+  uint32_t instance;
+} vk_draws_packet_t;
+/* Instanced draw */
+typedef struct {
+  uint32_t pass;
+  uint32_t pipeline;
+  uint32_t material;
+  uint32_t mesh;
+  uint32_t first_instance;        /* Into vk_draws_t.instances */
+  uint32_t instance_count;
+} vk_draws_batch_t;
+/* State changes and draws of a frame */
+typedef struct {
+  uint32_t draws;
+  uint32_t pipelines;
+  uint32_t descriptor_sets;
+  uint32_t vertex_buffers;
+  uint32_t index_buffers;
+} vk_draws_stats_t;
+/* Draw packets */
+typedef struct {
+  uint32_t max_packets;
+  vk_draws_packet_t *packets;
+  atomic_uint packet_count;
+  radix_item_t *keys;
+  radix_item_t *scratch;
+  uint32_t *instances;            /* Instance ids in draw order */
+  vk_draws_batch_t *batches;
+  uint32_t batch_count;
+  uint32_t pass_first[VK_DRAWS_MAX_PASSES + 1];  /* First batch per pass */
+  bool back_to_front[VK_DRAWS_MAX_PASSES];
+  uint32_t pass_count;
+  vk_draws_pipeline_t *pipelines;
+  uint32_t pipeline_count;
+  VkDescriptorSet *materials;
+  uint32_t material_count;
+  vk_draws_mesh_t *meshes;
+  uint32_t mesh_count;
+  vk_draws_stats_t unsorted;      /* Recording packets as pushed */
+  vk_draws_stats_t sorted;        /* Recording the batches */
+} vk_draws_t;
+
+/* Create draw packets, with room for some per frame */
+extern void vk_draws_create(vk_draws_t *draws, uint32_t max_packets);
+/* Add a pass, returning its id (passes record in any order) */
+extern uint32_t vk_draws_add_pass(vk_draws_t *draws, bool back_to_front);
+/* Add a pipeline, returning its id */
+extern uint32_t vk_draws_add_pipeline(
+    vk_draws_t *draws,
+    VkPipeline pipeline,
+    VkPipelineLayout layout
+);
+/* Add a material, returning its id */
+extern uint32_t vk_draws_add_material(vk_draws_t *draws, VkDescriptorSet set);
+/* Add a mesh, returning its id */
+extern uint32_t vk_draws_add_mesh(
+    vk_draws_t *draws,
+    const vk_draws_mesh_t *mesh
+);
+/* Forget the last frame's packets */
+extern void vk_draws_begin(vk_draws_t *draws);
+/* Push a packet (depth from 0 near to 1 far; thread safe) */
+extern void vk_draws_push(
+    vk_draws_t *draws,
+    const vk_draws_packet_t *packet,
+    float depth
+);
+/* Sort and merge the packets into batches (jobs may be NULL) */
+extern void vk_draws_sort(vk_draws_t *draws, jobs_t *jobs);
+/* Record a pass's batches */
+extern void vk_draws_record(
+    const vk_draws_t *draws,
+    VkCommandBuffer cmd,
+    uint32_t pass
+);
+/* Destroy draw packets */
+extern void vk_draws_destroy(vk_draws_t *draws);
+
+#endif /* VK_DRAWS_H */
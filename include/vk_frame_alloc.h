@@ -0,0 +1,68 @@
+/* Include guard */
+#if !defined(VK_FRAME_ALLOC_H)
+#define VK_FRAME_ALLOC_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <stdatomic.h>
+
+/*
+ * Per-frame linear allocator for dynamic data (uniforms, vertices, indices).
+ *
+ * One persistently mapped buffer is split into a region per frame in flight.
+ * Allocations bump an atomic offset into the current frame's region, so any
+ * thread can allocate and write per-object data with no API calls; the whole
+ * region is reset when its frame comes round again. Every allocation is
+ * aligned for use as a dynamic uniform or storage buffer offset.
+ *
+ * Memory is device local and host visible (resizable BAR) when such a heap
+ * is large enough, otherwise plain host visible memory. If it isn't host
+ * coherent, vk_frame_alloc_flush makes the frame's writes visible with a
+ * single flush, which must happen before the frame is submitted. Running
+ * captures (vk_capture.h) snapshot the frame's data there too.
+ */
+
+/* Types */
+/* Frame allocation */
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  void *ptr;
+} vk_frame_alloc_range_t;
+/* Per-frame linear allocator */
+typedef struct {
+  vk_buf_t buffer;
+  VkDeviceSize frame_size;
+  VkDeviceSize alignment;
+  VkDeviceSize atom_size;
+  uint32_t frame_count;
+  uint32_t frame;
+  bool coherent;
+  _Alignas(64) atomic_uint_fast64_t head;  /* Bytes used in the frame */
+} vk_frame_alloc_t;
+
+/* Create a per-frame allocator with frame_size bytes per frame */
+extern void vk_frame_alloc_create(
+    vk_frame_alloc_t *alloc,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize frame_size,
+    uint32_t frame_count
+);
+/* Start allocating from a frame's region (once the GPU is done with it) */
+extern void vk_frame_alloc_begin(vk_frame_alloc_t *alloc, uint32_t frame);
+/* Allocate from the current frame (thread safe, false if the frame is full) */
+extern bool vk_frame_alloc(
+    vk_frame_alloc_t *alloc,
+    VkDeviceSize size,
+    vk_frame_alloc_range_t *range
+);
+/* Make the current frame's writes visible to the device */
+extern void vk_frame_alloc_flush(vk_frame_alloc_t *alloc, vk_dev_t *dev);
+/* Destroy a per-frame allocator */
+extern void vk_frame_alloc_destroy(vk_frame_alloc_t *alloc, vk_dev_t *dev);
+
+#endif /* VK_FRAME_ALLOC_H */
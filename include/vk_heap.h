@@ -0,0 +1,166 @@
+/* Include guard */
+#if !defined(VK_HEAP_H)
+#define VK_HEAP_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_sync.h>
+#include <vk_submit.h>
+
+/*
+ * Buffer sub-allocator with incremental defragmentation.
+ *
+ * Memory comes in blocks, each one VkDeviceMemory bound to a single buffer
+ * spanning it, and allocations are ranges of a block's buffer found first
+ * fit in its free list. Allocations are named by ids that stay valid when
+ * they move; get their current buffer, offset and (with
+ * VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) device address from the
+ * accessors rather than keeping them.
+ *
+ * Freed ranges only return to the free lists once no frame in flight can
+ * reference them, and blocks left empty are given back to the device.
+ *
+ * vk_heap_defrag moves up to a number of bytes per call, from the emptiest
+ * blocks into holes in fuller ones (or lower down their own block), with
+ * vkCmdCopyBuffer on the queue vk_submit gives transfer work to, after a
+ * sync point (usually the last frame submitted) so that everything written
+ * before it is moved with the data. Only allocations made with a moved
+ * callback are moved, and they must not be written while vk_heap_moving
+ * says so. Once the copies are seen complete each allocation switches to
+ * its new range, its callback runs (to rewrite descriptors or device
+ * addresses) and the old range is freed as above.
+ * Copies are enqueued, reaching the driver with the next vk_submit_flush.
+ * Fragmentation (1 - largest free range / free bytes) is reported as
+ * telemetry before and after every batch of moves.
+ *
+ * Not thread safe: use it from the thread that renders.
+ */
+
+/* Invalid allocation id */
+#define VK_HEAP_INVALID UINT32_MAX
+/* Most blocks in a heap */
+#define VK_HEAP_MAX_BLOCKS 64
+/* Most allocations moved per defragmentation batch */
+#define VK_HEAP_MAX_MOVES 256
+/* Fragmentation below which defragmentation does nothing */
+#define VK_HEAP_DEFRAG_THRESHOLD 0.05
+/* Smallest allocation alignment */
+#define VK_HEAP_MIN_ALIGNMENT 16u
+
+/* Types */
+/* Called once an allocation has moved (the accessors give its new range) */
+typedef void (*vk_heap_moved_fn_t)(void *user, uint32_t id);
+/* Free range of a block */
+typedef struct {
+  VkDeviceSize offset;
+  VkDeviceSize size;
+} vk_heap_range_t;
+/* Block of device memory with one buffer bound over all of it */
+typedef struct {
+  VkDeviceMemory memory;          /* VK_NULL_HANDLE if the slot is unused */
+  VkBuffer buffer;
+  VkDeviceAddress address;
+  VkDeviceSize size;
+  VkDeviceSize used;              /* Allocated, retired or reserved bytes */
+  vk_heap_range_t *free_ranges;   /* Sorted by offset, never adjacent */
+  uint32_t free_count;
+  uint32_t free_capacity;
+} vk_heap_block_t;
+/* Allocation */
+typedef struct {
+  vk_heap_moved_fn_t moved;       /* NULL if it never moves */
+  void *user;
+  uint32_t block;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  VkDeviceSize alignment;
+  bool active;
+  bool moving;
+} vk_heap_allocation_t;
+/* Range waiting for the frames referencing it to finish */
+typedef struct {
+  uint32_t block;
+  vk_heap_range_t range;
+  uint64_t retire_frame;
+} vk_heap_retired_t;
+/* Pending move of an allocation */
+typedef struct {
+  uint32_t id;
+  uint32_t block;
+  VkDeviceSize offset;
+} vk_heap_move_t;
+/* Buffer sub-allocator */
+typedef struct {
+  vk_dev_t *dev;
+  const vk_phys_dev_info_t *phys_dev_info;
+  vk_submit_t *submit;
+  VkBufferUsageFlags usage;
+  VkMemoryPropertyFlags required;
+  uint32_t memory_type;
+  VkDeviceSize block_size;
+  uint32_t families[2];
+  uint32_t family_count;
+  uint32_t frames_in_flight;
+  uint64_t frame_counter;
+  vk_heap_block_t blocks[VK_HEAP_MAX_BLOCKS];
+  vk_heap_allocation_t *allocations;
+  uint32_t allocation_count;
+  uint32_t allocation_capacity;
+  uint32_t *free_ids;
+  uint32_t free_id_count;
+  vk_heap_retired_t *retired;
+  uint32_t retired_count;
+  uint32_t retired_capacity;
+  VkCommandPool command_pool;
+  VkCommandBuffer cmd;
+  vk_heap_move_t moves[VK_HEAP_MAX_MOVES];
+  uint32_t move_count;            /* Moves in the batch being copied */
+  vk_sync_point_t copied;
+  double defrag_start;
+} vk_heap_t;
+
+/* Create a sub-allocator of buffers with a usage, in blocks of block_size */
+extern void vk_heap_create(
+    vk_heap_t *heap,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_submit_t *submit,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required,
+    VkDeviceSize block_size,
+    uint32_t frames_in_flight
+);
+/* Allocate a range (VK_HEAP_INVALID on failure, moved may be NULL) */
+extern uint32_t vk_heap_alloc(
+    vk_heap_t *heap,
+    VkDeviceSize size,
+    VkDeviceSize alignment,
+    vk_heap_moved_fn_t moved,
+    void *user
+);
+/* Free a range once no frame in flight can reference it */
+extern void vk_heap_free(vk_heap_t *heap, uint32_t id);
+/* Get the buffer an allocation is in */
+extern VkBuffer vk_heap_buffer(const vk_heap_t *heap, uint32_t id);
+/* Get an allocation's offset in its buffer */
+extern VkDeviceSize vk_heap_offset(const vk_heap_t *heap, uint32_t id);
+/* Get an allocation's device address (0 without device address usage) */
+extern VkDeviceAddress vk_heap_address(const vk_heap_t *heap, uint32_t id);
+/* Check if an allocation is being moved (and so must not be written) */
+extern bool vk_heap_moving(const vk_heap_t *heap, uint32_t id);
+/* Get the fragmentation of the free space (0 when it is one range) */
+extern double vk_heap_fragmentation(const vk_heap_t *heap);
+/* Begin a frame: free ranges and blocks no frame in flight can reference */
+extern void vk_heap_begin_frame(vk_heap_t *heap);
+/* Finish moves that are done, then start moving up to max_bytes more */
+extern void vk_heap_defrag(
+    vk_heap_t *heap,
+    VkDeviceSize max_bytes,
+    vk_sync_point_t after
+);
+/* Destroy a sub-allocator (waits for moves) */
+extern void vk_heap_destroy(vk_heap_t *heap);
+
+#endif /* VK_HEAP_H */
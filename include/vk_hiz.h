@@ -0,0 +1,179 @@
+/* Include guard */
+#if !defined(VK_HIZ_H)
+#define VK_HIZ_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+
+/*
+ * Two phase Hi-Z occlusion culling.
+ *
+ * Per frame:
+ *   vk_hiz_begin_frame           - report the statistics of the last use of
+ *                                  this frame slot
+ *   vk_hiz_cmd_cull_early        - frustum cull, then occlusion cull against
+ *                                  the pyramid of the previous frame
+ *   vk_hiz_cmd_draw (early)      - main pass
+ *   vk_hiz_cmd_build_pyramid     - downsample this frame's depth
+ *   vk_hiz_cmd_cull_late         - re-test the objects the early phase
+ *                                  rejected against the new pyramid
+ *   vk_hiz_cmd_draw (late)       - draw the disoccluded objects
+ *
+ * Conventions (same as the cull shader): view space is +Z forward, the
+ * projection is reverse-Z with an infinite far plane and clip space Y points
+ * up (negative viewport height). The device needs drawIndirectCount,
+ * samplerFilterMinmax and shaderStorageImageArrayDynamicIndexing enabled,
+ * and the depth buffer must be readable by compute shaders in the layout
+ * given to vk_hiz_set_depth when the pyramid is built.
+ */
+
+/* Maximum depth pyramid mip count (4096x4096 pyramid) */
+#define VK_HIZ_MAX_MIPS 13
+
+/* Types */
+/* Hi-Z culling phases */
+typedef enum {
+  VK_HIZ_PHASE_EARLY,
+  VK_HIZ_PHASE_LATE
+} vk_hiz_phase_t;
+/* Hi-Z occlusion culler builder */
+typedef struct {
+  VkExtent2D extent;
+  uint32_t max_instances;
+  uint32_t frames_in_flight;
+  const char *shader_dir;
+} vk_hiz_builder_t;
+/* Instance bounds and draw arguments (matches hiz_cull.comp) */
+typedef struct {
+  float center[3];
+  float radius;
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  uint32_t padding;
+} vk_hiz_instance_t;
+/* Camera used for culling */
+typedef struct {
+  float view[16];
+  float p00;
+  float p11;
+  float znear;
+} vk_hiz_camera_t;
+/* Culling statistics of one frame */
+typedef struct {
+  uint32_t instance_count;
+  uint32_t early_drawn;
+  uint32_t late_drawn;
+  uint32_t frustum_culled;
+  uint32_t occlusion_culled;
+  double pyramid_build_ms;
+} vk_hiz_stats_t;
+/* Hi-Z occlusion culler */
+typedef struct {
+  VkImage pyramid;
+  VkDeviceMemory pyramid_memory;
+  VkImageView pyramid_view;
+  VkImageView mip_views[VK_HIZ_MAX_MIPS];
+  uint32_t pyramid_size;
+  uint32_t mip_count;
+  bool pyramid_initialized;
+  VkSampler reduce_sampler;
+  VkDescriptorSetLayout build_set_layout;
+  VkDescriptorSetLayout cull_set_layout;
+  VkDescriptorPool descriptor_pool;
+  VkDescriptorSet build_set;
+  VkDescriptorSet cull_set;
+  VkPipelineLayout build_layout;
+  VkPipelineLayout cull_layout;
+  VkPipeline build_pipeline;
+  VkPipeline cull_pipeline;
+  VkQueryPool timestamps;
+  float timestamp_period;
+  vk_buf_t params;
+  vk_buf_t instances;
+  vk_buf_t visibility;
+  vk_buf_t draws;
+  vk_buf_t counts;
+  vk_buf_t spd_counter;
+  vk_buf_t readback;
+  uint32_t max_instances;
+  uint32_t instance_count;
+  uint32_t frames_in_flight;
+  uint32_t frame;
+  uint32_t pending_frames;
+  vk_hiz_camera_t last_camera;
+  bool has_last_camera;
+  vk_hiz_stats_t stats;
+} vk_hiz_t;
+
+/* Create a Hi-Z occlusion culler builder */
+extern vk_hiz_builder_t vk_hiz_builder(void);
+/* Set the depth buffer extent */
+extern void vk_hiz_builder_set_extent(
+    vk_hiz_builder_t *builder,
+    uint32_t width,
+    uint32_t height
+);
+/* Set the maximum number of culled instances */
+extern void vk_hiz_builder_set_max_instances(
+    vk_hiz_builder_t *builder,
+    uint32_t max_instances
+);
+/* Set the number of frames in flight */
+extern void vk_hiz_builder_set_frames_in_flight(
+    vk_hiz_builder_t *builder,
+    uint32_t frames_in_flight
+);
+/* Set the directory compiled shaders are loaded from */
+extern void vk_hiz_builder_set_shader_dir(
+    vk_hiz_builder_t *builder,
+    const char *shader_dir
+);
+/* Create a Hi-Z occlusion culler (and free builder) */
+extern vk_hiz_t vk_hiz_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_hiz_builder_t *builder
+);
+/* Set the depth buffer the pyramid is built from (GPU must be idle) */
+extern void vk_hiz_set_depth(
+    vk_hiz_t *hiz,
+    vk_dev_t *dev,
+    VkImageView depth_view,
+    VkImageLayout depth_layout
+);
+/* Set the culled instances (GPU must be idle) */
+extern void vk_hiz_set_instances(
+    vk_hiz_t *hiz,
+    const vk_hiz_instance_t *instances,
+    uint32_t count
+);
+/* Begin a frame, reporting the statistics of the slot's previous frame */
+extern void vk_hiz_begin_frame(
+    vk_hiz_t *hiz,
+    vk_dev_t *dev,
+    uint32_t frame_index
+);
+/* Record the early culling phase */
+extern void vk_hiz_cmd_cull_early(
+    vk_hiz_t *hiz,
+    VkCommandBuffer cmd,
+    const vk_hiz_camera_t *camera
+);
+/* Record the depth pyramid build */
+extern void vk_hiz_cmd_build_pyramid(vk_hiz_t *hiz, VkCommandBuffer cmd);
+/* Record the late culling phase */
+extern void vk_hiz_cmd_cull_late(vk_hiz_t *hiz, VkCommandBuffer cmd);
+/* Record the indirect draws of a phase (pipeline and buffers bound) */
+extern void vk_hiz_cmd_draw(
+    vk_hiz_t *hiz,
+    VkCommandBuffer cmd,
+    vk_hiz_phase_t phase
+);
+/* Destroy a Hi-Z occlusion culler */
+extern void vk_hiz_destroy(vk_hiz_t *hiz, vk_dev_t *dev);
+
+#endif /* VK_HIZ_H */
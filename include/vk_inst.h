@@ -4,11 +4,13 @@
 
 /* Includes */
 #include <base.h>
+#include <vk_messages.h>
 
 /* Types */
 /* Vulkan instance builder */
 typedef struct {
   bool use_messenger;
+  bool best_practices;
   const char **extensions;
   uint32_t extension_count;
   const char **layers;
@@ -21,6 +23,7 @@ typedef struct {
   VkInstance instance;
   VkDebugUtilsMessengerEXT debug_messenger;
   bool use_messenger;
+  vk_messages_t *messages;  /* Messenger messages (NULL without one) */
 } vk_inst_t;
 
 /* Create a Vulkan instance builder */
@@ -44,6 +47,8 @@ extern void vk_inst_builder_add_layer(
 extern void vk_inst_builder_use_messenger(
     vk_inst_builder_t *builder
 );
+/* Enable best practices validation (needs the validation layer) */
+extern void vk_inst_builder_use_best_practices(vk_inst_builder_t *builder);
 /* Set application name */
 extern void vk_inst_builder_set_app_name(
     vk_inst_builder_t *builder,
@@ -57,7 +62,7 @@ extern void vk_inst_builder_set_app_version(
 
 /* Create a Vulkan instance (and free builder) */
 extern vk_inst_t vk_inst_create(vk_inst_builder_t *builder);
-/* Destroy a Vulkan instance */
+/* Destroy a Vulkan instance (logging a report of messenger messages) */
 extern void vk_inst_destroy(vk_inst_t *inst);
 
 #endif /* VK_INST_H */
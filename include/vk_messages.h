@@ -0,0 +1,89 @@
+/* Include guard */
+#if !defined(VK_MESSAGES_H)
+#define VK_MESSAGES_H
+
+/* Includes */
+#include <base.h>
+#include <pthread.h>
+
+/*
+ * Aggregator for debug messenger messages.
+ *
+ * Messages are deduplicated by messageIdNumber (or, for messages without
+ * one, by their id name or text) and counted. The first occurrence keeps
+ * the message text, the objects it names, the innermost command buffer or
+ * queue label and the call stack it was reported from, which for messages
+ * the validation layer reports during a Vulkan call leads back to the
+ * caller.
+ *
+ * vk_messages_report logs the messages of some types, most frequent first,
+ * so performance advice (from best practices validation, see
+ * vk_inst_builder_use_best_practices) can be acted on in order of impact
+ * rather than read off a scrolling terminal. Call sites are symbolized with
+ * backtrace_symbols and frames in the loader and layers are left out; link
+ * with -rdynamic for function names, or resolve the offsets with addr2line.
+ *
+ * Thread safe: the messenger may report from any thread.
+ */
+
+/* Most objects kept per message */
+#define VK_MESSAGES_MAX_OBJECTS 4
+/* Most call stack frames kept per message */
+#define VK_MESSAGES_MAX_FRAMES 32
+/* Longest id name, object name or label kept (including terminator) */
+#define VK_MESSAGES_MAX_NAME 96
+/* Messages logged by the report at shutdown */
+#define VK_MESSAGES_REPORT_LIMIT 20
+
+/* Types */
+/* Object named by a message */
+typedef struct {
+  VkObjectType type;
+  uint64_t handle;
+  char name[VK_MESSAGES_MAX_NAME];
+} vk_messages_object_t;
+/* Distinct message */
+typedef struct {
+  uint64_t key;
+  int32_t id;
+  char id_name[VK_MESSAGES_MAX_NAME];
+  VkDebugUtilsMessageSeverityFlagBitsEXT severity;  /* Highest seen */
+  VkDebugUtilsMessageTypeFlagsEXT types;            /* Every type seen */
+  uint64_t count;
+  char *message;                                    /* First text */
+  char label[VK_MESSAGES_MAX_NAME];                 /* "" if none */
+  vk_messages_object_t objects[VK_MESSAGES_MAX_OBJECTS];
+  uint32_t object_count;
+  void *frames[VK_MESSAGES_MAX_FRAMES];
+  uint32_t frame_count;
+} vk_messages_entry_t;
+/* Message aggregator */
+typedef struct vk_messages_s {
+  pthread_mutex_t mutex;
+  vk_messages_entry_t *entries;
+  uint32_t entry_count;
+  uint32_t entry_capacity;
+  uint64_t total;
+} vk_messages_t;
+
+/* Create a message aggregator */
+extern vk_messages_t *vk_messages_create(void);
+/* Record a message (returns true the first time it is seen) */
+extern bool vk_messages_record(
+    vk_messages_t *messages,
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT *data
+);
+/* Log messages of some types, most frequent first (limit 0: all) */
+extern void vk_messages_report(
+    vk_messages_t *messages,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    uint32_t limit
+);
+/* Forget every message recorded */
+extern void vk_messages_reset(vk_messages_t *messages);
+/* Destroy a message aggregator */
+extern void vk_messages_destroy(vk_messages_t *messages);
+
+#endif /* VK_MESSAGES_H */
@@ -15,6 +15,10 @@ typedef VkPhysicalDevice vk_phys_dev_t;
 typedef struct {
   VkPhysicalDeviceProperties properties;
   VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceVulkan12Features features12;
+  VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library;
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5;
   VkPhysicalDeviceMemoryProperties memory_properties;
   VkSurfaceCapabilitiesKHR surface_capabilities;
   struct {
@@ -41,7 +45,7 @@ typedef struct {
   uint32_t present_modes_count;
 } vk_phys_dev_info_t;
 
-/* Get a physical device's information */
+/* Get a physical device's information (surf may be NULL when headless) */
 extern void vk_phys_dev_get_info(
     VkPhysicalDevice device,
     vk_phys_dev_info_t *info,
@@ -49,11 +53,25 @@ extern void vk_phys_dev_get_info(
 );
 /* Free a physical device information structure */
 extern void vk_phys_dev_info_free(vk_phys_dev_info_t *info);
-/* Choose a physical device based on a scoring callback */
+/* Choose a physical device based on a scoring callback (surf may be NULL) */
 extern vk_phys_dev_t vk_phys_dev_choose(
     uint32_t (*score)(const vk_phys_dev_info_t *info),
     const vk_inst_t *inst,
     const vk_surf_t *surf
 );
+/* Score a device by type, memory, queues, features and limits (0: unusable) */
+extern uint32_t vk_phys_dev_score(const vk_phys_dev_info_t *info);
+/* Check if a physical device supports an extension */
+extern bool vk_phys_dev_supports_ext(
+    const vk_phys_dev_info_t *info,
+    const char *ext
+);
+/* Find a memory type (UINT32_MAX if none, preferred flags are optional) */
+extern uint32_t vk_phys_dev_find_memory_type(
+    const vk_phys_dev_info_t *info,
+    uint32_t type_bits,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+);
 
 #endif /* VK_PHYS_DEV_H */
@@ -0,0 +1,69 @@
+/* Include guard */
+#if !defined(VK_PHYS_DEV_PROBE_H)
+#define VK_PHYS_DEV_PROBE_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_inst.h>
+#include <vk_surf.h>
+
+/*
+ * Calibration probe for choosing the fastest of several physical devices.
+ *
+ * vk_phys_dev_probe creates a short lived device with one graphics queue
+ * and times copies between two device local buffers and a dispatch of
+ * probe.comp.spv (dependent multiply-adds) from a shader directory. Each is
+ * run once to warm up and once timed, with timestamps when the device has
+ * them on all graphics queues and host time around the submission if not.
+ * Without the shader only the copy is timed.
+ *
+ * Results are cached in a file keyed by device UUID and driver version, so
+ * a host pays for the probe once per device and driver.
+ *
+ * vk_phys_dev_choose_fastest scores devices with a callback as
+ * vk_phys_dev_choose does, and when more than one scores above zero ranks
+ * them by probe throughput, with the score only breaking ties. A software
+ * implementation next to a real GPU, or a slow discrete GPU next to a fast
+ * integrated one, is then ranked by what it measures rather than its type.
+ */
+
+/* Bump when the probe changes (older cache records are ignored) */
+#define VK_PHYS_DEV_PROBE_VERSION 1u
+/* Bytes per copy */
+#define VK_PHYS_DEV_PROBE_COPY_SIZE (64u * 1024u * 1024u)
+/* Copies timed */
+#define VK_PHYS_DEV_PROBE_COPIES 8u
+/* Workgroups dispatched (of 64 invocations) */
+#define VK_PHYS_DEV_PROBE_GROUPS 2048u
+/* Loop iterations per invocation */
+#define VK_PHYS_DEV_PROBE_ITERATIONS 2048u
+/* Rank points per GB/s of copy bandwidth (a GFLOP/s is one point) */
+#define VK_PHYS_DEV_PROBE_COPY_WEIGHT 10.0
+
+/* Types */
+/* Probe results */
+typedef struct {
+  float copy_gbps;                /* Device local copy bandwidth */
+  float compute_gflops;           /* 0 if the shader couldn't be loaded */
+  bool cached;                    /* Read from the cache, not measured */
+} vk_phys_dev_probe_t;
+
+/* Probe a device (shader_dir and cache_path may be NULL) */
+extern vk_phys_dev_probe_t vk_phys_dev_probe(
+    vk_phys_dev_t phys_dev,
+    const char *shader_dir,
+    const char *cache_path
+);
+/* Get a probe's rank (higher is faster) */
+extern double vk_phys_dev_probe_rank(const vk_phys_dev_probe_t *probe);
+/* Choose a device by score, probing when several are usable (surf optional) */
+extern vk_phys_dev_t vk_phys_dev_choose_fastest(
+    uint32_t (*score)(const vk_phys_dev_info_t *info),
+    const vk_inst_t *inst,
+    const vk_surf_t *surf,
+    const char *shader_dir,
+    const char *cache_path
+);
+
+#endif /* VK_PHYS_DEV_PROBE_H */
@@ -0,0 +1,44 @@
+/* Include guard */
+#if !defined(VK_PIPELINE_CACHE_H)
+#define VK_PIPELINE_CACHE_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+
+/*
+ * Pipeline cache persisted to disk. The file is read before the device
+ * exists (so it can overlap device creation), and only handed to the driver
+ * if its header matches the device.
+ */
+
+/* Types */
+/* Pipeline cache */
+typedef struct {
+  VkPipelineCache cache;
+  char *path;
+  void *data;
+  size_t size;
+} vk_pipeline_cache_t;
+
+/* Read a pipeline cache file (a missing file gives an empty cache) */
+extern void vk_pipeline_cache_read(
+    vk_pipeline_cache_t *cache,
+    const char *path
+);
+/* Create the Vulkan pipeline cache, seeded if the file matches the device */
+extern void vk_pipeline_cache_create(
+    vk_pipeline_cache_t *cache,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info
+);
+/* Write the pipeline cache back to its file */
+extern bool vk_pipeline_cache_write(vk_pipeline_cache_t *cache, vk_dev_t *dev);
+/* Destroy a pipeline cache */
+extern void vk_pipeline_cache_destroy(
+    vk_pipeline_cache_t *cache,
+    vk_dev_t *dev
+);
+
+#endif /* VK_PIPELINE_CACHE_H */
@@ -0,0 +1,136 @@
+/* Include guard */
+#if !defined(VK_PIPELINES_H)
+#define VK_PIPELINES_H
+
+/* Includes */
+#include <base.h>
+#include <vk_dev.h>
+#include <vk_shader.h>
+#include <jobs.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Asynchronous graphics pipeline compilation.
+ *
+ * Pipelines are requested by key: shader hashes, specialization constants,
+ * render state, layout and render pass. The first request for a key queues
+ * a compile job (against the shared VkPipelineCache) and returns at once;
+ * until the specialized variant is ready, the generic variant of the same
+ * key (no specialization constants, so the shaders' defaults) is returned
+ * instead, and if that isn't ready either, VK_NULL_HANDLE, meaning the draw
+ * should be skipped this frame. Nothing ever compiles on the calling thread.
+ *
+ * With VK_EXT_graphics_pipeline_library the four parts of a pipeline
+ * (vertex input, pre-rasterization shaders, fragment shader, fragment output)
+ * are compiled once as libraries and shared between keys. A new key then
+ * costs a fast link, and an optimized link replaces it once that's done.
+ *
+ * Keys are compared bytewise, so they must start from vk_pipeline_key_init.
+ * Shaders (see vk_shader.h) must outlive the compiles that use them, and
+ * viewport and scissor are dynamic state.
+ */
+
+/* Most shader stages in a pipeline */
+#define VK_PIPELINE_MAX_STAGES 4
+/* Most specialization constants in a key */
+#define VK_PIPELINE_MAX_SPEC 8
+/* Most color attachments, vertex bindings and vertex attributes */
+#define VK_PIPELINE_MAX_ATTACHMENTS 4
+#define VK_PIPELINE_MAX_VERTEX_BINDINGS 4
+#define VK_PIPELINE_MAX_VERTEX_ATTRIBUTES 8
+
+/* Types */
+/* Fixed function state */
+typedef struct {
+  uint32_t binding_count;
+  VkVertexInputBindingDescription bindings[VK_PIPELINE_MAX_VERTEX_BINDINGS];
+  uint32_t attribute_count;
+  VkVertexInputAttributeDescription
+    attributes[VK_PIPELINE_MAX_VERTEX_ATTRIBUTES];
+  VkPrimitiveTopology topology;
+  VkPolygonMode polygon_mode;
+  VkCullModeFlags cull_mode;
+  VkFrontFace front_face;
+  VkSampleCountFlagBits samples;
+  VkBool32 depth_test;
+  VkBool32 depth_write;
+  VkCompareOp depth_compare;
+  uint32_t attachment_count;
+  VkPipelineColorBlendAttachmentState blend[VK_PIPELINE_MAX_ATTACHMENTS];
+} vk_pipeline_state_t;
+/* 32 bit specialization constants (applied to every stage) */
+typedef struct {
+  uint32_t count;
+  uint32_t ids[VK_PIPELINE_MAX_SPEC];
+  uint32_t values[VK_PIPELINE_MAX_SPEC];
+} vk_pipeline_spec_t;
+/* Pipeline key */
+typedef struct {
+  VkPipelineLayout layout;
+  VkRenderPass render_pass;
+  uint32_t subpass;
+  uint32_t stage_count;
+  VkShaderStageFlagBits stages[VK_PIPELINE_MAX_STAGES];
+  uint64_t shader_hashes[VK_PIPELINE_MAX_STAGES];  /* Identify the SPIR-V */
+  vk_pipeline_state_t state;
+  vk_pipeline_spec_t spec;
+} vk_pipeline_key_t;
+/* Compiled pipeline or pipeline library */
+typedef struct vk_pipeline_entry_s {
+  vk_pipeline_key_t key;
+  uint64_t hash;
+  uint32_t part;                  /* Library part (0 for a pipeline) */
+  const vk_shader_t *shaders[VK_PIPELINE_MAX_STAGES];
+  atomic_int status;
+  _Atomic(VkPipeline) pipeline;
+  VkPipeline replaced;            /* Fast linked pipeline, kept until destroy */
+  job_t job;
+  struct vk_pipelines_s *pipelines;
+} vk_pipeline_entry_t;
+/* Open addressed table of entries */
+typedef struct {
+  vk_pipeline_entry_t **entries;
+  uint32_t count, capacity;
+} vk_pipeline_table_t;
+/* Asynchronous pipeline manager */
+typedef struct vk_pipelines_s {
+  vk_dev_t *dev;
+  VkPipelineCache cache;
+  jobs_t *jobs;
+  job_counter_t in_flight;
+  bool use_libraries;
+  pthread_mutex_t mutex;          /* Held for the pipeline table */
+  vk_pipeline_table_t table;
+  pthread_mutex_t library_mutex;  /* Held for the library table */
+  pthread_cond_t library_cond;    /* Broadcast when a library is done */
+  vk_pipeline_table_t libraries;
+} vk_pipelines_t;
+
+/* Start a key with everything zeroed */
+extern void vk_pipeline_key_init(vk_pipeline_key_t *key);
+/* Create a pipeline manager (cache may be VK_NULL_HANDLE) */
+extern void vk_pipelines_create(
+    vk_pipelines_t *pipelines,
+    vk_dev_t *dev,
+    VkPipelineCache cache,
+    jobs_t *jobs
+);
+/* Get the best pipeline ready for a key, queueing compiles as needed */
+extern VkPipeline vk_pipelines_get(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+);
+/* Queue a key's compile without using it yet */
+extern void vk_pipelines_prepare(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+);
+/* Wait for every queued compile (helping with jobs meanwhile) */
+extern void vk_pipelines_wait(vk_pipelines_t *pipelines);
+/* Destroy a pipeline manager and its pipelines (waiting for compiles) */
+extern void vk_pipelines_destroy(vk_pipelines_t *pipelines);
+
+#endif /* VK_PIPELINES_H */
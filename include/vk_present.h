@@ -0,0 +1,118 @@
+/* Include guard */
+#if !defined(VK_PRESENT_H)
+#define VK_PRESENT_H
+
+/* Includes */
+#include <base.h>
+#include <vk_surf.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_swapchain.h>
+#include <vk_submit.h>
+
+/*
+ * Presentation to several surfaces (views) from one device.
+ *
+ * Each view owns a swapchain and per frame acquire/present semaphores; the
+ * surface stays the caller's. Every frame acquires from each view
+ * independently, without blocking on any one of them unless none has an
+ * image ready, and then presents every acquired image with a single
+ * vkQueuePresentKHR. A view whose swapchain went out of date (or was
+ * resized) is rebuilt on its own at the next acquire, handing its old
+ * swapchain over so nothing waits for the device; the old one is destroyed
+ * once every frame slot has been reused.
+ *
+ * vk_present_acquire must be called after the frame slot's previous
+ * submission is known to be complete, as with the caller's other per frame
+ * resources.
+ */
+
+/* Most views */
+#define VK_PRESENT_MAX_VIEWS 8
+/* Most frames in flight */
+#define VK_PRESENT_MAX_FRAMES 4
+
+/* Types */
+/* View */
+typedef struct {
+  bool used;
+  void *user;                     /* Caller's window */
+  vk_surf_t surface;
+  vk_swapchain_t swapchain;
+  VkSurfaceFormatKHR format;
+  VkExtent2D extent;              /* Of the swapchain */
+  uint32_t width, height;         /* Requested (0 while minimized) */
+  bool out_of_date;
+  VkSemaphore image_available[VK_PRESENT_MAX_FRAMES];
+  VkSemaphore render_finished[VK_PRESENT_MAX_FRAMES];
+} vk_present_view_t;
+/* Acquired image */
+typedef struct {
+  uint32_t view;
+  uint32_t image_index;
+  VkImage image;
+  VkFormat format;
+  VkExtent2D extent;
+  VkSemaphore image_available;    /* Wait on before writing the image */
+  VkSemaphore render_finished;    /* Signal once the image is written */
+} vk_present_image_t;
+/* Swapchain waiting to be destroyed */
+typedef struct {
+  vk_swapchain_t swapchain;
+  uint64_t frame;                 /* Frame number it was retired at */
+} vk_present_retired_t;
+/* Presentation manager */
+typedef struct {
+  vk_dev_t *dev;
+  vk_phys_dev_t phys_dev;
+  uint32_t present_family;
+  uint32_t graphics_family;
+  uint32_t frames;
+  uint64_t frame_number;
+  vk_present_view_t views[VK_PRESENT_MAX_VIEWS];
+  vk_present_image_t images[VK_PRESENT_MAX_VIEWS];
+  uint32_t image_count;           /* Acquired this frame */
+  uint32_t frame;                 /* Slot acquired for */
+  vk_present_retired_t retired[VK_PRESENT_MAX_VIEWS * VK_PRESENT_MAX_FRAMES];
+  uint32_t retired_count;
+} vk_present_t;
+
+/* Create a presentation manager for frames frames in flight */
+extern void vk_present_create(
+    vk_present_t *present,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    uint32_t frames
+);
+/* Add a view of a surface (returns its index, or UINT32_MAX on failure) */
+extern uint32_t vk_present_add(
+    vk_present_t *present,
+    vk_surf_t surface,
+    uint32_t width,
+    uint32_t height,
+    void *user
+);
+/* Find the view of a caller's window (UINT32_MAX if none) */
+extern uint32_t vk_present_find(const vk_present_t *present, void *user);
+/* Resize a view (rebuilt at the next acquire, skipped while 0x0) */
+extern void vk_present_resize(
+    vk_present_t *present,
+    uint32_t view,
+    uint32_t width,
+    uint32_t height
+);
+/* Remove a view, waiting for the queues (the surface is left to the caller) */
+extern void vk_present_remove(
+    vk_present_t *present,
+    vk_submit_t *submit,
+    uint32_t view
+);
+/* Acquire an image from each view that has one (returns the count) */
+extern uint32_t vk_present_acquire(vk_present_t *present, uint32_t frame);
+/* Present every acquired image with one call (flushing submissions) */
+extern VkResult vk_present_submit(vk_present_t *present, vk_submit_t *submit);
+/* Destroy a presentation manager (the device must be idle) */
+extern void vk_present_destroy(vk_present_t *present);
+
+#endif /* VK_PRESENT_H */
@@ -0,0 +1,120 @@
+/* Include guard */
+#if !defined(VK_RESIDENCY_H)
+#define VK_RESIDENCY_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+
+/*
+ * Device memory residency manager.
+ *
+ * Each frame vk_residency_update polls the driver's per heap budget and
+ * usage (VK_EXT_memory_budget, when the device enabled it) and reports them
+ * as telemetry ("memory.heap<N>.usage_mb", "memory.heap<N>.budget_mb" and
+ * "memory.heap<N>.tracked_mb"). Without the extension the budget is
+ * estimated as a share of the heap and usage is what was registered here.
+ *
+ * Owners register resources with their size and memory type, and touch them
+ * on frames they are used. Resources registered with an evict callback are
+ * streamable: when a heap's usage passes VK_RESIDENCY_HIGH_WATER percent of
+ * its budget, the least recently used of them (not used this frame) are
+ * asked to leave the heap until usage is projected to fall below
+ * VK_RESIDENCY_LOW_WATER percent. An owner evicts by moving the data to host
+ * memory or dropping it (to be reloaded later), and reports the new size
+ * once the data is out; until then the promised bytes count as freed.
+ *
+ * vk_residency_room gives what can still be allocated from a memory type's
+ * heap below the high water mark, so owners can hold back allocations
+ * rather than have them fail or the OS page memory out.
+ *
+ * Not thread safe: use it from the thread that renders.
+ */
+
+/* Usage (percent of budget) that starts eviction */
+#define VK_RESIDENCY_HIGH_WATER 90u
+/* Usage (percent of budget) eviction stops at */
+#define VK_RESIDENCY_LOW_WATER 80u
+/* Share of a heap (percent) assumed available without VK_EXT_memory_budget */
+#define VK_RESIDENCY_HEAP_SHARE 80u
+/* Invalid resource id */
+#define VK_RESIDENCY_INVALID UINT32_MAX
+
+/* Types */
+/* Evict a resource (returns the bytes it will free, 0 if it can't) */
+typedef VkDeviceSize (*vk_residency_evict_fn_t)(
+    vk_dev_t *dev,
+    void *user,
+    uint32_t key
+);
+/* Registered resource */
+typedef struct {
+  vk_residency_evict_fn_t evict;  /* NULL if not streamable */
+  void *user;
+  uint32_t key;                   /* Passed back to evict */
+  uint32_t heap;
+  VkDeviceSize size;
+  uint64_t last_used;
+  VkDeviceSize releasing;         /* Promised by evict, not yet freed */
+  bool active;
+} vk_residency_entry_t;
+/* Memory heap state */
+typedef struct {
+  VkDeviceSize size;
+  VkDeviceSize budget;
+  VkDeviceSize usage;             /* Driver reported, or tracked */
+  VkDeviceSize tracked;           /* Sum of registered resources */
+} vk_residency_heap_t;
+/* Residency manager */
+typedef struct {
+  vk_dev_t *dev;
+  vk_phys_dev_t phys_dev;
+  const vk_phys_dev_info_t *phys_dev_info;
+  bool use_budget_ext;
+  uint64_t frame_counter;
+  vk_residency_heap_t heaps[VK_MAX_MEMORY_HEAPS];
+  uint32_t heap_count;
+  vk_residency_entry_t *entries;
+  uint32_t entry_count;
+  uint32_t entry_capacity;
+  uint32_t *free_ids;
+  uint32_t free_count;
+} vk_residency_t;
+
+/* Create a residency manager (polls budgets once) */
+extern void vk_residency_create(
+    vk_residency_t *residency,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const vk_phys_dev_info_t *phys_dev_info
+);
+/* Register a resource (evict may be NULL), initially with nothing resident */
+extern uint32_t vk_residency_add(
+    vk_residency_t *residency,
+    vk_residency_evict_fn_t evict,
+    void *user,
+    uint32_t key
+);
+/* Set the bytes a resource holds in a memory type's heap */
+extern void vk_residency_set_size(
+    vk_residency_t *residency,
+    uint32_t id,
+    uint32_t memory_type,
+    VkDeviceSize size
+);
+/* Mark a resource used this frame */
+extern void vk_residency_touch(vk_residency_t *residency, uint32_t id);
+/* Unregister a resource */
+extern void vk_residency_remove(vk_residency_t *residency, uint32_t id);
+/* Get the bytes allocatable from a memory type's heap below high water */
+extern VkDeviceSize vk_residency_room(
+    const vk_residency_t *residency,
+    uint32_t memory_type
+);
+/* Poll budgets, report them, and evict from heaps over high water */
+extern void vk_residency_update(vk_residency_t *residency);
+/* Destroy a residency manager */
+extern void vk_residency_destroy(vk_residency_t *residency);
+
+#endif /* VK_RESIDENCY_H */
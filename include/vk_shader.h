@@ -0,0 +1,100 @@
+/* Include guard */
+#if !defined(VK_SHADER_H)
+#define VK_SHADER_H
+
+/* Includes */
+#include <base.h>
+#include <vk_dev.h>
+#include <asset_pack.h>
+
+/*
+ * SPIR-V shaders loaded from a shader bundle (an asset pack of
+ * ASSET_CHUNK_SHADER chunks, see tools/asset_packer.c).
+ *
+ * The bundle is memory mapped and shaders point straight into it, so it must
+ * stay open while they're in use. Each shader is reflected for its stage,
+ * entry point, descriptor bindings and push constant range, so set and
+ * pipeline layouts can be built from the shaders that use them. Identical
+ * code shares one VkShaderModule per device (through the device cache).
+ *
+ * With VK_KHR_maintenance5 no module is created at all: the code is chained
+ * into the pipeline's stage create info instead (vk_shader_stage_info).
+ */
+
+/* Most descriptor bindings reflected per shader */
+#define VK_SHADER_MAX_BINDINGS 32
+/* Longest entry point name (including terminator) */
+#define VK_SHADER_MAX_ENTRY 64
+/* Descriptors given to a runtime sized array binding */
+#define VK_SHADER_UNSIZED_ARRAY_COUNT 1024u
+
+/* Types */
+/* Reflected descriptor binding */
+typedef struct {
+  uint32_t set;
+  uint32_t binding;
+  VkDescriptorType type;
+  uint32_t count;                 /* 0 for a runtime sized array */
+} vk_shader_binding_t;
+/* Loaded shader */
+typedef struct {
+  const uint32_t *code;
+  size_t size;
+  uint64_t hash;                  /* Of the code */
+  VkShaderStageFlagBits stage;
+  char entry[VK_SHADER_MAX_ENTRY];
+  VkShaderModule module;          /* VK_NULL_HANDLE if the code is inlined */
+  vk_shader_binding_t bindings[VK_SHADER_MAX_BINDINGS];
+  uint32_t binding_count;
+  VkPushConstantRange push_constants;  /* Size 0 if none */
+} vk_shader_t;
+/* Shader bundle */
+typedef struct {
+  asset_pack_t pack;
+  bool inline_code;               /* VK_KHR_maintenance5 enabled */
+} vk_shader_bundle_t;
+
+/* Map a shader bundle (false on failure) */
+extern bool vk_shader_bundle_open(
+    vk_shader_bundle_t *bundle,
+    vk_dev_t *dev,
+    const char *path
+);
+/* Unmap a shader bundle */
+extern void vk_shader_bundle_close(vk_shader_bundle_t *bundle);
+/* Reflect SPIR-V (false if it isn't valid SPIR-V with one entry point) */
+extern bool vk_shader_reflect(
+    vk_shader_t *shader,
+    const uint32_t *code,
+    size_t size
+);
+/* Load a shader from a bundle (false if missing or invalid) */
+extern bool vk_shader_load(
+    vk_shader_t *shader,
+    vk_shader_bundle_t *bundle,
+    vk_dev_t *dev,
+    const char *name
+);
+/* Fill a pipeline stage (module_info is chained in if the code is inlined) */
+extern void vk_shader_stage_info(
+    const vk_shader_t *shader,
+    VkPipelineShaderStageCreateInfo *stage_info,
+    VkShaderModuleCreateInfo *module_info
+);
+/* Get a cached set layout for one set of several shaders' bindings */
+extern VkDescriptorSetLayout vk_shader_set_layout(
+    vk_dev_t *dev,
+    const vk_shader_t *const *shaders,
+    uint32_t count,
+    uint32_t set
+);
+/* Get a cached pipeline layout for several shaders' sets and push constants */
+extern VkPipelineLayout vk_shader_pipeline_layout(
+    vk_dev_t *dev,
+    const vk_shader_t *const *shaders,
+    uint32_t count
+);
+/* Unload a shader */
+extern void vk_shader_unload(vk_shader_t *shader, vk_dev_t *dev);
+
+#endif /* VK_SHADER_H */
@@ -0,0 +1,57 @@
+/* Include guard */
+#if !defined(VK_STAGING_H)
+#define VK_STAGING_H
+
+/* Includes */
+#include <base.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+
+/*
+ * Host visible upload ring. Allocations are carved from a persistently
+ * mapped buffer in order; once the GPU has consumed everything recorded up
+ * to a mark (vk_staging_mark), the space is returned with vk_staging_release.
+ */
+
+/* Alignment of staging allocations */
+#define VK_STAGING_ALIGNMENT 16u
+
+/* Types */
+/* Staging ring */
+typedef struct {
+  vk_buf_t buffer;
+  VkDeviceSize head;
+  VkDeviceSize tail;
+} vk_staging_t;
+
+/* Create a staging ring */
+extern vk_staging_t vk_staging_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize size
+);
+/* Allocate contiguous staging memory (false if the ring is full) */
+extern bool vk_staging_alloc(
+    vk_staging_t *ring,
+    VkDeviceSize size,
+    VkDeviceSize *offset,
+    void **ptr
+);
+/* Get a mark covering every allocation made so far */
+extern VkDeviceSize vk_staging_mark(const vk_staging_t *ring);
+/* Release allocations up to a mark once the GPU has consumed them */
+extern void vk_staging_release(vk_staging_t *ring, VkDeviceSize mark);
+/* Record a copy into a buffer through the ring (returns bytes recorded) */
+extern VkDeviceSize vk_staging_cmd_upload(
+    vk_staging_t *ring,
+    VkCommandBuffer cmd,
+    const void *data,
+    VkDeviceSize size,
+    VkBuffer dst,
+    VkDeviceSize dst_offset
+);
+/* Destroy a staging ring */
+extern void vk_staging_destroy(vk_staging_t *ring, vk_dev_t *dev);
+
+#endif /* VK_STAGING_H */
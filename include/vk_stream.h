@@ -0,0 +1,261 @@
+/* Include guard */
+#if !defined(VK_STREAM_H)
+#define VK_STREAM_H
+
+/* Includes */
+#include <base.h>
+#include <stdatomic.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_sync.h>
+#include <vk_buf.h>
+#include <vk_submit.h>
+#include <vk_staging.h>
+#include <asset_pack.h>
+#include <jobs.h>
+#include <transcode.h>
+#include <vk_residency.h>
+
+/*
+ * Texture streaming.
+ *
+ * Textures are added from asset pack texture chunks and start with only
+ * their mip tail (every level no larger than VK_STREAM_TAIL_SIZE) resident.
+ * Shaders sample them through the stream's descriptor set (see
+ * shaders/stream.glsl), which also records the finest mip level each texture
+ * was sampled at. From that feedback finer levels are loaded, and when over
+ * budget the finest levels of the least recently used textures are dropped.
+ *
+ * Each residency change builds a new image holding exactly the resident
+ * levels, copied (or transcoded, for universal block chunks) from the pack by
+ * worker threads into the staging ring and enqueued on the submission
+ * layer's transfer queues (see vk_submit.h), reaching the driver with its
+ * next flush; the old image is destroyed once no frame in flight can
+ * reference it.
+ *
+ * With a residency manager (see vk_residency.h) each texture is registered
+ * as a streamable resource: when its heap nears the device's budget the
+ * least recently used textures drop to their mip tails, and finer levels
+ * are held back until there is room again.
+ *
+ * Per frame:
+ *   vk_stream_begin_frame   - once the frame slot's previous work finished:
+ *                             read its feedback and refresh its descriptors
+ *   vk_stream_update        - retire finished uploads, schedule new ones
+ *                             (enqueued, so they go out with vk_submit_flush)
+ *   bind sets[frame_index]  - when drawing with streamed textures
+ */
+
+/* Maximum mip levels of a streamed texture */
+#define VK_STREAM_MAX_MIPS 16
+/* Largest dimension of the levels that are always resident */
+#define VK_STREAM_TAIL_SIZE 128
+/* Maximum uploads in flight */
+#define VK_STREAM_MAX_LOADS 32
+/* Feedback bias (feedback is floor(lod) + bias, lod of the bound image) */
+#define VK_STREAM_FEEDBACK_BIAS 16
+/* Invalid texture id */
+#define VK_STREAM_INVALID UINT32_MAX
+
+/* Types */
+/* Texture streamer builder */
+typedef struct {
+  uint32_t max_textures;
+  uint32_t frames_in_flight;
+  VkDeviceSize budget;
+  VkDeviceSize upload_budget;
+  VkDeviceSize staging_size;
+  vk_submit_t *submit;
+  uint32_t transfer_family;
+  uint32_t graphics_family;
+  jobs_t *jobs;
+  transcode_target_t transcode_target;
+  vk_residency_t *residency;
+} vk_stream_builder_t;
+/* Streamed texture */
+typedef struct {
+  const asset_pack_t *pack;
+  const asset_chunk_t *chunk;
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_count;
+  uint32_t tail_mip;
+  uint32_t resident_mip;
+  uint32_t desired_mip;
+  uint64_t last_used;
+  VkDeviceSize mip_offsets[VK_STREAM_MAX_MIPS];
+  VkDeviceSize mip_sizes[VK_STREAM_MAX_MIPS];
+  VkDeviceSize source_offsets[VK_STREAM_MAX_MIPS];
+  bool transcoded;
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  VkDeviceSize memory_size;
+  VkDeviceSize retired_size;      /* Replaced images not yet destroyed */
+  uint32_t memory_type;
+  uint32_t residency_id;
+  uint32_t generation;
+  bool loading;
+} vk_stream_texture_t;
+/* Part of a load copied (or transcoded) straight into staging by a job */
+typedef struct {
+  job_t job;
+  bool transcode;
+  transcode_target_t target;
+  const uint8_t *source;
+  uint8_t *destination;
+  VkDeviceSize size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t first_row;
+  uint32_t row_count;
+} vk_stream_job_t;
+/* Upload of a new set of resident levels */
+typedef struct {
+  uint32_t texture;
+  uint32_t target_mip;
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  VkDeviceSize memory_size;
+  uint32_t memory_type;
+  VkDeviceSize staging_offset;
+  VkDeviceSize staging_mark;
+  VkCommandBuffer cmd;
+  vk_sync_point_t uploaded;
+  job_counter_t decode;
+  vk_stream_job_t *jobs;
+  uint32_t job_count;
+  bool submitted;
+  double start_time;
+  const uint8_t *source;
+  uint8_t *destination;
+  VkDeviceSize size;
+} vk_stream_load_t;
+/* Image waiting for the frames referencing it to finish */
+typedef struct {
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  uint32_t texture;
+  VkDeviceSize memory_size;
+  uint64_t retire_frame;
+} vk_stream_retired_t;
+/* Texture streamer */
+typedef struct {
+  vk_stream_texture_t *textures;
+  uint32_t texture_count;
+  uint32_t max_textures;
+  uint32_t frames_in_flight;
+  uint64_t frame_counter;
+  VkDeviceSize budget;
+  VkDeviceSize upload_budget;
+  VkDeviceSize resident_size;
+  VkDeviceSize peak_size;
+  const vk_phys_dev_info_t *phys_dev_info;
+  vk_submit_t *submit;
+  uint32_t queue_families[2];
+  uint32_t queue_family_count;
+  jobs_t *jobs;
+  transcode_target_t transcode_target;
+  vk_residency_t *residency;
+  vk_staging_t staging;
+  VkCommandPool command_pool;
+  vk_stream_load_t loads[VK_STREAM_MAX_LOADS];
+  uint32_t load_head;
+  uint32_t load_count;
+  vk_stream_retired_t *retired;
+  uint32_t retired_count;
+  uint32_t retired_capacity;
+  VkImage placeholder;
+  VkDeviceMemory placeholder_memory;
+  VkImageView placeholder_view;
+  VkSampler sampler;
+  VkDescriptorSetLayout set_layout;
+  VkDescriptorPool descriptor_pool;
+  VkDescriptorSet *sets;
+  vk_buf_t *feedback;
+  uint32_t *set_generations;
+  uint32_t *set_resident_mips;
+  VkDescriptorImageInfo *image_infos;
+  VkWriteDescriptorSet *writes;
+} vk_stream_t;
+
+/* Create a texture streamer builder */
+extern vk_stream_builder_t vk_stream_builder(void);
+/* Set the maximum number of textures */
+extern void vk_stream_builder_set_max_textures(
+    vk_stream_builder_t *builder,
+    uint32_t max_textures
+);
+/* Set the number of frames in flight */
+extern void vk_stream_builder_set_frames_in_flight(
+    vk_stream_builder_t *builder,
+    uint32_t frames_in_flight
+);
+/* Set the texture memory budget (0 for half the largest device heap) */
+extern void vk_stream_builder_set_budget(
+    vk_stream_builder_t *builder,
+    VkDeviceSize budget
+);
+/* Set the maximum bytes scheduled for upload per update */
+extern void vk_stream_builder_set_upload_budget(
+    vk_stream_builder_t *builder,
+    VkDeviceSize upload_budget
+);
+/* Set the staging ring size */
+extern void vk_stream_builder_set_staging_size(
+    vk_stream_builder_t *builder,
+    VkDeviceSize staging_size
+);
+/* Set the submission layer uploads go through, and its transfer family */
+extern void vk_stream_builder_set_submit(
+    vk_stream_builder_t *builder,
+    vk_submit_t *submit,
+    uint32_t transfer_family
+);
+/* Set the queue family that samples the textures */
+extern void vk_stream_builder_set_graphics_family(
+    vk_stream_builder_t *builder,
+    uint32_t family
+);
+/* Set the job system decoding runs on (NULL to decode on the caller) */
+extern void vk_stream_builder_set_jobs(
+    vk_stream_builder_t *builder,
+    jobs_t *jobs
+);
+/* Set the format universal block textures are transcoded to */
+extern void vk_stream_builder_set_transcode_target(
+    vk_stream_builder_t *builder,
+    transcode_target_t target
+);
+/* Set the residency manager textures are registered with (may be NULL) */
+extern void vk_stream_builder_set_residency(
+    vk_stream_builder_t *builder,
+    vk_residency_t *residency
+);
+/* Create a texture streamer (and free builder) */
+extern vk_stream_t vk_stream_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_stream_builder_t *builder
+);
+/* Add a texture chunk, loading its mip tail (VK_STREAM_INVALID on failure) */
+extern uint32_t vk_stream_add_texture(
+    vk_stream_t *stream,
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+);
+/* Begin a frame, once the slot's previous use has finished on the GPU */
+extern void vk_stream_begin_frame(
+    vk_stream_t *stream,
+    vk_dev_t *dev,
+    uint32_t frame_index
+);
+/* Retire finished uploads and schedule new ones */
+extern void vk_stream_update(vk_stream_t *stream, vk_dev_t *dev);
+/* Destroy a texture streamer (waits for uploads) */
+extern void vk_stream_destroy(vk_stream_t *stream, vk_dev_t *dev);
+
+#endif /* VK_STREAM_H */
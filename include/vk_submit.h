@@ -0,0 +1,125 @@
+/* Include guard */
+#if !defined(VK_SUBMIT_H)
+#define VK_SUBMIT_H
+
+/* Includes */
+#include <base.h>
+#include <vk_dev.h>
+#include <vk_sync.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Queue submission layer.
+ *
+ * Every VkQueue of a device is owned here, behind one lock per queue, so
+ * nothing else needs to synchronize queue access. Any thread can enqueue
+ * command buffers with the semaphores they wait on and signal; nothing
+ * reaches the driver until a flush, which hands each queue's pending work
+ * to the driver in as few vkQueueSubmit2KHR calls as fences allow (one per
+ * fence, plus one for the rest). Consecutive submissions share a batch when
+ * that adds no synchronization: the later one waits on nothing and the
+ * earlier one signals nothing.
+ *
+ * Each queue has a timeline, and every submission signals the next value
+ * of it, so its completion is a single sync point. Merged submissions only
+ * signal the last value, which also covers the earlier ones.
+ *
+ * Queues are flushed transfer, compute, graphics, then present, so binary
+ * semaphores must be signalled on a queue flushed no later than the one
+ * that waits. Timeline semaphores have no such restriction.
+ *
+ * Without VK_KHR_synchronization2 the same batches go through vkQueueSubmit.
+ */
+
+/* Types */
+/* Queue kinds */
+typedef enum {
+  VK_SUBMIT_GRAPHICS,
+  VK_SUBMIT_PRESENT,
+  VK_SUBMIT_COMPUTE,
+  VK_SUBMIT_TRANSFER,
+  VK_SUBMIT_KIND_COUNT
+} vk_submit_kind_t;
+/* Semaphore wait or signal */
+typedef struct {
+  VkSemaphore semaphore;
+  uint64_t value;                   /* Timeline value (ignored if binary) */
+  VkPipelineStageFlags2KHR stages;  /* 0 for all commands */
+} vk_submit_semaphore_t;
+/* Submission (copied when enqueued) */
+typedef struct {
+  const VkCommandBuffer *command_buffers;
+  uint32_t command_buffer_count;
+  const vk_submit_semaphore_t *waits;
+  uint32_t wait_count;
+  const vk_submit_semaphore_t *signals;
+  uint32_t signal_count;
+  VkFence fence;
+} vk_submission_t;
+/* Enqueued submission, as ranges of its queue's arrays */
+typedef struct {
+  uint32_t first_command_buffer, command_buffer_count;
+  uint32_t first_wait, wait_count;
+  uint32_t first_signal, signal_count;
+  VkFence fence;
+  uint64_t timeline_value;
+} vk_submit_entry_t;
+/* Work enqueued on a queue between flushes */
+typedef struct {
+  vk_submit_entry_t *entries;
+  uint32_t entry_count, entry_capacity;
+  VkCommandBufferSubmitInfoKHR *command_buffers;
+  uint32_t command_buffer_count, command_buffer_capacity;
+  VkSemaphoreSubmitInfoKHR *waits;
+  uint32_t wait_count, wait_capacity;
+  VkSemaphoreSubmitInfoKHR *signals;
+  uint32_t signal_count, signal_capacity;
+} vk_submit_list_t;
+/* Arbitrated queue */
+typedef struct {
+  VkQueue queue;
+  vk_timeline_t timeline;
+  pthread_mutex_t queue_mutex;    /* Held for every call on the queue */
+  pthread_mutex_t pending_mutex;  /* Held while enqueueing */
+  vk_submit_list_t pending;
+  vk_submit_list_t flushing;
+  atomic_uint load;               /* Command buffers enqueued since flush */
+  atomic_uint last_load;          /* Command buffers in the last flush */
+  VkSubmitInfo2KHR *batches;
+  uint32_t batch_capacity;
+  VkSemaphoreSubmitInfoKHR *batch_signals;
+  uint32_t batch_signal_capacity;
+  uint8_t *legacy;                /* vkQueueSubmit arrays, if needed */
+  uint32_t legacy_capacity;
+} vk_submit_queue_t;
+/* Submission layer */
+typedef struct {
+  vk_submit_queue_t *queues;
+  uint32_t queue_count;
+  uint32_t *kind_queues[VK_SUBMIT_KIND_COUNT];
+  uint32_t kind_queue_counts[VK_SUBMIT_KIND_COUNT];
+  PFN_vkQueueSubmit2KHR queue_submit2;
+} vk_submit_t;
+
+/* Take over a device's queues */
+extern void vk_submit_create(vk_submit_t *submit, vk_dev_t *dev);
+/* Enqueue work on the least loaded queue of a kind, giving its completion */
+extern vk_sync_point_t vk_submit_enqueue(
+    vk_submit_t *submit,
+    vk_submit_kind_t kind,
+    const vk_submission_t *submission
+);
+/* Hand all enqueued work to the driver */
+extern void vk_submit_flush(vk_submit_t *submit);
+/* Flush, then present on the present queue */
+extern VkResult vk_submit_present(
+    vk_submit_t *submit,
+    const VkPresentInfoKHR *present_info
+);
+/* Flush, then wait for every queue to go idle */
+extern void vk_submit_wait_idle(vk_submit_t *submit);
+/* Destroy the submission layer (flushing nothing) */
+extern void vk_submit_destroy(vk_submit_t *submit, vk_dev_t *dev);
+
+#endif /* VK_SUBMIT_H */
@@ -0,0 +1,74 @@
+/* Include guard */
+#if !defined(VK_SYNC_H)
+#define VK_SYNC_H
+
+/* Includes */
+#include <base.h>
+#include <vk_dev.h>
+#include <stdatomic.h>
+
+/*
+ * Timeline semaphore synchronization (Vulkan 1.2 core, needs the
+ * timelineSemaphore feature).
+ *
+ * A timeline is a semaphore whose 64 bit value only increases. Work that
+ * completes at some value is tracked by a sync point (timeline and value)
+ * instead of a fence: the CPU can poll it, wait on it with a timeout, or wait
+ * for any or all of several points at once, and the host can signal a value
+ * itself to release GPU work waiting on CPU produced data. A point with no
+ * timeline or a value of zero is always reached.
+ */
+
+/* Types */
+/* Timeline semaphore */
+typedef struct {
+  VkSemaphore semaphore;
+  atomic_uint_fast64_t next;       /* Last value handed out */
+  atomic_uint_fast64_t completed;  /* Highest value seen reached */
+} vk_timeline_t;
+/* Point on a timeline */
+typedef struct {
+  vk_timeline_t *timeline;
+  uint64_t value;
+} vk_sync_point_t;
+
+/* Create a timeline (starting at zero) */
+extern void vk_timeline_create(vk_timeline_t *timeline, vk_dev_t *dev);
+/* Reserve the next value to signal */
+extern uint64_t vk_timeline_advance(vk_timeline_t *timeline);
+/* Get the timeline's current value */
+extern uint64_t vk_timeline_completed(vk_timeline_t *timeline, vk_dev_t *dev);
+/* Signal a value from the host */
+extern void vk_timeline_signal(
+    vk_timeline_t *timeline,
+    vk_dev_t *dev,
+    uint64_t value
+);
+/* Destroy a timeline */
+extern void vk_timeline_destroy(vk_timeline_t *timeline, vk_dev_t *dev);
+
+/* Check if a point has been reached (without blocking) */
+extern bool vk_sync_reached(vk_sync_point_t point, vk_dev_t *dev);
+/* Wait for a point (false on timeout, in nanoseconds) */
+extern bool vk_sync_wait(
+    vk_sync_point_t point,
+    vk_dev_t *dev,
+    uint64_t timeout
+);
+/* Wait for every point (false on timeout) */
+extern bool vk_sync_wait_all(
+    const vk_sync_point_t *points,
+    uint32_t count,
+    vk_dev_t *dev,
+    uint64_t timeout
+);
+/* Wait for any point, giving its index (false on timeout) */
+extern bool vk_sync_wait_any(
+    const vk_sync_point_t *points,
+    uint32_t count,
+    vk_dev_t *dev,
+    uint64_t timeout,
+    uint32_t *reached
+);
+
+#endif /* VK_SYNC_H */
@@ -0,0 +1,11 @@
+#version 450
+
+/* Flat color from a specialization constant (see tools/check_pipelines.c) */
+
+layout(constant_id = 0) const uint VARIANT = 0;
+
+layout(location = 0) out vec4 color;
+
+void main() {
+  color = vec4(float(VARIANT & 255u) / 255.0, 0.0, 0.0, 1.0);
+}
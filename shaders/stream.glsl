@@ -0,0 +1,29 @@
+/* Streamed texture sampling (see vk_stream.h), include from fragment shaders */
+/* Requires GL_EXT_nonuniform_qualifier if ids aren't dynamically uniform */
+
+#if !defined(STREAM_SET)
+#define STREAM_SET 1
+#endif
+#if !defined(STREAM_MAX_TEXTURES)
+#define STREAM_MAX_TEXTURES 1024
+#endif
+/* Must match VK_STREAM_FEEDBACK_BIAS */
+#define STREAM_FEEDBACK_BIAS 16
+
+layout(set = STREAM_SET, binding = 0) uniform sampler2D
+  stream_textures[STREAM_MAX_TEXTURES];
+/* Finest level sampled per texture, floor(lod) + bias, 0xFFFFFFFF if unused */
+layout(set = STREAM_SET, binding = 1) buffer StreamFeedback {
+  uint stream_feedback[];
+};
+
+/* Sample a streamed texture, recording feedback from 1 in 64 pixels */
+vec4 stream_sample(uint id, vec2 uv) {
+  uvec2 pixel = uvec2(gl_FragCoord.xy);
+  if ((pixel.x & 7u) == 0u && (pixel.y & 7u) == 0u) {
+    float lod = textureQueryLod(stream_textures[id], uv).y;
+    uint value = uint(clamp(floor(lod) + STREAM_FEEDBACK_BIAS, 0.0, 255.0));
+    atomicMin(stream_feedback[id], value);
+  }
+  return texture(stream_textures[id], uv);
+}
@@ -0,0 +1,243 @@
+/* Implements asset_pack.h */
+#include <asset_pack.h>
+#include <hash.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Round up to the pack alignment */
+static uint64_t align_up(uint64_t value) {
+  return (value + ASSET_PACK_ALIGNMENT - 1)
+    & ~(uint64_t)(ASSET_PACK_ALIGNMENT - 1);
+}
+/* Write zeros up to an offset */
+static bool write_padding(FILE *file, uint64_t from, uint64_t to) {
+  static const uint8_t zeros[ASSET_PACK_ALIGNMENT];
+  while (from < to) {
+    size_t count = (size_t)(to - from);
+    if (count > sizeof(zeros)) count = sizeof(zeros);
+    if (fwrite(zeros, 1, count, file) != count) return false;
+    from += count;
+  }
+  return true;
+}
+
+/* Map an asset pack (false on failure) */
+bool asset_pack_open(asset_pack_t *pack, const char *path) {
+  const asset_pack_header_t *header;
+  struct stat st;
+  void *data;
+  int fd;
+
+  memset(pack, 0, sizeof(asset_pack_t));
+
+  /* Map file */
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to open asset pack %s", path);
+    return false;
+  }
+  if (
+      fstat(fd, &st) != 0
+      || (size_t)st.st_size < sizeof(asset_pack_header_t)
+  ) {
+    log_msg(LOG_LEVEL_ERROR, "Asset pack %s is truncated", path);
+    close(fd);
+    return false;
+  }
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to map asset pack %s", path);
+    return false;
+  }
+  pack->data = (uint8_t *)data;
+  pack->size = (size_t)st.st_size;
+
+  /* Validate header and table of contents */
+  header = (const asset_pack_header_t *)pack->data;
+  if (
+      header->magic != ASSET_PACK_MAGIC
+      || header->version != ASSET_PACK_VERSION
+      || header->file_size != pack->size
+      || header->toc_offset > pack->size
+      || (uint64_t)header->chunk_count * sizeof(asset_chunk_t)
+        > pack->size - header->toc_offset
+  ) {
+    log_msg(LOG_LEVEL_ERROR, "Asset pack %s has an invalid header", path);
+    asset_pack_close(pack);
+    return false;
+  }
+  pack->header = header;
+  pack->chunks = (const asset_chunk_t *)(pack->data + header->toc_offset);
+  pack->chunk_count = header->chunk_count;
+  if (
+      hash64(pack->chunks, sizeof(asset_chunk_t) * pack->chunk_count, 0)
+      != header->toc_hash
+  ) {
+    log_msg(LOG_LEVEL_ERROR, "Asset pack %s has a corrupt table", path);
+    asset_pack_close(pack);
+    return false;
+  }
+  for (uint32_t i = 0; i < pack->chunk_count; i++) {
+    const asset_chunk_t *chunk = &pack->chunks[i];
+    if (
+        chunk->offset % ASSET_PACK_ALIGNMENT != 0
+        || chunk->offset > pack->size
+        || chunk->size > pack->size - chunk->offset
+        || chunk->name[ASSET_CHUNK_NAME_MAX - 1] != '\0'
+    ) {
+      log_msg(LOG_LEVEL_ERROR, "Asset pack %s has an invalid chunk", path);
+      asset_pack_close(pack);
+      return false;
+    }
+  }
+
+  return true;
+}
+/* Unmap an asset pack */
+void asset_pack_close(asset_pack_t *pack) {
+  if (pack->data) munmap(pack->data, pack->size);
+  memset(pack, 0, sizeof(asset_pack_t));
+}
+/* Find a chunk by name (NULL if not present) */
+const asset_chunk_t *asset_pack_find(
+    const asset_pack_t *pack,
+    const char *name
+) {
+  for (uint32_t i = 0; i < pack->chunk_count; i++) {
+    if (strcmp(pack->chunks[i].name, name) == 0) return &pack->chunks[i];
+  }
+  return NULL;
+}
+/* Get a pointer to a chunk's payload */
+const void *asset_pack_chunk_data(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+) {
+  return pack->data + chunk->offset;
+}
+/* Check a chunk's payload against its hash */
+bool asset_pack_verify_chunk(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+) {
+  return hash64(pack->data + chunk->offset, (size_t)chunk->size, 0)
+    == chunk->hash;
+}
+/* Hint that a chunk will be read soon */
+void asset_pack_prefetch(
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+) {
+  if (chunk->size == 0) return;
+  madvise(
+      pack->data + chunk->offset,
+      (size_t)align_up(chunk->size),
+      MADV_WILLNEED
+  );
+}
+
+/* Start writing an asset pack (false on failure) */
+bool asset_pack_writer_begin(
+    asset_pack_writer_t *writer,
+    const char *path
+) {
+  memset(writer, 0, sizeof(asset_pack_writer_t));
+  writer->file = fopen(path, "wb");
+  if (!writer->file) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to create asset pack %s", path);
+    return false;
+  }
+  /* Reserve the header's page, it is written last */
+  if (!write_padding(writer->file, 0, ASSET_PACK_ALIGNMENT)) {
+    fclose(writer->file);
+    writer->file = NULL;
+    return false;
+  }
+  writer->offset = ASSET_PACK_ALIGNMENT;
+  return true;
+}
+/* Append a chunk (meta may be NULL, false on failure) */
+bool asset_pack_writer_add(
+    asset_pack_writer_t *writer,
+    const char *name,
+    asset_chunk_type_t type,
+    const uint32_t *meta,
+    const void *data,
+    uint64_t size
+) {
+  asset_chunk_t *chunk;
+  uint64_t offset = align_up(writer->offset);
+
+  if (strlen(name) >= ASSET_CHUNK_NAME_MAX) {
+    log_msg(LOG_LEVEL_ERROR, "Asset chunk name %s is too long", name);
+    return false;
+  }
+
+  /* Write payload, rewinding over it on failure */
+  if (
+      !write_padding(writer->file, writer->offset, offset)
+      || fwrite(data, 1, (size_t)size, writer->file) != (size_t)size
+  ) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to write asset chunk %s", name);
+    if (fseeko(writer->file, (off_t)writer->offset, SEEK_SET) != 0)
+      log_msg(LOG_LEVEL_ERROR, "Failed to rewind asset pack");
+    return false;
+  }
+
+  /* Grow table, now the chunk is there */
+  writer->chunk_count++;
+  writer->chunks = (asset_chunk_t *)realloc(
+      writer->chunks,
+      sizeof(asset_chunk_t) * writer->chunk_count
+  );
+  ASSERT(writer->chunks);
+  chunk = &writer->chunks[writer->chunk_count - 1];
+  memset(chunk, 0, sizeof(asset_chunk_t));
+  strcpy(chunk->name, name);
+  chunk->type = (uint32_t)type;
+  chunk->offset = offset;
+  chunk->size = size;
+  chunk->hash = hash64(data, (size_t)size, 0);
+  if (meta) memcpy(chunk->meta, meta, sizeof(chunk->meta));
+  writer->offset = offset + size;
+  return true;
+}
+/* Write the table of contents and close the file (false on failure) */
+bool asset_pack_writer_end(asset_pack_writer_t *writer) {
+  asset_pack_header_t header;
+  size_t toc_size = sizeof(asset_chunk_t) * writer->chunk_count;
+  bool ok = true;
+
+  /* Populate header */
+  memset(&header, 0, sizeof(header));
+  header.magic = ASSET_PACK_MAGIC;
+  header.version = ASSET_PACK_VERSION;
+  header.chunk_count = writer->chunk_count;
+  header.toc_offset = align_up(writer->offset);
+  header.file_size = align_up(header.toc_offset + toc_size);
+  header.toc_hash = hash64(writer->chunks, toc_size, 0);
+
+  /* Write table of contents, padding and header */
+  ok = ok && write_padding(writer->file, writer->offset, header.toc_offset);
+  ok = ok && fwrite(writer->chunks, 1, toc_size, writer->file) == toc_size;
+  ok = ok && write_padding(
+      writer->file,
+      header.toc_offset + toc_size,
+      header.file_size
+  );
+  ok = ok && fseek(writer->file, 0, SEEK_SET) == 0;
+  ok = ok && fwrite(&header, sizeof(header), 1, writer->file) == 1;
+  /* Drop anything a failed chunk left past the end */
+  ok = ok && fflush(writer->file) == 0;
+  ok = ok && ftruncate(fileno(writer->file), (off_t)header.file_size) == 0;
+  if (fclose(writer->file) != 0) ok = false;
+  if (!ok) log_msg(LOG_LEVEL_ERROR, "Failed to finish asset pack");
+
+  /* Free writer */
+  if (writer->chunks) free(writer->chunks);
+  memset(writer, 0, sizeof(asset_pack_writer_t));
+  return ok;
+}
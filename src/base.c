@@ -1,6 +1,7 @@
 /* Implements base.h */
 #include <base.h>
 #include <stdarg.h>
+#include <time.h>
 
 /* Log a message */
 void log_msg(log_level_t level, const char *message, ...) {
@@ -50,3 +51,31 @@ size_t get_option(
   }
   return option;
 }
+/* Get a monotonic time in seconds */
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+/* Read a whole file into memory (NULL on failure, free with free()) */
+void *read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  long length;
+  void *data;
+  if (file == NULL) return NULL;
+  if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0) {
+    fclose(file);
+    return NULL;
+  }
+  rewind(file);
+  data = malloc(length > 0 ? (size_t)length : 1);
+  ASSERT(data);
+  if (fread(data, 1, (size_t)length, file) != (size_t)length) {
+    free(data);
+    fclose(file);
+    return NULL;
+  }
+  fclose(file);
+  if (size) *size = (size_t)length;
+  return data;
+}
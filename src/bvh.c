@@ -0,0 +1,770 @@
+/* Implements bvh.h */
+#include <bvh.h>
+#include <telemetry.h>
+#include <float.h>
+#if defined(__SSE__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Every frustum plane */
+#define ALL_PLANES 0x3fu
+/* Initial object capacity */
+#define MIN_CAPACITY 256u
+/* Smallest ray direction component (avoids 0 * infinity in slab tests) */
+#define MIN_DIR 1e-30f
+
+/* Types */
+/* Subtree bvh_cull walks as one job */
+typedef struct {
+  uint32_t node;
+  uint32_t mask;                  /* Planes left to test (0: inside) */
+  uint32_t first;
+  uint32_t count;
+  uint32_t found;
+} cull_task_t;
+/* Cull job arguments */
+typedef struct {
+  const bvh_t *bvh;
+  const bvh_frustum_t *frustum;
+  cull_task_t *tasks;
+  uint32_t *visible;
+} cull_args_t;
+
+#if defined(__ARM_NEON)
+/* Get a bit per lane set in a comparison result */
+static uint32_t lane_mask(uint32x4_t v) {
+  return (vgetq_lane_u32(v, 0) & 1u) | (vgetq_lane_u32(v, 1) & 2u) |
+    (vgetq_lane_u32(v, 2) & 4u) | (vgetq_lane_u32(v, 3) & 8u);
+}
+#endif
+/* Test a node's children against a plane (lanes outside, lanes inside) */
+static void test_plane(
+    const bvh_node_t *node,
+    const float *plane,
+    uint32_t *outside,
+    uint32_t *inside
+) {
+  /* Corners furthest along the normal, and furthest against it */
+  const float *px = plane[0] > 0.0f ? node->max_x : node->min_x;
+  const float *py = plane[1] > 0.0f ? node->max_y : node->min_y;
+  const float *pz = plane[2] > 0.0f ? node->max_z : node->min_z;
+  const float *nx = plane[0] > 0.0f ? node->min_x : node->max_x;
+  const float *ny = plane[1] > 0.0f ? node->min_y : node->max_y;
+  const float *nz = plane[2] > 0.0f ? node->min_z : node->max_z;
+#if defined(__SSE__)
+  __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]);
+  __m128 c = _mm_set1_ps(plane[2]), d = _mm_set1_ps(plane[3]);
+  __m128 far = _mm_add_ps(
+      _mm_add_ps(
+          _mm_mul_ps(a, _mm_loadu_ps(px)),
+          _mm_mul_ps(b, _mm_loadu_ps(py))
+      ),
+      _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(pz)), d)
+  );
+  __m128 near = _mm_add_ps(
+      _mm_add_ps(
+          _mm_mul_ps(a, _mm_loadu_ps(nx)),
+          _mm_mul_ps(b, _mm_loadu_ps(ny))
+      ),
+      _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(nz)), d)
+  );
+  *outside = (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(far, _mm_setzero_ps()));
+  *inside = (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(near, _mm_setzero_ps()));
+#elif defined(__ARM_NEON)
+  float32x4_t d = vdupq_n_f32(plane[3]), zero = vdupq_n_f32(0.0f);
+  float32x4_t far = vmlaq_n_f32(d, vld1q_f32(px), plane[0]);
+  float32x4_t near = vmlaq_n_f32(d, vld1q_f32(nx), plane[0]);
+  far = vmlaq_n_f32(far, vld1q_f32(py), plane[1]);
+  far = vmlaq_n_f32(far, vld1q_f32(pz), plane[2]);
+  near = vmlaq_n_f32(near, vld1q_f32(ny), plane[1]);
+  near = vmlaq_n_f32(near, vld1q_f32(nz), plane[2]);
+  *outside = lane_mask(vcltq_f32(far, zero));
+  *inside = lane_mask(vcgeq_f32(near, zero));
+#else
+  *outside = 0;
+  *inside = 0;
+  for (uint32_t lane = 0; lane < 4; lane++) {
+    float far = plane[0] * px[lane] + plane[1] * py[lane] +
+      plane[2] * pz[lane] + plane[3];
+    float near = plane[0] * nx[lane] + plane[1] * ny[lane] +
+      plane[2] * nz[lane] + plane[3];
+    if (far < 0.0f) *outside |= 1u << lane;
+    if (near >= 0.0f) *inside |= 1u << lane;
+  }
+#endif
+}
+/* Test a node's children against a ray (lanes hit before limit) */
+static uint32_t test_ray(
+    const bvh_node_t *node,
+    const float *origin,
+    const float *inv_dir,
+    float limit,
+    float *near
+) {
+#if defined(__SSE__)
+  __m128 ox = _mm_set1_ps(origin[0]), ix = _mm_set1_ps(inv_dir[0]);
+  __m128 oy = _mm_set1_ps(origin[1]), iy = _mm_set1_ps(inv_dir[1]);
+  __m128 oz = _mm_set1_ps(origin[2]), iz = _mm_set1_ps(inv_dir[2]);
+  __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_x), ox), ix);
+  __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_x), ox), ix);
+  __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_y), oy), iy);
+  __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_y), oy), iy);
+  __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_z), oz), iz);
+  __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_z), oz), iz);
+  __m128 enter = _mm_max_ps(
+      _mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+      _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps())
+  );
+  __m128 leave = _mm_min_ps(
+      _mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+      _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(limit))
+  );
+  _mm_storeu_ps(near, enter);
+  return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(enter, leave));
+#elif defined(__ARM_NEON)
+  float32x4_t x0 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->min_x), vdupq_n_f32(origin[0])),
+      inv_dir[0]
+  );
+  float32x4_t x1 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->max_x), vdupq_n_f32(origin[0])),
+      inv_dir[0]
+  );
+  float32x4_t y0 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->min_y), vdupq_n_f32(origin[1])),
+      inv_dir[1]
+  );
+  float32x4_t y1 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->max_y), vdupq_n_f32(origin[1])),
+      inv_dir[1]
+  );
+  float32x4_t z0 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->min_z), vdupq_n_f32(origin[2])),
+      inv_dir[2]
+  );
+  float32x4_t z1 = vmulq_n_f32(
+      vsubq_f32(vld1q_f32(node->max_z), vdupq_n_f32(origin[2])),
+      inv_dir[2]
+  );
+  float32x4_t enter = vmaxq_f32(
+      vmaxq_f32(vminq_f32(x0, x1), vminq_f32(y0, y1)),
+      vmaxq_f32(vminq_f32(z0, z1), vdupq_n_f32(0.0f))
+  );
+  float32x4_t leave = vminq_f32(
+      vminq_f32(vmaxq_f32(x0, x1), vmaxq_f32(y0, y1)),
+      vminq_f32(vmaxq_f32(z0, z1), vdupq_n_f32(limit))
+  );
+  vst1q_f32(near, enter);
+  return lane_mask(vcleq_f32(enter, leave));
+#else
+  uint32_t hits = 0;
+  for (uint32_t lane = 0; lane < 4; lane++) {
+    const float lo[3] = {
+      node->min_x[lane], node->min_y[lane], node->min_z[lane]
+    };
+    const float hi[3] = {
+      node->max_x[lane], node->max_y[lane], node->max_z[lane]
+    };
+    float enter = 0.0f, leave = limit;
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float t0 = (lo[axis] - origin[axis]) * inv_dir[axis];
+      float t1 = (hi[axis] - origin[axis]) * inv_dir[axis];
+      if (t0 > t1) {
+        float t = t0;
+        t0 = t1;
+        t1 = t;
+      }
+      if (t0 > enter) enter = t0;
+      if (t1 < leave) leave = t1;
+    }
+    near[lane] = enter;
+    if (enter <= leave) hits |= 1u << lane;
+  }
+  return hits;
+#endif
+}
+/* Get the lanes of a node that hold a child */
+static uint32_t used_lanes(const bvh_node_t *node) {
+  uint32_t lanes = 0;
+  for (uint32_t lane = 0; lane < 4; lane++)
+    if (node->count[lane] > 0) lanes |= 1u << lane;
+  return lanes;
+}
+/* Test a node's children against planes (visible lanes, planes crossed) */
+static uint32_t test_node(
+    const bvh_node_t *node,
+    const bvh_frustum_t *frustum,
+    uint32_t mask,
+    uint32_t *masks
+) {
+  uint32_t visible = used_lanes(node);
+  masks[0] = masks[1] = masks[2] = masks[3] = 0;
+  for (uint32_t p = 0; p < 6 && visible; p++) {
+    uint32_t outside, inside, crossing;
+    if (!(mask & (1u << p))) continue;
+    test_plane(node, frustum->planes[p], &outside, &inside);
+    visible &= ~outside;
+    crossing = visible & ~inside;
+    for (uint32_t lane = 0; lane < 4; lane++)
+      if (crossing & (1u << lane)) masks[lane] |= 1u << p;
+  }
+  return visible;
+}
+/* Write the objects of a subtree in a frustum, returning their count */
+static uint32_t cull_subtree(
+    const bvh_t *bvh,
+    const bvh_frustum_t *frustum,
+    uint32_t root,
+    uint32_t mask,
+    uint32_t *out
+) {
+  uint32_t stack[BVH_MAX_STACK], stack_masks[BVH_MAX_STACK];
+  uint32_t depth = 1, count = 0;
+  stack[0] = root;
+  stack_masks[0] = mask;
+  while (depth > 0) {
+    const bvh_node_t *node;
+    uint32_t masks[4], visible;
+    depth--;
+    node = &bvh->nodes[stack[depth]];
+    visible = test_node(node, frustum, stack_masks[depth], masks);
+    for (uint32_t lane = 0; lane < 4; lane++) {
+      if (!(visible & (1u << lane))) continue;
+      if (node->count[lane] == 1) {
+        out[count++] = node->child[lane];
+      } else if (masks[lane] == 0) {
+        /* Entirely inside: the subtree's run of the order is the answer */
+        memcpy(
+            out + count,
+            bvh->order + node->first[lane],
+            sizeof(uint32_t) * node->count[lane]
+        );
+        count += node->count[lane];
+      } else {
+        ASSERT(depth < BVH_MAX_STACK);
+        stack[depth] = node->child[lane];
+        stack_masks[depth] = masks[lane];
+        depth++;
+      }
+    }
+  }
+  return count;
+}
+/* Cull job: walk tasks [begin, end), each into its own part of the output */
+static void cull_tasks(void *arg, uint32_t begin, uint32_t end) {
+  cull_args_t *args = (cull_args_t *)arg;
+  for (uint32_t i = begin; i < end; i++) {
+    cull_task_t *task = &args->tasks[i];
+    uint32_t *out = args->visible + task->first;
+    if (task->mask == 0) {
+      memcpy(
+          out,
+          args->bvh->order + task->first,
+          sizeof(uint32_t) * task->count
+      );
+      task->found = task->count;
+    } else {
+      task->found = cull_subtree(
+          args->bvh,
+          args->frustum,
+          task->node,
+          task->mask,
+          out
+      );
+    }
+  }
+}
+/* Open the top of the tree into subtrees (in order), returning how many */
+static uint32_t split_tasks(
+    const bvh_t *bvh,
+    const bvh_frustum_t *frustum,
+    cull_task_t *tasks
+) {
+  cull_task_t next[BVH_CULL_TASKS * 4];
+  uint32_t count = 1;
+  tasks[0].node = 0;
+  tasks[0].mask = ALL_PLANES;
+  tasks[0].first = 0;
+  tasks[0].count = bvh->order_count;
+  while (count < BVH_CULL_TASKS) {
+    uint32_t next_count = 0;
+    bool opened = false;
+    for (uint32_t i = 0; i < count; i++) {
+      const bvh_node_t *node;
+      uint32_t masks[4], visible;
+      if (tasks[i].mask == 0) {
+        next[next_count++] = tasks[i];
+        continue;
+      }
+      node = &bvh->nodes[tasks[i].node];
+      visible = test_node(node, frustum, tasks[i].mask, masks);
+      opened = true;
+      for (uint32_t lane = 0; lane < 4; lane++) {
+        cull_task_t *task;
+        if (!(visible & (1u << lane))) continue;
+        task = &next[next_count++];
+        task->node = node->child[lane];
+        task->mask = node->count[lane] == 1 ? 0 : masks[lane];
+        task->first = node->first[lane];
+        task->count = node->count[lane];
+      }
+    }
+    memcpy(tasks, next, sizeof(cull_task_t) * next_count);
+    count = next_count;
+    if (!opened) break;
+  }
+  return count;
+}
+/* Get the surface area of a box */
+static double box_area(const float *min, const float *max) {
+  double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+  if (dx < 0.0 || dy < 0.0 || dz < 0.0) return 0.0;
+  return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+/* Set a child's bounds */
+static void set_slot(
+    bvh_node_t *node,
+    uint32_t lane,
+    const float *min,
+    const float *max
+) {
+  node->min_x[lane] = min[0];
+  node->min_y[lane] = min[1];
+  node->min_z[lane] = min[2];
+  node->max_x[lane] = max[0];
+  node->max_y[lane] = max[1];
+  node->max_z[lane] = max[2];
+}
+/* Get a child's bounds */
+static void get_slot(
+    const bvh_node_t *node,
+    uint32_t lane,
+    float *min,
+    float *max
+) {
+  min[0] = node->min_x[lane];
+  min[1] = node->min_y[lane];
+  min[2] = node->min_z[lane];
+  max[0] = node->max_x[lane];
+  max[1] = node->max_y[lane];
+  max[2] = node->max_z[lane];
+}
+/* Get the bounds of a node's children */
+static void node_bounds(const bvh_node_t *node, float *min, float *max) {
+  min[0] = min[1] = min[2] = FLT_MAX;
+  max[0] = max[1] = max[2] = -FLT_MAX;
+  for (uint32_t lane = 0; lane < 4; lane++) {
+    float lo[3], hi[3];
+    if (node->count[lane] == 0) continue;
+    get_slot(node, lane, lo, hi);
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      if (lo[axis] < min[axis]) min[axis] = lo[axis];
+      if (hi[axis] > max[axis]) max[axis] = hi[axis];
+    }
+  }
+}
+/* Put a run's k lowest centroids first, along its longest centroid axis */
+static void split_median(
+    bvh_t *bvh,
+    const float *centroid,
+    uint32_t first,
+    uint32_t count,
+    uint32_t k
+) {
+  uint32_t *items = bvh->order + first, axis = 0;
+  float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  int64_t left = 0, right = (int64_t)count - 1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const float *c = centroid + items[i] * 3;
+    for (uint32_t j = 0; j < 3; j++) {
+      if (c[j] < lo[j]) lo[j] = c[j];
+      if (c[j] > hi[j]) hi[j] = c[j];
+    }
+  }
+  if (hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+  if (hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+
+  /* Quickselect with Hoare partitions */
+  while (left < right) {
+    float pivot = centroid[items[(left + right) / 2] * 3 + axis];
+    int64_t i = left, j = right;
+    while (i <= j) {
+      while (centroid[items[i] * 3 + axis] < pivot) i++;
+      while (centroid[items[j] * 3 + axis] > pivot) j--;
+      if (i <= j) {
+        uint32_t item = items[i];
+        items[i++] = items[j];
+        items[j--] = item;
+      }
+    }
+    if ((int64_t)k <= j) right = j;
+    else if ((int64_t)k >= i) left = i;
+    else break;
+  }
+}
+/* Build the node over a run of the order, returning its index */
+static uint32_t build_node(
+    bvh_t *bvh,
+    const float *centroid,
+    uint32_t first,
+    uint32_t count,
+    uint32_t parent
+) {
+  uint32_t node = bvh->node_count++, parts = 1;
+  uint32_t part_first[4] = { first }, part_count[4] = { count };
+  bvh->parent[node] = parent;
+
+  /* Halve the largest part until there are four */
+  while (parts < 4) {
+    uint32_t largest = 0, half;
+    for (uint32_t i = 1; i < parts; i++)
+      if (part_count[i] > part_count[largest]) largest = i;
+    if (part_count[largest] < 2) break;
+    half = part_count[largest] / 2;
+    split_median(
+        bvh,
+        centroid,
+        part_first[largest],
+        part_count[largest],
+        half
+    );
+    for (uint32_t i = parts; i > largest + 1; i--) {
+      part_first[i] = part_first[i - 1];
+      part_count[i] = part_count[i - 1];
+    }
+    part_first[largest + 1] = part_first[largest] + half;
+    part_count[largest + 1] = part_count[largest] - half;
+    part_count[largest] = half;
+    parts++;
+  }
+
+  for (uint32_t lane = 0; lane < 4; lane++) {
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    uint32_t child = BVH_NONE;
+    if (lane < parts && part_count[lane] == 1) {
+      child = bvh->order[part_first[lane]];
+      memcpy(min, bvh->bounds + child * 6, sizeof(min));
+      memcpy(max, bvh->bounds + child * 6 + 3, sizeof(max));
+      bvh->slot_of[child] = node * 4 + lane;
+    } else if (lane < parts) {
+      child = build_node(
+          bvh,
+          centroid,
+          part_first[lane],
+          part_count[lane],
+          node * 4 + lane
+      );
+      node_bounds(&bvh->nodes[child], min, max);
+      bvh->area += box_area(min, max);
+    }
+    set_slot(&bvh->nodes[node], lane, min, max);
+    bvh->nodes[node].child[lane] = child;
+    bvh->nodes[node].first[lane] = lane < parts ? part_first[lane] : 0;
+    bvh->nodes[node].count[lane] = lane < parts ? part_count[lane] : 0;
+  }
+  return node;
+}
+/* Rebuild the tree over every live object */
+static void build(bvh_t *bvh) {
+  double start = time_now();
+  float *centroid;
+  uint32_t capacity;
+
+  bvh->order_count = 0;
+  for (uint32_t i = 0; i < bvh->object_count; i++)
+    if (bvh->live[i]) bvh->order[bvh->order_count++] = i;
+
+  /* A tree of four way nodes over n objects has fewer than n nodes */
+  capacity = bvh->order_count > 1 ? bvh->order_count : 1;
+  if (capacity > bvh->node_capacity) {
+    bvh->node_capacity = capacity;
+    bvh->nodes = (bvh_node_t *)realloc(
+        bvh->nodes,
+        sizeof(bvh_node_t) * capacity
+    );
+    bvh->parent = (uint32_t *)realloc(
+        bvh->parent,
+        sizeof(uint32_t) * capacity
+    );
+    bvh->dirty = (uint32_t *)realloc(bvh->dirty, sizeof(uint32_t) * capacity);
+    bvh->node_dirty = (uint8_t *)realloc(bvh->node_dirty, capacity);
+    ASSERT(bvh->nodes && bvh->parent && bvh->dirty && bvh->node_dirty);
+  }
+  memset(bvh->node_dirty, 0, bvh->node_capacity);
+
+  centroid = (float *)malloc(sizeof(float) * 3 * (bvh->object_count + 1));
+  ASSERT(centroid);
+  for (uint32_t i = 0; i < bvh->order_count; i++) {
+    const float *b = bvh->bounds + bvh->order[i] * 6;
+    for (uint32_t axis = 0; axis < 3; axis++)
+      centroid[bvh->order[i] * 3 + axis] = b[axis] + b[3 + axis];
+  }
+  bvh->node_count = 0;
+  bvh->area = 0.0;
+  if (bvh->order_count > 0)
+    build_node(bvh, centroid, 0, bvh->order_count, BVH_NONE);
+  free(centroid);
+
+  bvh->build_area = bvh->area;
+  bvh->dirty_count = 0;
+  bvh->rebuild = false;
+  telemetry_report("bvh.build", TELEMETRY_TIMING, (time_now() - start) * 1e3);
+}
+/* Sort node indices, children (higher indices) first */
+static int compare_nodes(const void *a, const void *b) {
+  uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+  return ia > ib ? -1 : ia < ib;
+}
+/* Refit the bounds of moved objects' ancestors */
+static void refit(bvh_t *bvh) {
+  double start = time_now();
+  uint32_t moved = bvh->dirty_count;
+
+  for (uint32_t i = 0; i < moved; i++) {
+    uint32_t node = bvh->dirty[i];
+    while (bvh->parent[node] != BVH_NONE) {
+      node = bvh->parent[node] / 4;
+      if (bvh->node_dirty[node]) break;
+      bvh->node_dirty[node] = 1;
+      bvh->dirty[bvh->dirty_count++] = node;
+    }
+  }
+  qsort(bvh->dirty, bvh->dirty_count, sizeof(uint32_t), compare_nodes);
+  for (uint32_t i = 0; i < bvh->dirty_count; i++) {
+    uint32_t node = bvh->dirty[i], slot = bvh->parent[node];
+    float min[3], max[3], old_min[3], old_max[3];
+    bvh->node_dirty[node] = 0;
+    if (slot == BVH_NONE) continue;
+    node_bounds(&bvh->nodes[node], min, max);
+    get_slot(&bvh->nodes[slot / 4], slot % 4, old_min, old_max);
+    bvh->area += box_area(min, max) - box_area(old_min, old_max);
+    set_slot(&bvh->nodes[slot / 4], slot % 4, min, max);
+  }
+  bvh->dirty_count = 0;
+  telemetry_report("bvh.refit", TELEMETRY_TIMING, (time_now() - start) * 1e3);
+}
+
+/* Create an empty bounding volume hierarchy */
+void bvh_create(bvh_t *bvh) {
+  memset(bvh, 0, sizeof(bvh_t));
+}
+/* Add an object, returning its id */
+uint32_t bvh_insert(bvh_t *bvh, const float *min, const float *max) {
+  uint32_t object;
+  if (bvh->free_object_count > 0) {
+    object = bvh->free_objects[--bvh->free_object_count];
+  } else {
+    if (bvh->object_count == bvh->object_capacity) {
+      bvh->object_capacity =
+        bvh->object_capacity ? bvh->object_capacity * 2 : MIN_CAPACITY;
+      bvh->bounds = (float *)realloc(
+          bvh->bounds,
+          sizeof(float) * 6 * bvh->object_capacity
+      );
+      bvh->slot_of = (uint32_t *)realloc(
+          bvh->slot_of,
+          sizeof(uint32_t) * bvh->object_capacity
+      );
+      bvh->live = (uint8_t *)realloc(bvh->live, bvh->object_capacity);
+      bvh->free_objects = (uint32_t *)realloc(
+          bvh->free_objects,
+          sizeof(uint32_t) * bvh->object_capacity
+      );
+      bvh->order = (uint32_t *)realloc(
+          bvh->order,
+          sizeof(uint32_t) * bvh->object_capacity
+      );
+      ASSERT(bvh->bounds && bvh->slot_of && bvh->live);
+      ASSERT(bvh->free_objects && bvh->order);
+    }
+    object = bvh->object_count++;
+  }
+  memcpy(bvh->bounds + object * 6, min, sizeof(float) * 3);
+  memcpy(bvh->bounds + object * 6 + 3, max, sizeof(float) * 3);
+  bvh->live[object] = 1;
+  bvh->rebuild = true;
+  return object;
+}
+/* Remove an object */
+void bvh_remove(bvh_t *bvh, uint32_t object) {
+  ASSERT(object < bvh->object_count && bvh->live[object]);
+  bvh->live[object] = 0;
+  bvh->free_objects[bvh->free_object_count++] = object;
+  bvh->rebuild = true;
+}
+/* Move an object */
+void bvh_update(
+    bvh_t *bvh,
+    uint32_t object,
+    const float *min,
+    const float *max
+) {
+  uint32_t node;
+  ASSERT(object < bvh->object_count && bvh->live[object]);
+  memcpy(bvh->bounds + object * 6, min, sizeof(float) * 3);
+  memcpy(bvh->bounds + object * 6 + 3, max, sizeof(float) * 3);
+  if (bvh->rebuild) return;
+  node = bvh->slot_of[object] / 4;
+  set_slot(&bvh->nodes[node], bvh->slot_of[object] % 4, min, max);
+  if (!bvh->node_dirty[node]) {
+    bvh->node_dirty[node] = 1;
+    bvh->dirty[bvh->dirty_count++] = node;
+  }
+}
+/* Apply changes, refitting or rebuilding */
+void bvh_commit(bvh_t *bvh) {
+  if (!bvh->rebuild && bvh->dirty_count > 0) {
+    refit(bvh);
+    if (bvh->area > bvh->build_area * BVH_REBUILD_RATIO) bvh->rebuild = true;
+  }
+  if (bvh->rebuild) build(bvh);
+}
+/* Get the frustum of a column major view projection matrix (depth 0 to w) */
+void bvh_frustum_from_matrix(
+    bvh_frustum_t *frustum,
+    const float *view_proj
+) {
+  /* Rows of the matrix: clip x, y, z and w as functions of the point */
+  for (uint32_t i = 0; i < 4; i++) {
+    float x = view_proj[i * 4], y = view_proj[i * 4 + 1];
+    float z = view_proj[i * 4 + 2], w = view_proj[i * 4 + 3];
+    frustum->planes[0][i] = w + x;
+    frustum->planes[1][i] = w - x;
+    frustum->planes[2][i] = w + y;
+    frustum->planes[3][i] = w - y;
+    frustum->planes[4][i] = z;
+    frustum->planes[5][i] = w - z;
+  }
+}
+/* Get the frustum that selects objects overlapping a box */
+void bvh_frustum_from_box(
+    bvh_frustum_t *frustum,
+    const float *min,
+    const float *max
+) {
+  memset(frustum, 0, sizeof(bvh_frustum_t));
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    frustum->planes[axis * 2][axis] = 1.0f;
+    frustum->planes[axis * 2][3] = -min[axis];
+    frustum->planes[axis * 2 + 1][axis] = -1.0f;
+    frustum->planes[axis * 2 + 1][3] = max[axis];
+  }
+}
+/* Write the objects in a frustum, returning their count (jobs may be NULL) */
+uint32_t bvh_cull(
+    const bvh_t *bvh,
+    jobs_t *jobs,
+    const bvh_frustum_t *frustum,
+    uint32_t *visible
+) {
+  double start = time_now();
+  cull_task_t tasks[BVH_CULL_TASKS * 4];
+  cull_args_t args;
+  uint32_t task_count = 1, count = 0;
+
+  ASSERT(!bvh->rebuild && bvh->dirty_count == 0);
+  if (bvh->order_count == 0) return 0;
+  args.bvh = bvh;
+  args.frustum = frustum;
+  args.tasks = tasks;
+  args.visible = visible;
+  if (jobs && bvh->order_count >= BVH_CULL_PARALLEL_OBJECTS) {
+    task_count = split_tasks(bvh, frustum, tasks);
+    jobs_parallel_for(jobs, cull_tasks, &args, task_count, 1);
+  } else {
+    tasks[0].node = 0;
+    tasks[0].mask = ALL_PLANES;
+    tasks[0].first = 0;
+    tasks[0].count = bvh->order_count;
+    cull_tasks(&args, 0, 1);
+  }
+
+  /* Tasks are in order, so each one's results move down, never up */
+  for (uint32_t i = 0; i < task_count; i++) {
+    if (tasks[i].first != count) memmove(
+        visible + count,
+        visible + tasks[i].first,
+        sizeof(uint32_t) * tasks[i].found
+    );
+    count += tasks[i].found;
+  }
+  telemetry_report("bvh.cull", TELEMETRY_TIMING, (time_now() - start) * 1e3);
+  telemetry_report("bvh.visible", TELEMETRY_GAUGE, count);
+  return count;
+}
+/* Get the nearest object along a ray, or BVH_NONE (hit may be NULL) */
+uint32_t bvh_pick(
+    const bvh_t *bvh,
+    const float *origin,
+    const float *dir,
+    bvh_hit_fn_t hit,
+    void *arg,
+    float *distance
+) {
+  uint32_t stack[BVH_MAX_STACK], depth = 1, object = BVH_NONE;
+  float stack_near[BVH_MAX_STACK], inv_dir[3], best = FLT_MAX;
+
+  ASSERT(!bvh->rebuild && bvh->dirty_count == 0);
+  if (bvh->order_count == 0) return BVH_NONE;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    float d = dir[axis];
+    if (d > -MIN_DIR && d < MIN_DIR) d = d < 0.0f ? -MIN_DIR : MIN_DIR;
+    inv_dir[axis] = 1.0f / d;
+  }
+  stack[0] = 0;
+  stack_near[0] = 0.0f;
+  while (depth > 0) {
+    const bvh_node_t *node;
+    uint32_t hits, lanes[4], lane_count = 0;
+    float near[4];
+    depth--;
+    if (stack_near[depth] > best) continue;
+    node = &bvh->nodes[stack[depth]];
+    hits = test_ray(node, origin, inv_dir, best, near) & used_lanes(node);
+    for (uint32_t lane = 0; lane < 4; lane++) {
+      if (!(hits & (1u << lane))) continue;
+      if (node->count[lane] == 1) {
+        float t = near[lane];
+        if (hit) t = hit(arg, node->child[lane], origin, dir);
+        if (t >= 0.0f && t < best) {
+          best = t;
+          object = node->child[lane];
+        }
+        continue;
+      }
+      /* Insertion sort, farthest first, so the nearest is popped first */
+      lanes[lane_count] = lane;
+      for (uint32_t i = lane_count++; i > 0; i--) {
+        if (near[lanes[i - 1]] >= near[lanes[i]]) break;
+        lanes[i] = lanes[i - 1];
+        lanes[i - 1] = lane;
+      }
+    }
+    for (uint32_t i = 0; i < lane_count; i++) {
+      ASSERT(depth < BVH_MAX_STACK);
+      stack[depth] = node->child[lanes[i]];
+      stack_near[depth] = near[lanes[i]];
+      depth++;
+    }
+  }
+  if (distance) *distance = best;
+  return object;
+}
+/* Destroy a bounding volume hierarchy */
+void bvh_destroy(bvh_t *bvh) {
+  free(bvh->nodes);
+  free(bvh->parent);
+  free(bvh->bounds);
+  free(bvh->slot_of);
+  free(bvh->live);
+  free(bvh->free_objects);
+  free(bvh->order);
+  free(bvh->dirty);
+  free(bvh->node_dirty);
+  memset(bvh, 0, sizeof(bvh_t));
+}
@@ -0,0 +1,264 @@
+/* Implements image_write.h */
+#include <image_write.h>
+#include <pthread.h>
+#include <stdio.h>
+
+/* Largest stored deflate block (one per IDAT chunk) */
+#define PNG_BLOCK_SIZE 65535u
+/* Bytes summed before Adler-32 must reduce its sums */
+#define ADLER_SPAN 5552u
+/* Adler-32 modulus */
+#define ADLER_MOD 65521u
+/* OpenEXR magic and version (single part scanline) */
+#define EXR_MAGIC 20000630
+#define EXR_VERSION 2
+/* OpenEXR half float pixel type */
+#define EXR_HALF 1
+
+/* Types */
+/* PNG IDAT stream of stored deflate blocks */
+typedef struct {
+  FILE *file;
+  uint8_t *chunk;     /* Zlib header, block header, block, Adler-32 */
+  size_t used;        /* Bytes in the current block */
+  bool first;
+  uint32_t adler_a, adler_b;
+} png_stream_t;
+
+/* CRC-32 table (PNG polynomial) */
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/* Fill the CRC-32 table */
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (uint32_t k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+/* Continue a CRC-32 (start from 0) */
+static uint32_t crc_update(uint32_t crc, const uint8_t *data, size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+/* Store a 32 bit big endian value */
+static void put_be32(uint8_t *out, uint32_t value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+/* Write a PNG chunk */
+static void png_chunk(
+    FILE *file,
+    const char *type,
+    const uint8_t *data,
+    size_t size
+) {
+  uint8_t header[8], crc[4];
+  put_be32(header, (uint32_t)size);
+  memcpy(header + 4, type, 4);
+  put_be32(crc, crc_update(crc_update(0, header + 4, 4), data, size));
+  fwrite(header, 1, sizeof(header), file);
+  if (size > 0) fwrite(data, 1, size, file);
+  fwrite(crc, 1, sizeof(crc), file);
+}
+/* Write the current stored block as an IDAT chunk */
+static void png_flush(png_stream_t *stream, bool final) {
+  uint8_t *block = stream->chunk + 2;
+  size_t begin = stream->first ? 0 : 2;
+  size_t end = 7 + stream->used;
+  block[0] = final ? 1 : 0;
+  block[1] = (uint8_t)stream->used;
+  block[2] = (uint8_t)(stream->used >> 8);
+  block[3] = (uint8_t)~block[1];
+  block[4] = (uint8_t)~block[2];
+  if (final) {
+    put_be32(
+        stream->chunk + end,
+        (stream->adler_b << 16) | stream->adler_a
+    );
+    end += 4;
+  }
+  png_chunk(stream->file, "IDAT", stream->chunk + begin, end - begin);
+  stream->first = false;
+  stream->used = 0;
+}
+/* Add bytes to the deflate stream */
+static void png_push(png_stream_t *stream, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    size_t count;
+    if (stream->used == PNG_BLOCK_SIZE) png_flush(stream, false);
+    count = PNG_BLOCK_SIZE - stream->used;
+    if (count > size) count = size;
+    memcpy(stream->chunk + 7 + stream->used, data, count);
+    for (size_t i = 0; i < count; i += ADLER_SPAN) {
+      size_t span = count - i < ADLER_SPAN ? count - i : ADLER_SPAN;
+      for (size_t j = 0; j < span; j++) {
+        stream->adler_a += data[i + j];
+        stream->adler_b += stream->adler_a;
+      }
+      stream->adler_a %= ADLER_MOD;
+      stream->adler_b %= ADLER_MOD;
+    }
+    stream->used += count;
+    data += count;
+    size -= count;
+  }
+}
+/* Close a file, checking every write to it (false on failure) */
+static bool close_file(FILE *file) {
+  bool failed = ferror(file) != 0;
+  failed |= fclose(file) != 0;
+  return !failed;
+}
+/* Write an OpenEXR header attribute */
+static void exr_attribute(
+    FILE *file,
+    const char *name,
+    const char *type,
+    const void *value,
+    int32_t size
+) {
+  fwrite(name, 1, strlen(name) + 1, file);
+  fwrite(type, 1, strlen(type) + 1, file);
+  fwrite(&size, sizeof(size), 1, file);
+  fwrite(value, 1, (size_t)size, file);
+}
+
+/* Write 8 bit RGBA pixels as a PNG (false on failure) */
+bool image_write_png(
+    const char *path,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *pixels,
+    size_t stride
+) {
+  static const uint8_t signature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+  static const uint8_t filter = 0;
+  uint8_t header[13];
+  png_stream_t stream;
+
+  pthread_once(&crc_once, crc_init);
+  stream.file = fopen(path, "wb");
+  if (!stream.file) return false;
+  stream.chunk = (uint8_t *)malloc(2 + 5 + PNG_BLOCK_SIZE + 4);
+  ASSERT(stream.chunk);
+  stream.chunk[0] = 0x78;   /* Deflate, 32K window */
+  stream.chunk[1] = 0x01;   /* No preset dictionary, fastest */
+  stream.used = 0;
+  stream.first = true;
+  stream.adler_a = 1;
+  stream.adler_b = 0;
+
+  fwrite(signature, 1, sizeof(signature), stream.file);
+  put_be32(header, width);
+  put_be32(header + 4, height);
+  header[8] = 8;            /* Bits per channel */
+  header[9] = 6;            /* RGBA */
+  header[10] = 0;           /* Deflate */
+  header[11] = 0;           /* Adaptive filtering */
+  header[12] = 0;           /* Not interlaced */
+  png_chunk(stream.file, "IHDR", header, sizeof(header));
+  for (uint32_t y = 0; y < height; y++) {
+    png_push(&stream, &filter, 1);
+    png_push(&stream, pixels + stride * y, (size_t)width * 4);
+  }
+  png_flush(&stream, true);
+  png_chunk(stream.file, "IEND", NULL, 0);
+  free(stream.chunk);
+  return close_file(stream.file);
+}
+/* Write half float RGBA pixels as an OpenEXR file (false on failure) */
+bool image_write_exr(
+    const char *path,
+    uint32_t width,
+    uint32_t height,
+    const uint16_t *pixels,
+    size_t stride
+) {
+  /* Channels are stored in name order, planar per scanline */
+  static const char channel_names[4] = { 'A', 'B', 'G', 'R' };
+  static const uint32_t channel_offsets[4] = { 3, 2, 1, 0 };
+  uint8_t channels[4 * 18 + 1];
+  int32_t header[2], window[4], line[2];
+  float aspect = 1.0f, center[2] = { 0.0f, 0.0f };
+  uint8_t compression = 0, line_order = 0;
+  uint64_t offset, line_size = 8 + (uint64_t)width * 4 * 2;
+  uint16_t *row;
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+
+  /* Header */
+  header[0] = EXR_MAGIC;
+  header[1] = EXR_VERSION;
+  fwrite(header, sizeof(int32_t), 2, file);
+  memset(channels, 0, sizeof(channels));
+  for (uint32_t c = 0; c < 4; c++) {
+    uint8_t *channel = channels + c * 18;
+    int32_t type = EXR_HALF, sampling = 1;
+    channel[0] = (uint8_t)channel_names[c];
+    memcpy(channel + 2, &type, 4);
+    memcpy(channel + 10, &sampling, 4);
+    memcpy(channel + 14, &sampling, 4);
+  }
+  exr_attribute(file, "channels", "chlist", channels, sizeof(channels));
+  exr_attribute(file, "compression", "compression", &compression, 1);
+  window[0] = 0;
+  window[1] = 0;
+  window[2] = (int32_t)width - 1;
+  window[3] = (int32_t)height - 1;
+  exr_attribute(file, "dataWindow", "box2i", window, sizeof(window));
+  exr_attribute(file, "displayWindow", "box2i", window, sizeof(window));
+  exr_attribute(file, "lineOrder", "lineOrder", &line_order, 1);
+  exr_attribute(file, "pixelAspectRatio", "float", &aspect, sizeof(aspect));
+  exr_attribute(file, "screenWindowCenter", "v2f", center, sizeof(center));
+  exr_attribute(file, "screenWindowWidth", "float", &aspect, sizeof(aspect));
+  fputc(0, file);
+
+  /* Line offsets, then one uncompressed line per block */
+  offset = (uint64_t)ftell(file) + sizeof(uint64_t) * height;
+  for (uint32_t y = 0; y < height; y++) {
+    fwrite(&offset, sizeof(offset), 1, file);
+    offset += line_size;
+  }
+  row = (uint16_t *)malloc(sizeof(uint16_t) * 4 * (size_t)width);
+  ASSERT(row);
+  for (uint32_t y = 0; y < height; y++) {
+    const uint16_t *from =
+      (const uint16_t *)((const uint8_t *)pixels + stride * y);
+    line[0] = (int32_t)y;
+    line[1] = (int32_t)(line_size - 8);
+    for (uint32_t c = 0; c < 4; c++) {
+      uint16_t *to = row + (size_t)width * c;
+      for (uint32_t x = 0; x < width; x++)
+        to[x] = from[(size_t)x * 4 + channel_offsets[c]];
+    }
+    fwrite(line, sizeof(int32_t), 2, file);
+    fwrite(row, sizeof(uint16_t), (size_t)width * 4, file);
+  }
+  free(row);
+  return close_file(file);
+}
+/* Write rows of pixels as they are (false on failure) */
+bool image_write_raw(
+    const char *path,
+    uint32_t height,
+    const void *pixels,
+    size_t row_size,
+    size_t stride
+) {
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+  if (stride == row_size)
+    fwrite(pixels, row_size, height, file);
+  else for (uint32_t y = 0; y < height; y++)
+    fwrite((const uint8_t *)pixels + stride * y, 1, row_size, file);
+  return close_file(file);
+}
@@ -0,0 +1,167 @@
+/* Implements init_graph.h */
+#include <init_graph.h>
+#include <telemetry.h>
+#include <profile.h>
+#include <sched.h>
+
+/* Width of the timeline bars */
+#define TIMELINE_WIDTH 40
+
+/* Run a stage, recording when and where */
+static void run_stage(void *arg) {
+  init_stage_t *stage = (init_stage_t *)arg;
+  init_graph_t *graph = stage->graph;
+  stage->worker = jobs_worker_index(graph->jobs);
+  PROFILE_BEGIN(stage->name);
+  stage->start = time_now();
+  stage->ok = stage->fn(stage->arg);
+  stage->end = time_now();
+  PROFILE_END();
+  if (stage->ok)
+    atomic_fetch_or(
+        &graph->done,
+        (uint_fast64_t)1 << (stage - graph->stages)
+    );
+  else {
+    log_msg(LOG_LEVEL_ERROR, "Startup stage '%s' failed", stage->name);
+    atomic_store(&graph->failed, true);
+  }
+}
+
+/* Create an empty graph */
+void init_graph_create(init_graph_t *graph) {
+  memset(graph, 0, sizeof(init_graph_t));
+  atomic_init(&graph->done, 0);
+  atomic_init(&graph->failed, false);
+  atomic_init(&graph->in_flight.value, 0);
+}
+/* Add a stage, returning its index */
+uint32_t init_graph_add(
+    init_graph_t *graph,
+    const char *name,
+    init_stage_fn_t fn,
+    void *arg,
+    bool main_thread
+) {
+  init_stage_t *stage;
+  ASSERT(graph->stage_count < INIT_GRAPH_MAX_STAGES);
+  stage = &graph->stages[graph->stage_count];
+  stage->name = name;
+  stage->fn = fn;
+  stage->arg = arg;
+  stage->main_thread = main_thread;
+  stage->worker = JOBS_NOT_WORKER;
+  stage->graph = graph;
+  return graph->stage_count++;
+}
+/* Make a stage wait for another */
+void init_graph_depend(
+    init_graph_t *graph,
+    uint32_t stage,
+    uint32_t dependency
+) {
+  ASSERT(stage < graph->stage_count && dependency < graph->stage_count);
+  ASSERT(stage != dependency);
+  graph->stages[stage].dependencies |= (uint64_t)1 << dependency;
+}
+/* Run every stage (false if any failed) */
+bool init_graph_run(init_graph_t *graph, jobs_t *jobs) {
+  graph->jobs = jobs;
+  graph->start_time = time_now();
+  for (;;) {
+    /* Sample in-flight first: an idle graph has published all its bits */
+    bool idle = jobs_done(&graph->in_flight);
+    uint64_t done = atomic_load(&graph->done);
+    bool failed = atomic_load(&graph->failed);
+    bool waiting = false, main_waiting = false, progress = false;
+    init_stage_t *main_stage = NULL;
+
+    /* Launch ready worker stages before running one on this thread */
+    for (uint32_t i = 0; i < graph->stage_count && !failed; i++) {
+      init_stage_t *stage = &graph->stages[i];
+      if (stage->launched) continue;
+      if ((stage->dependencies & done) != stage->dependencies) {
+        waiting = true;
+        main_waiting |= stage->main_thread;
+        continue;
+      }
+      if (stage->main_thread) {
+        if (!main_stage) main_stage = stage;
+        continue;
+      }
+      stage->launched = true;
+      stage->job.fn = run_stage;
+      stage->job.arg = stage;
+      stage->job.counter = &graph->in_flight;
+      jobs_submit(jobs, &stage->job);
+      progress = true;
+    }
+    if (main_stage) {
+      main_stage->launched = true;
+      run_stage(main_stage);
+      progress = true;
+    }
+    if (progress) continue;
+    if (idle && (failed || !waiting)) break;
+    if (idle) {
+      log_msg(LOG_LEVEL_ERROR, "Startup graph has a dependency cycle");
+      atomic_store(&graph->failed, true);
+      break;
+    }
+
+    /*
+     * Help with worker stages, unless a main thread stage is about to become
+     * ready (the workers take them then)
+     */
+    if (main_waiting || !jobs_run_one(jobs))
+      sched_yield();
+  }
+  graph->end_time = time_now();
+  return !atomic_load(&graph->failed);
+}
+/* Log the stage timeline and report it as telemetry */
+void init_graph_report(const init_graph_t *graph) {
+  double total = graph->end_time - graph->start_time;
+  char bar[TIMELINE_WIDTH + 1];
+  char name[TELEMETRY_MAX_NAME];
+  char worker[16];
+
+  log_msg(LOG_LEVEL_INFO, "Startup timeline (%.2f ms):", total * 1e3);
+  for (uint32_t i = 0; i < graph->stage_count; i++) {
+    const init_stage_t *stage = &graph->stages[i];
+    double start = stage->start - graph->start_time;
+    double end = stage->end - graph->start_time;
+    uint32_t first, last;
+
+    if (!stage->launched) {
+      log_msg(LOG_LEVEL_INFO, "  %-20s skipped", stage->name);
+      continue;
+    }
+    first = total > 0.0 ? (uint32_t)(start / total * TIMELINE_WIDTH) : 0;
+    last = total > 0.0 ? (uint32_t)(end / total * TIMELINE_WIDTH) : 0;
+    if (last >= TIMELINE_WIDTH) last = TIMELINE_WIDTH - 1;
+    if (first > last) first = last;
+    for (uint32_t c = 0; c < TIMELINE_WIDTH; c++)
+      bar[c] = c >= first && c <= last ? '#' : '.';
+    bar[TIMELINE_WIDTH] = '\0';
+    /* Stages run on the calling thread aren't on a worker */
+    if (stage->worker == JOBS_NOT_WORKER)
+      snprintf(worker, sizeof(worker), " -");
+    else
+      snprintf(worker, sizeof(worker), "%2u", stage->worker);
+    log_msg(
+        LOG_LEVEL_INFO,
+        "  %-20s %8.2f - %8.2f ms %8.2f ms worker %s%s |%s|",
+        stage->name,
+        start * 1e3,
+        end * 1e3,
+        (end - start) * 1e3,
+        worker,
+        stage->main_thread ? " (main)" : "       ",
+        bar
+    );
+    snprintf(name, sizeof(name), "init.%s", stage->name);
+    telemetry_report(name, TELEMETRY_TIMING, (end - start) * 1e3);
+  }
+  telemetry_report("init.total", TELEMETRY_TIMING, total * 1e3);
+}
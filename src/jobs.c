@@ -0,0 +1,509 @@
+/* Implements jobs.h */
+#include <jobs.h>
+#include <sched.h>
+#include <unistd.h>
+
+/* Spins before an idle worker sleeps */
+#define JOBS_SPIN_COUNT 64
+
+/* Types */
+/* Worker thread arguments */
+typedef struct {
+  jobs_t *jobs;
+  uint32_t index;
+} worker_args_t;
+
+/* Calling thread's job system and worker index */
+static _Thread_local const jobs_t *local_jobs = NULL;
+static _Thread_local uint32_t local_worker = JOBS_NOT_WORKER;
+
+/* Hint to the CPU that this is a spin loop */
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+/* Step a xorshift generator */
+static uint32_t xorshift(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+/* Read an integer from a sysfs file (-1 on failure) */
+static int32_t read_sysfs_int(const char *path) {
+  FILE *file = fopen(path, "r");
+  int value = -1;
+  if (!file) return -1;
+  if (fscanf(file, "%d", &value) != 1) value = -1;
+  fclose(file);
+  return value;
+}
+/* Get the first logical CPU of each physical core we may run on */
+static uint32_t physical_core_cpus(int32_t *cpus, uint32_t max) {
+  cpu_set_t set;
+  int32_t seen[CPU_SETSIZE][2];
+  uint32_t count = 0;
+
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) return 0;
+  for (int32_t cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+    char path[128];
+    int32_t core, package;
+    bool duplicate = false;
+    if (!CPU_ISSET(cpu, &set)) continue;
+    snprintf(
+        path,
+        sizeof(path),
+        "/sys/devices/system/cpu/cpu%d/topology/core_id",
+        cpu
+    );
+    core = read_sysfs_int(path);
+    snprintf(
+        path,
+        sizeof(path),
+        "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+        cpu
+    );
+    package = read_sysfs_int(path);
+    if (core < 0 || package < 0) {
+      /* No topology: treat every CPU as a core */
+      core = cpu;
+      package = 0;
+    }
+    for (uint32_t i = 0; i < count && !duplicate; i++)
+      duplicate = seen[i][0] == core && seen[i][1] == package;
+    if (duplicate) continue;
+    seen[count][0] = core;
+    seen[count][1] = package;
+    if (cpus) cpus[count] = cpu;
+    count++;
+  }
+  return count;
+}
+
+/* Push a job to the bottom of a deque (owner only, false if full) */
+static bool deque_push(job_deque_t *deque, job_t *job) {
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if (bottom - top >= JOBS_DEQUE_CAPACITY) return false;
+  atomic_store_explicit(
+      &deque->buffer[bottom & (JOBS_DEQUE_CAPACITY - 1)],
+      job,
+      memory_order_relaxed
+  );
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  return true;
+}
+/* Pop a job from the bottom of a deque (owner only) */
+static job_t *deque_pop(job_deque_t *deque) {
+  int64_t bottom =
+    atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  int64_t top;
+  job_t *job = NULL;
+
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (top <= bottom) {
+    job = atomic_load_explicit(
+        &deque->buffer[bottom & (JOBS_DEQUE_CAPACITY - 1)],
+        memory_order_relaxed
+    );
+    if (top == bottom) {
+      /* Last job: race thieves for it */
+      if (!atomic_compare_exchange_strong_explicit(
+            &deque->top,
+            &top,
+            top + 1,
+            memory_order_seq_cst,
+            memory_order_relaxed
+      )) {
+        atomic_fetch_add_explicit(
+            &deque->contention,
+            1,
+            memory_order_relaxed
+        );
+        job = NULL;
+      }
+      atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return job;
+}
+/* Steal a job from the top of a deque */
+static job_t *deque_steal(job_deque_t *deque) {
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  int64_t bottom;
+  job_t *job;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom) return NULL;
+  job = atomic_load_explicit(
+      &deque->buffer[top & (JOBS_DEQUE_CAPACITY - 1)],
+      memory_order_relaxed
+  );
+  if (!atomic_compare_exchange_strong_explicit(
+        &deque->top,
+        &top,
+        top + 1,
+        memory_order_seq_cst,
+        memory_order_relaxed
+  )) {
+    atomic_fetch_add_explicit(&deque->contention, 1, memory_order_relaxed);
+    return NULL;
+  }
+  atomic_fetch_add_explicit(&deque->stolen, 1, memory_order_relaxed);
+  return job;
+}
+/* Pop a job submitted from outside the workers */
+static job_t *injected_pop(jobs_t *jobs) {
+  job_t *job = NULL;
+  pthread_mutex_lock(&jobs->mutex);
+  if (atomic_load(&jobs->injected_count) > 0) {
+    job = jobs->injected[jobs->injected_head];
+    jobs->injected_head =
+      (jobs->injected_head + 1) % jobs->injected_capacity;
+    atomic_fetch_sub(&jobs->injected_count, 1);
+  }
+  pthread_mutex_unlock(&jobs->mutex);
+  return job;
+}
+/* Check if any job is queued */
+static bool has_work(jobs_t *jobs) {
+  if (atomic_load(&jobs->injected_count) > 0) return true;
+  for (uint32_t i = 0; i < jobs->worker_count; i++) {
+    if (
+        atomic_load(&jobs->deques[i].bottom)
+        > atomic_load(&jobs->deques[i].top)
+    ) return true;
+  }
+  return false;
+}
+/* Find a job: own deque, then submitted jobs, then other deques */
+static job_t *find_job(jobs_t *jobs, uint32_t self, uint32_t *seed) {
+  job_t *job;
+  uint32_t start;
+  if (self != JOBS_NOT_WORKER && (job = deque_pop(&jobs->deques[self])))
+    return job;
+  if (atomic_load(&jobs->injected_count) > 0 && (job = injected_pop(jobs)))
+    return job;
+  start = xorshift(seed) % jobs->worker_count;
+  for (uint32_t i = 0; i < jobs->worker_count; i++) {
+    uint32_t victim = (start + i) % jobs->worker_count;
+    if (victim == self) continue;
+    if ((job = deque_steal(&jobs->deques[victim]))) return job;
+  }
+  return NULL;
+}
+/* Run a job and count it done */
+static void run_job(jobs_t *jobs, job_t *job, uint32_t self) {
+  job_counter_t *counter = job->counter;
+  job->fn(job->arg);
+  if (self != JOBS_NOT_WORKER)
+    atomic_fetch_add_explicit(
+        &jobs->deques[self].executed,
+        1,
+        memory_order_relaxed
+    );
+  /* The job may be freed as soon as its counter drops */
+  if (counter && atomic_fetch_sub(&counter->value, 1) == 1) {
+    /* Wake threads parked in jobs_wait */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&jobs->waiting) == 0) return;
+    pthread_mutex_lock(&jobs->mutex);
+    pthread_cond_broadcast(&jobs->wake_cond);
+    pthread_mutex_unlock(&jobs->mutex);
+  }
+}
+/* Wake a sleeping worker */
+static void wake_worker(jobs_t *jobs) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&jobs->sleeping) == 0) return;
+  pthread_mutex_lock(&jobs->mutex);
+  pthread_cond_signal(&jobs->wake_cond);
+  pthread_mutex_unlock(&jobs->mutex);
+}
+/* Worker thread */
+static void *worker_main(void *arg) {
+  worker_args_t *args = (worker_args_t *)arg;
+  jobs_t *jobs = args->jobs;
+  uint32_t self = args->index, seed = 0x9e3779b9u * (self + 1);
+  uint32_t spins = 0;
+
+  local_jobs = jobs;
+  local_worker = self;
+  free(args);
+  for (;;) {
+    job_t *job = find_job(jobs, self, &seed);
+    if (job) {
+      run_job(jobs, job, self);
+      spins = 0;
+      continue;
+    }
+    if (atomic_load(&jobs->stopping)) break;
+    if (++spins < JOBS_SPIN_COUNT) {
+      cpu_relax();
+      continue;
+    }
+
+    /* Sleep until a submission, rechecking after announcing it */
+    pthread_mutex_lock(&jobs->mutex);
+    atomic_fetch_add(&jobs->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!has_work(jobs) && !atomic_load(&jobs->stopping))
+      pthread_cond_wait(&jobs->wake_cond, &jobs->mutex);
+    atomic_fetch_sub(&jobs->sleeping, 1);
+    pthread_mutex_unlock(&jobs->mutex);
+    spins = 0;
+  }
+  return NULL;
+}
+
+/* Range of a parallel for */
+typedef struct {
+  job_t job;
+  jobs_for_fn_t fn;
+  void *arg;
+  uint32_t begin;
+  uint32_t end;
+} for_range_t;
+/* Run a range of a parallel for */
+static void for_range(void *arg) {
+  for_range_t *range = (for_range_t *)arg;
+  range->fn(range->arg, range->begin, range->end);
+}
+
+/* Get the number of physical cores */
+uint32_t jobs_physical_cores(void) {
+  uint32_t count = physical_core_cpus(NULL, CPU_SETSIZE);
+  if (count == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    count = online > 0 ? (uint32_t)online : 1;
+  }
+  return count;
+}
+/* Create a job system (0 workers for one per physical core) */
+void jobs_create(jobs_t *jobs, uint32_t worker_count, bool pin) {
+  uint32_t core_count;
+
+  memset(jobs, 0, sizeof(jobs_t));
+  if (worker_count == 0) worker_count = jobs_physical_cores();
+  jobs->worker_count = worker_count;
+  jobs->deques = (job_deque_t *)aligned_alloc(
+      64,
+      sizeof(job_deque_t) * worker_count
+  );
+  jobs->threads = (pthread_t *)calloc(worker_count, sizeof(pthread_t));
+  jobs->cpus = (int32_t *)malloc(sizeof(int32_t) * CPU_SETSIZE);
+  jobs->injected_capacity = 64;
+  jobs->injected = (job_t **)malloc(sizeof(job_t *) * jobs->injected_capacity);
+  ASSERT(jobs->deques && jobs->threads && jobs->cpus && jobs->injected);
+  for (uint32_t i = 0; i < worker_count; i++) {
+    job_deque_t *deque = &jobs->deques[i];
+    memset(deque, 0, sizeof(job_deque_t));
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->executed, 0);
+    atomic_init(&deque->stolen, 0);
+    atomic_init(&deque->contention, 0);
+    deque->buffer = (_Atomic(job_t *) *)calloc(
+        JOBS_DEQUE_CAPACITY,
+        sizeof(_Atomic(job_t *))
+    );
+    ASSERT(deque->buffer);
+  }
+  pthread_mutex_init(&jobs->mutex, NULL);
+  pthread_cond_init(&jobs->wake_cond, NULL);
+  atomic_init(&jobs->sleeping, 0);
+  atomic_init(&jobs->waiting, 0);
+  atomic_init(&jobs->stopping, false);
+  atomic_init(&jobs->injected_count, 0);
+
+  /* Start workers, one per physical core (the creator isn't one) */
+  core_count = pin ? physical_core_cpus(jobs->cpus, CPU_SETSIZE) : 0;
+  for (uint32_t i = 0; i < worker_count; i++) {
+    worker_args_t *args = (worker_args_t *)malloc(sizeof(worker_args_t));
+    int result;
+    ASSERT(args);
+    args->jobs = jobs;
+    args->index = i;
+    result = pthread_create(&jobs->threads[i], NULL, worker_main, args);
+    ASSERT(result == 0);
+    if (core_count > 1) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(jobs->cpus[i % core_count], &set);
+      if (pthread_setaffinity_np(jobs->threads[i], sizeof(set), &set) != 0)
+        log_msg(LOG_LEVEL_WARN, "Failed to pin job worker %u", i);
+    }
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Job system: %u workers%s",
+      worker_count,
+      core_count > 1 ? ", pinned to physical cores" : ""
+  );
+}
+/* Queue a job (incrementing its counter) */
+void jobs_submit(jobs_t *jobs, job_t *job) {
+  if (job->counter) atomic_fetch_add(&job->counter->value, 1);
+  if (local_jobs == jobs && local_worker != JOBS_NOT_WORKER) {
+    if (!deque_push(&jobs->deques[local_worker], job)) {
+      run_job(jobs, job, local_worker);
+      return;
+    }
+  } else {
+    pthread_mutex_lock(&jobs->mutex);
+
+    /* Grow the queue, unwrapping it */
+    if (atomic_load(&jobs->injected_count) == jobs->injected_capacity) {
+      uint32_t count = atomic_load(&jobs->injected_count);
+      job_t **injected =
+        (job_t **)malloc(sizeof(job_t *) * jobs->injected_capacity * 2);
+      ASSERT(injected);
+      for (uint32_t i = 0; i < count; i++) {
+        injected[i] = jobs->injected[
+          (jobs->injected_head + i) % jobs->injected_capacity
+        ];
+      }
+      free(jobs->injected);
+      jobs->injected = injected;
+      jobs->injected_head = 0;
+      jobs->injected_capacity *= 2;
+    }
+    jobs->injected[
+      (jobs->injected_head + atomic_load(&jobs->injected_count))
+        % jobs->injected_capacity
+    ] = job;
+    atomic_fetch_add(&jobs->injected_count, 1);
+    pthread_mutex_unlock(&jobs->mutex);
+  }
+  wake_worker(jobs);
+}
+/* Run jobs until a counter reaches zero */
+void jobs_wait(jobs_t *jobs, job_counter_t *counter) {
+  uint32_t self = local_jobs == jobs ? local_worker : JOBS_NOT_WORKER;
+  uint32_t seed = 0x2545f491u, spins = 0;
+  while (atomic_load(&counter->value) > 0) {
+    job_t *job = find_job(jobs, self, &seed);
+    if (job) {
+      run_job(jobs, job, self);
+      spins = 0;
+      continue;
+    }
+    if (++spins < JOBS_SPIN_COUNT) {
+      cpu_relax();
+      continue;
+    }
+
+    /* Park until a submission or the counter's last job finishing */
+    pthread_mutex_lock(&jobs->mutex);
+    atomic_fetch_add(&jobs->waiting, 1);
+    atomic_fetch_add(&jobs->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&counter->value) > 0 && !has_work(jobs))
+      pthread_cond_wait(&jobs->wake_cond, &jobs->mutex);
+    atomic_fetch_sub(&jobs->sleeping, 1);
+    atomic_fetch_sub(&jobs->waiting, 1);
+    pthread_mutex_unlock(&jobs->mutex);
+    spins = 0;
+  }
+}
+/* Run one queued job if there is one (false if none was found) */
+bool jobs_run_one(jobs_t *jobs) {
+  uint32_t self = local_jobs == jobs ? local_worker : JOBS_NOT_WORKER;
+  uint32_t seed = 0x2545f491u;
+  job_t *job = find_job(jobs, self, &seed);
+  if (!job) return false;
+  run_job(jobs, job, self);
+  return true;
+}
+/* Check if a counter has reached zero */
+bool jobs_done(const job_counter_t *counter) {
+  return atomic_load(&((job_counter_t *)counter)->value) == 0;
+}
+/* Split [0, count) into ranges of at least grain and run them in parallel */
+void jobs_parallel_for(
+    jobs_t *jobs,
+    jobs_for_fn_t fn,
+    void *arg,
+    uint32_t count,
+    uint32_t grain
+) {
+  job_counter_t counter;
+  for_range_t *ranges;
+  uint32_t range_count, size;
+
+  if (grain == 0) grain = 1;
+  range_count = (count + grain - 1) / grain;
+  if (range_count > jobs->worker_count * 4)
+    range_count = jobs->worker_count * 4;
+  if (range_count <= 1) {
+    if (count > 0) fn(arg, 0, count);
+    return;
+  }
+
+  size = (count + range_count - 1) / range_count;
+  ranges = (for_range_t *)malloc(sizeof(for_range_t) * range_count);
+  ASSERT(ranges);
+  atomic_init(&counter.value, 0);
+  for (uint32_t i = 0; i < range_count; i++) {
+    ranges[i].job.fn = for_range;
+    ranges[i].job.arg = &ranges[i];
+    ranges[i].job.counter = &counter;
+    ranges[i].fn = fn;
+    ranges[i].arg = arg;
+    ranges[i].begin = i * size < count ? i * size : count;
+    ranges[i].end = (i + 1) * size < count ? (i + 1) * size : count;
+    jobs_submit(jobs, &ranges[i].job);
+  }
+  jobs_wait(jobs, &counter);
+  free(ranges);
+}
+/* Get the calling thread's worker index (JOBS_NOT_WORKER if none) */
+uint32_t jobs_worker_index(const jobs_t *jobs) {
+  return local_jobs == jobs ? local_worker : JOBS_NOT_WORKER;
+}
+/* Get a deque's statistics */
+job_stats_t jobs_stats(const jobs_t *jobs, uint32_t worker) {
+  job_deque_t *deque = &jobs->deques[worker];
+  job_stats_t stats;
+  stats.executed = atomic_load(&deque->executed);
+  stats.stolen = atomic_load(&deque->stolen);
+  stats.contention = atomic_load(&deque->contention);
+  return stats;
+}
+/* Destroy a job system (finishing queued jobs) */
+void jobs_destroy(jobs_t *jobs) {
+  uint32_t seed = 0x2545f491u;
+  job_t *job;
+
+  /* Help drain, then stop workers once nothing is left */
+  while ((job = find_job(jobs, jobs_worker_index(jobs), &seed)))
+    run_job(jobs, job, jobs_worker_index(jobs));
+  pthread_mutex_lock(&jobs->mutex);
+  atomic_store(&jobs->stopping, true);
+  pthread_cond_broadcast(&jobs->wake_cond);
+  pthread_mutex_unlock(&jobs->mutex);
+  for (uint32_t i = 0; i < jobs->worker_count; i++)
+    pthread_join(jobs->threads[i], NULL);
+
+  if (local_jobs == jobs) {
+    local_jobs = NULL;
+    local_worker = JOBS_NOT_WORKER;
+  }
+  pthread_mutex_destroy(&jobs->mutex);
+  pthread_cond_destroy(&jobs->wake_cond);
+  for (uint32_t i = 0; i < jobs->worker_count; i++)
+    free(jobs->deques[i].buffer);
+  free(jobs->deques);
+  free(jobs->threads);
+  free(jobs->cpus);
+  free(jobs->injected);
+  memset(jobs, 0, sizeof(jobs_t));
+}
@@ -14,11 +14,57 @@
 #include <vk_phys_dev.h>
 #include <vk_dev.h>
 #include <vk_swapchain.h>
+#include <vk_present.h>
+#include <jobs.h>
+#include <init_graph.h>
+#include <asset_pack.h>
+#include <vk_pipeline_cache.h>
+#include <vk_phys_dev_probe.h>
+#include <vk_pipelines.h>
+#include <spsc_queue.h>
+#include <vk_submit.h>
+#include <vk_frame_alloc.h>
+#include <vk_residency.h>
+#include <vk_stream.h>
+#include <transcode.h>
+#include <vk_capture.h>
+#include <telemetry.h>
+#include <profile.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+/* Frames recorded ahead of the GPU */
+#define FRAMES_IN_FLIGHT 2
+/* Pipeline cache file */
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+/* Device probe cache file */
+#define PROBE_CACHE_PATH "device_probe.bin"
+/* Compiled shaders (for the device probe) */
+#define SHADER_DIR "bin/shaders"
+/* Dynamic uniform and vertex data per frame (bytes) */
+#define FRAME_ALLOC_SIZE (4u * 1024u * 1024u)
+/* Environment variable naming a file to capture Vulkan calls to */
+#define CAPTURE_ENV "VK_RENDERER_CAPTURE"
+/* Profiler trace written at exit */
+#define PROFILE_TRACE_PATH "trace.json"
+/* Events buffered between the event and render threads */
+#define EVENT_QUEUE_CAPACITY 1024
+/* Longest the event thread sleeps before rechecking for shutdown (ms) */
+#define EVENT_WAIT_TIMEOUT 100
+/* Key that logs the performance warnings seen so far */
+#define REPORT_KEY SDLK_F9
 
 /* App state */
 static struct {
   SDL_Window *window;
-  bool running;
+  uint32_t window_id;
+  atomic_bool running;
+  double start_time;
+  spsc_queue_t events;
+  sem_t wake;
+  atomic_bool render_sleeping;
+  pthread_t render_thread;
   bool same_queue_families;
   uint32_t width, height;
   vk_inst_t instance;
@@ -26,12 +72,29 @@ static struct {
   vk_phys_dev_t physical_device;
   vk_phys_dev_info_t physical_device_info;
   vk_dev_t device;
-  vk_swapchain_t swapchain;
+  vk_present_t present;
+  vk_submit_t submit;
+  vk_residency_t residency;
+  vk_pipeline_cache_t pipeline_cache;
+  vk_pipelines_t pipelines;
+  VkCommandPool command_pool;
+  VkCommandBuffer command_buffers[FRAMES_IN_FLIGHT];
+  vk_sync_point_t frame_done[FRAMES_IN_FLIGHT];
+  vk_frame_alloc_t frame_alloc;
+#if PROFILE_ENABLED
+  profile_gpu_t profiler;
+#endif
+  const char *asset_pack_path;
+  asset_pack_t asset_pack;
+  bool asset_pack_open;
+  vk_stream_t stream;
+  bool stream_created;
+  jobs_t jobs;
 } app_state;
 
-/* Get required instance extensions */
+/* Get required instance extensions (no window needed once loaded) */
 static void get_required_exts(const char **exts, uint32_t *count) {
-  SDL_Vulkan_GetInstanceExtensions(app_state.window, count, exts);
+  SDL_Vulkan_GetInstanceExtensions(NULL, count, exts);
 }
 /* Create surface */
 static VkSurfaceKHR create_surface(const VkInstance instance) {
@@ -41,16 +104,9 @@ static VkSurfaceKHR create_surface(const VkInstance instance) {
 }
 /* Score physical device */
 static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
-  switch (info->properties.deviceType) {
-    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-      return 1000;
-    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-      return 250;
-    case VK_PHYSICAL_DEVICE_TYPE_CPU:
-      return 125;
-    default:
-      return 0;
-  }
+  if (!info->queue_families.present_supported) return 0;
+  if (!info->features12.timelineSemaphore) return 0;
+  return vk_phys_dev_score(info);
 }
 static void app_create_instance(void) {
   vk_inst_builder_t builder = vk_inst_builder();
@@ -59,6 +115,7 @@ static void app_create_instance(void) {
   vk_inst_builder_set_app_name(&builder, "vk-renderer test");
   vk_inst_builder_set_app_version(&builder, 0, 0, 1);
   vk_inst_builder_add_layer(&builder, "VK_LAYER_KHRONOS_validation");
+  vk_inst_builder_use_best_practices(&builder);
   vk_inst_builder_add_ext(&builder, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   app_state.instance = vk_inst_create(&builder);
   log_msg(LOG_LEVEL_SUCCESS, "Created Vulkan instance");
@@ -68,10 +125,12 @@ static void app_create_surface(void) {
   log_msg(LOG_LEVEL_SUCCESS, "Created Vulkan surface");
 }
 static void app_create_device(void) {
-  app_state.physical_device = vk_phys_dev_choose(
+  app_state.physical_device = vk_phys_dev_choose_fastest(
       score_physical_device,
       &app_state.instance,
-      &app_state.surface
+      &app_state.surface,
+      SHADER_DIR,
+      PROBE_CACHE_PATH
   );
   vk_phys_dev_get_info(
       app_state.physical_device,
@@ -92,8 +151,42 @@ static void app_create_device(void) {
         "Same queue family used for graphics and presentation"
     );
   vk_dev_builder_t builder = vk_dev_builder();
+  VkPhysicalDeviceVulkan12Features features12;
+#if PROFILE_ENABLED
+  VkPhysicalDeviceFeatures features;
+#endif
+  memset(&features12, 0, sizeof(features12));
+  features12.timelineSemaphore = VK_TRUE;
+  vk_dev_builder_add_features12(&builder, features12);
   vk_dev_builder_add_ext(&builder, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
   vk_dev_builder_add_layer(&builder, "VK_LAYER_KHRONOS_validation");
+  /* Extension features are only enabled when the device reports them */
+  if (app_state.physical_device_info.synchronization2.synchronization2)
+    vk_dev_builder_add_synchronization2(&builder);
+  if (
+      app_state.physical_device_info.graphics_pipeline_library
+        .graphicsPipelineLibrary
+  ) vk_dev_builder_add_graphics_pipeline_library(&builder);
+  if (app_state.physical_device_info.maintenance5.maintenance5)
+    vk_dev_builder_add_maintenance5(&builder);
+  if (vk_phys_dev_supports_ext(
+        &app_state.physical_device_info,
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+  )) vk_dev_builder_add_ext(&builder, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+#if PROFILE_ENABLED
+  /* Profiling wants calibrated timestamps and pipeline statistics */
+  if (vk_phys_dev_supports_ext(
+        &app_state.physical_device_info,
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME
+  )) vk_dev_builder_add_ext(
+      &builder,
+      VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME
+  );
+  memset(&features, 0, sizeof(features));
+  features.pipelineStatisticsQuery =
+    app_state.physical_device_info.features.pipelineStatisticsQuery;
+  vk_dev_builder_add_features(&builder, features);
+#endif
   if (app_state.same_queue_families)
     vk_dev_builder_add_present_queue(&builder, 1.0f);
   else {
@@ -106,97 +199,405 @@ static void app_create_device(void) {
       &builder
   );
   log_msg(LOG_LEVEL_SUCCESS, "Created Vulkan device");
+  vk_submit_create(&app_state.submit, &app_state.device);
+  vk_residency_create(
+      &app_state.residency,
+      &app_state.device,
+      app_state.physical_device,
+      &app_state.physical_device_info
+  );
 }
 static void app_create_swapchain(void) {
-  vk_swapchain_builder_t builder = vk_swapchain_builder();
-  uint32_t image_count =
-    app_state.physical_device_info.surface_capabilities.minImageCount + 1;
-  if (
-    app_state.physical_device_info.surface_capabilities.maxImageCount > 0 &&
-    image_count
-    > app_state.physical_device_info.surface_capabilities.maxImageCount
-  ) image_count =
-      app_state.physical_device_info.surface_capabilities.maxImageCount;
-  for (
-      uint32_t i = 0;
-      i < app_state.physical_device_info.surface_formats_count;
-      i++
-  ) {
-    if (
-      app_state.physical_device_info.surface_formats[i].format
-      == VK_FORMAT_B8G8R8A8_SRGB
-    ) {
-      vk_swapchain_builder_set_format(
-          &builder, 
-          app_state.physical_device_info.surface_formats[i]
-      );
-      break;
-    }
+  uint32_t view;
+  vk_present_create(
+      &app_state.present,
+      &app_state.device,
+      app_state.physical_device,
+      &app_state.physical_device_info,
+      FRAMES_IN_FLIGHT
+  );
+  /* Views are keyed by SDL window ID, as window events carry it */
+  view = vk_present_add(
+      &app_state.present,
+      app_state.surface,
+      app_state.width,
+      app_state.height,
+      (void *)(uintptr_t)app_state.window_id
+  );
+  ASSERT(view != UINT32_MAX);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Swapchain image count: %d",
+      app_state.present.views[view].swapchain.image_count
+  );
+  log_msg(LOG_LEVEL_SUCCESS, "Created Vulkan swapchain");
+}
+static void app_create_frame_resources(void) {
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo alloc_info;
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex =
+    app_state.physical_device_info.queue_families.graphics_index;
+  VK_CHECK(vkCreateCommandPool(
+        app_state.device.device,
+        &pool_info,
+        NULL,
+        &app_state.command_pool
+  ));
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.commandPool = app_state.command_pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = FRAMES_IN_FLIGHT;
+  VK_CHECK(vkAllocateCommandBuffers(
+        app_state.device.device,
+        &alloc_info,
+        app_state.command_buffers
+  ));
+  for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    app_state.frame_done[i].timeline = NULL;
+    app_state.frame_done[i].value = 0;
   }
-  vk_swapchain_builder_set_extent(&builder, app_state.width, app_state.height);
-  vk_swapchain_builder_set_image_count(&builder, image_count);
-  vk_swapchain_builder_set_present_mode(&builder, VK_PRESENT_MODE_FIFO_KHR);
-  vk_swapchain_builder_set_clipped(&builder, true);
-  vk_swapchain_builder_set_image_usage(
-      &builder,
-      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+  vk_frame_alloc_create(
+      &app_state.frame_alloc,
+      &app_state.device,
+      &app_state.physical_device_info,
+      FRAME_ALLOC_SIZE,
+      FRAMES_IN_FLIGHT
   );
-  vk_swapchain_builder_set_image_array_layers(&builder, 1);
-  vk_swapchain_builder_set_old_swapchain(&builder, VK_NULL_HANDLE);
-  vk_swapchain_builder_set_pre_transform(
-      &builder,
-      VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR
+#if PROFILE_ENABLED
+  profile_gpu_create(
+      &app_state.profiler,
+      &app_state.instance,
+      app_state.physical_device,
+      &app_state.device,
+      &app_state.physical_device_info,
+      FRAMES_IN_FLIGHT,
+      app_state.physical_device_info.features.pipelineStatisticsQuery
   );
-  vk_swapchain_builder_set_composite_alpha(
+#endif
+  log_msg(LOG_LEVEL_SUCCESS, "Created frame resources");
+}
+static void app_create_textures(void) {
+  vk_stream_builder_t builder;
+  const asset_pack_t *pack = &app_state.asset_pack;
+  uint32_t texture_count = 0, graphics_family;
+
+  if (!app_state.asset_pack_open) return;
+  for (uint32_t i = 0; i < pack->chunk_count; i++)
+    if (pack->chunks[i].type == ASSET_CHUNK_TEXTURE) texture_count++;
+  if (texture_count == 0) return;
+
+  /* Stream the pack's textures, uploading on the graphics queue */
+  graphics_family =
+    app_state.physical_device_info.queue_families.graphics_index;
+  builder = vk_stream_builder();
+  vk_stream_builder_set_max_textures(&builder, texture_count);
+  vk_stream_builder_set_frames_in_flight(&builder, FRAMES_IN_FLIGHT);
+  vk_stream_builder_set_submit(&builder, &app_state.submit, graphics_family);
+  vk_stream_builder_set_graphics_family(&builder, graphics_family);
+  vk_stream_builder_set_jobs(&builder, &app_state.jobs);
+  vk_stream_builder_set_transcode_target(
       &builder,
-      VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR
+      transcode_choose_target(app_state.physical_device, false)
   );
-  app_state.swapchain = vk_swapchain_create(
+  vk_stream_builder_set_residency(&builder, &app_state.residency);
+  app_state.stream = vk_stream_create(
       &app_state.device,
-      &app_state.surface,
+      &app_state.physical_device_info,
       &builder
   );
-  if (app_state.same_queue_families)
-    vk_swapchain_builder_add_queue_family_index(
-        &builder,
-        app_state.physical_device_info.queue_families.present_index
-    );
-  else {
-    vk_swapchain_builder_add_queue_family_index(
-        &builder,
-        app_state.physical_device_info.queue_families.present_index
-    );
-    vk_swapchain_builder_add_queue_family_index(
-        &builder,
-        app_state.physical_device_info.queue_families.graphics_index
+  app_state.stream_created = true;
+  for (uint32_t i = 0; i < pack->chunk_count; i++) {
+    if (pack->chunks[i].type != ASSET_CHUNK_TEXTURE) continue;
+    if (vk_stream_add_texture(
+          &app_state.stream,
+          pack,
+          &pack->chunks[i]
+    ) == VK_STREAM_INVALID) log_msg(
+        LOG_LEVEL_WARN,
+        "Failed to stream texture %s",
+        pack->chunks[i].name
     );
   }
-  log_msg(LOG_LEVEL_INFO, "Swapchain image count: %d", app_state.swapchain.image_count);
-  log_msg(LOG_LEVEL_SUCCESS, "Created Vulkan swapchain");
+  log_msg(
+      LOG_LEVEL_SUCCESS,
+      "Streaming %u textures",
+      app_state.stream.texture_count
+  );
 }
+/* Destroy whatever Vulkan objects startup got as far as creating */
 static void app_cleanup_vulkan(void) {
-  vk_swapchain_destroy(&app_state.swapchain, &app_state.device);
-  log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan swapchain");
-  vk_dev_destroy(&app_state.device);
-  vk_phys_dev_info_free(&app_state.physical_device_info);
-  log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan device");
-  vk_surf_destroy(&app_state.surface, &app_state.instance);
-  log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan surface");
-  vk_inst_destroy(&app_state.instance);
-  log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan instance");
+  vk_capture_end();
+  if (app_state.command_pool) {
+#if PROFILE_ENABLED
+    profile_write_trace(PROFILE_TRACE_PATH, &app_state.profiler);
+    profile_gpu_destroy(&app_state.profiler);
+#endif
+    vk_frame_alloc_destroy(&app_state.frame_alloc, &app_state.device);
+    vkDestroyCommandPool(
+        app_state.device.device,
+        app_state.command_pool,
+        NULL
+    );
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed frame resources");
+  }
+  if (app_state.stream_created) {
+    vk_stream_destroy(&app_state.stream, &app_state.device);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed texture streamer");
+  }
+  if (app_state.pipeline_cache.cache) {
+    vk_pipelines_destroy(&app_state.pipelines);
+    if (!vk_pipeline_cache_write(&app_state.pipeline_cache, &app_state.device))
+      log_msg(LOG_LEVEL_WARN, "Failed to save pipeline cache");
+  }
+  vk_pipeline_cache_destroy(&app_state.pipeline_cache, &app_state.device);
+  if (app_state.present.dev) {
+    vk_present_destroy(&app_state.present);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan swapchain");
+  }
+  if (app_state.device.device) {
+    vk_submit_destroy(&app_state.submit, &app_state.device);
+    vk_residency_destroy(&app_state.residency);
+    vk_dev_destroy(&app_state.device);
+    vk_phys_dev_info_free(&app_state.physical_device_info);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan device");
+  }
+  if (app_state.surface) {
+    vk_surf_destroy(&app_state.surface, &app_state.instance);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan surface");
+  }
+  if (app_state.instance.instance) {
+    vk_inst_destroy(&app_state.instance);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed Vulkan instance");
+  }
+}
+/* Tear down everything startup created, then the job system */
+static void app_cleanup(void) {
+  app_cleanup_vulkan();
+  if (app_state.asset_pack_open) asset_pack_close(&app_state.asset_pack);
+  /* Destroy window */
+  if (app_state.window) {
+    SDL_DestroyWindow(app_state.window);
+    log_msg(LOG_LEVEL_SUCCESS, "Destroyed window");
+  }
+  /* Quit SDL2 */
+  SDL_Vulkan_UnloadLibrary();
+  SDL_Quit();
+  log_msg(LOG_LEVEL_SUCCESS, "Quit SDL");
+  /* Stop job system */
+  jobs_destroy(&app_state.jobs);
+#if PROFILE_ENABLED
+  profile_shutdown();
+#endif
 }
 
-/* Entry point */
-int main(void) {
+/* Draw and present a frame to every view with an image ready */
+static void app_draw_frame(uint32_t frame) {
+  VkCommandBuffer cmd = app_state.command_buffers[frame];
+  vk_submit_semaphore_t waits[VK_PRESENT_MAX_VIEWS];
+  vk_submit_semaphore_t signals[VK_PRESENT_MAX_VIEWS];
+  vk_submission_t submission;
+  VkCommandBufferBeginInfo begin_info;
+  VkImageMemoryBarrier barriers[VK_PRESENT_MAX_VIEWS];
+  uint32_t image_count;
+
+  /* Wait for the frame slot's last submission */
+  PROFILE_BEGIN("frame_wait");
+  vk_sync_wait(app_state.frame_done[frame], &app_state.device, UINT64_MAX);
+  PROFILE_END();
+  vk_residency_update(&app_state.residency);
+  if (app_state.stream_created) {
+    vk_stream_begin_frame(&app_state.stream, &app_state.device, frame);
+    vk_stream_update(&app_state.stream, &app_state.device);
+  }
+  vk_frame_alloc_begin(&app_state.frame_alloc, frame);
+  PROFILE_BEGIN("acquire");
+  image_count = vk_present_acquire(&app_state.present, frame);
+  PROFILE_END();
+  if (image_count == 0) return;
+
+  /* Record every view into one command buffer */
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(cmd, 0));
+  VK_CHECK(vk_capture_cmd_begin(cmd, &begin_info));
+  PROFILE_GPU_FRAME(&app_state.profiler, cmd, frame);
+  PROFILE_GPU_BEGIN(&app_state.profiler, cmd, "present_barriers");
+  for (uint32_t i = 0; i < image_count; i++) {
+    const vk_present_image_t *image = &app_state.present.images[i];
+    barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[i].pNext = NULL;
+    barriers[i].srcAccessMask = 0;
+    barriers[i].dstAccessMask = 0;
+    barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[i].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[i].image = image->image;
+    barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barriers[i].subresourceRange.baseMipLevel = 0;
+    barriers[i].subresourceRange.levelCount = 1;
+    barriers[i].subresourceRange.baseArrayLayer = 0;
+    barriers[i].subresourceRange.layerCount = 1;
+    waits[i].semaphore = image->image_available;
+    waits[i].value = 0;
+    waits[i].stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+    signals[i].semaphore = image->render_finished;
+    signals[i].value = 0;
+    signals[i].stages = 0;
+  }
+  vk_capture_cmd_pipeline_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0,
+      0, NULL,
+      0, NULL,
+      image_count, barriers
+  );
+  PROFILE_GPU_END(&app_state.profiler, cmd);
+  VK_CHECK(vk_capture_cmd_end(cmd));
+
+  /* Submit (with the frame's dynamic data visible) */
+  vk_frame_alloc_flush(&app_state.frame_alloc, &app_state.device);
+  submission.command_buffers = &cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = waits;
+  submission.wait_count = image_count;
+  submission.signals = signals;
+  submission.signal_count = image_count;
+  submission.fence = VK_NULL_HANDLE;
+  app_state.frame_done[frame] = vk_submit_enqueue(
+      &app_state.submit,
+      VK_SUBMIT_GRAPHICS,
+      &submission
+  );
+
+  /* Present every view at once (flushing the frame's submissions) */
+  PROFILE_BEGIN("present");
+  VK_CHECK(vk_present_submit(&app_state.present, &app_state.submit));
+  PROFILE_END();
+}
+/* Apply a window event on the render thread */
+static void app_handle_event(const SDL_Event *event, bool *minimized) {
+  uint32_t view;
+  switch (event->type) {
+    case SDL_QUIT:
+      atomic_store(&app_state.running, false);
+      break;
+    case SDL_WINDOWEVENT:
+      switch (event->window.event) {
+        case SDL_WINDOWEVENT_CLOSE:
+          atomic_store(&app_state.running, false);
+          break;
+        case SDL_WINDOWEVENT_RESIZED:
+          app_state.width = event->window.data1;
+          app_state.height = event->window.data2;
+          log_msg(
+              LOG_LEVEL_INFO,
+              "Window resized to %dx%d",
+              app_state.width,
+              app_state.height
+          );
+          view = vk_present_find(
+              &app_state.present,
+              (void *)(uintptr_t)event->window.windowID
+          );
+          if (view != UINT32_MAX) vk_present_resize(
+              &app_state.present,
+              view,
+              app_state.width,
+              app_state.height
+          );
+          break;
+        case SDL_WINDOWEVENT_MINIMIZED:
+          *minimized = true;
+          break;
+        case SDL_WINDOWEVENT_RESTORED:
+          *minimized = false;
+          break;
+      } break;
+    case SDL_KEYDOWN:
+      if (
+          event->key.keysym.sym == REPORT_KEY
+          && app_state.instance.messages
+      ) vk_messages_report(
+          app_state.instance.messages,
+          VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+          0
+      );
+      break;
+    default: break;
+  }
+}
+/* Render thread: owns the frame loop and the swapchains */
+static void *render_main(void *arg) {
+  uint32_t frame = 0;
+  bool minimized = false, first_frame = true;
+  (void)arg;
+#if PROFILE_ENABLED
+  profile_thread_name("render");
+#endif
+  while (atomic_load(&app_state.running)) {
+    SDL_Event event;
+    while (spsc_queue_pop(&app_state.events, &event))
+      app_handle_event(&event, &minimized);
+    if (!atomic_load(&app_state.running)) break;
+    /* Nothing to draw into, so sleep until the next event */
+    if (minimized || app_state.width == 0 || app_state.height == 0) {
+      atomic_store(&app_state.render_sleeping, true);
+      atomic_thread_fence(memory_order_seq_cst);
+      /* Recheck after announcing, as earlier events posted nothing */
+      if (spsc_queue_pop(&app_state.events, &event)) {
+        /* Consume the post if the event thread saw the flag first */
+        if (!atomic_exchange(&app_state.render_sleeping, false))
+          sem_wait(&app_state.wake);
+        app_handle_event(&event, &minimized);
+        continue;
+      }
+      sem_wait(&app_state.wake);
+      continue;
+    }
+    PROFILE_BEGIN("frame");
+    app_draw_frame(frame);
+    PROFILE_END();
+    frame = (frame + 1) % FRAMES_IN_FLIGHT;
+    if (first_frame) {
+      double elapsed = (time_now() - app_state.start_time) * 1e3;
+      telemetry_report("init.first_frame", TELEMETRY_TIMING, elapsed);
+      log_msg(LOG_LEVEL_INFO, "Time to first frame: %.2f ms", elapsed);
+      first_frame = false;
+    }
+  }
+  vk_submit_wait_idle(&app_state.submit);
+  return NULL;
+}
+
+/* Startup stages */
+static bool stage_sdl(void *arg) {
+  (void)arg;
   /* Choose backend */
   SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11");
   /* Initialize SDL2 */
   if (SDL_Init(SDL_INIT_VIDEO) < 0) {
     log_msg(LOG_LEVEL_ERROR, "Failed to initialize SDL: %s", SDL_GetError());
-    return 1;
+    return false;
+  }
+  /* Load the Vulkan loader now so the instance need not wait for a window */
+  if (SDL_Vulkan_LoadLibrary(NULL) < 0) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to load Vulkan: %s", SDL_GetError());
+    return false;
   }
   log_msg(LOG_LEVEL_SUCCESS, "Intialized SDL");
-  /* Create window */
+  return true;
+}
+static bool stage_window(void *arg) {
+  (void)arg;
   app_state.width = 800;
   app_state.height = 600;
   app_state.window = SDL_CreateWindow(
@@ -212,56 +613,204 @@ int main(void) {
   );
   if (app_state.window == NULL) {
     log_msg(LOG_LEVEL_ERROR, "Failed to create window: %s", SDL_GetError());
-    return 1;
+    return false;
   }
+  app_state.window_id = SDL_GetWindowID(app_state.window);
   log_msg(LOG_LEVEL_SUCCESS, "Created window");
-
-  /* Initialize vulkan */
+  return true;
+}
+static bool stage_instance(void *arg) {
+  (void)arg;
   app_create_instance();
+  return true;
+}
+static bool stage_surface(void *arg) {
+  (void)arg;
   app_create_surface();
+  return true;
+}
+static bool stage_device(void *arg) {
+  (void)arg;
   app_create_device();
+  return true;
+}
+static bool stage_swapchain(void *arg) {
+  (void)arg;
   app_create_swapchain();
+  return true;
+}
+static bool stage_frame_resources(void *arg) {
+  (void)arg;
+  app_create_frame_resources();
+  return true;
+}
+static bool stage_pipeline_cache_read(void *arg) {
+  (void)arg;
+  vk_pipeline_cache_read(&app_state.pipeline_cache, PIPELINE_CACHE_PATH);
+  return true;
+}
+static bool stage_pipeline_cache(void *arg) {
+  (void)arg;
+  vk_pipeline_cache_create(
+      &app_state.pipeline_cache,
+      &app_state.device,
+      &app_state.physical_device_info
+  );
+  vk_pipelines_create(
+      &app_state.pipelines,
+      &app_state.device,
+      app_state.pipeline_cache.cache,
+      &app_state.jobs
+  );
+  return true;
+}
+static bool stage_assets(void *arg) {
+  (void)arg;
+  if (!app_state.asset_pack_path) return true;
+  if (!asset_pack_open(&app_state.asset_pack, app_state.asset_pack_path)) {
+    log_msg(
+        LOG_LEVEL_ERROR,
+        "Failed to open asset pack %s",
+        app_state.asset_pack_path
+    );
+    return false;
+  }
+  app_state.asset_pack_open = true;
+  /* Start paging the pack in while the device comes up */
+  for (uint32_t i = 0; i < app_state.asset_pack.chunk_count; i++)
+    asset_pack_prefetch(&app_state.asset_pack, &app_state.asset_pack.chunks[i]);
+  log_msg(
+      LOG_LEVEL_SUCCESS,
+      "Mapped asset pack (%u chunks)",
+      app_state.asset_pack.chunk_count
+  );
+  return true;
+}
+static bool stage_textures(void *arg) {
+  (void)arg;
+  app_create_textures();
+  return true;
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  init_graph_t graph;
+  uint32_t sdl, window, instance, surface, device, swapchain;
+  uint32_t frame_resources, pipeline_cache_read, pipeline_cache, assets;
+  uint32_t textures;
+  const char *capture_path;
+
+  app_state.start_time = time_now();
+#if PROFILE_ENABLED
+  profile_thread_name("main");
+#endif
+  app_state.asset_pack_path = argc > 1 ? argv[1] : NULL;
+  /* Capture must start before any Vulkan object is created */
+  capture_path = getenv(CAPTURE_ENV);
+  if (capture_path && !vk_capture_begin(capture_path))
+    log_msg(LOG_LEVEL_WARN, "Failed to start capture to %s", capture_path);
+  /* Start job system */
+  jobs_create(&app_state.jobs, 0, true);
+
+  /*
+   * Bring-up graph: the instance is created while SDL opens the window, the
+   * pipeline cache and asset pack are read while the device is created, and
+   * frame resources are created while the swapchain is built; streaming
+   * the pack's textures needs both the device and the mapped pack
+   */
+  init_graph_create(&graph);
+  sdl = init_graph_add(&graph, "sdl", stage_sdl, NULL, true);
+  window = init_graph_add(&graph, "window", stage_window, NULL, true);
+  instance = init_graph_add(&graph, "instance", stage_instance, NULL, false);
+  surface = init_graph_add(&graph, "surface", stage_surface, NULL, true);
+  device = init_graph_add(&graph, "device", stage_device, NULL, false);
+  swapchain = init_graph_add(
+      &graph,
+      "swapchain",
+      stage_swapchain,
+      NULL,
+      false
+  );
+  frame_resources = init_graph_add(
+      &graph,
+      "frame_resources",
+      stage_frame_resources,
+      NULL,
+      false
+  );
+  pipeline_cache_read = init_graph_add(
+      &graph,
+      "pipeline_cache_read",
+      stage_pipeline_cache_read,
+      NULL,
+      false
+  );
+  pipeline_cache = init_graph_add(
+      &graph,
+      "pipeline_cache",
+      stage_pipeline_cache,
+      NULL,
+      false
+  );
+  assets = init_graph_add(&graph, "assets", stage_assets, NULL, false);
+  textures = init_graph_add(&graph, "textures", stage_textures, NULL, false);
+  init_graph_depend(&graph, window, sdl);
+  init_graph_depend(&graph, instance, sdl);
+  init_graph_depend(&graph, surface, window);
+  init_graph_depend(&graph, surface, instance);
+  init_graph_depend(&graph, device, surface);
+  init_graph_depend(&graph, swapchain, device);
+  init_graph_depend(&graph, frame_resources, device);
+  init_graph_depend(&graph, pipeline_cache, device);
+  init_graph_depend(&graph, pipeline_cache, pipeline_cache_read);
+  init_graph_depend(&graph, textures, device);
+  init_graph_depend(&graph, textures, assets);
+  if (!init_graph_run(&graph, &app_state.jobs)) {
+    init_graph_report(&graph);
+    /* Every stage has stopped, so unwind the ones that finished */
+    app_cleanup();
+    return 1;
+  }
+  init_graph_report(&graph);
   
-  /* Main loop */
-  app_state.running = true;
-  while (app_state.running) {
+  /* Hand the frame loop to the render thread */
+  atomic_store(&app_state.running, true);
+  spsc_queue_create(&app_state.events, sizeof(SDL_Event), EVENT_QUEUE_CAPACITY);
+  ASSERT(sem_init(&app_state.wake, 0, 0) == 0);
+  atomic_store(&app_state.render_sleeping, false);
+  ASSERT(pthread_create(
+        &app_state.render_thread,
+        NULL,
+        render_main,
+        NULL
+  ) == 0);
+
+  /* Event loop: sleep in SDL until there is input, then forward it */
+  while (atomic_load(&app_state.running)) {
     SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT:
-          app_state.running = false;
-          break;
-        case SDL_WINDOWEVENT:
-          switch (event.window.event) {
-            case SDL_WINDOWEVENT_CLOSE:
-              app_state.running = false;
-              break;
-            case SDL_WINDOWEVENT_RESIZED:
-              {
-                app_state.width = event.window.data1;
-                app_state.height = event.window.data2;
-                log_msg(
-                    LOG_LEVEL_INFO,
-                    "Window resized to %dx%d",
-                    app_state.width,
-                    app_state.height
-                );
-                vk_swapchain_destroy(&app_state.swapchain, &app_state.device);
-                app_create_swapchain();
-              } break;
-          } break;
-        default: break;
-      }
-    }
+    if (!SDL_WaitEventTimeout(&event, EVENT_WAIT_TIMEOUT)) continue;
+    do {
+      if (
+          event.type == SDL_QUIT
+          || (
+            event.type == SDL_WINDOWEVENT
+            && event.window.event == SDL_WINDOWEVENT_CLOSE
+          )
+      ) atomic_store(&app_state.running, false);
+      if (!spsc_queue_push(&app_state.events, &event))
+        telemetry_report("events.dropped", TELEMETRY_COUNTER, 1.0);
+    } while (SDL_PollEvent(&event));
+    /* Only wake the render thread if it's asleep, so posts don't pile up */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&app_state.render_sleeping, false))
+      sem_post(&app_state.wake);
   }
+  sem_post(&app_state.wake);
+  pthread_join(app_state.render_thread, NULL);
+  sem_destroy(&app_state.wake);
+  spsc_queue_destroy(&app_state.events);
 
   /* Cleanup */
-  app_cleanup_vulkan();
-  /* Destroy window */
-  SDL_DestroyWindow(app_state.window);
-  log_msg(LOG_LEVEL_SUCCESS, "Destroyed window");
-  /* Quit SDL2 */
-  SDL_Quit();
-  log_msg(LOG_LEVEL_SUCCESS, "Quit SDL");
+  app_cleanup();
   return 0;
 }
@@ -0,0 +1,500 @@
+/* Implements mesh_opt.h */
+#include <mesh_opt.h>
+#include <math.h>
+
+/* Sentinel for unassigned indices */
+#define NONE UINT32_MAX
+
+/* Vector helpers */
+static void vec3_sub(float *out, const float *a, const float *b) {
+  out[0] = a[0] - b[0];
+  out[1] = a[1] - b[1];
+  out[2] = a[2] - b[2];
+}
+static float vec3_dot(const float *a, const float *b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+static void vec3_cross(float *out, const float *a, const float *b) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+static bool vec3_normalize(float *v) {
+  float length = sqrtf(vec3_dot(v, v));
+  if (length == 0.0f) return false;
+  v[0] /= length;
+  v[1] /= length;
+  v[2] /= length;
+  return true;
+}
+/* Convert a float to a half float (round to nearest even) */
+static uint16_t float_to_half(float value) {
+  uint32_t bits;
+  uint32_t sign, mantissa;
+  int32_t exponent;
+  uint16_t half;
+  memcpy(&bits, &value, sizeof(bits));
+  sign = (bits >> 16) & 0x8000;
+  exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+  mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff)
+    return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  if (exponent >= 31) return (uint16_t)(sign | 0x7c00);
+  if (exponent <= 0) {
+    uint32_t shift, rest;
+    if (exponent < -10) return (uint16_t)sign;
+    mantissa |= 0x800000;
+    shift = (uint32_t)(14 - exponent);
+    half = (uint16_t)(mantissa >> shift);
+    rest = mantissa & ((1u << shift) - 1);
+    if (
+        rest > (1u << (shift - 1))
+        || (rest == (1u << (shift - 1)) && (half & 1))
+    ) half++;
+    return (uint16_t)(sign | half);
+  }
+  half = (uint16_t)(sign | ((uint32_t)exponent << 10) | (mantissa >> 13));
+  if (
+      (mantissa & 0x1fff) > 0x1000
+      || ((mantissa & 0x1fff) == 0x1000 && (half & 1))
+  ) half++;
+  return half;
+}
+/* Quantize to snorm16 */
+static int16_t quantize_snorm16(float value) {
+  if (value > 1.0f) value = 1.0f;
+  if (value < -1.0f) value = -1.0f;
+  return (int16_t)lrintf(value * 32767.0f);
+}
+/* Quantize to unorm16 */
+static uint16_t quantize_unorm16(float value) {
+  if (value > 1.0f) value = 1.0f;
+  if (value < 0.0f) value = 0.0f;
+  return (uint16_t)lrintf(value * 65535.0f);
+}
+
+/* Tipsify state */
+typedef struct {
+  const uint32_t *indices;
+  uint32_t *adjacency_offsets;
+  uint32_t *adjacency;
+  uint32_t *live;
+  uint32_t *cache_time;
+  uint32_t *dead_ends;
+  size_t dead_end_count;
+  uint32_t *candidates;
+  size_t candidate_count;
+  size_t vertex_count;
+  size_t cursor;
+  uint32_t timestamp;
+  uint32_t cache_size;
+} tipsify_t;
+/* Find a vertex with live triangles that left the stack or cursor */
+static uint32_t tipsify_skip_dead_end(tipsify_t *t) {
+  while (t->dead_end_count > 0) {
+    uint32_t vertex = t->dead_ends[--t->dead_end_count];
+    if (t->live[vertex] > 0) return vertex;
+  }
+  while (t->cursor < t->vertex_count) {
+    if (t->live[t->cursor] > 0) return (uint32_t)t->cursor;
+    t->cursor++;
+  }
+  return NONE;
+}
+/* Pick the next fanning vertex */
+static uint32_t tipsify_next_vertex(tipsify_t *t) {
+  uint32_t best = NONE;
+  int64_t best_priority = -1;
+  for (size_t i = 0; i < t->candidate_count; i++) {
+    uint32_t vertex = t->candidates[i];
+    int64_t priority = 0;
+    if (t->live[vertex] == 0) continue;
+    /* Prefer vertices still in the cache after emitting their triangles */
+    if (
+        t->timestamp - t->cache_time[vertex] + 2 * t->live[vertex]
+        <= t->cache_size
+    ) priority = t->timestamp - t->cache_time[vertex];
+    if (priority > best_priority) {
+      best_priority = priority;
+      best = vertex;
+    }
+  }
+  if (best == NONE) best = tipsify_skip_dead_end(t);
+  return best;
+}
+
+/* Reorder triangles for the post-transform cache (Tipsify) */
+void mesh_opt_reorder_indices(
+    uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count,
+    uint32_t cache_size
+) {
+  size_t triangle_count = index_count / 3;
+  size_t out_count = 0;
+  uint32_t *out;
+  bool *emitted;
+  uint32_t fan;
+  tipsify_t t;
+
+  if (triangle_count == 0 || vertex_count == 0) return;
+
+  /* Build vertex to triangle adjacency */
+  t.indices = indices;
+  t.vertex_count = vertex_count;
+  t.cache_size = cache_size;
+  t.timestamp = cache_size + 1;
+  t.cursor = 0;
+  t.dead_end_count = 0;
+  t.candidate_count = 0;
+  t.adjacency_offsets =
+    (uint32_t *)calloc(vertex_count + 1, sizeof(uint32_t));
+  t.adjacency = (uint32_t *)malloc(sizeof(uint32_t) * triangle_count * 3);
+  t.live = (uint32_t *)calloc(vertex_count, sizeof(uint32_t));
+  t.cache_time = (uint32_t *)calloc(vertex_count, sizeof(uint32_t));
+  t.dead_ends = (uint32_t *)malloc(sizeof(uint32_t) * triangle_count * 3);
+  t.candidates = (uint32_t *)malloc(sizeof(uint32_t) * triangle_count * 3);
+  emitted = (bool *)calloc(triangle_count, sizeof(bool));
+  out = (uint32_t *)malloc(sizeof(uint32_t) * triangle_count * 3);
+  ASSERT(
+      t.adjacency_offsets && t.adjacency && t.live && t.cache_time
+      && t.dead_ends && t.candidates && emitted && out
+  );
+  for (size_t i = 0; i < triangle_count * 3; i++) t.live[indices[i]]++;
+  for (size_t v = 0; v < vertex_count; v++)
+    t.adjacency_offsets[v + 1] = t.adjacency_offsets[v] + t.live[v];
+  {
+    uint32_t *fill = (uint32_t *)malloc(sizeof(uint32_t) * vertex_count);
+    ASSERT(fill);
+    memcpy(fill, t.adjacency_offsets, sizeof(uint32_t) * vertex_count);
+    for (size_t i = 0; i < triangle_count * 3; i++)
+      t.adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+    free(fill);
+  }
+
+  /* Fan around vertices, emitting all their live triangles */
+  fan = tipsify_skip_dead_end(&t);
+  while (fan != NONE) {
+    t.candidate_count = 0;
+    for (
+        uint32_t a = t.adjacency_offsets[fan];
+        a < t.adjacency_offsets[fan + 1];
+        a++
+    ) {
+      uint32_t triangle = t.adjacency[a];
+      if (emitted[triangle]) continue;
+      for (uint32_t k = 0; k < 3; k++) {
+        uint32_t vertex = indices[triangle * 3 + k];
+        out[out_count++] = vertex;
+        t.dead_ends[t.dead_end_count++] = vertex;
+        t.candidates[t.candidate_count++] = vertex;
+        t.live[vertex]--;
+        if (t.timestamp - t.cache_time[vertex] > cache_size)
+          t.cache_time[vertex] = t.timestamp++;
+      }
+      emitted[triangle] = true;
+    }
+    fan = tipsify_next_vertex(&t);
+  }
+  ASSERT(out_count == triangle_count * 3);
+  memcpy(indices, out, sizeof(uint32_t) * out_count);
+
+  free(t.adjacency_offsets);
+  free(t.adjacency);
+  free(t.live);
+  free(t.cache_time);
+  free(t.dead_ends);
+  free(t.candidates);
+  free(emitted);
+  free(out);
+}
+/* Reorder vertices by first use, dropping unused ones (returns new count) */
+size_t mesh_opt_reorder_vertices(
+    mesh_vertex_t *vertices,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count
+) {
+  uint32_t *remap = (uint32_t *)malloc(sizeof(uint32_t) * vertex_count);
+  mesh_vertex_t *reordered;
+  uint32_t next = 0;
+  ASSERT(remap);
+  for (size_t v = 0; v < vertex_count; v++) remap[v] = NONE;
+  for (size_t i = 0; i < index_count; i++) {
+    if (remap[indices[i]] == NONE) remap[indices[i]] = next++;
+    indices[i] = remap[indices[i]];
+  }
+  reordered = (mesh_vertex_t *)malloc(sizeof(mesh_vertex_t) * (next + 1));
+  ASSERT(reordered);
+  for (size_t v = 0; v < vertex_count; v++) {
+    if (remap[v] != NONE) reordered[remap[v]] = vertices[v];
+  }
+  memcpy(vertices, reordered, sizeof(mesh_vertex_t) * next);
+  free(reordered);
+  free(remap);
+  return next;
+}
+/* Simulate a FIFO post-transform cache */
+mesh_cache_stats_t mesh_opt_cache_stats(
+    const uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count,
+    uint32_t cache_size
+) {
+  mesh_cache_stats_t stats = { 0.0, 0.0 };
+  uint32_t *inserted = (uint32_t *)malloc(sizeof(uint32_t) * vertex_count);
+  size_t referenced = 0;
+  uint32_t misses = 0;
+  ASSERT(inserted);
+  for (size_t v = 0; v < vertex_count; v++) inserted[v] = NONE;
+  for (size_t i = 0; i < index_count; i++) {
+    uint32_t vertex = indices[i];
+    /* The FIFO holds the last cache_size misses */
+    if (inserted[vertex] == NONE) referenced++;
+    if (inserted[vertex] == NONE || misses - inserted[vertex] >= cache_size) {
+      inserted[vertex] = misses++;
+    }
+  }
+  if (index_count >= 3) stats.acmr = (double)misses / (index_count / 3);
+  if (referenced > 0) stats.atvr = (double)misses / referenced;
+  free(inserted);
+  return stats;
+}
+/* Quantize vertices */
+mesh_quant_params_t mesh_opt_quantize(
+    const mesh_vertex_t *vertices,
+    size_t vertex_count,
+    mesh_quant_vertex_t *out
+) {
+  mesh_quant_params_t params;
+  float min[5], max[5];
+  memset(&params, 0, sizeof(params));
+  params.position_scale = 1.0f;
+  params.uv_scale[0] = 1.0f;
+  params.uv_scale[1] = 1.0f;
+  if (vertex_count == 0) return params;
+
+  /* Get bounds of positions and uvs */
+  for (uint32_t k = 0; k < 3; k++)
+    min[k] = max[k] = vertices[0].position[k];
+  for (uint32_t k = 0; k < 2; k++)
+    min[3 + k] = max[3 + k] = vertices[0].uv[k];
+  for (size_t v = 1; v < vertex_count; v++) {
+    for (uint32_t k = 0; k < 3; k++) {
+      if (vertices[v].position[k] < min[k]) min[k] = vertices[v].position[k];
+      if (vertices[v].position[k] > max[k]) max[k] = vertices[v].position[k];
+    }
+    for (uint32_t k = 0; k < 2; k++) {
+      if (vertices[v].uv[k] < min[3 + k]) min[3 + k] = vertices[v].uv[k];
+      if (vertices[v].uv[k] > max[3 + k]) max[3 + k] = vertices[v].uv[k];
+    }
+  }
+  params.position_scale = 0.0f;
+  for (uint32_t k = 0; k < 3; k++) {
+    float half_extent = (max[k] - min[k]) * 0.5f;
+    params.position_offset[k] = (min[k] + max[k]) * 0.5f;
+    if (half_extent > params.position_scale)
+      params.position_scale = half_extent;
+  }
+  if (params.position_scale == 0.0f) params.position_scale = 1.0f;
+  for (uint32_t k = 0; k < 2; k++) {
+    params.uv_offset[k] = min[3 + k];
+    params.uv_scale[k] = max[3 + k] - min[3 + k];
+    if (params.uv_scale[k] == 0.0f) params.uv_scale[k] = 1.0f;
+  }
+
+  /* Quantize */
+  for (size_t v = 0; v < vertex_count; v++) {
+    const mesh_vertex_t *in = &vertices[v];
+    float n[3], l1;
+    for (uint32_t k = 0; k < 3; k++) {
+      out[v].position[k] = float_to_half(
+          (in->position[k] - params.position_offset[k])
+          / params.position_scale
+      );
+    }
+    out[v].position[3] = float_to_half(1.0f);
+
+    /* Octahedral normal */
+    memcpy(n, in->normal, sizeof(n));
+    l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if (l1 > 0.0f) {
+      n[0] /= l1;
+      n[1] /= l1;
+      n[2] /= l1;
+      if (n[2] < 0.0f) {
+        float x = n[0], y = n[1];
+        n[0] = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n[1] = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      }
+    } else {
+      n[0] = n[1] = 0.0f;
+    }
+    out[v].normal[0] = quantize_snorm16(n[0]);
+    out[v].normal[1] = quantize_snorm16(n[1]);
+
+    for (uint32_t k = 0; k < 2; k++) {
+      out[v].uv[k] = quantize_unorm16(
+          (in->uv[k] - params.uv_offset[k]) / params.uv_scale[k]
+      );
+    }
+  }
+  return params;
+}
+
+/* Compute a meshlet's bounding sphere and normal cone */
+static void meshlet_bounds(
+    mesh_meshlet_t *meshlet,
+    const mesh_vertex_t *vertices,
+    const uint32_t *meshlet_vertices,
+    const uint8_t *meshlet_triangles
+) {
+  float min[3], max[3], axis[3] = { 0.0f, 0.0f, 0.0f };
+  float min_dot = 1.0f, max_t = 0.0f;
+  const float *first = vertices[meshlet_vertices[0]].position;
+
+  /* Bounding sphere around the box center */
+  memcpy(min, first, sizeof(min));
+  memcpy(max, first, sizeof(max));
+  for (uint32_t i = 1; i < meshlet->vertex_count; i++) {
+    const float *p = vertices[meshlet_vertices[i]].position;
+    for (uint32_t k = 0; k < 3; k++) {
+      if (p[k] < min[k]) min[k] = p[k];
+      if (p[k] > max[k]) max[k] = p[k];
+    }
+  }
+  meshlet->radius = 0.0f;
+  for (uint32_t k = 0; k < 3; k++)
+    meshlet->center[k] = (min[k] + max[k]) * 0.5f;
+  for (uint32_t i = 0; i < meshlet->vertex_count; i++) {
+    float d[3], distance;
+    vec3_sub(d, vertices[meshlet_vertices[i]].position, meshlet->center);
+    distance = sqrtf(vec3_dot(d, d));
+    if (distance > meshlet->radius) meshlet->radius = distance;
+  }
+
+  /* Average triangle normal, then the widest deviation from it */
+  for (int pass = 0; pass < 3; pass++) {
+    for (uint32_t t = 0; t < meshlet->triangle_count; t++) {
+      const uint8_t *tri = &meshlet_triangles[t * 3];
+      const float *p0 = vertices[meshlet_vertices[tri[0]]].position;
+      const float *p1 = vertices[meshlet_vertices[tri[1]]].position;
+      const float *p2 = vertices[meshlet_vertices[tri[2]]].position;
+      float e1[3], e2[3], n[3];
+      vec3_sub(e1, p1, p0);
+      vec3_sub(e2, p2, p0);
+      vec3_cross(n, e1, e2);
+      if (!vec3_normalize(n)) continue;
+      if (pass == 0) {
+        axis[0] += n[0];
+        axis[1] += n[1];
+        axis[2] += n[2];
+      } else if (pass == 1) {
+        float d = vec3_dot(axis, n);
+        if (d < min_dot) min_dot = d;
+      } else {
+        float c[3], t_apex;
+        vec3_sub(c, meshlet->center, p0);
+        t_apex = vec3_dot(c, n) / vec3_dot(axis, n);
+        if (t_apex > max_t) max_t = t_apex;
+      }
+    }
+    if (pass == 0 && !vec3_normalize(axis)) break;
+    /* Normals spread over a hemisphere or more can't be cone culled */
+    if (pass == 1 && min_dot <= 0.1f) break;
+  }
+
+  memcpy(meshlet->cone_axis, axis, sizeof(axis));
+  if (min_dot <= 0.1f || vec3_dot(axis, axis) == 0.0f) {
+    memcpy(meshlet->cone_apex, meshlet->center, sizeof(meshlet->center));
+    meshlet->cone_cutoff = 1.0f;
+  } else {
+    for (uint32_t k = 0; k < 3; k++)
+      meshlet->cone_apex[k] = meshlet->center[k] - axis[k] * max_t;
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+  }
+  meshlet->padding = 0.0f;
+}
+/* Split a mesh into meshlets */
+mesh_meshlets_t mesh_opt_build_meshlets(
+    const mesh_vertex_t *vertices,
+    const uint32_t *indices,
+    size_t index_count
+) {
+  mesh_meshlets_t result;
+  mesh_meshlet_t *current;
+  uint32_t max_vertex = 0;
+  uint8_t *local;
+  size_t triangle_count = index_count / 3;
+
+  memset(&result, 0, sizeof(result));
+  if (triangle_count == 0) return result;
+  for (size_t i = 0; i < index_count; i++)
+    if (indices[i] > max_vertex) max_vertex = indices[i];
+  local = (uint8_t *)malloc(max_vertex + 1);
+  result.meshlets =
+    (mesh_meshlet_t *)malloc(sizeof(mesh_meshlet_t) * triangle_count);
+  result.vertices = (uint32_t *)malloc(sizeof(uint32_t) * index_count);
+  result.triangles = (uint8_t *)malloc(index_count);
+  ASSERT(local && result.meshlets && result.vertices && result.triangles);
+  memset(local, 0xff, max_vertex + 1);
+
+  current = &result.meshlets[0];
+  memset(current, 0, sizeof(mesh_meshlet_t));
+  result.meshlet_count = 1;
+  for (size_t t = 0; t < triangle_count; t++) {
+    const uint32_t *tri = &indices[t * 3];
+    uint32_t new_vertices = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      bool repeated =
+        (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+      if (local[tri[k]] == 0xff && !repeated) new_vertices++;
+    }
+
+    /* Start a new meshlet when this triangle doesn't fit */
+    if (
+        current->vertex_count + new_vertices > MESH_MESHLET_MAX_VERTICES
+        || current->triangle_count == MESH_MESHLET_MAX_TRIANGLES
+    ) {
+      meshlet_bounds(
+          current,
+          vertices,
+          &result.vertices[current->vertex_offset],
+          &result.triangles[current->triangle_offset * 3]
+      );
+      for (uint32_t i = 0; i < current->vertex_count; i++)
+        local[result.vertices[current->vertex_offset + i]] = 0xff;
+      current = &result.meshlets[result.meshlet_count++];
+      memset(current, 0, sizeof(mesh_meshlet_t));
+      current->vertex_offset = result.vertex_count;
+      current->triangle_offset = result.triangle_count;
+    }
+
+    for (uint32_t k = 0; k < 3; k++) {
+      if (local[tri[k]] == 0xff) {
+        local[tri[k]] = (uint8_t)current->vertex_count++;
+        result.vertices[result.vertex_count++] = tri[k];
+      }
+      result.triangles[result.triangle_count * 3 + k] = local[tri[k]];
+    }
+    current->triangle_count++;
+    result.triangle_count++;
+  }
+  meshlet_bounds(
+      current,
+      vertices,
+      &result.vertices[current->vertex_offset],
+      &result.triangles[current->triangle_offset * 3]
+  );
+
+  free(local);
+  return result;
+}
+/* Free meshlets */
+void mesh_opt_meshlets_free(mesh_meshlets_t *meshlets) {
+  if (meshlets->meshlets) free(meshlets->meshlets);
+  if (meshlets->vertices) free(meshlets->vertices);
+  if (meshlets->triangles) free(meshlets->triangles);
+  memset(meshlets, 0, sizeof(mesh_meshlets_t));
+}
@@ -0,0 +1,488 @@
+/* Implements profile.h (left out of release builds by the Makefile) */
+#include <profile.h>
+#include <telemetry.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Trace thread ID of the GPU */
+#define PROFILE_GPU_TID PROFILE_MAX_THREADS
+
+/* Statistics gathered (in bit order, as results come back) and their names */
+static const VkQueryPipelineStatisticFlags profile_statistic_flags =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+static const char *const profile_statistic_names[PROFILE_STATISTICS] = {
+  "input_vertices",
+  "vertex_invocations",
+  "clipped_primitives",
+  "fragment_invocations",
+  "compute_invocations"
+};
+
+/* Recording threads (published by count, never removed until shutdown) */
+static struct {
+  profile_thread_t *threads[PROFILE_MAX_THREADS];
+  atomic_uint thread_count;
+} profile;
+/* Registration lock */
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Calling thread's scopes */
+static _Thread_local profile_thread_t *profile_current;
+
+/* Get (registering on first use) the calling thread's scopes */
+static profile_thread_t *current_thread(void) {
+  profile_thread_t *thread;
+  uint32_t count;
+  if (profile_current) return profile_current;
+  pthread_mutex_lock(&profile_mutex);
+  count = atomic_load(&profile.thread_count);
+  if (count == PROFILE_MAX_THREADS) {
+    pthread_mutex_unlock(&profile_mutex);
+    return NULL;
+  }
+  thread = (profile_thread_t *)calloc(1, sizeof(profile_thread_t));
+  ASSERT(thread);
+  thread->events = (profile_event_t *)malloc(
+      sizeof(profile_event_t) * PROFILE_THREAD_EVENTS
+  );
+  ASSERT(thread->events);
+  thread->id = count;
+  snprintf(thread->name, PROFILE_MAX_NAME, "thread %u", count);
+  atomic_init(&thread->count, 0);
+  profile.threads[count] = thread;
+  atomic_store(&profile.thread_count, count + 1);
+  pthread_mutex_unlock(&profile_mutex);
+  profile_current = thread;
+  return thread;
+}
+/* Write a JSON string (names are expected to be plain) */
+static void write_string(FILE *file, const char *string) {
+  fputc('"', file);
+  for (; *string; string++) {
+    if (*string == '"' || *string == '\\') fputc('\\', file);
+    if ((unsigned char)*string >= 0x20) fputc(*string, file);
+  }
+  fputc('"', file);
+}
+/* Write a complete event */
+static void write_event(
+    FILE *file,
+    const profile_event_t *event,
+    uint32_t tid,
+    bool *first
+) {
+  fprintf(file, "%s\n{\"name\":", *first ? "" : ",");
+  write_string(file, event->name);
+  fprintf(
+      file,
+      ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+      tid,
+      (double)event->begin / 1e3,
+      (double)(event->end - event->begin) / 1e3
+  );
+  *first = false;
+}
+/* Write a thread name */
+static void write_thread_name(
+    FILE *file,
+    const char *name,
+    uint32_t tid,
+    bool *first
+) {
+  fprintf(
+      file,
+      "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+      "\"args\":{\"name\":",
+      *first ? "" : ",",
+      tid
+  );
+  write_string(file, name);
+  fprintf(file, "}}");
+  *first = false;
+}
+/* Check a device can calibrate its clock against CLOCK_MONOTONIC */
+static bool supports_time_domains(
+    const vk_inst_t *inst,
+    vk_phys_dev_t phys_dev
+) {
+  PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains;
+  VkTimeDomainEXT *domains;
+  uint32_t count = 0;
+  bool device = false, monotonic = false;
+
+  get_time_domains =
+    (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(
+        inst->instance,
+        "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"
+    );
+  if (!get_time_domains) return false;
+  if (get_time_domains(phys_dev, &count, NULL) != VK_SUCCESS || count == 0)
+    return false;
+  domains = (VkTimeDomainEXT *)malloc(sizeof(VkTimeDomainEXT) * count);
+  ASSERT(domains);
+  if (get_time_domains(phys_dev, &count, domains) != VK_SUCCESS) count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (domains[i] == VK_TIME_DOMAIN_DEVICE_EXT) device = true;
+    if (domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) monotonic = true;
+  }
+  free(domains);
+  return device && monotonic;
+}
+/* Match up GPU and CPU clocks (false without VK_EXT_calibrated_timestamps) */
+static bool calibrate(profile_gpu_t *gpu) {
+  VkCalibratedTimestampInfoEXT infos[2];
+  uint64_t timestamps[2], deviation;
+  if (!gpu->get_calibrated_timestamps) return false;
+  infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  infos[0].pNext = NULL;
+  infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  infos[1].pNext = NULL;
+  infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  if (gpu->get_calibrated_timestamps(
+        gpu->dev->device,
+        2,
+        infos,
+        timestamps,
+        &deviation
+  ) != VK_SUCCESS) return false;
+  gpu->gpu_base = timestamps[0];
+  gpu->cpu_base = timestamps[1];
+  return true;
+}
+/* Convert GPU ticks to CPU nanoseconds */
+static uint64_t gpu_to_cpu(const profile_gpu_t *gpu, uint64_t ticks) {
+  double offset = (double)(int64_t)(ticks - gpu->gpu_base) * gpu->period;
+  return (uint64_t)((double)gpu->cpu_base + offset);
+}
+/* Read back a frame slot's scopes (false if not yet available) */
+static bool resolve(profile_gpu_t *gpu, profile_gpu_frame_t *slot) {
+  uint64_t ticks[PROFILE_GPU_SCOPES * 2];
+  uint64_t statistics[PROFILE_GPU_SCOPES][PROFILE_STATISTICS];
+
+  if (vkGetQueryPoolResults(
+        gpu->dev->device,
+        slot->timestamps,
+        0,
+        slot->scope_count * 2,
+        sizeof(ticks),
+        ticks,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+  ) != VK_SUCCESS) return false;
+  if (slot->statistics_count > 0 && vkGetQueryPoolResults(
+        gpu->dev->device,
+        slot->statistics,
+        0,
+        slot->statistics_count,
+        sizeof(statistics),
+        statistics,
+        sizeof(statistics[0]),
+        VK_QUERY_RESULT_64_BIT
+  ) != VK_SUCCESS) return false;
+
+  /* Without calibration, the frame starts when its recording did */
+  if (!gpu->calibrated) {
+    gpu->gpu_base = ticks[0];
+    gpu->cpu_base = slot->cpu_begin;
+  }
+  for (uint32_t i = 0; i < slot->scope_count; i++) {
+    const profile_gpu_scope_t *scope = &slot->scopes[i];
+    profile_gpu_event_t *event;
+    if (gpu->event_count == PROFILE_GPU_EVENTS) {
+      telemetry_report(
+          "profile.dropped",
+          TELEMETRY_COUNTER,
+          (double)(slot->scope_count - i)
+      );
+      break;
+    }
+    event = &gpu->events[gpu->event_count++];
+    event->event.name = scope->name;
+    event->event.begin = gpu_to_cpu(gpu, ticks[i * 2]);
+    event->event.end = gpu_to_cpu(gpu, ticks[i * 2 + 1]);
+    event->event.depth = scope->depth;
+    event->has_statistics = scope->statistics_query != UINT32_MAX;
+    if (event->has_statistics) {
+      memcpy(
+          event->statistics,
+          statistics[scope->statistics_query],
+          sizeof(event->statistics)
+      );
+    }
+  }
+  return true;
+}
+
+/* Get the profiler clock (CLOCK_MONOTONIC nanoseconds) */
+uint64_t profile_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+/* Name the calling thread in traces */
+void profile_thread_name(const char *name) {
+  profile_thread_t *thread = current_thread();
+  if (!thread) return;
+  pthread_mutex_lock(&profile_mutex);
+  snprintf(thread->name, PROFILE_MAX_NAME, "%s", name);
+  pthread_mutex_unlock(&profile_mutex);
+}
+/* Open a CPU scope on the calling thread */
+void profile_begin(const char *name) {
+  profile_thread_t *thread = current_thread();
+  if (!thread) return;
+  if (thread->depth < PROFILE_MAX_DEPTH) {
+    thread->stack_names[thread->depth] = name;
+    thread->stack_begins[thread->depth] = profile_now();
+  }
+  thread->depth++;
+}
+/* Close the calling thread's innermost CPU scope */
+void profile_end(void) {
+  profile_thread_t *thread = current_thread();
+  profile_event_t *event;
+  uint32_t count;
+  if (!thread) return;
+  ASSERT(thread->depth > 0);
+  if (--thread->depth >= PROFILE_MAX_DEPTH) return;
+  count = atomic_load_explicit(&thread->count, memory_order_relaxed);
+  if (count == PROFILE_THREAD_EVENTS) {
+    telemetry_report("profile.dropped", TELEMETRY_COUNTER, 1.0);
+    return;
+  }
+  event = &thread->events[count];
+  event->name = thread->stack_names[thread->depth];
+  event->begin = thread->stack_begins[thread->depth];
+  event->end = profile_now();
+  event->depth = thread->depth;
+  atomic_store_explicit(&thread->count, count + 1, memory_order_release);
+}
+/* Create a GPU profiler (statistics needs pipelineStatisticsQuery enabled) */
+void profile_gpu_create(
+    profile_gpu_t *gpu,
+    const vk_inst_t *inst,
+    vk_phys_dev_t phys_dev,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    uint32_t frames,
+    bool statistics
+) {
+  VkQueryPoolCreateInfo query_info;
+  ASSERT(frames > 0 && frames <= PROFILE_MAX_FRAMES);
+  memset(gpu, 0, sizeof(profile_gpu_t));
+  gpu->dev = dev;
+  gpu->frames = frames;
+  gpu->statistics = statistics;
+  if (!phys_dev_info->properties.limits.timestampComputeAndGraphics) {
+    log_msg(LOG_LEVEL_WARN, "No GPU timestamps, so no GPU profiling");
+    return;
+  }
+  gpu->period = (double)phys_dev_info->properties.limits.timestampPeriod;
+  gpu->events = (profile_gpu_event_t *)malloc(
+      sizeof(profile_gpu_event_t) * PROFILE_GPU_EVENTS
+  );
+  ASSERT(gpu->events);
+
+  /* Queries for every frame slot */
+  query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  query_info.pNext = NULL;
+  query_info.flags = 0;
+  for (uint32_t i = 0; i < frames; i++) {
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = PROFILE_GPU_SCOPES * 2;
+    query_info.pipelineStatistics = 0;
+    VK_CHECK(vkCreateQueryPool(
+          dev->device,
+          &query_info,
+          NULL,
+          &gpu->slots[i].timestamps
+    ));
+    if (!statistics) continue;
+    query_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    query_info.queryCount = PROFILE_GPU_SCOPES;
+    query_info.pipelineStatistics = profile_statistic_flags;
+    VK_CHECK(vkCreateQueryPool(
+          dev->device,
+          &query_info,
+          NULL,
+          &gpu->slots[i].statistics
+    ));
+  }
+
+  /* Calibrated timestamps put GPU scopes exactly on the CPU timeline */
+  if (
+      vk_dev_has_ext(dev, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)
+      && supports_time_domains(inst, phys_dev)
+  ) {
+    gpu->get_calibrated_timestamps =
+      (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+          dev->device,
+          "vkGetCalibratedTimestampsEXT"
+      );
+  }
+  gpu->calibrated = calibrate(gpu);
+  if (!gpu->calibrated)
+    log_msg(LOG_LEVEL_WARN, "GPU profile times are approximate");
+}
+/* Read back a frame slot's last scopes and reset its queries in cmd */
+void profile_gpu_frame(
+    profile_gpu_t *gpu,
+    VkCommandBuffer cmd,
+    uint32_t frame
+) {
+  profile_gpu_frame_t *slot;
+  ASSERT(frame < gpu->frames);
+  if (gpu->period == 0.0) return;
+  slot = &gpu->slots[frame];
+  ASSERT(slot->depth == 0);
+  if (gpu->calibrated) calibrate(gpu);
+  if (slot->scope_count > 0 && !resolve(gpu, slot))
+    telemetry_report(
+        "profile.dropped",
+        TELEMETRY_COUNTER,
+        (double)slot->scope_count
+    );
+  vkCmdResetQueryPool(cmd, slot->timestamps, 0, PROFILE_GPU_SCOPES * 2);
+  if (gpu->statistics)
+    vkCmdResetQueryPool(cmd, slot->statistics, 0, PROFILE_GPU_SCOPES);
+  slot->scope_count = 0;
+  slot->statistics_count = 0;
+  slot->cpu_begin = profile_now();
+  gpu->frame = frame;
+}
+/* Open a GPU scope in cmd (outside or wholly inside a render pass) */
+void profile_gpu_begin(
+    profile_gpu_t *gpu,
+    VkCommandBuffer cmd,
+    const char *name
+) {
+  profile_gpu_frame_t *slot = &gpu->slots[gpu->frame];
+  profile_gpu_scope_t *scope;
+  uint32_t index;
+  if (gpu->period == 0.0) return;
+  ASSERT(slot->depth < PROFILE_MAX_DEPTH);
+  if (slot->scope_count == PROFILE_GPU_SCOPES) {
+    telemetry_report("profile.dropped", TELEMETRY_COUNTER, 1.0);
+    slot->stack[slot->depth++] = UINT32_MAX;
+    return;
+  }
+  index = slot->scope_count++;
+  scope = &slot->scopes[index];
+  scope->name = name;
+  scope->depth = slot->depth;
+  scope->statistics_query = UINT32_MAX;
+  vkCmdWriteTimestamp(
+      cmd,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      slot->timestamps,
+      index * 2
+  );
+  /* Statistics queries of one type can't nest */
+  if (gpu->statistics && slot->depth == 0) {
+    scope->statistics_query = slot->statistics_count++;
+    vkCmdBeginQuery(cmd, slot->statistics, scope->statistics_query, 0);
+  }
+  slot->stack[slot->depth++] = index;
+}
+/* Close the innermost GPU scope in cmd */
+void profile_gpu_end(profile_gpu_t *gpu, VkCommandBuffer cmd) {
+  profile_gpu_frame_t *slot = &gpu->slots[gpu->frame];
+  uint32_t index;
+  if (gpu->period == 0.0) return;
+  ASSERT(slot->depth > 0);
+  index = slot->stack[--slot->depth];
+  if (index == UINT32_MAX) return;
+  if (slot->scopes[index].statistics_query != UINT32_MAX)
+    vkCmdEndQuery(cmd, slot->statistics, slot->scopes[index].statistics_query);
+  vkCmdWriteTimestamp(
+      cmd,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      slot->timestamps,
+      index * 2 + 1
+  );
+}
+/* Destroy a GPU profiler */
+void profile_gpu_destroy(profile_gpu_t *gpu) {
+  if (gpu->period != 0.0) {
+    for (uint32_t i = 0; i < gpu->frames; i++) {
+      vkDestroyQueryPool(gpu->dev->device, gpu->slots[i].timestamps, NULL);
+      if (gpu->statistics)
+        vkDestroyQueryPool(gpu->dev->device, gpu->slots[i].statistics, NULL);
+    }
+    free(gpu->events);
+  }
+  memset(gpu, 0, sizeof(profile_gpu_t));
+}
+/* Write every scope so far as Chrome trace JSON (gpu may be NULL) */
+bool profile_write_trace(const char *path, const profile_gpu_t *gpu) {
+  FILE *file = fopen(path, "w");
+  uint32_t thread_count = atomic_load(&profile.thread_count);
+  bool first = true, ok;
+
+  if (!file) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to open %s: %s", path, strerror(errno));
+    return false;
+  }
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  /* CPU threads */
+  for (uint32_t i = 0; i < thread_count; i++) {
+    const profile_thread_t *thread = profile.threads[i];
+    uint32_t count = atomic_load_explicit(
+        (atomic_uint *)&thread->count,
+        memory_order_acquire
+    );
+    pthread_mutex_lock(&profile_mutex);
+    write_thread_name(file, thread->name, thread->id, &first);
+    pthread_mutex_unlock(&profile_mutex);
+    for (uint32_t j = 0; j < count; j++) {
+      write_event(file, &thread->events[j], thread->id, &first);
+      fprintf(file, "}");
+    }
+  }
+
+  /* GPU, with pipeline statistics as arguments */
+  if (gpu && gpu->event_count > 0) {
+    write_thread_name(file, "GPU", PROFILE_GPU_TID, &first);
+    for (uint32_t i = 0; i < gpu->event_count; i++) {
+      const profile_gpu_event_t *event = &gpu->events[i];
+      write_event(file, &event->event, PROFILE_GPU_TID, &first);
+      if (event->has_statistics) {
+        fprintf(file, ",\"args\":{");
+        for (uint32_t j = 0; j < PROFILE_STATISTICS; j++) {
+          fprintf(
+              file,
+              "%s\"%s\":%llu",
+              j ? "," : "",
+              profile_statistic_names[j],
+              (unsigned long long)event->statistics[j]
+          );
+        }
+        fprintf(file, "}");
+      }
+      fprintf(file, "}");
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  ok = !ferror(file);
+  if (fclose(file) != 0) ok = false;
+  if (ok) log_msg(LOG_LEVEL_SUCCESS, "Wrote trace to %s", path);
+  return ok;
+}
+/* Free every thread's scopes (no thread may still be recording) */
+void profile_shutdown(void) {
+  pthread_mutex_lock(&profile_mutex);
+  for (uint32_t i = 0; i < atomic_load(&profile.thread_count); i++) {
+    free(profile.threads[i]->events);
+    free(profile.threads[i]);
+    profile.threads[i] = NULL;
+  }
+  atomic_store(&profile.thread_count, 0);
+  pthread_mutex_unlock(&profile_mutex);
+  profile_current = NULL;
+}
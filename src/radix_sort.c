@@ -0,0 +1,158 @@
+/* Implements radix_sort.h */
+#include <radix_sort.h>
+
+/* Bytes per key, and values per byte */
+#define DIGITS 8
+#define BUCKETS 256
+/* Fewest items per chunk */
+#define MIN_CHUNK_ITEMS 4096u
+
+/* Types */
+/* Sort job arguments */
+typedef struct {
+  const radix_item_t *src;
+  radix_item_t *dst;
+  uint32_t count;
+  uint32_t chunk_size;
+  uint32_t shift;
+  uint32_t (*counts)[BUCKETS];              /* Per chunk, then starts */
+  uint32_t (*all_counts)[DIGITS][BUCKETS];  /* Per chunk, every byte */
+} sort_args_t;
+
+/* Get a chunk's range of the input */
+static void chunk_range(
+    const sort_args_t *args,
+    uint32_t chunk,
+    uint32_t *begin,
+    uint32_t *end
+) {
+  uint64_t first = (uint64_t)chunk * args->chunk_size;
+  uint64_t last = first + args->chunk_size;
+  *begin = first < args->count ? (uint32_t)first : args->count;
+  *end = last < args->count ? (uint32_t)last : args->count;
+}
+/* Count every byte of chunks [begin, end) */
+static void count_all(void *arg, uint32_t begin, uint32_t end) {
+  sort_args_t *args = (sort_args_t *)arg;
+  for (uint32_t chunk = begin; chunk < end; chunk++) {
+    uint32_t (*counts)[BUCKETS] = args->all_counts[chunk];
+    uint32_t first, last;
+    chunk_range(args, chunk, &first, &last);
+    memset(counts, 0, sizeof(uint32_t) * DIGITS * BUCKETS);
+    for (uint32_t i = first; i < last; i++) {
+      uint64_t key = args->src[i].key;
+      for (uint32_t digit = 0; digit < DIGITS; digit++)
+        counts[digit][(key >> (digit * 8)) & (BUCKETS - 1)]++;
+    }
+  }
+}
+/* Count one byte of chunks [begin, end) */
+static void count_digit(void *arg, uint32_t begin, uint32_t end) {
+  sort_args_t *args = (sort_args_t *)arg;
+  for (uint32_t chunk = begin; chunk < end; chunk++) {
+    uint32_t *counts = args->counts[chunk];
+    uint32_t first, last;
+    chunk_range(args, chunk, &first, &last);
+    memset(counts, 0, sizeof(uint32_t) * BUCKETS);
+    for (uint32_t i = first; i < last; i++)
+      counts[(args->src[i].key >> args->shift) & (BUCKETS - 1)]++;
+  }
+}
+/* Move chunks [begin, end) to their places by one byte */
+static void scatter(void *arg, uint32_t begin, uint32_t end) {
+  sort_args_t *args = (sort_args_t *)arg;
+  for (uint32_t chunk = begin; chunk < end; chunk++) {
+    uint32_t starts[BUCKETS], first, last;
+    memcpy(starts, args->counts[chunk], sizeof(starts));
+    chunk_range(args, chunk, &first, &last);
+    for (uint32_t i = first; i < last; i++) {
+      uint32_t bucket = (args->src[i].key >> args->shift) & (BUCKETS - 1);
+      args->dst[starts[bucket]++] = args->src[i];
+    }
+  }
+}
+/* Run a function over every chunk */
+static void run_chunks(
+    jobs_t *jobs,
+    jobs_for_fn_t fn,
+    sort_args_t *args,
+    uint32_t chunks
+) {
+  if (chunks > 1) jobs_parallel_for(jobs, fn, args, chunks, 1);
+  else fn(args, 0, 1);
+}
+
+/* Sort items by key (scratch holds count), returning the sorted array */
+radix_item_t *radix_sort(
+    jobs_t *jobs,
+    radix_item_t *items,
+    radix_item_t *scratch,
+    uint32_t count
+) {
+  sort_args_t args;
+  uint32_t chunks = 1;
+  bool counted = true;
+
+  if (count < 2) return items;
+  if (jobs && count >= RADIX_SORT_PARALLEL_ITEMS) {
+    chunks = count / MIN_CHUNK_ITEMS;
+    if (chunks > jobs->worker_count * 4) chunks = jobs->worker_count * 4;
+    if (chunks > RADIX_SORT_MAX_CHUNKS) chunks = RADIX_SORT_MAX_CHUNKS;
+    if (chunks < 1) chunks = 1;
+  }
+  args.src = items;
+  args.dst = scratch;
+  args.count = count;
+  args.chunk_size = (count + chunks - 1) / chunks;
+  args.counts = (uint32_t (*)[BUCKETS])malloc(
+      sizeof(uint32_t) * BUCKETS * chunks
+  );
+  args.all_counts = (uint32_t (*)[DIGITS][BUCKETS])malloc(
+      sizeof(uint32_t) * DIGITS * BUCKETS * chunks
+  );
+  ASSERT(args.counts && args.all_counts);
+  run_chunks(jobs, count_all, &args, chunks);
+
+  for (uint32_t digit = 0; digit < DIGITS; digit++) {
+    uint32_t start = 0;
+    bool same = false;
+    const radix_item_t *src;
+
+    /* Skip bytes every key shares */
+    for (uint32_t bucket = 0; bucket < BUCKETS && !same; bucket++) {
+      uint32_t total = 0;
+      for (uint32_t chunk = 0; chunk < chunks; chunk++)
+        total += args.all_counts[chunk][digit][bucket];
+      same = total == count;
+    }
+    if (same) continue;
+
+    /* Counts up front are per chunk only until the first scatter */
+    args.shift = digit * 8;
+    if (counted) {
+      for (uint32_t chunk = 0; chunk < chunks; chunk++) memcpy(
+          args.counts[chunk],
+          args.all_counts[chunk][digit],
+          sizeof(uint32_t) * BUCKETS
+      );
+      counted = false;
+    } else {
+      run_chunks(jobs, count_digit, &args, chunks);
+    }
+    for (uint32_t bucket = 0; bucket < BUCKETS; bucket++) {
+      for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        uint32_t n = args.counts[chunk][bucket];
+        args.counts[chunk][bucket] = start;
+        start += n;
+      }
+    }
+    run_chunks(jobs, scatter, &args, chunks);
+    src = args.src;
+    args.src = args.dst;
+    args.dst = (radix_item_t *)src;
+  }
+
+  free(args.counts);
+  free(args.all_counts);
+  return (radix_item_t *)args.src;
+}
@@ -0,0 +1,544 @@
+/* Implements scene.h */
+#include <scene.h>
+#include <telemetry.h>
+#if defined(__SSE__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Node flags */
+#define FLAG_DIRTY 1u
+#define FLAG_REMOVED 2u
+/* Alignment of the matrix arrays (bytes) */
+#define MATRIX_ALIGN 64
+/* Initial node and handle capacity */
+#define MIN_CAPACITY 256u
+
+/* Types */
+/* Update job arguments */
+typedef struct {
+  scene_t *scene;
+  uint8_t *upload;
+} update_args_t;
+
+/* Identity matrix */
+static const float identity[16] = {
+  1.0f, 0.0f, 0.0f, 0.0f,
+  0.0f, 1.0f, 0.0f, 0.0f,
+  0.0f, 0.0f, 1.0f, 0.0f,
+  0.0f, 0.0f, 0.0f, 1.0f,
+};
+
+/* Multiply a batch of local matrices by their parent's world matrix */
+static void multiply_batch(
+    const float *parent,
+    const float *local,
+    float *world,
+    uint32_t count
+) {
+#if defined(__AVX__)
+  /* Two result columns per iteration, each parent column in both halves */
+  __m256 c0 = _mm256_broadcast_ps((const __m128 *)(parent + 0));
+  __m256 c1 = _mm256_broadcast_ps((const __m128 *)(parent + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128 *)(parent + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128 *)(parent + 12));
+  for (uint32_t n = 0; n < count * 16; n += 8) {
+    __m256 v = _mm256_load_ps(local + n);
+    __m256 r = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xaa)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xff)));
+    _mm256_store_ps(world + n, r);
+  }
+#elif defined(__SSE__)
+  __m128 c0 = _mm_load_ps(parent + 0);
+  __m128 c1 = _mm_load_ps(parent + 4);
+  __m128 c2 = _mm_load_ps(parent + 8);
+  __m128 c3 = _mm_load_ps(parent + 12);
+  for (uint32_t n = 0; n < count * 16; n += 4) {
+    __m128 v = _mm_load_ps(local + n);
+    __m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xaa)));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, 0xff)));
+    _mm_store_ps(world + n, r);
+  }
+#elif defined(__ARM_NEON)
+  float32x4_t c0 = vld1q_f32(parent + 0);
+  float32x4_t c1 = vld1q_f32(parent + 4);
+  float32x4_t c2 = vld1q_f32(parent + 8);
+  float32x4_t c3 = vld1q_f32(parent + 12);
+  for (uint32_t n = 0; n < count * 16; n += 4) {
+    float32x4_t v = vld1q_f32(local + n);
+    float32x4_t r = vmulq_n_f32(c0, vgetq_lane_f32(v, 0));
+    r = vmlaq_n_f32(r, c1, vgetq_lane_f32(v, 1));
+    r = vmlaq_n_f32(r, c2, vgetq_lane_f32(v, 2));
+    r = vmlaq_n_f32(r, c3, vgetq_lane_f32(v, 3));
+    vst1q_f32(world + n, r);
+  }
+#else
+  for (uint32_t n = 0; n < count * 16; n += 4) {
+    for (uint32_t row = 0; row < 4; row++) {
+      world[n + row] =
+        parent[row] * local[n] +
+        parent[4 + row] * local[n + 1] +
+        parent[8 + row] * local[n + 2] +
+        parent[12 + row] * local[n + 3];
+    }
+  }
+#endif
+}
+/* Move matrices into a larger aligned array */
+static float *grow_matrices(float *old, uint32_t count, uint32_t capacity) {
+  float *matrices = (float *)aligned_alloc(
+      MATRIX_ALIGN,
+      (size_t)capacity * SCENE_MATRIX_SIZE
+  );
+  ASSERT(matrices);
+  if (count > 0) memcpy(matrices, old, (size_t)count * SCENE_MATRIX_SIZE);
+  free(old);
+  return matrices;
+}
+/* Make room for a number of nodes */
+static void reserve_nodes(scene_t *scene, uint32_t count) {
+  uint32_t capacity = scene->capacity ? scene->capacity : MIN_CAPACITY;
+  if (count <= scene->capacity) return;
+  while (capacity < count) capacity *= 2;
+  scene->local = grow_matrices(scene->local, scene->count, capacity);
+  scene->world = grow_matrices(scene->world, scene->count, capacity);
+  scene->parent = (uint32_t *)realloc(
+      scene->parent,
+      sizeof(uint32_t) * capacity
+  );
+  scene->subtree_end = (uint32_t *)realloc(
+      scene->subtree_end,
+      sizeof(uint32_t) * capacity
+  );
+  scene->handle_of = (uint32_t *)realloc(
+      scene->handle_of,
+      sizeof(uint32_t) * capacity
+  );
+  scene->flags = (uint8_t *)realloc(scene->flags, capacity);
+  scene->dirty = (uint32_t *)realloc(
+      scene->dirty,
+      sizeof(uint32_t) * capacity
+  );
+  scene->stack = (uint32_t *)realloc(
+      scene->stack,
+      sizeof(uint32_t) * capacity
+  );
+  scene->stack_end = (uint32_t *)realloc(
+      scene->stack_end,
+      sizeof(uint32_t) * capacity
+  );
+  ASSERT(scene->parent && scene->subtree_end && scene->handle_of);
+  ASSERT(scene->flags && scene->dirty && scene->stack && scene->stack_end);
+  scene->capacity = capacity;
+}
+/* Get an unused handle */
+static uint32_t new_handle(scene_t *scene) {
+  if (scene->free_handle_count > 0)
+    return scene->free_handles[--scene->free_handle_count];
+  if (scene->handle_count == scene->handle_capacity) {
+    scene->handle_capacity =
+      scene->handle_capacity ? scene->handle_capacity * 2 : MIN_CAPACITY;
+    scene->index_of = (uint32_t *)realloc(
+        scene->index_of,
+        sizeof(uint32_t) * scene->handle_capacity
+    );
+    scene->free_handles = (uint32_t *)realloc(
+        scene->free_handles,
+        sizeof(uint32_t) * scene->handle_capacity
+    );
+    ASSERT(scene->index_of && scene->free_handles);
+  }
+  return scene->handle_count++;
+}
+/* Mark a node dirty */
+static void mark_dirty(scene_t *scene, uint32_t index) {
+  if (scene->flags[index] & FLAG_DIRTY) return;
+  scene->flags[index] |= FLAG_DIRTY;
+  scene->dirty[scene->dirty_count++] = index;
+}
+/* Compare indices */
+static int compare_indices(const void *a, const void *b) {
+  uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+  return ia < ib ? -1 : ia > ib;
+}
+/* Rebuild the depth first order, dropping removed nodes */
+static void rebuild_order(scene_t *scene) {
+  uint32_t n = scene->count, count = 0, depth = 0;
+  uint32_t *first_child = (uint32_t *)calloc(n + 1, sizeof(uint32_t));
+  uint32_t *children = (uint32_t *)malloc(sizeof(uint32_t) * (n + 1));
+  uint32_t *order = (uint32_t *)malloc(sizeof(uint32_t) * (n + 1));
+  uint32_t *new_index = (uint32_t *)malloc(sizeof(uint32_t) * (n + 1));
+  uint32_t *subtree_end = (uint32_t *)malloc(
+      sizeof(uint32_t) * scene->capacity
+  );
+  uint32_t *parent, *handle_of;
+  float *local, *world;
+  ASSERT(first_child && children && order && new_index && subtree_end);
+
+  /* Children of each node, in index order (a compressed sparse row) */
+  for (uint32_t i = 0; i < n; i++) {
+    if (scene->flags[i] & FLAG_REMOVED) continue;
+    if (scene->parent[i] != SCENE_NONE) first_child[scene->parent[i] + 1]++;
+  }
+  for (uint32_t i = 0; i < n; i++) first_child[i + 1] += first_child[i];
+  memcpy(new_index, first_child, sizeof(uint32_t) * n);
+  for (uint32_t i = 0; i < n; i++) {
+    if (scene->flags[i] & FLAG_REMOVED) continue;
+    if (scene->parent[i] != SCENE_NONE)
+      children[new_index[scene->parent[i]]++] = i;
+  }
+
+  /* Walk each root's tree (stack: node, stack_end: next child) */
+  for (uint32_t root = 0; root < n; root++) {
+    if (scene->flags[root] & FLAG_REMOVED) continue;
+    if (scene->parent[root] != SCENE_NONE) continue;
+    new_index[root] = count;
+    order[count++] = root;
+    scene->stack[0] = root;
+    scene->stack_end[0] = first_child[root];
+    depth = 1;
+    while (depth > 0) {
+      uint32_t node = scene->stack[depth - 1];
+      if (scene->stack_end[depth - 1] < first_child[node + 1]) {
+        uint32_t child = children[scene->stack_end[depth - 1]++];
+        new_index[child] = count;
+        order[count++] = child;
+        scene->stack[depth] = child;
+        scene->stack_end[depth] = first_child[child];
+        depth++;
+      } else {
+        subtree_end[new_index[node]] = count;
+        depth--;
+      }
+    }
+  }
+
+  /* Permute every array into the new order */
+  local = grow_matrices(NULL, 0, scene->capacity);
+  world = grow_matrices(NULL, 0, scene->capacity);
+  parent = (uint32_t *)malloc(sizeof(uint32_t) * scene->capacity);
+  handle_of = (uint32_t *)malloc(sizeof(uint32_t) * scene->capacity);
+  ASSERT(parent && handle_of);
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t old = order[i];
+    memcpy(local + i * 16, scene->local + old * 16, SCENE_MATRIX_SIZE);
+    memcpy(world + i * 16, scene->world + old * 16, SCENE_MATRIX_SIZE);
+    parent[i] = scene->parent[old] == SCENE_NONE
+      ? SCENE_NONE : new_index[scene->parent[old]];
+    handle_of[i] = scene->handle_of[old];
+    scene->index_of[handle_of[i]] = i;
+    scene->flags[i] = 0;
+  }
+  free(scene->local);
+  free(scene->world);
+  free(scene->parent);
+  free(scene->subtree_end);
+  free(scene->handle_of);
+  scene->local = local;
+  scene->world = world;
+  scene->parent = parent;
+  scene->subtree_end = subtree_end;
+  scene->handle_of = handle_of;
+  scene->count = count;
+  scene->removed_count = 0;
+  scene->dirty_count = 0;
+  scene->order_stale = false;
+  scene->invalid = true;
+  scene->reordered = true;
+
+  free(first_child);
+  free(children);
+  free(order);
+  free(new_index);
+}
+/* Add a range to the plan, merging it into the last one if adjacent */
+static void push_range(
+    scene_t *scene,
+    uint32_t first,
+    uint32_t count,
+    bool serial
+) {
+  scene_range_t *last = scene->range_count > 0
+    ? &scene->ranges[scene->range_count - 1] : NULL;
+  if (
+      last && last->serial == serial &&
+      last->first + last->count == first &&
+      (serial || last->count + count <= SCENE_SPLIT_NODES)
+  ) {
+    last->count += count;
+    scene->upload_count += count;
+    return;
+  }
+  if (scene->range_count == scene->range_capacity) {
+    scene->range_capacity =
+      scene->range_capacity ? scene->range_capacity * 2 : 64;
+    scene->ranges = (scene_range_t *)realloc(
+        scene->ranges,
+        sizeof(scene_range_t) * scene->range_capacity
+    );
+    ASSERT(scene->ranges);
+  }
+  scene->ranges[scene->range_count].first = first;
+  scene->ranges[scene->range_count].count = count;
+  scene->ranges[scene->range_count].upload = scene->upload_count;
+  scene->ranges[scene->range_count].serial = serial;
+  scene->range_count++;
+  scene->upload_count += count;
+}
+/* Plan a subtree, splitting it at roots that are too large */
+static void plan_subtree(scene_t *scene, uint32_t root) {
+  uint32_t depth = 0;
+  if (scene->subtree_end[root] - root <= SCENE_SPLIT_NODES) {
+    push_range(scene, root, scene->subtree_end[root] - root, false);
+    return;
+  }
+  /* stack: next child to visit, stack_end: end of its parent's subtree */
+  push_range(scene, root, 1, true);
+  scene->stack[0] = root + 1;
+  scene->stack_end[0] = scene->subtree_end[root];
+  depth = 1;
+  while (depth > 0) {
+    uint32_t child = scene->stack[depth - 1], size;
+    if (child == scene->stack_end[depth - 1]) {
+      depth--;
+      continue;
+    }
+    size = scene->subtree_end[child] - child;
+    scene->stack[depth - 1] = scene->subtree_end[child];
+    if (size <= SCENE_SPLIT_NODES) {
+      push_range(scene, child, size, false);
+    } else {
+      push_range(scene, child, 1, true);
+      scene->stack[depth] = child + 1;
+      scene->stack_end[depth] = scene->subtree_end[child];
+      depth++;
+    }
+  }
+}
+/* Recompute a range of nodes and copy it to the upload */
+static void update_range(
+    scene_t *scene,
+    const scene_range_t *range,
+    uint8_t *upload
+) {
+  uint32_t end = range->first + range->count;
+  for (uint32_t i = range->first; i < end;) {
+    uint32_t parent = scene->parent[i], run = i + 1;
+    if (parent == SCENE_NONE) {
+      memcpy(
+          scene->world + i * 16,
+          scene->local + i * 16,
+          SCENE_MATRIX_SIZE
+      );
+      i++;
+      continue;
+    }
+    /* Siblings with the same parent share its columns */
+    while (run < end && scene->parent[run] == parent) run++;
+    multiply_batch(
+        scene->world + parent * 16,
+        scene->local + i * 16,
+        scene->world + i * 16,
+        run - i
+    );
+    i = run;
+  }
+  if (upload) memcpy(
+      upload + (size_t)range->upload * SCENE_MATRIX_SIZE,
+      scene->world + (size_t)range->first * 16,
+      (size_t)range->count * SCENE_MATRIX_SIZE
+  );
+}
+/* Update job: recompute the independent ranges in [begin, end) */
+static void update_ranges(void *arg, uint32_t begin, uint32_t end) {
+  update_args_t *args = (update_args_t *)arg;
+  for (uint32_t i = begin; i < end; i++) {
+    if (args->scene->ranges[i].serial) continue;
+    update_range(args->scene, &args->scene->ranges[i], args->upload);
+  }
+}
+
+/* Create an empty scene */
+void scene_create(scene_t *scene) {
+  memset(scene, 0, sizeof(scene_t));
+}
+/* Add a node under a parent (SCENE_NONE for a root), returning its handle */
+uint32_t scene_add(scene_t *scene, uint32_t parent, const float *local) {
+  uint32_t parent_index = SCENE_NONE, index, handle;
+  if (parent != SCENE_NONE) parent_index = scene_index(scene, parent);
+  reserve_nodes(scene, scene->count + 1);
+  index = scene->count++;
+  handle = new_handle(scene);
+  scene->index_of[handle] = index;
+  scene->handle_of[index] = handle;
+  memcpy(
+      scene->local + index * 16,
+      local ? local : identity,
+      SCENE_MATRIX_SIZE
+  );
+  memcpy(scene->world + index * 16, identity, SCENE_MATRIX_SIZE);
+  scene->parent[index] = parent_index;
+  scene->subtree_end[index] = index + 1;
+  scene->flags[index] = 0;
+  mark_dirty(scene, index);
+
+  /* Under the last subtree, every ancestor's subtree just grows by one */
+  if (parent_index == SCENE_NONE || scene->order_stale) return handle;
+  if (scene->subtree_end[parent_index] != index) {
+    scene->order_stale = true;
+    return handle;
+  }
+  for (uint32_t i = parent_index; i != SCENE_NONE; i = scene->parent[i])
+    scene->subtree_end[i] = index + 1;
+  return handle;
+}
+/* Remove a node and its descendants */
+void scene_remove(scene_t *scene, uint32_t handle) {
+  uint32_t index;
+  if (scene->order_stale) rebuild_order(scene);
+  index = scene_index(scene, handle);
+  for (uint32_t i = index; i < scene->subtree_end[index]; i++) {
+    if (scene->flags[i] & FLAG_REMOVED) continue;
+    scene->flags[i] |= FLAG_REMOVED;
+    scene->index_of[scene->handle_of[i]] = SCENE_NONE;
+    scene->free_handles[scene->free_handle_count++] = scene->handle_of[i];
+    scene->removed_count++;
+  }
+  if (scene->removed_count * 4 > scene->count) scene->order_stale = true;
+}
+/* Set a node's local matrix */
+void scene_set_local(scene_t *scene, uint32_t handle, const float *local) {
+  uint32_t index = scene_index(scene, handle);
+  memcpy(scene->local + index * 16, local, SCENE_MATRIX_SIZE);
+  mark_dirty(scene, index);
+}
+/* Get a node's world matrix (as of the last update) */
+const float *scene_world(const scene_t *scene, uint32_t handle) {
+  return scene->world + scene_index(scene, handle) * 16;
+}
+/* Get a node's index (its world matrix's place in the GPU copy) */
+uint32_t scene_index(const scene_t *scene, uint32_t handle) {
+  ASSERT(handle < scene->handle_count);
+  ASSERT(scene->index_of[handle] != SCENE_NONE);
+  return scene->index_of[handle];
+}
+/* Mark every node changed */
+void scene_invalidate(scene_t *scene) {
+  scene->invalid = true;
+}
+/* Plan the next update, returning the matrices it will upload */
+uint32_t scene_prepare(scene_t *scene) {
+  uint32_t covered = 0;
+  if (scene->order_stale) rebuild_order(scene);
+  scene->range_count = 0;
+  scene->upload_count = 0;
+  if (scene->invalid) {
+    for (uint32_t i = 0; i < scene->count; i = scene->subtree_end[i])
+      plan_subtree(scene, i);
+  } else {
+    /* A dirty node's subtree covers every dirty node inside it */
+    qsort(scene->dirty, scene->dirty_count, sizeof(uint32_t), compare_indices);
+    for (uint32_t i = 0; i < scene->dirty_count; i++) {
+      uint32_t index = scene->dirty[i];
+      if (index < covered) continue;
+      plan_subtree(scene, index);
+      covered = scene->subtree_end[index];
+    }
+  }
+  scene->prepared = true;
+  return scene->upload_count;
+}
+/* Recompute changed world matrices (jobs and upload may be NULL) */
+void scene_update(scene_t *scene, jobs_t *jobs, void *upload) {
+  double start = time_now();
+  update_args_t args;
+
+  if (!scene->prepared) scene_prepare(scene);
+  args.scene = scene;
+  args.upload = (uint8_t *)upload;
+
+  /* Split roots first, in order, so the ranges below them are independent */
+  for (uint32_t i = 0; i < scene->range_count; i++) {
+    if (scene->ranges[i].serial)
+      update_range(scene, &scene->ranges[i], args.upload);
+  }
+  if (jobs && scene->upload_count > SCENE_JOB_NODES) {
+    uint64_t grain =
+      (uint64_t)scene->range_count * SCENE_JOB_NODES / scene->upload_count;
+    jobs_parallel_for(
+        jobs,
+        update_ranges,
+        &args,
+        scene->range_count,
+        grain > 0 ? (uint32_t)grain : 1
+    );
+  } else {
+    update_ranges(&args, 0, scene->range_count);
+  }
+
+  for (uint32_t i = 0; i < scene->dirty_count; i++)
+    scene->flags[scene->dirty[i]] &= (uint8_t)~FLAG_DIRTY;
+  scene->dirty_count = 0;
+  scene->invalid = false;
+  scene->reordered = false;
+  scene->prepared = false;
+  telemetry_report(
+      "scene.update",
+      TELEMETRY_TIMING,
+      (time_now() - start) * 1e3
+  );
+  telemetry_report(
+      "scene.updated_nodes",
+      TELEMETRY_GAUGE,
+      scene->upload_count
+  );
+  telemetry_report("scene.ranges", TELEMETRY_GAUGE, scene->range_count);
+}
+/* Get the copies from an upload into the GPU copy (range_count at most) */
+uint32_t scene_upload_regions(
+    const scene_t *scene,
+    VkDeviceSize src_offset,
+    VkBufferCopy *regions
+) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < scene->range_count; i++) {
+    const scene_range_t *range = &scene->ranges[i];
+    VkDeviceSize src = src_offset + range->upload * SCENE_MATRIX_SIZE;
+    VkDeviceSize dst = range->first * SCENE_MATRIX_SIZE;
+    VkDeviceSize size = range->count * SCENE_MATRIX_SIZE;
+    if (
+        count > 0 &&
+        regions[count - 1].srcOffset + regions[count - 1].size == src &&
+        regions[count - 1].dstOffset + regions[count - 1].size == dst
+    ) {
+      regions[count - 1].size += size;
+      continue;
+    }
+    regions[count].srcOffset = src;
+    regions[count].dstOffset = dst;
+    regions[count].size = size;
+    count++;
+  }
+  return count;
+}
+/* Destroy a scene */
+void scene_destroy(scene_t *scene) {
+  free(scene->local);
+  free(scene->world);
+  free(scene->parent);
+  free(scene->subtree_end);
+  free(scene->handle_of);
+  free(scene->flags);
+  free(scene->index_of);
+  free(scene->free_handles);
+  free(scene->dirty);
+  free(scene->ranges);
+  free(scene->stack);
+  free(scene->stack_end);
+  memset(scene, 0, sizeof(scene_t));
+}
@@ -0,0 +1,63 @@
+/* Implements spsc_queue.h */
+#include <spsc_queue.h>
+
+/* Create a queue (capacity is rounded up to a power of two) */
+void spsc_queue_create(
+    spsc_queue_t *queue,
+    uint32_t element_size,
+    uint32_t capacity
+) {
+  uint32_t size = 1;
+  ASSERT(element_size > 0 && capacity > 0 && capacity <= (1u << 31));
+  while (size < capacity) size <<= 1;
+  memset(queue, 0, sizeof(spsc_queue_t));
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  queue->data = (uint8_t *)malloc((size_t)element_size * size);
+  ASSERT(queue->data);
+  queue->element_size = element_size;
+  queue->mask = size - 1;
+}
+/* Push an element (producer only, false if full) */
+bool spsc_queue_push(spsc_queue_t *queue, const void *element) {
+  uint32_t tail = (uint32_t)atomic_load_explicit(
+      &queue->tail,
+      memory_order_relaxed
+  );
+  uint32_t head = (uint32_t)atomic_load_explicit(
+      &queue->head,
+      memory_order_acquire
+  );
+  if (tail - head > queue->mask) return false;
+  memcpy(
+      queue->data + (size_t)(tail & queue->mask) * queue->element_size,
+      element,
+      queue->element_size
+  );
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return true;
+}
+/* Pop an element (consumer only, false if empty) */
+bool spsc_queue_pop(spsc_queue_t *queue, void *element) {
+  uint32_t head = (uint32_t)atomic_load_explicit(
+      &queue->head,
+      memory_order_relaxed
+  );
+  uint32_t tail = (uint32_t)atomic_load_explicit(
+      &queue->tail,
+      memory_order_acquire
+  );
+  if (head == tail) return false;
+  memcpy(
+      element,
+      queue->data + (size_t)(head & queue->mask) * queue->element_size,
+      queue->element_size
+  );
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return true;
+}
+/* Destroy a queue */
+void spsc_queue_destroy(spsc_queue_t *queue) {
+  free(queue->data);
+  memset(queue, 0, sizeof(spsc_queue_t));
+}
@@ -0,0 +1,98 @@
+/* Implements telemetry.h */
+#include <telemetry.h>
+#include <pthread.h>
+
+/* Telemetry registry */
+static struct {
+  telemetry_entry_t entries[TELEMETRY_MAX_ENTRIES];
+  uint32_t entry_count;
+} telemetry;
+/* Registry lock (reports may come from any thread) */
+static pthread_mutex_t telemetry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Find an entry by name */
+static telemetry_entry_t *find_entry(const char *name) {
+  for (uint32_t i = 0; i < telemetry.entry_count; i++) {
+    if (strcmp(telemetry.entries[i].name, name) == 0)
+      return &telemetry.entries[i];
+  }
+  return NULL;
+}
+
+/* Report a telemetry value (thread safe) */
+void telemetry_report(
+    const char *name,
+    telemetry_kind_t kind,
+    double value
+) {
+  telemetry_entry_t *entry;
+  pthread_mutex_lock(&telemetry_mutex);
+  entry = find_entry(name);
+  if (entry == NULL) {
+    ASSERT(telemetry.entry_count < TELEMETRY_MAX_ENTRIES);
+    ASSERT(strlen(name) < TELEMETRY_MAX_NAME);
+    entry = &telemetry.entries[telemetry.entry_count++];
+    memset(entry, 0, sizeof(telemetry_entry_t));
+    strcpy(entry->name, name);
+    entry->kind = kind;
+    entry->min = value;
+    entry->max = value;
+  }
+  ASSERT(entry->kind == kind);
+  if (kind == TELEMETRY_COUNTER) entry->value += value;
+  else entry->value = value;
+  if (value < entry->min) entry->min = value;
+  if (value > entry->max) entry->max = value;
+  entry->sum += value;
+  entry->samples++;
+  pthread_mutex_unlock(&telemetry_mutex);
+}
+/* Copy a telemetry entry out by name (false if never reported) */
+bool telemetry_get(const char *name, telemetry_entry_t *entry) {
+  const telemetry_entry_t *found;
+  pthread_mutex_lock(&telemetry_mutex);
+  found = find_entry(name);
+  if (found) *entry = *found;
+  pthread_mutex_unlock(&telemetry_mutex);
+  return found != NULL;
+}
+/* Log every telemetry entry */
+void telemetry_dump(void) {
+  pthread_mutex_lock(&telemetry_mutex);
+  for (uint32_t i = 0; i < telemetry.entry_count; i++) {
+    const telemetry_entry_t *entry = &telemetry.entries[i];
+    switch (entry->kind) {
+      case TELEMETRY_COUNTER:
+        log_msg(LOG_LEVEL_INFO, "%s: %.0f", entry->name, entry->value);
+        break;
+      case TELEMETRY_GAUGE:
+        log_msg(
+            LOG_LEVEL_INFO,
+            "%s: %.3f (min %.3f, max %.3f)",
+            entry->name,
+            entry->value,
+            entry->min,
+            entry->max
+        );
+        break;
+      case TELEMETRY_TIMING:
+        log_msg(
+            LOG_LEVEL_INFO,
+            "%s: %.3fms avg (min %.3fms, max %.3fms, %llu samples)",
+            entry->name,
+            entry->sum / (double)entry->samples,
+            entry->min,
+            entry->max,
+            (unsigned long long)entry->samples
+        );
+        break;
+    }
+  }
+  pthread_mutex_unlock(&telemetry_mutex);
+}
+/* Clear all telemetry entries */
+void telemetry_reset(void) {
+  pthread_mutex_lock(&telemetry_mutex);
+  memset(&telemetry, 0, sizeof(telemetry));
+  pthread_mutex_unlock(&telemetry_mutex);
+}
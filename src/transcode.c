@@ -0,0 +1,703 @@
+/* Implements transcode.h */
+#include <transcode.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSCODE_X86 1
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TRANSCODE_NEON 1
+#endif
+
+/* Interpolation weights (of 64) of the four selectors, shared by BC7/ASTC */
+static const uint32_t selector_weights[4] = { 0, 21, 43, 64 };
+
+/* Types */
+/* Row of RGBA8 blocks kernel */
+typedef void (*rgba8_row_fn_t)(
+    const uint8_t *src,
+    uint32_t block_count,
+    uint8_t *dst,
+    size_t pitch
+);
+/* Block rows job */
+typedef struct {
+  job_t job;
+  transcode_target_t target;
+  const uint8_t *src;
+  uint32_t width;
+  uint32_t height;
+  uint32_t first_row;
+  uint32_t row_count;
+  uint8_t *dst;
+} rows_job_t;
+
+/* Shuffle controls expanding a selector byte (4 texels) to palette bytes */
+static uint8_t shuffle_lut[256][16];
+/* Kernel in use */
+static transcode_kernel_t current_kernel = TRANSCODE_KERNEL_SCALAR;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/* Read a little endian 32 bit value */
+static uint32_t read32(const uint8_t *p) {
+  return (uint32_t)p[0]
+    | (uint32_t)p[1] << 8
+    | (uint32_t)p[2] << 16
+    | (uint32_t)p[3] << 24;
+}
+/* Write a little endian 64 bit value */
+static void write64(uint8_t *p, uint64_t value) {
+  for (uint32_t i = 0; i < 8; i++) p[i] = (uint8_t)(value >> (8 * i));
+}
+/* Build the four colour palette of a block */
+static void block_palette(const uint8_t *block, uint8_t palette[16]) {
+  for (uint32_t i = 0; i < 4; i++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      palette[i * 4 + c] = (uint8_t)((
+        block[c] * (64 - selector_weights[i])
+        + block[4 + c] * selector_weights[i]
+        + 32
+      ) >> 6);
+    }
+  }
+}
+/* Check if the CPU supports a kernel */
+static bool kernel_supported(transcode_kernel_t kernel) {
+  switch (kernel) {
+    case TRANSCODE_KERNEL_SCALAR:
+      return true;
+#if defined(TRANSCODE_X86)
+    case TRANSCODE_KERNEL_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+    case TRANSCODE_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#if defined(TRANSCODE_NEON)
+    case TRANSCODE_KERNEL_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+/* Build the shuffle table and pick the best kernel */
+static void transcode_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    for (uint32_t texel = 0; texel < 4; texel++) {
+      uint32_t selector = (i >> (2 * texel)) & 3;
+      for (uint32_t c = 0; c < 4; c++)
+        shuffle_lut[i][texel * 4 + c] = (uint8_t)(selector * 4 + c);
+    }
+  }
+  for (int kernel = TRANSCODE_KERNEL_COUNT - 1; kernel >= 0; kernel--) {
+    if (kernel_supported((transcode_kernel_t)kernel)) {
+      current_kernel = (transcode_kernel_t)kernel;
+      break;
+    }
+  }
+}
+
+/* Decode a row of whole blocks to RGBA8 (scalar) */
+static void rgba8_row_scalar(
+    const uint8_t *src,
+    uint32_t block_count,
+    uint8_t *dst,
+    size_t pitch
+) {
+  for (uint32_t i = 0; i < block_count; i++) {
+    const uint8_t *block = src + (size_t)i * TRANSCODE_BLOCK_BYTES;
+    uint32_t selectors = read32(block + 8);
+    uint8_t palette[16];
+    block_palette(block, palette);
+    for (uint32_t y = 0; y < 4; y++) {
+      uint8_t *out = dst + y * pitch + (size_t)i * 16;
+      for (uint32_t x = 0; x < 4; x++) {
+        uint32_t selector = (selectors >> (2 * (y * 4 + x))) & 3;
+        memcpy(out + x * 4, palette + selector * 4, 4);
+      }
+    }
+  }
+}
+#if defined(TRANSCODE_X86)
+/* Build two palettes (one per 128 bit lane) from widened endpoints */
+#define PALETTE_WEIGHTS(a, b) _mm_set_epi16(b, b, b, b, a, a, a, a)
+/* Decode a row of whole blocks to RGBA8 (SSE4.1) */
+__attribute__((target("sse4.1")))
+static void rgba8_row_sse41(
+    const uint8_t *src,
+    uint32_t block_count,
+    uint8_t *dst,
+    size_t pitch
+) {
+  const __m128i w0_lo = PALETTE_WEIGHTS(64, 43);
+  const __m128i w1_lo = PALETTE_WEIGHTS(0, 21);
+  const __m128i w0_hi = PALETTE_WEIGHTS(21, 0);
+  const __m128i w1_hi = PALETTE_WEIGHTS(43, 64);
+  const __m128i round = _mm_set1_epi16(32);
+  for (uint32_t i = 0; i < block_count; i++) {
+    const uint8_t *block = src + (size_t)i * TRANSCODE_BLOCK_BYTES;
+    __m128i endpoints = _mm_cvtepu8_epi16(
+        _mm_loadl_epi64((const __m128i *)block)
+    );
+    __m128i e0 = _mm_unpacklo_epi64(endpoints, endpoints);
+    __m128i e1 = _mm_unpackhi_epi64(endpoints, endpoints);
+    __m128i p01 = _mm_srli_epi16(_mm_add_epi16(
+          _mm_add_epi16(_mm_mullo_epi16(e0, w0_lo), _mm_mullo_epi16(e1, w1_lo)),
+          round
+    ), 6);
+    __m128i p23 = _mm_srli_epi16(_mm_add_epi16(
+          _mm_add_epi16(_mm_mullo_epi16(e0, w0_hi), _mm_mullo_epi16(e1, w1_hi)),
+          round
+    ), 6);
+    __m128i palette = _mm_packus_epi16(p01, p23);
+    uint32_t selectors = read32(block + 8);
+    for (uint32_t y = 0; y < 4; y++) {
+      __m128i control = _mm_loadu_si128(
+          (const __m128i *)shuffle_lut[(selectors >> (8 * y)) & 0xff]
+      );
+      _mm_storeu_si128(
+          (__m128i *)(dst + y * pitch + (size_t)i * 16),
+          _mm_shuffle_epi8(palette, control)
+      );
+    }
+  }
+}
+/* Decode a row of whole blocks to RGBA8 (AVX2, two blocks at a time) */
+__attribute__((target("avx2")))
+static void rgba8_row_avx2(
+    const uint8_t *src,
+    uint32_t block_count,
+    uint8_t *dst,
+    size_t pitch
+) {
+  const __m256i w0_lo = _mm256_broadcastsi128_si256(PALETTE_WEIGHTS(64, 43));
+  const __m256i w1_lo = _mm256_broadcastsi128_si256(PALETTE_WEIGHTS(0, 21));
+  const __m256i w0_hi = _mm256_broadcastsi128_si256(PALETTE_WEIGHTS(21, 0));
+  const __m256i w1_hi = _mm256_broadcastsi128_si256(PALETTE_WEIGHTS(43, 64));
+  const __m256i round = _mm256_set1_epi16(32);
+  uint32_t i = 0;
+  for (; i + 2 <= block_count; i += 2) {
+    const uint8_t *block_a = src + (size_t)i * TRANSCODE_BLOCK_BYTES;
+    const uint8_t *block_b = block_a + TRANSCODE_BLOCK_BYTES;
+    __m256i endpoints = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(
+          _mm_loadl_epi64((const __m128i *)block_a),
+          _mm_loadl_epi64((const __m128i *)block_b)
+    ));
+    __m256i e0 = _mm256_unpacklo_epi64(endpoints, endpoints);
+    __m256i e1 = _mm256_unpackhi_epi64(endpoints, endpoints);
+    __m256i p01 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(e0, w0_lo),
+            _mm256_mullo_epi16(e1, w1_lo)
+    ), round), 6);
+    __m256i p23 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(e0, w0_hi),
+            _mm256_mullo_epi16(e1, w1_hi)
+    ), round), 6);
+    __m256i palettes = _mm256_packus_epi16(p01, p23);
+    uint32_t selectors_a = read32(block_a + 8);
+    uint32_t selectors_b = read32(block_b + 8);
+    for (uint32_t y = 0; y < 4; y++) {
+      __m256i control = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128(
+              (const __m128i *)shuffle_lut[(selectors_a >> (8 * y)) & 0xff]
+          )),
+          _mm_loadu_si128(
+              (const __m128i *)shuffle_lut[(selectors_b >> (8 * y)) & 0xff]
+          ),
+          1
+      );
+      _mm256_storeu_si256(
+          (__m256i *)(dst + y * pitch + (size_t)i * 16),
+          _mm256_shuffle_epi8(palettes, control)
+      );
+    }
+  }
+  if (i < block_count)
+    rgba8_row_sse41(
+        src + (size_t)i * TRANSCODE_BLOCK_BYTES,
+        block_count - i,
+        dst + (size_t)i * 16,
+        pitch
+    );
+}
+#endif
+#if defined(TRANSCODE_NEON)
+/* Decode a row of whole blocks to RGBA8 (NEON) */
+static void rgba8_row_neon(
+    const uint8_t *src,
+    uint32_t block_count,
+    uint8_t *dst,
+    size_t pitch
+) {
+  static const uint16_t weights[4][8] = {
+    { 64, 64, 64, 64, 43, 43, 43, 43 },
+    { 0, 0, 0, 0, 21, 21, 21, 21 },
+    { 21, 21, 21, 21, 0, 0, 0, 0 },
+    { 43, 43, 43, 43, 64, 64, 64, 64 }
+  };
+  const uint16x8_t w0_lo = vld1q_u16(weights[0]);
+  const uint16x8_t w1_lo = vld1q_u16(weights[1]);
+  const uint16x8_t w0_hi = vld1q_u16(weights[2]);
+  const uint16x8_t w1_hi = vld1q_u16(weights[3]);
+  for (uint32_t i = 0; i < block_count; i++) {
+    const uint8_t *block = src + (size_t)i * TRANSCODE_BLOCK_BYTES;
+    uint16x8_t endpoints = vmovl_u8(vld1_u8(block));
+    uint16x8_t e0 = vcombine_u16(
+        vget_low_u16(endpoints),
+        vget_low_u16(endpoints)
+    );
+    uint16x8_t e1 = vcombine_u16(
+        vget_high_u16(endpoints),
+        vget_high_u16(endpoints)
+    );
+    uint16x8_t p01 = vmlaq_u16(vmulq_u16(e0, w0_lo), e1, w1_lo);
+    uint16x8_t p23 = vmlaq_u16(vmulq_u16(e0, w0_hi), e1, w1_hi);
+    uint8x16_t palette = vcombine_u8(
+        vrshrn_n_u16(p01, 6),
+        vrshrn_n_u16(p23, 6)
+    );
+    uint32_t selectors = read32(block + 8);
+    for (uint32_t y = 0; y < 4; y++) {
+      uint8x16_t control =
+        vld1q_u8(shuffle_lut[(selectors >> (8 * y)) & 0xff]);
+      vst1q_u8(
+          dst + y * pitch + (size_t)i * 16,
+          vqtbl1q_u8(palette, control)
+      );
+    }
+  }
+}
+#endif
+/* Get the RGBA8 row kernel in use */
+static rgba8_row_fn_t rgba8_row_kernel(void) {
+  switch (current_kernel) {
+#if defined(TRANSCODE_X86)
+    case TRANSCODE_KERNEL_SSE41:
+      return rgba8_row_sse41;
+    case TRANSCODE_KERNEL_AVX2:
+      return rgba8_row_avx2;
+#endif
+#if defined(TRANSCODE_NEON)
+    case TRANSCODE_KERNEL_NEON:
+      return rgba8_row_neon;
+#endif
+    default:
+      return rgba8_row_scalar;
+  }
+}
+
+/* Spread 16 2 bit selectors into the low half of 16 nibbles */
+static uint64_t spread_selectors(uint32_t selectors) {
+  uint64_t x = selectors;
+  x = (x | x << 16) & 0x0000ffff0000ffffull;
+  x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+  x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+  x = (x | x << 2) & 0x3333333333333333ull;
+  return x;
+}
+/* Reverse the bits of a 32 bit value */
+static uint32_t reverse32(uint32_t x) {
+  x = (x >> 1 & 0x55555555u) | (x & 0x55555555u) << 1;
+  x = (x >> 2 & 0x33333333u) | (x & 0x33333333u) << 2;
+  x = (x >> 4 & 0x0f0f0f0fu) | (x & 0x0f0f0f0fu) << 4;
+  return __builtin_bswap32(x);
+}
+/* Pick the BC7 mode 6 p bit of an endpoint */
+static uint32_t bc7_pbit(const uint8_t *endpoint) {
+  uint32_t error[2] = { 0, 0 };
+  for (uint32_t p = 0; p < 2; p++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      int32_t q = ((int32_t)endpoint[c] - (int32_t)p + 1) >> 1;
+      int32_t value;
+      if (q < 0) q = 0;
+      if (q > 127) q = 127;
+      value = (q << 1) | (int32_t)p;
+      error[p] += (uint32_t)abs(value - (int32_t)endpoint[c]);
+    }
+  }
+  return error[1] < error[0];
+}
+/* Repack a block as BC7 mode 6 */
+static void block_bc7(const uint8_t *block, uint8_t *dst) {
+  const uint8_t *e0 = block, *e1 = block + 4;
+  uint32_t selectors = read32(block + 8);
+  uint64_t lo = 1u << 6, hi;
+  uint64_t indices;
+  uint32_t p0, p1;
+
+  /* Index 0 is stored without its top bit, so it must be below 8 */
+  if ((selectors & 3) >= 2) {
+    e0 = block + 4;
+    e1 = block;
+    selectors = ~selectors;
+  }
+  p0 = bc7_pbit(e0);
+  p1 = bc7_pbit(e1);
+  for (uint32_t c = 0; c < 4; c++) {
+    int32_t q0 = ((int32_t)e0[c] - (int32_t)p0 + 1) >> 1;
+    int32_t q1 = ((int32_t)e1[c] - (int32_t)p1 + 1) >> 1;
+    q0 = q0 < 0 ? 0 : q0 > 127 ? 127 : q0;
+    q1 = q1 < 0 ? 0 : q1 > 127 ? 127 : q1;
+    lo |= (uint64_t)q0 << (7 + 14 * c);
+    lo |= (uint64_t)q1 << (14 + 14 * c);
+  }
+  lo |= (uint64_t)p0 << 63;
+
+  /* Selectors 0..3 are indices 0, 5, 10, 15 */
+  indices = spread_selectors(selectors) * 5;
+  hi = p1 | (indices & 7) << 1 | (indices & ~0xfull);
+  write64(dst, lo);
+  write64(dst + 8, hi);
+}
+/* Write bits into a 128 bit block */
+static void put_bits(uint64_t bits[2], uint32_t offset, uint64_t value) {
+  bits[offset / 64] |= value << (offset % 64);
+  if (offset % 64 > 56) bits[offset / 64 + 1] |= value >> (64 - offset % 64);
+}
+/* Repack a block as ASTC 4x4 (RGBA direct, 8 bit endpoints, 2 bit weights) */
+static void block_astc(const uint8_t *block, uint8_t *dst) {
+  const uint8_t *e0 = block, *e1 = block + 4;
+  uint32_t selectors = read32(block + 8);
+  uint64_t bits[2] = { 0, 0 };
+
+  /* Decoders blue contract endpoint pairs whose sums are descending */
+  if (e1[0] + e1[1] + e1[2] < e0[0] + e0[1] + e0[2]) {
+    e0 = block + 4;
+    e1 = block;
+    selectors = ~selectors;
+  }
+  /* 4x4 weight grid of range 0..3, one partition, endpoint mode 12 */
+  bits[0] = 0x042 | 12u << 13;
+  for (uint32_t c = 0; c < 4; c++) {
+    put_bits(bits, 17 + 16 * c, e0[c]);
+    put_bits(bits, 25 + 16 * c, e1[c]);
+  }
+  /* Weights are stored bit reversed from the top of the block */
+  bits[1] |= (uint64_t)reverse32(selectors) << 32;
+  write64(dst, bits[0]);
+  write64(dst + 8, bits[1]);
+}
+/* Run a block rows job */
+static void rows_job(void *arg) {
+  rows_job_t *job = (rows_job_t *)arg;
+  transcode_rows(
+      job->target,
+      job->src,
+      job->width,
+      job->height,
+      job->first_row,
+      job->row_count,
+      job->dst
+  );
+}
+
+/* Squared error of a pixel against a palette entry */
+static uint32_t pixel_error(const uint8_t *pixel, const uint8_t *entry) {
+  uint32_t error = 0;
+  for (uint32_t c = 0; c < 4; c++) {
+    int32_t d = (int32_t)pixel[c] - (int32_t)entry[c];
+    error += (uint32_t)(d * d);
+  }
+  return error;
+}
+/* Choose selectors for endpoints, returns total squared error */
+static uint32_t fit_selectors(
+    const uint8_t pixels[16][4],
+    uint8_t *block
+) {
+  uint8_t palette[16];
+  uint32_t selectors = 0, total = 0;
+  block_palette(block, palette);
+  for (uint32_t i = 0; i < 16; i++) {
+    uint32_t best = 0, best_error = UINT32_MAX;
+    for (uint32_t s = 0; s < 4; s++) {
+      uint32_t error = pixel_error(pixels[i], palette + s * 4);
+      if (error < best_error) {
+        best_error = error;
+        best = s;
+      }
+    }
+    selectors |= best << (2 * i);
+    total += best_error;
+  }
+  for (uint32_t i = 0; i < 4; i++)
+    block[8 + i] = (uint8_t)(selectors >> (8 * i));
+  return total;
+}
+/* Quantize a float channel value */
+static uint8_t to_u8(float value) {
+  if (value < 0.0f) value = 0.0f;
+  if (value > 255.0f) value = 255.0f;
+  return (uint8_t)(value + 0.5f);
+}
+/* Encode one block: principal axis endpoints, then a least squares refit */
+static void encode_block(const uint8_t pixels[16][4], uint8_t *block) {
+  float mean[4] = { 0 }, cov[4][4] = { { 0 } }, axis[4] = { 1, 1, 1, 1 };
+  float t_min = INFINITY, t_max = -INFINITY;
+  uint8_t refit[TRANSCODE_BLOCK_BYTES];
+  uint32_t error;
+
+  for (uint32_t i = 0; i < 16; i++)
+    for (uint32_t c = 0; c < 4; c++) mean[c] += pixels[i][c] / 16.0f;
+  for (uint32_t i = 0; i < 16; i++)
+    for (uint32_t a = 0; a < 4; a++)
+      for (uint32_t b = 0; b < 4; b++)
+        cov[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+  for (uint32_t it = 0; it < 8; it++) {
+    float next[4] = { 0 }, length = 0.0f;
+    for (uint32_t a = 0; a < 4; a++)
+      for (uint32_t b = 0; b < 4; b++) next[a] += cov[a][b] * axis[b];
+    for (uint32_t a = 0; a < 4; a++) length += next[a] * next[a];
+    if (length < 1e-12f) break;
+    length = 1.0f / sqrtf(length);
+    for (uint32_t a = 0; a < 4; a++) axis[a] = next[a] * length;
+  }
+  for (uint32_t i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (uint32_t c = 0; c < 4; c++) t += (pixels[i][c] - mean[c]) * axis[c];
+    if (t < t_min) t_min = t;
+    if (t > t_max) t_max = t;
+  }
+  for (uint32_t c = 0; c < 4; c++) {
+    block[c] = to_u8(mean[c] + axis[c] * t_min);
+    block[4 + c] = to_u8(mean[c] + axis[c] * t_max);
+  }
+  error = fit_selectors(pixels, block);
+
+  /* Solve for the endpoints best matching the chosen selectors */
+  {
+    uint32_t selectors = read32(block + 8);
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, det;
+    float ax[4] = { 0 }, bx[4] = { 0 };
+    for (uint32_t i = 0; i < 16; i++) {
+      float w = selector_weights[(selectors >> (2 * i)) & 3] / 64.0f;
+      aa += (1.0f - w) * (1.0f - w);
+      ab += (1.0f - w) * w;
+      bb += w * w;
+      for (uint32_t c = 0; c < 4; c++) {
+        ax[c] += (1.0f - w) * pixels[i][c];
+        bx[c] += w * pixels[i][c];
+      }
+    }
+    det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return;
+    for (uint32_t c = 0; c < 4; c++) {
+      refit[c] = to_u8((ax[c] * bb - bx[c] * ab) / det);
+      refit[4 + c] = to_u8((bx[c] * aa - ax[c] * ab) / det);
+    }
+    if (fit_selectors(pixels, refit) < error)
+      memcpy(block, refit, TRANSCODE_BLOCK_BYTES);
+  }
+}
+
+/* Check if a texture format is a universal block format */
+bool transcode_is_universal(uint32_t format) {
+  return format == TRANSCODE_FORMAT_UNIVERSAL_UNORM
+    || format == TRANSCODE_FORMAT_UNIVERSAL_SRGB;
+}
+/* Get the bytes a level takes in universal blocks */
+size_t transcode_universal_size(uint32_t width, uint32_t height) {
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4)
+    * TRANSCODE_BLOCK_BYTES;
+}
+/* Get the bytes a level takes in a target format */
+size_t transcode_target_size(
+    transcode_target_t target,
+    uint32_t width,
+    uint32_t height
+) {
+  if (target == TRANSCODE_TARGET_RGBA8) return (size_t)width * height * 4;
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+}
+/* Get the Vulkan format of a target */
+VkFormat transcode_target_format(transcode_target_t target, bool srgb) {
+  switch (target) {
+    case TRANSCODE_TARGET_BC7:
+      return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    case TRANSCODE_TARGET_ASTC_4x4:
+      return srgb
+        ? VK_FORMAT_ASTC_4x4_SRGB_BLOCK
+        : VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+    default:
+      return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  }
+}
+/* Get a target's name */
+const char *transcode_target_name(transcode_target_t target) {
+  static const char *names[TRANSCODE_TARGET_COUNT] = {
+    "RGBA8",
+    "BC7",
+    "ASTC 4x4"
+  };
+  return target < TRANSCODE_TARGET_COUNT ? names[target] : "unknown";
+}
+/* Choose the smallest target the device can sample (BC7, ASTC, RGBA8) */
+transcode_target_t transcode_choose_target(
+    VkPhysicalDevice phys_dev,
+    bool srgb
+) {
+  const VkFormatFeatureFlags required =
+    VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+    | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+  const transcode_target_t order[] = {
+    TRANSCODE_TARGET_BC7,
+    TRANSCODE_TARGET_ASTC_4x4
+  };
+  for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(
+        phys_dev,
+        transcode_target_format(order[i], srgb),
+        &properties
+    );
+    if ((properties.optimalTilingFeatures & required) == required)
+      return order[i];
+  }
+  return TRANSCODE_TARGET_RGBA8;
+}
+/* Get the kernel in use (the best the CPU supports unless overridden) */
+transcode_kernel_t transcode_get_kernel(void) {
+  pthread_once(&init_once, transcode_init);
+  return current_kernel;
+}
+/* Use a kernel (false if the CPU doesn't support it) */
+bool transcode_set_kernel(transcode_kernel_t kernel) {
+  pthread_once(&init_once, transcode_init);
+  if (!kernel_supported(kernel)) return false;
+  current_kernel = kernel;
+  return true;
+}
+/* Get a kernel's name */
+const char *transcode_kernel_name(transcode_kernel_t kernel) {
+  static const char *names[TRANSCODE_KERNEL_COUNT] = {
+    "scalar",
+    "SSE4.1",
+    "AVX2",
+    "NEON"
+  };
+  return kernel < TRANSCODE_KERNEL_COUNT ? names[kernel] : "unknown";
+}
+/* Transcode block rows [first_row, first_row + row_count) of a level */
+void transcode_rows(
+    transcode_target_t target,
+    const uint8_t *src,
+    uint32_t width,
+    uint32_t height,
+    uint32_t first_row,
+    uint32_t row_count,
+    uint8_t *dst
+) {
+  uint32_t blocks_x = (width + 3) / 4;
+  pthread_once(&init_once, transcode_init);
+
+  for (uint32_t row = first_row; row < first_row + row_count; row++) {
+    const uint8_t *src_row =
+      src + (size_t)row * blocks_x * TRANSCODE_BLOCK_BYTES;
+    if (target == TRANSCODE_TARGET_RGBA8) {
+      size_t pitch = (size_t)width * 4;
+      uint8_t *dst_row = dst + (size_t)row * 4 * pitch;
+      uint32_t whole = height - row * 4 >= 4 ? width / 4 : 0;
+      rgba8_row_kernel()(src_row, whole, dst_row, pitch);
+
+      /* Clip blocks overhanging the right or bottom edge */
+      for (uint32_t x = whole; x < blocks_x; x++) {
+        uint8_t texels[4 * 16];
+        rgba8_row_scalar(
+            src_row + (size_t)x * TRANSCODE_BLOCK_BYTES,
+            1,
+            texels,
+            16
+        );
+        for (uint32_t y = 0; y < 4 && row * 4 + y < height; y++) {
+          uint32_t columns = width - x * 4 < 4 ? width - x * 4 : 4;
+          memcpy(
+              dst_row + y * pitch + (size_t)x * 16,
+              texels + y * 16,
+              (size_t)columns * 4
+          );
+        }
+      }
+    } else {
+      uint8_t *dst_row = dst + (size_t)row * blocks_x * 16;
+      for (uint32_t x = 0; x < blocks_x; x++) {
+        const uint8_t *block = src_row + (size_t)x * TRANSCODE_BLOCK_BYTES;
+        if (target == TRANSCODE_TARGET_BC7)
+          block_bc7(block, dst_row + (size_t)x * 16);
+        else
+          block_astc(block, dst_row + (size_t)x * 16);
+      }
+    }
+  }
+}
+/* Transcode a level, split across a job system if given */
+void transcode_level(
+    transcode_target_t target,
+    const uint8_t *src,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst,
+    jobs_t *job_system
+) {
+  uint32_t block_rows = (height + 3) / 4;
+  uint32_t rows_per_job, job_count;
+  job_counter_t counter;
+  rows_job_t *jobs;
+
+  if (!job_system || block_rows < 2) {
+    transcode_rows(target, src, width, height, 0, block_rows, dst);
+    return;
+  }
+
+  /* A few jobs per worker to even out the load */
+  rows_per_job = block_rows / (job_system->worker_count * 4);
+  if (rows_per_job == 0) rows_per_job = 1;
+  job_count = (block_rows + rows_per_job - 1) / rows_per_job;
+  jobs = (rows_job_t *)malloc(sizeof(rows_job_t) * job_count);
+  ASSERT(jobs);
+  atomic_init(&counter.value, 0);
+  for (uint32_t i = 0; i < job_count; i++) {
+    jobs[i].job.fn = rows_job;
+    jobs[i].job.arg = &jobs[i];
+    jobs[i].job.counter = &counter;
+    jobs[i].target = target;
+    jobs[i].src = src;
+    jobs[i].width = width;
+    jobs[i].height = height;
+    jobs[i].first_row = i * rows_per_job;
+    jobs[i].row_count = block_rows - jobs[i].first_row < rows_per_job
+      ? block_rows - jobs[i].first_row
+      : rows_per_job;
+    jobs[i].dst = dst;
+    jobs_submit(job_system, &jobs[i].job);
+  }
+  jobs_wait(job_system, &counter);
+  free(jobs);
+}
+/* Encode an RGBA8 level into universal blocks (offline, slow) */
+void transcode_encode(
+    const uint8_t *rgba,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst
+) {
+  uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  for (uint32_t by = 0; by < blocks_y; by++) {
+    for (uint32_t bx = 0; bx < blocks_x; bx++) {
+      uint8_t pixels[16][4];
+      uint8_t *block =
+        dst + ((size_t)by * blocks_x + bx) * TRANSCODE_BLOCK_BYTES;
+
+      /* Gather, repeating edge texels into overhanging blocks */
+      for (uint32_t y = 0; y < 4; y++) {
+        uint32_t py = by * 4 + y < height ? by * 4 + y : height - 1;
+        for (uint32_t x = 0; x < 4; x++) {
+          uint32_t px = bx * 4 + x < width ? bx * 4 + x : width - 1;
+          memcpy(pixels[y * 4 + x], rgba + ((size_t)py * width + px) * 4, 4);
+        }
+      }
+      encode_block((const uint8_t (*)[4])pixels, block);
+    }
+  }
+}
@@ -0,0 +1,163 @@
+/* Implements vk_asset.h */
+#include <vk_asset.h>
+
+/* Import an asset pack as host memory (false if unsupported) */
+bool vk_asset_import(
+    vk_asset_import_t *import,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const asset_pack_t *pack
+) {
+  PFN_vkGetMemoryHostPointerPropertiesEXT get_host_pointer_properties;
+  VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties;
+  VkPhysicalDeviceProperties2 properties;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  VkMemoryHostPointerPropertiesEXT pointer_properties;
+  VkExternalMemoryBufferCreateInfo external_info;
+  VkBufferCreateInfo buffer_info;
+  VkImportMemoryHostPointerInfoEXT import_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryRequirements requirements;
+  uint32_t type_bits;
+  uint32_t memory_type = UINT32_MAX;
+
+  import->buffer = VK_NULL_HANDLE;
+  import->memory = VK_NULL_HANDLE;
+  if (!vk_dev_has_ext(dev, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+    return false;
+  get_host_pointer_properties = (PFN_vkGetMemoryHostPointerPropertiesEXT)
+    vkGetDeviceProcAddr(dev->device, "vkGetMemoryHostPointerPropertiesEXT");
+  if (!get_host_pointer_properties) return false;
+
+  /* Check the mapping's alignment */
+  host_properties.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+  host_properties.pNext = NULL;
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &host_properties;
+  vkGetPhysicalDeviceProperties2(phys_dev, &properties);
+  if (
+      (uintptr_t)pack->data % host_properties.minImportedHostPointerAlignment
+      || pack->size % host_properties.minImportedHostPointerAlignment
+  ) {
+    log_msg(LOG_LEVEL_WARN, "Asset pack is not aligned for import");
+    return false;
+  }
+
+  /* Get memory types the mapping can be imported as */
+  pointer_properties.sType =
+    VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  pointer_properties.pNext = NULL;
+  if (get_host_pointer_properties(
+        dev->device,
+        VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        pack->data,
+        &pointer_properties
+  ) != VK_SUCCESS) return false;
+
+  /* Create buffer */
+  external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+  external_info.pNext = NULL;
+  external_info.handleTypes =
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.pNext = &external_info;
+  buffer_info.flags = 0;
+  buffer_info.size = pack->size;
+  buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  buffer_info.queueFamilyIndexCount = 0;
+  buffer_info.pQueueFamilyIndices = NULL;
+  VK_CHECK(vkCreateBuffer(dev->device, &buffer_info, NULL, &import->buffer));
+  vkGetBufferMemoryRequirements(dev->device, import->buffer, &requirements);
+
+  /* Pick a memory type, host cached if possible */
+  type_bits = requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+  vkGetPhysicalDeviceMemoryProperties(phys_dev, &memory_properties);
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if (!(type_bits & (1u << i))) continue;
+    if (memory_type == UINT32_MAX) memory_type = i;
+    if (
+        memory_properties.memoryTypes[i].propertyFlags
+        & VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+    ) {
+      memory_type = i;
+      break;
+    }
+  }
+  if (memory_type == UINT32_MAX || requirements.size > pack->size) {
+    vkDestroyBuffer(dev->device, import->buffer, NULL);
+    import->buffer = VK_NULL_HANDLE;
+    return false;
+  }
+
+  /* Import and bind memory */
+  import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+  import_info.pNext = NULL;
+  import_info.handleType =
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  import_info.pHostPointer = pack->data;
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = &import_info;
+  alloc_info.allocationSize = pack->size;
+  alloc_info.memoryTypeIndex = memory_type;
+  if (vkAllocateMemory(
+        dev->device,
+        &alloc_info,
+        NULL,
+        &import->memory
+  ) != VK_SUCCESS) {
+    log_msg(LOG_LEVEL_WARN, "Failed to import asset pack as host memory");
+    vkDestroyBuffer(dev->device, import->buffer, NULL);
+    import->buffer = VK_NULL_HANDLE;
+    return false;
+  }
+  VK_CHECK(vkBindBufferMemory(
+        dev->device,
+        import->buffer,
+        import->memory,
+        0
+  ));
+
+  return true;
+}
+/* Release an imported asset pack (before closing the pack) */
+void vk_asset_import_destroy(vk_asset_import_t *import, vk_dev_t *dev) {
+  if (import->buffer) vkDestroyBuffer(dev->device, import->buffer, NULL);
+  if (import->memory) vkFreeMemory(dev->device, import->memory, NULL);
+  memset(import, 0, sizeof(vk_asset_import_t));
+}
+/* Record a copy of a chunk from chunk_offset onwards into a buffer */
+VkDeviceSize vk_asset_cmd_upload(
+    const vk_asset_import_t *import,
+    vk_staging_t *ring,
+    VkCommandBuffer cmd,
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk,
+    VkDeviceSize chunk_offset,
+    VkBuffer dst,
+    VkDeviceSize dst_offset
+) {
+  VkDeviceSize size = chunk->size - chunk_offset;
+  if (chunk_offset >= chunk->size) return 0;
+
+  /* Copy straight from the imported mapping */
+  if (import && import->buffer) {
+    VkBufferCopy region;
+    region.srcOffset = chunk->offset + chunk_offset;
+    region.dstOffset = dst_offset;
+    region.size = size;
+    vkCmdCopyBuffer(cmd, import->buffer, dst, 1, &region);
+    return size;
+  }
+
+  /* Copy from the mapping into the staging ring */
+  return vk_staging_cmd_upload(
+      ring,
+      cmd,
+      (const uint8_t *)asset_pack_chunk_data(pack, chunk) + chunk_offset,
+      size,
+      dst,
+      dst_offset
+  );
+}
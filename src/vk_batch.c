@@ -0,0 +1,500 @@
+/* Implements vk_batch.h */
+#include <vk_batch.h>
+#include <image_write.h>
+#include <telemetry.h>
+#include <stdio.h>
+
+/* Get an output format's file extension */
+static const char *extension(vk_batch_format_t output) {
+  switch (output) {
+    case VK_BATCH_PNG: return "png";
+    case VK_BATCH_EXR: return "exr";
+    default: return "raw";
+  }
+}
+/* Create a slot's offscreen target */
+static void create_target(
+    vk_batch_t *batch,
+    vk_batch_slot_t *slot,
+    const vk_phys_dev_info_t *phys_dev_info,
+    const uint32_t *families,
+    uint32_t family_count
+) {
+  VkImageCreateInfo image_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryRequirements requirements;
+
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.pNext = NULL;
+  image_info.flags = 0;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = batch->format;
+  image_info.extent.width = batch->width;
+  image_info.extent.height = batch->height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+    | VK_IMAGE_USAGE_STORAGE_BIT
+    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+    | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image_info.sharingMode = family_count > 1
+    ? VK_SHARING_MODE_CONCURRENT
+    : VK_SHARING_MODE_EXCLUSIVE;
+  image_info.queueFamilyIndexCount = family_count > 1 ? family_count : 0;
+  image_info.pQueueFamilyIndices = family_count > 1 ? families : NULL;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK(vkCreateImage(
+        batch->dev->device,
+        &image_info,
+        NULL,
+        &slot->target
+  ));
+  vkGetImageMemoryRequirements(
+      batch->dev->device,
+      slot->target,
+      &requirements
+  );
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = vk_phys_dev_find_memory_type(
+      phys_dev_info,
+      requirements.memoryTypeBits,
+      0,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+  ASSERT(alloc_info.memoryTypeIndex != UINT32_MAX);
+  VK_CHECK(vkAllocateMemory(
+        batch->dev->device,
+        &alloc_info,
+        NULL,
+        &slot->target_memory
+  ));
+  VK_CHECK(vkBindImageMemory(
+        batch->dev->device,
+        slot->target,
+        slot->target_memory,
+        0
+  ));
+}
+/* Create a command pool */
+static VkCommandPool create_pool(vk_dev_t *dev, uint32_t family) {
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandPool pool;
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = family;
+  VK_CHECK(vkCreateCommandPool(dev->device, &pool_info, NULL, &pool));
+  return pool;
+}
+/* Allocate a primary command buffer */
+static VkCommandBuffer allocate_cmd(vk_dev_t *dev, VkCommandPool pool) {
+  VkCommandBufferAllocateInfo alloc_info;
+  VkCommandBuffer cmd;
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.commandPool = pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(dev->device, &alloc_info, &cmd));
+  return cmd;
+}
+/* Fill an image barrier over the whole target */
+static void target_barrier(
+    VkImageMemoryBarrier *barrier,
+    VkImage target,
+    VkAccessFlags src_access,
+    VkAccessFlags dst_access,
+    VkImageLayout old_layout,
+    VkImageLayout new_layout
+) {
+  barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier->pNext = NULL;
+  barrier->srcAccessMask = src_access;
+  barrier->dstAccessMask = dst_access;
+  barrier->oldLayout = old_layout;
+  barrier->newLayout = new_layout;
+  barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier->image = target;
+  barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier->subresourceRange.baseMipLevel = 0;
+  barrier->subresourceRange.levelCount = 1;
+  barrier->subresourceRange.baseArrayLayer = 0;
+  barrier->subresourceRange.layerCount = 1;
+}
+/* Encode job: write a slot's readback buffer to its frame's file */
+static void encode_job(void *arg) {
+  vk_batch_slot_t *slot = (vk_batch_slot_t *)arg;
+  vk_batch_t *batch = slot->batch;
+  char path[VK_BATCH_MAX_PATH + 32];      /* Prefix, frame and extension */
+  size_t row_size = (size_t)batch->width * batch->pixel_size;
+  double start = time_now();
+  bool written;
+
+  snprintf(
+      path,
+      sizeof(path),
+      "%s%06llu.%s",
+      batch->prefix,
+      (unsigned long long)slot->frame,
+      extension(batch->output)
+  );
+  switch (batch->output) {
+    case VK_BATCH_PNG:
+      written = image_write_png(
+          path,
+          batch->width,
+          batch->height,
+          (const uint8_t *)slot->readback.mapped,
+          row_size
+      );
+      break;
+    case VK_BATCH_EXR:
+      written = image_write_exr(
+          path,
+          batch->width,
+          batch->height,
+          (const uint16_t *)slot->readback.mapped,
+          row_size
+      );
+      break;
+    default:
+      written = image_write_raw(
+          path,
+          batch->height,
+          slot->readback.mapped,
+          row_size,
+          row_size
+      );
+      break;
+  }
+  if (!written) log_msg(LOG_LEVEL_ERROR, "Failed to write %s", path);
+  slot->failed = !written;
+  telemetry_report(
+      "batch.encode",
+      TELEMETRY_TIMING,
+      (time_now() - start) * 1e3
+  );
+}
+/* Hand a slot whose copy is done to an encode job */
+static void start_encode(vk_batch_t *batch, vk_batch_slot_t *slot) {
+  telemetry_report(
+      "batch.gpu",
+      TELEMETRY_TIMING,
+      (time_now() - slot->submitted) * 1e3
+  );
+  if (!(slot->readback.memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    VkMappedMemoryRange memory_range;
+    memory_range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    memory_range.pNext = NULL;
+    memory_range.memory = slot->readback.memory;
+    memory_range.offset = 0;
+    memory_range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkInvalidateMappedMemoryRanges(
+          batch->dev->device,
+          1,
+          &memory_range
+    ));
+  }
+  slot->pending = false;
+  slot->job.fn = encode_job;
+  slot->job.arg = slot;
+  slot->job.counter = &slot->counter;
+  jobs_submit(batch->jobs, &slot->job);
+}
+/* Start encoding every frame whose copy is done, in order */
+static void poll_copies(vk_batch_t *batch, uint32_t next) {
+  for (uint32_t i = 0; i < batch->slot_count; i++) {
+    vk_batch_slot_t *slot = &batch->slots[(next + i) % batch->slot_count];
+    if (!slot->pending) continue;
+    if (!vk_sync_reached(slot->copied, batch->dev)) break;
+    start_encode(batch, slot);
+  }
+}
+/* Wait for a slot's frame to be copied and encoded (false if it failed) */
+static bool retire(vk_batch_t *batch, vk_batch_slot_t *slot) {
+  double start = time_now();
+  if (slot->pending) {
+    vk_sync_wait(slot->copied, batch->dev, UINT64_MAX);
+    start_encode(batch, slot);
+  }
+  jobs_wait(batch->jobs, &slot->counter);
+  telemetry_report(
+      "batch.stall",
+      TELEMETRY_TIMING,
+      (time_now() - start) * 1e3
+  );
+  return !slot->failed;
+}
+/* Record and submit a frame's render and copy */
+static void submit_frame(
+    vk_batch_t *batch,
+    vk_batch_slot_t *slot,
+    uint64_t frame,
+    vk_batch_record_fn_t record,
+    void *user
+) {
+  VkCommandBufferBeginInfo begin_info;
+  VkImageMemoryBarrier barrier;
+  VkBufferMemoryBarrier readback_barrier;
+  VkBufferImageCopy region;
+  vk_submission_t submission;
+  vk_submit_semaphore_t rendered;
+  vk_sync_point_t point;
+
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+
+  /* Render, leaving the target ready to copy from */
+  VK_CHECK(vkBeginCommandBuffer(slot->render_cmd, &begin_info));
+  target_barrier(
+      &barrier,
+      slot->target,
+      0,
+      VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_GENERAL
+  );
+  vkCmdPipelineBarrier(
+      slot->render_cmd,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      0,
+      0, NULL,
+      0, NULL,
+      1, &barrier
+  );
+  record(user, slot->render_cmd, slot->target, frame);
+  target_barrier(
+      &barrier,
+      slot->target,
+      VK_ACCESS_MEMORY_WRITE_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT,
+      VK_IMAGE_LAYOUT_GENERAL,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+  );
+  vkCmdPipelineBarrier(
+      slot->render_cmd,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0, NULL,
+      0, NULL,
+      1, &barrier
+  );
+  VK_CHECK(vkEndCommandBuffer(slot->render_cmd));
+
+  /* Copy into the readback buffer, visible to the host once done */
+  VK_CHECK(vkBeginCommandBuffer(slot->copy_cmd, &begin_info));
+  region.bufferOffset = 0;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset.x = 0;
+  region.imageOffset.y = 0;
+  region.imageOffset.z = 0;
+  region.imageExtent.width = batch->width;
+  region.imageExtent.height = batch->height;
+  region.imageExtent.depth = 1;
+  vkCmdCopyImageToBuffer(
+      slot->copy_cmd,
+      slot->target,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      slot->readback.buffer,
+      1,
+      &region
+  );
+  readback_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  readback_barrier.pNext = NULL;
+  readback_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  readback_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  readback_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  readback_barrier.buffer = slot->readback.buffer;
+  readback_barrier.offset = 0;
+  readback_barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(
+      slot->copy_cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      0,
+      0, NULL,
+      1, &readback_barrier,
+      0, NULL
+  );
+  VK_CHECK(vkEndCommandBuffer(slot->copy_cmd));
+
+  /* The copy waits on the render's timeline value, on the device */
+  submission.command_buffers = &slot->render_cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = NULL;
+  submission.wait_count = 0;
+  submission.signals = NULL;
+  submission.signal_count = 0;
+  submission.fence = VK_NULL_HANDLE;
+  point = vk_submit_enqueue(batch->submit, VK_SUBMIT_GRAPHICS, &submission);
+  rendered.semaphore = point.timeline->semaphore;
+  rendered.value = point.value;
+  rendered.stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+  submission.command_buffers = &slot->copy_cmd;
+  submission.waits = &rendered;
+  submission.wait_count = 1;
+  slot->copied = vk_submit_enqueue(
+      batch->submit,
+      VK_SUBMIT_TRANSFER,
+      &submission
+  );
+  vk_submit_flush(batch->submit);
+  slot->frame = frame;
+  slot->submitted = time_now();
+  slot->pending = true;
+  slot->failed = false;
+}
+
+/* Create a batch renderer writing <prefix><frame>.<extension> files */
+void vk_batch_create(
+    vk_batch_t *batch,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_submit_t *submit,
+    jobs_t *jobs,
+    uint32_t width,
+    uint32_t height,
+    vk_batch_format_t output,
+    uint32_t slot_count,
+    const char *prefix
+) {
+  uint32_t families[2], family_count = 1;
+  uint32_t copy_family;
+
+  ASSERT(slot_count > 0 && slot_count <= VK_BATCH_MAX_SLOTS);
+  ASSERT(strlen(prefix) < VK_BATCH_MAX_PATH);
+  memset(batch, 0, sizeof(vk_batch_t));
+  batch->dev = dev;
+  batch->submit = submit;
+  batch->jobs = jobs;
+  batch->width = width;
+  batch->height = height;
+  batch->output = output;
+  batch->slot_count = slot_count;
+  strcpy(batch->prefix, prefix);
+  if (output == VK_BATCH_EXR) {
+    batch->format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    batch->pixel_size = 8;
+  } else {
+    batch->format = VK_FORMAT_R8G8B8A8_UNORM;
+    batch->pixel_size = 4;
+  }
+
+  /* Copies run on whichever queue vk_submit gives transfer work to */
+  families[0] = phys_dev_info->queue_families.graphics_index;
+  if (dev->transfer_queue_count > 0)
+    copy_family = phys_dev_info->queue_families.transfer_index;
+  else if (dev->compute_queue_count > 0)
+    copy_family = phys_dev_info->queue_families.compute_index;
+  else
+    copy_family = families[0];
+  if (copy_family != families[0]) families[family_count++] = copy_family;
+  batch->render_pool = create_pool(dev, families[0]);
+  batch->copy_pool = create_pool(dev, copy_family);
+
+  for (uint32_t i = 0; i < slot_count; i++) {
+    vk_batch_slot_t *slot = &batch->slots[i];
+    slot->batch = batch;
+    create_target(batch, slot, phys_dev_info, families, family_count);
+    slot->readback = vk_buf_create(
+        dev,
+        phys_dev_info,
+        (VkDeviceSize)width * height * batch->pixel_size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+    );
+    slot->render_cmd = allocate_cmd(dev, batch->render_pool);
+    slot->copy_cmd = allocate_cmd(dev, batch->copy_pool);
+    atomic_init(&slot->counter.value, 0);
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Batch renderer: %ux%u %s, %u slots, copies on family %u",
+      width,
+      height,
+      extension(output),
+      slot_count,
+      copy_family
+  );
+}
+/* Render and write frames first to last (false if any failed to write) */
+bool vk_batch_render(
+    vk_batch_t *batch,
+    uint64_t first,
+    uint64_t last,
+    vk_batch_record_fn_t record,
+    void *user
+) {
+  double start = time_now(), elapsed;
+  uint64_t count = last >= first ? last - first + 1 : 0;
+  uint32_t next = 0, in_flight;
+  bool written = true;
+
+  for (uint64_t frame = first; frame < first + count; frame++) {
+    vk_batch_slot_t *slot = &batch->slots[next];
+    double record_start;
+    /* The slot's last frame must be written before it can be reused */
+    if (frame - first >= batch->slot_count)
+      written &= retire(batch, slot);
+    record_start = time_now();
+    submit_frame(batch, slot, frame, record, user);
+    telemetry_report(
+        "batch.record",
+        TELEMETRY_TIMING,
+        (time_now() - record_start) * 1e3
+    );
+    next = (next + 1) % batch->slot_count;
+    poll_copies(batch, next);
+  }
+  /* Drain the ring, oldest first */
+  in_flight = count < batch->slot_count ? (uint32_t)count : batch->slot_count;
+  for (uint32_t i = 0; i < in_flight; i++) {
+    uint32_t index = (next + batch->slot_count - in_flight + i)
+      % batch->slot_count;
+    written &= retire(batch, &batch->slots[index]);
+  }
+
+  elapsed = time_now() - start;
+  telemetry_report(
+      "batch.fps",
+      TELEMETRY_GAUGE,
+      elapsed > 0.0 ? (double)count / elapsed : 0.0
+  );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Rendered %llu frames in %.3f s (%.2f frames/s)",
+      (unsigned long long)count,
+      elapsed,
+      elapsed > 0.0 ? (double)count / elapsed : 0.0
+  );
+  return written;
+}
+/* Destroy a batch renderer */
+void vk_batch_destroy(vk_batch_t *batch) {
+  for (uint32_t i = 0; i < batch->slot_count; i++) {
+    vk_batch_slot_t *slot = &batch->slots[i];
+    vkDestroyImage(batch->dev->device, slot->target, NULL);
+    vkFreeMemory(batch->dev->device, slot->target_memory, NULL);
+    vk_buf_destroy(&slot->readback, batch->dev);
+  }
+  vkDestroyCommandPool(batch->dev->device, batch->render_pool, NULL);
+  vkDestroyCommandPool(batch->dev->device, batch->copy_pool, NULL);
+  memset(batch, 0, sizeof(vk_batch_t));
+}
@@ -0,0 +1,80 @@
+/* Implements vk_buf.h */
+#include <vk_buf.h>
+#include <vk_capture.h>
+
+/* Create a Vulkan buffer (persistently mapped if host visible) */
+vk_buf_t vk_buf_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+) {
+  VkBufferCreateInfo buffer_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryRequirements requirements;
+  uint32_t memory_type;
+  vk_buf_t buf;
+
+  /* Populate buffer */
+  buf.buffer = VK_NULL_HANDLE;
+  buf.memory = VK_NULL_HANDLE;
+  buf.size = size;
+  buf.memory_flags = 0;
+  buf.mapped = NULL;
+
+  /* Create buffer */
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.pNext = NULL;
+  buffer_info.flags = 0;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  buffer_info.queueFamilyIndexCount = 0;
+  buffer_info.pQueueFamilyIndices = NULL;
+  VK_CHECK(vkCreateBuffer(dev->device, &buffer_info, NULL, &buf.buffer));
+
+  /* Allocate and bind memory */
+  vkGetBufferMemoryRequirements(dev->device, buf.buffer, &requirements);
+  memory_type = vk_phys_dev_find_memory_type(
+      phys_dev_info,
+      requirements.memoryTypeBits,
+      required,
+      preferred
+  );
+  if (memory_type == UINT32_MAX) {
+    log_msg(LOG_LEVEL_ERROR, "No suitable memory type for buffer");
+    abort();
+  }
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = memory_type;
+  VK_CHECK(vkAllocateMemory(dev->device, &alloc_info, NULL, &buf.memory));
+  VK_CHECK(vkBindBufferMemory(dev->device, buf.buffer, buf.memory, 0));
+  buf.memory_flags =
+    phys_dev_info->memory_properties.memoryTypes[memory_type].propertyFlags;
+
+  /* Map host visible memory for the lifetime of the buffer */
+  if (buf.memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    VK_CHECK(vkMapMemory(
+          dev->device,
+          buf.memory,
+          0,
+          VK_WHOLE_SIZE,
+          0,
+          &buf.mapped
+    ));
+  }
+  vk_capture_buffer(buf.buffer, size, usage);
+
+  return buf;
+}
+/* Destroy a Vulkan buffer */
+void vk_buf_destroy(vk_buf_t *buf, vk_dev_t *dev) {
+  if (buf->mapped) vkUnmapMemory(dev->device, buf->memory);
+  vkDestroyBuffer(dev->device, buf->buffer, NULL);
+  vkFreeMemory(dev->device, buf->memory, NULL);
+  memset(buf, 0, sizeof(vk_buf_t));
+}
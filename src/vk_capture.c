@@ -0,0 +1,407 @@
+/* Implements vk_capture.h */
+#include <vk_capture.h>
+#include <hash.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* Stream write buffer (bytes) */
+#define CAPTURE_BUFFER_SIZE (1u << 20)
+/* Initial handle map capacity (a power of two) */
+#define CAPTURE_HANDLE_CAPACITY 256u
+
+/* Types */
+/* Kinds of handle remapped */
+typedef enum {
+  CAPTURE_BUFFER,
+  CAPTURE_IMAGE,
+  CAPTURE_COMMAND_BUFFER,
+  CAPTURE_SEMAPHORE
+} capture_kind_t;
+/* Handle map slot (id 0 if empty) */
+typedef struct {
+  uint64_t handle;
+  uint32_t kind;
+  uint32_t id;
+} capture_handle_t;
+
+/* Capture state */
+static struct {
+  atomic_bool active;
+  FILE *file;
+  capture_handle_t *handles;
+  uint32_t handle_count, handle_capacity;
+  uint32_t next_id;
+  uint64_t frames, bytes;
+} capture;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get the bits of a handle (dispatchable or not) */
+static uint64_t handle_bits(const void *handle, size_t size) {
+  uint64_t bits = 0;
+  memcpy(&bits, handle, size);
+  return bits;
+}
+#define HANDLE(handle) handle_bits(&(handle), sizeof(handle))
+/* Get a handle's map slot (mutex held) */
+static uint32_t handle_slot(
+    const capture_handle_t *handles,
+    uint32_t capacity,
+    capture_kind_t kind,
+    uint64_t handle
+) {
+  uint64_t key = hash64_combine(handle, kind);
+  uint32_t mask = capacity - 1;
+  uint32_t i = (uint32_t)hash64(&key, sizeof(key), 0) & mask;
+  while (
+      handles[i].id != 0
+      && (handles[i].handle != handle || handles[i].kind != kind)
+  ) i = (i + 1) & mask;
+  return i;
+}
+/* Get a handle's id, giving it a new one if unseen or fresh (mutex held) */
+static uint32_t handle_id(capture_kind_t kind, uint64_t handle, bool fresh) {
+  uint32_t i;
+  if (handle == 0) return 0;
+  if ((capture.handle_count + 1) * 2 > capture.handle_capacity) {
+    uint32_t capacity = capture.handle_capacity * 2;
+    capture_handle_t *handles = (capture_handle_t *)calloc(
+        capacity,
+        sizeof(capture_handle_t)
+    );
+    ASSERT(handles);
+    for (uint32_t j = 0; j < capture.handle_capacity; j++) {
+      const capture_handle_t *old = &capture.handles[j];
+      if (old->id == 0) continue;
+      handles[handle_slot(handles, capacity, old->kind, old->handle)] = *old;
+    }
+    free(capture.handles);
+    capture.handles = handles;
+    capture.handle_capacity = capacity;
+  }
+  i = handle_slot(capture.handles, capture.handle_capacity, kind, handle);
+  if (capture.handles[i].id == 0) capture.handle_count++;
+  else if (!fresh) return capture.handles[i].id;
+  /* A driver may hand a destroyed object's handle out again */
+  capture.handles[i].handle = handle;
+  capture.handles[i].kind = kind;
+  capture.handles[i].id = capture.next_id++;
+  return capture.handles[i].id;
+}
+/* Write bytes to the stream (mutex held) */
+static void emit(const void *data, size_t size) {
+  if (size == 0) return;
+  fwrite(data, 1, size, capture.file);
+  capture.bytes += size;
+}
+/* Start a record of size payload bytes (mutex held) */
+static void record(vk_capture_op_t op, size_t size) {
+  vk_capture_record_t header;
+  ASSERT(size <= UINT32_MAX);
+  header.op = op;
+  header.size = (uint32_t)size;
+  emit(&header, sizeof(header));
+}
+/* Lock the capture, if running (false, unlocked, if not) */
+static bool capture_lock(void) {
+  if (!atomic_load_explicit(&capture.active, memory_order_relaxed))
+    return false;
+  pthread_mutex_lock(&capture_mutex);
+  if (atomic_load_explicit(&capture.active, memory_order_relaxed))
+    return true;
+  pthread_mutex_unlock(&capture_mutex);
+  return false;
+}
+/* Write a submission's semaphores (mutex held) */
+static void emit_semaphores(
+    const vk_submit_semaphore_t *semaphores,
+    uint32_t count
+) {
+  for (uint32_t i = 0; i < count; i++) {
+    vk_capture_semaphore_t semaphore;
+    semaphore.semaphore = handle_id(
+        CAPTURE_SEMAPHORE,
+        HANDLE(semaphores[i].semaphore),
+        false
+    );
+    semaphore.pad = 0;
+    semaphore.value = semaphores[i].value;
+    semaphore.stages = semaphores[i].stages;
+    emit(&semaphore, sizeof(semaphore));
+  }
+}
+
+/* Start capturing to a file (false if it can't be created) */
+bool vk_capture_begin(const char *path) {
+  vk_capture_header_t header;
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+  setvbuf(file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+  pthread_mutex_lock(&capture_mutex);
+  ASSERT(!atomic_load(&capture.active));
+  capture.file = file;
+  capture.handles = (capture_handle_t *)calloc(
+      CAPTURE_HANDLE_CAPACITY,
+      sizeof(capture_handle_t)
+  );
+  ASSERT(capture.handles);
+  capture.handle_count = 0;
+  capture.handle_capacity = CAPTURE_HANDLE_CAPACITY;
+  capture.next_id = 1;
+  capture.frames = 0;
+  capture.bytes = 0;
+  header.magic = VK_CAPTURE_MAGIC;
+  header.version = VK_CAPTURE_VERSION;
+  emit(&header, sizeof(header));
+  atomic_store(&capture.active, true);
+  pthread_mutex_unlock(&capture_mutex);
+  log_msg(LOG_LEVEL_INFO, "Capturing Vulkan calls to %s", path);
+  return true;
+}
+/* Stop capturing, closing the file */
+void vk_capture_end(void) {
+  bool failed;
+  if (!capture_lock()) return;
+  atomic_store(&capture.active, false);
+  failed = ferror(capture.file) != 0;
+  failed |= fclose(capture.file) != 0;
+  free(capture.handles);
+  if (failed) log_msg(LOG_LEVEL_ERROR, "Failed to write capture");
+  else log_msg(
+      LOG_LEVEL_SUCCESS,
+      "Captured %llu frames (%llu bytes)",
+      (unsigned long long)capture.frames,
+      (unsigned long long)capture.bytes
+  );
+  capture.file = NULL;
+  capture.handles = NULL;
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* Check if a capture is running */
+bool vk_capture_active(void) {
+  return atomic_load_explicit(&capture.active, memory_order_relaxed);
+}
+
+/* Register a buffer */
+void vk_capture_buffer(
+    VkBuffer buffer,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage
+) {
+  vk_capture_buffer_op_t op;
+  if (!capture_lock()) return;
+  op.id = handle_id(CAPTURE_BUFFER, HANDLE(buffer), true);
+  op.usage = usage;
+  op.size = size;
+  record(VK_CAPTURE_OP_BUFFER, sizeof(op));
+  emit(&op, sizeof(op));
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* Register an image (2D, single mip and layer) */
+void vk_capture_image(
+    VkImage image,
+    VkFormat format,
+    VkExtent2D extent,
+    VkImageUsageFlags usage
+) {
+  vk_capture_image_op_t op;
+  if (!capture_lock()) return;
+  op.id = handle_id(CAPTURE_IMAGE, HANDLE(image), true);
+  op.format = (uint32_t)format;
+  op.width = extent.width;
+  op.height = extent.height;
+  op.usage = usage;
+  record(VK_CAPTURE_OP_IMAGE, sizeof(op));
+  emit(&op, sizeof(op));
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* Snapshot a range of a buffer's mapped contents */
+void vk_capture_buffer_data(
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize size,
+    const void *data
+) {
+  vk_capture_data_op_t op;
+  if (!capture_lock()) return;
+  op.id = handle_id(CAPTURE_BUFFER, HANDLE(buffer), false);
+  op.pad = 0;
+  op.offset = offset;
+  op.size = size;
+  record(VK_CAPTURE_OP_BUFFER_DATA, sizeof(op) + (size_t)size);
+  emit(&op, sizeof(op));
+  emit(data, (size_t)size);
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* Record a submission */
+void vk_capture_submit(
+    vk_submit_kind_t kind,
+    const vk_submission_t *submission
+) {
+  vk_capture_submit_op_t op;
+  if (!capture_lock()) return;
+  op.kind = (uint32_t)kind;
+  op.command_buffer_count = submission->command_buffer_count;
+  op.wait_count = submission->wait_count;
+  op.signal_count = submission->signal_count;
+  record(
+      VK_CAPTURE_OP_SUBMIT,
+      sizeof(op)
+      + sizeof(uint32_t) * op.command_buffer_count
+      + sizeof(vk_capture_semaphore_t) * (op.wait_count + op.signal_count)
+  );
+  emit(&op, sizeof(op));
+  for (uint32_t i = 0; i < op.command_buffer_count; i++) {
+    uint32_t id = handle_id(
+        CAPTURE_COMMAND_BUFFER,
+        HANDLE(submission->command_buffers[i]),
+        false
+    );
+    emit(&id, sizeof(id));
+  }
+  emit_semaphores(submission->waits, op.wait_count);
+  emit_semaphores(submission->signals, op.signal_count);
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* Record the end of a frame */
+void vk_capture_frame(void) {
+  if (!capture_lock()) return;
+  record(VK_CAPTURE_OP_FRAME, 0);
+  capture.frames++;
+  pthread_mutex_unlock(&capture_mutex);
+}
+
+/* vkBeginCommandBuffer, captured */
+VkResult vk_capture_cmd_begin(
+    VkCommandBuffer cmd,
+    const VkCommandBufferBeginInfo *begin_info
+) {
+  VkResult result = vkBeginCommandBuffer(cmd, begin_info);
+  vk_capture_cmd_op_t op;
+  if (result != VK_SUCCESS || !capture_lock()) return result;
+  op.cmd = handle_id(CAPTURE_COMMAND_BUFFER, HANDLE(cmd), false);
+  op.flags = begin_info->flags;
+  record(VK_CAPTURE_OP_CMD_BEGIN, sizeof(op));
+  emit(&op, sizeof(op));
+  pthread_mutex_unlock(&capture_mutex);
+  return result;
+}
+/* vkEndCommandBuffer, captured */
+VkResult vk_capture_cmd_end(VkCommandBuffer cmd) {
+  VkResult result = vkEndCommandBuffer(cmd);
+  vk_capture_cmd_op_t op;
+  if (result != VK_SUCCESS || !capture_lock()) return result;
+  op.cmd = handle_id(CAPTURE_COMMAND_BUFFER, HANDLE(cmd), false);
+  op.flags = 0;
+  record(VK_CAPTURE_OP_CMD_END, sizeof(op));
+  emit(&op, sizeof(op));
+  pthread_mutex_unlock(&capture_mutex);
+  return result;
+}
+/* vkCmdPipelineBarrier, captured */
+void vk_capture_cmd_pipeline_barrier(
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags src_stages,
+    VkPipelineStageFlags dst_stages,
+    VkDependencyFlags dependency_flags,
+    uint32_t memory_count,
+    const VkMemoryBarrier *memory_barriers,
+    uint32_t buffer_count,
+    const VkBufferMemoryBarrier *buffer_barriers,
+    uint32_t image_count,
+    const VkImageMemoryBarrier *image_barriers
+) {
+  vk_capture_barrier_op_t op;
+  vkCmdPipelineBarrier(
+      cmd,
+      src_stages,
+      dst_stages,
+      dependency_flags,
+      memory_count, memory_barriers,
+      buffer_count, buffer_barriers,
+      image_count, image_barriers
+  );
+  if (!capture_lock()) return;
+  op.cmd = handle_id(CAPTURE_COMMAND_BUFFER, HANDLE(cmd), false);
+  op.src_stages = src_stages;
+  op.dst_stages = dst_stages;
+  op.dependency_flags = dependency_flags;
+  op.memory_count = memory_count;
+  op.buffer_count = buffer_count;
+  op.image_count = image_count;
+  record(
+      VK_CAPTURE_OP_PIPELINE_BARRIER,
+      sizeof(op)
+      + sizeof(vk_capture_memory_barrier_t) * memory_count
+      + sizeof(vk_capture_buffer_barrier_t) * buffer_count
+      + sizeof(vk_capture_image_barrier_t) * image_count
+  );
+  emit(&op, sizeof(op));
+  for (uint32_t i = 0; i < memory_count; i++) {
+    vk_capture_memory_barrier_t barrier;
+    barrier.src_access = memory_barriers[i].srcAccessMask;
+    barrier.dst_access = memory_barriers[i].dstAccessMask;
+    emit(&barrier, sizeof(barrier));
+  }
+  for (uint32_t i = 0; i < buffer_count; i++) {
+    const VkBufferMemoryBarrier *from = &buffer_barriers[i];
+    vk_capture_buffer_barrier_t barrier;
+    barrier.src_access = from->srcAccessMask;
+    barrier.dst_access = from->dstAccessMask;
+    barrier.src_family = from->srcQueueFamilyIndex;
+    barrier.dst_family = from->dstQueueFamilyIndex;
+    barrier.buffer = handle_id(CAPTURE_BUFFER, HANDLE(from->buffer), false);
+    barrier.pad = 0;
+    barrier.offset = from->offset;
+    barrier.size = from->size;
+    emit(&barrier, sizeof(barrier));
+  }
+  for (uint32_t i = 0; i < image_count; i++) {
+    const VkImageMemoryBarrier *from = &image_barriers[i];
+    vk_capture_image_barrier_t barrier;
+    barrier.src_access = from->srcAccessMask;
+    barrier.dst_access = from->dstAccessMask;
+    barrier.old_layout = (uint32_t)from->oldLayout;
+    barrier.new_layout = (uint32_t)from->newLayout;
+    barrier.src_family = from->srcQueueFamilyIndex;
+    barrier.dst_family = from->dstQueueFamilyIndex;
+    barrier.image = handle_id(CAPTURE_IMAGE, HANDLE(from->image), false);
+    barrier.aspect = from->subresourceRange.aspectMask;
+    barrier.base_mip = from->subresourceRange.baseMipLevel;
+    barrier.mip_count = from->subresourceRange.levelCount;
+    barrier.base_layer = from->subresourceRange.baseArrayLayer;
+    barrier.layer_count = from->subresourceRange.layerCount;
+    emit(&barrier, sizeof(barrier));
+  }
+  pthread_mutex_unlock(&capture_mutex);
+}
+/* vkCmdCopyBuffer, captured */
+void vk_capture_cmd_copy_buffer(
+    VkCommandBuffer cmd,
+    VkBuffer src,
+    VkBuffer dst,
+    uint32_t region_count,
+    const VkBufferCopy *regions
+) {
+  vk_capture_copy_op_t op;
+  vkCmdCopyBuffer(cmd, src, dst, region_count, regions);
+  if (!capture_lock()) return;
+  op.cmd = handle_id(CAPTURE_COMMAND_BUFFER, HANDLE(cmd), false);
+  op.src = handle_id(CAPTURE_BUFFER, HANDLE(src), false);
+  op.dst = handle_id(CAPTURE_BUFFER, HANDLE(dst), false);
+  op.region_count = region_count;
+  record(
+      VK_CAPTURE_OP_COPY_BUFFER,
+      sizeof(op) + sizeof(vk_capture_region_t) * region_count
+  );
+  emit(&op, sizeof(op));
+  for (uint32_t i = 0; i < region_count; i++) {
+    vk_capture_region_t region;
+    region.src_offset = regions[i].srcOffset;
+    region.dst_offset = regions[i].dstOffset;
+    region.size = regions[i].size;
+    emit(&region, sizeof(region));
+  }
+  pthread_mutex_unlock(&capture_mutex);
+}
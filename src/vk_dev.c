@@ -1,5 +1,6 @@
 /* Implements vk_dev.h */
 #include <vk_dev.h>
+#include <vk_dev_cache.h>
 
 /* Create a Vulkan device builder */
 vk_dev_builder_t vk_dev_builder(void) {
@@ -17,6 +18,30 @@ vk_dev_builder_t vk_dev_builder(void) {
   builder.transfer_queues = 0;
   builder.transfer_queue_priorities = NULL;
   memset(&builder.features, 0, sizeof(VkPhysicalDeviceFeatures));
+  memset(&builder.features12, 0, sizeof(VkPhysicalDeviceVulkan12Features));
+  builder.features12.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  memset(
+      &builder.synchronization2,
+      0,
+      sizeof(VkPhysicalDeviceSynchronization2FeaturesKHR)
+  );
+  builder.synchronization2.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+  memset(
+      &builder.graphics_pipeline_library,
+      0,
+      sizeof(VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT)
+  );
+  builder.graphics_pipeline_library.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  memset(
+      &builder.maintenance5,
+      0,
+      sizeof(VkPhysicalDeviceMaintenance5FeaturesKHR)
+  );
+  builder.maintenance5.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
   return builder;
 }
 /* Add a Vulkan device extension */
@@ -144,6 +169,37 @@ void vk_dev_builder_add_features(
 ) {
   builder->features = features;
 }
+/* Add Vulkan 1.2 device features */
+void vk_dev_builder_add_features12(
+    vk_dev_builder_t *builder,
+    VkPhysicalDeviceVulkan12Features features
+) {
+  builder->features12 = features;
+  builder->features12.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  builder->features12.pNext = NULL;
+}
+/* Enable VK_KHR_synchronization2 (vkQueueSubmit2KHR and friends) */
+void vk_dev_builder_add_synchronization2(vk_dev_builder_t *builder) {
+  vk_dev_builder_add_ext(builder, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+  builder->synchronization2.synchronization2 = VK_TRUE;
+}
+/* Enable VK_EXT_graphics_pipeline_library (and VK_KHR_pipeline_library) */
+void vk_dev_builder_add_graphics_pipeline_library(
+    vk_dev_builder_t *builder
+) {
+  vk_dev_builder_add_ext(builder, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+  vk_dev_builder_add_ext(
+      builder,
+      VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+  );
+  builder->graphics_pipeline_library.graphicsPipelineLibrary = VK_TRUE;
+}
+/* Enable VK_KHR_maintenance5 (shader code inlined into pipeline stages) */
+void vk_dev_builder_add_maintenance5(vk_dev_builder_t *builder) {
+  vk_dev_builder_add_ext(builder, VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+  builder->maintenance5.maintenance5 = VK_TRUE;
+}
 /* Create a Vulkan device (and free builder) */
 vk_dev_t vk_dev_create(
     vk_phys_dev_t *phys_dev,
@@ -155,6 +211,15 @@ vk_dev_t vk_dev_create(
   uint32_t cur = 0;
   vk_dev_t dev;
 
+  /* Check the device is Vulkan 1.2, as the 1.2 features are always chained */
+  if (phys_dev_info->properties.apiVersion < VK_API_VERSION_1_2) {
+    log_msg(
+      LOG_LEVEL_ERROR,
+      "Device %s doesn't support Vulkan 1.2",
+      phys_dev_info->properties.deviceName
+    );
+    abort();
+  }
   /* Check extensions are present */
   for (uint32_t i = 0; i < builder->extension_count; i++) {
     bool supported = false;
@@ -208,6 +273,9 @@ vk_dev_t vk_dev_create(
   dev.compute_queue_count = 0;
   dev.transfer_queues = NULL;
   dev.transfer_queue_count = 0;
+  dev.extensions = NULL;
+  dev.extension_count = 0;
+  dev.cache = NULL;
 
   /* Check there aren't too many requested queues */
   if (
@@ -287,7 +355,20 @@ vk_dev_t vk_dev_create(
 
   /* Populate device create info */
   dev_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  dev_create_info.pNext = NULL;
+  builder->features12.pNext = NULL;
+  if (builder->graphics_pipeline_library.graphicsPipelineLibrary) {
+    builder->graphics_pipeline_library.pNext = builder->features12.pNext;
+    builder->features12.pNext = &builder->graphics_pipeline_library;
+  }
+  if (builder->maintenance5.maintenance5) {
+    builder->maintenance5.pNext = builder->features12.pNext;
+    builder->features12.pNext = &builder->maintenance5;
+  }
+  if (builder->synchronization2.synchronization2) {
+    builder->synchronization2.pNext = builder->features12.pNext;
+    builder->features12.pNext = &builder->synchronization2;
+  }
+  dev_create_info.pNext = &builder->features12;
   dev_create_info.flags = 0;
   dev_create_info.queueCreateInfoCount = cur;
   dev_create_info.pQueueCreateInfos = queue_create_infos;
@@ -310,21 +391,25 @@ vk_dev_t vk_dev_create(
     dev.graphics_queues =
       (VkQueue *)malloc(sizeof(VkQueue) * builder->graphics_queues);
     ASSERT(dev.graphics_queues);
+    dev.graphics_queue_count = builder->graphics_queues;
   }
   if (builder->present_queues > 0) {
     dev.present_queues =
       (VkQueue *)malloc(sizeof(VkQueue) * builder->present_queues);
     ASSERT(dev.present_queues);
+    dev.present_queue_count = builder->present_queues;
   }
   if (builder->compute_queues > 0) {
     dev.compute_queues =
       (VkQueue *)malloc(sizeof(VkQueue) * builder->compute_queues);
     ASSERT(dev.compute_queues);
+    dev.compute_queue_count = builder->compute_queues;
   }
   if (builder->transfer_queues > 0) {
     dev.transfer_queues =
       (VkQueue *)malloc(sizeof(VkQueue) * builder->transfer_queues);
     ASSERT(dev.transfer_queues);
+    dev.transfer_queue_count = builder->transfer_queues;
   }
 
   /* Get queues */
@@ -361,8 +446,12 @@ vk_dev_t vk_dev_create(
     );
   }
 
+  /* Keep the enabled extension list (names must outlive the device) */
+  dev.extensions = builder->extensions;
+  dev.extension_count = builder->extension_count;
+  dev.cache = vk_dev_cache_create(phys_dev_info);
+
   /* Free builder */
-  if (builder->extensions) free(builder->extensions);
   if (builder->layers) free(builder->layers);
   if (builder->graphics_queue_priorities)
     free(builder->graphics_queue_priorities);
@@ -376,9 +465,18 @@ vk_dev_t vk_dev_create(
 
   return dev;
 }
+/* Check if a Vulkan device extension was enabled */
+bool vk_dev_has_ext(const vk_dev_t *dev, const char *ext) {
+  for (uint32_t i = 0; i < dev->extension_count; i++) {
+    if (strcmp(dev->extensions[i], ext) == 0) return true;
+  }
+  return false;
+}
 /* Destroy a Vulkan device */
 void vk_dev_destroy(vk_dev_t *dev) {
+  if (dev->cache) vk_dev_cache_destroy(dev->cache, dev->device);
   vkDestroyDevice(dev->device, NULL);
+  if (dev->extensions) free(dev->extensions);
   if (dev->graphics_queues) free(dev->graphics_queues);
   if (dev->present_queues) free(dev->present_queues);
   if (dev->compute_queues) free(dev->compute_queues);
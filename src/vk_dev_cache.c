@@ -0,0 +1,874 @@
+/* Implements vk_dev_cache.h */
+#include <vk_dev_cache.h>
+#include <hash.h>
+#include <telemetry.h>
+
+/* Initial slots per shard table */
+#define VK_DEV_CACHE_INITIAL_CAPACITY 16u
+/* Key words and dependencies held on the stack before spilling */
+#define VK_DEV_CACHE_LOCAL_WORDS 64u
+#define VK_DEV_CACHE_LOCAL_DEPENDENCIES 16u
+/* Bindings or ranges sorted on the stack before spilling */
+#define VK_DEV_CACHE_LOCAL_ORDER 32u
+
+/* Types */
+/* Canonical key under construction */
+typedef struct {
+  uint32_t *words;
+  uint32_t count, capacity;
+  uint64_t *dependencies;
+  uint32_t dependency_count, dependency_capacity;
+  uint32_t local_words[VK_DEV_CACHE_LOCAL_WORDS];
+  uint64_t local_dependencies[VK_DEV_CACHE_LOCAL_DEPENDENCIES];
+} cache_key_t;
+
+/* Telemetry names of the object counts */
+static const char *const count_names[VK_DEV_CACHE_KIND_COUNT] = {
+  "dev_cache.samplers",
+  "dev_cache.set_layouts",
+  "dev_cache.pipeline_layouts",
+  "dev_cache.shader_modules"
+};
+
+/* Get the bits of a non-dispatchable handle */
+static uint64_t handle_bits(const void *handle, size_t size) {
+  uint64_t bits = 0;
+  memcpy(&bits, handle, size);
+  return bits;
+}
+/* Get the kind of the handles an entry depends on */
+static vk_dev_cache_kind_t dependency_kind(vk_dev_cache_kind_t kind) {
+  return kind == VK_DEV_CACHE_PIPELINE_LAYOUT
+    ? VK_DEV_CACHE_SET_LAYOUT
+    : VK_DEV_CACHE_SAMPLER;
+}
+
+/* Start an empty key */
+static void key_init(cache_key_t *key, vk_dev_cache_kind_t kind) {
+  key->words = key->local_words;
+  key->count = 0;
+  key->capacity = VK_DEV_CACHE_LOCAL_WORDS;
+  key->dependencies = key->local_dependencies;
+  key->dependency_count = 0;
+  key->dependency_capacity = VK_DEV_CACHE_LOCAL_DEPENDENCIES;
+  key->words[key->count++] = (uint32_t)kind;
+}
+/* Append a word to a key */
+static void key_push(cache_key_t *key, uint32_t word) {
+  if (key->count == key->capacity) {
+    uint32_t *words = (uint32_t *)malloc(
+        sizeof(uint32_t) * key->capacity * 2
+    );
+    ASSERT(words);
+    memcpy(words, key->words, sizeof(uint32_t) * key->count);
+    if (key->words != key->local_words) free(key->words);
+    key->words = words;
+    key->capacity *= 2;
+  }
+  key->words[key->count++] = word;
+}
+/* Append a float to a key (with -0 folded into +0) */
+static void key_push_float(cache_key_t *key, float value) {
+  uint32_t word;
+  value += 0.0f;
+  memcpy(&word, &value, sizeof(word));
+  key_push(key, word);
+}
+/* Append a handle the object depends on to a key */
+static void key_push_dependency(cache_key_t *key, uint64_t handle) {
+  key_push(key, (uint32_t)handle);
+  key_push(key, (uint32_t)(handle >> 32));
+  if (key->dependency_count == key->dependency_capacity) {
+    uint64_t *dependencies = (uint64_t *)malloc(
+        sizeof(uint64_t) * key->dependency_capacity * 2
+    );
+    ASSERT(dependencies);
+    memcpy(
+        dependencies,
+        key->dependencies,
+        sizeof(uint64_t) * key->dependency_count
+    );
+    if (key->dependencies != key->local_dependencies)
+      free(key->dependencies);
+    key->dependencies = dependencies;
+    key->dependency_capacity *= 2;
+  }
+  key->dependencies[key->dependency_count++] = handle;
+}
+/* Free a key's spilled storage */
+static void key_free(cache_key_t *key) {
+  if (key->words != key->local_words) free(key->words);
+  if (key->dependencies != key->local_dependencies) free(key->dependencies);
+}
+/* Reject a pNext structure the key can't represent */
+static void unsupported_next(VkStructureType type) {
+  log_msg(
+      LOG_LEVEL_ERROR,
+      "Device cache can't key pNext structure (sType %d)",
+      (int)type
+  );
+  abort();
+}
+/* Sort indices by a sort key (insertion sort, counts are small) */
+static void sort_order(uint32_t *order, const uint64_t *keys, uint32_t count) {
+  for (uint32_t i = 1; i < count; i++) {
+    uint32_t index = order[i];
+    uint32_t j = i;
+    while (j > 0 && keys[order[j - 1]] > keys[index]) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = index;
+  }
+}
+
+/* Build the key of a sampler */
+static void sampler_key(cache_key_t *key, const VkSamplerCreateInfo *info) {
+  VkSamplerReductionMode reduction =
+    VK_SAMPLER_REDUCTION_MODE_WEIGHTED_AVERAGE;
+  bool border = false;
+
+  for (
+      const VkBaseInStructure *next = (const VkBaseInStructure *)info->pNext;
+      next;
+      next = next->pNext
+  ) {
+    if (next->sType == VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO) {
+      reduction = ((const VkSamplerReductionModeCreateInfo *)next)
+        ->reductionMode;
+    } else unsupported_next(next->sType);
+  }
+  border = info->addressModeU == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER
+    || info->addressModeV == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER
+    || info->addressModeW == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+
+  /* Fields that are ignored are keyed as a fixed value */
+  key_push(key, (uint32_t)info->flags);
+  key_push(key, (uint32_t)info->magFilter);
+  key_push(key, (uint32_t)info->minFilter);
+  key_push(key, (uint32_t)info->mipmapMode);
+  key_push(key, (uint32_t)info->addressModeU);
+  key_push(key, (uint32_t)info->addressModeV);
+  key_push(key, (uint32_t)info->addressModeW);
+  key_push_float(key, info->mipLodBias);
+  key_push(key, info->anisotropyEnable ? 1u : 0u);
+  key_push_float(key, info->anisotropyEnable ? info->maxAnisotropy : 1.0f);
+  key_push(key, info->compareEnable ? 1u : 0u);
+  key_push(key, info->compareEnable ? (uint32_t)info->compareOp : 0u);
+  key_push_float(key, info->minLod);
+  key_push_float(key, info->maxLod);
+  key_push(key, border ? (uint32_t)info->borderColor : 0u);
+  key_push(key, info->unnormalizedCoordinates ? 1u : 0u);
+  key_push(key, (uint32_t)reduction);
+}
+/* Build the key of a descriptor set layout (bindings in binding order) */
+static void set_layout_key(
+    cache_key_t *key,
+    const VkDescriptorSetLayoutCreateInfo *info
+) {
+  const VkDescriptorBindingFlags *binding_flags = NULL;
+  uint32_t local_order[VK_DEV_CACHE_LOCAL_ORDER];
+  uint64_t local_keys[VK_DEV_CACHE_LOCAL_ORDER];
+  uint32_t *order = local_order;
+  uint64_t *keys = local_keys;
+
+  for (
+      const VkBaseInStructure *next = (const VkBaseInStructure *)info->pNext;
+      next;
+      next = next->pNext
+  ) {
+    if (
+        next->sType
+        == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO
+    ) {
+      const VkDescriptorSetLayoutBindingFlagsCreateInfo *flags_info =
+        (const VkDescriptorSetLayoutBindingFlagsCreateInfo *)next;
+      ASSERT(
+          flags_info->bindingCount == 0
+          || flags_info->bindingCount == info->bindingCount
+      );
+      if (flags_info->bindingCount) binding_flags = flags_info->pBindingFlags;
+    } else unsupported_next(next->sType);
+  }
+
+  /* Binding order in the create info doesn't matter */
+  if (info->bindingCount > VK_DEV_CACHE_LOCAL_ORDER) {
+    order = (uint32_t *)malloc(sizeof(uint32_t) * info->bindingCount);
+    keys = (uint64_t *)malloc(sizeof(uint64_t) * info->bindingCount);
+    ASSERT(order && keys);
+  }
+  for (uint32_t i = 0; i < info->bindingCount; i++) {
+    order[i] = i;
+    keys[i] = info->pBindings[i].binding;
+  }
+  sort_order(order, keys, info->bindingCount);
+
+  key_push(key, (uint32_t)info->flags);
+  key_push(key, info->bindingCount);
+  for (uint32_t i = 0; i < info->bindingCount; i++) {
+    const VkDescriptorSetLayoutBinding *binding = &info->pBindings[order[i]];
+    bool immutable = binding->pImmutableSamplers && (
+        binding->descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER
+        || binding->descriptorType
+          == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    );
+    key_push(key, binding->binding);
+    key_push(key, (uint32_t)binding->descriptorType);
+    key_push(key, binding->descriptorCount);
+    key_push(key, (uint32_t)binding->stageFlags);
+    key_push(key, binding_flags ? (uint32_t)binding_flags[order[i]] : 0u);
+    key_push(key, immutable ? 1u : 0u);
+    if (!immutable) continue;
+    for (uint32_t j = 0; j < binding->descriptorCount; j++) {
+      key_push_dependency(key, handle_bits(
+            &binding->pImmutableSamplers[j],
+            sizeof(VkSampler)
+      ));
+    }
+  }
+
+  if (order != local_order) {
+    free(order);
+    free(keys);
+  }
+}
+/* Build the key of a pipeline layout (push constants in offset order) */
+static void pipeline_layout_key(
+    cache_key_t *key,
+    const VkPipelineLayoutCreateInfo *info
+) {
+  uint32_t local_order[VK_DEV_CACHE_LOCAL_ORDER];
+  uint64_t local_keys[VK_DEV_CACHE_LOCAL_ORDER];
+  uint32_t count = info->pushConstantRangeCount;
+
+  if (info->pNext)
+    unsupported_next(((const VkBaseInStructure *)info->pNext)->sType);
+  ASSERT(count <= VK_DEV_CACHE_LOCAL_ORDER);
+
+  key_push(key, (uint32_t)info->flags);
+  key_push(key, info->setLayoutCount);
+  for (uint32_t i = 0; i < info->setLayoutCount; i++) {
+    key_push_dependency(key, handle_bits(
+          &info->pSetLayouts[i],
+          sizeof(VkDescriptorSetLayout)
+    ));
+  }
+
+  /* Range order in the create info doesn't matter */
+  for (uint32_t i = 0; i < count; i++) {
+    local_order[i] = i;
+    local_keys[i] = ((uint64_t)info->pPushConstantRanges[i].offset << 32)
+      | (uint64_t)info->pPushConstantRanges[i].stageFlags;
+  }
+  if (count > 1) sort_order(local_order, local_keys, count);
+  key_push(key, count);
+  for (uint32_t i = 0; i < count; i++) {
+    const VkPushConstantRange *range =
+      &info->pPushConstantRanges[local_order[i]];
+    key_push(key, (uint32_t)range->stageFlags);
+    key_push(key, range->offset);
+    key_push(key, range->size);
+  }
+}
+/* Build the key of a shader module (its code is too big to key directly) */
+static void shader_module_key(
+    cache_key_t *key,
+    const VkShaderModuleCreateInfo *info
+) {
+  uint64_t hash = hash64(info->pCode, info->codeSize, 0);
+  if (info->pNext)
+    unsupported_next(((const VkBaseInStructure *)info->pNext)->sType);
+  key_push(key, (uint32_t)info->flags);
+  key_push(key, (uint32_t)info->codeSize);
+  key_push(key, (uint32_t)((uint64_t)info->codeSize >> 32));
+  key_push(key, (uint32_t)hash);
+  key_push(key, (uint32_t)(hash >> 32));
+}
+
+/* Allocate an empty table */
+static vk_dev_cache_table_t *table_create(uint32_t capacity) {
+  vk_dev_cache_table_t *table =
+    (vk_dev_cache_table_t *)malloc(sizeof(vk_dev_cache_table_t));
+  ASSERT(table);
+  table->retired = NULL;
+  table->capacity = capacity;
+  table->slots = (_Atomic(vk_dev_cache_entry_t *) *)malloc(
+      sizeof(_Atomic(vk_dev_cache_entry_t *)) * capacity
+  );
+  ASSERT(table->slots);
+  for (uint32_t i = 0; i < capacity; i++) atomic_init(&table->slots[i], NULL);
+  return table;
+}
+/* Free a table and every table it replaced */
+static void table_free(vk_dev_cache_table_t *table) {
+  while (table) {
+    vk_dev_cache_table_t *retired = table->retired;
+    free(table->slots);
+    free(table);
+    table = retired;
+  }
+}
+/* Put an entry in the first free slot of its probe sequence */
+static void table_place(
+    vk_dev_cache_table_t *table,
+    vk_dev_cache_entry_t *entry
+) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t i = (uint32_t)entry->hash & mask;
+  while (atomic_load_explicit(&table->slots[i], memory_order_relaxed))
+    i = (i + 1) & mask;
+  atomic_store_explicit(&table->slots[i], entry, memory_order_release);
+}
+/* Find an entry by key (safe without the shard lock) */
+static vk_dev_cache_entry_t *table_find(
+    vk_dev_cache_table_t *table,
+    uint64_t hash,
+    const cache_key_t *key
+) {
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+    vk_dev_cache_entry_t *entry =
+      atomic_load_explicit(&table->slots[i], memory_order_acquire);
+    if (!entry) return NULL;
+    if (
+        entry->hash == hash
+        && entry->key_size == key->count
+        && memcmp(entry->key, key->words, sizeof(uint32_t) * key->count) == 0
+    ) return entry;
+  }
+}
+
+/* Get the shard holding a handle in its handle map */
+static vk_dev_cache_shard_t *handle_shard(
+    vk_dev_cache_t *cache,
+    uint64_t handle
+) {
+  uint64_t hash = hash64(&handle, sizeof(handle), 0);
+  return &cache->shards[(hash >> 32) & (VK_DEV_CACHE_SHARDS - 1)];
+}
+/* Put an entry in a handle map (handle mutex held) */
+static void handles_place(
+    vk_dev_cache_entry_t **handles,
+    uint32_t capacity,
+    vk_dev_cache_entry_t *entry
+) {
+  uint32_t mask = capacity - 1;
+  uint32_t i = (uint32_t)hash64(&entry->handle, sizeof(uint64_t), 0) & mask;
+  while (handles[i]) i = (i + 1) & mask;
+  handles[i] = entry;
+}
+/* Add an entry to its handle map */
+static void handles_insert(
+    vk_dev_cache_t *cache,
+    vk_dev_cache_entry_t *entry
+) {
+  vk_dev_cache_shard_t *shard = handle_shard(cache, entry->handle);
+  pthread_mutex_lock(&shard->handle_mutex);
+  if ((shard->handle_count + 1) * 2 > shard->handle_capacity) {
+    uint32_t capacity = shard->handle_capacity * 2;
+    vk_dev_cache_entry_t **handles = (vk_dev_cache_entry_t **)calloc(
+        capacity,
+        sizeof(vk_dev_cache_entry_t *)
+    );
+    ASSERT(handles);
+    for (uint32_t i = 0; i < shard->handle_capacity; i++) {
+      if (shard->handles[i])
+        handles_place(handles, capacity, shard->handles[i]);
+    }
+    free(shard->handles);
+    shard->handles = handles;
+    shard->handle_capacity = capacity;
+  }
+  handles_place(shard->handles, shard->handle_capacity, entry);
+  shard->handle_count++;
+  pthread_mutex_unlock(&shard->handle_mutex);
+}
+/* Find an entry by kind and handle (NULL if not cached) */
+static vk_dev_cache_entry_t *handles_find(
+    vk_dev_cache_t *cache,
+    vk_dev_cache_kind_t kind,
+    uint64_t handle
+) {
+  vk_dev_cache_shard_t *shard = handle_shard(cache, handle);
+  vk_dev_cache_entry_t *found = NULL;
+  uint32_t mask;
+  pthread_mutex_lock(&shard->handle_mutex);
+  mask = shard->handle_capacity - 1;
+  for (
+      uint32_t i = (uint32_t)hash64(&handle, sizeof(handle), 0) & mask;
+      shard->handles[i];
+      i = (i + 1) & mask
+  ) {
+    if (
+        shard->handles[i]->handle == handle
+        && shard->handles[i]->kind == kind
+    ) {
+      found = shard->handles[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&shard->handle_mutex);
+  return found;
+}
+/* Drop a reference on a cached entry */
+static void release(
+    vk_dev_cache_t *cache,
+    vk_dev_cache_kind_t kind,
+    uint64_t handle
+) {
+  vk_dev_cache_entry_t *entry = handles_find(cache, kind, handle);
+  unsigned int refs;
+  if (!entry) {
+    log_msg(LOG_LEVEL_ERROR, "Released an object the cache doesn't own");
+    abort();
+  }
+  refs = atomic_fetch_sub(&entry->refs, 1);
+  ASSERT(refs > 0);
+}
+
+/* Create the Vulkan object of a new entry */
+static void create_object(
+    vk_dev_cache_entry_t *entry,
+    VkDevice device,
+    const void *info
+) {
+  switch (entry->kind) {
+    case VK_DEV_CACHE_SAMPLER: {
+      VkSampler sampler;
+      VK_CHECK(vkCreateSampler(
+            device,
+            (const VkSamplerCreateInfo *)info,
+            NULL,
+            &sampler
+      ));
+      entry->handle = handle_bits(&sampler, sizeof(sampler));
+      break;
+    }
+    case VK_DEV_CACHE_SET_LAYOUT: {
+      VkDescriptorSetLayout layout;
+      VK_CHECK(vkCreateDescriptorSetLayout(
+            device,
+            (const VkDescriptorSetLayoutCreateInfo *)info,
+            NULL,
+            &layout
+      ));
+      entry->handle = handle_bits(&layout, sizeof(layout));
+      break;
+    }
+    case VK_DEV_CACHE_PIPELINE_LAYOUT: {
+      VkPipelineLayout layout;
+      VK_CHECK(vkCreatePipelineLayout(
+            device,
+            (const VkPipelineLayoutCreateInfo *)info,
+            NULL,
+            &layout
+      ));
+      entry->handle = handle_bits(&layout, sizeof(layout));
+      break;
+    }
+    case VK_DEV_CACHE_SHADER_MODULE: {
+      VkShaderModule module;
+      VK_CHECK(vkCreateShaderModule(
+            device,
+            (const VkShaderModuleCreateInfo *)info,
+            NULL,
+            &module
+      ));
+      entry->handle = handle_bits(&module, sizeof(module));
+      break;
+    }
+    default: ASSERT(false);
+  }
+}
+/* Destroy the Vulkan object of an entry */
+static void destroy_object(vk_dev_cache_entry_t *entry, VkDevice device) {
+  switch (entry->kind) {
+    case VK_DEV_CACHE_SAMPLER: {
+      VkSampler sampler = VK_NULL_HANDLE;
+      memcpy(&sampler, &entry->handle, sizeof(sampler));
+      vkDestroySampler(device, sampler, NULL);
+      break;
+    }
+    case VK_DEV_CACHE_SET_LAYOUT: {
+      VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+      memcpy(&layout, &entry->handle, sizeof(layout));
+      vkDestroyDescriptorSetLayout(device, layout, NULL);
+      break;
+    }
+    case VK_DEV_CACHE_PIPELINE_LAYOUT: {
+      VkPipelineLayout layout = VK_NULL_HANDLE;
+      memcpy(&layout, &entry->handle, sizeof(layout));
+      vkDestroyPipelineLayout(device, layout, NULL);
+      break;
+    }
+    case VK_DEV_CACHE_SHADER_MODULE: {
+      VkShaderModule module = VK_NULL_HANDLE;
+      memcpy(&module, &entry->handle, sizeof(module));
+      vkDestroyShaderModule(device, module, NULL);
+      break;
+    }
+    default: ASSERT(false);
+  }
+}
+/* Allocate an entry for a key (with its key and dependencies inline) */
+static vk_dev_cache_entry_t *entry_create(
+    const cache_key_t *key,
+    uint64_t hash,
+    vk_dev_cache_kind_t kind
+) {
+  vk_dev_cache_entry_t *entry = (vk_dev_cache_entry_t *)malloc(
+      sizeof(vk_dev_cache_entry_t)
+      + sizeof(uint64_t) * key->dependency_count
+      + sizeof(uint32_t) * key->count
+  );
+  ASSERT(entry);
+  entry->hash = hash;
+  entry->handle = 0;
+  entry->kind = kind;
+  atomic_init(&entry->refs, 1);
+  entry->dependencies = (uint64_t *)(entry + 1);
+  entry->dependency_count = 0;
+  entry->key_size = key->count;
+  entry->key = (uint32_t *)(entry->dependencies + key->dependency_count);
+  memcpy(entry->key, key->words, sizeof(uint32_t) * key->count);
+  return entry;
+}
+/* Insert an entry into a shard's table (shard mutex held) */
+static void shard_insert(
+    vk_dev_cache_shard_t *shard,
+    vk_dev_cache_entry_t *entry
+) {
+  vk_dev_cache_table_t *table =
+    atomic_load_explicit(&shard->table, memory_order_relaxed);
+
+  /* Readers may still be probing the old table, so it's only retired */
+  if ((shard->count + 1) * 2 > table->capacity) {
+    vk_dev_cache_table_t *grown = table_create(table->capacity * 2);
+    for (uint32_t i = 0; i < table->capacity; i++) {
+      vk_dev_cache_entry_t *old =
+        atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+      if (old) table_place(grown, old);
+    }
+    grown->retired = table;
+    atomic_store_explicit(&shard->table, grown, memory_order_release);
+    table = grown;
+  }
+  table_place(table, entry);
+  shard->count++;
+}
+/* Look up or create the object for a key, adding a reference */
+static uint64_t acquire(
+    vk_dev_t *dev,
+    cache_key_t *key,
+    vk_dev_cache_kind_t kind,
+    const void *info
+) {
+  vk_dev_cache_t *cache = dev->cache;
+  uint64_t hash = hash64(key->words, sizeof(uint32_t) * key->count, 0);
+  vk_dev_cache_shard_t *shard =
+    &cache->shards[(hash >> 32) & (VK_DEV_CACHE_SHARDS - 1)];
+  vk_dev_cache_entry_t *entry;
+  unsigned int count;
+
+  /* Lock free hit */
+  entry = table_find(
+      atomic_load_explicit(&shard->table, memory_order_acquire),
+      hash,
+      key
+  );
+  if (entry) {
+    atomic_fetch_add(&entry->refs, 1);
+    key_free(key);
+    return entry->handle;
+  }
+
+  /* Miss: check again under the lock, then create */
+  pthread_mutex_lock(&shard->mutex);
+  entry = table_find(
+      atomic_load_explicit(&shard->table, memory_order_relaxed),
+      hash,
+      key
+  );
+  if (entry) {
+    atomic_fetch_add(&entry->refs, 1);
+    pthread_mutex_unlock(&shard->mutex);
+    key_free(key);
+    return entry->handle;
+  }
+  entry = entry_create(key, hash, kind);
+  create_object(entry, dev->device, info);
+  for (uint32_t i = 0; i < key->dependency_count; i++) {
+    vk_dev_cache_entry_t *dependency = handles_find(
+        cache,
+        dependency_kind(kind),
+        key->dependencies[i]
+    );
+    if (!dependency) continue;
+    atomic_fetch_add(&dependency->refs, 1);
+    entry->dependencies[entry->dependency_count++] = key->dependencies[i];
+  }
+  handles_insert(cache, entry);
+  shard_insert(shard, entry);
+  pthread_mutex_unlock(&shard->mutex);
+  key_free(key);
+
+  count = atomic_fetch_add(&cache->counts[kind], 1) + 1;
+  telemetry_report(count_names[kind], TELEMETRY_GAUGE, (double)count);
+  if (kind == VK_DEV_CACHE_SAMPLER && count > cache->max_samplers) {
+    log_msg(
+        LOG_LEVEL_WARN,
+        "%u cached samplers exceed maxSamplerAllocationCount (%u)",
+        count,
+        cache->max_samplers
+    );
+  }
+  return entry->handle;
+}
+
+/* Create a device object cache */
+vk_dev_cache_t *vk_dev_cache_create(const vk_phys_dev_info_t *phys_dev_info) {
+  vk_dev_cache_t *cache = (vk_dev_cache_t *)malloc(sizeof(vk_dev_cache_t));
+  ASSERT(cache);
+  for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+    vk_dev_cache_shard_t *shard = &cache->shards[i];
+    atomic_init(&shard->table, table_create(VK_DEV_CACHE_INITIAL_CAPACITY));
+    pthread_mutex_init(&shard->mutex, NULL);
+    shard->count = 0;
+    pthread_mutex_init(&shard->handle_mutex, NULL);
+    shard->handles = (vk_dev_cache_entry_t **)calloc(
+        VK_DEV_CACHE_INITIAL_CAPACITY,
+        sizeof(vk_dev_cache_entry_t *)
+    );
+    ASSERT(shard->handles);
+    shard->handle_count = 0;
+    shard->handle_capacity = VK_DEV_CACHE_INITIAL_CAPACITY;
+  }
+  for (uint32_t i = 0; i < VK_DEV_CACHE_KIND_COUNT; i++)
+    atomic_init(&cache->counts[i], 0);
+  cache->max_samplers =
+    phys_dev_info->properties.limits.maxSamplerAllocationCount;
+  return cache;
+}
+/* Get a cached sampler (referenced until released) */
+VkSampler vk_dev_cache_sampler(
+    vk_dev_t *dev,
+    const VkSamplerCreateInfo *info
+) {
+  VkSampler sampler = VK_NULL_HANDLE;
+  uint64_t handle;
+  cache_key_t key;
+  key_init(&key, VK_DEV_CACHE_SAMPLER);
+  sampler_key(&key, info);
+  handle = acquire(dev, &key, VK_DEV_CACHE_SAMPLER, info);
+  memcpy(&sampler, &handle, sizeof(sampler));
+  return sampler;
+}
+/* Get a cached descriptor set layout (referenced until released) */
+VkDescriptorSetLayout vk_dev_cache_set_layout(
+    vk_dev_t *dev,
+    const VkDescriptorSetLayoutCreateInfo *info
+) {
+  VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+  uint64_t handle;
+  cache_key_t key;
+  key_init(&key, VK_DEV_CACHE_SET_LAYOUT);
+  set_layout_key(&key, info);
+  handle = acquire(dev, &key, VK_DEV_CACHE_SET_LAYOUT, info);
+  memcpy(&layout, &handle, sizeof(layout));
+  return layout;
+}
+/* Get a cached pipeline layout (referenced until released) */
+VkPipelineLayout vk_dev_cache_pipeline_layout(
+    vk_dev_t *dev,
+    const VkPipelineLayoutCreateInfo *info
+) {
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  uint64_t handle;
+  cache_key_t key;
+  key_init(&key, VK_DEV_CACHE_PIPELINE_LAYOUT);
+  pipeline_layout_key(&key, info);
+  handle = acquire(dev, &key, VK_DEV_CACHE_PIPELINE_LAYOUT, info);
+  memcpy(&layout, &handle, sizeof(layout));
+  return layout;
+}
+/* Get a cached shader module (keyed by a hash of the code) */
+VkShaderModule vk_dev_cache_shader_module(
+    vk_dev_t *dev,
+    const VkShaderModuleCreateInfo *info
+) {
+  VkShaderModule module = VK_NULL_HANDLE;
+  uint64_t handle;
+  cache_key_t key;
+  key_init(&key, VK_DEV_CACHE_SHADER_MODULE);
+  shader_module_key(&key, info);
+  handle = acquire(dev, &key, VK_DEV_CACHE_SHADER_MODULE, info);
+  memcpy(&module, &handle, sizeof(module));
+  return module;
+}
+/* Release a cached sampler */
+void vk_dev_cache_release_sampler(vk_dev_t *dev, VkSampler sampler) {
+  release(
+      dev->cache,
+      VK_DEV_CACHE_SAMPLER,
+      handle_bits(&sampler, sizeof(sampler))
+  );
+}
+/* Release a cached descriptor set layout */
+void vk_dev_cache_release_set_layout(
+    vk_dev_t *dev,
+    VkDescriptorSetLayout layout
+) {
+  release(
+      dev->cache,
+      VK_DEV_CACHE_SET_LAYOUT,
+      handle_bits(&layout, sizeof(layout))
+  );
+}
+/* Release a cached pipeline layout */
+void vk_dev_cache_release_pipeline_layout(
+    vk_dev_t *dev,
+    VkPipelineLayout layout
+) {
+  release(
+      dev->cache,
+      VK_DEV_CACHE_PIPELINE_LAYOUT,
+      handle_bits(&layout, sizeof(layout))
+  );
+}
+/* Release a cached shader module */
+void vk_dev_cache_release_shader_module(
+    vk_dev_t *dev,
+    VkShaderModule module
+) {
+  release(
+      dev->cache,
+      VK_DEV_CACHE_SHADER_MODULE,
+      handle_bits(&module, sizeof(module))
+  );
+}
+/* Destroy unreferenced objects (no other use of the cache may overlap) */
+void vk_dev_cache_trim(vk_dev_t *dev) {
+  vk_dev_cache_t *cache = dev->cache;
+  vk_dev_cache_entry_t **dead = NULL;
+  uint32_t dead_count = 0, dead_capacity = 0;
+
+  /* Users go before what they depend on, so that can go in the same pass */
+  for (int kind = VK_DEV_CACHE_KIND_COUNT - 1; kind >= 0; kind--) {
+    for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+      vk_dev_cache_shard_t *shard = &cache->shards[i];
+      vk_dev_cache_table_t *table = atomic_load(&shard->table);
+      vk_dev_cache_table_t *kept = table_create(table->capacity);
+      shard->count = 0;
+      for (uint32_t j = 0; j < table->capacity; j++) {
+        vk_dev_cache_entry_t *entry = atomic_load(&table->slots[j]);
+        if (!entry) continue;
+        if ((int)entry->kind != kind || atomic_load(&entry->refs) > 0) {
+          table_place(kept, entry);
+          shard->count++;
+          continue;
+        }
+        destroy_object(entry, dev->device);
+        for (uint32_t k = 0; k < entry->dependency_count; k++) {
+          release(
+              cache,
+              dependency_kind(entry->kind),
+              entry->dependencies[k]
+          );
+        }
+        atomic_fetch_sub(&cache->counts[entry->kind], 1);
+        if (dead_count == dead_capacity) {
+          dead_capacity = dead_capacity ? dead_capacity * 2 : 16;
+          dead = (vk_dev_cache_entry_t **)realloc(
+              dead,
+              sizeof(vk_dev_cache_entry_t *) * dead_capacity
+          );
+          ASSERT(dead);
+        }
+        dead[dead_count++] = entry;
+      }
+      atomic_store(&shard->table, kept);
+      table_free(table);
+    }
+    telemetry_report(
+        count_names[kind],
+        TELEMETRY_GAUGE,
+        (double)atomic_load(&cache->counts[kind])
+    );
+  }
+
+  /* Rebuild the handle maps without the destroyed entries */
+  for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+    memset(
+        cache->shards[i].handles,
+        0,
+        sizeof(vk_dev_cache_entry_t *) * cache->shards[i].handle_capacity
+    );
+    cache->shards[i].handle_count = 0;
+  }
+  for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+    vk_dev_cache_table_t *table = atomic_load(&cache->shards[i].table);
+    for (uint32_t j = 0; j < table->capacity; j++) {
+      vk_dev_cache_entry_t *entry = atomic_load(&table->slots[j]);
+      if (entry) handles_insert(cache, entry);
+    }
+  }
+
+  if (dead_count) {
+    log_msg(LOG_LEVEL_INFO, "Trimmed %u cached device objects", dead_count);
+  }
+  for (uint32_t i = 0; i < dead_count; i++) free(dead[i]);
+  if (dead) free(dead);
+}
+/* Destroy a device object cache and every object in it */
+void vk_dev_cache_destroy(vk_dev_cache_t *cache, VkDevice device) {
+  uint32_t leaked = 0;
+
+  /* Drop references held between entries, leaving only the users' */
+  for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+    vk_dev_cache_table_t *table = atomic_load(&cache->shards[i].table);
+    for (uint32_t j = 0; j < table->capacity; j++) {
+      vk_dev_cache_entry_t *entry = atomic_load(&table->slots[j]);
+      if (!entry) continue;
+      for (uint32_t k = 0; k < entry->dependency_count; k++) {
+        release(
+            cache,
+            dependency_kind(entry->kind),
+            entry->dependencies[k]
+        );
+      }
+    }
+  }
+
+  /* Destroy users before what they depend on */
+  for (int kind = VK_DEV_CACHE_KIND_COUNT - 1; kind >= 0; kind--) {
+    for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+      vk_dev_cache_table_t *table = atomic_load(&cache->shards[i].table);
+      for (uint32_t j = 0; j < table->capacity; j++) {
+        vk_dev_cache_entry_t *entry = atomic_load(&table->slots[j]);
+        if (!entry || (int)entry->kind != kind) continue;
+        if (atomic_load(&entry->refs) > 0) leaked++;
+        destroy_object(entry, device);
+      }
+    }
+  }
+  if (leaked) {
+    log_msg(
+        LOG_LEVEL_WARN,
+        "%u cached device objects still referenced at shutdown",
+        leaked
+    );
+  }
+  for (uint32_t i = 0; i < VK_DEV_CACHE_SHARDS; i++) {
+    vk_dev_cache_shard_t *shard = &cache->shards[i];
+    vk_dev_cache_table_t *table = atomic_load(&shard->table);
+    for (uint32_t j = 0; j < table->capacity; j++) {
+      vk_dev_cache_entry_t *entry = atomic_load(&table->slots[j]);
+      if (entry) free(entry);
+    }
+    table_free(table);
+    free(shard->handles);
+    pthread_mutex_destroy(&shard->mutex);
+    pthread_mutex_destroy(&shard->handle_mutex);
+  }
+  free(cache);
+}
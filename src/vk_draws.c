@@ -0,0 +1,330 @@
+/* Implements vk_draws.h */
+#include <vk_draws.h>
+#include <telemetry.h>
+
+/* Largest depth bucket */
+#define DEPTH_MAX ((1ull << VK_DRAWS_DEPTH_BITS) - 1)
+/* Key field shifts, front to back */
+#define FRONT_MESH_SHIFT VK_DRAWS_DEPTH_BITS
+#define FRONT_MATERIAL_SHIFT (FRONT_MESH_SHIFT + VK_DRAWS_MESH_BITS)
+#define FRONT_PIPELINE_SHIFT (FRONT_MATERIAL_SHIFT + VK_DRAWS_MATERIAL_BITS)
+/* Key field shifts, back to front */
+#define BACK_MATERIAL_SHIFT VK_DRAWS_MESH_BITS
+#define BACK_PIPELINE_SHIFT (BACK_MATERIAL_SHIFT + VK_DRAWS_MATERIAL_BITS)
+#define BACK_DEPTH_SHIFT (BACK_PIPELINE_SHIFT + VK_DRAWS_PIPELINE_BITS)
+/* Pass shift (both) */
+#define PASS_SHIFT (64 - VK_DRAWS_PASS_BITS)
+
+/* Types */
+/* Bound state while recording */
+typedef struct {
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+  VkDescriptorSet material;
+  VkBuffer vertex_buffer;
+  VkDeviceSize vertex_buffer_offset;
+  VkBuffer index_buffer;
+  VkDeviceSize index_buffer_offset;
+  VkIndexType index_type;
+} bind_state_t;
+
+/* Get a packet's sort key */
+static uint64_t packet_key(
+    const vk_draws_t *draws,
+    const vk_draws_packet_t *packet,
+    float depth
+) {
+  uint64_t bucket = 0;
+  if (depth >= 1.0f) bucket = DEPTH_MAX;
+  else if (depth > 0.0f) bucket = (uint64_t)(depth * (float)DEPTH_MAX);
+  if (draws->back_to_front[packet->pass]) {
+    return (uint64_t)packet->pass << PASS_SHIFT |
+      (DEPTH_MAX - bucket) << BACK_DEPTH_SHIFT |
+      (uint64_t)packet->pipeline << BACK_PIPELINE_SHIFT |
+      (uint64_t)packet->material << BACK_MATERIAL_SHIFT |
+      (uint64_t)packet->mesh;
+  }
+  return (uint64_t)packet->pass << PASS_SHIFT |
+    (uint64_t)packet->pipeline << FRONT_PIPELINE_SHIFT |
+    (uint64_t)packet->material << FRONT_MATERIAL_SHIFT |
+    (uint64_t)packet->mesh << FRONT_MESH_SHIFT |
+    bucket;
+}
+/* Bind the state a batch changes and draw it (cmd NULL: only count) */
+static void draw_batch(
+    const vk_draws_t *draws,
+    bind_state_t *state,
+    VkCommandBuffer cmd,
+    const vk_draws_batch_t *batch,
+    vk_draws_stats_t *stats
+) {
+  const vk_draws_pipeline_t *pipeline = &draws->pipelines[batch->pipeline];
+  const vk_draws_mesh_t *mesh = &draws->meshes[batch->mesh];
+  VkDescriptorSet material = draws->materials[batch->material];
+
+  if (pipeline->pipeline != state->pipeline) {
+    if (cmd) vkCmdBindPipeline(
+        cmd,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline->pipeline
+    );
+    state->pipeline = pipeline->pipeline;
+    stats->pipelines++;
+  }
+  /* A new layout may not keep the set bound */
+  if (material != state->material || pipeline->layout != state->layout) {
+    if (cmd) vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline->layout,
+        VK_DRAWS_MATERIAL_SET,
+        1, &material,
+        0, NULL
+    );
+    state->material = material;
+    state->layout = pipeline->layout;
+    stats->descriptor_sets++;
+  }
+  if (
+      mesh->vertex_buffer != state->vertex_buffer ||
+      mesh->vertex_buffer_offset != state->vertex_buffer_offset
+  ) {
+    if (cmd) vkCmdBindVertexBuffers(
+        cmd,
+        0, 1,
+        &mesh->vertex_buffer,
+        &mesh->vertex_buffer_offset
+    );
+    state->vertex_buffer = mesh->vertex_buffer;
+    state->vertex_buffer_offset = mesh->vertex_buffer_offset;
+    stats->vertex_buffers++;
+  }
+  if (
+      mesh->index_buffer != state->index_buffer ||
+      mesh->index_buffer_offset != state->index_buffer_offset ||
+      mesh->index_type != state->index_type
+  ) {
+    if (cmd) vkCmdBindIndexBuffer(
+        cmd,
+        mesh->index_buffer,
+        mesh->index_buffer_offset,
+        mesh->index_type
+    );
+    state->index_buffer = mesh->index_buffer;
+    state->index_buffer_offset = mesh->index_buffer_offset;
+    state->index_type = mesh->index_type;
+    stats->index_buffers++;
+  }
+  if (cmd) vkCmdDrawIndexed(
+      cmd,
+      mesh->index_count,
+      batch->instance_count,
+      mesh->first_index,
+      mesh->vertex_offset,
+      batch->first_instance
+  );
+  stats->draws++;
+}
+/* Report a frame's state changes */
+static void report_stats(const char *name, const vk_draws_stats_t *stats) {
+  char key[TELEMETRY_MAX_NAME];
+  snprintf(key, sizeof(key), "draws.%s.draws", name);
+  telemetry_report(key, TELEMETRY_GAUGE, stats->draws);
+  snprintf(key, sizeof(key), "draws.%s.pipelines", name);
+  telemetry_report(key, TELEMETRY_GAUGE, stats->pipelines);
+  snprintf(key, sizeof(key), "draws.%s.descriptor_sets", name);
+  telemetry_report(key, TELEMETRY_GAUGE, stats->descriptor_sets);
+  snprintf(key, sizeof(key), "draws.%s.vertex_buffers", name);
+  telemetry_report(key, TELEMETRY_GAUGE, stats->vertex_buffers);
+  snprintf(key, sizeof(key), "draws.%s.index_buffers", name);
+  telemetry_report(key, TELEMETRY_GAUGE, stats->index_buffers);
+}
+
+/* Create draw packets, with room for some per frame */
+void vk_draws_create(vk_draws_t *draws, uint32_t max_packets) {
+  memset(draws, 0, sizeof(vk_draws_t));
+  draws->max_packets = max_packets;
+  draws->packets = (vk_draws_packet_t *)malloc(
+      sizeof(vk_draws_packet_t) * max_packets
+  );
+  draws->keys = (radix_item_t *)malloc(sizeof(radix_item_t) * max_packets);
+  draws->scratch = (radix_item_t *)malloc(
+      sizeof(radix_item_t) * max_packets
+  );
+  draws->instances = (uint32_t *)malloc(sizeof(uint32_t) * max_packets);
+  draws->batches = (vk_draws_batch_t *)malloc(
+      sizeof(vk_draws_batch_t) * max_packets
+  );
+  ASSERT(draws->packets && draws->keys && draws->scratch);
+  ASSERT(draws->instances && draws->batches);
+  atomic_init(&draws->packet_count, 0);
+}
+/* Add a pass, returning its id (passes record in any order) */
+uint32_t vk_draws_add_pass(vk_draws_t *draws, bool back_to_front) {
+  ASSERT(draws->pass_count < VK_DRAWS_MAX_PASSES);
+  draws->back_to_front[draws->pass_count] = back_to_front;
+  return draws->pass_count++;
+}
+/* Add a pipeline, returning its id */
+uint32_t vk_draws_add_pipeline(
+    vk_draws_t *draws,
+    VkPipeline pipeline,
+    VkPipelineLayout layout
+) {
+  ASSERT(draws->pipeline_count < (1u << VK_DRAWS_PIPELINE_BITS));
+  draws->pipelines = (vk_draws_pipeline_t *)realloc(
+      draws->pipelines,
+      sizeof(vk_draws_pipeline_t) * (draws->pipeline_count + 1)
+  );
+  ASSERT(draws->pipelines);
+  draws->pipelines[draws->pipeline_count].pipeline = pipeline;
+  draws->pipelines[draws->pipeline_count].layout = layout;
+  return draws->pipeline_count++;
+}
+/* Add a material, returning its id */
+uint32_t vk_draws_add_material(vk_draws_t *draws, VkDescriptorSet set) {
+  ASSERT(draws->material_count < (1u << VK_DRAWS_MATERIAL_BITS));
+  draws->materials = (VkDescriptorSet *)realloc(
+      draws->materials,
+      sizeof(VkDescriptorSet) * (draws->material_count + 1)
+  );
+  ASSERT(draws->materials);
+  draws->materials[draws->material_count] = set;
+  return draws->material_count++;
+}
+/* Add a mesh, returning its id */
+uint32_t vk_draws_add_mesh(vk_draws_t *draws, const vk_draws_mesh_t *mesh) {
+  ASSERT(draws->mesh_count < (1u << VK_DRAWS_MESH_BITS));
+  draws->meshes = (vk_draws_mesh_t *)realloc(
+      draws->meshes,
+      sizeof(vk_draws_mesh_t) * (draws->mesh_count + 1)
+  );
+  ASSERT(draws->meshes);
+  draws->meshes[draws->mesh_count] = *mesh;
+  return draws->mesh_count++;
+}
+/* Forget the last frame's packets */
+void vk_draws_begin(vk_draws_t *draws) {
+  atomic_store(&draws->packet_count, 0);
+  draws->batch_count = 0;
+  memset(draws->pass_first, 0, sizeof(draws->pass_first));
+}
+/* Push a packet (depth from 0 near to 1 far; thread safe) */
+void vk_draws_push(
+    vk_draws_t *draws,
+    const vk_draws_packet_t *packet,
+    float depth
+) {
+  uint32_t index = atomic_fetch_add(&draws->packet_count, 1);
+  ASSERT(index < draws->max_packets);
+  ASSERT(packet->pass < draws->pass_count);
+  ASSERT(packet->pipeline < draws->pipeline_count);
+  ASSERT(packet->material < draws->material_count);
+  ASSERT(packet->mesh < draws->mesh_count);
+  draws->packets[index] = *packet;
+  draws->keys[index].key = packet_key(draws, packet, depth);
+  draws->keys[index].value = index;
+}
+/* Sort and merge the packets into batches (jobs may be NULL) */
+void vk_draws_sort(vk_draws_t *draws, jobs_t *jobs) {
+  double start = time_now();
+  uint32_t count = atomic_load(&draws->packet_count), batch = 0;
+  bind_state_t states[VK_DRAWS_MAX_PASSES];
+  const radix_item_t *sorted;
+
+  /* State changes of recording each packet as pushed, pass by pass */
+  memset(states, 0, sizeof(states));
+  memset(&draws->unsorted, 0, sizeof(vk_draws_stats_t));
+  for (uint32_t i = 0; i < count; i++) {
+    const vk_draws_packet_t *packet = &draws->packets[i];
+    vk_draws_batch_t single = {
+      packet->pass, packet->pipeline, packet->material, packet->mesh, i, 1
+    };
+    draw_batch(
+        draws,
+        &states[packet->pass],
+        VK_NULL_HANDLE,
+        &single,
+        &draws->unsorted
+    );
+  }
+
+  /* Merge runs of packets with the same state into instanced draws */
+  sorted = radix_sort(jobs, draws->keys, draws->scratch, count);
+  draws->batch_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const vk_draws_packet_t *packet = &draws->packets[sorted[i].value];
+    vk_draws_batch_t *last = draws->batch_count > 0
+      ? &draws->batches[draws->batch_count - 1] : NULL;
+    draws->instances[i] = packet->instance;
+    if (
+        last && last->pass == packet->pass &&
+        last->pipeline == packet->pipeline &&
+        last->material == packet->material &&
+        last->mesh == packet->mesh
+    ) {
+      last->instance_count++;
+      continue;
+    }
+    last = &draws->batches[draws->batch_count++];
+    last->pass = packet->pass;
+    last->pipeline = packet->pipeline;
+    last->material = packet->material;
+    last->mesh = packet->mesh;
+    last->first_instance = i;
+    last->instance_count = 1;
+  }
+  for (uint32_t pass = 0; pass <= VK_DRAWS_MAX_PASSES; pass++) {
+    while (
+        batch < draws->batch_count && draws->batches[batch].pass < pass
+    ) batch++;
+    draws->pass_first[pass] = batch;
+  }
+
+  /* State changes of recording the batches */
+  memset(states, 0, sizeof(states));
+  memset(&draws->sorted, 0, sizeof(vk_draws_stats_t));
+  for (uint32_t i = 0; i < draws->batch_count; i++) {
+    draw_batch(
+        draws,
+        &states[draws->batches[i].pass],
+        VK_NULL_HANDLE,
+        &draws->batches[i],
+        &draws->sorted
+    );
+  }
+
+  telemetry_report("draws.sort", TELEMETRY_TIMING, (time_now() - start) * 1e3);
+  telemetry_report("draws.packets", TELEMETRY_GAUGE, count);
+  report_stats("unsorted", &draws->unsorted);
+  report_stats("sorted", &draws->sorted);
+}
+/* Record a pass's batches */
+void vk_draws_record(
+    const vk_draws_t *draws,
+    VkCommandBuffer cmd,
+    uint32_t pass
+) {
+  bind_state_t state;
+  vk_draws_stats_t stats;
+  ASSERT(pass < VK_DRAWS_MAX_PASSES);
+  memset(&state, 0, sizeof(state));
+  memset(&stats, 0, sizeof(stats));
+  for (
+      uint32_t i = draws->pass_first[pass];
+      i < draws->pass_first[pass + 1];
+      i++
+  ) draw_batch(draws, &state, cmd, &draws->batches[i], &stats);
+}
+/* Destroy draw packets */
+void vk_draws_destroy(vk_draws_t *draws) {
+  free(draws->packets);
+  free(draws->keys);
+  free(draws->scratch);
+  free(draws->instances);
+  free(draws->batches);
+  free(draws->pipelines);
+  free(draws->materials);
+  free(draws->meshes);
+  memset(draws, 0, sizeof(vk_draws_t));
+}
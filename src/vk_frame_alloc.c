@@ -0,0 +1,154 @@
+/* Implements vk_frame_alloc.h */
+#include <vk_frame_alloc.h>
+#include <vk_capture.h>
+#include <telemetry.h>
+
+/* Fraction of a device local, host visible heap the allocator may take */
+#define VK_FRAME_ALLOC_HEAP_SHARE 4u
+/* Alignment of vertex and index data */
+#define VK_FRAME_ALLOC_MIN_ALIGNMENT 16u
+
+/* Round up to a power of two alignment */
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+/* Check for a device local, host visible memory type with room to spare */
+static bool has_rebar(
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize size
+) {
+  const VkPhysicalDeviceMemoryProperties *properties =
+    &phys_dev_info->memory_properties;
+  const VkMemoryPropertyFlags flags =
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+    const VkMemoryType *type = &properties->memoryTypes[i];
+    if ((type->propertyFlags & flags) != flags) continue;
+    if (
+        properties->memoryHeaps[type->heapIndex].size
+        / VK_FRAME_ALLOC_HEAP_SHARE >= size
+    ) return true;
+  }
+  return false;
+}
+
+/* Create a per-frame allocator with frame_size bytes per frame */
+void vk_frame_alloc_create(
+    vk_frame_alloc_t *alloc,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize frame_size,
+    uint32_t frame_count
+) {
+  const VkPhysicalDeviceLimits *limits = &phys_dev_info->properties.limits;
+  VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  VkMemoryPropertyFlags preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  ASSERT(frame_count > 0);
+  memset(alloc, 0, sizeof(vk_frame_alloc_t));
+
+  /* Align every allocation for dynamic uniform and storage offsets */
+  alloc->alignment = VK_FRAME_ALLOC_MIN_ALIGNMENT;
+  if (limits->minUniformBufferOffsetAlignment > alloc->alignment)
+    alloc->alignment = limits->minUniformBufferOffsetAlignment;
+  if (limits->minStorageBufferOffsetAlignment > alloc->alignment)
+    alloc->alignment = limits->minStorageBufferOffsetAlignment;
+  alloc->atom_size = limits->nonCoherentAtomSize;
+  if (alloc->atom_size == 0) alloc->atom_size = 1;
+
+  /* Frames start on flushable boundaries */
+  alloc->frame_size = align_up(frame_size, alloc->alignment);
+  alloc->frame_size = align_up(alloc->frame_size, alloc->atom_size);
+  alloc->frame_count = frame_count;
+
+  /* Write straight into VRAM when the whole of it is mappable */
+  if (has_rebar(phys_dev_info, alloc->frame_size * frame_count)) {
+    required |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  }
+  alloc->buffer = vk_buf_create(
+      dev,
+      phys_dev_info,
+      alloc->frame_size * frame_count,
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+      | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+      | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+      | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      required,
+      preferred
+  );
+  alloc->coherent =
+    (alloc->buffer.memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+  atomic_init(&alloc->head, 0);
+
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Frame allocator: %u x %.1f KB, %s%s",
+      frame_count,
+      (double)alloc->frame_size / 1024.0,
+      (required & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        ? "device local" : "host",
+      alloc->coherent ? "" : ", non-coherent"
+  );
+}
+/* Start allocating from a frame's region (once the GPU is done with it) */
+void vk_frame_alloc_begin(vk_frame_alloc_t *alloc, uint32_t frame) {
+  VkDeviceSize used = atomic_exchange(&alloc->head, 0);
+  ASSERT(frame < alloc->frame_count);
+  if (used > alloc->frame_size) used = alloc->frame_size;
+  telemetry_report("frame_alloc.used", TELEMETRY_GAUGE, (double)used);
+  alloc->frame = frame;
+}
+/* Allocate from the current frame (thread safe, false if the frame is full) */
+bool vk_frame_alloc(
+    vk_frame_alloc_t *alloc,
+    VkDeviceSize size,
+    vk_frame_alloc_range_t *range
+) {
+  VkDeviceSize offset;
+
+  /* Sizes stay aligned, so every offset is too */
+  size = align_up(size, alloc->alignment);
+  offset = atomic_fetch_add(&alloc->head, size);
+  if (size == 0 || offset + size > alloc->frame_size) {
+    telemetry_report("frame_alloc.overflows", TELEMETRY_COUNTER, 1.0);
+    return false;
+  }
+
+  offset += (VkDeviceSize)alloc->frame * alloc->frame_size;
+  range->buffer = alloc->buffer.buffer;
+  range->offset = offset;
+  range->ptr = (uint8_t *)alloc->buffer.mapped + offset;
+  return true;
+}
+/* Make the current frame's writes visible to the device */
+void vk_frame_alloc_flush(vk_frame_alloc_t *alloc, vk_dev_t *dev) {
+  VkMappedMemoryRange memory_range;
+  VkDeviceSize used;
+
+  used = atomic_load(&alloc->head);
+  if (used == 0) return;
+  if (used > alloc->frame_size) used = alloc->frame_size;
+  /* Captures snapshot the frame's data as the device will see it */
+  if (vk_capture_active()) vk_capture_buffer_data(
+      alloc->buffer.buffer,
+      (VkDeviceSize)alloc->frame * alloc->frame_size,
+      used,
+      (const uint8_t *)alloc->buffer.mapped
+      + (size_t)alloc->frame * alloc->frame_size
+  );
+  if (alloc->coherent) return;
+
+  /* One range covers every allocation of the frame */
+  memory_range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  memory_range.pNext = NULL;
+  memory_range.memory = alloc->buffer.memory;
+  memory_range.offset = (VkDeviceSize)alloc->frame * alloc->frame_size;
+  memory_range.size = align_up(used, alloc->atom_size);
+  VK_CHECK(vkFlushMappedMemoryRanges(dev->device, 1, &memory_range));
+}
+/* Destroy a per-frame allocator */
+void vk_frame_alloc_destroy(vk_frame_alloc_t *alloc, vk_dev_t *dev) {
+  vk_buf_destroy(&alloc->buffer, dev);
+  memset(alloc, 0, sizeof(vk_frame_alloc_t));
+}
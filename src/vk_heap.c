@@ -0,0 +1,668 @@
+/* Implements vk_heap.h */
+#include <vk_heap.h>
+#include <telemetry.h>
+
+/* Types */
+/* Allocation that could be moved */
+typedef struct {
+  uint32_t id;
+  VkDeviceSize offset;
+} candidate_t;
+
+/* Round up to an alignment */
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+/* Sort candidates, highest offset first */
+static int compare_candidates(const void *a, const void *b) {
+  const candidate_t *ca = (const candidate_t *)a;
+  const candidate_t *cb = (const candidate_t *)b;
+  if (ca->offset != cb->offset) return ca->offset > cb->offset ? -1 : 1;
+  return 0;
+}
+/* Insert a free range at an index of a block's free list */
+static void range_insert(
+    vk_heap_block_t *block,
+    uint32_t index,
+    VkDeviceSize offset,
+    VkDeviceSize size
+) {
+  if (block->free_count == block->free_capacity) {
+    block->free_capacity =
+      block->free_capacity ? block->free_capacity * 2 : 16;
+    block->free_ranges = (vk_heap_range_t *)realloc(
+        block->free_ranges,
+        sizeof(vk_heap_range_t) * block->free_capacity
+    );
+    ASSERT(block->free_ranges);
+  }
+  memmove(
+      &block->free_ranges[index + 1],
+      &block->free_ranges[index],
+      sizeof(vk_heap_range_t) * (block->free_count - index)
+  );
+  block->free_ranges[index].offset = offset;
+  block->free_ranges[index].size = size;
+  block->free_count++;
+}
+/* Remove the free range at an index of a block's free list */
+static void range_remove(vk_heap_block_t *block, uint32_t index) {
+  memmove(
+      &block->free_ranges[index],
+      &block->free_ranges[index + 1],
+      sizeof(vk_heap_range_t) * (block->free_count - index - 1)
+  );
+  block->free_count--;
+}
+/* Take the first free range that fits and ends by max_end (false if none) */
+static bool range_take(
+    vk_heap_block_t *block,
+    VkDeviceSize size,
+    VkDeviceSize alignment,
+    VkDeviceSize max_end,
+    VkDeviceSize *offset
+) {
+  for (uint32_t i = 0; i < block->free_count; i++) {
+    vk_heap_range_t *range = &block->free_ranges[i];
+    VkDeviceSize start = align_up(range->offset, alignment);
+    VkDeviceSize end = range->offset + range->size;
+    if (range->offset >= max_end) break;
+    if (start + size > end || start + size > max_end) continue;
+
+    /* Keep the padding before and the rest after as free ranges */
+    if (start + size < end) {
+      if (start > range->offset) {
+        range->size = start - range->offset;
+        range_insert(block, i + 1, start + size, end - start - size);
+      } else {
+        range->offset = start + size;
+        range->size = end - range->offset;
+      }
+    } else if (start > range->offset) {
+      range->size = start - range->offset;
+    } else {
+      range_remove(block, i);
+    }
+    block->used += size;
+    *offset = start;
+    return true;
+  }
+  return false;
+}
+/* Return a range to a block's free list, merging it with its neighbours */
+static void range_give(
+    vk_heap_block_t *block,
+    VkDeviceSize offset,
+    VkDeviceSize size
+) {
+  uint32_t index = 0;
+  bool merged = false;
+  while (
+      index < block->free_count
+      && block->free_ranges[index].offset < offset
+  ) index++;
+  block->used -= size;
+
+  if (index > 0) {
+    vk_heap_range_t *before = &block->free_ranges[index - 1];
+    if (before->offset + before->size == offset) {
+      before->size += size;
+      merged = true;
+    }
+  }
+  if (index < block->free_count) {
+    vk_heap_range_t *after = &block->free_ranges[index];
+    if (offset + size == after->offset) {
+      if (merged) {
+        block->free_ranges[index - 1].size += after->size;
+        range_remove(block, index);
+      } else {
+        after->offset = offset;
+        after->size += size;
+        merged = true;
+      }
+    }
+  }
+  if (!merged) range_insert(block, index, offset, size);
+}
+/* Create a block in an unused slot (false if out of device memory) */
+static bool create_block(vk_heap_t *heap, uint32_t index, VkDeviceSize size) {
+  vk_heap_block_t *block = &heap->blocks[index];
+  VkBufferCreateInfo buffer_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryAllocateFlagsInfo flags_info;
+  VkBufferDeviceAddressInfo address_info;
+  VkMemoryRequirements requirements;
+  bool addresses =
+    (heap->usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0;
+
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.pNext = NULL;
+  buffer_info.flags = 0;
+  buffer_info.size = size;
+  buffer_info.usage = heap->usage;
+  buffer_info.sharingMode = heap->family_count > 1
+    ? VK_SHARING_MODE_CONCURRENT
+    : VK_SHARING_MODE_EXCLUSIVE;
+  buffer_info.queueFamilyIndexCount = heap->family_count;
+  buffer_info.pQueueFamilyIndices = heap->families;
+  VK_CHECK(vkCreateBuffer(
+        heap->dev->device,
+        &buffer_info,
+        NULL,
+        &block->buffer
+  ));
+
+  /* Every block shares the first block's memory type */
+  vkGetBufferMemoryRequirements(
+      heap->dev->device,
+      block->buffer,
+      &requirements
+  );
+  if (heap->memory_type == UINT32_MAX) {
+    heap->memory_type = vk_phys_dev_find_memory_type(
+        heap->phys_dev_info,
+        requirements.memoryTypeBits,
+        heap->required,
+        0
+    );
+  }
+  ASSERT(heap->memory_type != UINT32_MAX);
+  ASSERT(requirements.memoryTypeBits & (1u << heap->memory_type));
+  flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+  flags_info.pNext = NULL;
+  flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+  flags_info.deviceMask = 0;
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = addresses ? &flags_info : NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = heap->memory_type;
+  if (vkAllocateMemory(
+        heap->dev->device,
+        &alloc_info,
+        NULL,
+        &block->memory
+  ) != VK_SUCCESS) {
+    vkDestroyBuffer(heap->dev->device, block->buffer, NULL);
+    memset(block, 0, sizeof(vk_heap_block_t));
+    return false;
+  }
+  VK_CHECK(vkBindBufferMemory(
+        heap->dev->device,
+        block->buffer,
+        block->memory,
+        0
+  ));
+  if (addresses) {
+    address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    address_info.pNext = NULL;
+    address_info.buffer = block->buffer;
+    block->address = vkGetBufferDeviceAddress(
+        heap->dev->device,
+        &address_info
+    );
+  }
+
+  /* All of it starts free */
+  block->size = size;
+  block->used = 0;
+  block->free_count = 0;
+  range_insert(block, 0, 0, size);
+  return true;
+}
+/* Destroy a block, leaving its slot unused */
+static void destroy_block(vk_heap_t *heap, uint32_t index) {
+  vk_heap_block_t *block = &heap->blocks[index];
+  vkDestroyBuffer(heap->dev->device, block->buffer, NULL);
+  vkFreeMemory(heap->dev->device, block->memory, NULL);
+  free(block->free_ranges);
+  memset(block, 0, sizeof(vk_heap_block_t));
+}
+/* Free a range once no frame in flight can reference it */
+static void retire_range(
+    vk_heap_t *heap,
+    uint32_t block,
+    VkDeviceSize offset,
+    VkDeviceSize size
+) {
+  vk_heap_retired_t *retired;
+  if (heap->retired_count == heap->retired_capacity) {
+    heap->retired_capacity =
+      heap->retired_capacity ? heap->retired_capacity * 2 : 64;
+    heap->retired = (vk_heap_retired_t *)realloc(
+        heap->retired,
+        sizeof(vk_heap_retired_t) * heap->retired_capacity
+    );
+    ASSERT(heap->retired);
+  }
+  retired = &heap->retired[heap->retired_count++];
+  retired->block = block;
+  retired->range.offset = offset;
+  retired->range.size = size;
+  retired->retire_frame = heap->frame_counter + heap->frames_in_flight;
+}
+/* Make an allocation id available again */
+static void release_id(vk_heap_t *heap, uint32_t id) {
+  memset(&heap->allocations[id], 0, sizeof(vk_heap_allocation_t));
+  heap->free_ids[heap->free_id_count++] = id;
+}
+/* Switch moved allocations to their new ranges */
+static void finish_moves(vk_heap_t *heap) {
+  VkDeviceSize moved = 0;
+  for (uint32_t i = 0; i < heap->move_count; i++) {
+    const vk_heap_move_t *move = &heap->moves[i];
+    vk_heap_allocation_t *allocation = &heap->allocations[move->id];
+    retire_range(heap, allocation->block, allocation->offset, allocation->size);
+    if (!allocation->active) {
+      /* Freed while moving */
+      retire_range(heap, move->block, move->offset, allocation->size);
+      release_id(heap, move->id);
+      continue;
+    }
+    allocation->block = move->block;
+    allocation->offset = move->offset;
+    allocation->moving = false;
+    moved += allocation->size;
+    allocation->moved(allocation->user, move->id);
+  }
+  telemetry_report(
+      "defrag.batch",
+      TELEMETRY_TIMING,
+      (time_now() - heap->defrag_start) * 1e3
+  );
+  telemetry_report("defrag.moves", TELEMETRY_COUNTER, heap->move_count);
+  telemetry_report(
+      "defrag.moved_mb",
+      TELEMETRY_COUNTER,
+      (double)moved / (1024.0 * 1024.0)
+  );
+  telemetry_report(
+      "defrag.fragmentation_after",
+      TELEMETRY_GAUGE,
+      vk_heap_fragmentation(heap)
+  );
+  heap->move_count = 0;
+}
+/* Pick allocations to move, emptiest blocks first, up to max_bytes */
+static void plan_moves(vk_heap_t *heap, VkDeviceSize max_bytes) {
+  uint32_t order[VK_HEAP_MAX_BLOCKS], block_count = 0;
+  candidate_t *candidates;
+  VkDeviceSize planned = 0;
+
+  /* Blocks from emptiest to fullest */
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++) {
+    uint32_t j = block_count;
+    if (!heap->blocks[i].memory) continue;
+    block_count++;
+    while (j > 0 && heap->blocks[order[j - 1]].used > heap->blocks[i].used) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  candidates = (candidate_t *)malloc(
+      sizeof(candidate_t) * (heap->allocation_count + 1)
+  );
+  ASSERT(candidates);
+  for (uint32_t s = 0; s < block_count; s++) {
+    uint32_t source = order[s], candidate_count = 0;
+
+    /* Movable allocations of the block, from the top down */
+    for (uint32_t i = 0; i < heap->allocation_count; i++) {
+      const vk_heap_allocation_t *allocation = &heap->allocations[i];
+      if (
+          !allocation->active
+          || !allocation->moved
+          || allocation->moving
+          || allocation->block != source
+      ) continue;
+      candidates[candidate_count].id = i;
+      candidates[candidate_count].offset = allocation->offset;
+      candidate_count++;
+    }
+    qsort(
+        candidates,
+        candidate_count,
+        sizeof(candidate_t),
+        compare_candidates
+    );
+
+    for (uint32_t c = 0; c < candidate_count; c++) {
+      vk_heap_allocation_t *allocation = &heap->allocations[candidates[c].id];
+      vk_heap_move_t *move = &heap->moves[heap->move_count];
+      bool found = false;
+      if (allocation->size > max_bytes - planned) continue;
+
+      /* Into a fuller block, fullest first, else lower in its own */
+      for (uint32_t d = block_count - 1; d > s && !found; d--) {
+        found = range_take(
+            &heap->blocks[order[d]],
+            allocation->size,
+            allocation->alignment,
+            heap->blocks[order[d]].size,
+            &move->offset
+        );
+        move->block = order[d];
+      }
+      if (!found) {
+        found = range_take(
+            &heap->blocks[source],
+            allocation->size,
+            allocation->alignment,
+            allocation->offset,
+            &move->offset
+        );
+        move->block = source;
+      }
+      if (!found) continue;
+      move->id = candidates[c].id;
+      allocation->moving = true;
+      planned += allocation->size;
+      if (++heap->move_count == VK_HEAP_MAX_MOVES) break;
+    }
+    if (heap->move_count == VK_HEAP_MAX_MOVES || planned == max_bytes) break;
+  }
+  free(candidates);
+}
+/* Record and enqueue the copies of the planned moves */
+static void submit_moves(vk_heap_t *heap, vk_sync_point_t after) {
+  VkCommandBufferBeginInfo begin_info;
+  vk_submit_semaphore_t wait;
+  vk_submission_t submission;
+
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(heap->cmd, 0));
+  VK_CHECK(vkBeginCommandBuffer(heap->cmd, &begin_info));
+  for (uint32_t i = 0; i < heap->move_count; i++) {
+    const vk_heap_move_t *move = &heap->moves[i];
+    const vk_heap_allocation_t *allocation = &heap->allocations[move->id];
+    VkBufferCopy region;
+    region.srcOffset = allocation->offset;
+    region.dstOffset = move->offset;
+    region.size = allocation->size;
+    vkCmdCopyBuffer(
+        heap->cmd,
+        heap->blocks[allocation->block].buffer,
+        heap->blocks[move->block].buffer,
+        1,
+        &region
+    );
+  }
+  VK_CHECK(vkEndCommandBuffer(heap->cmd));
+
+  submission.command_buffers = &heap->cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = &wait;
+  submission.wait_count = after.timeline ? 1 : 0;
+  submission.signals = NULL;
+  submission.signal_count = 0;
+  submission.fence = VK_NULL_HANDLE;
+  if (after.timeline) {
+    wait.semaphore = after.timeline->semaphore;
+    wait.value = after.value;
+    wait.stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+  }
+  heap->copied =
+    vk_submit_enqueue(heap->submit, VK_SUBMIT_TRANSFER, &submission);
+}
+
+/* Create a sub-allocator of buffers with a usage, in blocks of block_size */
+void vk_heap_create(
+    vk_heap_t *heap,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_submit_t *submit,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags required,
+    VkDeviceSize block_size,
+    uint32_t frames_in_flight
+) {
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo alloc_info;
+  uint32_t copy_family;
+
+  ASSERT(block_size > 0 && frames_in_flight > 0);
+  memset(heap, 0, sizeof(vk_heap_t));
+  heap->dev = dev;
+  heap->phys_dev_info = phys_dev_info;
+  heap->submit = submit;
+  heap->usage = usage
+    | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+    | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  heap->required = required;
+  heap->memory_type = UINT32_MAX;
+  heap->block_size = block_size;
+  heap->frames_in_flight = frames_in_flight;
+
+  /* Moves run on whichever queue vk_submit gives transfer work to */
+  heap->families[0] = phys_dev_info->queue_families.graphics_index;
+  heap->family_count = 1;
+  if (dev->transfer_queue_count > 0)
+    copy_family = phys_dev_info->queue_families.transfer_index;
+  else if (dev->compute_queue_count > 0)
+    copy_family = phys_dev_info->queue_families.compute_index;
+  else
+    copy_family = heap->families[0];
+  if (copy_family != heap->families[0])
+    heap->families[heap->family_count++] = copy_family;
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = copy_family;
+  VK_CHECK(vkCreateCommandPool(
+        dev->device,
+        &pool_info,
+        NULL,
+        &heap->command_pool
+  ));
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.commandPool = heap->command_pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(dev->device, &alloc_info, &heap->cmd));
+}
+/* Allocate a range (VK_HEAP_INVALID on failure, moved may be NULL) */
+uint32_t vk_heap_alloc(
+    vk_heap_t *heap,
+    VkDeviceSize size,
+    VkDeviceSize alignment,
+    vk_heap_moved_fn_t moved,
+    void *user
+) {
+  vk_heap_allocation_t *allocation;
+  VkDeviceSize offset = 0;
+  uint32_t block = VK_HEAP_MAX_BLOCKS, unused = VK_HEAP_MAX_BLOCKS;
+  uint32_t id;
+  bool taken;
+
+  ASSERT(size > 0);
+  if (alignment < VK_HEAP_MIN_ALIGNMENT) alignment = VK_HEAP_MIN_ALIGNMENT;
+
+  /* First fit in an existing block, else a new one */
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++) {
+    vk_heap_block_t *candidate = &heap->blocks[i];
+    if (!candidate->memory) {
+      if (unused == VK_HEAP_MAX_BLOCKS) unused = i;
+      continue;
+    }
+    if (range_take(candidate, size, alignment, candidate->size, &offset)) {
+      block = i;
+      break;
+    }
+  }
+  if (block == VK_HEAP_MAX_BLOCKS) {
+    VkDeviceSize block_size =
+      size > heap->block_size ? align_up(size, alignment) : heap->block_size;
+    if (
+        unused == VK_HEAP_MAX_BLOCKS
+        || !create_block(heap, unused, block_size)
+    ) {
+      telemetry_report("heap.alloc_failures", TELEMETRY_COUNTER, 1.0);
+      return VK_HEAP_INVALID;
+    }
+    block = unused;
+    taken = range_take(
+        &heap->blocks[block],
+        size,
+        alignment,
+        block_size,
+        &offset
+    );
+    ASSERT(taken);
+  }
+
+  /* Name it */
+  if (heap->free_id_count > 0) {
+    id = heap->free_ids[--heap->free_id_count];
+  } else {
+    if (heap->allocation_count == heap->allocation_capacity) {
+      heap->allocation_capacity =
+        heap->allocation_capacity ? heap->allocation_capacity * 2 : 256;
+      heap->allocations = (vk_heap_allocation_t *)realloc(
+          heap->allocations,
+          sizeof(vk_heap_allocation_t) * heap->allocation_capacity
+      );
+      heap->free_ids = (uint32_t *)realloc(
+          heap->free_ids,
+          sizeof(uint32_t) * heap->allocation_capacity
+      );
+      ASSERT(heap->allocations && heap->free_ids);
+    }
+    id = heap->allocation_count++;
+  }
+  allocation = &heap->allocations[id];
+  allocation->moved = moved;
+  allocation->user = user;
+  allocation->block = block;
+  allocation->offset = offset;
+  allocation->size = size;
+  allocation->alignment = alignment;
+  allocation->active = true;
+  allocation->moving = false;
+  return id;
+}
+/* Free a range once no frame in flight can reference it */
+void vk_heap_free(vk_heap_t *heap, uint32_t id) {
+  vk_heap_allocation_t *allocation = &heap->allocations[id];
+  ASSERT(id < heap->allocation_count && allocation->active);
+  allocation->active = false;
+  /* A moving allocation is released when its move finishes */
+  if (allocation->moving) return;
+  retire_range(heap, allocation->block, allocation->offset, allocation->size);
+  release_id(heap, id);
+}
+/* Get the buffer an allocation is in */
+VkBuffer vk_heap_buffer(const vk_heap_t *heap, uint32_t id) {
+  ASSERT(id < heap->allocation_count && heap->allocations[id].active);
+  return heap->blocks[heap->allocations[id].block].buffer;
+}
+/* Get an allocation's offset in its buffer */
+VkDeviceSize vk_heap_offset(const vk_heap_t *heap, uint32_t id) {
+  ASSERT(id < heap->allocation_count && heap->allocations[id].active);
+  return heap->allocations[id].offset;
+}
+/* Get an allocation's device address (0 without device address usage) */
+VkDeviceAddress vk_heap_address(const vk_heap_t *heap, uint32_t id) {
+  const vk_heap_allocation_t *allocation;
+  ASSERT(id < heap->allocation_count && heap->allocations[id].active);
+  allocation = &heap->allocations[id];
+  if (!heap->blocks[allocation->block].address) return 0;
+  return heap->blocks[allocation->block].address + allocation->offset;
+}
+/* Check if an allocation is being moved (and so must not be written) */
+bool vk_heap_moving(const vk_heap_t *heap, uint32_t id) {
+  ASSERT(id < heap->allocation_count && heap->allocations[id].active);
+  return heap->allocations[id].moving;
+}
+/* Get the fragmentation of the free space (0 when it is one range) */
+double vk_heap_fragmentation(const vk_heap_t *heap) {
+  VkDeviceSize free_size = 0, largest = 0;
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++) {
+    const vk_heap_block_t *block = &heap->blocks[i];
+    for (uint32_t j = 0; j < block->free_count; j++) {
+      free_size += block->free_ranges[j].size;
+      if (block->free_ranges[j].size > largest)
+        largest = block->free_ranges[j].size;
+    }
+  }
+  return free_size > 0 ? 1.0 - (double)largest / (double)free_size : 0.0;
+}
+/* Begin a frame: free ranges and blocks no frame in flight can reference */
+void vk_heap_begin_frame(vk_heap_t *heap) {
+  uint32_t retained = 0, block_count = 0;
+  VkDeviceSize used = 0;
+
+  heap->frame_counter++;
+  for (uint32_t i = 0; i < heap->retired_count; i++) {
+    const vk_heap_retired_t *retired = &heap->retired[i];
+    if (retired->retire_frame <= heap->frame_counter) {
+      range_give(
+          &heap->blocks[retired->block],
+          retired->range.offset,
+          retired->range.size
+      );
+    } else {
+      heap->retired[retained++] = *retired;
+    }
+  }
+  heap->retired_count = retained;
+
+  /* Give empty blocks back, keeping one */
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++)
+    if (heap->blocks[i].memory) block_count++;
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS && block_count > 1; i++) {
+    if (!heap->blocks[i].memory || heap->blocks[i].used > 0) continue;
+    destroy_block(heap, i);
+    block_count--;
+  }
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++)
+    used += heap->blocks[i].used;
+  telemetry_report("heap.blocks", TELEMETRY_GAUGE, block_count);
+  telemetry_report(
+      "heap.used_mb",
+      TELEMETRY_GAUGE,
+      (double)used / (1024.0 * 1024.0)
+  );
+}
+/* Finish moves that are done, then start moving up to max_bytes more */
+void vk_heap_defrag(
+    vk_heap_t *heap,
+    VkDeviceSize max_bytes,
+    vk_sync_point_t after
+) {
+  double fragmentation;
+
+  /* One batch at a time */
+  if (heap->move_count > 0) {
+    if (!vk_sync_reached(heap->copied, heap->dev)) return;
+    finish_moves(heap);
+  }
+  fragmentation = vk_heap_fragmentation(heap);
+  if (fragmentation < VK_HEAP_DEFRAG_THRESHOLD || max_bytes == 0) return;
+
+  plan_moves(heap, max_bytes);
+  if (heap->move_count == 0) return;
+  heap->defrag_start = time_now();
+  submit_moves(heap, after);
+  telemetry_report(
+      "defrag.fragmentation_before",
+      TELEMETRY_GAUGE,
+      fragmentation
+  );
+}
+/* Destroy a sub-allocator (waits for moves) */
+void vk_heap_destroy(vk_heap_t *heap) {
+  if (heap->move_count > 0) vk_sync_wait(heap->copied, heap->dev, UINT64_MAX);
+  for (uint32_t i = 0; i < VK_HEAP_MAX_BLOCKS; i++)
+    if (heap->blocks[i].memory) destroy_block(heap, i);
+  vkDestroyCommandPool(heap->dev->device, heap->command_pool, NULL);
+  free(heap->allocations);
+  free(heap->free_ids);
+  free(heap->retired);
+  memset(heap, 0, sizeof(vk_heap_t));
+}
@@ -0,0 +1,911 @@
+/* Implements vk_hiz.h */
+#include <vk_hiz.h>
+#include <vk_dev_cache.h>
+#include <telemetry.h>
+#include <math.h>
+
+/* Cull shader uniform parameters (std140, matches hiz_cull.comp) */
+typedef struct {
+  float view[2][16];
+  float proj[2][4];
+  float frustum[4];
+} cull_params_t;
+/* Cull shader push constants */
+typedef struct {
+  uint32_t phase;
+  uint32_t instance_count;
+  uint32_t max_instances;
+} cull_push_t;
+/* Build shader push constants */
+typedef struct {
+  uint32_t size;
+  uint32_t mip_count;
+  uint32_t workgroup_count;
+} build_push_t;
+/* Draw counts and statistics (matches hiz_cull.comp) */
+typedef struct {
+  uint32_t draw_count[2];
+  uint32_t frustum_culled;
+  uint32_t occlusion_culled;
+} cull_counts_t;
+
+/* Create a compute pipeline from a SPIR-V file */
+static VkPipeline create_compute_pipeline(
+    vk_dev_t *dev,
+    const char *shader_dir,
+    const char *name,
+    VkPipelineLayout layout
+) {
+  VkShaderModuleCreateInfo module_info;
+  VkComputePipelineCreateInfo pipeline_info;
+  VkShaderModule module;
+  VkPipeline pipeline;
+  char path[512];
+  size_t size;
+  void *code;
+
+  snprintf(path, sizeof(path), "%s/%s", shader_dir, name);
+  code = read_file(path, &size);
+  if (code == NULL) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read shader %s: %s", path, strerror(errno));
+    abort();
+  }
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.pNext = NULL;
+  module_info.flags = 0;
+  module_info.codeSize = size;
+  module_info.pCode = (const uint32_t *)code;
+  VK_CHECK(vkCreateShaderModule(dev->device, &module_info, NULL, &module));
+  free(code);
+
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.pNext = NULL;
+  pipeline_info.flags = 0;
+  pipeline_info.stage.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.pNext = NULL;
+  pipeline_info.stage.flags = 0;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.stage.pSpecializationInfo = NULL;
+  pipeline_info.layout = layout;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_info.basePipelineIndex = -1;
+  VK_CHECK(vkCreateComputePipelines(
+        dev->device,
+        VK_NULL_HANDLE,
+        1,
+        &pipeline_info,
+        NULL,
+        &pipeline
+  ));
+  vkDestroyShaderModule(dev->device, module, NULL);
+  return pipeline;
+}
+/* Create a descriptor set layout */
+static VkDescriptorSetLayout create_set_layout(
+    vk_dev_t *dev,
+    const VkDescriptorType *types,
+    const uint32_t *counts,
+    uint32_t binding_count
+) {
+  VkDescriptorSetLayoutBinding bindings[8];
+  VkDescriptorSetLayoutCreateInfo layout_info;
+  ASSERT(binding_count <= 8);
+  for (uint32_t i = 0; i < binding_count; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = types[i];
+    bindings[i].descriptorCount = counts[i];
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[i].pImmutableSamplers = NULL;
+  }
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.pNext = NULL;
+  layout_info.flags = 0;
+  layout_info.bindingCount = binding_count;
+  layout_info.pBindings = bindings;
+  return vk_dev_cache_set_layout(dev, &layout_info);
+}
+/* Create a pipeline layout with one set and a push constant range */
+static VkPipelineLayout create_pipeline_layout(
+    vk_dev_t *dev,
+    VkDescriptorSetLayout set_layout,
+    uint32_t push_size
+) {
+  VkPipelineLayoutCreateInfo layout_info;
+  VkPushConstantRange push_range;
+  push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_range.offset = 0;
+  push_range.size = push_size;
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.pNext = NULL;
+  layout_info.flags = 0;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &set_layout;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_range;
+  return vk_dev_cache_pipeline_layout(dev, &layout_info);
+}
+/* Record a global memory barrier */
+static void cmd_barrier(
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags src_stage,
+    VkAccessFlags src_access,
+    VkPipelineStageFlags dst_stage,
+    VkAccessFlags dst_access
+) {
+  VkMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = src_access;
+  barrier.dstAccessMask = dst_access;
+  vkCmdPipelineBarrier(
+      cmd,
+      src_stage,
+      dst_stage,
+      0,
+      1, &barrier,
+      0, NULL,
+      0, NULL
+  );
+}
+/* Fill the camera half of the cull parameters */
+static void set_camera(
+    cull_params_t *params,
+    uint32_t slot,
+    const vk_hiz_camera_t *camera,
+    uint32_t pyramid_size
+) {
+  memcpy(params->view[slot], camera->view, sizeof(camera->view));
+  params->proj[slot][0] = camera->p00;
+  params->proj[slot][1] = camera->p11;
+  params->proj[slot][2] = camera->znear;
+  params->proj[slot][3] = (float)pyramid_size;
+}
+
+/* Create a Hi-Z occlusion culler builder */
+vk_hiz_builder_t vk_hiz_builder(void) {
+  vk_hiz_builder_t builder;
+  builder.extent.width = 0;
+  builder.extent.height = 0;
+  builder.max_instances = 0;
+  builder.frames_in_flight = 1;
+  builder.shader_dir = "bin/shaders";
+  return builder;
+}
+/* Set the depth buffer extent */
+void vk_hiz_builder_set_extent(
+    vk_hiz_builder_t *builder,
+    uint32_t width,
+    uint32_t height
+) {
+  builder->extent.width = width;
+  builder->extent.height = height;
+}
+/* Set the maximum number of culled instances */
+void vk_hiz_builder_set_max_instances(
+    vk_hiz_builder_t *builder,
+    uint32_t max_instances
+) {
+  builder->max_instances = max_instances;
+}
+/* Set the number of frames in flight */
+void vk_hiz_builder_set_frames_in_flight(
+    vk_hiz_builder_t *builder,
+    uint32_t frames_in_flight
+) {
+  builder->frames_in_flight = frames_in_flight;
+}
+/* Set the directory compiled shaders are loaded from */
+void vk_hiz_builder_set_shader_dir(
+    vk_hiz_builder_t *builder,
+    const char *shader_dir
+) {
+  builder->shader_dir = shader_dir;
+}
+/* Create a Hi-Z occlusion culler (and free builder) */
+vk_hiz_t vk_hiz_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_hiz_builder_t *builder
+) {
+  VkImageCreateInfo image_info;
+  VkImageViewCreateInfo view_info;
+  VkSamplerCreateInfo sampler_info;
+  VkSamplerReductionModeCreateInfo reduction_info;
+  VkMemoryRequirements requirements;
+  VkMemoryAllocateInfo alloc_info;
+  VkDescriptorPoolSize pool_sizes[4];
+  VkDescriptorPoolCreateInfo pool_info;
+  VkDescriptorSetAllocateInfo set_info;
+  VkDescriptorSetLayout set_layouts[2];
+  VkDescriptorSet sets[2];
+  VkQueryPoolCreateInfo query_info;
+  uint32_t largest;
+  vk_hiz_t hiz;
+
+  ASSERT(builder->extent.width > 0 && builder->extent.height > 0);
+  ASSERT(builder->max_instances > 0);
+  ASSERT(builder->frames_in_flight > 0 && builder->frames_in_flight <= 32);
+  memset(&hiz, 0, sizeof(vk_hiz_t));
+  hiz.max_instances = builder->max_instances;
+  hiz.frames_in_flight = builder->frames_in_flight;
+
+  /* Pyramid is square, the previous power of two of the depth buffer */
+  largest = builder->extent.width > builder->extent.height
+    ? builder->extent.width
+    : builder->extent.height;
+  hiz.pyramid_size = 1;
+  while (hiz.pyramid_size * 2 <= largest) hiz.pyramid_size *= 2;
+  hiz.mip_count = 1;
+  while ((hiz.pyramid_size >> hiz.mip_count) > 0) hiz.mip_count++;
+  if (hiz.mip_count > VK_HIZ_MAX_MIPS) {
+    log_msg(LOG_LEVEL_ERROR, "Depth buffer too large for Hi-Z pyramid");
+    abort();
+  }
+
+  /* Create pyramid image */
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.pNext = NULL;
+  image_info.flags = 0;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = VK_FORMAT_R32_SFLOAT;
+  image_info.extent.width = hiz.pyramid_size;
+  image_info.extent.height = hiz.pyramid_size;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = hiz.mip_count;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT
+    | VK_IMAGE_USAGE_SAMPLED_BIT
+    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT   /* Read back by tools/check_hiz */
+    | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.queueFamilyIndexCount = 0;
+  image_info.pQueueFamilyIndices = NULL;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK(vkCreateImage(dev->device, &image_info, NULL, &hiz.pyramid));
+  vkGetImageMemoryRequirements(dev->device, hiz.pyramid, &requirements);
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = vk_phys_dev_find_memory_type(
+      phys_dev_info,
+      requirements.memoryTypeBits,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  ASSERT(alloc_info.memoryTypeIndex != UINT32_MAX);
+  VK_CHECK(vkAllocateMemory(
+        dev->device,
+        &alloc_info,
+        NULL,
+        &hiz.pyramid_memory
+  ));
+  VK_CHECK(vkBindImageMemory(dev->device, hiz.pyramid, hiz.pyramid_memory, 0));
+
+  /* Create pyramid views, one for sampling and one per mip for storage */
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.pNext = NULL;
+  view_info.flags = 0;
+  view_info.image = hiz.pyramid;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = VK_FORMAT_R32_SFLOAT;
+  view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.baseMipLevel = 0;
+  view_info.subresourceRange.levelCount = hiz.mip_count;
+  view_info.subresourceRange.baseArrayLayer = 0;
+  view_info.subresourceRange.layerCount = 1;
+  VK_CHECK(vkCreateImageView(
+        dev->device,
+        &view_info,
+        NULL,
+        &hiz.pyramid_view
+  ));
+  view_info.subresourceRange.levelCount = 1;
+  for (uint32_t i = 0; i < hiz.mip_count; i++) {
+    view_info.subresourceRange.baseMipLevel = i;
+    VK_CHECK(vkCreateImageView(
+          dev->device,
+          &view_info,
+          NULL,
+          &hiz.mip_views[i]
+    ));
+  }
+
+  /* Create min reduction sampler */
+  reduction_info.sType =
+    VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO;
+  reduction_info.pNext = NULL;
+  reduction_info.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.pNext = &reduction_info;
+  sampler_info.flags = 0;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.mipLodBias = 0.0f;
+  sampler_info.anisotropyEnable = VK_FALSE;
+  sampler_info.maxAnisotropy = 1.0f;
+  sampler_info.compareEnable = VK_FALSE;
+  sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+  sampler_info.minLod = 0.0f;
+  sampler_info.maxLod = (float)VK_HIZ_MAX_MIPS;
+  sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+  sampler_info.unnormalizedCoordinates = VK_FALSE;
+  hiz.reduce_sampler = vk_dev_cache_sampler(dev, &sampler_info);
+
+  /* Create buffers */
+  hiz.params = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(cull_params_t),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0
+  );
+  hiz.instances = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(vk_hiz_instance_t) * hiz.max_instances,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+  hiz.visibility = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(uint32_t) * hiz.max_instances,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0
+  );
+  hiz.draws = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(VkDrawIndexedIndirectCommand) * hiz.max_instances * 2,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0
+  );
+  hiz.counts = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(cull_counts_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+      | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+      | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+      | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0
+  );
+  hiz.spd_counter = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0
+  );
+  hiz.readback = vk_buf_create(
+      dev, phys_dev_info,
+      sizeof(cull_counts_t) * hiz.frames_in_flight,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+  );
+
+  /* Create descriptor set layouts */
+  {
+    const VkDescriptorType build_types[3] = {
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+    const uint32_t build_counts[3] = { 1, VK_HIZ_MAX_MIPS, 1 };
+    const VkDescriptorType cull_types[6] = {
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+    const uint32_t cull_counts[6] = { 1, 1, 1, 1, 1, 1 };
+    hiz.build_set_layout = create_set_layout(dev, build_types, build_counts, 3);
+    hiz.cull_set_layout = create_set_layout(dev, cull_types, cull_counts, 6);
+  }
+  hiz.build_layout = create_pipeline_layout(
+      dev,
+      hiz.build_set_layout,
+      sizeof(build_push_t)
+  );
+  hiz.cull_layout = create_pipeline_layout(
+      dev,
+      hiz.cull_set_layout,
+      sizeof(cull_push_t)
+  );
+
+  /* Allocate descriptor sets */
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_sizes[0].descriptorCount = 2;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  pool_sizes[1].descriptorCount = VK_HIZ_MAX_MIPS;
+  pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[2].descriptorCount = 5;
+  pool_sizes[3].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_sizes[3].descriptorCount = 1;
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = 0;
+  pool_info.maxSets = 2;
+  pool_info.poolSizeCount = 4;
+  pool_info.pPoolSizes = pool_sizes;
+  VK_CHECK(vkCreateDescriptorPool(
+        dev->device,
+        &pool_info,
+        NULL,
+        &hiz.descriptor_pool
+  ));
+  set_layouts[0] = hiz.build_set_layout;
+  set_layouts[1] = hiz.cull_set_layout;
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.pNext = NULL;
+  set_info.descriptorPool = hiz.descriptor_pool;
+  set_info.descriptorSetCount = 2;
+  set_info.pSetLayouts = set_layouts;
+  VK_CHECK(vkAllocateDescriptorSets(dev->device, &set_info, sets));
+  hiz.build_set = sets[0];
+  hiz.cull_set = sets[1];
+
+  /* Write descriptors that never change */
+  {
+    VkDescriptorImageInfo mip_infos[VK_HIZ_MAX_MIPS];
+    VkDescriptorImageInfo pyramid_info;
+    VkDescriptorBufferInfo buffer_infos[6];
+    VkWriteDescriptorSet writes[8];
+    const vk_buf_t *buffers[6];
+    for (uint32_t i = 0; i < VK_HIZ_MAX_MIPS; i++) {
+      /* Unused array elements alias the smallest mip */
+      uint32_t mip = i < hiz.mip_count ? i : hiz.mip_count - 1;
+      mip_infos[i].sampler = VK_NULL_HANDLE;
+      mip_infos[i].imageView = hiz.mip_views[mip];
+      mip_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    pyramid_info.sampler = hiz.reduce_sampler;
+    pyramid_info.imageView = hiz.pyramid_view;
+    pyramid_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    buffers[0] = &hiz.spd_counter;
+    buffers[1] = &hiz.params;
+    buffers[2] = &hiz.instances;
+    buffers[3] = &hiz.visibility;
+    buffers[4] = &hiz.draws;
+    buffers[5] = &hiz.counts;
+    for (uint32_t i = 0; i < 8; i++) {
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].pNext = NULL;
+      writes[i].dstSet = hiz.cull_set;
+      writes[i].dstArrayElement = 0;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pImageInfo = NULL;
+      writes[i].pBufferInfo = NULL;
+      writes[i].pTexelBufferView = NULL;
+    }
+    for (uint32_t i = 0; i < 6; i++) {
+      buffer_infos[i].buffer = buffers[i]->buffer;
+      buffer_infos[i].offset = 0;
+      buffer_infos[i].range = VK_WHOLE_SIZE;
+    }
+    /* Build set: mips and workgroup counter (depth is set later) */
+    writes[0].dstSet = hiz.build_set;
+    writes[0].dstBinding = 1;
+    writes[0].descriptorCount = VK_HIZ_MAX_MIPS;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = mip_infos;
+    writes[1].dstSet = hiz.build_set;
+    writes[1].dstBinding = 2;
+    writes[1].pBufferInfo = &buffer_infos[0];
+    /* Cull set: parameters, pyramid and buffers */
+    writes[2].dstBinding = 0;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[2].pBufferInfo = &buffer_infos[1];
+    writes[3].dstBinding = 1;
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[3].pImageInfo = &pyramid_info;
+    for (uint32_t i = 4; i < 8; i++) {
+      writes[i].dstBinding = i - 2;
+      writes[i].pBufferInfo = &buffer_infos[i - 2];
+    }
+    vkUpdateDescriptorSets(dev->device, 8, writes, 0, NULL);
+  }
+
+  /* Create pipelines */
+  hiz.build_pipeline = create_compute_pipeline(
+      dev,
+      builder->shader_dir,
+      "hiz_build.comp.spv",
+      hiz.build_layout
+  );
+  hiz.cull_pipeline = create_compute_pipeline(
+      dev,
+      builder->shader_dir,
+      "hiz_cull.comp.spv",
+      hiz.cull_layout
+  );
+
+  /* Create timestamp queries, two per frame in flight */
+  hiz.timestamp_period = phys_dev_info->properties.limits.timestampPeriod;
+  query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  query_info.pNext = NULL;
+  query_info.flags = 0;
+  query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  query_info.queryCount = hiz.frames_in_flight * 2;
+  query_info.pipelineStatistics = 0;
+  VK_CHECK(vkCreateQueryPool(
+        dev->device,
+        &query_info,
+        NULL,
+        &hiz.timestamps
+  ));
+
+  /* Free builder */
+  memset(builder, 0, sizeof(vk_hiz_builder_t));
+
+  return hiz;
+}
+/* Set the depth buffer the pyramid is built from (GPU must be idle) */
+void vk_hiz_set_depth(
+    vk_hiz_t *hiz,
+    vk_dev_t *dev,
+    VkImageView depth_view,
+    VkImageLayout depth_layout
+) {
+  VkDescriptorImageInfo depth_info;
+  VkWriteDescriptorSet write;
+  depth_info.sampler = hiz->reduce_sampler;
+  depth_info.imageView = depth_view;
+  depth_info.imageLayout = depth_layout;
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = NULL;
+  write.dstSet = hiz->build_set;
+  write.dstBinding = 0;
+  write.dstArrayElement = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &depth_info;
+  write.pBufferInfo = NULL;
+  write.pTexelBufferView = NULL;
+  vkUpdateDescriptorSets(dev->device, 1, &write, 0, NULL);
+}
+/* Set the culled instances (GPU must be idle) */
+void vk_hiz_set_instances(
+    vk_hiz_t *hiz,
+    const vk_hiz_instance_t *instances,
+    uint32_t count
+) {
+  ASSERT(count <= hiz->max_instances);
+  memcpy(hiz->instances.mapped, instances, sizeof(vk_hiz_instance_t) * count);
+  hiz->instance_count = count;
+}
+/* Begin a frame, reporting the statistics of the slot's previous frame */
+void vk_hiz_begin_frame(
+    vk_hiz_t *hiz,
+    vk_dev_t *dev,
+    uint32_t frame_index
+) {
+  uint32_t slot = frame_index % hiz->frames_in_flight;
+  hiz->frame = slot;
+  if (!(hiz->pending_frames & (1u << slot))) return;
+  hiz->pending_frames &= ~(1u << slot);
+
+  /* Counts were copied at the end of the late phase */
+  {
+    const cull_counts_t *counts =
+      (const cull_counts_t *)hiz->readback.mapped + slot;
+    uint32_t culled = counts->frustum_culled + counts->occlusion_culled;
+    hiz->stats.early_drawn = counts->draw_count[VK_HIZ_PHASE_EARLY];
+    hiz->stats.late_drawn = counts->draw_count[VK_HIZ_PHASE_LATE];
+    hiz->stats.frustum_culled = counts->frustum_culled;
+    hiz->stats.occlusion_culled = counts->occlusion_culled;
+    if (hiz->stats.instance_count > 0)
+      telemetry_report(
+          "hiz.culled_ratio",
+          TELEMETRY_GAUGE,
+          (double)culled / (double)hiz->stats.instance_count
+      );
+  }
+  /* Pyramid build time */
+  if (hiz->timestamp_period > 0.0f) {
+    uint64_t ticks[2];
+    VkResult result = vkGetQueryPoolResults(
+        dev->device,
+        hiz->timestamps,
+        slot * 2,
+        2,
+        sizeof(ticks),
+        ticks,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+    if (result == VK_SUCCESS) {
+      hiz->stats.pyramid_build_ms =
+        (double)(ticks[1] - ticks[0]) * hiz->timestamp_period / 1e6;
+      telemetry_report(
+          "hiz.pyramid_build",
+          TELEMETRY_TIMING,
+          hiz->stats.pyramid_build_ms
+      );
+    }
+  }
+}
+/* Record the early culling phase */
+void vk_hiz_cmd_cull_early(
+    vk_hiz_t *hiz,
+    VkCommandBuffer cmd,
+    const vk_hiz_camera_t *camera
+) {
+  cull_params_t params;
+  cull_push_t push;
+  float len_x = sqrtf(camera->p00 * camera->p00 + 1.0f);
+  float len_y = sqrtf(camera->p11 * camera->p11 + 1.0f);
+
+  /* Occlusion is tested from the camera the pyramid was rendered with */
+  set_camera(
+      &params,
+      0,
+      hiz->has_last_camera ? &hiz->last_camera : camera,
+      hiz->pyramid_size
+  );
+  set_camera(&params, 1, camera, hiz->pyramid_size);
+  params.frustum[0] = camera->p00 / len_x;
+  params.frustum[1] = 1.0f / len_x;
+  params.frustum[2] = camera->p11 / len_y;
+  params.frustum[3] = 1.0f / len_y;
+  hiz->last_camera = *camera;
+  hiz->has_last_camera = true;
+  hiz->stats.instance_count = hiz->instance_count;
+
+  /* Previous frame's reads and indirect draws must be finished */
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+      | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+      | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT
+  );
+  /* Clear the pyramid to the far plane on first use */
+  if (!hiz->pyramid_initialized) {
+    VkImageMemoryBarrier barrier;
+    VkClearColorValue far_plane;
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = hiz->pyramid;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = hiz->mip_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, NULL,
+        0, NULL,
+        1, &barrier
+    );
+    memset(&far_plane, 0, sizeof(far_plane));
+    vkCmdClearColorImage(
+        cmd,
+        hiz->pyramid,
+        VK_IMAGE_LAYOUT_GENERAL,
+        &far_plane,
+        1,
+        &barrier.subresourceRange
+    );
+    hiz->pyramid_initialized = true;
+  }
+  vkCmdUpdateBuffer(cmd, hiz->params.buffer, 0, sizeof(params), &params);
+  vkCmdFillBuffer(cmd, hiz->counts.buffer, 0, VK_WHOLE_SIZE, 0);
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_UNIFORM_READ_BIT
+      | VK_ACCESS_SHADER_READ_BIT
+      | VK_ACCESS_SHADER_WRITE_BIT
+  );
+
+  /* Cull */
+  push.phase = VK_HIZ_PHASE_EARLY;
+  push.instance_count = hiz->instance_count;
+  push.max_instances = hiz->max_instances;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz->cull_pipeline);
+  vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      hiz->cull_layout,
+      0, 1, &hiz->cull_set,
+      0, NULL
+  );
+  vkCmdPushConstants(
+      cmd,
+      hiz->cull_layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(push),
+      &push
+  );
+  vkCmdDispatch(cmd, (hiz->instance_count + 63) / 64, 1, 1);
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+      | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+      | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+      | VK_ACCESS_SHADER_READ_BIT
+      | VK_ACCESS_SHADER_WRITE_BIT
+  );
+}
+/* Record the depth pyramid build */
+void vk_hiz_cmd_build_pyramid(vk_hiz_t *hiz, VkCommandBuffer cmd) {
+  build_push_t push;
+  uint32_t groups = (hiz->pyramid_size + 63) / 64;
+
+  /* Early phase sampling must be finished before the pyramid is written */
+  vkCmdResetQueryPool(cmd, hiz->timestamps, hiz->frame * 2, 2);
+  vkCmdFillBuffer(cmd, hiz->spd_counter.buffer, 0, VK_WHOLE_SIZE, 0);
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+  );
+  vkCmdWriteTimestamp(
+      cmd,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      hiz->timestamps,
+      hiz->frame * 2
+  );
+
+  /* Single dispatch, the last workgroup reduces the tail mips */
+  push.size = hiz->pyramid_size;
+  push.mip_count = hiz->mip_count;
+  push.workgroup_count = groups * groups;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz->build_pipeline);
+  vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      hiz->build_layout,
+      0, 1, &hiz->build_set,
+      0, NULL
+  );
+  vkCmdPushConstants(
+      cmd,
+      hiz->build_layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(push),
+      &push
+  );
+  vkCmdDispatch(cmd, push.workgroup_count, 1, 1);
+  vkCmdWriteTimestamp(
+      cmd,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      hiz->timestamps,
+      hiz->frame * 2 + 1
+  );
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT
+  );
+}
+/* Record the late culling phase */
+void vk_hiz_cmd_cull_late(vk_hiz_t *hiz, VkCommandBuffer cmd) {
+  cull_push_t push;
+  VkBufferCopy region;
+
+  /* Re-test the instances the early phase found occluded */
+  push.phase = VK_HIZ_PHASE_LATE;
+  push.instance_count = hiz->instance_count;
+  push.max_instances = hiz->max_instances;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz->cull_pipeline);
+  vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      hiz->cull_layout,
+      0, 1, &hiz->cull_set,
+      0, NULL
+  );
+  vkCmdPushConstants(
+      cmd,
+      hiz->cull_layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(push),
+      &push
+  );
+  vkCmdDispatch(cmd, (hiz->instance_count + 63) / 64, 1, 1);
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+      | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+      | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+      | VK_ACCESS_SHADER_READ_BIT
+      | VK_ACCESS_TRANSFER_READ_BIT
+  );
+
+  /* Copy counts for vk_hiz_begin_frame */
+  region.srcOffset = 0;
+  region.dstOffset = sizeof(cull_counts_t) * hiz->frame;
+  region.size = sizeof(cull_counts_t);
+  vkCmdCopyBuffer(cmd, hiz->counts.buffer, hiz->readback.buffer, 1, &region);
+  cmd_barrier(
+      cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      VK_ACCESS_HOST_READ_BIT
+  );
+  hiz->pending_frames |= 1u << hiz->frame;
+}
+/* Record the indirect draws of a phase (pipeline and buffers bound) */
+void vk_hiz_cmd_draw(
+    vk_hiz_t *hiz,
+    VkCommandBuffer cmd,
+    vk_hiz_phase_t phase
+) {
+  vkCmdDrawIndexedIndirectCount(
+      cmd,
+      hiz->draws.buffer,
+      sizeof(VkDrawIndexedIndirectCommand) * hiz->max_instances * phase,
+      hiz->counts.buffer,
+      sizeof(uint32_t) * phase,
+      hiz->max_instances,
+      sizeof(VkDrawIndexedIndirectCommand)
+  );
+}
+/* Destroy a Hi-Z occlusion culler */
+void vk_hiz_destroy(vk_hiz_t *hiz, vk_dev_t *dev) {
+  vkDestroyQueryPool(dev->device, hiz->timestamps, NULL);
+  vkDestroyPipeline(dev->device, hiz->build_pipeline, NULL);
+  vkDestroyPipeline(dev->device, hiz->cull_pipeline, NULL);
+  vk_dev_cache_release_pipeline_layout(dev, hiz->build_layout);
+  vk_dev_cache_release_pipeline_layout(dev, hiz->cull_layout);
+  vkDestroyDescriptorPool(dev->device, hiz->descriptor_pool, NULL);
+  vk_dev_cache_release_set_layout(dev, hiz->build_set_layout);
+  vk_dev_cache_release_set_layout(dev, hiz->cull_set_layout);
+  vk_buf_destroy(&hiz->params, dev);
+  vk_buf_destroy(&hiz->instances, dev);
+  vk_buf_destroy(&hiz->visibility, dev);
+  vk_buf_destroy(&hiz->draws, dev);
+  vk_buf_destroy(&hiz->counts, dev);
+  vk_buf_destroy(&hiz->spd_counter, dev);
+  vk_buf_destroy(&hiz->readback, dev);
+  vk_dev_cache_release_sampler(dev, hiz->reduce_sampler);
+  for (uint32_t i = 0; i < hiz->mip_count; i++)
+    vkDestroyImageView(dev->device, hiz->mip_views[i], NULL);
+  vkDestroyImageView(dev->device, hiz->pyramid_view, NULL);
+  vkDestroyImage(dev->device, hiz->pyramid, NULL);
+  vkFreeMemory(dev->device, hiz->pyramid_memory, NULL);
+  memset(hiz, 0, sizeof(vk_hiz_t));
+}
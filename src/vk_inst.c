@@ -1,14 +1,24 @@
 /* Implements vk_inst.h */
 #include <vk_inst.h>
 
+/* Layer best practices validation is part of */
+#define VALIDATION_LAYER "VK_LAYER_KHRONOS_validation"
+
 /* Debug messenger callback */
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageType,
     const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
     void* pUserData) {
+  vk_messages_t *messages = (vk_messages_t *)pUserData;
   const char *severity;
   const char *type;
+
+  /* Count repeats, printing them only if they are errors */
+  if (
+      !vk_messages_record(messages, messageSeverity, messageType, pCallbackData)
+      && messageSeverity < VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
+  ) return VK_FALSE;
   switch (messageSeverity) {
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
       severity = "\033[1;37mVERBOSE\033[0m";
@@ -38,6 +48,8 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     case VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT:
       type = "GENERAL";
       break;
+    default:
+      type = "UNKNOWN";
   }
   fprintf(
       stderr,
@@ -46,8 +58,6 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
       type,
       pCallbackData->pMessage
   );
-  (void)pUserData;
-  (void)pCallbackData;
   return VK_FALSE;
 }
 
@@ -55,6 +65,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 vk_inst_builder_t vk_inst_builder(void) {
   vk_inst_builder_t builder;
   builder.use_messenger = false;
+  builder.best_practices = false;
   builder.extensions = NULL;
   builder.extension_count = 0;
   builder.layers = NULL;
@@ -123,6 +134,10 @@ void vk_inst_builder_use_messenger(
 ) {
   builder->use_messenger = true;
 }
+/* Enable best practices validation (needs the validation layer) */
+void vk_inst_builder_use_best_practices(vk_inst_builder_t *builder) {
+  builder->best_practices = true;
+}
 /* Set application name */
 void vk_inst_builder_set_app_name(
     vk_inst_builder_t *builder,
@@ -144,6 +159,11 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
   VkApplicationInfo app_info;
   VkInstanceCreateInfo create_info;
   VkDebugUtilsMessengerCreateInfoEXT messenger_info;
+  VkValidationFeaturesEXT validation_features;
+  VkValidationFeatureEnableEXT best_practices_features[1] = {
+    VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT
+  };
+  bool best_practices = builder->best_practices;
   VkExtensionProperties *supported_exts = NULL;
   uint32_t supported_ext_count = 0;
   VkLayerProperties *supported_layers = NULL;
@@ -207,10 +227,37 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
     }
   }
 
+  /* Best practices validation comes with the validation layer */
+  if (best_practices) {
+    bool layer_enabled = false;
+    for (uint32_t i = 0; i < builder->layer_count; i++) {
+      if (strcmp(builder->layers[i], VALIDATION_LAYER) == 0)
+        layer_enabled = true;
+    }
+    if (!layer_enabled) {
+      log_msg(
+          LOG_LEVEL_WARN,
+          "Best practices validation needs %s, not enabling it",
+          VALIDATION_LAYER
+      );
+      best_practices = false;
+    }
+  }
+  if (best_practices) {
+    validation_features.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+    validation_features.pNext = NULL;
+    validation_features.enabledValidationFeatureCount = 1;
+    validation_features.pEnabledValidationFeatures = best_practices_features;
+    validation_features.disabledValidationFeatureCount = 0;
+    validation_features.pDisabledValidationFeatures = NULL;
+    vk_inst_builder_add_ext(builder, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+  }
+
   /* Populate instance */
   inst.use_messenger = builder->use_messenger;
   inst.instance = VK_NULL_HANDLE;
   inst.debug_messenger = VK_NULL_HANDLE;
+  inst.messages = builder->use_messenger ? vk_messages_create() : NULL;
 
   /* Populate debug messenger create info */
   if (builder->use_messenger) {
@@ -229,7 +276,7 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
       | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
       | VK_DEBUG_UTILS_MESSAGE_TYPE_DEVICE_ADDRESS_BINDING_BIT_EXT;
     messenger_info.pfnUserCallback = debug_callback;
-    messenger_info.pUserData = NULL;
+    messenger_info.pUserData = inst.messages;
   }
   
   /* Populate application info */
@@ -244,6 +291,10 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
   /* Populate instance create info */
   create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   create_info.pNext = builder->use_messenger ? &messenger_info : NULL;
+  if (best_practices) {
+    validation_features.pNext = (void *)create_info.pNext;
+    create_info.pNext = &validation_features;
+  }
   create_info.flags = 0;
   create_info.pApplicationInfo = &app_info;
   create_info.enabledExtensionCount = builder->extension_count;
@@ -277,6 +328,7 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
   if (builder->extensions) free(builder->extensions);
   if (builder->layers) free(builder->layers);
   builder->use_messenger = false;
+  builder->best_practices = false;
   builder->extensions = NULL;
   builder->extension_count = 0;
   builder->layers = NULL;
@@ -286,7 +338,7 @@ vk_inst_t vk_inst_create(vk_inst_builder_t *builder) {
 
   return inst;
 }
-/* Destroy a Vulkan instance */
+/* Destroy a Vulkan instance (logging a report of messenger messages) */
 void vk_inst_destroy(vk_inst_t *inst) {
   if (inst->use_messenger) {
     /* Get vkDestroyDebugUtilsMessengerEXT */
@@ -304,4 +356,17 @@ void vk_inst_destroy(vk_inst_t *inst) {
   }
   /* Destroy instance */
   vkDestroyInstance(inst->instance, NULL);
+  /* Report messages, now that the instance can't add any */
+  if (inst->messages) {
+    vk_messages_report(
+        inst->messages,
+        VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_DEVICE_ADDRESS_BINDING_BIT_EXT,
+        VK_MESSAGES_REPORT_LIMIT
+    );
+    vk_messages_destroy(inst->messages);
+    inst->messages = NULL;
+  }
 }
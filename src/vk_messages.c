@@ -0,0 +1,249 @@
+/* Implements vk_messages.h */
+#include <vk_messages.h>
+#include <hash.h>
+#include <execinfo.h>
+
+/* Frames skipped when recording (vk_messages_record and the callback) */
+#define SKIP_FRAMES 2
+/* Call stack frames logged per message */
+#define REPORT_FRAMES 6
+/* Marks keys made from a hash rather than a messageIdNumber */
+#define HASH_KEY_BIT (1ull << 63)
+
+/* Sort entries, most frequent first, then most severe */
+static int compare_entries(const void *a, const void *b) {
+  const vk_messages_entry_t *ea = *(const vk_messages_entry_t *const *)a;
+  const vk_messages_entry_t *eb = *(const vk_messages_entry_t *const *)b;
+  if (ea->count != eb->count) return ea->count > eb->count ? -1 : 1;
+  if (ea->severity != eb->severity) return ea->severity > eb->severity ? -1 : 1;
+  return 0;
+}
+/* Get a message's deduplication key */
+static uint64_t message_key(const VkDebugUtilsMessengerCallbackDataEXT *data) {
+  const char *text;
+  if (data->messageIdNumber != 0) return (uint32_t)data->messageIdNumber;
+  text = data->pMessageIdName ? data->pMessageIdName : data->pMessage;
+  if (!text) return HASH_KEY_BIT;
+  return hash64(text, strlen(text), 0) | HASH_KEY_BIT;
+}
+/* Copy a string, cut to fit (src may be NULL) */
+static void copy_name(char *dst, const char *src) {
+  snprintf(dst, VK_MESSAGES_MAX_NAME, "%s", src ? src : "");
+}
+/* Append labels to an entry's label string */
+static void append_labels(
+    vk_messages_entry_t *entry,
+    const VkDebugUtilsLabelEXT *labels,
+    uint32_t count
+) {
+  for (uint32_t i = 0; i < count; i++) {
+    size_t used = strlen(entry->label);
+    if (!labels[i].pLabelName) continue;
+    snprintf(
+        entry->label + used,
+        VK_MESSAGES_MAX_NAME - used,
+        "%s%s",
+        used > 0 ? " > " : "",
+        labels[i].pLabelName
+    );
+  }
+}
+/* Fill in a new entry from a message's first occurrence */
+static void fill_entry(
+    vk_messages_entry_t *entry,
+    uint64_t key,
+    const VkDebugUtilsMessengerCallbackDataEXT *data
+) {
+  memset(entry, 0, sizeof(vk_messages_entry_t));
+  entry->key = key;
+  entry->id = data->messageIdNumber;
+  copy_name(entry->id_name, data->pMessageIdName);
+  if (data->pMessage) {
+    entry->message = strdup(data->pMessage);
+    ASSERT(entry->message);
+  }
+  for (uint32_t i = 0; i < data->objectCount; i++) {
+    vk_messages_object_t *object;
+    if (entry->object_count == VK_MESSAGES_MAX_OBJECTS) break;
+    object = &entry->objects[entry->object_count++];
+    object->type = data->pObjects[i].objectType;
+    object->handle = data->pObjects[i].objectHandle;
+    copy_name(object->name, data->pObjects[i].pObjectName);
+  }
+  append_labels(entry, data->pQueueLabels, data->queueLabelCount);
+  append_labels(entry, data->pCmdBufLabels, data->cmdBufLabelCount);
+}
+/* Get the name of a message severity */
+static const char *severity_name(VkDebugUtilsMessageSeverityFlagBitsEXT s) {
+  switch (s) {
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return "VERBOSE";
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "INFO";
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "WARNING";
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "ERROR";
+    default: return "UNKNOWN";
+  }
+}
+/* Get the name of the most specific message type in a set */
+static const char *type_name(VkDebugUtilsMessageTypeFlagsEXT types) {
+  if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)
+    return "PERFORMANCE";
+  if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT)
+    return "VALIDATION";
+  if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_DEVICE_ADDRESS_BINDING_BIT_EXT)
+    return "DEVICE_ADDRESS_BINDING";
+  return "GENERAL";
+}
+/* Log where an entry was first reported from, leaving out layer frames */
+static void report_frames(const vk_messages_entry_t *entry) {
+  char **symbols;
+  uint32_t logged = 0;
+
+  if (entry->frame_count == 0) return;
+  symbols = backtrace_symbols(entry->frames, (int)entry->frame_count);
+  if (!symbols) return;
+  for (uint32_t i = 0; i < entry->frame_count; i++) {
+    if (logged == REPORT_FRAMES) break;
+    if (strstr(symbols[i], "libVkLayer") || strstr(symbols[i], "libvulkan"))
+      continue;
+    log_msg(LOG_LEVEL_INFO, "    at %s", symbols[i]);
+    logged++;
+  }
+  free(symbols);
+}
+
+/* Create a message aggregator */
+vk_messages_t *vk_messages_create(void) {
+  vk_messages_t *messages = (vk_messages_t *)calloc(1, sizeof(vk_messages_t));
+  ASSERT(messages);
+  ASSERT(pthread_mutex_init(&messages->mutex, NULL) == 0);
+  return messages;
+}
+/* Record a message (returns true the first time it is seen) */
+bool vk_messages_record(
+    vk_messages_t *messages,
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT *data
+) {
+  void *frames[VK_MESSAGES_MAX_FRAMES + SKIP_FRAMES];
+  uint64_t key = message_key(data);
+  vk_messages_entry_t *entry = NULL;
+  bool first = false;
+  int frame_count;
+
+  pthread_mutex_lock(&messages->mutex);
+  for (uint32_t i = 0; i < messages->entry_count; i++) {
+    if (messages->entries[i].key == key) {
+      entry = &messages->entries[i];
+      break;
+    }
+  }
+  if (!entry) {
+    if (messages->entry_count == messages->entry_capacity) {
+      messages->entry_capacity =
+        messages->entry_capacity ? messages->entry_capacity * 2 : 64;
+      messages->entries = (vk_messages_entry_t *)realloc(
+          messages->entries,
+          sizeof(vk_messages_entry_t) * messages->entry_capacity
+      );
+      ASSERT(messages->entries);
+    }
+    entry = &messages->entries[messages->entry_count++];
+    fill_entry(entry, key, data);
+    frame_count = backtrace(frames, VK_MESSAGES_MAX_FRAMES + SKIP_FRAMES);
+    if (frame_count > SKIP_FRAMES) {
+      entry->frame_count = (uint32_t)(frame_count - SKIP_FRAMES);
+      memcpy(
+          entry->frames,
+          frames + SKIP_FRAMES,
+          sizeof(void *) * entry->frame_count
+      );
+    }
+    first = true;
+  }
+  if (severity > entry->severity) entry->severity = severity;
+  entry->types |= types;
+  entry->count++;
+  messages->total++;
+  pthread_mutex_unlock(&messages->mutex);
+  return first;
+}
+/* Log messages of some types, most frequent first (limit 0: all) */
+void vk_messages_report(
+    vk_messages_t *messages,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    uint32_t limit
+) {
+  vk_messages_entry_t **sorted;
+  uint32_t count = 0;
+
+  pthread_mutex_lock(&messages->mutex);
+  sorted = (vk_messages_entry_t **)malloc(
+      sizeof(vk_messages_entry_t *) * (messages->entry_count + 1)
+  );
+  ASSERT(sorted);
+  for (uint32_t i = 0; i < messages->entry_count; i++) {
+    if (messages->entries[i].types & types)
+      sorted[count++] = &messages->entries[i];
+  }
+  if (count > 1) qsort(
+      sorted,
+      count,
+      sizeof(vk_messages_entry_t *),
+      compare_entries
+  );
+
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Vulkan messages: %u distinct of %llu total (%u of the types asked)",
+      messages->entry_count,
+      (unsigned long long)messages->total,
+      count
+  );
+  if (limit > 0 && count > limit) count = limit;
+  for (uint32_t i = 0; i < count; i++) {
+    const vk_messages_entry_t *entry = sorted[i];
+    log_msg(
+        LOG_LEVEL_INFO,
+        "%2u. %llux (%s,%s) %s [0x%08x]: %s",
+        i + 1,
+        (unsigned long long)entry->count,
+        severity_name(entry->severity),
+        type_name(entry->types),
+        entry->id_name,
+        (uint32_t)entry->id,
+        entry->message ? entry->message : ""
+    );
+    for (uint32_t j = 0; j < entry->object_count; j++) {
+      const vk_messages_object_t *object = &entry->objects[j];
+      log_msg(
+          LOG_LEVEL_INFO,
+          "    object %s 0x%llx %s",
+          string_VkObjectType(object->type),
+          (unsigned long long)object->handle,
+          object->name
+      );
+    }
+    if (entry->label[0])
+      log_msg(LOG_LEVEL_INFO, "    in %s", entry->label);
+    report_frames(entry);
+  }
+  pthread_mutex_unlock(&messages->mutex);
+  free(sorted);
+}
+/* Forget every message recorded */
+void vk_messages_reset(vk_messages_t *messages) {
+  pthread_mutex_lock(&messages->mutex);
+  for (uint32_t i = 0; i < messages->entry_count; i++)
+    free(messages->entries[i].message);
+  messages->entry_count = 0;
+  messages->total = 0;
+  pthread_mutex_unlock(&messages->mutex);
+}
+/* Destroy a message aggregator */
+void vk_messages_destroy(vk_messages_t *messages) {
+  vk_messages_reset(messages);
+  pthread_mutex_destroy(&messages->mutex);
+  free(messages->entries);
+  free(messages);
+}
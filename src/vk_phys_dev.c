@@ -1,7 +1,7 @@
 /* Implements vk_phys_dev.h */
 #include <vk_phys_dev.h>
 
-/* Get a physical device's information */
+/* Get a physical device's information (surf may be NULL when headless) */
 void vk_phys_dev_get_info(
     VkPhysicalDevice device,
     vk_phys_dev_info_t *info,
@@ -15,12 +15,25 @@ void vk_phys_dev_get_info(
   vkGetPhysicalDeviceFeatures(device, &info->features);
   vkGetPhysicalDeviceMemoryProperties(device, &info->memory_properties);
 
-  /* Get surface capabilities */
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-      device,
-      *surf,
-      &info->surface_capabilities
-  );
+  /* Clear lists (left empty when the device reports none) */
+  info->extensions_supported = NULL;
+  info->extensions_supported_count = 0;
+  info->layers_supported = NULL;
+  info->layers_supported_count = 0;
+  info->surface_formats = NULL;
+  info->surface_formats_count = 0;
+  info->present_modes = NULL;
+  info->present_modes_count = 0;
+
+  /* Get surface capabilities (none when headless) */
+  memset(&info->surface_capabilities, 0, sizeof(VkSurfaceCapabilitiesKHR));
+  if (surf) {
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+        device,
+        *surf,
+        &info->surface_capabilities
+    );
+  }
 
   /* Get queue family indices */
   vkGetPhysicalDeviceQueueFamilyProperties(
@@ -41,12 +54,14 @@ void vk_phys_dev_get_info(
     );
     for (uint32_t i = 0; i < queue_family_count; i++) {
       VkBool32 present_support = VK_FALSE;
-      vkGetPhysicalDeviceSurfaceSupportKHR(
-          device,
-          i,
-          *surf,
-          &present_support
-      );
+      if (surf) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(
+            device,
+            i,
+            *surf,
+            &present_support
+        );
+      }
       if (present_support == VK_TRUE) {
         info->queue_families.present_index = i;
         info->queue_families.present_supported = true;
@@ -94,6 +109,55 @@ void vk_phys_dev_get_info(
         info->extensions_supported
     );
   }
+
+  /* Get features (extension features stay false when it isn't supported) */
+  {
+    VkPhysicalDeviceFeatures2 features2;
+    memset(&info->features12, 0, sizeof(info->features12));
+    memset(&info->synchronization2, 0, sizeof(info->synchronization2));
+    memset(
+        &info->graphics_pipeline_library,
+        0,
+        sizeof(info->graphics_pipeline_library)
+    );
+    memset(&info->maintenance5, 0, sizeof(info->maintenance5));
+    info->features12.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    info->synchronization2.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    info->graphics_pipeline_library.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    info->maintenance5.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    /* Vulkan 1.1 devices don't know the 1.2 features struct */
+    features2.pNext = info->properties.apiVersion >= VK_API_VERSION_1_2
+      ? &info->features12
+      : NULL;
+    if (vk_phys_dev_supports_ext(
+          info,
+          VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME
+    )) {
+      info->synchronization2.pNext = features2.pNext;
+      features2.pNext = &info->synchronization2;
+    }
+    if (vk_phys_dev_supports_ext(
+          info,
+          VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+    )) {
+      info->graphics_pipeline_library.pNext = features2.pNext;
+      features2.pNext = &info->graphics_pipeline_library;
+    }
+    if (vk_phys_dev_supports_ext(info, VK_KHR_MAINTENANCE_5_EXTENSION_NAME)) {
+      info->maintenance5.pNext = features2.pNext;
+      features2.pNext = &info->maintenance5;
+    }
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    info->features12.pNext = NULL;
+    info->synchronization2.pNext = NULL;
+    info->graphics_pipeline_library.pNext = NULL;
+    info->maintenance5.pNext = NULL;
+  }
   /* Get layers supported */
   vkEnumerateDeviceLayerProperties(
       device,
@@ -111,43 +175,45 @@ void vk_phys_dev_get_info(
         info->layers_supported
     );
   }
-  /* Get surface formats */
-  vkGetPhysicalDeviceSurfaceFormatsKHR(
-      device,
-      *surf,
-      &info->surface_formats_count,
-      NULL
-  );
-  if (info->surface_formats_count > 0) {
-    info->surface_formats = (VkSurfaceFormatKHR *)malloc(
-        sizeof(VkSurfaceFormatKHR) * info->surface_formats_count
-    );
-    ASSERT(info->surface_formats);
+  /* Get surface formats and present modes (none when headless) */
+  if (surf) {
     vkGetPhysicalDeviceSurfaceFormatsKHR(
         device,
         *surf,
         &info->surface_formats_count,
-        info->surface_formats
+        NULL
     );
-  }
-  /* Get present modes */
-  vkGetPhysicalDeviceSurfacePresentModesKHR(
-      device,
-      *surf,
-      &info->present_modes_count,
-      NULL
-  );
-  if (info->present_modes_count > 0) {
-    info->present_modes = (VkPresentModeKHR *)malloc(
-        sizeof(VkPresentModeKHR) * info->present_modes_count
-    );
-    ASSERT(info->present_modes);
+    if (info->surface_formats_count > 0) {
+      info->surface_formats = (VkSurfaceFormatKHR *)malloc(
+          sizeof(VkSurfaceFormatKHR) * info->surface_formats_count
+      );
+      ASSERT(info->surface_formats);
+      vkGetPhysicalDeviceSurfaceFormatsKHR(
+          device,
+          *surf,
+          &info->surface_formats_count,
+          info->surface_formats
+      );
+    }
+    /* Get present modes */
     vkGetPhysicalDeviceSurfacePresentModesKHR(
         device,
         *surf,
         &info->present_modes_count,
-        info->present_modes
+        NULL
     );
+    if (info->present_modes_count > 0) {
+      info->present_modes = (VkPresentModeKHR *)malloc(
+          sizeof(VkPresentModeKHR) * info->present_modes_count
+      );
+      ASSERT(info->present_modes);
+      vkGetPhysicalDeviceSurfacePresentModesKHR(
+          device,
+          *surf,
+          &info->present_modes_count,
+          info->present_modes
+      );
+    }
   }
 
 }
@@ -159,7 +225,7 @@ void vk_phys_dev_info_free(vk_phys_dev_info_t *info) {
   if (info->present_modes) free(info->present_modes);
   memset(info, 0, sizeof(vk_phys_dev_info_t));
 }
-/* Choose a physical device based on a scoring callback */
+/* Choose a physical device based on a scoring callback (surf may be NULL) */
 vk_phys_dev_t vk_phys_dev_choose(
     uint32_t (*score)(const vk_phys_dev_info_t *info),
     const vk_inst_t *inst,
@@ -197,3 +263,87 @@ vk_phys_dev_t vk_phys_dev_choose(
   }
   return physical_devices[best_score_index];
 }
+/* Score a device by type, memory, queues, features and limits (0: unusable) */
+uint32_t vk_phys_dev_score(const vk_phys_dev_info_t *info) {
+  const VkPhysicalDeviceLimits *limits = &info->properties.limits;
+  VkDeviceSize local_size = 0;
+  uint32_t score = 1;
+
+  if (!info->queue_families.graphics_supported) return 0;
+  /* The renderer is built on Vulkan 1.2 */
+  if (info->properties.apiVersion < VK_API_VERSION_1_2) return 0;
+
+  /* Device type */
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      score += 400;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      score += 200;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      score += 100;
+      break;
+    default:
+      break;
+  }
+  /* Largest device local heap, for every doubling past 64 MB */
+  for (uint32_t i = 0; i < info->memory_properties.memoryHeapCount; i++) {
+    const VkMemoryHeap *heap = &info->memory_properties.memoryHeaps[i];
+    if (!(heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+    if (heap->size > local_size) local_size = heap->size;
+  }
+  for (VkDeviceSize mb = 64; mb <= local_size >> 20; mb *= 2) score += 32;
+  /* Queue families that run beside graphics */
+  if (
+      info->queue_families.transfer_supported
+      && info->queue_families.transfer_index
+      != info->queue_families.graphics_index
+  ) score += 100;
+  if (
+      info->queue_families.compute_supported
+      && info->queue_families.compute_index
+      != info->queue_families.graphics_index
+  ) score += 100;
+  /* Features the renderer uses or benefits from */
+  if (info->features12.timelineSemaphore) score += 50;
+  if (info->features12.descriptorIndexing) score += 50;
+  if (info->features12.bufferDeviceAddress) score += 25;
+  if (info->features.samplerAnisotropy) score += 25;
+  if (info->features.multiDrawIndirect) score += 25;
+  if (info->features.textureCompressionBC) score += 25;
+  /* Limits */
+  score += limits->maxImageDimension2D / 1024;
+  score += limits->maxComputeWorkGroupInvocations / 128;
+  score += limits->maxComputeSharedMemorySize / 8192;
+  return score;
+}
+/* Check if a physical device supports an extension */
+bool vk_phys_dev_supports_ext(
+    const vk_phys_dev_info_t *info,
+    const char *ext
+) {
+  for (uint32_t i = 0; i < info->extensions_supported_count; i++) {
+    if (strcmp(info->extensions_supported[i].extensionName, ext) == 0)
+      return true;
+  }
+  return false;
+}
+/* Find a memory type (UINT32_MAX if none, preferred flags are optional) */
+uint32_t vk_phys_dev_find_memory_type(
+    const vk_phys_dev_info_t *info,
+    uint32_t type_bits,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+) {
+  uint32_t fallback = UINT32_MAX;
+  for (uint32_t i = 0; i < info->memory_properties.memoryTypeCount; i++) {
+    VkMemoryPropertyFlags flags =
+      info->memory_properties.memoryTypes[i].propertyFlags;
+    if (!(type_bits & (1u << i))) continue;
+    if ((flags & required) != required) continue;
+    if ((flags & preferred) == preferred) return i;
+    if (fallback == UINT32_MAX) fallback = i;
+  }
+  return fallback;
+}
@@ -0,0 +1,613 @@
+/* Implements vk_phys_dev_probe.h */
+#include <vk_phys_dev_probe.h>
+#include <vk_dev.h>
+#include <vk_dev_cache.h>
+#include <vk_buf.h>
+
+/* Invocations per workgroup (local_size_x in probe.comp) */
+#define PROBE_GROUP_SIZE 64u
+/* Flops per loop iteration of probe.comp */
+#define PROBE_FLOPS_PER_ITERATION 32u
+/* Shortest time trusted, against timers that don't advance (s) */
+#define PROBE_MIN_TIME 1e-6
+
+/* Types */
+/* Cache file record */
+typedef struct {
+  uint8_t uuid[VK_UUID_SIZE];
+  uint32_t driver_version;
+  uint32_t version;
+  float copy_gbps;
+  float compute_gflops;
+} record_t;
+/* Device being probed */
+typedef struct {
+  vk_phys_dev_info_t info;
+  vk_dev_t dev;
+  VkQueue queue;
+  VkCommandPool command_pool;
+  VkCommandBuffer cmd;
+  VkFence fence;
+  VkQueryPool queries;            /* VK_NULL_HANDLE without timestamps */
+} probe_dev_t;
+/* Records commands to time */
+typedef void (*record_fn_t)(VkCommandBuffer cmd, const void *user);
+/* Buffers copied between */
+typedef struct {
+  VkBuffer src;
+  VkBuffer dst;
+  VkDeviceSize size;
+} copy_args_t;
+/* Compute dispatch */
+typedef struct {
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+  VkDescriptorSet set;
+} dispatch_args_t;
+
+/* Get a device's UUID */
+static void get_uuid(vk_phys_dev_t phys_dev, uint8_t *uuid) {
+  VkPhysicalDeviceIDProperties id;
+  VkPhysicalDeviceProperties2 properties;
+  memset(&id, 0, sizeof(id));
+  id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  id.pNext = NULL;
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &id;
+  vkGetPhysicalDeviceProperties2(phys_dev, &properties);
+  memcpy(uuid, id.deviceUUID, VK_UUID_SIZE);
+}
+/* Find the record for a device and driver (NULL if none) */
+static const record_t *find_record(
+    const record_t *records,
+    size_t count,
+    const record_t *key
+) {
+  for (size_t i = 0; i < count; i++) {
+    if (
+        memcmp(records[i].uuid, key->uuid, VK_UUID_SIZE) == 0
+        && records[i].driver_version == key->driver_version
+        && records[i].version == key->version
+    ) return &records[i];
+  }
+  return NULL;
+}
+/* Write a cache file, replacing the device's older records with one */
+static void write_cache(
+    const char *path,
+    const record_t *records,
+    size_t count,
+    const record_t *record
+) {
+  FILE *file = fopen(path, "wb");
+  bool ok;
+
+  if (!file) {
+    log_msg(
+        LOG_LEVEL_WARN,
+        "Failed to write device probe cache %s: %s",
+        path,
+        strerror(errno)
+    );
+    return;
+  }
+  ok = fwrite(record, sizeof(record_t), 1, file) == 1;
+  for (size_t i = 0; i < count && ok; i++) {
+    if (memcmp(records[i].uuid, record->uuid, VK_UUID_SIZE) == 0) continue;
+    ok = fwrite(&records[i], sizeof(record_t), 1, file) == 1;
+  }
+  if (fclose(file) != 0) ok = false;
+  if (!ok)
+    log_msg(LOG_LEVEL_WARN, "Failed to write device probe cache %s", path);
+}
+/* Create a device with one graphics queue to probe */
+static void probe_dev_create(probe_dev_t *probe, vk_phys_dev_t phys_dev) {
+  vk_dev_builder_t builder = vk_dev_builder();
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo cmd_info;
+  VkFenceCreateInfo fence_info;
+  VkQueryPoolCreateInfo query_info;
+
+  vk_phys_dev_get_info(phys_dev, &probe->info, NULL);
+  vk_dev_builder_add_graphics_queue(&builder, 1.0f);
+  probe->dev = vk_dev_create(&phys_dev, &probe->info, &builder);
+  probe->queue = probe->dev.graphics_queues[0];
+
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = probe->info.queue_families.graphics_index;
+  VK_CHECK(vkCreateCommandPool(
+        probe->dev.device,
+        &pool_info,
+        NULL,
+        &probe->command_pool
+  ));
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.pNext = NULL;
+  cmd_info.commandPool = probe->command_pool;
+  cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(probe->dev.device, &cmd_info, &probe->cmd));
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.pNext = NULL;
+  fence_info.flags = 0;
+  VK_CHECK(vkCreateFence(probe->dev.device, &fence_info, NULL, &probe->fence));
+
+  /* Timestamps, if every graphics and compute queue has them */
+  probe->queries = VK_NULL_HANDLE;
+  if (probe->info.properties.limits.timestampComputeAndGraphics) {
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.pNext = NULL;
+    query_info.flags = 0;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2;
+    query_info.pipelineStatistics = 0;
+    VK_CHECK(vkCreateQueryPool(
+          probe->dev.device,
+          &query_info,
+          NULL,
+          &probe->queries
+    ));
+  }
+}
+/* Destroy a device created to probe */
+static void probe_dev_destroy(probe_dev_t *probe) {
+  if (probe->queries != VK_NULL_HANDLE)
+    vkDestroyQueryPool(probe->dev.device, probe->queries, NULL);
+  vkDestroyFence(probe->dev.device, probe->fence, NULL);
+  vkDestroyCommandPool(probe->dev.device, probe->command_pool, NULL);
+  vk_dev_destroy(&probe->dev);
+  vk_phys_dev_info_free(&probe->info);
+  memset(probe, 0, sizeof(probe_dev_t));
+}
+/* Record, submit and wait for commands, returning the seconds they took */
+static double run_timed(
+    probe_dev_t *probe,
+    record_fn_t record,
+    const void *user
+) {
+  VkCommandBufferBeginInfo begin_info;
+  VkSubmitInfo submit_info;
+  uint64_t timestamps[2];
+  double start, elapsed;
+
+  VK_CHECK(vkResetCommandPool(probe->dev.device, probe->command_pool, 0));
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkBeginCommandBuffer(probe->cmd, &begin_info));
+  if (probe->queries != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(probe->cmd, probe->queries, 0, 2);
+    vkCmdWriteTimestamp(
+        probe->cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        probe->queries,
+        0
+    );
+  }
+  record(probe->cmd, user);
+  if (probe->queries != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(
+        probe->cmd,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        probe->queries,
+        1
+    );
+  }
+  VK_CHECK(vkEndCommandBuffer(probe->cmd));
+
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = NULL;
+  submit_info.waitSemaphoreCount = 0;
+  submit_info.pWaitSemaphores = NULL;
+  submit_info.pWaitDstStageMask = NULL;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &probe->cmd;
+  submit_info.signalSemaphoreCount = 0;
+  submit_info.pSignalSemaphores = NULL;
+  start = time_now();
+  VK_CHECK(vkQueueSubmit(probe->queue, 1, &submit_info, probe->fence));
+  VK_CHECK(vkWaitForFences(
+        probe->dev.device,
+        1,
+        &probe->fence,
+        VK_TRUE,
+        UINT64_MAX
+  ));
+  elapsed = time_now() - start;
+  VK_CHECK(vkResetFences(probe->dev.device, 1, &probe->fence));
+
+  if (probe->queries != VK_NULL_HANDLE) {
+    VK_CHECK(vkGetQueryPoolResults(
+          probe->dev.device,
+          probe->queries,
+          0,
+          2,
+          sizeof(timestamps),
+          timestamps,
+          sizeof(uint64_t),
+          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+    ));
+    if (timestamps[1] > timestamps[0]) {
+      elapsed = (double)(timestamps[1] - timestamps[0])
+        * (double)probe->info.properties.limits.timestampPeriod * 1e-9;
+    }
+  }
+  return elapsed > PROBE_MIN_TIME ? elapsed : PROBE_MIN_TIME;
+}
+/* Record filling the source buffer */
+static void record_fill(VkCommandBuffer cmd, const void *user) {
+  const copy_args_t *args = (const copy_args_t *)user;
+  vkCmdFillBuffer(cmd, args->src, 0, VK_WHOLE_SIZE, 0x5a5a5a5au);
+}
+/* Record the copies, each after the last */
+static void record_copies(VkCommandBuffer cmd, const void *user) {
+  const copy_args_t *args = (const copy_args_t *)user;
+  VkMemoryBarrier barrier;
+  VkBufferCopy region;
+
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  region.srcOffset = 0;
+  region.dstOffset = 0;
+  region.size = args->size;
+  for (uint32_t i = 0; i < VK_PHYS_DEV_PROBE_COPIES; i++) {
+    if (i > 0) vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        NULL,
+        0,
+        NULL
+    );
+    vkCmdCopyBuffer(cmd, args->src, args->dst, 1, &region);
+  }
+}
+/* Record the dispatch */
+static void record_dispatch(VkCommandBuffer cmd, const void *user) {
+  const dispatch_args_t *args = (const dispatch_args_t *)user;
+  uint32_t iterations = VK_PHYS_DEV_PROBE_ITERATIONS;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, args->pipeline);
+  vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      args->layout,
+      0,
+      1,
+      &args->set,
+      0,
+      NULL
+  );
+  vkCmdPushConstants(
+      cmd,
+      args->layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(iterations),
+      &iterations
+  );
+  vkCmdDispatch(cmd, VK_PHYS_DEV_PROBE_GROUPS, 1, 1);
+}
+/* Time copies between device local buffers (GB/s) */
+static float probe_copy(probe_dev_t *probe) {
+  const VkPhysicalDeviceMemoryProperties *memory =
+    &probe->info.memory_properties;
+  VkDeviceSize size = VK_PHYS_DEV_PROBE_COPY_SIZE;
+  VkDeviceSize local_size = 0;
+  vk_buf_t src, dst;
+  copy_args_t args;
+  double seconds;
+
+  /* Keep to an eighth of the largest device local heap */
+  for (uint32_t i = 0; i < memory->memoryHeapCount; i++) {
+    if (!(memory->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+      continue;
+    if (memory->memoryHeaps[i].size > local_size)
+      local_size = memory->memoryHeaps[i].size;
+  }
+  if (local_size / 8 < size) size = (local_size / 8) & ~(VkDeviceSize)3;
+  ASSERT(size > 0);
+
+  src = vk_buf_create(
+      &probe->dev,
+      &probe->info,
+      size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  dst = vk_buf_create(
+      &probe->dev,
+      &probe->info,
+      size,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  args.src = src.buffer;
+  args.dst = dst.buffer;
+  args.size = size;
+  run_timed(probe, record_fill, &args);
+  run_timed(probe, record_copies, &args);
+  seconds = run_timed(probe, record_copies, &args);
+  vk_buf_destroy(&src, &probe->dev);
+  vk_buf_destroy(&dst, &probe->dev);
+  return (float)(
+      (double)size * VK_PHYS_DEV_PROBE_COPIES / seconds / 1e9
+  );
+}
+/* Time a dispatch of probe.comp (GFLOP/s, 0 if the shader is missing) */
+static float probe_compute(probe_dev_t *probe, const char *shader_dir) {
+  VkDevice device = probe->dev.device;
+  VkDescriptorSetLayoutBinding binding;
+  VkDescriptorSetLayoutCreateInfo set_layout_info;
+  VkPushConstantRange push_range;
+  VkPipelineLayoutCreateInfo layout_info;
+  VkShaderModuleCreateInfo module_info;
+  VkComputePipelineCreateInfo pipeline_info;
+  VkDescriptorPoolSize pool_size;
+  VkDescriptorPoolCreateInfo pool_info;
+  VkDescriptorSetAllocateInfo set_info;
+  VkDescriptorBufferInfo buffer_info;
+  VkWriteDescriptorSet write;
+  VkDescriptorSetLayout set_layout;
+  VkDescriptorPool descriptor_pool;
+  VkShaderModule module;
+  dispatch_args_t args;
+  vk_buf_t results;
+  char path[512];
+  size_t size;
+  void *code;
+  double seconds;
+
+  snprintf(path, sizeof(path), "%s/probe.comp.spv", shader_dir);
+  code = read_file(path, &size);
+  if (code == NULL) {
+    log_msg(
+        LOG_LEVEL_WARN,
+        "Failed to read shader %s (%s), timing copies only",
+        path,
+        strerror(errno)
+    );
+    return 0.0f;
+  }
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.pNext = NULL;
+  module_info.flags = 0;
+  module_info.codeSize = size;
+  module_info.pCode = (const uint32_t *)code;
+  module = vk_dev_cache_shader_module(&probe->dev, &module_info);
+  free(code);
+
+  /* Layouts */
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  binding.descriptorCount = 1;
+  binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  binding.pImmutableSamplers = NULL;
+  set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_info.pNext = NULL;
+  set_layout_info.flags = 0;
+  set_layout_info.bindingCount = 1;
+  set_layout_info.pBindings = &binding;
+  set_layout = vk_dev_cache_set_layout(&probe->dev, &set_layout_info);
+  push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_range.offset = 0;
+  push_range.size = sizeof(uint32_t);
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.pNext = NULL;
+  layout_info.flags = 0;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &set_layout;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_range;
+  args.layout = vk_dev_cache_pipeline_layout(&probe->dev, &layout_info);
+
+  /* Pipeline */
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.pNext = NULL;
+  pipeline_info.flags = 0;
+  pipeline_info.stage.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.pNext = NULL;
+  pipeline_info.stage.flags = 0;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.stage.pSpecializationInfo = NULL;
+  pipeline_info.layout = args.layout;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_info.basePipelineIndex = -1;
+  VK_CHECK(vkCreateComputePipelines(
+        device,
+        VK_NULL_HANDLE,
+        1,
+        &pipeline_info,
+        NULL,
+        &args.pipeline
+  ));
+
+  /* Results buffer and its descriptor */
+  results = vk_buf_create(
+      &probe->dev,
+      &probe->info,
+      (VkDeviceSize)VK_PHYS_DEV_PROBE_GROUPS * PROBE_GROUP_SIZE * 16u,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = 1;
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = 0;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  VK_CHECK(vkCreateDescriptorPool(device, &pool_info, NULL, &descriptor_pool));
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.pNext = NULL;
+  set_info.descriptorPool = descriptor_pool;
+  set_info.descriptorSetCount = 1;
+  set_info.pSetLayouts = &set_layout;
+  VK_CHECK(vkAllocateDescriptorSets(device, &set_info, &args.set));
+  buffer_info.buffer = results.buffer;
+  buffer_info.offset = 0;
+  buffer_info.range = VK_WHOLE_SIZE;
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = NULL;
+  write.dstSet = args.set;
+  write.dstBinding = 0;
+  write.dstArrayElement = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pImageInfo = NULL;
+  write.pBufferInfo = &buffer_info;
+  write.pTexelBufferView = NULL;
+  vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+  run_timed(probe, record_dispatch, &args);
+  seconds = run_timed(probe, record_dispatch, &args);
+
+  vkDestroyDescriptorPool(device, descriptor_pool, NULL);
+  vk_buf_destroy(&results, &probe->dev);
+  vkDestroyPipeline(device, args.pipeline, NULL);
+  vk_dev_cache_release_pipeline_layout(&probe->dev, args.layout);
+  vk_dev_cache_release_set_layout(&probe->dev, set_layout);
+  vk_dev_cache_release_shader_module(&probe->dev, module);
+  return (float)(
+      (double)VK_PHYS_DEV_PROBE_GROUPS * PROBE_GROUP_SIZE
+      * VK_PHYS_DEV_PROBE_ITERATIONS * PROBE_FLOPS_PER_ITERATION
+      / seconds / 1e9
+  );
+}
+
+/* Probe a device (shader_dir and cache_path may be NULL) */
+vk_phys_dev_probe_t vk_phys_dev_probe(
+    vk_phys_dev_t phys_dev,
+    const char *shader_dir,
+    const char *cache_path
+) {
+  VkPhysicalDeviceProperties properties;
+  vk_phys_dev_probe_t result;
+  const record_t *found = NULL;
+  record_t *records = NULL;
+  record_t record;
+  size_t size = 0, count = 0;
+  probe_dev_t probe;
+
+  vkGetPhysicalDeviceProperties(phys_dev, &properties);
+  memset(&record, 0, sizeof(record_t));
+  get_uuid(phys_dev, record.uuid);
+  record.driver_version = properties.driverVersion;
+  record.version = VK_PHYS_DEV_PROBE_VERSION;
+  if (cache_path) {
+    records = (record_t *)read_file(cache_path, &size);
+    count = records ? size / sizeof(record_t) : 0;
+    found = find_record(records, count, &record);
+  }
+  /* Records made without the shader don't do for probes with it */
+  if (found && shader_dir && found->compute_gflops <= 0.0f) found = NULL;
+
+  memset(&result, 0, sizeof(vk_phys_dev_probe_t));
+  if (found) {
+    result.copy_gbps = found->copy_gbps;
+    result.compute_gflops = found->compute_gflops;
+    result.cached = true;
+  } else {
+    probe_dev_create(&probe, phys_dev);
+    result.copy_gbps = probe_copy(&probe);
+    if (shader_dir)
+      result.compute_gflops = probe_compute(&probe, shader_dir);
+    probe_dev_destroy(&probe);
+    record.copy_gbps = result.copy_gbps;
+    record.compute_gflops = result.compute_gflops;
+    if (cache_path) write_cache(cache_path, records, count, &record);
+  }
+  free(records);
+
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Probed %s: %.1f GB/s copy, %.1f GFLOP/s compute (%s)",
+      properties.deviceName,
+      result.copy_gbps,
+      result.compute_gflops,
+      result.cached ? "cached" : "measured"
+  );
+  return result;
+}
+/* Get a probe's rank (higher is faster) */
+double vk_phys_dev_probe_rank(const vk_phys_dev_probe_t *probe) {
+  return (double)probe->copy_gbps * VK_PHYS_DEV_PROBE_COPY_WEIGHT
+    + (double)probe->compute_gflops;
+}
+/* Choose a device by score, probing when several are usable (surf optional) */
+vk_phys_dev_t vk_phys_dev_choose_fastest(
+    uint32_t (*score)(const vk_phys_dev_info_t *info),
+    const vk_inst_t *inst,
+    const vk_surf_t *surf,
+    const char *shader_dir,
+    const char *cache_path
+) {
+  VkPhysicalDevice *physical_devices;
+  VkPhysicalDevice chosen;
+  uint32_t physical_devices_count;
+  uint32_t *scores;
+  uint32_t usable = 0;
+  uint32_t best = 0;
+  double best_rank = -1.0;
+
+  vkEnumeratePhysicalDevices(inst->instance, &physical_devices_count, NULL);
+  ASSERT(physical_devices_count > 0);
+  physical_devices = (VkPhysicalDevice *)malloc(
+      sizeof(VkPhysicalDevice) * physical_devices_count
+  );
+  scores = (uint32_t *)malloc(sizeof(uint32_t) * physical_devices_count);
+  ASSERT(physical_devices && scores);
+  vkEnumeratePhysicalDevices(
+      inst->instance,
+      &physical_devices_count,
+      physical_devices
+  );
+
+  /* Score, keeping the best in case probing isn't needed */
+  for (uint32_t i = 0; i < physical_devices_count; i++) {
+    vk_phys_dev_info_t info;
+    vk_phys_dev_get_info(physical_devices[i], &info, surf);
+    scores[i] = score(&info);
+    vk_phys_dev_info_free(&info);
+    if (scores[i] > 0) usable++;
+    if (scores[i] > scores[best]) best = i;
+  }
+
+  /* Rank the usable devices by what they measure */
+  if (usable > 1) {
+    for (uint32_t i = 0; i < physical_devices_count; i++) {
+      vk_phys_dev_probe_t probe;
+      double rank;
+      if (scores[i] == 0) continue;
+      probe = vk_phys_dev_probe(physical_devices[i], shader_dir, cache_path);
+      rank = vk_phys_dev_probe_rank(&probe);
+      if (
+          rank > best_rank
+          || (rank == best_rank && scores[i] > scores[best])
+      ) {
+        best_rank = rank;
+        best = i;
+      }
+    }
+  }
+
+  chosen = physical_devices[best];
+  free(scores);
+  free(physical_devices);
+  return chosen;
+}
@@ -0,0 +1,105 @@
+/* Implements vk_pipeline_cache.h */
+#include <vk_pipeline_cache.h>
+
+/* Size of the pipeline cache header version one */
+#define PIPELINE_CACHE_HEADER_SIZE 32
+
+/* Read a little endian 32 bit value */
+static uint32_t read32(const uint8_t *p) {
+  return (uint32_t)p[0]
+    | (uint32_t)p[1] << 8
+    | (uint32_t)p[2] << 16
+    | (uint32_t)p[3] << 24;
+}
+/* Check a cache blob was written by this device and driver */
+static bool header_matches(
+    const uint8_t *data,
+    size_t size,
+    const vk_phys_dev_info_t *phys_dev_info
+) {
+  if (size < PIPELINE_CACHE_HEADER_SIZE) return false;
+  return read32(data) >= PIPELINE_CACHE_HEADER_SIZE
+    && read32(data + 4) == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+    && read32(data + 8) == phys_dev_info->properties.vendorID
+    && read32(data + 12) == phys_dev_info->properties.deviceID
+    && memcmp(
+        data + 16,
+        phys_dev_info->properties.pipelineCacheUUID,
+        VK_UUID_SIZE
+    ) == 0;
+}
+
+/* Read a pipeline cache file (a missing file gives an empty cache) */
+void vk_pipeline_cache_read(vk_pipeline_cache_t *cache, const char *path) {
+  memset(cache, 0, sizeof(vk_pipeline_cache_t));
+  cache->path = strdup(path);
+  ASSERT(cache->path);
+  cache->data = read_file(path, &cache->size);
+  if (!cache->data) cache->size = 0;
+}
+/* Create the Vulkan pipeline cache, seeded if the file matches the device */
+void vk_pipeline_cache_create(
+    vk_pipeline_cache_t *cache,
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info
+) {
+  VkPipelineCacheCreateInfo create_info;
+  bool seeded = cache->data && header_matches(
+      (const uint8_t *)cache->data,
+      cache->size,
+      phys_dev_info
+  );
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  create_info.pNext = NULL;
+  create_info.flags = 0;
+  create_info.initialDataSize = seeded ? cache->size : 0;
+  create_info.pInitialData = seeded ? cache->data : NULL;
+  VK_CHECK(vkCreatePipelineCache(
+        dev->device,
+        &create_info,
+        NULL,
+        &cache->cache
+  ));
+  if (seeded)
+    log_msg(LOG_LEVEL_INFO, "Pipeline cache: %zu bytes", cache->size);
+  else if (cache->data)
+    log_msg(LOG_LEVEL_WARN, "Pipeline cache is stale, starting empty");
+  free(cache->data);
+  cache->data = NULL;
+  cache->size = 0;
+}
+/* Write the pipeline cache back to its file */
+bool vk_pipeline_cache_write(vk_pipeline_cache_t *cache, vk_dev_t *dev) {
+  size_t size = 0;
+  void *data;
+  FILE *file;
+  bool ok;
+
+  VK_CHECK(vkGetPipelineCacheData(dev->device, cache->cache, &size, NULL));
+  data = malloc(size);
+  ASSERT(data);
+  VK_CHECK(vkGetPipelineCacheData(dev->device, cache->cache, &size, data));
+  file = fopen(cache->path, "wb");
+  if (!file) {
+    log_msg(
+        LOG_LEVEL_WARN,
+        "Failed to write %s: %s",
+        cache->path,
+        strerror(errno)
+    );
+    free(data);
+    return false;
+  }
+  ok = fwrite(data, 1, size, file) == size;
+  ok = fclose(file) == 0 && ok;
+  free(data);
+  return ok;
+}
+/* Destroy a pipeline cache */
+void vk_pipeline_cache_destroy(vk_pipeline_cache_t *cache, vk_dev_t *dev) {
+  if (cache->cache)
+    vkDestroyPipelineCache(dev->device, cache->cache, NULL);
+  free(cache->data);
+  free(cache->path);
+  memset(cache, 0, sizeof(vk_pipeline_cache_t));
+}
@@ -0,0 +1,524 @@
+/* Implements vk_pipelines.h */
+#include <vk_pipelines.h>
+#include <hash.h>
+#include <telemetry.h>
+
+/* Initial table capacity */
+#define VK_PIPELINES_INITIAL_CAPACITY 64u
+
+/* Entry statuses */
+#define STATUS_QUEUED 0
+#define STATUS_READY 1
+
+/* Entry parts (libraries are the graphics pipeline library parts) */
+#define PART_PIPELINE 0u
+#define PART_VERTEX_INPUT 1u
+#define PART_PRE_RASTERIZATION 2u
+#define PART_FRAGMENT_SHADER 3u
+#define PART_FRAGMENT_OUTPUT 4u
+#define PART_COUNT 5u
+
+/* Types */
+/* Create info with the state it points to */
+typedef struct {
+  VkPipelineShaderStageCreateInfo stages[VK_PIPELINE_MAX_STAGES];
+  VkShaderModuleCreateInfo modules[VK_PIPELINE_MAX_STAGES];
+  VkSpecializationMapEntry map[VK_PIPELINE_MAX_SPEC];
+  VkSpecializationInfo spec;
+  VkPipelineVertexInputStateCreateInfo vertex_input;
+  VkPipelineInputAssemblyStateCreateInfo input_assembly;
+  VkPipelineViewportStateCreateInfo viewport;
+  VkPipelineRasterizationStateCreateInfo rasterization;
+  VkPipelineMultisampleStateCreateInfo multisample;
+  VkPipelineDepthStencilStateCreateInfo depth_stencil;
+  VkPipelineColorBlendStateCreateInfo color_blend;
+  VkDynamicState dynamic_states[2];
+  VkPipelineDynamicStateCreateInfo dynamic;
+  VkGraphicsPipelineLibraryCreateInfoEXT library;
+  VkGraphicsPipelineCreateInfo info;
+} pipeline_info_t;
+
+/* Find an entry in a table (its mutex held) */
+static vk_pipeline_entry_t *table_find(
+    const vk_pipeline_table_t *table,
+    uint64_t hash,
+    uint32_t part,
+    const vk_pipeline_key_t *key
+) {
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+    vk_pipeline_entry_t *entry = table->entries[i];
+    if (!entry) return NULL;
+    if (
+        entry->hash == hash
+        && entry->part == part
+        && memcmp(&entry->key, key, sizeof(vk_pipeline_key_t)) == 0
+    ) return entry;
+  }
+}
+/* Put an entry in the first free slot of its probe sequence */
+static void table_place(
+    vk_pipeline_entry_t **entries,
+    uint32_t capacity,
+    vk_pipeline_entry_t *entry
+) {
+  uint32_t mask = capacity - 1;
+  uint32_t i = (uint32_t)entry->hash & mask;
+  while (entries[i]) i = (i + 1) & mask;
+  entries[i] = entry;
+}
+/* Add an entry to a table (its mutex held) */
+static void table_insert(
+    vk_pipeline_table_t *table,
+    vk_pipeline_entry_t *entry
+) {
+  if ((table->count + 1) * 2 > table->capacity) {
+    uint32_t capacity = table->capacity * 2;
+    vk_pipeline_entry_t **entries = (vk_pipeline_entry_t **)calloc(
+        capacity,
+        sizeof(vk_pipeline_entry_t *)
+    );
+    ASSERT(entries);
+    for (uint32_t i = 0; i < table->capacity; i++) {
+      if (table->entries[i]) table_place(entries, capacity, table->entries[i]);
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+  }
+  table_place(table->entries, table->capacity, entry);
+  table->count++;
+}
+/* Create an empty table */
+static void table_create(vk_pipeline_table_t *table) {
+  table->entries = (vk_pipeline_entry_t **)calloc(
+      VK_PIPELINES_INITIAL_CAPACITY,
+      sizeof(vk_pipeline_entry_t *)
+  );
+  ASSERT(table->entries);
+  table->count = 0;
+  table->capacity = VK_PIPELINES_INITIAL_CAPACITY;
+}
+/* Destroy a table's pipelines and entries */
+static void table_destroy(vk_pipeline_table_t *table, VkDevice device) {
+  for (uint32_t i = 0; i < table->capacity; i++) {
+    vk_pipeline_entry_t *entry = table->entries[i];
+    if (!entry) continue;
+    vkDestroyPipeline(device, atomic_load(&entry->pipeline), NULL);
+    if (entry->replaced) vkDestroyPipeline(device, entry->replaced, NULL);
+    free(entry);
+  }
+  free(table->entries);
+  memset(table, 0, sizeof(vk_pipeline_table_t));
+}
+
+/* Create an entry for a key */
+static vk_pipeline_entry_t *entry_create(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    uint64_t hash,
+    uint32_t part,
+    const vk_shader_t *const *shaders
+) {
+  vk_pipeline_entry_t *entry =
+    (vk_pipeline_entry_t *)calloc(1, sizeof(vk_pipeline_entry_t));
+  ASSERT(entry);
+  memcpy(&entry->key, key, sizeof(vk_pipeline_key_t));
+  entry->hash = hash;
+  entry->part = part;
+  memcpy(
+      entry->shaders,
+      shaders,
+      sizeof(const vk_shader_t *) * key->stage_count
+  );
+  atomic_init(&entry->status, STATUS_QUEUED);
+  atomic_init(&entry->pipeline, VK_NULL_HANDLE);
+  entry->replaced = VK_NULL_HANDLE;
+  entry->pipelines = pipelines;
+  return entry;
+}
+/* Reduce a key to what one library part depends on */
+static void part_key(
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders,
+    uint32_t part,
+    vk_pipeline_key_t *out,
+    const vk_shader_t **out_shaders
+) {
+  const vk_pipeline_state_t *state = &key->state;
+  vk_pipeline_key_init(out);
+  switch (part) {
+    case PART_VERTEX_INPUT:
+      out->state.binding_count = state->binding_count;
+      memcpy(
+          out->state.bindings,
+          state->bindings,
+          sizeof(state->bindings)
+      );
+      out->state.attribute_count = state->attribute_count;
+      memcpy(
+          out->state.attributes,
+          state->attributes,
+          sizeof(state->attributes)
+      );
+      out->state.topology = state->topology;
+      break;
+    case PART_PRE_RASTERIZATION:
+    case PART_FRAGMENT_SHADER:
+      out->layout = key->layout;
+      out->render_pass = key->render_pass;
+      out->subpass = key->subpass;
+      out->spec = key->spec;
+      for (uint32_t i = 0; i < key->stage_count; i++) {
+        bool fragment = key->stages[i] == VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (fragment != (part == PART_FRAGMENT_SHADER)) continue;
+        out->stages[out->stage_count] = key->stages[i];
+        out->shader_hashes[out->stage_count] = key->shader_hashes[i];
+        out_shaders[out->stage_count++] = shaders[i];
+      }
+      if (part == PART_PRE_RASTERIZATION) {
+        out->state.polygon_mode = state->polygon_mode;
+        out->state.cull_mode = state->cull_mode;
+        out->state.front_face = state->front_face;
+      } else {
+        out->state.samples = state->samples;
+        out->state.depth_test = state->depth_test;
+        out->state.depth_write = state->depth_write;
+        out->state.depth_compare = state->depth_compare;
+      }
+      break;
+    case PART_FRAGMENT_OUTPUT:
+      out->render_pass = key->render_pass;
+      out->subpass = key->subpass;
+      out->state.samples = state->samples;
+      out->state.attachment_count = state->attachment_count;
+      memcpy(out->state.blend, state->blend, sizeof(state->blend));
+      break;
+    default: ASSERT(false);
+  }
+}
+/* Fill a create info from a key (state outside a library's part is unused) */
+static void fill_info(
+    pipeline_info_t *pi,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+) {
+  const vk_pipeline_state_t *state = &key->state;
+  memset(pi, 0, sizeof(pipeline_info_t));
+
+  /* Stages, sharing one specialization */
+  for (uint32_t i = 0; i < key->spec.count; i++) {
+    pi->map[i].constantID = key->spec.ids[i];
+    pi->map[i].offset = (uint32_t)(sizeof(uint32_t) * i);
+    pi->map[i].size = sizeof(uint32_t);
+  }
+  pi->spec.mapEntryCount = key->spec.count;
+  pi->spec.pMapEntries = pi->map;
+  pi->spec.dataSize = sizeof(uint32_t) * key->spec.count;
+  pi->spec.pData = key->spec.values;
+  for (uint32_t i = 0; i < key->stage_count; i++) {
+    vk_shader_stage_info(shaders[i], &pi->stages[i], &pi->modules[i]);
+    pi->stages[i].pSpecializationInfo = key->spec.count ? &pi->spec : NULL;
+  }
+
+  /* Fixed function state */
+  pi->vertex_input.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  pi->vertex_input.vertexBindingDescriptionCount = state->binding_count;
+  pi->vertex_input.pVertexBindingDescriptions = state->bindings;
+  pi->vertex_input.vertexAttributeDescriptionCount = state->attribute_count;
+  pi->vertex_input.pVertexAttributeDescriptions = state->attributes;
+  pi->input_assembly.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  pi->input_assembly.topology = state->topology;
+  pi->viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  pi->viewport.viewportCount = 1;
+  pi->viewport.scissorCount = 1;
+  pi->rasterization.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  pi->rasterization.polygonMode = state->polygon_mode;
+  pi->rasterization.cullMode = state->cull_mode;
+  pi->rasterization.frontFace = state->front_face;
+  pi->rasterization.lineWidth = 1.0f;
+  pi->multisample.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  pi->multisample.rasterizationSamples =
+    state->samples ? state->samples : VK_SAMPLE_COUNT_1_BIT;
+  pi->depth_stencil.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  pi->depth_stencil.depthTestEnable = state->depth_test;
+  pi->depth_stencil.depthWriteEnable = state->depth_write;
+  pi->depth_stencil.depthCompareOp = state->depth_compare;
+  pi->color_blend.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  pi->color_blend.attachmentCount = state->attachment_count;
+  pi->color_blend.pAttachments = state->blend;
+  pi->dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
+  pi->dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
+  pi->dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  pi->dynamic.dynamicStateCount = 2;
+  pi->dynamic.pDynamicStates = pi->dynamic_states;
+
+  /* Pipeline */
+  pi->info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pi->info.stageCount = key->stage_count;
+  pi->info.pStages = pi->stages;
+  pi->info.pVertexInputState = &pi->vertex_input;
+  pi->info.pInputAssemblyState = &pi->input_assembly;
+  pi->info.pViewportState = &pi->viewport;
+  pi->info.pRasterizationState = &pi->rasterization;
+  pi->info.pMultisampleState = &pi->multisample;
+  pi->info.pDepthStencilState = &pi->depth_stencil;
+  pi->info.pColorBlendState = &pi->color_blend;
+  pi->info.pDynamicState = &pi->dynamic;
+  pi->info.layout = key->layout;
+  pi->info.renderPass = key->render_pass;
+  pi->info.subpass = key->subpass;
+  pi->info.basePipelineIndex = -1;
+}
+/* Compile one library part */
+static VkPipeline compile_library(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_entry_t *entry
+) {
+  static const VkGraphicsPipelineLibraryFlagsEXT part_flags[PART_COUNT] = {
+    0,
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+  };
+  pipeline_info_t pi;
+  VkPipeline library;
+  fill_info(&pi, &entry->key, entry->shaders);
+  pi.library.sType =
+    VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+  pi.library.flags = part_flags[entry->part];
+  pi.info.pNext = &pi.library;
+  pi.info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR
+    | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+  VK_CHECK(vkCreateGraphicsPipelines(
+        pipelines->dev->device,
+        pipelines->cache,
+        1,
+        &pi.info,
+        NULL,
+        &library
+  ));
+  return library;
+}
+/* Get a library part, compiling it here or waiting for another thread */
+static VkPipeline acquire_library(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders,
+    uint32_t part
+) {
+  const vk_shader_t *part_shaders[VK_PIPELINE_MAX_STAGES];
+  vk_pipeline_key_t library_key;
+  vk_pipeline_entry_t *entry;
+  VkPipeline library;
+  uint64_t hash;
+
+  part_key(key, shaders, part, &library_key, part_shaders);
+  hash = hash64(&library_key, sizeof(vk_pipeline_key_t), part);
+  pthread_mutex_lock(&pipelines->library_mutex);
+  entry = table_find(&pipelines->libraries, hash, part, &library_key);
+  if (!entry) {
+    entry = entry_create(pipelines, &library_key, hash, part, part_shaders);
+    table_insert(&pipelines->libraries, entry);
+    pthread_mutex_unlock(&pipelines->library_mutex);
+    library = compile_library(pipelines, entry);
+    pthread_mutex_lock(&pipelines->library_mutex);
+    atomic_store(&entry->pipeline, library);
+    atomic_store(&entry->status, STATUS_READY);
+    pthread_cond_broadcast(&pipelines->library_cond);
+    pthread_mutex_unlock(&pipelines->library_mutex);
+    telemetry_report("pipeline.libraries", TELEMETRY_COUNTER, 1.0);
+    return library;
+  }
+  while (atomic_load(&entry->status) != STATUS_READY)
+    pthread_cond_wait(&pipelines->library_cond, &pipelines->library_mutex);
+  pthread_mutex_unlock(&pipelines->library_mutex);
+  return atomic_load(&entry->pipeline);
+}
+/* Link a pipeline from its library parts */
+static VkPipeline link_libraries(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const VkPipeline *libraries,
+    VkPipelineCreateFlags flags
+) {
+  VkPipelineLibraryCreateInfoKHR library_info;
+  VkGraphicsPipelineCreateInfo info;
+  VkPipeline pipeline;
+  library_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+  library_info.pNext = NULL;
+  library_info.libraryCount = PART_COUNT - 1;
+  library_info.pLibraries = libraries;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  info.pNext = &library_info;
+  info.flags = flags;
+  info.layout = key->layout;
+  info.basePipelineIndex = -1;
+  VK_CHECK(vkCreateGraphicsPipelines(
+        pipelines->dev->device,
+        pipelines->cache,
+        1,
+        &info,
+        NULL,
+        &pipeline
+  ));
+  return pipeline;
+}
+/* Compile a pipeline (job) */
+static void compile_job(void *arg) {
+  vk_pipeline_entry_t *entry = (vk_pipeline_entry_t *)arg;
+  vk_pipelines_t *pipelines = entry->pipelines;
+  double start = time_now();
+  VkPipeline pipeline;
+
+  if (pipelines->use_libraries) {
+    VkPipeline libraries[PART_COUNT - 1];
+    for (uint32_t part = PART_VERTEX_INPUT; part < PART_COUNT; part++) {
+      libraries[part - 1] =
+        acquire_library(pipelines, &entry->key, entry->shaders, part);
+    }
+
+    /* Fast link to use now, then an optimized link to use from then on */
+    pipeline = link_libraries(pipelines, &entry->key, libraries, 0);
+    atomic_store(&entry->pipeline, pipeline);
+    atomic_store(&entry->status, STATUS_READY);
+    telemetry_report(
+        "pipeline.compile",
+        TELEMETRY_TIMING,
+        (time_now() - start) * 1000.0
+    );
+    entry->replaced = pipeline;
+    atomic_store(&entry->pipeline, link_libraries(
+          pipelines,
+          &entry->key,
+          libraries,
+          VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT
+    ));
+  } else {
+    pipeline_info_t pi;
+    fill_info(&pi, &entry->key, entry->shaders);
+    VK_CHECK(vkCreateGraphicsPipelines(
+          pipelines->dev->device,
+          pipelines->cache,
+          1,
+          &pi.info,
+          NULL,
+          &pipeline
+    ));
+    atomic_store(&entry->pipeline, pipeline);
+    atomic_store(&entry->status, STATUS_READY);
+    telemetry_report(
+        "pipeline.compile",
+        TELEMETRY_TIMING,
+        (time_now() - start) * 1000.0
+    );
+  }
+}
+/* Find a key's entry, queueing its compile if it's new */
+static vk_pipeline_entry_t *request(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+) {
+  uint64_t hash = hash64(key, sizeof(vk_pipeline_key_t), PART_PIPELINE);
+  vk_pipeline_entry_t *entry;
+  ASSERT(key->stage_count <= VK_PIPELINE_MAX_STAGES);
+  ASSERT(key->spec.count <= VK_PIPELINE_MAX_SPEC);
+  pthread_mutex_lock(&pipelines->mutex);
+  entry = table_find(&pipelines->table, hash, PART_PIPELINE, key);
+  if (!entry) {
+    entry = entry_create(pipelines, key, hash, PART_PIPELINE, shaders);
+    table_insert(&pipelines->table, entry);
+    entry->job.fn = compile_job;
+    entry->job.arg = entry;
+    entry->job.counter = &pipelines->in_flight;
+    jobs_submit(pipelines->jobs, &entry->job);
+  }
+  pthread_mutex_unlock(&pipelines->mutex);
+  return entry;
+}
+
+/* Start a key with everything zeroed */
+void vk_pipeline_key_init(vk_pipeline_key_t *key) {
+  memset(key, 0, sizeof(vk_pipeline_key_t));
+}
+/* Create a pipeline manager (cache may be VK_NULL_HANDLE) */
+void vk_pipelines_create(
+    vk_pipelines_t *pipelines,
+    vk_dev_t *dev,
+    VkPipelineCache cache,
+    jobs_t *jobs
+) {
+  pipelines->dev = dev;
+  pipelines->cache = cache;
+  pipelines->jobs = jobs;
+  atomic_init(&pipelines->in_flight.value, 0);
+  pipelines->use_libraries = vk_dev_has_ext(
+      dev,
+      VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+  );
+  pthread_mutex_init(&pipelines->mutex, NULL);
+  table_create(&pipelines->table);
+  pthread_mutex_init(&pipelines->library_mutex, NULL);
+  pthread_cond_init(&pipelines->library_cond, NULL);
+  table_create(&pipelines->libraries);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Pipelines compile %s",
+      pipelines->use_libraries
+        ? "from graphics pipeline libraries"
+        : "as whole pipelines"
+  );
+}
+/* Get the best pipeline ready for a key, queueing compiles as needed */
+VkPipeline vk_pipelines_get(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+) {
+  vk_pipeline_entry_t *entry = request(pipelines, key, shaders);
+  vk_pipeline_key_t generic;
+
+  if (atomic_load(&entry->status) == STATUS_READY)
+    return atomic_load(&entry->pipeline);
+  telemetry_report("pipeline.fallbacks", TELEMETRY_COUNTER, 1.0);
+  if (key->spec.count == 0) return VK_NULL_HANDLE;
+
+  /* Fall back to the shaders' default constants */
+  memcpy(&generic, key, sizeof(vk_pipeline_key_t));
+  memset(&generic.spec, 0, sizeof(vk_pipeline_spec_t));
+  entry = request(pipelines, &generic, shaders);
+  if (atomic_load(&entry->status) == STATUS_READY)
+    return atomic_load(&entry->pipeline);
+  return VK_NULL_HANDLE;
+}
+/* Queue a key's compile without using it yet */
+void vk_pipelines_prepare(
+    vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key,
+    const vk_shader_t *const *shaders
+) {
+  request(pipelines, key, shaders);
+}
+/* Wait for every queued compile (helping with jobs meanwhile) */
+void vk_pipelines_wait(vk_pipelines_t *pipelines) {
+  jobs_wait(pipelines->jobs, &pipelines->in_flight);
+}
+/* Destroy a pipeline manager and its pipelines (waiting for compiles) */
+void vk_pipelines_destroy(vk_pipelines_t *pipelines) {
+  vk_pipelines_wait(pipelines);
+  table_destroy(&pipelines->table, pipelines->dev->device);
+  table_destroy(&pipelines->libraries, pipelines->dev->device);
+  pthread_mutex_destroy(&pipelines->mutex);
+  pthread_mutex_destroy(&pipelines->library_mutex);
+  pthread_cond_destroy(&pipelines->library_cond);
+  memset(pipelines, 0, sizeof(vk_pipelines_t));
+}
@@ -0,0 +1,379 @@
+/* Implements vk_present.h */
+#include <vk_present.h>
+#include <vk_capture.h>
+#include <telemetry.h>
+
+/* Capacity of the retired swapchain list */
+#define VK_PRESENT_MAX_RETIRED \
+  (sizeof(((vk_present_t *)0)->retired) / sizeof(vk_present_retired_t))
+
+/* Clamp a value to a range */
+static uint32_t clamp_u32(uint32_t value, uint32_t min, uint32_t max) {
+  if (value < min) return min;
+  if (value > max) return max;
+  return value;
+}
+/* Destroy retired swapchains no frame slot can still be using */
+static void destroy_retired(vk_present_t *present, bool all) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < present->retired_count; i++) {
+    vk_present_retired_t *retired = &present->retired[i];
+    if (all || present->frame_number - retired->frame > present->frames) {
+      vk_swapchain_destroy(&retired->swapchain, present->dev);
+    } else present->retired[kept++] = *retired;
+  }
+  present->retired_count = kept;
+}
+/* Rebuild a view's swapchain at its requested size (false if it can't be) */
+static bool rebuild(vk_present_t *present, vk_present_view_t *view) {
+  vk_swapchain_builder_t builder = vk_swapchain_builder();
+  VkSurfaceCapabilitiesKHR caps;
+  VkExtent2D extent;
+  uint32_t image_count;
+
+  if (present->retired_count == VK_PRESENT_MAX_RETIRED) return false;
+  VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+        present->phys_dev,
+        view->surface,
+        &caps
+  ));
+  if (caps.currentExtent.width != UINT32_MAX) {
+    extent = caps.currentExtent;
+  } else {
+    extent.width = clamp_u32(
+        view->width,
+        caps.minImageExtent.width,
+        caps.maxImageExtent.width
+    );
+    extent.height = clamp_u32(
+        view->height,
+        caps.minImageExtent.height,
+        caps.maxImageExtent.height
+    );
+  }
+  if (extent.width == 0 || extent.height == 0) return false;
+  image_count = caps.minImageCount + 1;
+  if (caps.maxImageCount > 0 && image_count > caps.maxImageCount)
+    image_count = caps.maxImageCount;
+
+  vk_swapchain_builder_set_format(&builder, view->format);
+  vk_swapchain_builder_set_extent(&builder, extent.width, extent.height);
+  vk_swapchain_builder_set_image_count(&builder, image_count);
+  vk_swapchain_builder_set_present_mode(&builder, VK_PRESENT_MODE_FIFO_KHR);
+  vk_swapchain_builder_set_clipped(&builder, true);
+  vk_swapchain_builder_set_image_usage(
+      &builder,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+  );
+  vk_swapchain_builder_set_image_array_layers(&builder, 1);
+  vk_swapchain_builder_set_old_swapchain(&builder, view->swapchain.swapchain);
+  vk_swapchain_builder_set_pre_transform(&builder, caps.currentTransform);
+  vk_swapchain_builder_set_composite_alpha(
+      &builder,
+      VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR
+  );
+  if (present->present_family != present->graphics_family) {
+    vk_swapchain_builder_add_queue_family_index(
+        &builder,
+        present->present_family
+    );
+    vk_swapchain_builder_add_queue_family_index(
+        &builder,
+        present->graphics_family
+    );
+  }
+
+  /* The old swapchain may still be presenting, so it's retired */
+  if (view->swapchain.swapchain != VK_NULL_HANDLE) {
+    present->retired[present->retired_count].swapchain = view->swapchain;
+    present->retired[present->retired_count++].frame = present->frame_number;
+  }
+  view->swapchain = vk_swapchain_create(present->dev, &view->surface, &builder);
+  view->extent = extent;
+  view->out_of_date = false;
+  telemetry_report("present.rebuilds", TELEMETRY_COUNTER, 1.0);
+  return true;
+}
+/* Try to acquire a view's next image (false if none was acquired) */
+static bool acquire(
+    vk_present_t *present,
+    uint32_t index,
+    uint64_t timeout
+) {
+  vk_present_view_t *view = &present->views[index];
+  vk_present_image_t *image;
+  uint32_t image_index;
+  VkResult result;
+
+  if (view->out_of_date && !rebuild(present, view)) return false;
+  result = vkAcquireNextImageKHR(
+      present->dev->device,
+      view->swapchain.swapchain,
+      timeout,
+      view->image_available[present->frame],
+      VK_NULL_HANDLE,
+      &image_index
+  );
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    /* Rebuild once and retry */
+    view->out_of_date = true;
+    if (!rebuild(present, view)) return false;
+    result = vkAcquireNextImageKHR(
+        present->dev->device,
+        view->swapchain.swapchain,
+        timeout,
+        view->image_available[present->frame],
+        VK_NULL_HANDLE,
+        &image_index
+    );
+  }
+  if (
+      result == VK_TIMEOUT
+      || result == VK_NOT_READY
+      || result == VK_ERROR_OUT_OF_DATE_KHR
+  ) {
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) view->out_of_date = true;
+    return false;
+  }
+  if (result == VK_SUBOPTIMAL_KHR) view->out_of_date = true;
+  else VK_CHECK(result);
+
+  image = &present->images[present->image_count++];
+  image->view = index;
+  image->image_index = image_index;
+  image->image = view->swapchain.images[image_index];
+  image->format = view->format.format;
+  image->extent = view->extent;
+  image->image_available = view->image_available[present->frame];
+  image->render_finished = view->render_finished[present->frame];
+  return true;
+}
+
+/* Create a presentation manager for frames frames in flight */
+void vk_present_create(
+    vk_present_t *present,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    uint32_t frames
+) {
+  ASSERT(frames > 0 && frames <= VK_PRESENT_MAX_FRAMES);
+  memset(present, 0, sizeof(vk_present_t));
+  present->dev = dev;
+  present->phys_dev = phys_dev;
+  present->present_family = phys_dev_info->queue_families.present_index;
+  present->graphics_family = phys_dev_info->queue_families.graphics_index;
+  present->frames = frames;
+}
+/* Add a view of a surface (returns its index, or UINT32_MAX on failure) */
+uint32_t vk_present_add(
+    vk_present_t *present,
+    vk_surf_t surface,
+    uint32_t width,
+    uint32_t height,
+    void *user
+) {
+  vk_present_view_t *view = NULL;
+  VkSemaphoreCreateInfo semaphore_info;
+  VkSurfaceFormatKHR *formats;
+  VkBool32 supported = VK_FALSE;
+  uint32_t index, format_count = 0;
+
+  for (index = 0; index < VK_PRESENT_MAX_VIEWS; index++) {
+    if (!present->views[index].used) {
+      view = &present->views[index];
+      break;
+    }
+  }
+  if (!view) {
+    log_msg(LOG_LEVEL_ERROR, "Too many views (%d)", VK_PRESENT_MAX_VIEWS);
+    return UINT32_MAX;
+  }
+  VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(
+        present->phys_dev,
+        present->present_family,
+        surface,
+        &supported
+  ));
+  if (!supported) {
+    log_msg(LOG_LEVEL_ERROR, "Surface can't be presented to");
+    return UINT32_MAX;
+  }
+
+  /* Prefer an sRGB format, else whatever comes first */
+  VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(
+        present->phys_dev,
+        surface,
+        &format_count,
+        NULL
+  ));
+  if (format_count == 0) return UINT32_MAX;
+  formats = (VkSurfaceFormatKHR *)malloc(
+      sizeof(VkSurfaceFormatKHR) * format_count
+  );
+  ASSERT(formats);
+  VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(
+        present->phys_dev,
+        surface,
+        &format_count,
+        formats
+  ));
+  memset(view, 0, sizeof(vk_present_view_t));
+  view->format = formats[0];
+  for (uint32_t i = 0; i < format_count; i++) {
+    if (formats[i].format == VK_FORMAT_B8G8R8A8_SRGB) {
+      view->format = formats[i];
+      break;
+    }
+  }
+  free(formats);
+
+  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphore_info.pNext = NULL;
+  semaphore_info.flags = 0;
+  for (uint32_t i = 0; i < present->frames; i++) {
+    VK_CHECK(vkCreateSemaphore(
+          present->dev->device,
+          &semaphore_info,
+          NULL,
+          &view->image_available[i]
+    ));
+    VK_CHECK(vkCreateSemaphore(
+          present->dev->device,
+          &semaphore_info,
+          NULL,
+          &view->render_finished[i]
+    ));
+  }
+  view->used = true;
+  view->user = user;
+  view->surface = surface;
+  view->width = width;
+  view->height = height;
+  view->out_of_date = true;
+  rebuild(present, view);
+  return index;
+}
+/* Find the view of a caller's window (UINT32_MAX if none) */
+uint32_t vk_present_find(const vk_present_t *present, void *user) {
+  for (uint32_t i = 0; i < VK_PRESENT_MAX_VIEWS; i++) {
+    if (present->views[i].used && present->views[i].user == user) return i;
+  }
+  return UINT32_MAX;
+}
+/* Resize a view (rebuilt at the next acquire, skipped while 0x0) */
+void vk_present_resize(
+    vk_present_t *present,
+    uint32_t view,
+    uint32_t width,
+    uint32_t height
+) {
+  ASSERT(view < VK_PRESENT_MAX_VIEWS && present->views[view].used);
+  present->views[view].width = width;
+  present->views[view].height = height;
+  present->views[view].out_of_date = true;
+}
+/* Remove a view, waiting for the queues (the surface is left to the caller) */
+void vk_present_remove(
+    vk_present_t *present,
+    vk_submit_t *submit,
+    uint32_t view
+) {
+  vk_present_view_t *removed = &present->views[view];
+  ASSERT(view < VK_PRESENT_MAX_VIEWS && removed->used);
+  vk_submit_wait_idle(submit);
+  for (uint32_t i = 0; i < present->frames; i++) {
+    vkDestroySemaphore(present->dev->device, removed->image_available[i], NULL);
+    vkDestroySemaphore(present->dev->device, removed->render_finished[i], NULL);
+  }
+  destroy_retired(present, true);
+  if (removed->swapchain.swapchain != VK_NULL_HANDLE)
+    vk_swapchain_destroy(&removed->swapchain, present->dev);
+  memset(removed, 0, sizeof(vk_present_view_t));
+}
+/* Acquire an image from each view that has one (returns the count) */
+uint32_t vk_present_acquire(vk_present_t *present, uint32_t frame) {
+  uint32_t drawable = UINT32_MAX;
+  ASSERT(frame < present->frames);
+  present->frame = frame;
+  present->frame_number++;
+  present->image_count = 0;
+  destroy_retired(present, false);
+
+  /* Take whatever's ready without waiting on any one view */
+  for (uint32_t i = 0; i < VK_PRESENT_MAX_VIEWS; i++) {
+    const vk_present_view_t *view = &present->views[i];
+    if (!view->used || view->width == 0 || view->height == 0) continue;
+    if (drawable == UINT32_MAX) drawable = i;
+    if (!acquire(present, i, 0))
+      telemetry_report("present.skipped", TELEMETRY_COUNTER, 1.0);
+  }
+
+  /* Nothing was ready, so wait on one view rather than spin */
+  if (present->image_count == 0 && drawable != UINT32_MAX)
+    acquire(present, drawable, UINT64_MAX);
+  return present->image_count;
+}
+/* Present every acquired image with one call (flushing submissions) */
+VkResult vk_present_submit(vk_present_t *present, vk_submit_t *submit) {
+  VkSwapchainKHR swapchains[VK_PRESENT_MAX_VIEWS];
+  VkSemaphore waits[VK_PRESENT_MAX_VIEWS];
+  uint32_t indices[VK_PRESENT_MAX_VIEWS];
+  VkResult results[VK_PRESENT_MAX_VIEWS];
+  VkPresentInfoKHR present_info;
+  VkResult result;
+
+  vk_capture_frame();
+  if (present->image_count == 0) {
+    vk_submit_flush(submit);
+    return VK_SUCCESS;
+  }
+  for (uint32_t i = 0; i < present->image_count; i++) {
+    const vk_present_image_t *image = &present->images[i];
+    swapchains[i] = present->views[image->view].swapchain.swapchain;
+    waits[i] = image->render_finished;
+    indices[i] = image->image_index;
+    results[i] = VK_SUCCESS;
+  }
+  present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  present_info.pNext = NULL;
+  present_info.waitSemaphoreCount = present->image_count;
+  present_info.pWaitSemaphores = waits;
+  present_info.swapchainCount = present->image_count;
+  present_info.pSwapchains = swapchains;
+  present_info.pImageIndices = indices;
+  present_info.pResults = results;
+  result = vk_submit_present(submit, &present_info);
+  telemetry_report(
+      "present.views",
+      TELEMETRY_GAUGE,
+      (double)present->image_count
+  );
+
+  /* Out of date views are rebuilt at their next acquire */
+  for (uint32_t i = 0; i < present->image_count; i++) {
+    if (
+        results[i] == VK_ERROR_OUT_OF_DATE_KHR
+        || results[i] == VK_SUBOPTIMAL_KHR
+    ) present->views[present->images[i].view].out_of_date = true;
+  }
+  present->image_count = 0;
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    return VK_SUCCESS;
+  return result;
+}
+/* Destroy a presentation manager (the device must be idle) */
+void vk_present_destroy(vk_present_t *present) {
+  destroy_retired(present, true);
+  for (uint32_t i = 0; i < VK_PRESENT_MAX_VIEWS; i++) {
+    vk_present_view_t *view = &present->views[i];
+    if (!view->used) continue;
+    for (uint32_t j = 0; j < present->frames; j++) {
+      vkDestroySemaphore(present->dev->device, view->image_available[j], NULL);
+      vkDestroySemaphore(present->dev->device, view->render_finished[j], NULL);
+    }
+    if (view->swapchain.swapchain != VK_NULL_HANDLE)
+      vk_swapchain_destroy(&view->swapchain, present->dev);
+  }
+  memset(present, 0, sizeof(vk_present_t));
+}
@@ -0,0 +1,284 @@
+/* Implements vk_residency.h */
+#include <vk_residency.h>
+#include <telemetry.h>
+
+/* Types */
+/* Eviction candidate */
+typedef struct {
+  uint32_t id;
+  uint64_t last_used;
+} candidate_t;
+
+/* Sort candidates, least recently used first */
+static int compare_candidates(const void *a, const void *b) {
+  const candidate_t *ca = (const candidate_t *)a;
+  const candidate_t *cb = (const candidate_t *)b;
+  if (ca->last_used != cb->last_used)
+    return ca->last_used < cb->last_used ? -1 : 1;
+  return ca->id < cb->id ? -1 : ca->id > cb->id;
+}
+/* Get a percentage of a size */
+static VkDeviceSize percent_of(VkDeviceSize size, uint32_t percent) {
+  return size / 100u * percent + size % 100u * percent / 100u;
+}
+/* Get the bytes registered resources have promised to free from a heap */
+static VkDeviceSize heap_releasing(
+    const vk_residency_t *residency,
+    uint32_t heap
+) {
+  VkDeviceSize releasing = 0;
+  for (uint32_t i = 0; i < residency->entry_count; i++) {
+    const vk_residency_entry_t *entry = &residency->entries[i];
+    if (entry->active && entry->heap == heap) releasing += entry->releasing;
+  }
+  return releasing;
+}
+/* Read the heap budgets and usage */
+static void poll_budgets(vk_residency_t *residency) {
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget;
+  VkPhysicalDeviceMemoryProperties2 properties;
+
+  if (residency->use_budget_ext) {
+    memset(&budget, 0, sizeof(budget));
+    budget.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    budget.pNext = NULL;
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(residency->phys_dev, &properties);
+  }
+  for (uint32_t i = 0; i < residency->heap_count; i++) {
+    vk_residency_heap_t *heap = &residency->heaps[i];
+    if (residency->use_budget_ext && budget.heapBudget[i] > 0) {
+      heap->budget = budget.heapBudget[i];
+      heap->usage = budget.heapUsage[i];
+    } else {
+      heap->budget = percent_of(heap->size, VK_RESIDENCY_HEAP_SHARE);
+      heap->usage = heap->tracked;
+    }
+  }
+}
+/* Report a heap's state as telemetry */
+static void report_heap(const vk_residency_heap_t *heap, uint32_t index) {
+  char name[TELEMETRY_MAX_NAME];
+  snprintf(name, sizeof(name), "memory.heap%u.usage_mb", index);
+  telemetry_report(
+      name,
+      TELEMETRY_GAUGE,
+      (double)heap->usage / (1024.0 * 1024.0)
+  );
+  snprintf(name, sizeof(name), "memory.heap%u.budget_mb", index);
+  telemetry_report(
+      name,
+      TELEMETRY_GAUGE,
+      (double)heap->budget / (1024.0 * 1024.0)
+  );
+  snprintf(name, sizeof(name), "memory.heap%u.tracked_mb", index);
+  telemetry_report(
+      name,
+      TELEMETRY_GAUGE,
+      (double)heap->tracked / (1024.0 * 1024.0)
+  );
+}
+/* Evict least recently used resources until a heap is below low water */
+static void evict_heap(
+    vk_residency_t *residency,
+    uint32_t heap,
+    candidate_t *candidates
+) {
+  const vk_residency_heap_t *state = &residency->heaps[heap];
+  VkDeviceSize target = percent_of(state->budget, VK_RESIDENCY_LOW_WATER);
+  VkDeviceSize releasing = heap_releasing(residency, heap);
+  VkDeviceSize projected =
+    state->usage > releasing ? state->usage - releasing : 0;
+  uint32_t candidate_count = 0;
+
+  if (projected <= target) return;
+
+  /* Streamable, resident, not used this frame and not already leaving */
+  for (uint32_t i = 0; i < residency->entry_count; i++) {
+    const vk_residency_entry_t *entry = &residency->entries[i];
+    if (
+        !entry->active
+        || !entry->evict
+        || entry->heap != heap
+        || entry->size == 0
+        || entry->releasing > 0
+        || entry->last_used >= residency->frame_counter
+    ) continue;
+    candidates[candidate_count].id = i;
+    candidates[candidate_count].last_used = entry->last_used;
+    candidate_count++;
+  }
+  if (candidate_count > 1) qsort(
+      candidates,
+      candidate_count,
+      sizeof(candidate_t),
+      compare_candidates
+  );
+
+  for (uint32_t i = 0; i < candidate_count && projected > target; i++) {
+    vk_residency_entry_t *entry = &residency->entries[candidates[i].id];
+    VkDeviceSize freed = entry->evict(residency->dev, entry->user, entry->key);
+    if (freed == 0) continue;
+    if (freed > entry->size) freed = entry->size;
+    entry->releasing = freed;
+    projected = projected > freed ? projected - freed : 0;
+    telemetry_report("memory.evictions", TELEMETRY_COUNTER, 1.0);
+    telemetry_report(
+        "memory.evicted_mb",
+        TELEMETRY_COUNTER,
+        (double)freed / (1024.0 * 1024.0)
+    );
+  }
+  if (projected > target)
+    telemetry_report("memory.over_budget", TELEMETRY_COUNTER, 1.0);
+}
+
+/* Create a residency manager (polls budgets once) */
+void vk_residency_create(
+    vk_residency_t *residency,
+    vk_dev_t *dev,
+    vk_phys_dev_t phys_dev,
+    const vk_phys_dev_info_t *phys_dev_info
+) {
+  const VkPhysicalDeviceMemoryProperties *properties =
+    &phys_dev_info->memory_properties;
+
+  memset(residency, 0, sizeof(vk_residency_t));
+  residency->dev = dev;
+  residency->phys_dev = phys_dev;
+  residency->phys_dev_info = phys_dev_info;
+  residency->use_budget_ext =
+    vk_dev_has_ext(dev, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  residency->heap_count = properties->memoryHeapCount;
+  for (uint32_t i = 0; i < residency->heap_count; i++)
+    residency->heaps[i].size = properties->memoryHeaps[i].size;
+  poll_budgets(residency);
+
+  for (uint32_t i = 0; i < residency->heap_count; i++) {
+    log_msg(
+        LOG_LEVEL_INFO,
+        "Memory heap %u: %.1f MB, budget %.1f MB (%s)",
+        i,
+        (double)residency->heaps[i].size / (1024.0 * 1024.0),
+        (double)residency->heaps[i].budget / (1024.0 * 1024.0),
+        residency->use_budget_ext ? "reported" : "estimated"
+    );
+  }
+}
+/* Register a resource (evict may be NULL), initially with nothing resident */
+uint32_t vk_residency_add(
+    vk_residency_t *residency,
+    vk_residency_evict_fn_t evict,
+    void *user,
+    uint32_t key
+) {
+  vk_residency_entry_t *entry;
+  uint32_t id;
+
+  if (residency->free_count > 0) {
+    id = residency->free_ids[--residency->free_count];
+  } else {
+    if (residency->entry_count == residency->entry_capacity) {
+      residency->entry_capacity =
+        residency->entry_capacity ? residency->entry_capacity * 2 : 64;
+      residency->entries = (vk_residency_entry_t *)realloc(
+          residency->entries,
+          sizeof(vk_residency_entry_t) * residency->entry_capacity
+      );
+      residency->free_ids = (uint32_t *)realloc(
+          residency->free_ids,
+          sizeof(uint32_t) * residency->entry_capacity
+      );
+      ASSERT(residency->entries && residency->free_ids);
+    }
+    id = residency->entry_count++;
+  }
+  entry = &residency->entries[id];
+  memset(entry, 0, sizeof(vk_residency_entry_t));
+  entry->evict = evict;
+  entry->user = user;
+  entry->key = key;
+  entry->last_used = residency->frame_counter;
+  entry->active = true;
+  return id;
+}
+/* Set the bytes a resource holds in a memory type's heap */
+void vk_residency_set_size(
+    vk_residency_t *residency,
+    uint32_t id,
+    uint32_t memory_type,
+    VkDeviceSize size
+) {
+  vk_residency_entry_t *entry = &residency->entries[id];
+  ASSERT(id < residency->entry_count && entry->active);
+  ASSERT(
+      memory_type
+      < residency->phys_dev_info->memory_properties.memoryTypeCount
+  );
+  residency->heaps[entry->heap].tracked -= entry->size;
+  entry->heap = residency->phys_dev_info->memory_properties
+    .memoryTypes[memory_type].heapIndex;
+  entry->size = size;
+  entry->releasing = 0;
+  residency->heaps[entry->heap].tracked += size;
+}
+/* Mark a resource used this frame */
+void vk_residency_touch(vk_residency_t *residency, uint32_t id) {
+  ASSERT(id < residency->entry_count && residency->entries[id].active);
+  residency->entries[id].last_used = residency->frame_counter;
+}
+/* Unregister a resource */
+void vk_residency_remove(vk_residency_t *residency, uint32_t id) {
+  vk_residency_entry_t *entry = &residency->entries[id];
+  ASSERT(id < residency->entry_count && entry->active);
+  residency->heaps[entry->heap].tracked -= entry->size;
+  memset(entry, 0, sizeof(vk_residency_entry_t));
+  residency->free_ids[residency->free_count++] = id;
+}
+/* Get the bytes allocatable from a memory type's heap below high water */
+VkDeviceSize vk_residency_room(
+    const vk_residency_t *residency,
+    uint32_t memory_type
+) {
+  const vk_residency_heap_t *heap;
+  VkDeviceSize limit;
+  ASSERT(
+      memory_type
+      < residency->phys_dev_info->memory_properties.memoryTypeCount
+  );
+  heap = &residency->heaps[
+    residency->phys_dev_info->memory_properties
+      .memoryTypes[memory_type].heapIndex
+  ];
+  limit = percent_of(heap->budget, VK_RESIDENCY_HIGH_WATER);
+  return heap->usage < limit ? limit - heap->usage : 0;
+}
+/* Poll budgets, report them, and evict from heaps over high water */
+void vk_residency_update(vk_residency_t *residency) {
+  candidate_t *candidates = NULL;
+
+  residency->frame_counter++;
+  poll_budgets(residency);
+  for (uint32_t i = 0; i < residency->heap_count; i++) {
+    const vk_residency_heap_t *heap = &residency->heaps[i];
+    report_heap(heap, i);
+    if (heap->usage <= percent_of(heap->budget, VK_RESIDENCY_HIGH_WATER))
+      continue;
+    if (!candidates && residency->entry_count > 0) {
+      candidates = (candidate_t *)malloc(
+          sizeof(candidate_t) * residency->entry_count
+      );
+      ASSERT(candidates);
+    }
+    evict_heap(residency, i, candidates);
+  }
+  free(candidates);
+}
+/* Destroy a residency manager */
+void vk_residency_destroy(vk_residency_t *residency) {
+  free(residency->entries);
+  free(residency->free_ids);
+  memset(residency, 0, sizeof(vk_residency_t));
+}
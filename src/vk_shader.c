@@ -0,0 +1,613 @@
+/* Implements vk_shader.h */
+#include <vk_shader.h>
+#include <vk_dev_cache.h>
+
+/* SPIR-V magic number and header size (words) */
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_HEADER_WORDS 5u
+/* Opcodes */
+#define OP_ENTRY_POINT 15u
+#define OP_TYPE_INT 21u
+#define OP_TYPE_FLOAT 22u
+#define OP_TYPE_VECTOR 23u
+#define OP_TYPE_MATRIX 24u
+#define OP_TYPE_IMAGE 25u
+#define OP_TYPE_SAMPLER 26u
+#define OP_TYPE_SAMPLED_IMAGE 27u
+#define OP_TYPE_ARRAY 28u
+#define OP_TYPE_RUNTIME_ARRAY 29u
+#define OP_TYPE_STRUCT 30u
+#define OP_TYPE_POINTER 32u
+#define OP_CONSTANT 43u
+#define OP_VARIABLE 59u
+#define OP_DECORATE 71u
+#define OP_MEMBER_DECORATE 72u
+#define OP_TYPE_ACCELERATION_STRUCTURE 5341u
+/* Decorations */
+#define DECORATION_BUFFER_BLOCK 3u
+#define DECORATION_ARRAY_STRIDE 6u
+#define DECORATION_MATRIX_STRIDE 7u
+#define DECORATION_BINDING 33u
+#define DECORATION_DESCRIPTOR_SET 34u
+#define DECORATION_OFFSET 35u
+/* Storage classes */
+#define STORAGE_UNIFORM_CONSTANT 0u
+#define STORAGE_UNIFORM 2u
+#define STORAGE_PUSH_CONSTANT 9u
+#define STORAGE_STORAGE_BUFFER 12u
+/* Image dimensions */
+#define DIM_BUFFER 5u
+#define DIM_SUBPASS_DATA 6u
+/* Most descriptor sets a pipeline layout is built with */
+#define VK_SHADER_MAX_SETS 8u
+/* Deepest type nesting followed when sizing push constants */
+#define VK_SHADER_MAX_TYPE_DEPTH 8u
+
+/* Types */
+/* What reflection needs to know about an id */
+typedef struct {
+  uint32_t opcode;
+  uint32_t word;                  /* Offset of the defining instruction */
+  uint32_t set, binding;
+  uint32_t array_stride;
+  bool has_set, has_binding, buffer_block;
+} spirv_id_t;
+/* Struct member decoration */
+typedef struct {
+  uint32_t id, member, decoration, value;
+} spirv_member_t;
+/* Parsed module */
+typedef struct {
+  const uint32_t *code;
+  uint32_t word_count;
+  uint32_t bound;
+  spirv_id_t *ids;
+  spirv_member_t *members;
+  uint32_t member_count, member_capacity;
+} spirv_t;
+
+/* Get an id's defining instruction word (0 if undefined) */
+static uint32_t id_word(const spirv_t *spirv, uint32_t id, uint32_t opcode) {
+  if (id >= spirv->bound || spirv->ids[id].opcode != opcode) return 0;
+  return spirv->ids[id].word;
+}
+/* Get a struct member's decoration (false if undecorated) */
+static bool member_decoration(
+    const spirv_t *spirv,
+    uint32_t id,
+    uint32_t member,
+    uint32_t decoration,
+    uint32_t *value
+) {
+  for (uint32_t i = 0; i < spirv->member_count; i++) {
+    const spirv_member_t *entry = &spirv->members[i];
+    if (
+        entry->id == id
+        && entry->member == member
+        && entry->decoration == decoration
+    ) {
+      *value = entry->value;
+      return true;
+    }
+  }
+  return false;
+}
+/* Get a type's size in bytes (as laid out in a block) */
+static uint32_t type_size(const spirv_t *spirv, uint32_t id, uint32_t depth) {
+  const uint32_t *code = spirv->code;
+  uint32_t word;
+  if (id >= spirv->bound || depth > VK_SHADER_MAX_TYPE_DEPTH) return 0;
+  word = spirv->ids[id].word;
+  switch (spirv->ids[id].opcode) {
+    case OP_TYPE_INT:
+    case OP_TYPE_FLOAT:
+      return code[word + 2] / 8;
+    case OP_TYPE_VECTOR:
+    case OP_TYPE_MATRIX:
+      return code[word + 3] * type_size(spirv, code[word + 2], depth + 1);
+    case OP_TYPE_ARRAY: {
+      uint32_t length = id_word(spirv, code[word + 3], OP_CONSTANT);
+      uint32_t stride = spirv->ids[id].array_stride;
+      if (!length) return 0;
+      if (!stride) stride = type_size(spirv, code[word + 2], depth + 1);
+      return code[length + 3] * stride;
+    }
+    case OP_TYPE_STRUCT: {
+      uint32_t member_count = (code[word] >> 16) - 2;
+      uint32_t end = 0;
+      for (uint32_t i = 0; i < member_count; i++) {
+        uint32_t member_type = code[word + 2 + i];
+        uint32_t offset = 0, stride, size;
+        member_decoration(spirv, id, i, DECORATION_OFFSET, &offset);
+        size = type_size(spirv, member_type, depth + 1);
+        if (
+            member_type < spirv->bound
+            && spirv->ids[member_type].opcode == OP_TYPE_MATRIX
+            && member_decoration(
+              spirv,
+              id,
+              i,
+              DECORATION_MATRIX_STRIDE,
+              &stride
+            )
+        ) size = code[spirv->ids[member_type].word + 3] * stride;
+        if (offset + size > end) end = offset + size;
+      }
+      return end;
+    }
+    default:
+      return 0;
+  }
+}
+/* Get the range of a push constant block's members */
+static void push_constant_range(
+    const spirv_t *spirv,
+    uint32_t struct_id,
+    VkPushConstantRange *range
+) {
+  uint32_t word = id_word(spirv, struct_id, OP_TYPE_STRUCT);
+  uint32_t member_count, start = UINT32_MAX;
+  if (!word) return;
+  member_count = (spirv->code[word] >> 16) - 2;
+  for (uint32_t i = 0; i < member_count; i++) {
+    uint32_t offset = 0;
+    member_decoration(spirv, struct_id, i, DECORATION_OFFSET, &offset);
+    if (offset < start) start = offset;
+  }
+  if (start == UINT32_MAX) return;
+  range->offset = start;
+  range->size = type_size(spirv, struct_id, 0) - start;
+}
+/* Work out a resource variable's descriptor type and count */
+static bool descriptor_type(
+    const spirv_t *spirv,
+    uint32_t type_id,
+    uint32_t storage,
+    VkDescriptorType *type,
+    uint32_t *count
+) {
+  const uint32_t *code = spirv->code;
+  uint32_t depth = 0;
+
+  /* Unwrap arrays */
+  *count = 1;
+  while (type_id < spirv->bound && depth++ < VK_SHADER_MAX_TYPE_DEPTH) {
+    uint32_t word = spirv->ids[type_id].word;
+    if (spirv->ids[type_id].opcode == OP_TYPE_ARRAY) {
+      uint32_t length = id_word(spirv, code[word + 3], OP_CONSTANT);
+      if (!length) return false;
+      *count *= code[length + 3];
+    } else if (spirv->ids[type_id].opcode == OP_TYPE_RUNTIME_ARRAY) {
+      *count = 0;
+    } else break;
+    type_id = code[word + 2];
+  }
+  if (type_id >= spirv->bound) return false;
+
+  switch (spirv->ids[type_id].opcode) {
+    case OP_TYPE_SAMPLER:
+      *type = VK_DESCRIPTOR_TYPE_SAMPLER;
+      return true;
+    case OP_TYPE_SAMPLED_IMAGE: {
+      uint32_t image = id_word(
+          spirv,
+          code[spirv->ids[type_id].word + 2],
+          OP_TYPE_IMAGE
+      );
+      *type = image && code[image + 3] == DIM_BUFFER
+        ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER
+        : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      return true;
+    }
+    case OP_TYPE_IMAGE: {
+      uint32_t word = spirv->ids[type_id].word;
+      bool storage_image = code[word + 7] == 2;
+      if (code[word + 3] == DIM_BUFFER) {
+        *type = storage_image
+          ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+          : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      } else if (code[word + 3] == DIM_SUBPASS_DATA) {
+        *type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      } else {
+        *type = storage_image
+          ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+          : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+      }
+      return true;
+    }
+    case OP_TYPE_STRUCT:
+      *type = storage == STORAGE_STORAGE_BUFFER
+        || spirv->ids[type_id].buffer_block
+        ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+        : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      return true;
+    case OP_TYPE_ACCELERATION_STRUCTURE:
+      *type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+      return true;
+    default:
+      return false;
+  }
+}
+/* Map an execution model to a shader stage (0 if unsupported) */
+static VkShaderStageFlagBits model_stage(uint32_t model) {
+  switch (model) {
+    case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    case 5364: return VK_SHADER_STAGE_TASK_BIT_EXT;
+    case 5365: return VK_SHADER_STAGE_MESH_BIT_EXT;
+    default: return (VkShaderStageFlagBits)0;
+  }
+}
+/* Get the fewest words an indexed instruction has (0 if not indexed) */
+static uint32_t min_length(uint32_t opcode) {
+  switch (opcode) {
+    case OP_TYPE_SAMPLER:
+    case OP_TYPE_STRUCT:
+    case OP_TYPE_ACCELERATION_STRUCTURE:
+      return 2;
+    case OP_TYPE_FLOAT:
+    case OP_TYPE_SAMPLED_IMAGE:
+    case OP_TYPE_RUNTIME_ARRAY:
+    case OP_DECORATE:
+      return 3;
+    case OP_TYPE_INT:
+    case OP_TYPE_VECTOR:
+    case OP_TYPE_MATRIX:
+    case OP_TYPE_ARRAY:
+    case OP_TYPE_POINTER:
+    case OP_CONSTANT:
+    case OP_VARIABLE:
+    case OP_MEMBER_DECORATE:
+      return 4;
+    case OP_TYPE_IMAGE:
+      return 9;
+    default:
+      return 0;
+  }
+}
+/* Index every instruction by the id it defines or decorates */
+static bool parse(spirv_t *spirv) {
+  const uint32_t *code = spirv->code;
+  uint32_t word = SPIRV_HEADER_WORDS;
+  while (word < spirv->word_count) {
+    uint32_t length = code[word] >> 16;
+    uint32_t opcode = code[word] & 0xFFFFu;
+    if (length == 0 || word + length > spirv->word_count) return false;
+    /* Operands read later are only checked here */
+    if (length < min_length(opcode)) return false;
+    switch (opcode) {
+      case OP_TYPE_INT:
+      case OP_TYPE_FLOAT:
+      case OP_TYPE_VECTOR:
+      case OP_TYPE_MATRIX:
+      case OP_TYPE_IMAGE:
+      case OP_TYPE_SAMPLER:
+      case OP_TYPE_SAMPLED_IMAGE:
+      case OP_TYPE_ARRAY:
+      case OP_TYPE_RUNTIME_ARRAY:
+      case OP_TYPE_STRUCT:
+      case OP_TYPE_POINTER:
+      case OP_TYPE_ACCELERATION_STRUCTURE:
+        if (code[word + 1] >= spirv->bound) return false;
+        spirv->ids[code[word + 1]].opcode = opcode;
+        spirv->ids[code[word + 1]].word = word;
+        break;
+      case OP_CONSTANT:
+      case OP_VARIABLE:
+        if (code[word + 2] >= spirv->bound) return false;
+        spirv->ids[code[word + 2]].opcode = opcode;
+        spirv->ids[code[word + 2]].word = word;
+        break;
+      case OP_DECORATE: {
+        spirv_id_t *target;
+        if (code[word + 1] >= spirv->bound) return false;
+        target = &spirv->ids[code[word + 1]];
+        if (code[word + 2] == DECORATION_BUFFER_BLOCK)
+          target->buffer_block = true;
+        if (length < 4) break;
+        if (code[word + 2] == DECORATION_DESCRIPTOR_SET) {
+          target->set = code[word + 3];
+          target->has_set = true;
+        } else if (code[word + 2] == DECORATION_BINDING) {
+          target->binding = code[word + 3];
+          target->has_binding = true;
+        } else if (code[word + 2] == DECORATION_ARRAY_STRIDE) {
+          target->array_stride = code[word + 3];
+        }
+        break;
+      }
+      case OP_MEMBER_DECORATE:
+        if (length < 5) break;
+        if (
+            code[word + 3] != DECORATION_OFFSET
+            && code[word + 3] != DECORATION_MATRIX_STRIDE
+        ) break;
+        if (spirv->member_count == spirv->member_capacity) {
+          spirv->member_capacity = spirv->member_capacity
+            ? spirv->member_capacity * 2
+            : 64;
+          spirv->members = (spirv_member_t *)realloc(
+              spirv->members,
+              sizeof(spirv_member_t) * spirv->member_capacity
+          );
+          ASSERT(spirv->members);
+        }
+        spirv->members[spirv->member_count].id = code[word + 1];
+        spirv->members[spirv->member_count].member = code[word + 2];
+        spirv->members[spirv->member_count].decoration = code[word + 3];
+        spirv->members[spirv->member_count++].value = code[word + 4];
+        break;
+      default:
+        break;
+    }
+    word += length;
+  }
+  return true;
+}
+
+/* Map a shader bundle (false on failure) */
+bool vk_shader_bundle_open(
+    vk_shader_bundle_t *bundle,
+    vk_dev_t *dev,
+    const char *path
+) {
+  if (!asset_pack_open(&bundle->pack, path)) return false;
+  bundle->inline_code =
+    vk_dev_has_ext(dev, VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+  return true;
+}
+/* Unmap a shader bundle */
+void vk_shader_bundle_close(vk_shader_bundle_t *bundle) {
+  asset_pack_close(&bundle->pack);
+  memset(bundle, 0, sizeof(vk_shader_bundle_t));
+}
+/* Reflect SPIR-V (false if it isn't valid SPIR-V with one entry point) */
+bool vk_shader_reflect(
+    vk_shader_t *shader,
+    const uint32_t *code,
+    size_t size
+) {
+  spirv_t spirv;
+  uint32_t entry_points = 0;
+  bool ok;
+
+  memset(shader, 0, sizeof(vk_shader_t));
+  shader->code = code;
+  shader->size = size;
+  if (
+      size % sizeof(uint32_t) != 0
+      || size < SPIRV_HEADER_WORDS * sizeof(uint32_t)
+      || code[0] != SPIRV_MAGIC
+  ) return false;
+
+  memset(&spirv, 0, sizeof(spirv));
+  spirv.code = code;
+  spirv.word_count = (uint32_t)(size / sizeof(uint32_t));
+  spirv.bound = code[3];
+  spirv.ids = (spirv_id_t *)calloc(spirv.bound + 1, sizeof(spirv_id_t));
+  ASSERT(spirv.ids);
+  ok = parse(&spirv);
+
+  for (
+      uint32_t word = SPIRV_HEADER_WORDS;
+      ok && word < spirv.word_count;
+      word += code[word] >> 16
+  ) {
+    uint32_t length = code[word] >> 16;
+    uint32_t opcode = code[word] & 0xFFFFu;
+
+    /* Stage and entry point name */
+    if (opcode == OP_ENTRY_POINT && length >= 4) {
+      size_t max = (length - 3) * sizeof(uint32_t);
+      if (max > VK_SHADER_MAX_ENTRY - 1) max = VK_SHADER_MAX_ENTRY - 1;
+      shader->stage = model_stage(code[word + 1]);
+      memcpy(shader->entry, &code[word + 3], max);
+      shader->entry[max] = '\0';
+      entry_points++;
+    }
+
+    /* Resources */
+    if (opcode == OP_VARIABLE) {
+      const spirv_id_t *variable = &spirv.ids[code[word + 2]];
+      uint32_t storage = code[word + 3];
+      uint32_t pointer = id_word(&spirv, code[word + 1], OP_TYPE_POINTER);
+      vk_shader_binding_t *binding;
+      if (!pointer) continue;
+      if (storage == STORAGE_PUSH_CONSTANT) {
+        push_constant_range(&spirv, code[pointer + 3], &shader->push_constants);
+        continue;
+      }
+      if (
+          storage != STORAGE_UNIFORM_CONSTANT
+          && storage != STORAGE_UNIFORM
+          && storage != STORAGE_STORAGE_BUFFER
+      ) continue;
+      if (!variable->has_binding) continue;
+      if (shader->binding_count == VK_SHADER_MAX_BINDINGS) {
+        ok = false;
+        break;
+      }
+      binding = &shader->bindings[shader->binding_count];
+      binding->set = variable->has_set ? variable->set : 0;
+      binding->binding = variable->binding;
+      if (descriptor_type(
+            &spirv,
+            code[pointer + 3],
+            storage,
+            &binding->type,
+            &binding->count
+      )) shader->binding_count++;
+    }
+  }
+
+  free(spirv.ids);
+  if (spirv.members) free(spirv.members);
+  if (shader->push_constants.size) {
+    shader->push_constants.stageFlags = (VkShaderStageFlags)shader->stage;
+  }
+  return ok && entry_points == 1 && shader->stage != 0;
+}
+/* Load a shader from a bundle (false if missing or invalid) */
+bool vk_shader_load(
+    vk_shader_t *shader,
+    vk_shader_bundle_t *bundle,
+    vk_dev_t *dev,
+    const char *name
+) {
+  const asset_chunk_t *chunk = asset_pack_find(&bundle->pack, name);
+  VkShaderModuleCreateInfo module_info;
+
+  if (!chunk || chunk->type != ASSET_CHUNK_SHADER) {
+    log_msg(LOG_LEVEL_ERROR, "Shader %s not found", name);
+    return false;
+  }
+  if (!vk_shader_reflect(
+        shader,
+        (const uint32_t *)asset_pack_chunk_data(&bundle->pack, chunk),
+        (size_t)chunk->size
+  )) {
+    log_msg(LOG_LEVEL_ERROR, "Shader %s isn't valid SPIR-V", name);
+    return false;
+  }
+  shader->hash = chunk->hash;
+
+  /* Modules are only needed without maintenance5 */
+  if (bundle->inline_code) return true;
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.pNext = NULL;
+  module_info.flags = 0;
+  module_info.codeSize = shader->size;
+  module_info.pCode = shader->code;
+  shader->module = vk_dev_cache_shader_module(dev, &module_info);
+  return true;
+}
+/* Fill a pipeline stage (module_info is chained in if the code is inlined) */
+void vk_shader_stage_info(
+    const vk_shader_t *shader,
+    VkPipelineShaderStageCreateInfo *stage_info,
+    VkShaderModuleCreateInfo *module_info
+) {
+  stage_info->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stage_info->pNext = NULL;
+  stage_info->flags = 0;
+  stage_info->stage = shader->stage;
+  stage_info->module = shader->module;
+  stage_info->pName = shader->entry;
+  stage_info->pSpecializationInfo = NULL;
+  if (shader->module) return;
+  module_info->sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info->pNext = NULL;
+  module_info->flags = 0;
+  module_info->codeSize = shader->size;
+  module_info->pCode = shader->code;
+  stage_info->pNext = module_info;
+}
+/* Get a cached set layout for one set of several shaders' bindings */
+VkDescriptorSetLayout vk_shader_set_layout(
+    vk_dev_t *dev,
+    const vk_shader_t *const *shaders,
+    uint32_t count,
+    uint32_t set
+) {
+  VkDescriptorSetLayoutBinding bindings[VK_SHADER_MAX_BINDINGS];
+  VkDescriptorSetLayoutCreateInfo layout_info;
+  uint32_t binding_count = 0;
+
+  /* Merge the shaders' bindings, combining their stages */
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint32_t j = 0; j < shaders[i]->binding_count; j++) {
+      const vk_shader_binding_t *binding = &shaders[i]->bindings[j];
+      uint32_t k = 0;
+      if (binding->set != set) continue;
+      while (k < binding_count && bindings[k].binding != binding->binding)
+        k++;
+      if (k == binding_count) {
+        ASSERT(binding_count < VK_SHADER_MAX_BINDINGS);
+        bindings[k].binding = binding->binding;
+        bindings[k].descriptorType = binding->type;
+        bindings[k].descriptorCount = binding->count
+          ? binding->count
+          : VK_SHADER_UNSIZED_ARRAY_COUNT;
+        bindings[k].stageFlags = 0;
+        bindings[k].pImmutableSamplers = NULL;
+        binding_count++;
+      } else if (bindings[k].descriptorType != binding->type) {
+        log_msg(
+            LOG_LEVEL_ERROR,
+            "Shaders disagree on the type of set %u binding %u",
+            set,
+            binding->binding
+        );
+        abort();
+      }
+      bindings[k].stageFlags |= (VkShaderStageFlags)shaders[i]->stage;
+    }
+  }
+
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.pNext = NULL;
+  layout_info.flags = 0;
+  layout_info.bindingCount = binding_count;
+  layout_info.pBindings = bindings;
+  return vk_dev_cache_set_layout(dev, &layout_info);
+}
+/* Get a cached pipeline layout for several shaders' sets and push constants */
+VkPipelineLayout vk_shader_pipeline_layout(
+    vk_dev_t *dev,
+    const vk_shader_t *const *shaders,
+    uint32_t count
+) {
+  VkDescriptorSetLayout set_layouts[VK_SHADER_MAX_SETS];
+  VkPushConstantRange ranges[VK_SHADER_MAX_SETS];
+  VkPipelineLayoutCreateInfo layout_info;
+  VkPipelineLayout layout;
+  uint32_t set_count = 0, range_count = 0;
+
+  /* One push constant range per stage */
+  for (uint32_t i = 0; i < count; i++) {
+    const VkPushConstantRange *push = &shaders[i]->push_constants;
+    uint32_t j = 0;
+    for (uint32_t k = 0; k < shaders[i]->binding_count; k++) {
+      if (shaders[i]->bindings[k].set + 1 > set_count)
+        set_count = shaders[i]->bindings[k].set + 1;
+    }
+    if (push->size == 0) continue;
+    while (j < range_count && ranges[j].stageFlags != push->stageFlags) j++;
+    if (j == range_count) {
+      ASSERT(range_count < VK_SHADER_MAX_SETS);
+      ranges[range_count++] = *push;
+    } else {
+      uint32_t end = ranges[j].offset + ranges[j].size;
+      if (push->offset + push->size > end) end = push->offset + push->size;
+      if (push->offset < ranges[j].offset) ranges[j].offset = push->offset;
+      ranges[j].size = end - ranges[j].offset;
+    }
+  }
+  ASSERT(set_count <= VK_SHADER_MAX_SETS);
+  for (uint32_t i = 0; i < set_count; i++)
+    set_layouts[i] = vk_shader_set_layout(dev, shaders, count, i);
+
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.pNext = NULL;
+  layout_info.flags = 0;
+  layout_info.setLayoutCount = set_count;
+  layout_info.pSetLayouts = set_layouts;
+  layout_info.pushConstantRangeCount = range_count;
+  layout_info.pPushConstantRanges = ranges;
+  layout = vk_dev_cache_pipeline_layout(dev, &layout_info);
+
+  /* The pipeline layout keeps its set layouts referenced */
+  for (uint32_t i = 0; i < set_count; i++)
+    vk_dev_cache_release_set_layout(dev, set_layouts[i]);
+  return layout;
+}
+/* Unload a shader */
+void vk_shader_unload(vk_shader_t *shader, vk_dev_t *dev) {
+  if (shader->module)
+    vk_dev_cache_release_shader_module(dev, shader->module);
+  memset(shader, 0, sizeof(vk_shader_t));
+}
@@ -0,0 +1,110 @@
+/* Implements vk_staging.h */
+#include <vk_staging.h>
+
+/* Reserve between min_size and max_size contiguous bytes (0 if full) */
+static VkDeviceSize reserve(
+    vk_staging_t *ring,
+    VkDeviceSize min_size,
+    VkDeviceSize max_size,
+    VkDeviceSize *offset
+) {
+  VkDeviceSize capacity = ring->buffer.size;
+  VkDeviceSize head = (ring->head + VK_STAGING_ALIGNMENT - 1)
+    & ~(VkDeviceSize)(VK_STAGING_ALIGNMENT - 1);
+  VkDeviceSize position = head % capacity;
+  VkDeviceSize available;
+
+  /* Skip the end of the ring if the request doesn't fit before it */
+  if (capacity - position < min_size) {
+    head += capacity - position;
+    position = 0;
+  }
+  if (head - ring->tail >= capacity) return 0;
+  available = capacity - (head - ring->tail);
+  if (available > capacity - position) available = capacity - position;
+  if (available < min_size) return 0;
+  if (available > max_size) available = max_size;
+
+  ring->head = head + available;
+  *offset = position;
+  return available;
+}
+
+/* Create a staging ring */
+vk_staging_t vk_staging_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    VkDeviceSize size
+) {
+  vk_staging_t ring;
+  ring.buffer = vk_buf_create(
+      dev,
+      phys_dev_info,
+      size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      0
+  );
+  ring.head = 0;
+  ring.tail = 0;
+  return ring;
+}
+/* Allocate contiguous staging memory (false if the ring is full) */
+bool vk_staging_alloc(
+    vk_staging_t *ring,
+    VkDeviceSize size,
+    VkDeviceSize *offset,
+    void **ptr
+) {
+  if (size == 0 || size > ring->buffer.size) return false;
+  if (reserve(ring, size, size, offset) == 0) return false;
+  if (ptr) *ptr = (uint8_t *)ring->buffer.mapped + *offset;
+  return true;
+}
+/* Get a mark covering every allocation made so far */
+VkDeviceSize vk_staging_mark(const vk_staging_t *ring) {
+  return ring->head;
+}
+/* Release allocations up to a mark once the GPU has consumed them */
+void vk_staging_release(vk_staging_t *ring, VkDeviceSize mark) {
+  if (mark > ring->tail) ring->tail = mark;
+}
+/* Record a copy into a buffer through the ring (returns bytes recorded) */
+VkDeviceSize vk_staging_cmd_upload(
+    vk_staging_t *ring,
+    VkCommandBuffer cmd,
+    const void *data,
+    VkDeviceSize size,
+    VkBuffer dst,
+    VkDeviceSize dst_offset
+) {
+  VkDeviceSize recorded = 0;
+  while (recorded < size) {
+    VkBufferCopy region;
+    VkDeviceSize offset;
+    VkDeviceSize count = reserve(
+        ring,
+        VK_STAGING_ALIGNMENT,
+        size - recorded,
+        &offset
+    );
+    if (count == 0) break;
+    memcpy(
+        (uint8_t *)ring->buffer.mapped + offset,
+        (const uint8_t *)data + recorded,
+        (size_t)count
+    );
+    region.srcOffset = offset;
+    region.dstOffset = dst_offset + recorded;
+    region.size = count;
+    vkCmdCopyBuffer(cmd, ring->buffer.buffer, dst, 1, &region);
+    recorded += count;
+  }
+  return recorded;
+}
+/* Destroy a staging ring */
+void vk_staging_destroy(vk_staging_t *ring, vk_dev_t *dev) {
+  vk_buf_destroy(&ring->buffer, dev);
+  memset(ring, 0, sizeof(vk_staging_t));
+}
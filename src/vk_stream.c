@@ -0,0 +1,1211 @@
+/* Implements vk_stream.h */
+#include <vk_stream.h>
+#include <vk_dev_cache.h>
+#include <telemetry.h>
+
+/* Block rows per transcode job */
+#define VK_STREAM_JOB_ROWS 16
+/* Level alignment in staging (copy offsets must be texel and 4 aligned) */
+#define VK_STREAM_LEVEL_ALIGNMENT 16
+
+/* Types */
+/* Promotion candidate */
+typedef struct {
+  uint32_t texture;
+  uint32_t levels;
+  uint64_t last_used;
+} candidate_t;
+
+/* Get a format's block size (false if not streamable) */
+static bool format_block(
+    VkFormat format,
+    uint32_t *block_extent,
+    uint32_t *block_bytes
+) {
+  *block_extent = 1;
+  switch (format) {
+    case VK_FORMAT_R8_UNORM:
+      *block_bytes = 1;
+      return true;
+    case VK_FORMAT_R8G8_UNORM:
+      *block_bytes = 2;
+      return true;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      *block_bytes = 4;
+      return true;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      *block_bytes = 8;
+      return true;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+      *block_extent = 4;
+      *block_bytes = 8;
+      return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+      *block_extent = 4;
+      *block_bytes = 16;
+      return true;
+    default:
+      return false;
+  }
+}
+/* Get a mip level's dimension */
+static uint32_t mip_extent(uint32_t extent, uint32_t level) {
+  extent >>= level;
+  return extent > 0 ? extent : 1;
+}
+/* Sort candidates, most levels missing first, then most recently used */
+static int compare_candidates(const void *a, const void *b) {
+  const candidate_t *ca = (const candidate_t *)a;
+  const candidate_t *cb = (const candidate_t *)b;
+  if (ca->levels != cb->levels) return ca->levels > cb->levels ? -1 : 1;
+  if (ca->last_used != cb->last_used)
+    return ca->last_used > cb->last_used ? -1 : 1;
+  return 0;
+}
+/* Copy or transcode part of a load into staging memory */
+static void decode_job(void *arg) {
+  vk_stream_job_t *job = (vk_stream_job_t *)arg;
+  if (!job->transcode) {
+    memcpy(job->destination, job->source, (size_t)job->size);
+    return;
+  }
+  transcode_rows(
+      job->target,
+      job->source,
+      job->width,
+      job->height,
+      job->first_row,
+      job->row_count,
+      job->destination
+  );
+}
+
+/* Create an image holding levels first_mip onwards of a texture */
+static void create_image(
+    vk_stream_t *stream,
+    vk_dev_t *dev,
+    VkFormat format,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mip_count,
+    VkImage *image,
+    VkDeviceMemory *memory,
+    VkImageView *view,
+    VkDeviceSize *memory_size,
+    uint32_t *memory_type
+) {
+  VkImageCreateInfo image_info;
+  VkImageViewCreateInfo view_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryRequirements requirements;
+
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.pNext = NULL;
+  image_info.flags = 0;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = format;
+  image_info.extent.width = width;
+  image_info.extent.height = height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = mip_count;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage =
+    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  image_info.sharingMode = stream->queue_family_count > 1
+    ? VK_SHARING_MODE_CONCURRENT
+    : VK_SHARING_MODE_EXCLUSIVE;
+  image_info.queueFamilyIndexCount = stream->queue_family_count;
+  image_info.pQueueFamilyIndices = stream->queue_families;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK(vkCreateImage(dev->device, &image_info, NULL, image));
+
+  vkGetImageMemoryRequirements(dev->device, *image, &requirements);
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = vk_phys_dev_find_memory_type(
+      stream->phys_dev_info,
+      requirements.memoryTypeBits,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  ASSERT(alloc_info.memoryTypeIndex != UINT32_MAX);
+  VK_CHECK(vkAllocateMemory(dev->device, &alloc_info, NULL, memory));
+  VK_CHECK(vkBindImageMemory(dev->device, *image, *memory, 0));
+  *memory_size = requirements.size;
+  *memory_type = alloc_info.memoryTypeIndex;
+
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.pNext = NULL;
+  view_info.flags = 0;
+  view_info.image = *image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.baseMipLevel = 0;
+  view_info.subresourceRange.levelCount = mip_count;
+  view_info.subresourceRange.baseArrayLayer = 0;
+  view_info.subresourceRange.layerCount = 1;
+  VK_CHECK(vkCreateImageView(dev->device, &view_info, NULL, view));
+}
+/* Record a layout transition of every level of an image */
+static void cmd_transition(
+    VkCommandBuffer cmd,
+    VkImage image,
+    uint32_t mip_count,
+    VkImageLayout old_layout,
+    VkImageLayout new_layout,
+    VkPipelineStageFlags src_stage,
+    VkAccessFlags src_access,
+    VkPipelineStageFlags dst_stage,
+    VkAccessFlags dst_access
+) {
+  VkImageMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = src_access;
+  barrier.dstAccessMask = dst_access;
+  barrier.oldLayout = old_layout;
+  barrier.newLayout = new_layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_count;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  vkCmdPipelineBarrier(
+      cmd,
+      src_stage,
+      dst_stage,
+      0,
+      0,
+      NULL,
+      0,
+      NULL,
+      1,
+      &barrier
+  );
+}
+/* Report the bytes a texture's images hold to the residency manager */
+static void report_residency(vk_stream_t *stream, uint32_t index) {
+  const vk_stream_texture_t *texture = &stream->textures[index];
+  if (stream->residency) vk_residency_set_size(
+      stream->residency,
+      texture->residency_id,
+      texture->memory_type,
+      texture->memory_size + texture->retired_size
+  );
+}
+/* Queue a texture's image for destruction once no frame in flight uses it */
+static void retire_image(vk_stream_t *stream, uint32_t index) {
+  vk_stream_texture_t *texture = &stream->textures[index];
+  vk_stream_retired_t *retired;
+  if (!texture->image) return;
+  if (stream->retired_count == stream->retired_capacity) {
+    stream->retired_capacity =
+      stream->retired_capacity ? stream->retired_capacity * 2 : 16;
+    stream->retired = (vk_stream_retired_t *)realloc(
+        stream->retired,
+        sizeof(vk_stream_retired_t) * stream->retired_capacity
+    );
+    ASSERT(stream->retired);
+  }
+  retired = &stream->retired[stream->retired_count++];
+  retired->image = texture->image;
+  retired->memory = texture->memory;
+  retired->view = texture->view;
+  retired->texture = index;
+  retired->memory_size = texture->memory_size;
+  retired->retire_frame = stream->frame_counter + stream->frames_in_flight;
+  texture->retired_size += texture->memory_size;
+}
+/* Estimate the memory a set of resident levels needs */
+static VkDeviceSize levels_size(
+    const vk_stream_texture_t *texture,
+    uint32_t first_mip
+) {
+  uint32_t last = texture->mip_count - 1;
+  return texture->mip_offsets[last]
+    + texture->mip_sizes[last]
+    - texture->mip_offsets[first_mip];
+}
+/* Schedule an upload of levels target_mip onwards (false if no room) */
+static bool schedule_load(
+    vk_stream_t *stream,
+    vk_dev_t *dev,
+    uint32_t index,
+    uint32_t target_mip
+) {
+  vk_stream_texture_t *texture = &stream->textures[index];
+  vk_stream_load_t *load;
+  VkDeviceSize size = levels_size(texture, target_mip);
+  VkDeviceSize offset;
+  uint32_t job_count;
+  void *ptr;
+
+  if (stream->load_count == VK_STREAM_MAX_LOADS) return false;
+  if (!vk_staging_alloc(&stream->staging, size, &offset, &ptr)) return false;
+
+  /* Populate load */
+  load = &stream->loads[
+    (stream->load_head + stream->load_count) % VK_STREAM_MAX_LOADS
+  ];
+  stream->load_count++;
+  load->texture = index;
+  load->target_mip = target_mip;
+  load->staging_offset = offset;
+  load->staging_mark = vk_staging_mark(&stream->staging);
+  load->submitted = false;
+  load->start_time = time_now();
+  load->source = (const uint8_t *)asset_pack_chunk_data(
+      texture->pack,
+      texture->chunk
+  ) + texture->source_offsets[target_mip];
+  load->destination = (uint8_t *)ptr;
+  load->size = size;
+  atomic_init(&load->decode.value, 0);
+  create_image(
+      stream,
+      dev,
+      texture->format,
+      mip_extent(texture->width, target_mip),
+      mip_extent(texture->height, target_mip),
+      texture->mip_count - target_mip,
+      &load->image,
+      &load->memory,
+      &load->view,
+      &load->memory_size,
+      &load->memory_type
+  );
+  texture->loading = true;
+
+  /* Account for the new image replacing the old one */
+  stream->resident_size += load->memory_size;
+  stream->resident_size -= texture->memory_size;
+  if (stream->resident_size + texture->memory_size > stream->peak_size)
+    stream->peak_size = stream->resident_size + texture->memory_size;
+
+  /* Copy by level, or transcode in block row slices, straight into staging */
+  job_count = texture->mip_count - target_mip;
+  if (texture->transcoded) {
+    job_count = 0;
+    for (uint32_t i = target_mip; i < texture->mip_count; i++) {
+      uint32_t rows = (mip_extent(texture->height, i) + 3) / 4;
+      job_count += (rows + VK_STREAM_JOB_ROWS - 1) / VK_STREAM_JOB_ROWS;
+    }
+  }
+  load->jobs = (vk_stream_job_t *)calloc(job_count, sizeof(vk_stream_job_t));
+  load->job_count = job_count;
+  ASSERT(load->jobs);
+  if (!texture->transcoded) {
+    for (uint32_t i = target_mip; i < texture->mip_count; i++) {
+      vk_stream_job_t *job = &load->jobs[i - target_mip];
+      job->source = load->source
+        + texture->source_offsets[i]
+        - texture->source_offsets[target_mip];
+      job->destination = load->destination
+        + texture->mip_offsets[i]
+        - texture->mip_offsets[target_mip];
+      job->size = texture->mip_sizes[i];
+    }
+  } else {
+    job_count = 0;
+    for (uint32_t i = target_mip; i < texture->mip_count; i++) {
+      uint32_t rows = (mip_extent(texture->height, i) + 3) / 4;
+      for (uint32_t row = 0; row < rows; row += VK_STREAM_JOB_ROWS) {
+        vk_stream_job_t *job = &load->jobs[job_count++];
+        job->transcode = true;
+        job->target = stream->transcode_target;
+        job->source = load->source
+          + texture->source_offsets[i]
+          - texture->source_offsets[target_mip];
+        job->destination = load->destination
+          + texture->mip_offsets[i]
+          - texture->mip_offsets[target_mip];
+        job->width = mip_extent(texture->width, i);
+        job->height = mip_extent(texture->height, i);
+        job->first_row = row;
+        job->row_count = rows - row < VK_STREAM_JOB_ROWS
+          ? rows - row
+          : VK_STREAM_JOB_ROWS;
+      }
+    }
+  }
+  for (uint32_t i = 0; i < load->job_count; i++) {
+    vk_stream_job_t *job = &load->jobs[i];
+    job->job.fn = decode_job;
+    job->job.arg = job;
+    job->job.counter = &load->decode;
+    if (stream->jobs)
+      jobs_submit(stream->jobs, &job->job);
+    else
+      decode_job(job);
+  }
+  return true;
+}
+/* Enqueue an upload on a transfer queue, giving its completion */
+static vk_sync_point_t submit_upload(
+    vk_stream_t *stream,
+    VkCommandBuffer cmd
+) {
+  vk_submission_t submission;
+  memset(&submission, 0, sizeof(submission));
+  submission.command_buffers = &cmd;
+  submission.command_buffer_count = 1;
+  return vk_submit_enqueue(stream->submit, VK_SUBMIT_TRANSFER, &submission);
+}
+/* Record and submit a decoded load */
+static void submit_load(vk_stream_t *stream, vk_stream_load_t *load) {
+  const vk_stream_texture_t *texture = &stream->textures[load->texture];
+  VkBufferImageCopy regions[VK_STREAM_MAX_MIPS];
+  uint32_t level_count = texture->mip_count - load->target_mip;
+  VkCommandBufferBeginInfo begin_info;
+
+  for (uint32_t i = 0; i < level_count; i++) {
+    uint32_t level = load->target_mip + i;
+    regions[i].bufferOffset = load->staging_offset
+      + texture->mip_offsets[level]
+      - texture->mip_offsets[load->target_mip];
+    regions[i].bufferRowLength = 0;
+    regions[i].bufferImageHeight = 0;
+    regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[i].imageSubresource.mipLevel = i;
+    regions[i].imageSubresource.baseArrayLayer = 0;
+    regions[i].imageSubresource.layerCount = 1;
+    regions[i].imageOffset.x = 0;
+    regions[i].imageOffset.y = 0;
+    regions[i].imageOffset.z = 0;
+    regions[i].imageExtent.width = mip_extent(texture->width, level);
+    regions[i].imageExtent.height = mip_extent(texture->height, level);
+    regions[i].imageExtent.depth = 1;
+  }
+
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(load->cmd, 0));
+  VK_CHECK(vkBeginCommandBuffer(load->cmd, &begin_info));
+  cmd_transition(
+      load->cmd,
+      load->image,
+      level_count,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      0,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT
+  );
+  vkCmdCopyBufferToImage(
+      load->cmd,
+      stream->staging.buffer.buffer,
+      load->image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      level_count,
+      regions
+  );
+  /* The sampling queue only sees the image once the upload is reached */
+  cmd_transition(
+      load->cmd,
+      load->image,
+      level_count,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0
+  );
+  VK_CHECK(vkEndCommandBuffer(load->cmd));
+
+  load->uploaded = submit_upload(stream, load->cmd);
+  load->submitted = true;
+}
+/* Swap a finished load's image in */
+static void finish_load(vk_stream_t *stream, vk_stream_load_t *load) {
+  vk_stream_texture_t *texture = &stream->textures[load->texture];
+  bool grew = load->memory_size >= texture->memory_size;
+  free(load->jobs);
+  load->jobs = NULL;
+  vk_staging_release(&stream->staging, load->staging_mark);
+  retire_image(stream, load->texture);
+  texture->image = load->image;
+  texture->memory = load->memory;
+  texture->view = load->view;
+  texture->memory_size = load->memory_size;
+  texture->memory_type = load->memory_type;
+  texture->resident_mip = load->target_mip;
+  texture->generation++;
+  texture->loading = false;
+  /* Freed bytes are only reported once the old image is destroyed */
+  if (grew) report_residency(stream, load->texture);
+  telemetry_report(
+      "stream.load_latency",
+      TELEMETRY_TIMING,
+      (time_now() - load->start_time) * 1e3
+  );
+  telemetry_report(
+      "stream.uploaded_mb",
+      TELEMETRY_COUNTER,
+      (double)load->size / (1024.0 * 1024.0)
+  );
+}
+/* Drop the finest level of least recently used textures (false if stuck) */
+static bool evict(
+    vk_stream_t *stream,
+    vk_dev_t *dev,
+    VkDeviceSize needed,
+    uint32_t keep
+) {
+  while (stream->resident_size + needed > stream->budget) {
+    uint32_t victim = VK_STREAM_INVALID;
+    for (uint32_t i = 0; i < stream->texture_count; i++) {
+      const vk_stream_texture_t *texture = &stream->textures[i];
+      if (
+          i == keep
+          || texture->loading
+          || texture->resident_mip >= texture->tail_mip
+          || texture->last_used >= stream->frame_counter
+      ) continue;
+      if (
+          victim == VK_STREAM_INVALID
+          || texture->last_used < stream->textures[victim].last_used
+      ) victim = i;
+    }
+    if (victim == VK_STREAM_INVALID) return false;
+    stream->textures[victim].desired_mip =
+      stream->textures[victim].resident_mip + 1;
+    if (!schedule_load(
+          stream,
+          dev,
+          victim,
+          stream->textures[victim].resident_mip + 1
+    )) return false;
+    telemetry_report("stream.evictions", TELEMETRY_COUNTER, 1.0);
+  }
+  return true;
+}
+/* Drop a texture to its mip tail for the residency manager */
+static VkDeviceSize evict_to_tail(vk_dev_t *dev, void *user, uint32_t key) {
+  vk_stream_t *stream = (vk_stream_t *)user;
+  vk_stream_texture_t *texture = &stream->textures[key];
+  VkDeviceSize old_size = texture->memory_size;
+  const vk_stream_load_t *load;
+  if (texture->loading || texture->resident_mip >= texture->tail_mip)
+    return 0;
+  if (!schedule_load(stream, dev, key, texture->tail_mip)) return 0;
+  texture->desired_mip = texture->tail_mip;
+  load = &stream->loads[
+    (stream->load_head + stream->load_count - 1) % VK_STREAM_MAX_LOADS
+  ];
+  return old_size > load->memory_size ? old_size - load->memory_size : 0;
+}
+
+/* Create a texture streamer builder */
+vk_stream_builder_t vk_stream_builder(void) {
+  vk_stream_builder_t builder;
+  builder.max_textures = 1024;
+  builder.frames_in_flight = 1;
+  builder.budget = 0;
+  builder.upload_budget = 32u << 20;
+  builder.staging_size = 64u << 20;
+  builder.submit = NULL;
+  builder.transfer_family = 0;
+  builder.graphics_family = 0;
+  builder.jobs = NULL;
+  builder.transcode_target = TRANSCODE_TARGET_RGBA8;
+  builder.residency = NULL;
+  return builder;
+}
+/* Set the maximum number of textures */
+void vk_stream_builder_set_max_textures(
+    vk_stream_builder_t *builder,
+    uint32_t max_textures
+) {
+  builder->max_textures = max_textures;
+}
+/* Set the number of frames in flight */
+void vk_stream_builder_set_frames_in_flight(
+    vk_stream_builder_t *builder,
+    uint32_t frames_in_flight
+) {
+  builder->frames_in_flight = frames_in_flight;
+}
+/* Set the texture memory budget (0 for half the largest device heap) */
+void vk_stream_builder_set_budget(
+    vk_stream_builder_t *builder,
+    VkDeviceSize budget
+) {
+  builder->budget = budget;
+}
+/* Set the maximum bytes scheduled for upload per update */
+void vk_stream_builder_set_upload_budget(
+    vk_stream_builder_t *builder,
+    VkDeviceSize upload_budget
+) {
+  builder->upload_budget = upload_budget;
+}
+/* Set the staging ring size */
+void vk_stream_builder_set_staging_size(
+    vk_stream_builder_t *builder,
+    VkDeviceSize staging_size
+) {
+  builder->staging_size = staging_size;
+}
+/* Set the submission layer uploads go through, and its transfer family */
+void vk_stream_builder_set_submit(
+    vk_stream_builder_t *builder,
+    vk_submit_t *submit,
+    uint32_t transfer_family
+) {
+  builder->submit = submit;
+  builder->transfer_family = transfer_family;
+}
+/* Set the queue family that samples the textures */
+void vk_stream_builder_set_graphics_family(
+    vk_stream_builder_t *builder,
+    uint32_t family
+) {
+  builder->graphics_family = family;
+}
+/* Set the job system decoding runs on (NULL to decode on the caller) */
+void vk_stream_builder_set_jobs(vk_stream_builder_t *builder, jobs_t *jobs) {
+  builder->jobs = jobs;
+}
+/* Set the format universal block textures are transcoded to */
+void vk_stream_builder_set_transcode_target(
+    vk_stream_builder_t *builder,
+    transcode_target_t target
+) {
+  builder->transcode_target = target;
+}
+/* Set the residency manager textures are registered with (may be NULL) */
+void vk_stream_builder_set_residency(
+    vk_stream_builder_t *builder,
+    vk_residency_t *residency
+) {
+  builder->residency = residency;
+}
+/* Create a texture streamer (and free builder) */
+vk_stream_t vk_stream_create(
+    vk_dev_t *dev,
+    const vk_phys_dev_info_t *phys_dev_info,
+    vk_stream_builder_t *builder
+) {
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo cmd_info;
+  VkSamplerCreateInfo sampler_info;
+  VkDescriptorSetLayoutBinding bindings[2];
+  VkDescriptorSetLayoutCreateInfo set_layout_info;
+  VkDescriptorPoolSize pool_sizes[2];
+  VkDescriptorPoolCreateInfo descriptor_pool_info;
+  VkDescriptorSetAllocateInfo set_info;
+  VkDescriptorSetLayout *set_layouts;
+  VkDeviceSize placeholder_size;
+  uint32_t placeholder_type;
+  vk_stream_t stream;
+
+  ASSERT(builder->submit);
+  ASSERT(builder->max_textures > 0 && builder->frames_in_flight > 0);
+  memset(&stream, 0, sizeof(stream));
+  stream.max_textures = builder->max_textures;
+  stream.frames_in_flight = builder->frames_in_flight;
+  stream.upload_budget = builder->upload_budget;
+  stream.phys_dev_info = phys_dev_info;
+  stream.submit = builder->submit;
+  stream.jobs = builder->jobs;
+  stream.transcode_target = builder->transcode_target;
+  stream.residency = builder->residency;
+  stream.queue_families[0] = builder->transfer_family;
+  stream.queue_families[1] = builder->graphics_family;
+  stream.queue_family_count =
+    builder->transfer_family == builder->graphics_family ? 1 : 2;
+
+  /* Budget defaults to half the largest device local heap */
+  stream.budget = builder->budget;
+  if (stream.budget == 0) {
+    for (
+        uint32_t i = 0;
+        i < phys_dev_info->memory_properties.memoryHeapCount;
+        i++
+    ) {
+      const VkMemoryHeap *heap =
+        &phys_dev_info->memory_properties.memoryHeaps[i];
+      if (
+          (heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+          && heap->size / 2 > stream.budget
+      ) stream.budget = heap->size / 2;
+    }
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Texture streaming budget: %.1f MB",
+      (double)stream.budget / (1024.0 * 1024.0)
+  );
+
+  stream.textures = (vk_stream_texture_t *)calloc(
+      stream.max_textures,
+      sizeof(vk_stream_texture_t)
+  );
+  stream.sets = (VkDescriptorSet *)malloc(
+      sizeof(VkDescriptorSet) * stream.frames_in_flight
+  );
+  stream.feedback =
+    (vk_buf_t *)malloc(sizeof(vk_buf_t) * stream.frames_in_flight);
+  stream.set_generations = (uint32_t *)calloc(
+      (size_t)stream.max_textures * stream.frames_in_flight,
+      sizeof(uint32_t)
+  );
+  stream.set_resident_mips = (uint32_t *)malloc(
+      sizeof(uint32_t) * stream.max_textures * stream.frames_in_flight
+  );
+  stream.image_infos = (VkDescriptorImageInfo *)malloc(
+      sizeof(VkDescriptorImageInfo) * stream.max_textures
+  );
+  stream.writes = (VkWriteDescriptorSet *)malloc(
+      sizeof(VkWriteDescriptorSet) * stream.max_textures
+  );
+  set_layouts = (VkDescriptorSetLayout *)malloc(
+      sizeof(VkDescriptorSetLayout) * stream.frames_in_flight
+  );
+  ASSERT(
+      stream.textures && stream.sets && stream.feedback
+      && stream.set_generations && stream.set_resident_mips
+      && stream.image_infos && stream.writes && set_layouts
+  );
+  for (uint32_t i = 0; i < stream.max_textures * stream.frames_in_flight; i++)
+    stream.set_resident_mips[i] = VK_STREAM_INVALID;
+
+  stream.staging = vk_staging_create(
+      dev,
+      phys_dev_info,
+      builder->staging_size
+  );
+
+  /* Create upload command buffers */
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = builder->transfer_family;
+  VK_CHECK(vkCreateCommandPool(
+        dev->device,
+        &pool_info,
+        NULL,
+        &stream.command_pool
+  ));
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.pNext = NULL;
+  cmd_info.commandPool = stream.command_pool;
+  cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount = 1;
+  for (uint32_t i = 0; i < VK_STREAM_MAX_LOADS; i++) {
+    VK_CHECK(vkAllocateCommandBuffers(
+          dev->device,
+          &cmd_info,
+          &stream.loads[i].cmd
+    ));
+  }
+
+  /* Create and upload the placeholder bound to textures not yet loaded */
+  create_image(
+      &stream,
+      dev,
+      VK_FORMAT_R8G8B8A8_UNORM,
+      1,
+      1,
+      1,
+      &stream.placeholder,
+      &stream.placeholder_memory,
+      &stream.placeholder_view,
+      &placeholder_size,
+      &placeholder_type
+  );
+  {
+    vk_stream_load_t *load = &stream.loads[0];
+    VkCommandBufferBeginInfo begin_info;
+    VkBufferImageCopy region;
+    VkDeviceSize offset;
+    void *ptr;
+    ASSERT(vk_staging_alloc(&stream.staging, 4, &offset, &ptr));
+    memcpy(ptr, "\x80\x80\x80\xff", 4);
+    memset(&region, 0, sizeof(region));
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = 1;
+    region.imageExtent.height = 1;
+    region.imageExtent.depth = 1;
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = NULL;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
+    VK_CHECK(vkBeginCommandBuffer(load->cmd, &begin_info));
+    cmd_transition(
+        load->cmd,
+        stream.placeholder,
+        1,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT
+    );
+    vkCmdCopyBufferToImage(
+        load->cmd,
+        stream.staging.buffer.buffer,
+        stream.placeholder,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1,
+        &region
+    );
+    cmd_transition(
+        load->cmd,
+        stream.placeholder,
+        1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0
+    );
+    VK_CHECK(vkEndCommandBuffer(load->cmd));
+    load->uploaded = submit_upload(&stream, load->cmd);
+    vk_submit_flush(stream.submit);
+    vk_sync_wait(load->uploaded, dev, UINT64_MAX);
+    vk_staging_release(&stream.staging, vk_staging_mark(&stream.staging));
+  }
+
+  /* Create sampler */
+  memset(&sampler_info, 0, sizeof(sampler_info));
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+  stream.sampler = vk_dev_cache_sampler(dev, &sampler_info);
+
+  /* Create descriptor sets (textures, feedback) */
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = stream.max_textures;
+  bindings[0].stageFlags =
+    VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[0].pImmutableSamplers = NULL;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags =
+    VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[1].pImmutableSamplers = NULL;
+  set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_info.pNext = NULL;
+  set_layout_info.flags = 0;
+  set_layout_info.bindingCount = 2;
+  set_layout_info.pBindings = bindings;
+  stream.set_layout = vk_dev_cache_set_layout(dev, &set_layout_info);
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_sizes[0].descriptorCount = stream.max_textures * stream.frames_in_flight;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[1].descriptorCount = stream.frames_in_flight;
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.pNext = NULL;
+  descriptor_pool_info.flags = 0;
+  descriptor_pool_info.maxSets = stream.frames_in_flight;
+  descriptor_pool_info.poolSizeCount = 2;
+  descriptor_pool_info.pPoolSizes = pool_sizes;
+  VK_CHECK(vkCreateDescriptorPool(
+        dev->device,
+        &descriptor_pool_info,
+        NULL,
+        &stream.descriptor_pool
+  ));
+  for (uint32_t i = 0; i < stream.frames_in_flight; i++)
+    set_layouts[i] = stream.set_layout;
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.pNext = NULL;
+  set_info.descriptorPool = stream.descriptor_pool;
+  set_info.descriptorSetCount = stream.frames_in_flight;
+  set_info.pSetLayouts = set_layouts;
+  VK_CHECK(vkAllocateDescriptorSets(dev->device, &set_info, stream.sets));
+  free(set_layouts);
+
+  /* Create feedback buffers and point every texture at the placeholder */
+  for (uint32_t i = 0; i < stream.max_textures; i++) {
+    stream.image_infos[i].sampler = stream.sampler;
+    stream.image_infos[i].imageView = stream.placeholder_view;
+    stream.image_infos[i].imageLayout =
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+  for (uint32_t i = 0; i < stream.frames_in_flight; i++) {
+    VkDescriptorBufferInfo buffer_info;
+    VkWriteDescriptorSet writes[2];
+    stream.feedback[i] = vk_buf_create(
+        dev,
+        phys_dev_info,
+        sizeof(uint32_t) * stream.max_textures,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+    );
+    memset(
+        stream.feedback[i].mapped,
+        0xff,
+        sizeof(uint32_t) * stream.max_textures
+    );
+    buffer_info.buffer = stream.feedback[i].buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+    memset(writes, 0, sizeof(writes));
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = stream.sets[i];
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = stream.max_textures;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = stream.image_infos;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = stream.sets[i];
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(dev->device, 2, writes, 0, NULL);
+  }
+
+  /* Free builder */
+  memset(builder, 0, sizeof(vk_stream_builder_t));
+
+  return stream;
+}
+/* Add a texture chunk, loading its mip tail (VK_STREAM_INVALID on failure) */
+uint32_t vk_stream_add_texture(
+    vk_stream_t *stream,
+    const asset_pack_t *pack,
+    const asset_chunk_t *chunk
+) {
+  vk_stream_texture_t *texture;
+  uint32_t block_extent, block_bytes;
+  uint32_t format = chunk->meta[ASSET_META_TEXTURE_FORMAT];
+  VkDeviceSize offset = 0, source_offset = 0;
+
+  if (stream->texture_count == stream->max_textures) {
+    log_msg(LOG_LEVEL_WARN, "Too many streamed textures");
+    return VK_STREAM_INVALID;
+  }
+  texture = &stream->textures[stream->texture_count];
+  memset(texture, 0, sizeof(vk_stream_texture_t));
+  texture->pack = pack;
+  texture->chunk = chunk;
+  texture->transcoded = transcode_is_universal(format);
+  texture->format = texture->transcoded
+    ? transcode_target_format(
+        stream->transcode_target,
+        format == TRANSCODE_FORMAT_UNIVERSAL_SRGB
+    )
+    : (VkFormat)format;
+  texture->width = chunk->meta[ASSET_META_TEXTURE_WIDTH];
+  texture->height = chunk->meta[ASSET_META_TEXTURE_HEIGHT];
+  texture->mip_count = chunk->meta[ASSET_META_TEXTURE_MIPS];
+  if (
+      chunk->type != ASSET_CHUNK_TEXTURE
+      || !format_block(texture->format, &block_extent, &block_bytes)
+      || texture->mip_count == 0
+      || texture->mip_count > VK_STREAM_MAX_MIPS
+      || texture->width == 0
+      || texture->height == 0
+  ) {
+    log_msg(LOG_LEVEL_WARN, "Texture %s can't be streamed", chunk->name);
+    return VK_STREAM_INVALID;
+  }
+
+  /* Locate levels (stored largest first) */
+  texture->tail_mip = texture->mip_count - 1;
+  for (uint32_t i = 0; i < texture->mip_count; i++) {
+    uint32_t width = mip_extent(texture->width, i);
+    uint32_t height = mip_extent(texture->height, i);
+    offset = (offset + VK_STREAM_LEVEL_ALIGNMENT - 1)
+      & ~(VkDeviceSize)(VK_STREAM_LEVEL_ALIGNMENT - 1);
+    texture->mip_offsets[i] = offset;
+    texture->mip_sizes[i] = (VkDeviceSize)block_bytes
+      * ((width + block_extent - 1) / block_extent)
+      * ((height + block_extent - 1) / block_extent);
+    offset += texture->mip_sizes[i];
+    texture->source_offsets[i] = source_offset;
+    source_offset += texture->transcoded
+      ? transcode_universal_size(width, height)
+      : texture->mip_sizes[i];
+    if (
+        i < texture->tail_mip
+        && width <= VK_STREAM_TAIL_SIZE
+        && height <= VK_STREAM_TAIL_SIZE
+    ) texture->tail_mip = i;
+  }
+  if (source_offset > chunk->size) {
+    log_msg(LOG_LEVEL_WARN, "Texture %s is truncated", chunk->name);
+    return VK_STREAM_INVALID;
+  }
+
+  /* Nothing is resident until the tail arrives */
+  texture->resident_mip = texture->mip_count;
+  texture->desired_mip = texture->tail_mip;
+  if (stream->residency) texture->residency_id = vk_residency_add(
+      stream->residency,
+      evict_to_tail,
+      stream,
+      stream->texture_count
+  );
+  return stream->texture_count++;
+}
+/* Begin a frame, once the slot's previous use has finished on the GPU */
+void vk_stream_begin_frame(
+    vk_stream_t *stream,
+    vk_dev_t *dev,
+    uint32_t frame_index
+) {
+  uint32_t *feedback = (uint32_t *)stream->feedback[frame_index].mapped;
+  uint32_t *generations =
+    &stream->set_generations[frame_index * stream->max_textures];
+  uint32_t *bound_mips =
+    &stream->set_resident_mips[frame_index * stream->max_textures];
+  uint32_t write_count = 0;
+  uint32_t retained = 0;
+
+  stream->frame_counter++;
+
+  /* Destroy images no frame in flight can reference anymore */
+  for (uint32_t i = 0; i < stream->retired_count; i++) {
+    vk_stream_retired_t *retired = &stream->retired[i];
+    if (retired->retire_frame <= stream->frame_counter) {
+      vkDestroyImageView(dev->device, retired->view, NULL);
+      vkDestroyImage(dev->device, retired->image, NULL);
+      vkFreeMemory(dev->device, retired->memory, NULL);
+      stream->textures[retired->texture].retired_size -= retired->memory_size;
+      report_residency(stream, retired->texture);
+    } else {
+      stream->retired[retained++] = *retired;
+    }
+  }
+  stream->retired_count = retained;
+
+  /* Read feedback: the finest level sampled, relative to the bound image */
+  for (uint32_t i = 0; i < stream->texture_count; i++) {
+    vk_stream_texture_t *texture = &stream->textures[i];
+    if (feedback[i] != UINT32_MAX) {
+      texture->last_used = stream->frame_counter;
+      if (stream->residency)
+        vk_residency_touch(stream->residency, texture->residency_id);
+      if (bound_mips[i] != VK_STREAM_INVALID) {
+        int64_t level = (int64_t)feedback[i]
+          - VK_STREAM_FEEDBACK_BIAS
+          + bound_mips[i];
+        if (level < 0) level = 0;
+        if (level > texture->tail_mip) level = texture->tail_mip;
+        texture->desired_mip = (uint32_t)level;
+      }
+    } else if (
+        !texture->loading
+        && texture->resident_mip <= texture->tail_mip
+    ) {
+      /* Unseen textures keep what they have (or are being evicted to) */
+      texture->desired_mip = texture->resident_mip;
+    }
+  }
+  memset(feedback, 0xff, sizeof(uint32_t) * stream->max_textures);
+
+  /* Point this slot's descriptors at textures swapped since its last use */
+  for (uint32_t i = 0; i < stream->texture_count; i++) {
+    vk_stream_texture_t *texture = &stream->textures[i];
+    VkWriteDescriptorSet *write;
+    if (generations[i] == texture->generation) continue;
+    generations[i] = texture->generation;
+    bound_mips[i] = texture->view ? texture->resident_mip : VK_STREAM_INVALID;
+    stream->image_infos[write_count].sampler = stream->sampler;
+    stream->image_infos[write_count].imageView =
+      texture->view ? texture->view : stream->placeholder_view;
+    stream->image_infos[write_count].imageLayout =
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    write = &stream->writes[write_count];
+    write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write->pNext = NULL;
+    write->dstSet = stream->sets[frame_index];
+    write->dstBinding = 0;
+    write->dstArrayElement = i;
+    write->descriptorCount = 1;
+    write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write->pImageInfo = &stream->image_infos[write_count];
+    write->pBufferInfo = NULL;
+    write->pTexelBufferView = NULL;
+    write_count++;
+  }
+  if (write_count > 0)
+    vkUpdateDescriptorSets(dev->device, write_count, stream->writes, 0, NULL);
+
+  telemetry_report(
+      "stream.resident_mb",
+      TELEMETRY_GAUGE,
+      (double)stream->resident_size / (1024.0 * 1024.0)
+  );
+  telemetry_report(
+      "stream.peak_mb",
+      TELEMETRY_GAUGE,
+      (double)stream->peak_size / (1024.0 * 1024.0)
+  );
+}
+/* Retire finished uploads and schedule new ones */
+void vk_stream_update(vk_stream_t *stream, vk_dev_t *dev) {
+  candidate_t *candidates;
+  uint32_t candidate_count = 0;
+  VkDeviceSize scheduled = 0;
+
+  /* Submit decoded loads, in order so the staging ring is released in order */
+  for (uint32_t i = 0; i < stream->load_count; i++) {
+    vk_stream_load_t *load =
+      &stream->loads[(stream->load_head + i) % VK_STREAM_MAX_LOADS];
+    if (load->submitted) continue;
+    if (!jobs_done(&load->decode)) break;
+    submit_load(stream, load);
+  }
+  /* Swap in finished loads */
+  while (stream->load_count > 0) {
+    vk_stream_load_t *load = &stream->loads[stream->load_head];
+    if (!load->submitted || !vk_sync_reached(load->uploaded, dev)) break;
+    finish_load(stream, load);
+    stream->load_head = (stream->load_head + 1) % VK_STREAM_MAX_LOADS;
+    stream->load_count--;
+  }
+
+  /* Gather textures wanting finer levels, missing tails first */
+  candidates =
+    (candidate_t *)malloc(sizeof(candidate_t) * (stream->texture_count + 1));
+  ASSERT(candidates);
+  for (uint32_t i = 0; i < stream->texture_count; i++) {
+    const vk_stream_texture_t *texture = &stream->textures[i];
+    if (texture->loading || texture->desired_mip >= texture->resident_mip)
+      continue;
+    candidates[candidate_count].texture = i;
+    candidates[candidate_count].levels = texture->view
+      ? texture->resident_mip - texture->desired_mip
+      : UINT32_MAX;
+    candidates[candidate_count].last_used = texture->last_used;
+    candidate_count++;
+  }
+  qsort(candidates, candidate_count, sizeof(candidate_t), compare_candidates);
+
+  /* Schedule within the upload and memory budgets */
+  for (uint32_t i = 0; i < candidate_count; i++) {
+    uint32_t index = candidates[i].texture;
+    vk_stream_texture_t *texture = &stream->textures[index];
+    uint32_t target = texture->desired_mip;
+    VkDeviceSize size = levels_size(texture, target);
+    VkDeviceSize growth;
+
+    /* Evicting for an earlier candidate may have scheduled this one */
+    if (texture->loading) continue;
+    /* Fall back to one level finer if the full request doesn't fit */
+    if (
+        texture->view
+        && stream->resident_size + size - texture->memory_size
+          > stream->budget
+    ) {
+      target = texture->resident_mip - 1;
+      size = levels_size(texture, target);
+    }
+    if (scheduled > 0 && scheduled + size > stream->upload_budget) break;
+    growth = size > texture->memory_size ? size - texture->memory_size : 0;
+    if (!evict(stream, dev, growth, index) && texture->view) continue;
+    /* Finer levels wait while the heap is near its budget */
+    if (
+        stream->residency
+        && texture->view
+        && growth > vk_residency_room(stream->residency, texture->memory_type)
+    ) continue;
+    if (!schedule_load(stream, dev, index, target)) break;
+    scheduled += size;
+  }
+  free(candidates);
+}
+/* Destroy a texture streamer (waits for uploads) */
+void vk_stream_destroy(vk_stream_t *stream, vk_dev_t *dev) {
+  /* Wait for decodes, then flush and wait for the submitted uploads */
+  for (uint32_t i = 0; i < stream->load_count; i++) {
+    vk_stream_load_t *load =
+      &stream->loads[(stream->load_head + i) % VK_STREAM_MAX_LOADS];
+    if (stream->jobs) jobs_wait(stream->jobs, &load->decode);
+    free(load->jobs);
+    load->jobs = NULL;
+  }
+  vk_submit_flush(stream->submit);
+  for (uint32_t i = 0; i < stream->load_count; i++) {
+    vk_stream_load_t *load =
+      &stream->loads[(stream->load_head + i) % VK_STREAM_MAX_LOADS];
+    if (load->submitted) vk_sync_wait(load->uploaded, dev, UINT64_MAX);
+    vkDestroyImageView(dev->device, load->view, NULL);
+    vkDestroyImage(dev->device, load->image, NULL);
+    vkFreeMemory(dev->device, load->memory, NULL);
+  }
+  vkDestroyCommandPool(dev->device, stream->command_pool, NULL);
+
+  /* Destroy images */
+  for (uint32_t i = 0; i < stream->retired_count; i++) {
+    vkDestroyImageView(dev->device, stream->retired[i].view, NULL);
+    vkDestroyImage(dev->device, stream->retired[i].image, NULL);
+    vkFreeMemory(dev->device, stream->retired[i].memory, NULL);
+  }
+  for (uint32_t i = 0; i < stream->texture_count; i++) {
+    vk_stream_texture_t *texture = &stream->textures[i];
+    if (stream->residency)
+      vk_residency_remove(stream->residency, texture->residency_id);
+    if (!texture->image) continue;
+    vkDestroyImageView(dev->device, texture->view, NULL);
+    vkDestroyImage(dev->device, texture->image, NULL);
+    vkFreeMemory(dev->device, texture->memory, NULL);
+  }
+  vkDestroyImageView(dev->device, stream->placeholder_view, NULL);
+  vkDestroyImage(dev->device, stream->placeholder, NULL);
+  vkFreeMemory(dev->device, stream->placeholder_memory, NULL);
+
+  /* Destroy descriptors and buffers */
+  vk_dev_cache_release_sampler(dev, stream->sampler);
+  vkDestroyDescriptorPool(dev->device, stream->descriptor_pool, NULL);
+  vk_dev_cache_release_set_layout(dev, stream->set_layout);
+  for (uint32_t i = 0; i < stream->frames_in_flight; i++)
+    vk_buf_destroy(&stream->feedback[i], dev);
+  vk_staging_destroy(&stream->staging, dev);
+
+  free(stream->textures);
+  free(stream->sets);
+  free(stream->feedback);
+  free(stream->set_generations);
+  free(stream->set_resident_mips);
+  free(stream->image_infos);
+  free(stream->writes);
+  if (stream->retired) free(stream->retired);
+  memset(stream, 0, sizeof(vk_stream_t));
+}
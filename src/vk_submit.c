@@ -0,0 +1,509 @@
+/* Implements vk_submit.h */
+#include <vk_submit.h>
+#include <vk_capture.h>
+#include <telemetry.h>
+
+/* Grow an array to hold at least count elements */
+static void *reserve(
+    void *array,
+    uint32_t *capacity,
+    uint32_t count,
+    size_t element_size
+) {
+  uint32_t new_capacity = *capacity ? *capacity : 16;
+  if (count <= *capacity) return array;
+  while (new_capacity < count) new_capacity *= 2;
+  array = realloc(array, element_size * new_capacity);
+  ASSERT(array);
+  *capacity = new_capacity;
+  return array;
+}
+/* Free a list */
+static void list_free(vk_submit_list_t *list) {
+  free(list->entries);
+  free(list->command_buffers);
+  free(list->waits);
+  free(list->signals);
+  memset(list, 0, sizeof(vk_submit_list_t));
+}
+/* Fill a semaphore submit info */
+static void semaphore_info(
+    VkSemaphoreSubmitInfoKHR *info,
+    const vk_submit_semaphore_t *semaphore
+) {
+  info->sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+  info->pNext = NULL;
+  info->semaphore = semaphore->semaphore;
+  info->value = semaphore->value;
+  info->stageMask = semaphore->stages
+    ? semaphore->stages
+    : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+  info->deviceIndex = 0;
+}
+/* Add a queue (or find it, if another kind shares it) */
+static uint32_t add_queue(vk_submit_t *submit, vk_dev_t *dev, VkQueue queue) {
+  vk_submit_queue_t *entry;
+  for (uint32_t i = 0; i < submit->queue_count; i++)
+    if (submit->queues[i].queue == queue) return i;
+  entry = &submit->queues[submit->queue_count];
+  memset(entry, 0, sizeof(vk_submit_queue_t));
+  entry->queue = queue;
+  vk_timeline_create(&entry->timeline, dev);
+  pthread_mutex_init(&entry->queue_mutex, NULL);
+  pthread_mutex_init(&entry->pending_mutex, NULL);
+  atomic_init(&entry->load, 0);
+  atomic_init(&entry->last_load, 0);
+  return submit->queue_count++;
+}
+/* Set the queues of a kind */
+static void set_kind(
+    vk_submit_t *submit,
+    vk_dev_t *dev,
+    vk_submit_kind_t kind,
+    const VkQueue *queues,
+    uint32_t count
+) {
+  if (count == 0) return;
+  submit->kind_queues[kind] = (uint32_t *)malloc(sizeof(uint32_t) * count);
+  ASSERT(submit->kind_queues[kind]);
+  for (uint32_t i = 0; i < count; i++)
+    submit->kind_queues[kind][i] = add_queue(submit, dev, queues[i]);
+  submit->kind_queue_counts[kind] = count;
+}
+/* Use another kind's queues for a kind the device has none of */
+static void alias_kind(
+    vk_submit_t *submit,
+    vk_submit_kind_t kind,
+    vk_submit_kind_t fallback
+) {
+  uint32_t count = submit->kind_queue_counts[fallback];
+  if (submit->kind_queue_counts[kind] > 0 || count == 0) return;
+  submit->kind_queues[kind] = (uint32_t *)malloc(sizeof(uint32_t) * count);
+  ASSERT(submit->kind_queues[kind]);
+  memcpy(
+      submit->kind_queues[kind],
+      submit->kind_queues[fallback],
+      sizeof(uint32_t) * count
+  );
+  submit->kind_queue_counts[kind] = count;
+}
+/* Reserve an 8 byte aligned range of a scratch block, giving its offset */
+static size_t carve(size_t *size, size_t bytes) {
+  size_t offset = (*size + 7) & ~(size_t)7;
+  *size = offset + bytes;
+  return offset;
+}
+/* Submit batches with vkQueueSubmit (without synchronization2) */
+static void submit_legacy(
+    vk_submit_queue_t *queue,
+    const VkSubmitInfo2KHR *batches,
+    uint32_t batch_count,
+    VkFence fence
+) {
+  uint32_t cmd_count = 0, wait_count = 0, signal_count = 0;
+  size_t offsets[8], size = 0;
+  VkSubmitInfo *infos;
+  VkTimelineSemaphoreSubmitInfo *timelines;
+  VkCommandBuffer *cmds;
+  VkSemaphore *waits, *signals;
+  VkPipelineStageFlags *wait_stages;
+  uint64_t *wait_values, *signal_values;
+
+  if (batch_count == 0) {
+    VK_CHECK(vkQueueSubmit(queue->queue, 0, NULL, fence));
+    return;
+  }
+  for (uint32_t i = 0; i < batch_count; i++) {
+    cmd_count += batches[i].commandBufferInfoCount;
+    wait_count += batches[i].waitSemaphoreInfoCount;
+    signal_count += batches[i].signalSemaphoreInfoCount;
+  }
+  /* The arrays share one block, kept on the queue between flushes */
+  offsets[0] = carve(&size, sizeof(VkSubmitInfo) * batch_count);
+  offsets[1] =
+    carve(&size, sizeof(VkTimelineSemaphoreSubmitInfo) * batch_count);
+  offsets[2] = carve(&size, sizeof(VkCommandBuffer) * cmd_count);
+  offsets[3] = carve(&size, sizeof(VkSemaphore) * wait_count);
+  offsets[4] = carve(&size, sizeof(VkSemaphore) * signal_count);
+  offsets[5] = carve(&size, sizeof(VkPipelineStageFlags) * wait_count);
+  offsets[6] = carve(&size, sizeof(uint64_t) * wait_count);
+  offsets[7] = carve(&size, sizeof(uint64_t) * signal_count);
+  queue->legacy = (uint8_t *)reserve(
+      queue->legacy,
+      &queue->legacy_capacity,
+      (uint32_t)size,
+      1
+  );
+  infos = (VkSubmitInfo *)(queue->legacy + offsets[0]);
+  timelines = (VkTimelineSemaphoreSubmitInfo *)(queue->legacy + offsets[1]);
+  cmds = (VkCommandBuffer *)(queue->legacy + offsets[2]);
+  waits = (VkSemaphore *)(queue->legacy + offsets[3]);
+  signals = (VkSemaphore *)(queue->legacy + offsets[4]);
+  wait_stages = (VkPipelineStageFlags *)(queue->legacy + offsets[5]);
+  wait_values = (uint64_t *)(queue->legacy + offsets[6]);
+  signal_values = (uint64_t *)(queue->legacy + offsets[7]);
+
+  cmd_count = wait_count = signal_count = 0;
+  for (uint32_t i = 0; i < batch_count; i++) {
+    const VkSubmitInfo2KHR *batch = &batches[i];
+    VkSubmitInfo *info = &infos[i];
+    VkTimelineSemaphoreSubmitInfo *timeline = &timelines[i];
+
+    info->sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info->pNext = timeline;
+    info->waitSemaphoreCount = batch->waitSemaphoreInfoCount;
+    info->pWaitSemaphores = &waits[wait_count];
+    info->pWaitDstStageMask = &wait_stages[wait_count];
+    info->commandBufferCount = batch->commandBufferInfoCount;
+    info->pCommandBuffers = &cmds[cmd_count];
+    info->signalSemaphoreCount = batch->signalSemaphoreInfoCount;
+    info->pSignalSemaphores = &signals[signal_count];
+    timeline->sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline->pNext = NULL;
+    timeline->waitSemaphoreValueCount = batch->waitSemaphoreInfoCount;
+    timeline->pWaitSemaphoreValues = &wait_values[wait_count];
+    timeline->signalSemaphoreValueCount = batch->signalSemaphoreInfoCount;
+    timeline->pSignalSemaphoreValues = &signal_values[signal_count];
+    for (uint32_t j = 0; j < batch->waitSemaphoreInfoCount; j++) {
+      const VkSemaphoreSubmitInfoKHR *wait = &batch->pWaitSemaphoreInfos[j];
+      /* Legacy stages are the low bits of the synchronization2 ones */
+      VkPipelineStageFlags stages = (VkPipelineStageFlags)(
+          wait->stageMask & 0x7fffffffu
+      );
+      waits[wait_count] = wait->semaphore;
+      wait_values[wait_count] = wait->value;
+      wait_stages[wait_count++] = stages
+        ? stages
+        : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+    for (uint32_t j = 0; j < batch->commandBufferInfoCount; j++)
+      cmds[cmd_count++] = batch->pCommandBufferInfos[j].commandBuffer;
+    for (uint32_t j = 0; j < batch->signalSemaphoreInfoCount; j++) {
+      signals[signal_count] = batch->pSignalSemaphoreInfos[j].semaphore;
+      signal_values[signal_count++] = batch->pSignalSemaphoreInfos[j].value;
+    }
+  }
+  VK_CHECK(vkQueueSubmit(queue->queue, batch_count, infos, fence));
+}
+/* Submit a run of batches */
+static void submit_batches(
+    vk_submit_t *submit,
+    vk_submit_queue_t *queue,
+    uint32_t first,
+    uint32_t count,
+    VkFence fence
+) {
+  if (count == 0 && fence == VK_NULL_HANDLE) return;
+  if (submit->queue_submit2)
+    VK_CHECK(submit->queue_submit2(
+          queue->queue,
+          count,
+          count ? &queue->batches[first] : NULL,
+          fence
+    ));
+  else
+    submit_legacy(queue, &queue->batches[first], count, fence);
+  telemetry_report("submit.calls", TELEMETRY_COUNTER, 1.0);
+}
+/* Finish a batch: its own signals, then the queue timeline's */
+static void close_batch(
+    vk_submit_queue_t *queue,
+    VkSubmitInfo2KHR *batch,
+    uint64_t value,
+    uint32_t *signal_offset
+) {
+  VkSemaphoreSubmitInfoKHR *signals = &queue->batch_signals[*signal_offset];
+  vk_submit_semaphore_t timeline;
+  if (batch->signalSemaphoreInfoCount > 0) memcpy(
+      signals,
+      batch->pSignalSemaphoreInfos,
+      sizeof(VkSemaphoreSubmitInfoKHR) * batch->signalSemaphoreInfoCount
+  );
+  timeline.semaphore = queue->timeline.semaphore;
+  timeline.value = value;
+  timeline.stages = 0;
+  semaphore_info(&signals[batch->signalSemaphoreInfoCount], &timeline);
+  batch->pSignalSemaphoreInfos = signals;
+  batch->signalSemaphoreInfoCount++;
+  *signal_offset += batch->signalSemaphoreInfoCount;
+}
+/* Submit a queue's pending work (queue mutex held) */
+static void flush_queue(vk_submit_t *submit, vk_submit_queue_t *queue) {
+  vk_submit_list_t swap, *list = &queue->flushing;
+  uint32_t batch_count = 0, call_start = 0, signal_offset = 0;
+  VkSubmitInfo2KHR *batch = NULL;
+  uint64_t batch_value = 0;
+
+  /* Take the pending list, leaving an empty one for enqueuers */
+  pthread_mutex_lock(&queue->pending_mutex);
+  swap = queue->pending;
+  queue->pending = queue->flushing;
+  queue->flushing = swap;
+  atomic_store(&queue->last_load, atomic_exchange(&queue->load, 0));
+  pthread_mutex_unlock(&queue->pending_mutex);
+  if (list->entry_count == 0) return;
+
+  queue->batches = (VkSubmitInfo2KHR *)reserve(
+      queue->batches,
+      &queue->batch_capacity,
+      list->entry_count,
+      sizeof(VkSubmitInfo2KHR)
+  );
+  queue->batch_signals = (VkSemaphoreSubmitInfoKHR *)reserve(
+      queue->batch_signals,
+      &queue->batch_signal_capacity,
+      list->signal_count + list->entry_count,
+      sizeof(VkSemaphoreSubmitInfoKHR)
+  );
+  for (uint32_t i = 0; i < list->entry_count; i++) {
+    const vk_submit_entry_t *entry = &list->entries[i];
+
+    /* Extend the open batch if that adds no synchronization */
+    if (
+        batch
+        && entry->wait_count == 0
+        && batch->signalSemaphoreInfoCount == 0
+    ) {
+      batch->commandBufferInfoCount += entry->command_buffer_count;
+      batch->signalSemaphoreInfoCount = entry->signal_count;
+      batch->pSignalSemaphoreInfos = &list->signals[entry->first_signal];
+    } else {
+      if (batch) close_batch(queue, batch, batch_value, &signal_offset);
+      batch = &queue->batches[batch_count++];
+      batch->sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+      batch->pNext = NULL;
+      batch->flags = 0;
+      batch->waitSemaphoreInfoCount = entry->wait_count;
+      batch->pWaitSemaphoreInfos = &list->waits[entry->first_wait];
+      batch->commandBufferInfoCount = entry->command_buffer_count;
+      batch->pCommandBufferInfos =
+        &list->command_buffers[entry->first_command_buffer];
+      batch->signalSemaphoreInfoCount = entry->signal_count;
+      batch->pSignalSemaphoreInfos = &list->signals[entry->first_signal];
+    }
+    batch_value = entry->timeline_value;
+
+    /* A fence covers a whole call, so it ends one */
+    if (entry->fence != VK_NULL_HANDLE) {
+      close_batch(queue, batch, batch_value, &signal_offset);
+      batch = NULL;
+      submit_batches(
+          submit,
+          queue,
+          call_start,
+          batch_count - call_start,
+          entry->fence
+      );
+      call_start = batch_count;
+    }
+  }
+  if (batch) close_batch(queue, batch, batch_value, &signal_offset);
+  submit_batches(
+      submit,
+      queue,
+      call_start,
+      batch_count - call_start,
+      VK_NULL_HANDLE
+  );
+  telemetry_report(
+      "submit.submissions",
+      TELEMETRY_COUNTER,
+      (double)list->entry_count
+  );
+
+  list->entry_count = 0;
+  list->command_buffer_count = 0;
+  list->wait_count = 0;
+  list->signal_count = 0;
+}
+
+/* Take over a device's queues */
+void vk_submit_create(vk_submit_t *submit, vk_dev_t *dev) {
+  uint32_t total = dev->graphics_queue_count + dev->present_queue_count
+    + dev->compute_queue_count + dev->transfer_queue_count;
+  memset(submit, 0, sizeof(vk_submit_t));
+  ASSERT(total > 0);
+  submit->queues = (vk_submit_queue_t *)malloc(
+      sizeof(vk_submit_queue_t) * total
+  );
+  ASSERT(submit->queues);
+  /* Queues are numbered in flush order */
+  set_kind(
+      submit,
+      dev,
+      VK_SUBMIT_TRANSFER,
+      dev->transfer_queues,
+      dev->transfer_queue_count
+  );
+  set_kind(
+      submit,
+      dev,
+      VK_SUBMIT_COMPUTE,
+      dev->compute_queues,
+      dev->compute_queue_count
+  );
+  set_kind(
+      submit,
+      dev,
+      VK_SUBMIT_GRAPHICS,
+      dev->graphics_queues,
+      dev->graphics_queue_count
+  );
+  set_kind(
+      submit,
+      dev,
+      VK_SUBMIT_PRESENT,
+      dev->present_queues,
+      dev->present_queue_count
+  );
+  /* Graphics queues can do everything, and often present too */
+  alias_kind(submit, VK_SUBMIT_GRAPHICS, VK_SUBMIT_PRESENT);
+  alias_kind(submit, VK_SUBMIT_PRESENT, VK_SUBMIT_GRAPHICS);
+  alias_kind(submit, VK_SUBMIT_COMPUTE, VK_SUBMIT_GRAPHICS);
+  alias_kind(submit, VK_SUBMIT_TRANSFER, VK_SUBMIT_COMPUTE);
+
+  if (vk_dev_has_ext(dev, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+    submit->queue_submit2 = (PFN_vkQueueSubmit2KHR)vkGetDeviceProcAddr(
+        dev->device,
+        "vkQueueSubmit2KHR"
+    );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Submission layer: %u queues, %s",
+      submit->queue_count,
+      submit->queue_submit2 ? "vkQueueSubmit2KHR" : "vkQueueSubmit"
+  );
+}
+/* Enqueue work on the least loaded queue of a kind, giving its completion */
+vk_sync_point_t vk_submit_enqueue(
+    vk_submit_t *submit,
+    vk_submit_kind_t kind,
+    const vk_submission_t *submission
+) {
+  vk_submit_queue_t *queue = NULL;
+  vk_submit_list_t *list;
+  vk_submit_entry_t *entry;
+  vk_sync_point_t point;
+  uint32_t best = UINT32_MAX;
+
+  ASSERT(submit->kind_queue_counts[kind] > 0);
+  vk_capture_submit(kind, submission);
+  /* Load is this frame's work plus last frame's, still likely in flight */
+  for (uint32_t i = 0; i < submit->kind_queue_counts[kind]; i++) {
+    vk_submit_queue_t *candidate =
+      &submit->queues[submit->kind_queues[kind][i]];
+    uint32_t load = atomic_load(&candidate->load)
+      + atomic_load(&candidate->last_load);
+    if (load < best) {
+      best = load;
+      queue = candidate;
+    }
+  }
+
+  pthread_mutex_lock(&queue->pending_mutex);
+  list = &queue->pending;
+  list->entries = (vk_submit_entry_t *)reserve(
+      list->entries,
+      &list->entry_capacity,
+      list->entry_count + 1,
+      sizeof(vk_submit_entry_t)
+  );
+  list->command_buffers = (VkCommandBufferSubmitInfoKHR *)reserve(
+      list->command_buffers,
+      &list->command_buffer_capacity,
+      list->command_buffer_count + submission->command_buffer_count,
+      sizeof(VkCommandBufferSubmitInfoKHR)
+  );
+  list->waits = (VkSemaphoreSubmitInfoKHR *)reserve(
+      list->waits,
+      &list->wait_capacity,
+      list->wait_count + submission->wait_count,
+      sizeof(VkSemaphoreSubmitInfoKHR)
+  );
+  list->signals = (VkSemaphoreSubmitInfoKHR *)reserve(
+      list->signals,
+      &list->signal_capacity,
+      list->signal_count + submission->signal_count,
+      sizeof(VkSemaphoreSubmitInfoKHR)
+  );
+  entry = &list->entries[list->entry_count++];
+  entry->first_command_buffer = list->command_buffer_count;
+  entry->command_buffer_count = submission->command_buffer_count;
+  entry->first_wait = list->wait_count;
+  entry->wait_count = submission->wait_count;
+  entry->first_signal = list->signal_count;
+  entry->signal_count = submission->signal_count;
+  entry->fence = submission->fence;
+  /* Reserved under the lock, so values rise in submission order */
+  entry->timeline_value = vk_timeline_advance(&queue->timeline);
+  point.timeline = &queue->timeline;
+  point.value = entry->timeline_value;
+  for (uint32_t i = 0; i < submission->command_buffer_count; i++) {
+    VkCommandBufferSubmitInfoKHR *info =
+      &list->command_buffers[list->command_buffer_count++];
+    info->sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+    info->pNext = NULL;
+    info->commandBuffer = submission->command_buffers[i];
+    info->deviceMask = 0;
+  }
+  for (uint32_t i = 0; i < submission->wait_count; i++)
+    semaphore_info(&list->waits[list->wait_count++], &submission->waits[i]);
+  for (uint32_t i = 0; i < submission->signal_count; i++)
+    semaphore_info(
+        &list->signals[list->signal_count++],
+        &submission->signals[i]
+    );
+  atomic_fetch_add(&queue->load, submission->command_buffer_count);
+  pthread_mutex_unlock(&queue->pending_mutex);
+  return point;
+}
+/* Hand all enqueued work to the driver */
+void vk_submit_flush(vk_submit_t *submit) {
+  for (uint32_t i = 0; i < submit->queue_count; i++) {
+    pthread_mutex_lock(&submit->queues[i].queue_mutex);
+    flush_queue(submit, &submit->queues[i]);
+    pthread_mutex_unlock(&submit->queues[i].queue_mutex);
+  }
+}
+/* Flush, then present on the present queue */
+VkResult vk_submit_present(
+    vk_submit_t *submit,
+    const VkPresentInfoKHR *present_info
+) {
+  vk_submit_queue_t *queue;
+  VkResult result;
+  ASSERT(submit->kind_queue_counts[VK_SUBMIT_PRESENT] > 0);
+  vk_submit_flush(submit);
+  queue = &submit->queues[submit->kind_queues[VK_SUBMIT_PRESENT][0]];
+  pthread_mutex_lock(&queue->queue_mutex);
+  result = vkQueuePresentKHR(queue->queue, present_info);
+  pthread_mutex_unlock(&queue->queue_mutex);
+  return result;
+}
+/* Flush, then wait for every queue to go idle */
+void vk_submit_wait_idle(vk_submit_t *submit) {
+  vk_submit_flush(submit);
+  for (uint32_t i = 0; i < submit->queue_count; i++) {
+    pthread_mutex_lock(&submit->queues[i].queue_mutex);
+    VK_CHECK(vkQueueWaitIdle(submit->queues[i].queue));
+    pthread_mutex_unlock(&submit->queues[i].queue_mutex);
+  }
+}
+/* Destroy the submission layer (flushing nothing) */
+void vk_submit_destroy(vk_submit_t *submit, vk_dev_t *dev) {
+  for (uint32_t i = 0; i < submit->queue_count; i++) {
+    vk_submit_queue_t *queue = &submit->queues[i];
+    vk_timeline_destroy(&queue->timeline, dev);
+    pthread_mutex_destroy(&queue->queue_mutex);
+    pthread_mutex_destroy(&queue->pending_mutex);
+    list_free(&queue->pending);
+    list_free(&queue->flushing);
+    free(queue->batches);
+    free(queue->batch_signals);
+    free(queue->legacy);
+  }
+  for (uint32_t k = 0; k < VK_SUBMIT_KIND_COUNT; k++)
+    free(submit->kind_queues[k]);
+  free(submit->queues);
+  memset(submit, 0, sizeof(vk_submit_t));
+}
@@ -1,5 +1,6 @@
 /* Implements vk_swapchain.h */
 #include <vk_swapchain.h>
+#include <vk_capture.h>
 
 /* Create a Vulkan swapchain builder */
 vk_swapchain_builder_t vk_swapchain_builder(void) {
@@ -159,6 +160,12 @@ vk_swapchain_t vk_swapchain_create(
         &swapchain.image_count,
         swapchain.images
   ));
+  for (uint32_t i = 0; i < swapchain.image_count; i++) vk_capture_image(
+      swapchain.images[i],
+      builder->format.format,
+      builder->extent,
+      builder->image_usage
+  );
 
   /* Free builder */
   if (builder->queue_family_indices) free(builder->queue_family_indices);
@@ -0,0 +1,155 @@
+/* Implements vk_sync.h */
+#include <vk_sync.h>
+
+/* Most points a single wait can take */
+#define VK_SYNC_MAX_POINTS 32
+
+/* Raise the cached completed value */
+static void note_completed(vk_timeline_t *timeline, uint64_t value) {
+  uint_fast64_t seen = atomic_load(&timeline->completed);
+  while (
+      seen < value
+      && !atomic_compare_exchange_weak(&timeline->completed, &seen, value)
+  );
+}
+/* Check a point against the cached value only */
+static bool reached_cached(vk_sync_point_t point) {
+  return !point.timeline
+    || point.value == 0
+    || atomic_load(&point.timeline->completed) >= point.value;
+}
+/* Wait on several points with vkWaitSemaphores */
+static bool wait_points(
+    const vk_sync_point_t *points,
+    uint32_t count,
+    vk_dev_t *dev,
+    uint64_t timeout,
+    bool any
+) {
+  VkSemaphore semaphores[VK_SYNC_MAX_POINTS];
+  uint64_t values[VK_SYNC_MAX_POINTS];
+  VkSemaphoreWaitInfo wait_info;
+  uint32_t wait_count = 0;
+  VkResult result;
+
+  ASSERT(count <= VK_SYNC_MAX_POINTS);
+  for (uint32_t i = 0; i < count; i++) {
+    if (reached_cached(points[i])) {
+      if (any) return true;
+      continue;
+    }
+    semaphores[wait_count] = points[i].timeline->semaphore;
+    values[wait_count++] = points[i].value;
+  }
+  if (wait_count == 0) return true;
+
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.pNext = NULL;
+  wait_info.flags = any ? VK_SEMAPHORE_WAIT_ANY_BIT : 0;
+  wait_info.semaphoreCount = wait_count;
+  wait_info.pSemaphores = semaphores;
+  wait_info.pValues = values;
+  result = vkWaitSemaphores(dev->device, &wait_info, timeout);
+  if (result == VK_TIMEOUT) return false;
+  VK_CHECK(result);
+  if (!any) {
+    for (uint32_t i = 0; i < count; i++) {
+      if (points[i].timeline)
+        note_completed(points[i].timeline, points[i].value);
+    }
+  }
+  return true;
+}
+
+/* Create a timeline (starting at zero) */
+void vk_timeline_create(vk_timeline_t *timeline, vk_dev_t *dev) {
+  VkSemaphoreTypeCreateInfo type_info;
+  VkSemaphoreCreateInfo create_info;
+  type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  type_info.pNext = NULL;
+  type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  type_info.initialValue = 0;
+  create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  create_info.pNext = &type_info;
+  create_info.flags = 0;
+  VK_CHECK(vkCreateSemaphore(
+        dev->device,
+        &create_info,
+        NULL,
+        &timeline->semaphore
+  ));
+  atomic_init(&timeline->next, 0);
+  atomic_init(&timeline->completed, 0);
+}
+/* Reserve the next value to signal */
+uint64_t vk_timeline_advance(vk_timeline_t *timeline) {
+  return atomic_fetch_add(&timeline->next, 1) + 1;
+}
+/* Get the timeline's current value */
+uint64_t vk_timeline_completed(vk_timeline_t *timeline, vk_dev_t *dev) {
+  uint64_t value;
+  VK_CHECK(vkGetSemaphoreCounterValue(
+        dev->device,
+        timeline->semaphore,
+        &value
+  ));
+  note_completed(timeline, value);
+  return value;
+}
+/* Signal a value from the host */
+void vk_timeline_signal(
+    vk_timeline_t *timeline,
+    vk_dev_t *dev,
+    uint64_t value
+) {
+  VkSemaphoreSignalInfo signal_info;
+  signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+  signal_info.pNext = NULL;
+  signal_info.semaphore = timeline->semaphore;
+  signal_info.value = value;
+  VK_CHECK(vkSignalSemaphore(dev->device, &signal_info));
+  note_completed(timeline, value);
+}
+/* Destroy a timeline */
+void vk_timeline_destroy(vk_timeline_t *timeline, vk_dev_t *dev) {
+  vkDestroySemaphore(dev->device, timeline->semaphore, NULL);
+  memset(timeline, 0, sizeof(vk_timeline_t));
+}
+
+/* Check if a point has been reached (without blocking) */
+bool vk_sync_reached(vk_sync_point_t point, vk_dev_t *dev) {
+  if (reached_cached(point)) return true;
+  return vk_timeline_completed(point.timeline, dev) >= point.value;
+}
+/* Wait for a point (false on timeout, in nanoseconds) */
+bool vk_sync_wait(vk_sync_point_t point, vk_dev_t *dev, uint64_t timeout) {
+  return wait_points(&point, 1, dev, timeout, false);
+}
+/* Wait for every point (false on timeout) */
+bool vk_sync_wait_all(
+    const vk_sync_point_t *points,
+    uint32_t count,
+    vk_dev_t *dev,
+    uint64_t timeout
+) {
+  return wait_points(points, count, dev, timeout, false);
+}
+/* Wait for any point, giving its index (false on timeout) */
+bool vk_sync_wait_any(
+    const vk_sync_point_t *points,
+    uint32_t count,
+    vk_dev_t *dev,
+    uint64_t timeout,
+    uint32_t *reached
+) {
+  if (!wait_points(points, count, dev, timeout, true)) return false;
+  for (uint32_t i = 0; i < count; i++) {
+    if (vk_sync_reached(points[i], dev)) {
+      if (reached) *reached = i;
+      return true;
+    }
+  }
+  /* Timelines never go backwards, so one of the points was found above */
+  ASSERT(false);
+  return false;
+}
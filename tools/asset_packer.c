@@ -0,0 +1,582 @@
+/* Offline asset packer */
+#include <base.h>
+#include <hash.h>
+#include <asset_pack.h>
+#include <mesh_opt.h>
+#include <transcode.h>
+#include <vk_shader.h>
+
+/*
+ * Usage: asset_packer <output> <entry>...
+ *
+ * Entries:
+ *   obj <name> <file.obj>                  - triangulated, cache optimized
+ *                                            mesh, written as
+ *                                            <name>.vertices (quantized),
+ *                                            <name>.indices (32 bit) and
+ *                                            <name>.meshlets
+ *   vertex <name> <file> <stride>          - raw vertex data
+ *   index <name> <file> <16|32>            - raw index data
+ *   texture <name> <file> <format> <width> <height> <mips>
+ *                                          - raw texel data, mips largest
+ *                                            first, format is a VkFormat value
+ *   universal <name> <file> <width> <height> <srgb 0|1>
+ *                                          - RGBA8 texels, encoded with a
+ *                                            full mip chain as universal
+ *                                            blocks (see transcode.h)
+ *   shader <name> <file.spv>               - SPIR-V, checked and reflected
+ *                                            for its stage
+ *   raw <name> <file>                      - uninterpreted data
+ */
+
+/* Types */
+/* Growable array */
+typedef struct {
+  void *data;
+  size_t count;
+  size_t capacity;
+  size_t stride;
+} array_t;
+/* Vertex deduplication table (keys are packed OBJ index triples) */
+typedef struct {
+  uint64_t *keys;
+  uint32_t *values;
+  size_t capacity;
+} vertex_map_t;
+
+/* Append to an array */
+static void *array_push(array_t *array) {
+  if (array->count == array->capacity) {
+    array->capacity = array->capacity ? array->capacity * 2 : 256;
+    array->data = realloc(array->data, array->capacity * array->stride);
+    ASSERT(array->data);
+  }
+  return (uint8_t *)array->data + array->stride * array->count++;
+}
+/* Find or insert a vertex (returns true if it was inserted) */
+static bool vertex_map_get(vertex_map_t *map, uint64_t key, uint32_t *value) {
+  size_t i = (size_t)hash64(&key, sizeof(key), 0) & (map->capacity - 1);
+  while (map->keys[i] != UINT64_MAX) {
+    if (map->keys[i] == key) {
+      *value = map->values[i];
+      return false;
+    }
+    i = (i + 1) & (map->capacity - 1);
+  }
+  map->keys[i] = key;
+  map->values[i] = *value;
+  return true;
+}
+/* Resolve a (possibly negative) OBJ index */
+static int64_t obj_index(long index, size_t count) {
+  if (index < 0) return (int64_t)count + index;
+  return (int64_t)index - 1;
+}
+
+/* Optimize, quantize and pack a mesh */
+static bool pack_mesh(
+    asset_pack_writer_t *writer,
+    const char *name,
+    mesh_vertex_t *vertices,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count
+) {
+  mesh_cache_stats_t before, after;
+  mesh_quant_vertex_t *quantized;
+  mesh_quant_params_t params;
+  mesh_meshlets_t meshlets;
+  char chunk_name[ASSET_CHUNK_NAME_MAX];
+  uint32_t meta[ASSET_CHUNK_META_COUNT];
+  size_t meshlet_size;
+  uint8_t *meshlet_data;
+  bool ok;
+
+  /* Reorder for the post-transform cache, then for vertex fetch */
+  before = mesh_opt_cache_stats(
+      indices,
+      index_count,
+      vertex_count,
+      MESH_OPT_CACHE_SIZE
+  );
+  mesh_opt_reorder_indices(
+      indices,
+      index_count,
+      vertex_count,
+      MESH_OPT_CACHE_SIZE
+  );
+  vertex_count = mesh_opt_reorder_vertices(
+      vertices,
+      vertex_count,
+      indices,
+      index_count
+  );
+  after = mesh_opt_cache_stats(
+      indices,
+      index_count,
+      vertex_count,
+      MESH_OPT_CACHE_SIZE
+  );
+
+  /* Quantize and build meshlets */
+  quantized = (mesh_quant_vertex_t *)malloc(
+      sizeof(mesh_quant_vertex_t) * (vertex_count + 1)
+  );
+  ASSERT(quantized);
+  params = mesh_opt_quantize(vertices, vertex_count, quantized);
+  meshlets = mesh_opt_build_meshlets(vertices, indices, index_count);
+  meshlet_size =
+    sizeof(mesh_meshlet_t) * meshlets.meshlet_count
+    + sizeof(uint32_t) * meshlets.vertex_count
+    + meshlets.triangle_count * 3;
+  meshlet_data = (uint8_t *)malloc(meshlet_size);
+  ASSERT(meshlet_data);
+  memcpy(
+      meshlet_data,
+      meshlets.meshlets,
+      sizeof(mesh_meshlet_t) * meshlets.meshlet_count
+  );
+  memcpy(
+      meshlet_data + sizeof(mesh_meshlet_t) * meshlets.meshlet_count,
+      meshlets.vertices,
+      sizeof(uint32_t) * meshlets.vertex_count
+  );
+  memcpy(
+      meshlet_data
+      + sizeof(mesh_meshlet_t) * meshlets.meshlet_count
+      + sizeof(uint32_t) * meshlets.vertex_count,
+      meshlets.triangles,
+      meshlets.triangle_count * 3
+  );
+
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%s: %zu vertices, %zu triangles, %u meshlets",
+      name,
+      vertex_count,
+      index_count / 3,
+      meshlets.meshlet_count
+  );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu -> %zu bytes/vertex",
+      name,
+      before.acmr,
+      after.acmr,
+      before.atvr,
+      after.atvr,
+      sizeof(mesh_vertex_t),
+      sizeof(mesh_quant_vertex_t)
+  );
+
+  /* Write chunks */
+  memset(meta, 0, sizeof(meta));
+  meta[ASSET_META_VERTEX_STRIDE] = sizeof(mesh_quant_vertex_t);
+  meta[ASSET_META_VERTEX_COUNT] = (uint32_t)vertex_count;
+  meta[ASSET_META_VERTEX_FORMAT] = ASSET_VERTEX_FORMAT_QUANTIZED;
+  memcpy(&meta[ASSET_META_VERTEX_QUANT], &params, sizeof(params));
+  snprintf(chunk_name, sizeof(chunk_name), "%s.vertices", name);
+  ok = asset_pack_writer_add(
+      writer,
+      chunk_name,
+      ASSET_CHUNK_VERTEX,
+      meta,
+      quantized,
+      sizeof(mesh_quant_vertex_t) * vertex_count
+  );
+  if (ok) {
+    memset(meta, 0, sizeof(meta));
+    meta[ASSET_META_INDEX_SIZE] = sizeof(uint32_t);
+    meta[ASSET_META_INDEX_COUNT] = (uint32_t)index_count;
+    snprintf(chunk_name, sizeof(chunk_name), "%s.indices", name);
+    ok = asset_pack_writer_add(
+        writer,
+        chunk_name,
+        ASSET_CHUNK_INDEX,
+        meta,
+        indices,
+        sizeof(uint32_t) * index_count
+    );
+  }
+  if (ok) {
+    memset(meta, 0, sizeof(meta));
+    meta[ASSET_META_MESHLET_COUNT] = meshlets.meshlet_count;
+    meta[ASSET_META_MESHLET_VERTEX_COUNT] = meshlets.vertex_count;
+    meta[ASSET_META_MESHLET_TRIANGLE_COUNT] = meshlets.triangle_count;
+    snprintf(chunk_name, sizeof(chunk_name), "%s.meshlets", name);
+    ok = asset_pack_writer_add(
+        writer,
+        chunk_name,
+        ASSET_CHUNK_MESHLET,
+        meta,
+        meshlet_data,
+        meshlet_size
+    );
+  }
+
+  free(meshlet_data);
+  mesh_opt_meshlets_free(&meshlets);
+  free(quantized);
+  return ok;
+}
+/* Load and pack an OBJ mesh */
+static bool pack_obj(
+    asset_pack_writer_t *writer,
+    const char *name,
+    const char *path
+) {
+  array_t positions = { NULL, 0, 0, sizeof(float) * 3 };
+  array_t normals = { NULL, 0, 0, sizeof(float) * 3 };
+  array_t uvs = { NULL, 0, 0, sizeof(float) * 2 };
+  array_t vertices = { NULL, 0, 0, sizeof(mesh_vertex_t) };
+  array_t indices = { NULL, 0, 0, sizeof(uint32_t) };
+  vertex_map_t map;
+  char line[1024];
+  bool ok = true;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to open %s", path);
+    return false;
+  }
+
+  map.capacity = 1 << 16;
+  map.keys = (uint64_t *)malloc(sizeof(uint64_t) * map.capacity);
+  map.values = (uint32_t *)malloc(sizeof(uint32_t) * map.capacity);
+  ASSERT(map.keys && map.values);
+  memset(map.keys, 0xff, sizeof(uint64_t) * map.capacity);
+
+  while (ok && fgets(line, sizeof(line), file)) {
+    if (strncmp(line, "v ", 2) == 0) {
+      float *p = (float *)array_push(&positions);
+      if (sscanf(line + 2, "%f %f %f", &p[0], &p[1], &p[2]) != 3) ok = false;
+    } else if (strncmp(line, "vn ", 3) == 0) {
+      float *n = (float *)array_push(&normals);
+      if (sscanf(line + 3, "%f %f %f", &n[0], &n[1], &n[2]) != 3) ok = false;
+    } else if (strncmp(line, "vt ", 3) == 0) {
+      float *t = (float *)array_push(&uvs);
+      if (sscanf(line + 3, "%f %f", &t[0], &t[1]) != 2) ok = false;
+    } else if (strncmp(line, "f ", 2) == 0) {
+      uint32_t face[64];
+      uint32_t face_count = 0;
+      char *token = strtok(line + 2, " \t\r\n");
+      for (; token && face_count < 64; token = strtok(NULL, " \t\r\n")) {
+        long v = 0, t = 0, n = 0;
+        int64_t vi, ti, ni;
+        uint32_t index;
+        char *end;
+        v = strtol(token, &end, 10);
+        if (*end == '/') {
+          if (end[1] != '/') t = strtol(end + 1, &end, 10);
+          else end++;
+          if (*end == '/') n = strtol(end + 1, &end, 10);
+        }
+        vi = obj_index(v, positions.count);
+        ti = t ? obj_index(t, uvs.count) : -1;
+        ni = n ? obj_index(n, normals.count) : -1;
+        if (
+            vi < 0 || vi >= (int64_t)positions.count
+            || ti >= (int64_t)uvs.count || ni >= (int64_t)normals.count
+        ) {
+          ok = false;
+          break;
+        }
+
+        /* Deduplicate the index triple */
+        index = (uint32_t)vertices.count;
+        if (vertex_map_get(
+              &map,
+              ((uint64_t)vi << 42)
+              | ((uint64_t)(ti + 1) << 21)
+              | (uint64_t)(ni + 1),
+              &index
+        )) {
+          mesh_vertex_t *vertex = (mesh_vertex_t *)array_push(&vertices);
+          memset(vertex, 0, sizeof(mesh_vertex_t));
+          memcpy(
+              vertex->position,
+              (float *)positions.data + vi * 3,
+              sizeof(float) * 3
+          );
+          if (ni >= 0)
+            memcpy(
+                vertex->normal,
+                (float *)normals.data + ni * 3,
+                sizeof(float) * 3
+            );
+          if (ti >= 0)
+            memcpy(vertex->uv, (float *)uvs.data + ti * 2, sizeof(float) * 2);
+
+          /* Grow the table past half full */
+          if (vertices.count * 2 > map.capacity) {
+            vertex_map_t grown;
+            grown.capacity = map.capacity * 2;
+            grown.keys = (uint64_t *)malloc(sizeof(uint64_t) * grown.capacity);
+            grown.values =
+              (uint32_t *)malloc(sizeof(uint32_t) * grown.capacity);
+            ASSERT(grown.keys && grown.values);
+            memset(grown.keys, 0xff, sizeof(uint64_t) * grown.capacity);
+            for (size_t i = 0; i < map.capacity; i++) {
+              if (map.keys[i] != UINT64_MAX)
+                vertex_map_get(&grown, map.keys[i], &map.values[i]);
+            }
+            free(map.keys);
+            free(map.values);
+            map = grown;
+          }
+        }
+        face[face_count++] = index;
+      }
+
+      /* Triangulate as a fan */
+      for (uint32_t i = 2; ok && i < face_count; i++) {
+        *(uint32_t *)array_push(&indices) = face[0];
+        *(uint32_t *)array_push(&indices) = face[i - 1];
+        *(uint32_t *)array_push(&indices) = face[i];
+      }
+    }
+  }
+  fclose(file);
+  if (!ok || indices.count == 0) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to parse %s", path);
+    ok = false;
+  }
+
+  /* Optimize and write chunks */
+  if (ok) {
+    ok = pack_mesh(
+        writer,
+        name,
+        (mesh_vertex_t *)vertices.data,
+        vertices.count,
+        (uint32_t *)indices.data,
+        indices.count
+    );
+  }
+
+  free(positions.data);
+  free(normals.data);
+  free(uvs.data);
+  free(vertices.data);
+  free(indices.data);
+  free(map.keys);
+  free(map.values);
+  return ok;
+}
+/* Pack a raw file */
+static bool pack_raw(
+    asset_pack_writer_t *writer,
+    const char *name,
+    const char *path,
+    asset_chunk_type_t type,
+    const uint32_t *meta
+) {
+  size_t size;
+  void *data = read_file(path, &size);
+  bool ok;
+  if (!data) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read %s: %s", path, strerror(errno));
+    return false;
+  }
+  ok = asset_pack_writer_add(writer, name, type, meta, data, size);
+  free(data);
+  return ok;
+}
+/* Pack a SPIR-V shader */
+static bool pack_shader(
+    asset_pack_writer_t *writer,
+    const char *name,
+    const char *path
+) {
+  uint32_t meta[ASSET_CHUNK_META_COUNT];
+  vk_shader_t shader;
+  size_t size;
+  void *code = read_file(path, &size);
+  bool ok;
+  if (!code) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read %s: %s", path, strerror(errno));
+    return false;
+  }
+  if (!vk_shader_reflect(&shader, (const uint32_t *)code, size)) {
+    log_msg(LOG_LEVEL_ERROR, "%s isn't valid SPIR-V", path);
+    free(code);
+    return false;
+  }
+  memset(meta, 0, sizeof(meta));
+  meta[ASSET_META_SHADER_STAGE] = (uint32_t)shader.stage;
+  ok = asset_pack_writer_add(
+      writer,
+      name,
+      ASSET_CHUNK_SHADER,
+      meta,
+      code,
+      size
+  );
+  free(code);
+  return ok;
+}
+
+/* Pack an RGBA8 image as universal blocks with a full mip chain */
+static bool pack_universal(
+    asset_pack_writer_t *writer,
+    const char *name,
+    const char *path,
+    uint32_t width,
+    uint32_t height,
+    bool srgb
+) {
+  uint32_t meta[ASSET_CHUNK_META_COUNT];
+  uint32_t mip_count = 1;
+  size_t size, total = 0, offset = 0;
+  uint8_t *level = (uint8_t *)read_file(path, &size);
+  uint8_t *blocks;
+  double start = time_now();
+  bool ok;
+
+  if (!level) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read %s: %s", path, strerror(errno));
+    return false;
+  }
+  if (width == 0 || height == 0 || size < (size_t)width * height * 4) {
+    log_msg(
+        LOG_LEVEL_ERROR,
+        "%s is smaller than %ux%u RGBA8",
+        path,
+        width,
+        height
+    );
+    free(level);
+    return false;
+  }
+  while ((width >> mip_count) > 0 || (height >> mip_count) > 0) mip_count++;
+  for (uint32_t i = 0; i < mip_count; i++) {
+    total += transcode_universal_size(
+        width >> i ? width >> i : 1,
+        height >> i ? height >> i : 1
+    );
+  }
+  blocks = (uint8_t *)malloc(total);
+  ASSERT(blocks);
+
+  /* Encode each level, then box filter it into the next */
+  for (uint32_t i = 0; i < mip_count; i++) {
+    uint32_t w = width >> i ? width >> i : 1;
+    uint32_t h = height >> i ? height >> i : 1;
+    uint32_t next_w = w > 1 ? w / 2 : 1, next_h = h > 1 ? h / 2 : 1;
+    transcode_encode(level, w, h, blocks + offset);
+    offset += transcode_universal_size(w, h);
+    if (i + 1 == mip_count) break;
+    for (uint32_t y = 0; y < next_h; y++) {
+      for (uint32_t x = 0; x < next_w; x++) {
+        uint32_t x0 = x * 2 < w ? x * 2 : w - 1;
+        uint32_t y0 = y * 2 < h ? y * 2 : h - 1;
+        uint32_t x1 = x0 + 1 < w ? x0 + 1 : x0;
+        uint32_t y1 = y0 + 1 < h ? y0 + 1 : y0;
+        for (uint32_t c = 0; c < 4; c++) {
+          uint32_t sum = level[((size_t)y0 * w + x0) * 4 + c]
+            + level[((size_t)y0 * w + x1) * 4 + c]
+            + level[((size_t)y1 * w + x0) * 4 + c]
+            + level[((size_t)y1 * w + x1) * 4 + c];
+          level[((size_t)y * next_w + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+        }
+      }
+    }
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%s: %u levels, %.2f MB -> %.2f MB in %.2f s",
+      name,
+      mip_count,
+      (double)width * height * 4 * 4 / 3 * 1e-6,
+      (double)total * 1e-6,
+      time_now() - start
+  );
+
+  memset(meta, 0, sizeof(meta));
+  meta[ASSET_META_TEXTURE_FORMAT] = srgb
+    ? TRANSCODE_FORMAT_UNIVERSAL_SRGB
+    : TRANSCODE_FORMAT_UNIVERSAL_UNORM;
+  meta[ASSET_META_TEXTURE_WIDTH] = width;
+  meta[ASSET_META_TEXTURE_HEIGHT] = height;
+  meta[ASSET_META_TEXTURE_MIPS] = mip_count;
+  ok = asset_pack_writer_add(
+      writer,
+      name,
+      ASSET_CHUNK_TEXTURE,
+      meta,
+      blocks,
+      total
+  );
+  free(level);
+  free(blocks);
+  return ok;
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  asset_pack_writer_t writer;
+  bool ok = true;
+  int i = 2;
+
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <output> <entry>...\n", argv[0]);
+    return 1;
+  }
+  if (!asset_pack_writer_begin(&writer, argv[1])) return 1;
+
+  while (ok && i < argc) {
+    uint32_t meta[ASSET_CHUNK_META_COUNT];
+    const char *kind = argv[i];
+    memset(meta, 0, sizeof(meta));
+    if (strcmp(kind, "obj") == 0 && i + 2 < argc) {
+      ok = pack_obj(&writer, argv[i + 1], argv[i + 2]);
+      i += 3;
+    } else if (strcmp(kind, "vertex") == 0 && i + 3 < argc) {
+      meta[ASSET_META_VERTEX_STRIDE] = (uint32_t)atoi(argv[i + 3]);
+      ok = meta[ASSET_META_VERTEX_STRIDE] > 0 && pack_raw(
+          &writer, argv[i + 1], argv[i + 2], ASSET_CHUNK_VERTEX, meta
+      );
+      i += 4;
+    } else if (strcmp(kind, "index") == 0 && i + 3 < argc) {
+      meta[ASSET_META_INDEX_SIZE] = (uint32_t)atoi(argv[i + 3]) / 8;
+      ok = (
+          meta[ASSET_META_INDEX_SIZE] == 2
+          || meta[ASSET_META_INDEX_SIZE] == 4
+      ) && pack_raw(
+          &writer, argv[i + 1], argv[i + 2], ASSET_CHUNK_INDEX, meta
+      );
+      i += 4;
+    } else if (strcmp(kind, "texture") == 0 && i + 6 < argc) {
+      meta[ASSET_META_TEXTURE_FORMAT] = (uint32_t)atoi(argv[i + 3]);
+      meta[ASSET_META_TEXTURE_WIDTH] = (uint32_t)atoi(argv[i + 4]);
+      meta[ASSET_META_TEXTURE_HEIGHT] = (uint32_t)atoi(argv[i + 5]);
+      meta[ASSET_META_TEXTURE_MIPS] = (uint32_t)atoi(argv[i + 6]);
+      ok = pack_raw(
+          &writer, argv[i + 1], argv[i + 2], ASSET_CHUNK_TEXTURE, meta
+      );
+      i += 7;
+    } else if (strcmp(kind, "universal") == 0 && i + 5 < argc) {
+      ok = pack_universal(
+          &writer,
+          argv[i + 1],
+          argv[i + 2],
+          (uint32_t)atoi(argv[i + 3]),
+          (uint32_t)atoi(argv[i + 4]),
+          atoi(argv[i + 5]) != 0
+      );
+      i += 6;
+    } else if (strcmp(kind, "shader") == 0 && i + 2 < argc) {
+      ok = pack_shader(&writer, argv[i + 1], argv[i + 2]);
+      i += 3;
+    } else if (strcmp(kind, "raw") == 0 && i + 2 < argc) {
+      ok = pack_raw(&writer, argv[i + 1], argv[i + 2], ASSET_CHUNK_RAW, meta);
+      i += 3;
+    } else {
+      log_msg(LOG_LEVEL_ERROR, "Invalid entry at argument %d (%s)", i, kind);
+      ok = false;
+    }
+  }
+
+  if (!asset_pack_writer_end(&writer)) ok = false;
+  if (ok) log_msg(LOG_LEVEL_SUCCESS, "Wrote %s", argv[1]);
+  return ok ? 0 : 1;
+}
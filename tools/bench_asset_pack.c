@@ -0,0 +1,329 @@
+/* Asset pack load throughput benchmark */
+#include <base.h>
+#include <asset_pack.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <vk_staging.h>
+#include <vk_asset.h>
+
+/*
+ * Usage: bench_asset_pack <pack> [iterations]
+ *
+ * Measures, in GB/s of chunk payload:
+ *   verify   - hashing every chunk straight from the mapping
+ *   staging  - copying every chunk through a staging ring into device local
+ *              memory, with two submissions in flight
+ *   import   - GPU copies straight from the imported mapping (only where
+ *              VK_EXT_external_memory_host is supported)
+ */
+
+/* Size of the staging ring */
+#define STAGING_SIZE (64u << 20)
+
+/* Types */
+/* Submission slot */
+typedef struct {
+  VkCommandBuffer cmd;
+  VkFence fence;
+  VkDeviceSize mark;
+  bool pending;
+} slot_t;
+/* Benchmark state */
+static struct {
+  vk_inst_t instance;
+  vk_phys_dev_t physical_device;
+  vk_phys_dev_info_t physical_device_info;
+  vk_dev_t device;
+  VkQueue queue;
+  VkCommandPool command_pool;
+  slot_t slots[2];
+  uint32_t slot;
+  vk_staging_t staging;
+  vk_buf_t destination;
+} bench;
+
+/* Score physical device */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.transfer_supported) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Create a headless device with one transfer queue */
+static void bench_create_device(void) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo cmd_info;
+  VkFenceCreateInfo fence_info;
+
+  vk_inst_builder_set_app_name(&inst_builder, "bench_asset_pack");
+  bench.instance = vk_inst_create(&inst_builder);
+  bench.physical_device = vk_phys_dev_choose(
+      score_physical_device,
+      &bench.instance,
+      NULL
+  );
+  vk_phys_dev_get_info(
+      bench.physical_device,
+      &bench.physical_device_info,
+      NULL
+  );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Device: %s",
+      bench.physical_device_info.properties.deviceName
+  );
+  if (vk_phys_dev_supports_ext(
+        &bench.physical_device_info,
+        VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME
+  )) {
+    vk_dev_builder_add_ext(
+        &dev_builder,
+        VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME
+    );
+  }
+  vk_dev_builder_add_transfer_queue(&dev_builder, 1.0f);
+  bench.device = vk_dev_create(
+      &bench.physical_device,
+      &bench.physical_device_info,
+      &dev_builder
+  );
+  bench.queue = bench.device.transfer_queues[0];
+
+  /* Create submission slots */
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex =
+    bench.physical_device_info.queue_families.transfer_index;
+  VK_CHECK(vkCreateCommandPool(
+        bench.device.device,
+        &pool_info,
+        NULL,
+        &bench.command_pool
+  ));
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.pNext = NULL;
+  cmd_info.commandPool = bench.command_pool;
+  cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount = 1;
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.pNext = NULL;
+  fence_info.flags = 0;
+  for (uint32_t i = 0; i < 2; i++) {
+    VK_CHECK(vkAllocateCommandBuffers(
+          bench.device.device,
+          &cmd_info,
+          &bench.slots[i].cmd
+    ));
+    VK_CHECK(vkCreateFence(
+          bench.device.device,
+          &fence_info,
+          NULL,
+          &bench.slots[i].fence
+    ));
+    bench.slots[i].pending = false;
+  }
+}
+/* Wait for a slot's submission and release its staging memory */
+static void slot_wait(slot_t *slot) {
+  if (!slot->pending) return;
+  VK_CHECK(vkWaitForFences(
+        bench.device.device,
+        1,
+        &slot->fence,
+        VK_TRUE,
+        UINT64_MAX
+  ));
+  VK_CHECK(vkResetFences(bench.device.device, 1, &slot->fence));
+  vk_staging_release(&bench.staging, slot->mark);
+  slot->pending = false;
+}
+/* Begin recording into the current slot */
+static VkCommandBuffer slot_begin(void) {
+  slot_t *slot = &bench.slots[bench.slot];
+  VkCommandBufferBeginInfo begin_info;
+  slot_wait(slot);
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkBeginCommandBuffer(slot->cmd, &begin_info));
+  return slot->cmd;
+}
+/* Submit the current slot and move to the next one */
+static void slot_submit(void) {
+  slot_t *slot = &bench.slots[bench.slot];
+  VkSubmitInfo submit_info;
+  VK_CHECK(vkEndCommandBuffer(slot->cmd));
+  memset(&submit_info, 0, sizeof(submit_info));
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &slot->cmd;
+  VK_CHECK(vkQueueSubmit(bench.queue, 1, &submit_info, slot->fence));
+  slot->mark = vk_staging_mark(&bench.staging);
+  slot->pending = true;
+  bench.slot = (bench.slot + 1) % 2;
+}
+/* Upload every chunk of a pack, returns seconds taken */
+static double upload_pack(
+    const asset_pack_t *pack,
+    const vk_asset_import_t *import
+) {
+  double start = time_now();
+  VkCommandBuffer cmd = slot_begin();
+  for (uint32_t i = 0; i < pack->chunk_count; i++) {
+    const asset_chunk_t *chunk = &pack->chunks[i];
+    VkDeviceSize offset = 0;
+    while (offset < chunk->size) {
+      VkDeviceSize recorded = vk_asset_cmd_upload(
+          import,
+          &bench.staging,
+          cmd,
+          pack,
+          chunk,
+          offset,
+          bench.destination.buffer,
+          offset
+      );
+      offset += recorded;
+      if (offset < chunk->size) {
+        /* Ring is full, hand it to the GPU and continue in the other slot */
+        slot_submit();
+        cmd = slot_begin();
+      }
+    }
+  }
+  slot_submit();
+  slot_wait(&bench.slots[0]);
+  slot_wait(&bench.slots[1]);
+  return time_now() - start;
+}
+/* Log a throughput result */
+static void report(const char *name, uint64_t bytes, double *times, int n) {
+  double best = times[0], total = 0.0;
+  for (int i = 0; i < n; i++) {
+    if (times[i] < best) best = times[i];
+    total += times[i];
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%-8s first %6.2f GB/s, best %6.2f GB/s, average %6.2f GB/s",
+      name,
+      (double)bytes / times[0] * 1e-9,
+      (double)bytes / best * 1e-9,
+      (double)bytes * n / total * 1e-9
+  );
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  asset_pack_t pack;
+  vk_asset_import_t import;
+  uint64_t total_bytes = 0;
+  VkDeviceSize largest_chunk = 1;
+  int iterations = 10;
+  double *times;
+  double start;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <pack> [iterations]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2) iterations = atoi(argv[2]);
+  if (iterations < 1) iterations = 1;
+  times = (double *)malloc(sizeof(double) * iterations);
+  ASSERT(times);
+
+  /* Map pack */
+  start = time_now();
+  if (!asset_pack_open(&pack, argv[1])) return 1;
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Mapped %u chunks in %.3f ms",
+      pack.chunk_count,
+      (time_now() - start) * 1e3
+  );
+  for (uint32_t i = 0; i < pack.chunk_count; i++) {
+    total_bytes += pack.chunks[i].size;
+    if (pack.chunks[i].size > largest_chunk)
+      largest_chunk = pack.chunks[i].size;
+  }
+  log_msg(LOG_LEVEL_INFO, "Payload: %.2f MB", (double)total_bytes * 1e-6);
+
+  /* Verify */
+  for (int it = 0; it < iterations; it++) {
+    start = time_now();
+    for (uint32_t i = 0; i < pack.chunk_count; i++) {
+      if (!asset_pack_verify_chunk(&pack, &pack.chunks[i])) {
+        log_msg(LOG_LEVEL_ERROR, "Chunk %s is corrupt", pack.chunks[i].name);
+        return 1;
+      }
+    }
+    times[it] = time_now() - start;
+  }
+  report("verify", total_bytes, times, iterations);
+
+  /* Staging ring uploads */
+  bench_create_device();
+  bench.staging = vk_staging_create(
+      &bench.device,
+      &bench.physical_device_info,
+      STAGING_SIZE
+  );
+  bench.destination = vk_buf_create(
+      &bench.device,
+      &bench.physical_device_info,
+      largest_chunk,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  for (int it = 0; it < iterations; it++)
+    times[it] = upload_pack(&pack, NULL);
+  report("staging", total_bytes, times, iterations);
+
+  /* Imported uploads */
+  start = time_now();
+  if (vk_asset_import(
+        &import,
+        &bench.device,
+        bench.physical_device,
+        &pack
+  )) {
+    log_msg(
+        LOG_LEVEL_INFO,
+        "Imported pack in %.3f ms",
+        (time_now() - start) * 1e3
+    );
+    for (int it = 0; it < iterations; it++)
+      times[it] = upload_pack(&pack, &import);
+    report("import", total_bytes, times, iterations);
+    vk_asset_import_destroy(&import, &bench.device);
+  } else {
+    log_msg(LOG_LEVEL_INFO, "Host memory import unavailable");
+  }
+
+  /* Clean up */
+  for (uint32_t i = 0; i < 2; i++)
+    vkDestroyFence(bench.device.device, bench.slots[i].fence, NULL);
+  vkDestroyCommandPool(bench.device.device, bench.command_pool, NULL);
+  vk_buf_destroy(&bench.destination, &bench.device);
+  vk_staging_destroy(&bench.staging, &bench.device);
+  vk_dev_destroy(&bench.device);
+  vk_phys_dev_info_free(&bench.physical_device_info);
+  vk_inst_destroy(&bench.instance);
+  asset_pack_close(&pack);
+  free(times);
+  return 0;
+}
@@ -0,0 +1,350 @@
+/* Bounding volume hierarchy culling and picking benchmark */
+#include <base.h>
+#include <jobs.h>
+#include <bvh.h>
+#include <math.h>
+
+/*
+ * Usage: bench_bvh [objects] [views] [max workers]
+ *
+ * Scatters boxes through a cube (100k and 1M by default) and, for random
+ * views, compares against a brute force loop over every object:
+ *   cull  - frustum culling, on the calling thread and with 1 to N workers
+ *           (default one per physical core)
+ *   refit - moving 1% of the objects and committing
+ *   pick  - the nearest box along a ray
+ * Reports milliseconds per view, objects visible, and how many results
+ * differ from brute force.
+ */
+
+/* Size of the cube objects are scattered through */
+#define WORLD_SIZE 1000.0f
+/* Largest object */
+#define MAX_OBJECT_SIZE 5.0f
+/* Camera field of view (radians), aspect ratio and depth range */
+#define FOV 1.0472f
+#define ASPECT (16.0f / 9.0f)
+#define NEAR 0.1f
+#define FAR 250.0f
+/* Objects moved per refit (percent) */
+#define MOVED_PERCENT 1.0
+
+/* Types */
+/* Random view */
+typedef struct {
+  float eye[3];
+  float dir[3];
+  bvh_frustum_t frustum;
+} view_t;
+
+/* Next random number */
+static uint32_t random_next(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+/* Random float in [lo, hi) */
+static float random_float(uint32_t *state, float lo, float hi) {
+  return lo + (hi - lo) * (float)(random_next(state) >> 8) / 16777216.0f;
+}
+/* Random box */
+static void random_box(uint32_t *state, float *min, float *max) {
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    min[axis] = random_float(state, 0.0f, WORLD_SIZE);
+    max[axis] = min[axis] + random_float(state, 0.5f, MAX_OBJECT_SIZE);
+  }
+}
+/* Normalize a vector */
+static void normalize(float *v) {
+  float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  v[0] /= length;
+  v[1] /= length;
+  v[2] /= length;
+}
+/* Multiply column major matrices (out = a * b) */
+static void multiply(const float *a, const float *b, float *out) {
+  for (uint32_t col = 0; col < 4; col++) {
+    for (uint32_t row = 0; row < 4; row++) {
+      float sum = 0.0f;
+      for (uint32_t k = 0; k < 4; k++) sum += a[k * 4 + row] * b[col * 4 + k];
+      out[col * 4 + row] = sum;
+    }
+  }
+}
+/* Random view from inside the cube, with its frustum */
+static void random_view(uint32_t *state, view_t *view) {
+  float s[3], u[3], f[3], up[3] = { 0.0f, 1.0f, 0.0f };
+  float look[16], proj[16], view_proj[16];
+  float focal = 1.0f / tanf(FOV * 0.5f);
+
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    view->eye[axis] = random_float(state, 0.0f, WORLD_SIZE);
+    view->dir[axis] = random_float(state, -1.0f, 1.0f);
+  }
+  normalize(view->dir);
+  memcpy(f, view->dir, sizeof(f));
+  s[0] = f[1] * up[2] - f[2] * up[1];
+  s[1] = f[2] * up[0] - f[0] * up[2];
+  s[2] = f[0] * up[1] - f[1] * up[0];
+  normalize(s);
+  u[0] = s[1] * f[2] - s[2] * f[1];
+  u[1] = s[2] * f[0] - s[0] * f[2];
+  u[2] = s[0] * f[1] - s[1] * f[0];
+
+  memset(look, 0, sizeof(look));
+  for (uint32_t i = 0; i < 3; i++) {
+    look[i * 4] = s[i];
+    look[i * 4 + 1] = u[i];
+    look[i * 4 + 2] = -f[i];
+    look[12] -= s[i] * view->eye[i];
+    look[13] -= u[i] * view->eye[i];
+    look[14] += f[i] * view->eye[i];
+  }
+  look[15] = 1.0f;
+  memset(proj, 0, sizeof(proj));
+  proj[0] = focal / ASPECT;
+  proj[5] = focal;
+  proj[10] = FAR / (NEAR - FAR);
+  proj[11] = -1.0f;
+  proj[14] = NEAR * FAR / (NEAR - FAR);
+  multiply(proj, look, view_proj);
+  bvh_frustum_from_matrix(&view->frustum, view_proj);
+}
+/* Cull every object against a frustum, one at a time */
+static uint32_t brute_cull(
+    const bvh_t *bvh,
+    const bvh_frustum_t *frustum,
+    uint32_t *visible
+) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < bvh->object_count; i++) {
+    const float *b = bvh->bounds + i * 6;
+    bool inside = bvh->live[i];
+    for (uint32_t p = 0; p < 6 && inside; p++) {
+      const float *plane = frustum->planes[p];
+      float x = plane[0] > 0.0f ? b[3] : b[0];
+      float y = plane[1] > 0.0f ? b[4] : b[1];
+      float z = plane[2] > 0.0f ? b[5] : b[2];
+      if ((plane[0] * x + plane[1] * y) + (plane[2] * z + plane[3]) < 0.0f)
+        inside = false;
+    }
+    if (inside) visible[count++] = i;
+  }
+  return count;
+}
+/* Find the nearest box along a ray, one at a time */
+static uint32_t brute_pick(
+    const bvh_t *bvh,
+    const float *origin,
+    const float *dir,
+    float *distance
+) {
+  uint32_t object = BVH_NONE;
+  float best = 3.4e38f;
+  for (uint32_t i = 0; i < bvh->object_count; i++) {
+    const float *b = bvh->bounds + i * 6;
+    float enter = 0.0f, leave = best;
+    if (!bvh->live[i]) continue;
+    for (uint32_t axis = 0; axis < 3 && enter <= leave; axis++) {
+      float t0 = (b[axis] - origin[axis]) / dir[axis];
+      float t1 = (b[3 + axis] - origin[axis]) / dir[axis];
+      if (t0 > t1) {
+        float t = t0;
+        t0 = t1;
+        t1 = t;
+      }
+      if (t0 > enter) enter = t0;
+      if (t1 < leave) leave = t1;
+    }
+    if (enter <= leave && enter < best) {
+      best = enter;
+      object = i;
+    }
+  }
+  *distance = best;
+  return object;
+}
+/* Compare object ids */
+static int compare_ids(const void *a, const void *b) {
+  uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+  return ia < ib ? -1 : ia > ib;
+}
+/* Check a cull result against brute force (sorting both) */
+static bool same_objects(
+    uint32_t *a,
+    uint32_t a_count,
+    uint32_t *b,
+    uint32_t b_count
+) {
+  if (a_count != b_count) return false;
+  qsort(a, a_count, sizeof(uint32_t), compare_ids);
+  qsort(b, b_count, sizeof(uint32_t), compare_ids);
+  return memcmp(a, b, sizeof(uint32_t) * a_count) == 0;
+}
+/* Run every test over some number of objects */
+static void run(uint32_t object_count, uint32_t view_count, uint32_t workers) {
+  uint32_t *visible, *expected, *ids, seed = 0x9e3779b9u + object_count;
+  uint32_t moved = (uint32_t)(object_count * MOVED_PERCENT / 100.0);
+  uint32_t mismatched = 0;
+  uint64_t visible_total = 0;
+  double start, build_time, brute_time = 0.0, serial_time = 0.0;
+  double refit_time, pick_time = 0.0, brute_pick_time = 0.0;
+  view_t *views;
+  bvh_t bvh;
+
+  visible = (uint32_t *)malloc(sizeof(uint32_t) * object_count);
+  expected = (uint32_t *)malloc(sizeof(uint32_t) * object_count);
+  ids = (uint32_t *)malloc(sizeof(uint32_t) * object_count);
+  views = (view_t *)malloc(sizeof(view_t) * view_count);
+  ASSERT(visible && expected && ids && views);
+  for (uint32_t i = 0; i < view_count; i++) random_view(&seed, &views[i]);
+
+  bvh_create(&bvh);
+  for (uint32_t i = 0; i < object_count; i++) {
+    float min[3], max[3];
+    random_box(&seed, min, max);
+    ids[i] = bvh_insert(&bvh, min, max);
+  }
+  start = time_now();
+  bvh_commit(&bvh);
+  build_time = time_now() - start;
+
+  /* Culling on the calling thread */
+  for (uint32_t i = 0; i < view_count; i++) {
+    uint32_t count, expected_count;
+    start = time_now();
+    expected_count = brute_cull(&bvh, &views[i].frustum, expected);
+    brute_time += time_now() - start;
+    start = time_now();
+    count = bvh_cull(&bvh, NULL, &views[i].frustum, visible);
+    serial_time += time_now() - start;
+    visible_total += count;
+    if (!same_objects(visible, count, expected, expected_count)) mismatched++;
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%u objects: build %.1f ms, %.0f visible per view",
+      object_count,
+      build_time * 1e3,
+      (double)visible_total / view_count
+  );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "  cull  brute force %8.3f ms, bvh %8.3f ms (%5.1fx), %u mismatched",
+      brute_time / view_count * 1e3,
+      serial_time / view_count * 1e3,
+      brute_time / serial_time,
+      mismatched
+  );
+
+  /* Culling on the job system */
+  for (uint32_t worker_count = 1; worker_count <= workers; worker_count++) {
+    double parallel_time = 0.0;
+    jobs_t jobs;
+    mismatched = 0;
+    jobs_create(&jobs, worker_count, true);
+    for (uint32_t i = 0; i < view_count; i++) {
+      uint32_t count, expected_count;
+      start = time_now();
+      count = bvh_cull(&bvh, &jobs, &views[i].frustum, visible);
+      parallel_time += time_now() - start;
+      expected_count = brute_cull(&bvh, &views[i].frustum, expected);
+      if (!same_objects(visible, count, expected, expected_count))
+        mismatched++;
+    }
+    jobs_destroy(&jobs);
+    log_msg(
+        LOG_LEVEL_INFO,
+        "  cull  %2u workers %8.3f ms (%5.1fx brute force), %u mismatched",
+        worker_count,
+        parallel_time / view_count * 1e3,
+        brute_time / parallel_time,
+        mismatched
+    );
+  }
+
+  /* Refit after moving some objects */
+  for (uint32_t i = 0; i < moved; i++) {
+    uint32_t object = ids[random_next(&seed) % object_count];
+    float min[3], max[3];
+    memcpy(min, bvh.bounds + object * 6, sizeof(min));
+    memcpy(max, bvh.bounds + object * 6 + 3, sizeof(max));
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float offset = random_float(&seed, -2.0f, 2.0f);
+      min[axis] += offset;
+      max[axis] += offset;
+    }
+    bvh_update(&bvh, object, min, max);
+  }
+  start = time_now();
+  bvh_commit(&bvh);
+  refit_time = time_now() - start;
+  mismatched = 0;
+  for (uint32_t i = 0; i < view_count; i++) {
+    uint32_t count = bvh_cull(&bvh, NULL, &views[i].frustum, visible);
+    uint32_t expected_count = brute_cull(&bvh, &views[i].frustum, expected);
+    if (!same_objects(visible, count, expected, expected_count)) mismatched++;
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "  refit %u moved %8.3f ms, area %.3fx of build, %u mismatched",
+      moved,
+      refit_time * 1e3,
+      bvh.area / bvh.build_area,
+      mismatched
+  );
+
+  /* Picking along each view's direction */
+  mismatched = 0;
+  for (uint32_t i = 0; i < view_count; i++) {
+    float distance, expected_distance;
+    uint32_t object, expected_object;
+    start = time_now();
+    expected_object = brute_pick(
+        &bvh,
+        views[i].eye,
+        views[i].dir,
+        &expected_distance
+    );
+    brute_pick_time += time_now() - start;
+    start = time_now();
+    object = bvh_pick(&bvh, views[i].eye, views[i].dir, NULL, NULL, &distance);
+    pick_time += time_now() - start;
+    if (
+        object != expected_object &&
+        fabsf(distance - expected_distance) > 1e-3f * expected_distance
+    ) mismatched++;
+  }
+  log_msg(
+      LOG_LEVEL_INFO,
+      "  pick  brute force %8.3f ms, bvh %8.4f ms (%5.0fx), %u mismatched",
+      brute_pick_time / view_count * 1e3,
+      pick_time / view_count * 1e3,
+      brute_pick_time / pick_time,
+      mismatched
+  );
+
+  bvh_destroy(&bvh);
+  free(visible);
+  free(expected);
+  free(ids);
+  free(views);
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  uint32_t object_count = argc > 1 ? (uint32_t)atoi(argv[1]) : 0;
+  int views = argc > 2 ? atoi(argv[2]) : 50;
+  uint32_t max_workers = argc > 3 ? (uint32_t)atoi(argv[3]) : 0;
+
+  if (views < 1) views = 1;
+  if (max_workers == 0) max_workers = jobs_physical_cores();
+  if (object_count > 0) {
+    run(object_count, (uint32_t)views, max_workers);
+  } else {
+    run(100000, (uint32_t)views, max_workers);
+    run(1000000, (uint32_t)views, max_workers);
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+/* Draw packet sorting and merging benchmark */
+#include <base.h>
+#include <jobs.h>
+#include <radix_sort.h>
+#include <vk_draws.h>
+
+/*
+ * Usage: bench_draws [instances] [frames] [max workers]
+ *
+ * Pushes packets for visible instances (default 100k) of a synthetic scene
+ * (depth prepass, opaque and back to front translucent passes over shared
+ * pipelines, materials and meshes) in a random order, and reports:
+ *   sort   - radix_sort on the calling thread and with 1 to N workers
+ *            (default one per physical core) against qsort, checking the
+ *            results match
+ *   frame  - pushing, sorting and merging per frame, checking the merged
+ *            draws cover every packet
+ *   state  - draws and state changes of recording the packets as pushed
+ *            against recording the sorted, merged draws
+ * No device is needed: handles are placeholders and nothing is recorded.
+ */
+
+/* Scene size */
+#define PIPELINES 16u
+#define LAYOUTS 4u
+#define MATERIALS 256u
+#define MESHES 1024u
+#define BUFFERS 8u
+/* Instances drawn in the translucent pass (percent) */
+#define TRANSLUCENT_PERCENT 10u
+
+/* Types */
+/* Instance of the synthetic scene */
+typedef struct {
+  uint32_t mesh;
+  uint32_t material;
+  uint32_t pipeline;
+  bool translucent;
+} instance_t;
+/* Push job arguments */
+typedef struct {
+  vk_draws_t *draws;
+  const instance_t *instances;
+  const float *depths;
+  uint32_t passes[3];
+} push_args_t;
+
+/* Next random number */
+static uint32_t random_next(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+/* Placeholder handle */
+static void *handle(uint32_t kind, uint32_t index) {
+  return (void *)(uintptr_t)(((uintptr_t)kind << 32 | index) + 1);
+}
+/* Push job: the packets of instances [begin, end) */
+static void push_instances(void *arg, uint32_t begin, uint32_t end) {
+  push_args_t *args = (push_args_t *)arg;
+  for (uint32_t i = begin; i < end; i++) {
+    const instance_t *instance = &args->instances[i];
+    vk_draws_packet_t packet;
+    packet.pipeline = instance->pipeline;
+    packet.material = instance->material;
+    packet.mesh = instance->mesh;
+    packet.instance = i;
+    if (instance->translucent) {
+      packet.pass = args->passes[2];
+      vk_draws_push(args->draws, &packet, args->depths[i]);
+      continue;
+    }
+    packet.pass = args->passes[0];
+    vk_draws_push(args->draws, &packet, args->depths[i]);
+    packet.pass = args->passes[1];
+    vk_draws_push(args->draws, &packet, args->depths[i]);
+  }
+}
+/* Order items by key, then value (what a stable sort gives) */
+static int compare_items(const void *a, const void *b) {
+  const radix_item_t *ia = (const radix_item_t *)a;
+  const radix_item_t *ib = (const radix_item_t *)b;
+  if (ia->key != ib->key) return ia->key < ib->key ? -1 : 1;
+  return ia->value < ib->value ? -1 : ia->value > ib->value;
+}
+/* Log a frame's state changes */
+static void log_stats(const char *name, const vk_draws_stats_t *stats) {
+  log_msg(
+      LOG_LEVEL_INFO,
+      "  %-8s %7u draws, %6u pipelines, %6u descriptor sets, "
+      "%6u vertex buffers, %6u index buffers",
+      name,
+      stats->draws,
+      stats->pipelines,
+      stats->descriptor_sets,
+      stats->vertex_buffers,
+      stats->index_buffers
+  );
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  uint32_t instance_count = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+  int frames = argc > 2 ? atoi(argv[2]) : 20;
+  uint32_t max_workers = argc > 3 ? (uint32_t)atoi(argv[3]) : 0;
+  uint32_t seed = 0x9e3779b9u, packet_count;
+  radix_item_t *input, *items, *scratch, *expected;
+  instance_t *instances;
+  float *depths;
+  push_args_t args;
+  vk_draws_t draws;
+  double start, qsort_time;
+
+  if (instance_count < 1) instance_count = 1;
+  if (frames < 1) frames = 1;
+  if (max_workers == 0) max_workers = jobs_physical_cores();
+  instances = (instance_t *)malloc(sizeof(instance_t) * instance_count);
+  depths = (float *)malloc(sizeof(float) * instance_count);
+  ASSERT(instances && depths);
+
+  /* Scene: meshes share buffers, and each has a material with a pipeline */
+  vk_draws_create(&draws, instance_count * 2);
+  args.passes[0] = vk_draws_add_pass(&draws, false);
+  args.passes[1] = vk_draws_add_pass(&draws, false);
+  args.passes[2] = vk_draws_add_pass(&draws, true);
+  for (uint32_t i = 0; i < PIPELINES; i++) {
+    vk_draws_add_pipeline(
+        &draws,
+        (VkPipeline)handle(1, i),
+        (VkPipelineLayout)handle(2, i % LAYOUTS)
+    );
+  }
+  for (uint32_t i = 0; i < MATERIALS; i++)
+    vk_draws_add_material(&draws, (VkDescriptorSet)handle(3, i));
+  for (uint32_t i = 0; i < MESHES; i++) {
+    vk_draws_mesh_t mesh;
+    mesh.vertex_buffer = (VkBuffer)handle(4, i % BUFFERS);
+    mesh.vertex_buffer_offset = 0;
+    mesh.index_buffer = (VkBuffer)handle(5, i % BUFFERS);
+    mesh.index_buffer_offset = 0;
+    mesh.index_type = VK_INDEX_TYPE_UINT32;
+    mesh.index_count = 3 * 500;
+    mesh.first_index = i / BUFFERS * 3 * 500;
+    mesh.vertex_offset = (int32_t)(i / BUFFERS * 300);
+    vk_draws_add_mesh(&draws, &mesh);
+  }
+  for (uint32_t i = 0; i < instance_count; i++) {
+    /* Favour low mesh ids, as a few meshes usually dominate a scene */
+    uint32_t mesh = random_next(&seed) % MESHES;
+    mesh = mesh * mesh / MESHES;
+    instances[i].mesh = mesh;
+    instances[i].material = mesh % MATERIALS;
+    instances[i].pipeline = instances[i].material % PIPELINES;
+    instances[i].translucent =
+      random_next(&seed) % 100 < TRANSLUCENT_PERCENT;
+    depths[i] = (float)(random_next(&seed) >> 8) / 16777216.0f;
+  }
+  args.draws = &draws;
+  args.instances = instances;
+  args.depths = depths;
+
+  /* Keys of one frame, to sort on their own */
+  vk_draws_begin(&draws);
+  push_instances(&args, 0, instance_count);
+  packet_count = atomic_load(&draws.packet_count);
+  input = (radix_item_t *)malloc(sizeof(radix_item_t) * packet_count);
+  items = (radix_item_t *)malloc(sizeof(radix_item_t) * packet_count);
+  scratch = (radix_item_t *)malloc(sizeof(radix_item_t) * packet_count);
+  expected = (radix_item_t *)malloc(sizeof(radix_item_t) * packet_count);
+  ASSERT(input && items && scratch && expected);
+  memcpy(input, draws.keys, sizeof(radix_item_t) * packet_count);
+  memcpy(expected, input, sizeof(radix_item_t) * packet_count);
+  start = time_now();
+  qsort(expected, packet_count, sizeof(radix_item_t), compare_items);
+  qsort_time = time_now() - start;
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%u instances, %u packets: qsort %.3f ms",
+      instance_count,
+      packet_count,
+      qsort_time * 1e3
+  );
+
+  for (uint32_t workers = 0; workers <= max_workers; workers++) {
+    double sort_time = 0.0, push_time = 0.0, frame_time = 0.0;
+    uint32_t mismatched = 0;
+    jobs_t jobs;
+
+    if (workers > 0) jobs_create(&jobs, workers, true);
+    for (int frame = 0; frame < frames; frame++) {
+      const radix_item_t *sorted;
+      uint32_t merged = 0;
+      memcpy(items, input, sizeof(radix_item_t) * packet_count);
+      start = time_now();
+      sorted = radix_sort(
+          workers ? &jobs : NULL,
+          items,
+          scratch,
+          packet_count
+      );
+      sort_time += time_now() - start;
+      if (memcmp(sorted, expected, sizeof(radix_item_t) * packet_count))
+        mismatched++;
+
+      start = time_now();
+      vk_draws_begin(&draws);
+      if (workers > 0)
+        jobs_parallel_for(
+            &jobs,
+            push_instances,
+            &args,
+            instance_count,
+            4096
+        );
+      else
+        push_instances(&args, 0, instance_count);
+      push_time += time_now() - start;
+      vk_draws_sort(&draws, workers ? &jobs : NULL);
+      frame_time += time_now() - start;
+      for (uint32_t i = 0; i < draws.batch_count; i++)
+        merged += draws.batches[i].instance_count;
+      if (merged != packet_count) mismatched++;
+    }
+    if (workers > 0) jobs_destroy(&jobs);
+    log_msg(
+        LOG_LEVEL_INFO,
+        "%2u workers: radix sort %7.3f ms (%4.1fx qsort), %u mismatched; "
+        "frame %7.3f ms (push %7.3f ms)",
+        workers,
+        sort_time / frames * 1e3,
+        qsort_time / (sort_time / frames),
+        mismatched,
+        frame_time / frames * 1e3,
+        push_time / frames * 1e3
+    );
+  }
+
+  /* The last frame pushed on one thread, so its order is the scene's */
+  vk_draws_begin(&draws);
+  push_instances(&args, 0, instance_count);
+  vk_draws_sort(&draws, NULL);
+  log_msg(LOG_LEVEL_INFO, "State changes per frame:");
+  log_stats("unsorted", &draws.unsorted);
+  log_stats("sorted", &draws.sorted);
+
+  vk_draws_destroy(&draws);
+  free(instances);
+  free(depths);
+  free(input);
+  free(items);
+  free(scratch);
+  free(expected);
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* Job system scaling benchmark */
+#include <base.h>
+#include <jobs.h>
+
+/*
+ * Usage: bench_jobs [max workers] [iterations]
+ *
+ * Runs three workloads with 1 to N workers (default one per physical core)
+ * and reports the best time, speedup over one worker, and per deque counts
+ * of jobs executed, stolen and lost races (contention):
+ *   flat    - independent jobs submitted from the main thread
+ *   nested  - a binary tree of jobs, each spawning and waiting on children
+ *   for     - jobs_parallel_for over an array
+ */
+
+/* Flat workload size */
+#define FLAT_JOBS 4000
+#define FLAT_WORK 20000
+/* Nested workload depth */
+#define NESTED_DEPTH 14
+/* Parallel for size */
+#define FOR_COUNT (1u << 22)
+
+/* Types */
+/* Flat job */
+typedef struct {
+  job_t job;
+  uint32_t seed;
+  uint32_t result;
+} flat_job_t;
+/* Nested job */
+typedef struct {
+  job_t job;
+  jobs_t *jobs;
+  uint32_t depth;
+  uint32_t result;
+} nested_job_t;
+/* Parallel for arguments */
+typedef struct {
+  const float *input;
+  float *output;
+} for_args_t;
+
+/* Spin on some arithmetic */
+static uint32_t work(uint32_t seed, uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+  }
+  return seed;
+}
+/* Flat job function */
+static void flat_job(void *arg) {
+  flat_job_t *job = (flat_job_t *)arg;
+  job->result = work(job->seed, FLAT_WORK);
+}
+/* Nested job function: spawn two children and wait for them */
+static void nested_job(void *arg) {
+  nested_job_t *job = (nested_job_t *)arg;
+  nested_job_t children[2];
+  job_counter_t counter;
+
+  job->result = work(job->depth + 1, 500);
+  if (job->depth == 0) return;
+  atomic_init(&counter.value, 0);
+  for (uint32_t i = 0; i < 2; i++) {
+    children[i].job.fn = nested_job;
+    children[i].job.arg = &children[i];
+    children[i].job.counter = &counter;
+    children[i].jobs = job->jobs;
+    children[i].depth = job->depth - 1;
+    jobs_submit(job->jobs, &children[i].job);
+  }
+  jobs_wait(job->jobs, &counter);
+  job->result += children[0].result + children[1].result;
+}
+/* Parallel for body */
+static void for_body(void *arg, uint32_t begin, uint32_t end) {
+  for_args_t *args = (for_args_t *)arg;
+  for (uint32_t i = begin; i < end; i++) {
+    float x = args->input[i];
+    args->output[i] = x * x * 0.5f + x * 0.25f + 1.0f;
+  }
+}
+
+/* Run the flat workload */
+static void run_flat(jobs_t *jobs, flat_job_t *flat) {
+  job_counter_t counter;
+  atomic_init(&counter.value, 0);
+  for (uint32_t i = 0; i < FLAT_JOBS; i++) {
+    flat[i].job.fn = flat_job;
+    flat[i].job.arg = &flat[i];
+    flat[i].job.counter = &counter;
+    flat[i].seed = i + 1;
+    jobs_submit(jobs, &flat[i].job);
+  }
+  jobs_wait(jobs, &counter);
+}
+/* Run the nested workload */
+static void run_nested(jobs_t *jobs) {
+  nested_job_t root;
+  job_counter_t counter;
+  atomic_init(&counter.value, 0);
+  root.job.fn = nested_job;
+  root.job.arg = &root;
+  root.job.counter = &counter;
+  root.jobs = jobs;
+  root.depth = NESTED_DEPTH;
+  jobs_submit(jobs, &root.job);
+  jobs_wait(jobs, &counter);
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  uint32_t max_workers = argc > 1 ? (uint32_t)atoi(argv[1]) : 0;
+  int iterations = argc > 2 ? atoi(argv[2]) : 5;
+  const char *names[3] = { "flat", "nested", "for" };
+  double baseline[3] = { 0.0, 0.0, 0.0 };
+  flat_job_t *flat;
+  for_args_t for_args;
+  float *input, *output;
+
+  if (max_workers == 0) max_workers = jobs_physical_cores();
+  if (iterations < 1) iterations = 1;
+  flat = (flat_job_t *)malloc(sizeof(flat_job_t) * FLAT_JOBS);
+  input = (float *)malloc(sizeof(float) * FOR_COUNT);
+  output = (float *)malloc(sizeof(float) * FOR_COUNT);
+  ASSERT(flat && input && output);
+  for (uint32_t i = 0; i < FOR_COUNT; i++) input[i] = (float)i * 1e-3f;
+  for_args.input = input;
+  for_args.output = output;
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Physical cores: %u, scaling to %u workers",
+      jobs_physical_cores(),
+      max_workers
+  );
+
+  for (uint32_t workers = 1; workers <= max_workers; workers++) {
+    jobs_t jobs;
+    jobs_create(&jobs, workers, true);
+    for (uint32_t workload = 0; workload < 3; workload++) {
+      double best = 1e30;
+      for (int it = 0; it < iterations; it++) {
+        double start = time_now(), elapsed;
+        if (workload == 0)
+          run_flat(&jobs, flat);
+        else if (workload == 1)
+          run_nested(&jobs);
+        else
+          jobs_parallel_for(&jobs, for_body, &for_args, FOR_COUNT, 4096);
+        elapsed = time_now() - start;
+        if (elapsed < best) best = elapsed;
+      }
+      if (workers == 1) baseline[workload] = best;
+      log_msg(
+          LOG_LEVEL_INFO,
+          "%2u workers %-6s %8.3f ms, speedup %5.2fx, efficiency %3.0f%%",
+          workers,
+          names[workload],
+          best * 1e3,
+          baseline[workload] / best,
+          baseline[workload] / best / workers * 100.0
+      );
+    }
+    for (uint32_t i = 0; i < workers; i++) {
+      job_stats_t stats = jobs_stats(&jobs, i);
+      log_msg(
+          LOG_LEVEL_INFO,
+          "  deque %2u: executed %8llu, stolen %8llu, contention %6llu",
+          i,
+          (unsigned long long)stats.executed,
+          (unsigned long long)stats.stolen,
+          (unsigned long long)stats.contention
+      );
+    }
+    jobs_destroy(&jobs);
+  }
+
+  free(flat);
+  free(input);
+  free(output);
+  return 0;
+}
@@ -0,0 +1,231 @@
+/* Scene graph transform propagation benchmark */
+#include <base.h>
+#include <jobs.h>
+#include <scene.h>
+#include <math.h>
+
+/*
+ * Usage: bench_scene [nodes] [frames] [changed percent] [max workers]
+ *
+ * Builds a tree of nodes (default 1M, eight children per node) and times:
+ *   naive - recomputing every world matrix with a scalar loop, by handle
+ *   full  - scene_update of every node on one thread
+ *   frame - changing a percentage of local matrices (default 1%) and
+ *           updating into an upload buffer, with 1 to N workers (default
+ *           one per physical core)
+ * Reports milliseconds per frame, matrices uploaded, ranges and copy
+ * regions, and checks world matrices and the upload against the naive
+ * result.
+ */
+
+/* Children per node */
+#define BRANCHING 8u
+/* Largest relative error accepted */
+#define TOLERANCE 1e-3f
+
+/* Next random number */
+static uint32_t random_next(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+/* Random float in [lo, hi) */
+static float random_float(uint32_t *state, float lo, float hi) {
+  return lo + (hi - lo) * (float)(random_next(state) >> 8) / 16777216.0f;
+}
+/* Random local matrix: rotation about z, scale near one, translation */
+static void random_local(uint32_t *state, float *m) {
+  float angle = random_float(state, -0.5f, 0.5f);
+  float scale = random_float(state, 0.9f, 1.1f);
+  float c = cosf(angle) * scale, s = sinf(angle) * scale;
+  memset(m, 0, SCENE_MATRIX_SIZE);
+  m[0] = c;
+  m[1] = s;
+  m[4] = -s;
+  m[5] = c;
+  m[10] = scale;
+  m[12] = random_float(state, -1.0f, 1.0f);
+  m[13] = random_float(state, -1.0f, 1.0f);
+  m[14] = random_float(state, -1.0f, 1.0f);
+  m[15] = 1.0f;
+}
+/* Multiply column major matrices (out = a * b) */
+static void multiply(const float *a, const float *b, float *out) {
+  for (uint32_t col = 0; col < 4; col++) {
+    for (uint32_t row = 0; row < 4; row++) {
+      float sum = 0.0f;
+      for (uint32_t k = 0; k < 4; k++) sum += a[k * 4 + row] * b[col * 4 + k];
+      out[col * 4 + row] = sum;
+    }
+  }
+}
+/* Recompute every world matrix by handle (parents have lower handles) */
+static void naive_update(
+    const float *local,
+    float *world,
+    const uint32_t *parent,
+    uint32_t count
+) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (parent[i] == SCENE_NONE)
+      memcpy(world + i * 16, local + i * 16, SCENE_MATRIX_SIZE);
+    else
+      multiply(world + parent[i] * 16, local + i * 16, world + i * 16);
+  }
+}
+/* Count world matrices that differ from the reference */
+static uint32_t check_world(
+    const scene_t *scene,
+    const uint32_t *handles,
+    const float *reference,
+    uint32_t count
+) {
+  uint32_t errors = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const float *world = scene_world(scene, handles[i]);
+    for (uint32_t j = 0; j < 16; j++) {
+      float expected = reference[i * 16 + j];
+      float error = fabsf(world[j] - expected);
+      if (error > TOLERANCE * (1.0f + fabsf(expected))) {
+        errors++;
+        break;
+      }
+    }
+  }
+  return errors;
+}
+/* Count copy regions whose upload differs from the world matrices */
+static uint32_t check_upload(
+    const scene_t *scene,
+    const uint8_t *upload,
+    const VkBufferCopy *regions,
+    uint32_t region_count
+) {
+  uint32_t errors = 0;
+  for (uint32_t i = 0; i < region_count; i++) {
+    if (memcmp(
+        upload + regions[i].srcOffset,
+        (const uint8_t *)scene->world + regions[i].dstOffset,
+        regions[i].size
+    ) != 0) errors++;
+  }
+  return errors;
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  uint32_t node_count = argc > 1 ? (uint32_t)atoi(argv[1]) : (1u << 20);
+  int frames = argc > 2 ? atoi(argv[2]) : 100;
+  double percent = argc > 3 ? atof(argv[3]) : 1.0;
+  uint32_t max_workers = argc > 4 ? (uint32_t)atoi(argv[4]) : 0;
+  uint32_t *handles, *parent, changed, seed = 0x9e3779b9u;
+  float *local, *reference, matrix[16];
+  VkBufferCopy *regions;
+  uint8_t *upload;
+  scene_t scene;
+  double start, naive_time, full_time;
+
+  if (node_count < 2) node_count = 2;
+  if (frames < 1) frames = 1;
+  if (max_workers == 0) max_workers = jobs_physical_cores();
+  changed = (uint32_t)(node_count * percent / 100.0);
+  if (changed < 1) changed = 1;
+  handles = (uint32_t *)malloc(sizeof(uint32_t) * node_count);
+  parent = (uint32_t *)malloc(sizeof(uint32_t) * node_count);
+  local = (float *)malloc(SCENE_MATRIX_SIZE * node_count);
+  reference = (float *)malloc(SCENE_MATRIX_SIZE * node_count);
+  regions = (VkBufferCopy *)malloc(sizeof(VkBufferCopy) * node_count);
+  upload = (uint8_t *)malloc(SCENE_MATRIX_SIZE * node_count);
+  ASSERT(handles && parent && local && reference && regions && upload);
+
+  /* Breadth first adds, so the first prepare rebuilds the order */
+  start = time_now();
+  scene_create(&scene);
+  for (uint32_t i = 0; i < node_count; i++) {
+    parent[i] = i == 0 ? SCENE_NONE : (i - 1) / BRANCHING;
+    random_local(&seed, local + i * 16);
+    handles[i] = scene_add(
+        &scene,
+        i == 0 ? SCENE_NONE : handles[parent[i]],
+        local + i * 16
+    );
+  }
+  scene_prepare(&scene);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%u nodes built and ordered in %.1f ms, %u changed per frame",
+      node_count,
+      (time_now() - start) * 1e3,
+      changed
+  );
+
+  start = time_now();
+  naive_update(local, reference, parent, node_count);
+  naive_time = time_now() - start;
+  start = time_now();
+  scene_update(&scene, NULL, NULL);
+  full_time = time_now() - start;
+  log_msg(
+      LOG_LEVEL_INFO,
+      "naive %8.3f ms, full %8.3f ms (%.1f Mnodes/s), %u mismatched",
+      naive_time * 1e3,
+      full_time * 1e3,
+      node_count / full_time * 1e-6,
+      check_world(&scene, handles, reference, node_count)
+  );
+
+  for (uint32_t workers = 1; workers <= max_workers; workers++) {
+    double best = 1e30, total = 0.0;
+    uint64_t uploaded = 0, ranges = 0, copies = 0;
+    uint32_t region_count = 0, errors;
+    jobs_t jobs;
+
+    jobs_create(&jobs, workers, true);
+    for (int frame = 0; frame < frames; frame++) {
+      double elapsed;
+      for (uint32_t i = 0; i < changed; i++) {
+        uint32_t node = random_next(&seed) % node_count;
+        random_local(&seed, matrix);
+        memcpy(local + node * 16, matrix, SCENE_MATRIX_SIZE);
+        scene_set_local(&scene, handles[node], matrix);
+      }
+      start = time_now();
+      uploaded += scene_prepare(&scene);
+      scene_update(&scene, &jobs, upload);
+      region_count = scene_upload_regions(&scene, 0, regions);
+      elapsed = time_now() - start;
+      ranges += scene.range_count;
+      copies += region_count;
+      total += elapsed;
+      if (elapsed < best) best = elapsed;
+    }
+    jobs_destroy(&jobs);
+
+    naive_update(local, reference, parent, node_count);
+    errors = check_world(&scene, handles, reference, node_count);
+    errors += check_upload(&scene, upload, regions, region_count);
+    log_msg(
+        LOG_LEVEL_INFO,
+        "%2u workers frame %7.3f ms (best %7.3f), %7.0f matrices, "
+        "%6.0f ranges, %6.0f regions, %6.1f Mnodes/s, %u mismatched",
+        workers,
+        total / frames * 1e3,
+        best * 1e3,
+        (double)uploaded / frames,
+        (double)ranges / frames,
+        (double)copies / frames,
+        uploaded / total * 1e-6,
+        errors
+    );
+  }
+
+  scene_destroy(&scene);
+  free(handles);
+  free(parent);
+  free(local);
+  free(reference);
+  free(regions);
+  free(upload);
+  return 0;
+}
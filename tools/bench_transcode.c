@@ -0,0 +1,114 @@
+/* Texture transcoder throughput benchmark */
+#include <base.h>
+#include <transcode.h>
+#include <jobs.h>
+
+/*
+ * Usage: bench_transcode [size] [iterations] [threads]
+ *
+ * Encodes a synthetic size x size RGBA8 image once, then transcodes it to
+ * every target with every kernel the CPU supports, on one thread and split
+ * across the job system. Reports megapixels per second, and per core for
+ * the parallel run.
+ */
+
+/* Fill an image with gradients and noise */
+static void make_image(uint8_t *rgba, uint32_t size) {
+  uint32_t state = 0x9e3779b9u;
+  for (uint32_t y = 0; y < size; y++) {
+    for (uint32_t x = 0; x < size; x++) {
+      uint8_t *texel = rgba + ((size_t)y * size + x) * 4;
+      state = state * 1664525u + 1013904223u;
+      texel[0] = (uint8_t)(x * 255 / size);
+      texel[1] = (uint8_t)(y * 255 / size);
+      texel[2] = (uint8_t)((x ^ y) + (state >> 28));
+      texel[3] = (uint8_t)(255 - ((x + y) * 127 / size));
+    }
+  }
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  uint32_t size = argc > 1 ? (uint32_t)atoi(argv[1]) : 2048;
+  int iterations = argc > 2 ? atoi(argv[2]) : 10;
+  uint32_t threads = argc > 3 ? (uint32_t)atoi(argv[3]) : 0;
+  transcode_kernel_t best_kernel = transcode_get_kernel();
+  double megapixels;
+  jobs_t jobs;
+  uint8_t *rgba, *blocks, *dst;
+  double start;
+
+  if (size < 4) size = 4;
+  if (iterations < 1) iterations = 1;
+  megapixels = (double)size * size * 1e-6;
+  rgba = (uint8_t *)malloc((size_t)size * size * 4);
+  blocks = (uint8_t *)malloc(transcode_universal_size(size, size));
+  dst = (uint8_t *)malloc(
+      transcode_target_size(TRANSCODE_TARGET_RGBA8, size, size)
+  );
+  ASSERT(rgba && blocks && dst);
+
+  /* Encode */
+  make_image(rgba, size);
+  start = time_now();
+  transcode_encode(rgba, size, size, blocks);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Encoded %ux%u in %.2f s (%.2f MP/s)",
+      size,
+      size,
+      time_now() - start,
+      megapixels / (time_now() - start)
+  );
+
+  jobs_create(&jobs, threads, true);
+  for (int kernel = 0; kernel < TRANSCODE_KERNEL_COUNT; kernel++) {
+    if (!transcode_set_kernel((transcode_kernel_t)kernel)) continue;
+    for (int target = 0; target < TRANSCODE_TARGET_COUNT; target++) {
+      double single = 1e30, parallel = 1e30;
+      for (int it = 0; it < iterations; it++) {
+        double elapsed;
+        start = time_now();
+        transcode_level(
+            (transcode_target_t)target,
+            blocks,
+            size,
+            size,
+            dst,
+            NULL
+        );
+        elapsed = time_now() - start;
+        if (elapsed < single) single = elapsed;
+        start = time_now();
+        transcode_level(
+            (transcode_target_t)target,
+            blocks,
+            size,
+            size,
+            dst,
+            &jobs
+        );
+        elapsed = time_now() - start;
+        if (elapsed < parallel) parallel = elapsed;
+      }
+      log_msg(
+          LOG_LEVEL_INFO,
+          "%-6s %-8s 1 thread %8.1f MP/s, %u threads %8.1f MP/s"
+          " (%.1f MP/s per core)",
+          transcode_kernel_name((transcode_kernel_t)kernel),
+          transcode_target_name((transcode_target_t)target),
+          megapixels / single,
+          jobs.worker_count,
+          megapixels / parallel,
+          megapixels / parallel / jobs.worker_count
+      );
+    }
+  }
+  transcode_set_kernel(best_kernel);
+
+  jobs_destroy(&jobs);
+  free(rgba);
+  free(blocks);
+  free(dst);
+  return 0;
+}
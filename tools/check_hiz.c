@@ -0,0 +1,697 @@
+/* Hi-Z pyramid and occlusion culling check */
+#include <base.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <vk_submit.h>
+#include <vk_hiz.h>
+#include <telemetry.h>
+#include <math.h>
+
+/*
+ * Usage: check_hiz [width] [height] [instances] [shader dir]
+ *
+ * Runs vk_hiz headless (so it runs on lavapipe) over a known depth buffer
+ * (default 800x600, the renderer's window, so the pyramid is smaller than
+ * it) with a wall over its top left quarter, and checks:
+ *   pyramid - every texel of every mip is no further than the depth under
+ *             it, and no nearer than the depth a texel around it
+ *   culling - frame 0 (empty pyramid) draws everything in the frustum
+ *             early; frame 1 culls exactly the instances behind the wall;
+ *             frame 2 removes the wall, so the early phase still rejects
+ *             them against frame 1's pyramid and the late phase draws them
+ * Instances are placed well clear of the wall's and frustum's edges, where
+ * the answer doesn't depend on the pyramid level picked. Exits non-zero on
+ * any mismatch.
+ */
+
+/* Defaults */
+#define DEFAULT_WIDTH 800
+#define DEFAULT_HEIGHT 600
+#define DEFAULT_INSTANCES 4096
+/* Camera */
+#define ZNEAR 0.1f
+/* Depth of the wall (reverse-Z), and the patterns put on the depth */
+#define WALL_Z 5.0f
+#define PATTERN_DEPTH 0.001f
+/* Frames checked */
+#define FRAMES 3
+
+/* Types */
+/* Where an instance is put */
+typedef enum {
+  PLACE_HIDDEN,       /* Behind the wall */
+  PLACE_IN_FRONT,     /* In front of the wall */
+  PLACE_OPEN,         /* Beside the wall */
+  PLACE_OUTSIDE,      /* Outside the frustum */
+  PLACE_COUNT
+} place_t;
+/* Check state */
+typedef struct {
+  vk_dev_t dev;
+  vk_phys_dev_info_t info;
+  vk_submit_t submit;
+  vk_hiz_t hiz;
+  VkImage depth;
+  VkDeviceMemory depth_memory;
+  VkImageView depth_view;
+  bool depth_initialized;
+  vk_buf_t staging;
+  vk_buf_t readback;
+  VkCommandPool pool;
+  VkCommandBuffer cmd;
+  uint32_t width, height;
+  uint64_t rng;
+  uint32_t errors;
+} check_t;
+
+/* Score physical device */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.graphics_supported) return 0;
+  if (!info->features12.timelineSemaphore) return 0;
+  if (!info->features12.samplerFilterMinmax) return 0;
+  if (!info->features.shaderStorageImageArrayDynamicIndexing) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Next pseudo random number */
+static uint32_t next_random(check_t *check) {
+  check->rng ^= check->rng << 13;
+  check->rng ^= check->rng >> 7;
+  check->rng ^= check->rng << 17;
+  return (uint32_t)(check->rng >> 32);
+}
+/* Pseudo random float in [lo, hi) */
+static float random_range(check_t *check, float lo, float hi) {
+  return lo + (hi - lo) * (float)(next_random(check) >> 8) / 16777216.0f;
+}
+/* Record a global memory barrier */
+static void cmd_barrier(
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags src_stage,
+    VkAccessFlags src_access,
+    VkPipelineStageFlags dst_stage,
+    VkAccessFlags dst_access
+) {
+  VkMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = src_access;
+  barrier.dstAccessMask = dst_access;
+  vkCmdPipelineBarrier(
+      cmd,
+      src_stage,
+      dst_stage,
+      0,
+      1, &barrier,
+      0, NULL,
+      0, NULL
+  );
+}
+/* Depth buffer texel (reverse-Z, with a pattern so mins are not uniform) */
+static float depth_at(const check_t *check, uint32_t x, uint32_t y, bool wall) {
+  float pattern = PATTERN_DEPTH * (float)((x * 7 + y * 13) % 17) / 17.0f;
+  if (wall && x < check->width / 2 && y < check->height / 2)
+    return ZNEAR / WALL_Z + pattern;
+  return pattern;
+}
+/* Create the depth buffer and its staging buffer */
+static void create_depth(check_t *check) {
+  VkImageCreateInfo image_info;
+  VkImageViewCreateInfo view_info;
+  VkMemoryRequirements requirements;
+  VkMemoryAllocateInfo alloc_info;
+
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.pNext = NULL;
+  image_info.flags = 0;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = VK_FORMAT_D32_SFLOAT;
+  image_info.extent.width = check->width;
+  image_info.extent.height = check->height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage =
+    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.queueFamilyIndexCount = 0;
+  image_info.pQueueFamilyIndices = NULL;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK(vkCreateImage(check->dev.device, &image_info, NULL, &check->depth));
+  vkGetImageMemoryRequirements(
+      check->dev.device,
+      check->depth,
+      &requirements
+  );
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = vk_phys_dev_find_memory_type(
+      &check->info,
+      requirements.memoryTypeBits,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0
+  );
+  ASSERT(alloc_info.memoryTypeIndex != UINT32_MAX);
+  VK_CHECK(vkAllocateMemory(
+        check->dev.device,
+        &alloc_info,
+        NULL,
+        &check->depth_memory
+  ));
+  VK_CHECK(vkBindImageMemory(
+        check->dev.device,
+        check->depth,
+        check->depth_memory,
+        0
+  ));
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.pNext = NULL;
+  view_info.flags = 0;
+  view_info.image = check->depth;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = VK_FORMAT_D32_SFLOAT;
+  view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  view_info.subresourceRange.baseMipLevel = 0;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.baseArrayLayer = 0;
+  view_info.subresourceRange.layerCount = 1;
+  VK_CHECK(vkCreateImageView(
+        check->dev.device,
+        &view_info,
+        NULL,
+        &check->depth_view
+  ));
+  check->staging = vk_buf_create(
+      &check->dev,
+      &check->info,
+      sizeof(float) * check->width * check->height,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      0
+  );
+}
+/* Record the depth buffer's upload from staging, ready for sampling */
+static void cmd_upload_depth(check_t *check) {
+  VkImageMemoryBarrier barrier;
+  VkBufferImageCopy region;
+
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = check->depth_initialized
+    ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    : VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = check->depth;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  vkCmdPipelineBarrier(
+      check->cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0, NULL,
+      0, NULL,
+      1, &barrier
+  );
+  region.bufferOffset = 0;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset.x = 0;
+  region.imageOffset.y = 0;
+  region.imageOffset.z = 0;
+  region.imageExtent.width = check->width;
+  region.imageExtent.height = check->height;
+  region.imageExtent.depth = 1;
+  vkCmdCopyBufferToImage(
+      check->cmd,
+      check->staging.buffer,
+      check->depth,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1,
+      &region
+  );
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(
+      check->cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0, NULL,
+      0, NULL,
+      1, &barrier
+  );
+  check->depth_initialized = true;
+}
+/* Record the copy of every pyramid mip to the readback buffer */
+static void cmd_read_pyramid(check_t *check) {
+  VkBufferImageCopy regions[VK_HIZ_MAX_MIPS];
+  VkDeviceSize offset = 0;
+
+  cmd_barrier(
+      check->cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT
+  );
+  for (uint32_t i = 0; i < check->hiz.mip_count; i++) {
+    uint32_t size = check->hiz.pyramid_size >> i;
+    regions[i].bufferOffset = offset;
+    regions[i].bufferRowLength = 0;
+    regions[i].bufferImageHeight = 0;
+    regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[i].imageSubresource.mipLevel = i;
+    regions[i].imageSubresource.baseArrayLayer = 0;
+    regions[i].imageSubresource.layerCount = 1;
+    regions[i].imageOffset.x = 0;
+    regions[i].imageOffset.y = 0;
+    regions[i].imageOffset.z = 0;
+    regions[i].imageExtent.width = size;
+    regions[i].imageExtent.height = size;
+    regions[i].imageExtent.depth = 1;
+    offset += sizeof(float) * size * size;
+  }
+  vkCmdCopyImageToBuffer(
+      check->cmd,
+      check->hiz.pyramid,
+      VK_IMAGE_LAYOUT_GENERAL,
+      check->readback.buffer,
+      check->hiz.mip_count,
+      regions
+  );
+  cmd_barrier(
+      check->cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      VK_ACCESS_HOST_READ_BIT
+  );
+}
+/* Min of the depth over [x0, x1) x [y0, y1), clamped to the buffer */
+static float depth_min(
+    const check_t *check,
+    bool wall,
+    int64_t x0,
+    int64_t y0,
+    int64_t x1,
+    int64_t y1
+) {
+  float result = INFINITY;
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > (int64_t)check->width) x1 = check->width;
+  if (y1 > (int64_t)check->height) y1 = check->height;
+  for (int64_t y = y0; y < y1; y++) {
+    for (int64_t x = x0; x < x1; x++) {
+      float depth = depth_at(check, (uint32_t)x, (uint32_t)y, wall);
+      if (depth < result) result = depth;
+    }
+  }
+  return result;
+}
+/* Check the read back pyramid against the depth it was built from */
+static void check_pyramid(check_t *check, bool wall) {
+  uint32_t size = check->hiz.pyramid_size;
+  const float *mip = (const float *)check->readback.mapped;
+  float *lo = (float *)malloc(sizeof(float) * size * size);
+  float *hi = (float *)malloc(sizeof(float) * size * size);
+  uint32_t errors = 0;
+  ASSERT(lo && hi);
+
+  /*
+   * Base texels must be no further (lower) than every depth texel they
+   * cover, and no nearer than the depth within a texel of them
+   */
+  for (uint32_t y = 0; y < size; y++) {
+    int64_t y0 = (int64_t)y * check->height / size;
+    int64_t y1 = ((int64_t)y + 1) * check->height;
+    y1 = (y1 + size - 1) / size;
+    for (uint32_t x = 0; x < size; x++) {
+      int64_t x0 = (int64_t)x * check->width / size;
+      int64_t x1 = ((int64_t)x + 1) * check->width;
+      x1 = (x1 + size - 1) / size;
+      hi[y * size + x] = depth_min(check, wall, x0, y0, x1, y1);
+      lo[y * size + x] =
+        depth_min(check, wall, x0 - 1, y0 - 1, x1 + 1, y1 + 1);
+    }
+  }
+  /* Every mip is the exact min of the one above */
+  for (uint32_t level = 0; level < check->hiz.mip_count; level++) {
+    for (uint32_t i = 0; i < size * size; i++) {
+      if (mip[i] <= hi[i] && mip[i] >= lo[i]) continue;
+      if (errors < 8) log_msg(
+          LOG_LEVEL_ERROR,
+          "Pyramid mip %u texel (%u, %u) is %g, expected %g to %g",
+          level,
+          i % size,
+          i / size,
+          (double)mip[i],
+          (double)lo[i],
+          (double)hi[i]
+      );
+      errors++;
+    }
+    mip += size * size;
+    if (size == 1) break;
+    size /= 2;
+    for (uint32_t y = 0; y < size; y++) {
+      for (uint32_t x = 0; x < size; x++) {
+        uint32_t i = y * 2 * size * 2 + x * 2;
+        lo[y * size + x] = fminf(
+            fminf(lo[i], lo[i + 1]),
+            fminf(lo[i + size * 2], lo[i + size * 2 + 1])
+        );
+        hi[y * size + x] = fminf(
+            fminf(hi[i], hi[i + 1]),
+            fminf(hi[i + size * 2], hi[i + size * 2 + 1])
+        );
+      }
+    }
+  }
+  free(lo);
+  free(hi);
+  log_msg(
+      errors ? LOG_LEVEL_ERROR : LOG_LEVEL_INFO,
+      "Pyramid (%u mips, %s wall): %u texels wrong",
+      check->hiz.mip_count,
+      wall ? "with" : "without",
+      errors
+  );
+  check->errors += errors;
+}
+/* Place an instance, in view space */
+static void place_instance(
+    check_t *check,
+    vk_hiz_instance_t *instance,
+    place_t place,
+    const vk_hiz_camera_t *camera
+) {
+  float x, y, z;
+  switch (place) {
+    case PLACE_HIDDEN:
+      /* Top left of the screen (clip space Y is up), behind the wall */
+      x = random_range(check, -0.8f, -0.3f);
+      y = random_range(check, 0.3f, 0.8f);
+      z = random_range(check, 2.0f * WALL_Z, 8.0f * WALL_Z);
+      instance->radius = random_range(check, 0.1f, 0.4f);
+      break;
+    case PLACE_IN_FRONT:
+      x = random_range(check, -0.8f, -0.3f);
+      y = random_range(check, 0.3f, 0.8f);
+      z = random_range(check, 0.2f * WALL_Z, 0.6f * WALL_Z);
+      instance->radius = random_range(check, 0.05f, 0.2f);
+      break;
+    case PLACE_OPEN:
+      /* Any other quarter */
+      x = random_range(check, 0.3f, 0.8f);
+      y = random_range(check, -0.8f, -0.3f);
+      if (next_random(check) % 3 == 0) x = -x;
+      else if (next_random(check) % 2 == 0) y = -y;
+      z = random_range(check, 2.0f * WALL_Z, 8.0f * WALL_Z);
+      instance->radius = random_range(check, 0.1f, 0.4f);
+      break;
+    default:
+      /* Far to one side, or behind the camera */
+      x = random_range(check, 2.0f, 4.0f);
+      y = random_range(check, -0.5f, 0.5f);
+      if (next_random(check) % 2 == 0) x = -x;
+      z = random_range(check, 2.0f * WALL_Z, 8.0f * WALL_Z);
+      if (next_random(check) % 3 == 0) z = -z;
+      instance->radius = random_range(check, 0.1f, 0.4f);
+  }
+  /* From normalized device coordinates back to view space */
+  instance->center[0] = x * fabsf(z) / camera->p00;
+  instance->center[1] = y * fabsf(z) / camera->p11;
+  instance->center[2] = z;
+  instance->index_count = 3;
+  instance->first_index = 0;
+  instance->vertex_offset = 0;
+  instance->padding = 0;
+}
+/* Record, submit and wait for a frame, with or without the wall */
+static void run_frame(
+    check_t *check,
+    uint32_t frame,
+    const vk_hiz_camera_t *camera,
+    bool wall
+) {
+  VkCommandBufferBeginInfo begin_info;
+  vk_submission_t submission;
+  float *depth = (float *)check->staging.mapped;
+
+  for (uint32_t y = 0; y < check->height; y++) {
+    for (uint32_t x = 0; x < check->width; x++)
+      depth[y * check->width + x] = depth_at(check, x, y, wall);
+  }
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(check->cmd, 0));
+  VK_CHECK(vkBeginCommandBuffer(check->cmd, &begin_info));
+  vk_hiz_begin_frame(&check->hiz, &check->dev, frame);
+  vk_hiz_cmd_cull_early(&check->hiz, check->cmd, camera);
+  /* (The early draws would render the depth here) */
+  cmd_upload_depth(check);
+  vk_hiz_cmd_build_pyramid(&check->hiz, check->cmd);
+  vk_hiz_cmd_cull_late(&check->hiz, check->cmd);
+  cmd_read_pyramid(check);
+  VK_CHECK(vkEndCommandBuffer(check->cmd));
+  submission.command_buffers = &check->cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = NULL;
+  submission.wait_count = 0;
+  submission.signals = NULL;
+  submission.signal_count = 0;
+  submission.fence = VK_NULL_HANDLE;
+  vk_sync_wait(
+      vk_submit_enqueue(&check->submit, VK_SUBMIT_GRAPHICS, &submission),
+      &check->dev,
+      UINT64_MAX
+  );
+  /* Statistics of the frame just run */
+  vk_hiz_begin_frame(&check->hiz, &check->dev, frame + 1);
+}
+/* Check a frame's statistics */
+static void check_stats(
+    check_t *check,
+    uint32_t frame,
+    uint32_t early,
+    uint32_t late,
+    uint32_t frustum_culled,
+    uint32_t occlusion_culled
+) {
+  const vk_hiz_stats_t *stats = &check->hiz.stats;
+  bool ok = stats->early_drawn == early
+    && stats->late_drawn == late
+    && stats->frustum_culled == frustum_culled
+    && stats->occlusion_culled == occlusion_culled;
+  log_msg(
+      ok ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR,
+      "Frame %u: %u early, %u late, %u frustum culled, %u occlusion culled "
+      "(expected %u, %u, %u, %u), pyramid built in %.3f ms",
+      frame,
+      stats->early_drawn,
+      stats->late_drawn,
+      stats->frustum_culled,
+      stats->occlusion_culled,
+      early,
+      late,
+      frustum_culled,
+      occlusion_culled,
+      stats->pyramid_build_ms
+  );
+  if (!ok) check->errors++;
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  vk_hiz_builder_t hiz_builder = vk_hiz_builder();
+  VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceVulkan12Features features12;
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo alloc_info;
+  vk_hiz_instance_t *instances;
+  vk_hiz_camera_t camera;
+  uint32_t counts[PLACE_COUNT], readback_size = 0;
+  uint32_t instance_count;
+  vk_inst_t inst;
+  vk_phys_dev_t phys_dev;
+  check_t check;
+
+  memset(&check, 0, sizeof(check));
+  check.width = argc > 1 ? (uint32_t)atoi(argv[1]) : DEFAULT_WIDTH;
+  check.height = argc > 2 ? (uint32_t)atoi(argv[2]) : DEFAULT_HEIGHT;
+  instance_count = argc > 3 ? (uint32_t)atoi(argv[3]) : DEFAULT_INSTANCES;
+  check.rng = 0x9e3779b97f4a7c15ull;
+  ASSERT(check.width >= 2 && check.height >= 2 && instance_count > 0);
+
+  /* Headless instance and device with the culler's features */
+  vk_inst_builder_set_app_name(&inst_builder, "vk-renderer check_hiz");
+  vk_inst_builder_set_app_version(&inst_builder, 0, 0, 1);
+  inst = vk_inst_create(&inst_builder);
+  phys_dev = vk_phys_dev_choose(score_physical_device, &inst, NULL);
+  vk_phys_dev_get_info(phys_dev, &check.info, NULL);
+  ASSERT(score_physical_device(&check.info) > 0);
+  log_msg(LOG_LEVEL_INFO, "Checking on %s", check.info.properties.deviceName);
+  memset(&features, 0, sizeof(features));
+  features.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+  vk_dev_builder_add_features(&dev_builder, features);
+  memset(&features12, 0, sizeof(features12));
+  features12.timelineSemaphore = VK_TRUE;
+  features12.samplerFilterMinmax = VK_TRUE;
+  vk_dev_builder_add_features12(&dev_builder, features12);
+  vk_dev_builder_add_graphics_queue(&dev_builder, 1.0f);
+  check.dev = vk_dev_create(&phys_dev, &check.info, &dev_builder);
+  vk_submit_create(&check.submit, &check.dev);
+
+  /* Culler, depth buffer and readback */
+  vk_hiz_builder_set_extent(&hiz_builder, check.width, check.height);
+  vk_hiz_builder_set_max_instances(&hiz_builder, instance_count);
+  if (argc > 4) vk_hiz_builder_set_shader_dir(&hiz_builder, argv[4]);
+  check.hiz = vk_hiz_create(&check.dev, &check.info, &hiz_builder);
+  create_depth(&check);
+  vk_hiz_set_depth(
+      &check.hiz,
+      &check.dev,
+      check.depth_view,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  );
+  for (uint32_t i = 0; i < check.hiz.mip_count; i++) {
+    uint32_t size = check.hiz.pyramid_size >> i;
+    readback_size += size * size;
+  }
+  check.readback = vk_buf_create(
+      &check.dev,
+      &check.info,
+      sizeof(float) * readback_size,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+  );
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = check.info.queue_families.graphics_index;
+  VK_CHECK(vkCreateCommandPool(
+        check.dev.device,
+        &pool_info,
+        NULL,
+        &check.pool
+  ));
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.commandPool = check.pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(check.dev.device, &alloc_info, &check.cmd));
+
+  /* Camera at the origin looking down +Z, instances in every place */
+  memset(&camera, 0, sizeof(camera));
+  for (uint32_t i = 0; i < 4; i++) camera.view[i * 5] = 1.0f;
+  camera.p11 = 1.0f;
+  camera.p00 = camera.p11 * (float)check.height / (float)check.width;
+  camera.znear = ZNEAR;
+  instances = (vk_hiz_instance_t *)malloc(
+      sizeof(vk_hiz_instance_t) * instance_count
+  );
+  ASSERT(instances);
+  memset(counts, 0, sizeof(counts));
+  for (uint32_t i = 0; i < instance_count; i++) {
+    place_t place = (place_t)(next_random(&check) % PLACE_COUNT);
+    place_instance(&check, &instances[i], place, &camera);
+    counts[place]++;
+  }
+  vk_hiz_set_instances(&check.hiz, instances, instance_count);
+  free(instances);
+
+  /* Frame 0: nothing in the pyramid yet, so everything visible is early */
+  run_frame(&check, 0, &camera, true);
+  check_pyramid(&check, true);
+  check_stats(
+      &check,
+      0,
+      instance_count - counts[PLACE_OUTSIDE],
+      0,
+      counts[PLACE_OUTSIDE],
+      0
+  );
+  /* Frame 1: the wall hides what is behind it */
+  run_frame(&check, 1, &camera, true);
+  check_stats(
+      &check,
+      1,
+      counts[PLACE_IN_FRONT] + counts[PLACE_OPEN],
+      0,
+      counts[PLACE_OUTSIDE],
+      counts[PLACE_HIDDEN]
+  );
+  /* Frame 2: the wall goes, and the late phase draws what it hid */
+  run_frame(&check, 2, &camera, false);
+  check_pyramid(&check, false);
+  check_stats(
+      &check,
+      2,
+      counts[PLACE_IN_FRONT] + counts[PLACE_OPEN],
+      counts[PLACE_HIDDEN],
+      counts[PLACE_OUTSIDE],
+      0
+  );
+  log_msg(
+      check.errors ? LOG_LEVEL_ERROR : LOG_LEVEL_SUCCESS,
+      "%u frames, %u instances: %u errors",
+      FRAMES,
+      instance_count,
+      check.errors
+  );
+  telemetry_dump();
+
+  vk_submit_wait_idle(&check.submit);
+  vkDestroyCommandPool(check.dev.device, check.pool, NULL);
+  vk_buf_destroy(&check.readback, &check.dev);
+  vk_buf_destroy(&check.staging, &check.dev);
+  vkDestroyImageView(check.dev.device, check.depth_view, NULL);
+  vkDestroyImage(check.dev.device, check.depth, NULL);
+  vkFreeMemory(check.dev.device, check.depth_memory, NULL);
+  vk_hiz_destroy(&check.hiz, &check.dev);
+  vk_submit_destroy(&check.submit, &check.dev);
+  vk_dev_destroy(&check.dev);
+  vk_phys_dev_info_free(&check.info);
+  vk_inst_destroy(&inst);
+  return check.errors > 0 ? 1 : 0;
+}
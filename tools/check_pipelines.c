@@ -0,0 +1,429 @@
+/* Asynchronous pipeline compilation check */
+#include <base.h>
+#include <hash.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_dev_cache.h>
+#include <vk_shader.h>
+#include <vk_pipelines.h>
+#include <jobs.h>
+#include <sched.h>
+#include <pthread.h>
+
+/*
+ * Usage: check_pipelines [shader dir] [libraries]
+ *
+ * Requests pipelines from vk_pipelines headless, with the job system's only
+ * worker held by a job, so compiles only run when the caller helps inside
+ * vk_pipelines_wait and every answer is deterministic. Checks:
+ *   queued   - a key without specialization constants gets VK_NULL_HANDLE
+ *              until it's compiled (nothing compiles on the caller)
+ *   fallback - a specialized key gets its generic key's pipeline until its
+ *              own is compiled, then its own
+ *   linking  - with graphics pipeline libraries, each key's fast link was
+ *              replaced by its optimized link, and a key differing only in
+ *              blend state compiles just one new library part; without
+ *              them, whole pipelines are compiled and no libraries built
+ *   async    - once the worker is free, a key requested from another thread
+ *              (which never waits or helps) is compiled by the worker alone
+ * Libraries are used when the device has them, unless libraries is 0.
+ * Shaders (check_pipelines.vert and .frag) default to bin/shaders. Exits
+ * non-zero on any mismatch.
+ */
+
+/* Defaults */
+#define DEFAULT_SHADER_DIR "bin/shaders"
+/* Specialization constant picking the fragment shader's color */
+#define VARIANT_ID 0
+#define VARIANT_VALUE 7
+/* Keys checked */
+#define KEY_GENERIC 0
+#define KEY_SPECIALIZED 1
+#define KEY_BLENDED 2
+#define KEY_COUNT 3
+/* Longest the other thread polls for its pipeline (seconds) */
+#define ASYNC_TIMEOUT 10.0
+
+/* Types */
+/* Job keeping the worker busy until released */
+typedef struct {
+  job_t job;
+  job_counter_t counter;
+  atomic_bool started;
+  atomic_bool released;
+} hold_t;
+/* Request made from another thread */
+typedef struct {
+  vk_pipelines_t *pipelines;
+  vk_pipeline_key_t key;
+  const vk_shader_t *const *shaders;
+  VkPipeline pipeline;
+  double elapsed;
+} request_t;
+/* Check state */
+typedef struct {
+  vk_dev_t dev;
+  vk_phys_dev_info_t info;
+  jobs_t jobs;
+  vk_pipelines_t pipelines;
+  void *code[2];
+  vk_shader_t shaders[2];
+  VkPipelineLayout layout;
+  VkRenderPass render_pass;
+  uint32_t errors;
+} check_t;
+
+/* Score physical device */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.graphics_supported) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Hold the worker running this job until released */
+static void hold_job(void *arg) {
+  hold_t *hold = (hold_t *)arg;
+  atomic_store(&hold->started, true);
+  while (!atomic_load(&hold->released)) sched_yield();
+}
+/* Occupy the job system's workers (just one here) */
+static void hold_workers(jobs_t *jobs, hold_t *hold) {
+  atomic_init(&hold->counter.value, 0);
+  atomic_init(&hold->started, false);
+  atomic_init(&hold->released, false);
+  hold->job.fn = hold_job;
+  hold->job.arg = hold;
+  hold->job.counter = &hold->counter;
+  jobs_submit(jobs, &hold->job);
+  while (!atomic_load(&hold->started)) sched_yield();
+}
+/* Poll a request until a worker compiles it, never waiting or helping */
+static void *request_thread(void *arg) {
+  request_t *request = (request_t *)arg;
+  double start = time_now();
+  do {
+    request->pipeline = vk_pipelines_get(
+        request->pipelines,
+        &request->key,
+        request->shaders
+    );
+    request->elapsed = time_now() - start;
+    if (request->pipeline == VK_NULL_HANDLE) sched_yield();
+  } while (
+      request->pipeline == VK_NULL_HANDLE
+      && request->elapsed < ASYNC_TIMEOUT
+  );
+  return NULL;
+}
+/* Count a mismatch */
+static void expect(check_t *check, bool ok, const char *what) {
+  if (ok) return;
+  log_msg(LOG_LEVEL_ERROR, "Mismatch: %s", what);
+  check->errors++;
+}
+/* Load a shader from a SPIR-V file (inlined into stages with maintenance5) */
+static bool load_shader(
+    check_t *check,
+    uint32_t index,
+    const char *shader_dir,
+    const char *name
+) {
+  vk_shader_t *shader = &check->shaders[index];
+  VkShaderModuleCreateInfo module_info;
+  char path[512];
+  size_t size;
+
+  snprintf(path, sizeof(path), "%s/%s", shader_dir, name);
+  check->code[index] = read_file(path, &size);
+  if (!check->code[index]) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read shader %s", path);
+    return false;
+  }
+  if (!vk_shader_reflect(shader, (const uint32_t *)check->code[index], size)) {
+    log_msg(LOG_LEVEL_ERROR, "Shader %s isn't valid SPIR-V", path);
+    return false;
+  }
+  shader->hash = hash64(shader->code, shader->size, 0);
+  if (vk_dev_has_ext(&check->dev, VK_KHR_MAINTENANCE_5_EXTENSION_NAME))
+    return true;
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.pNext = NULL;
+  module_info.flags = 0;
+  module_info.codeSize = shader->size;
+  module_info.pCode = shader->code;
+  shader->module = vk_dev_cache_shader_module(&check->dev, &module_info);
+  return true;
+}
+/* Create a render pass with one color attachment */
+static void create_render_pass(check_t *check) {
+  VkAttachmentDescription attachment;
+  VkAttachmentReference reference;
+  VkSubpassDescription subpass;
+  VkRenderPassCreateInfo info;
+
+  memset(&attachment, 0, sizeof(attachment));
+  attachment.format = VK_FORMAT_R8G8B8A8_UNORM;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  reference.attachment = 0;
+  reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  memset(&subpass, 0, sizeof(subpass));
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &reference;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  info.attachmentCount = 1;
+  info.pAttachments = &attachment;
+  info.subpassCount = 1;
+  info.pSubpasses = &subpass;
+  VK_CHECK(vkCreateRenderPass(
+        check->dev.device,
+        &info,
+        NULL,
+        &check->render_pass
+  ));
+}
+/* Build the checked keys */
+static void create_keys(const check_t *check, vk_pipeline_key_t *keys) {
+  vk_pipeline_key_t *generic = &keys[KEY_GENERIC];
+  VkPipelineColorBlendAttachmentState *blend;
+
+  /* Fullscreen triangle into one attachment, shaders' default constants */
+  vk_pipeline_key_init(generic);
+  generic->layout = check->layout;
+  generic->render_pass = check->render_pass;
+  generic->stage_count = 2;
+  for (uint32_t i = 0; i < 2; i++) {
+    generic->stages[i] = check->shaders[i].stage;
+    generic->shader_hashes[i] = check->shaders[i].hash;
+  }
+  generic->state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  generic->state.polygon_mode = VK_POLYGON_MODE_FILL;
+  generic->state.cull_mode = VK_CULL_MODE_NONE;
+  generic->state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  generic->state.samples = VK_SAMPLE_COUNT_1_BIT;
+  generic->state.attachment_count = 1;
+  generic->state.blend[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+    | VK_COLOR_COMPONENT_G_BIT
+    | VK_COLOR_COMPONENT_B_BIT
+    | VK_COLOR_COMPONENT_A_BIT;
+
+  /* The same with a constant set */
+  keys[KEY_SPECIALIZED] = *generic;
+  keys[KEY_SPECIALIZED].spec.count = 1;
+  keys[KEY_SPECIALIZED].spec.ids[0] = VARIANT_ID;
+  keys[KEY_SPECIALIZED].spec.values[0] = VARIANT_VALUE;
+
+  /* The same with alpha blending (only the fragment output part differs) */
+  keys[KEY_BLENDED] = *generic;
+  blend = &keys[KEY_BLENDED].state.blend[0];
+  blend->blendEnable = VK_TRUE;
+  blend->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  blend->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  blend->colorBlendOp = VK_BLEND_OP_ADD;
+  blend->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  blend->dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  blend->alphaBlendOp = VK_BLEND_OP_ADD;
+}
+/* Find a key's pipeline entry (NULL if it was never requested) */
+static const vk_pipeline_entry_t *find_entry(
+    const vk_pipelines_t *pipelines,
+    const vk_pipeline_key_t *key
+) {
+  for (uint32_t i = 0; i < pipelines->table.capacity; i++) {
+    const vk_pipeline_entry_t *entry = pipelines->table.entries[i];
+    if (
+        entry
+        && entry->part == 0
+        && memcmp(&entry->key, key, sizeof(vk_pipeline_key_t)) == 0
+    ) return entry;
+  }
+  return NULL;
+}
+/* Help compile everything queued, logging how long it took */
+static void wait_compiles(check_t *check, const char *what) {
+  double start = time_now();
+  vk_pipelines_wait(&check->pipelines);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Compiled %s in %.2f ms",
+      what,
+      (time_now() - start) * 1e3
+  );
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  const char *shader_dir = argc > 1 ? argv[1] : DEFAULT_SHADER_DIR;
+  bool libraries = argc > 2 ? atoi(argv[2]) != 0 : true;
+  const vk_shader_t *shaders[2];
+  vk_pipeline_key_t keys[KEY_COUNT];
+  VkPipeline generic, specialized, blended;
+  uint32_t library_count;
+  hold_t hold;
+  request_t request;
+  pthread_t thread;
+  vk_inst_t inst;
+  vk_phys_dev_t phys_dev;
+  check_t check;
+
+  memset(&check, 0, sizeof(check));
+
+  /* Headless instance and device, with libraries and maintenance5 if any */
+  vk_inst_builder_set_app_name(&inst_builder, "vk-renderer check_pipelines");
+  vk_inst_builder_set_app_version(&inst_builder, 0, 0, 1);
+  inst = vk_inst_create(&inst_builder);
+  phys_dev = vk_phys_dev_choose(score_physical_device, &inst, NULL);
+  vk_phys_dev_get_info(phys_dev, &check.info, NULL);
+  ASSERT(score_physical_device(&check.info) > 0);
+  log_msg(LOG_LEVEL_INFO, "Checking on %s", check.info.properties.deviceName);
+  if (
+      libraries
+      && check.info.graphics_pipeline_library.graphicsPipelineLibrary
+  ) vk_dev_builder_add_graphics_pipeline_library(&dev_builder);
+  if (check.info.maintenance5.maintenance5)
+    vk_dev_builder_add_maintenance5(&dev_builder);
+  vk_dev_builder_add_graphics_queue(&dev_builder, 1.0f);
+  check.dev = vk_dev_create(&phys_dev, &check.info, &dev_builder);
+  jobs_create(&check.jobs, 1, false);
+
+  /* Shaders, layout and render pass the keys share */
+  if (
+      !load_shader(&check, 0, shader_dir, "check_pipelines.vert.spv")
+      || !load_shader(&check, 1, shader_dir, "check_pipelines.frag.spv")
+  ) return 1;
+  shaders[0] = &check.shaders[0];
+  shaders[1] = &check.shaders[1];
+  check.layout = vk_shader_pipeline_layout(&check.dev, shaders, 2);
+  create_render_pass(&check);
+  create_keys(&check, keys);
+  vk_pipelines_create(
+      &check.pipelines,
+      &check.dev,
+      VK_NULL_HANDLE,
+      &check.jobs
+  );
+
+  /* Queued: nothing is ready until the caller helps compile it */
+  hold_workers(&check.jobs, &hold);
+  expect(
+      &check,
+      vk_pipelines_get(&check.pipelines, &keys[KEY_GENERIC], shaders)
+        == VK_NULL_HANDLE,
+      "generic key was ready before it was compiled"
+  );
+  wait_compiles(&check, "generic key");
+  generic = vk_pipelines_get(&check.pipelines, &keys[KEY_GENERIC], shaders);
+  expect(&check, generic != VK_NULL_HANDLE, "generic key wasn't compiled");
+
+  /* Fallback: the generic pipeline stands in until the variant is ready */
+  expect(
+      &check,
+      vk_pipelines_get(&check.pipelines, &keys[KEY_SPECIALIZED], shaders)
+        == generic,
+      "specialized key didn't fall back to the generic pipeline"
+  );
+  wait_compiles(&check, "specialized key");
+  specialized =
+    vk_pipelines_get(&check.pipelines, &keys[KEY_SPECIALIZED], shaders);
+  expect(
+      &check,
+      specialized != VK_NULL_HANDLE && specialized != generic,
+      "specialized key didn't get its own pipeline"
+  );
+
+  /* Linking: fast links replaced, and library parts shared between keys */
+  library_count = check.pipelines.libraries.count;
+  vk_pipelines_prepare(&check.pipelines, &keys[KEY_BLENDED], shaders);
+  wait_compiles(&check, "blended key");
+  blended = vk_pipelines_get(&check.pipelines, &keys[KEY_BLENDED], shaders);
+  expect(&check, blended != VK_NULL_HANDLE, "blended key wasn't compiled");
+  for (uint32_t i = 0; i < KEY_COUNT; i++) {
+    const vk_pipeline_entry_t *entry = find_entry(&check.pipelines, &keys[i]);
+    VkPipeline pipeline =
+      entry ? atomic_load(&entry->pipeline) : VK_NULL_HANDLE;
+    if (!entry) {
+      expect(&check, false, "requested key has no entry");
+    } else if (check.pipelines.use_libraries) {
+      expect(
+          &check,
+          entry->replaced != VK_NULL_HANDLE && entry->replaced != pipeline,
+          "fast link wasn't replaced by an optimized link"
+      );
+    } else {
+      expect(
+          &check,
+          entry->replaced == VK_NULL_HANDLE,
+          "whole pipeline was replaced"
+      );
+    }
+  }
+  expect(
+      &check,
+      check.pipelines.libraries.count
+        == (check.pipelines.use_libraries ? library_count + 1 : 0),
+      check.pipelines.use_libraries
+        ? "blended key didn't share its other library parts"
+        : "libraries were compiled without graphics pipeline library"
+  );
+
+  atomic_store(&hold.released, true);
+  jobs_wait(&check.jobs, &hold.counter);
+
+  /* Async: a request from another thread is compiled by the worker alone */
+  request.pipelines = &check.pipelines;
+  request.key = keys[KEY_GENERIC];
+  request.key.state.cull_mode = VK_CULL_MODE_BACK_BIT;
+  request.shaders = shaders;
+  ASSERT(pthread_create(&thread, NULL, request_thread, &request) == 0);
+  pthread_join(thread, NULL);
+  expect(
+      &check,
+      request.pipeline != VK_NULL_HANDLE,
+      "key requested from another thread was never compiled"
+  );
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Compiled another thread's key in %.2f ms",
+      request.elapsed * 1e3
+  );
+
+  log_msg(
+      check.errors ? LOG_LEVEL_ERROR : LOG_LEVEL_SUCCESS,
+      "%u keys, %u libraries (%s): %u errors",
+      check.pipelines.table.count,
+      check.pipelines.libraries.count,
+      check.pipelines.use_libraries ? "linked" : "whole pipelines",
+      check.errors
+  );
+
+  /* Cleanup */
+  vk_pipelines_destroy(&check.pipelines);
+  vkDestroyRenderPass(check.dev.device, check.render_pass, NULL);
+  vk_dev_cache_release_pipeline_layout(&check.dev, check.layout);
+  for (uint32_t i = 0; i < 2; i++) {
+    vk_shader_unload(&check.shaders[i], &check.dev);
+    free(check.code[i]);
+  }
+  jobs_destroy(&check.jobs);
+  vk_dev_destroy(&check.dev);
+  vk_phys_dev_info_free(&check.info);
+  vk_inst_destroy(&inst);
+  return check.errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,373 @@
+/* Sub-allocator and defragmentation soak test */
+#include <base.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <vk_submit.h>
+#include <vk_heap.h>
+#include <telemetry.h>
+
+/*
+ * Usage: soak_heap [frames] [seed] [live allocations]
+ *
+ * Churns a device local heap headless (so it runs on lavapipe): every frame
+ * frees a few random allocations, makes new ones of random sizes up to the
+ * live count, fills each with its own pattern on the graphics queue, and
+ * defragments up to DEFRAG_BYTES. Every VERIFY_INTERVAL frames, and at the
+ * end, every live allocation is read back and checked against its pattern,
+ * wherever it has been moved to. Exits non-zero on any mismatch.
+ */
+
+/* Defaults */
+#define DEFAULT_FRAMES 2000
+#define DEFAULT_LIVE 1500
+/* Frames recorded ahead of the GPU */
+#define FRAMES_IN_FLIGHT 2
+/* Heap block size */
+#define BLOCK_SIZE (16u << 20)
+/* Bytes moved per frame at most */
+#define DEFRAG_BYTES (4u << 20)
+/* Share of live allocations freed per frame (1 in n) */
+#define FREE_RATE 25
+/* Share of allocations that may never move (1 in n) */
+#define PINNED_RATE 10
+/* Frames between full verifications */
+#define VERIFY_INTERVAL 250
+/* Readback buffer size */
+#define READBACK_SIZE (32u << 20)
+/* Allocation alignment */
+#define ALIGNMENT 256u
+
+/* Types */
+/* Live allocation, as the test expects it to be */
+typedef struct {
+  uint32_t id;
+  VkDeviceSize size;
+  uint32_t pattern;
+} live_t;
+/* Soak test state */
+typedef struct {
+  vk_dev_t dev;
+  vk_submit_t submit;
+  vk_heap_t heap;
+  vk_buf_t readback;
+  VkCommandPool pool;
+  VkCommandBuffer cmds[FRAMES_IN_FLIGHT];
+  VkCommandBuffer verify_cmd;
+  vk_sync_point_t done[FRAMES_IN_FLIGHT];
+  live_t *live;
+  uint32_t live_count;
+  uint64_t rng;
+  uint64_t allocated, freed, failed, moved, errors;
+} soak_t;
+
+/* Score physical device */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.graphics_supported) return 0;
+  if (!info->features12.timelineSemaphore) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Next pseudo random number */
+static uint32_t next_random(soak_t *soak) {
+  soak->rng ^= soak->rng << 13;
+  soak->rng ^= soak->rng >> 7;
+  soak->rng ^= soak->rng << 17;
+  return (uint32_t)(soak->rng >> 32);
+}
+/* Count moves (a renderer would rewrite descriptors here) */
+static void allocation_moved(void *user, uint32_t id) {
+  soak_t *soak = (soak_t *)user;
+  (void)id;
+  soak->moved++;
+}
+/* Pick an allocation size, mostly small with a long tail */
+static VkDeviceSize random_size(soak_t *soak) {
+  uint32_t scale = next_random(soak) % 12;
+  VkDeviceSize size = (VkDeviceSize)ALIGNMENT << scale;
+  return size + (VkDeviceSize)(next_random(soak) % (1u << scale)) * 4;
+}
+/* Read back and check a run of live allocations (returns the next index) */
+static uint32_t verify_some(soak_t *soak, uint32_t first) {
+  VkCommandBufferBeginInfo begin_info;
+  vk_submission_t submission;
+  VkDeviceSize used = 0;
+  uint32_t last = first;
+
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(soak->verify_cmd, 0));
+  VK_CHECK(vkBeginCommandBuffer(soak->verify_cmd, &begin_info));
+  while (last < soak->live_count) {
+    const live_t *live = &soak->live[last];
+    VkBufferCopy region;
+    if (used + live->size > READBACK_SIZE) break;
+    region.srcOffset = vk_heap_offset(&soak->heap, live->id);
+    region.dstOffset = used;
+    region.size = live->size;
+    vkCmdCopyBuffer(
+        soak->verify_cmd,
+        vk_heap_buffer(&soak->heap, live->id),
+        soak->readback.buffer,
+        1,
+        &region
+    );
+    used += live->size;
+    last++;
+  }
+  VK_CHECK(vkEndCommandBuffer(soak->verify_cmd));
+  submission.command_buffers = &soak->verify_cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = NULL;
+  submission.wait_count = 0;
+  submission.signals = NULL;
+  submission.signal_count = 0;
+  submission.fence = VK_NULL_HANDLE;
+  vk_sync_wait(
+      vk_submit_enqueue(&soak->submit, VK_SUBMIT_GRAPHICS, &submission),
+      &soak->dev,
+      UINT64_MAX
+  );
+  if (!(soak->readback.memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    VkMappedMemoryRange range;
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.pNext = NULL;
+    range.memory = soak->readback.memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    VK_CHECK(vkInvalidateMappedMemoryRanges(soak->dev.device, 1, &range));
+  }
+
+  used = 0;
+  for (uint32_t i = first; i < last; i++) {
+    const live_t *live = &soak->live[i];
+    const uint32_t *words =
+      (const uint32_t *)((const uint8_t *)soak->readback.mapped + used);
+    for (VkDeviceSize w = 0; w < live->size / 4; w++) {
+      if (words[w] == live->pattern) continue;
+      if (soak->errors < 8) log_msg(
+          LOG_LEVEL_ERROR,
+          "Allocation %u corrupt at byte %llu",
+          live->id,
+          (unsigned long long)(w * 4)
+      );
+      soak->errors++;
+      break;
+    }
+    used += live->size;
+  }
+  return last;
+}
+/* Check every live allocation holds its pattern */
+static void verify(soak_t *soak) {
+  uint32_t next = 0;
+  vk_submit_wait_idle(&soak->submit);
+  while (next < soak->live_count) next = verify_some(soak, next);
+}
+/* Run a frame of churn */
+static void run_frame(soak_t *soak, uint32_t frame, uint32_t live_target) {
+  VkCommandBuffer cmd = soak->cmds[frame % FRAMES_IN_FLIGHT];
+  VkCommandBufferBeginInfo begin_info;
+  vk_submission_t submission;
+
+  vk_sync_wait(soak->done[frame % FRAMES_IN_FLIGHT], &soak->dev, UINT64_MAX);
+  vk_heap_begin_frame(&soak->heap);
+
+  /* Free a few at random */
+  for (uint32_t i = 0; i < soak->live_count;) {
+    if (next_random(soak) % FREE_RATE != 0) {
+      i++;
+      continue;
+    }
+    vk_heap_free(&soak->heap, soak->live[i].id);
+    soak->live[i] = soak->live[--soak->live_count];
+    soak->freed++;
+  }
+
+  /* Refill, writing each new allocation's pattern */
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = NULL;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin_info.pInheritanceInfo = NULL;
+  VK_CHECK(vkResetCommandBuffer(cmd, 0));
+  VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+  while (soak->live_count < live_target) {
+    live_t *live = &soak->live[soak->live_count];
+    bool pinned = next_random(soak) % PINNED_RATE == 0;
+    live->size = random_size(soak);
+    live->pattern = next_random(soak);
+    live->id = vk_heap_alloc(
+        &soak->heap,
+        live->size,
+        ALIGNMENT,
+        pinned ? NULL : allocation_moved,
+        soak
+    );
+    if (live->id == VK_HEAP_INVALID) {
+      soak->failed++;
+      break;
+    }
+    vkCmdFillBuffer(
+        cmd,
+        vk_heap_buffer(&soak->heap, live->id),
+        vk_heap_offset(&soak->heap, live->id),
+        live->size,
+        live->pattern
+    );
+    soak->live_count++;
+    soak->allocated++;
+  }
+  VK_CHECK(vkEndCommandBuffer(cmd));
+  submission.command_buffers = &cmd;
+  submission.command_buffer_count = 1;
+  submission.waits = NULL;
+  submission.wait_count = 0;
+  submission.signals = NULL;
+  submission.signal_count = 0;
+  submission.fence = VK_NULL_HANDLE;
+  soak->done[frame % FRAMES_IN_FLIGHT] =
+    vk_submit_enqueue(&soak->submit, VK_SUBMIT_GRAPHICS, &submission);
+
+  /* Moves wait for the fills */
+  vk_heap_defrag(
+      &soak->heap,
+      DEFRAG_BYTES,
+      soak->done[frame % FRAMES_IN_FLIGHT]
+  );
+  vk_submit_flush(&soak->submit);
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  VkPhysicalDeviceVulkan12Features features12;
+  VkCommandPoolCreateInfo pool_info;
+  VkCommandBufferAllocateInfo alloc_info;
+  vk_inst_t inst;
+  vk_phys_dev_t phys_dev;
+  vk_phys_dev_info_t info;
+  soak_t soak;
+  uint32_t frames = argc > 1 ? (uint32_t)atoi(argv[1]) : DEFAULT_FRAMES;
+  uint32_t live_target = argc > 3 ? (uint32_t)atoi(argv[3]) : DEFAULT_LIVE;
+  double start;
+
+  memset(&soak, 0, sizeof(soak));
+  soak.rng = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+  soak.rng = soak.rng * 0x9e3779b97f4a7c15ull + 1;
+  if (live_target == 0) live_target = 1;
+
+  /* Headless instance and device, with a transfer queue if there is one */
+  vk_inst_builder_set_app_name(&inst_builder, "vk-renderer soak");
+  vk_inst_builder_set_app_version(&inst_builder, 0, 0, 1);
+  inst = vk_inst_create(&inst_builder);
+  phys_dev = vk_phys_dev_choose(score_physical_device, &inst, NULL);
+  vk_phys_dev_get_info(phys_dev, &info, NULL);
+  ASSERT(score_physical_device(&info) > 0);
+  log_msg(LOG_LEVEL_INFO, "Soaking on %s", info.properties.deviceName);
+  memset(&features12, 0, sizeof(features12));
+  features12.timelineSemaphore = VK_TRUE;
+  vk_dev_builder_add_features12(&dev_builder, features12);
+  if (info.synchronization2.synchronization2)
+    vk_dev_builder_add_synchronization2(&dev_builder);
+  vk_dev_builder_add_graphics_queue(&dev_builder, 1.0f);
+  if (
+      info.queue_families.transfer_supported
+      && info.queue_families.transfer_index
+      != info.queue_families.graphics_index
+  ) vk_dev_builder_add_transfer_queue(&dev_builder, 1.0f);
+  soak.dev = vk_dev_create(&phys_dev, &info, &dev_builder);
+  vk_submit_create(&soak.submit, &soak.dev);
+
+  /* Heap, readback and command buffers */
+  vk_heap_create(
+      &soak.heap,
+      &soak.dev,
+      &info,
+      &soak.submit,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      BLOCK_SIZE,
+      FRAMES_IN_FLIGHT
+  );
+  soak.readback = vk_buf_create(
+      &soak.dev,
+      &info,
+      READBACK_SIZE,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+  );
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = info.queue_families.graphics_index;
+  VK_CHECK(vkCreateCommandPool(soak.dev.device, &pool_info, NULL, &soak.pool));
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.commandPool = soak.pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = FRAMES_IN_FLIGHT;
+  VK_CHECK(vkAllocateCommandBuffers(soak.dev.device, &alloc_info, soak.cmds));
+  alloc_info.commandBufferCount = 1;
+  VK_CHECK(vkAllocateCommandBuffers(
+        soak.dev.device,
+        &alloc_info,
+        &soak.verify_cmd
+  ));
+  soak.live = (live_t *)malloc(sizeof(live_t) * live_target);
+  ASSERT(soak.live);
+
+  /* Churn */
+  start = time_now();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    run_frame(&soak, frame, live_target);
+    if ((frame + 1) % VERIFY_INTERVAL == 0) {
+      verify(&soak);
+      log_msg(
+          LOG_LEVEL_INFO,
+          "Frame %u: %u live, fragmentation %.3f, %llu moved",
+          frame + 1,
+          soak.live_count,
+          vk_heap_fragmentation(&soak.heap),
+          (unsigned long long)soak.moved
+      );
+    }
+  }
+  verify(&soak);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%u frames in %.2f s: %llu allocated, %llu freed, %llu failed, "
+      "%llu moved, %llu corrupt",
+      frames,
+      time_now() - start,
+      (unsigned long long)soak.allocated,
+      (unsigned long long)soak.freed,
+      (unsigned long long)soak.failed,
+      (unsigned long long)soak.moved,
+      (unsigned long long)soak.errors
+  );
+  telemetry_dump();
+
+  vk_submit_wait_idle(&soak.submit);
+  free(soak.live);
+  vkDestroyCommandPool(soak.dev.device, soak.pool, NULL);
+  vk_buf_destroy(&soak.readback, &soak.dev);
+  vk_heap_destroy(&soak.heap);
+  vk_submit_destroy(&soak.submit, &soak.dev);
+  vk_dev_destroy(&soak.dev);
+  vk_phys_dev_info_free(&info);
+  vk_inst_destroy(&inst);
+  return soak.errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,406 @@
+/* Texture streaming soak test */
+#include <base.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_submit.h>
+#include <vk_stream.h>
+#include <asset_pack.h>
+#include <transcode.h>
+#include <jobs.h>
+#include <telemetry.h>
+
+/*
+ * Usage: soak_stream [textures] [phases] [pack path]
+ *
+ * Streams a synthetic asset pack (written to the pack path, default
+ * soak_stream.pack, and removed afterwards) headless, so it runs on
+ * lavapipe: TEXTURE_SIZE textures with full mip chains, RGBA8 except one in
+ * UNIVERSAL_RATE stored as universal blocks and transcoded to what the
+ * device samples. Nothing is drawn; every frame writes the feedback a draw
+ * would for a window of visible textures, asking for their finest level,
+ * and each phase slides the window on by its width. The budget fits about
+ * twice the window at full resolution, so once more than that has been
+ * seen, textures that went out of view must be evicted. Each phase runs
+ * until the stream settles (no loads in flight, every texture with an
+ * image, every visible texture at level 0) and checks:
+ *   requests - it settles within MAX_PHASE_FRAMES frames
+ *   tails    - no texture lost its mip tail
+ *   budget   - resident memory is what the textures' images take, and is
+ *              within the budget (give or take BUDGET_SLACK, as eviction
+ *              works from packed level sizes and drivers pad images)
+ *   eviction - textures out of view lost levels once those seen at full
+ *              resolution no longer fit
+ * Exits non-zero on any mismatch.
+ */
+
+/* Defaults */
+#define DEFAULT_TEXTURES 64
+#define DEFAULT_PHASES 8
+#define DEFAULT_PACK "soak_stream.pack"
+/* Texture size, and its full mip chain */
+#define TEXTURE_SIZE 512u
+#define TEXTURE_MIPS 10u
+/* Share of textures stored as universal blocks (1 in n) */
+#define UNIVERSAL_RATE 4
+/* Share of textures visible at once (1 in n) */
+#define VISIBLE_RATE 8
+/* Frames recorded ahead of the GPU */
+#define FRAMES_IN_FLIGHT 2
+/* Share of the budget resident memory may overshoot it by (1 in n) */
+#define BUDGET_SLACK 64
+/* Frames a phase may take to settle */
+#define MAX_PHASE_FRAMES 2000
+
+/* Types */
+/* Soak state */
+typedef struct {
+  vk_dev_t dev;
+  vk_phys_dev_info_t info;
+  vk_submit_t submit;
+  jobs_t jobs;
+  asset_pack_t pack;
+  vk_stream_t stream;
+  uint32_t texture_count;
+  uint32_t window_first, window_count;
+  uint64_t frame;
+  uint32_t errors;
+} soak_t;
+
+/* Score physical device */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.graphics_supported) return 0;
+  if (!info->features12.timelineSemaphore) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Get a mip level's dimension */
+static uint32_t mip_extent(uint32_t extent, uint32_t level) {
+  extent >>= level;
+  return extent > 0 ? extent : 1;
+}
+/* Fill a level with a pattern of its texture and level */
+static void fill_level(
+    uint8_t *texels,
+    uint32_t size,
+    uint32_t texture,
+    uint32_t level
+) {
+  for (uint32_t y = 0; y < size; y++) {
+    for (uint32_t x = 0; x < size; x++) {
+      uint8_t *texel = &texels[((size_t)y * size + x) * 4];
+      texel[0] = (uint8_t)(x * 255 / size);
+      texel[1] = (uint8_t)(y * 255 / size);
+      texel[2] = (uint8_t)(texture * 37 + level * 91);
+      texel[3] = 0xff;
+    }
+  }
+}
+/* Write the synthetic pack (false on failure) */
+static bool write_pack(const char *path, uint32_t texture_count) {
+  size_t rgba_size = 0, universal_size = 0, offset;
+  asset_pack_writer_t writer;
+  uint8_t *rgba, *universal, *level;
+  bool ok = true;
+
+  for (uint32_t i = 0; i < TEXTURE_MIPS; i++) {
+    uint32_t size = mip_extent(TEXTURE_SIZE, i);
+    rgba_size += (size_t)size * size * 4;
+    universal_size += transcode_universal_size(size, size);
+  }
+  rgba = (uint8_t *)malloc(rgba_size);
+  universal = (uint8_t *)malloc(universal_size);
+  level = (uint8_t *)malloc((size_t)TEXTURE_SIZE * TEXTURE_SIZE * 4);
+  ASSERT(rgba && universal && level);
+
+  /* Universal textures share one chain, as encoding is slow */
+  offset = 0;
+  for (uint32_t i = 0; i < TEXTURE_MIPS; i++) {
+    uint32_t size = mip_extent(TEXTURE_SIZE, i);
+    fill_level(level, size, 0, i);
+    transcode_encode(level, size, size, universal + offset);
+    offset += transcode_universal_size(size, size);
+  }
+
+  if (!asset_pack_writer_begin(&writer, path)) {
+    free(rgba);
+    free(universal);
+    free(level);
+    return false;
+  }
+  for (uint32_t t = 0; ok && t < texture_count; t++) {
+    uint32_t meta[ASSET_CHUNK_META_COUNT];
+    bool is_universal = t % UNIVERSAL_RATE == UNIVERSAL_RATE - 1;
+    char name[ASSET_CHUNK_NAME_MAX];
+    memset(meta, 0, sizeof(meta));
+    meta[ASSET_META_TEXTURE_FORMAT] = is_universal
+      ? TRANSCODE_FORMAT_UNIVERSAL_UNORM
+      : (uint32_t)VK_FORMAT_R8G8B8A8_UNORM;
+    meta[ASSET_META_TEXTURE_WIDTH] = TEXTURE_SIZE;
+    meta[ASSET_META_TEXTURE_HEIGHT] = TEXTURE_SIZE;
+    meta[ASSET_META_TEXTURE_MIPS] = TEXTURE_MIPS;
+    snprintf(name, sizeof(name), "texture%u", t);
+    if (!is_universal) {
+      offset = 0;
+      for (uint32_t i = 0; i < TEXTURE_MIPS; i++) {
+        uint32_t size = mip_extent(TEXTURE_SIZE, i);
+        fill_level(rgba + offset, size, t, i);
+        offset += (size_t)size * size * 4;
+      }
+    }
+    ok = asset_pack_writer_add(
+        &writer,
+        name,
+        ASSET_CHUNK_TEXTURE,
+        meta,
+        is_universal ? universal : rgba,
+        is_universal ? universal_size : rgba_size
+    );
+  }
+  ok = asset_pack_writer_end(&writer) && ok;
+  free(rgba);
+  free(universal);
+  free(level);
+  return ok;
+}
+/* Check if a texture is in the visible window */
+static bool is_visible(const soak_t *soak, uint32_t texture) {
+  uint32_t offset =
+    (texture + soak->texture_count - soak->window_first) % soak->texture_count;
+  return offset < soak->window_count;
+}
+/* Write the feedback drawing the window at its finest level would give */
+static void write_feedback(soak_t *soak, uint32_t frame_index) {
+  vk_stream_t *stream = &soak->stream;
+  uint32_t *feedback = (uint32_t *)stream->feedback[frame_index].mapped;
+  const uint32_t *bound =
+    &stream->set_resident_mips[frame_index * stream->max_textures];
+  for (uint32_t i = 0; i < soak->window_count; i++) {
+    uint32_t texture = (soak->window_first + i) % soak->texture_count;
+    /* Level 0 is -bound levels into the bound image, clamped to 0 */
+    feedback[texture] = bound[texture] == VK_STREAM_INVALID
+      ? VK_STREAM_FEEDBACK_BIAS
+      : VK_STREAM_FEEDBACK_BIAS - bound[texture];
+  }
+}
+/* Check if every load landed and every request was met */
+static bool settled(const soak_t *soak) {
+  const vk_stream_t *stream = &soak->stream;
+  if (stream->load_count > 0) return false;
+  for (uint32_t i = 0; i < stream->texture_count; i++) {
+    const vk_stream_texture_t *texture = &stream->textures[i];
+    if (!texture->view) return false;
+    if (is_visible(soak, i) && texture->resident_mip != 0) return false;
+  }
+  return true;
+}
+/* Run frames until the stream settles (false if it doesn't) */
+static bool run_phase(soak_t *soak) {
+  vk_stream_t *stream = &soak->stream;
+  for (uint32_t i = 0; i < MAX_PHASE_FRAMES; i++) {
+    uint32_t frame_index = (uint32_t)(soak->frame++ % FRAMES_IN_FLIGHT);
+    vk_stream_begin_frame(stream, &soak->dev, frame_index);
+    write_feedback(soak, frame_index);
+    vk_stream_update(stream, &soak->dev);
+    vk_submit_flush(&soak->submit);
+    if (settled(soak)) return true;
+    /* Stand in for frame time: wait for the oldest load to land */
+    if (stream->load_count > 0) {
+      vk_stream_load_t *load = &stream->loads[stream->load_head];
+      if (load->submitted)
+        vk_sync_wait(load->uploaded, &soak->dev, UINT64_MAX);
+      else
+        jobs_wait(&soak->jobs, &load->decode);
+    }
+  }
+  return false;
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  vk_stream_builder_t stream_builder = vk_stream_builder();
+  VkPhysicalDeviceVulkan12Features features12;
+  const char *pack_path = argc > 3 ? argv[3] : DEFAULT_PACK;
+  uint32_t phases = argc > 2 ? (uint32_t)atoi(argv[2]) : DEFAULT_PHASES;
+  uint32_t transfer_family, evicted = 0;
+  VkDeviceSize full_size = 0, seen_size = 0;
+  bool *full;
+  vk_inst_t inst;
+  vk_phys_dev_t phys_dev;
+  soak_t soak;
+
+  memset(&soak, 0, sizeof(soak));
+  soak.texture_count = argc > 1 ? (uint32_t)atoi(argv[1]) : DEFAULT_TEXTURES;
+  ASSERT(soak.texture_count >= VISIBLE_RATE && phases > 0);
+  soak.window_count = soak.texture_count / VISIBLE_RATE;
+
+  /* Headless instance and device, with a transfer queue if there is one */
+  vk_inst_builder_set_app_name(&inst_builder, "vk-renderer soak_stream");
+  vk_inst_builder_set_app_version(&inst_builder, 0, 0, 1);
+  inst = vk_inst_create(&inst_builder);
+  phys_dev = vk_phys_dev_choose(score_physical_device, &inst, NULL);
+  vk_phys_dev_get_info(phys_dev, &soak.info, NULL);
+  ASSERT(score_physical_device(&soak.info) > 0);
+  log_msg(LOG_LEVEL_INFO, "Soaking on %s", soak.info.properties.deviceName);
+  memset(&features12, 0, sizeof(features12));
+  features12.timelineSemaphore = VK_TRUE;
+  vk_dev_builder_add_features12(&dev_builder, features12);
+  if (soak.info.synchronization2.synchronization2)
+    vk_dev_builder_add_synchronization2(&dev_builder);
+  vk_dev_builder_add_graphics_queue(&dev_builder, 1.0f);
+  transfer_family = soak.info.queue_families.graphics_index;
+  if (
+      soak.info.queue_families.transfer_supported
+      && soak.info.queue_families.transfer_index
+      != soak.info.queue_families.graphics_index
+  ) {
+    vk_dev_builder_add_transfer_queue(&dev_builder, 1.0f);
+    transfer_family = soak.info.queue_families.transfer_index;
+  }
+  soak.dev = vk_dev_create(&phys_dev, &soak.info, &dev_builder);
+  vk_submit_create(&soak.submit, &soak.dev);
+  jobs_create(&soak.jobs, jobs_physical_cores(), false);
+
+  /* Pack, and a streamer with room for about two windows */
+  if (
+      !write_pack(pack_path, soak.texture_count)
+      || !asset_pack_open(&soak.pack, pack_path)
+  ) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to write %s", pack_path);
+    return 1;
+  }
+  for (uint32_t i = 0; i < TEXTURE_MIPS; i++) {
+    uint32_t size = mip_extent(TEXTURE_SIZE, i);
+    full_size += (VkDeviceSize)size * size * 4;
+  }
+  vk_stream_builder_set_max_textures(&stream_builder, soak.texture_count);
+  vk_stream_builder_set_frames_in_flight(&stream_builder, FRAMES_IN_FLIGHT);
+  vk_stream_builder_set_budget(
+      &stream_builder,
+      full_size * soak.window_count * 5 / 2
+  );
+  vk_stream_builder_set_submit(&stream_builder, &soak.submit, transfer_family);
+  vk_stream_builder_set_graphics_family(
+      &stream_builder,
+      soak.info.queue_families.graphics_index
+  );
+  vk_stream_builder_set_jobs(&stream_builder, &soak.jobs);
+  vk_stream_builder_set_transcode_target(
+      &stream_builder,
+      transcode_choose_target(phys_dev, false)
+  );
+  soak.stream = vk_stream_create(&soak.dev, &soak.info, &stream_builder);
+  for (uint32_t i = 0; i < soak.pack.chunk_count; i++) {
+    if (vk_stream_add_texture(
+          &soak.stream,
+          &soak.pack,
+          &soak.pack.chunks[i]
+    ) == VK_STREAM_INVALID) soak.errors++;
+  }
+  full = (bool *)calloc(soak.texture_count, sizeof(bool));
+  ASSERT(full);
+
+  for (uint32_t phase = 0; phase < phases; phase++) {
+    const vk_stream_t *stream = &soak.stream;
+    VkDeviceSize resident = 0;
+    uint32_t phase_evicted = 0;
+
+    soak.window_first = phase * soak.window_count % soak.texture_count;
+    if (!run_phase(&soak)) {
+      log_msg(
+          LOG_LEVEL_ERROR,
+          "Phase %u: not settled after %u frames (%u loads in flight)",
+          phase,
+          MAX_PHASE_FRAMES,
+          stream->load_count
+      );
+      soak.errors++;
+      continue;
+    }
+
+    for (uint32_t i = 0; i < stream->texture_count; i++) {
+      const vk_stream_texture_t *texture = &stream->textures[i];
+      resident += texture->memory_size;
+      if (texture->resident_mip > texture->tail_mip) {
+        log_msg(
+            LOG_LEVEL_ERROR,
+            "Phase %u: texture %u lost its tail",
+            phase,
+            i
+        );
+        soak.errors++;
+      }
+      /* Each texture counts towards what was seen once, at full size */
+      if (texture->resident_mip == 0 && !full[i]) {
+        full[i] = true;
+        seen_size += texture->memory_size;
+      } else if (texture->resident_mip > 0 && full[i]) {
+        full[i] = false;
+        phase_evicted++;
+      }
+    }
+    evicted += phase_evicted;
+    if (
+        resident != stream->resident_size
+        || resident > stream->budget + stream->budget / BUDGET_SLACK
+    ) {
+      log_msg(
+          LOG_LEVEL_ERROR,
+          "Phase %u: %.1f MB resident, %.1f MB accounted, %.1f MB budget",
+          phase,
+          (double)resident / (1024.0 * 1024.0),
+          (double)stream->resident_size / (1024.0 * 1024.0),
+          (double)stream->budget / (1024.0 * 1024.0)
+      );
+      soak.errors++;
+    }
+    if (seen_size > stream->budget && evicted == 0) {
+      log_msg(
+          LOG_LEVEL_ERROR,
+          "Phase %u: over budget but nothing evicted",
+          phase
+      );
+      soak.errors++;
+    }
+    log_msg(
+        LOG_LEVEL_INFO,
+        "Phase %u: settled by frame %llu, %.1f MB resident, %u evicted",
+        phase,
+        (unsigned long long)soak.frame,
+        (double)resident / (1024.0 * 1024.0),
+        phase_evicted
+    );
+  }
+  log_msg(
+      soak.errors ? LOG_LEVEL_ERROR : LOG_LEVEL_SUCCESS,
+      "%u textures, %u phases, %llu frames: %u evicted, %u errors",
+      soak.texture_count,
+      phases,
+      (unsigned long long)soak.frame,
+      evicted,
+      soak.errors
+  );
+  telemetry_dump();
+
+  free(full);
+  vk_stream_destroy(&soak.stream, &soak.dev);
+  vk_submit_wait_idle(&soak.submit);
+  jobs_destroy(&soak.jobs);
+  asset_pack_close(&soak.pack);
+  remove(pack_path);
+  vk_submit_destroy(&soak.submit, &soak.dev);
+  vk_dev_destroy(&soak.dev);
+  vk_phys_dev_info_free(&soak.info);
+  vk_inst_destroy(&inst);
+  return soak.errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,775 @@
+/* Headless Vulkan capture replay benchmark */
+#include <base.h>
+#include <vk_inst.h>
+#include <vk_phys_dev.h>
+#include <vk_dev.h>
+#include <vk_buf.h>
+#include <vk_sync.h>
+#include <vk_submit.h>
+#include <vk_capture.h>
+#include <telemetry.h>
+
+/*
+ * Usage: vk_replay <capture> [loops] [frames in flight]
+ *
+ * Re-issues a stream written by vk_capture.h (run the renderer with
+ * VK_RENDERER_CAPTURE=<file>) as fast as it can, with no window and no app
+ * logic, on a CPU device (lavapipe) if there is one. Swapchain images
+ * become offscreen images, presentation layouts become GENERAL, captured
+ * semaphores become timelines (a wait on one nothing in the stream signals
+ * is dropped), and each frame records fresh command buffers from its slot's
+ * pool. Submissions go through vk_submit, as the renderer's do.
+ *
+ * The captured frames are replayed loops times (default 10), and the CPU
+ * cost of every frame, from recording through buffer uploads to the
+ * submission flush, is reported as min, average, p99 and max. Time spent
+ * waiting for a frame slot is left out.
+ */
+
+/* Most frames in flight */
+#define REPLAY_MAX_FRAMES 4
+
+/* Types */
+/* Kinds of replayed resource */
+typedef enum {
+  REPLAY_NONE,
+  REPLAY_BUFFER,
+  REPLAY_IMAGE
+} replay_kind_t;
+/* Object standing in for a captured id */
+typedef struct {
+  replay_kind_t kind;
+  vk_buf_t buffer;
+  VkImage image;
+  VkDeviceMemory memory;
+  VkCommandBuffer cmd;            /* Recording, for command buffer ids */
+  vk_timeline_t *timeline;        /* For semaphore ids */
+  uint64_t signalled;             /* Last value signalled */
+} replay_object_t;
+/* Frame slot */
+typedef struct {
+  VkCommandPool pool;
+  VkCommandBuffer *cmds;
+  uint32_t cmd_count, cmd_capacity, cmd_used;
+  vk_sync_point_t done;
+} replay_slot_t;
+/* Capture stream */
+typedef struct {
+  const uint8_t *data;
+  size_t size, pos;
+} replay_stream_t;
+/* Replayer */
+typedef struct {
+  vk_inst_t inst;
+  vk_phys_dev_t phys_dev;
+  vk_phys_dev_info_t info;
+  vk_dev_t dev;
+  vk_submit_t submit;
+  replay_object_t *objects;
+  uint32_t object_capacity;
+  replay_slot_t slots[REPLAY_MAX_FRAMES];
+  uint32_t frames, slot;
+  /* Scratch for translated records */
+  VkMemoryBarrier *memory_barriers;
+  uint32_t memory_barrier_capacity;
+  VkBufferMemoryBarrier *buffer_barriers;
+  uint32_t buffer_barrier_capacity;
+  VkImageMemoryBarrier *image_barriers;
+  uint32_t image_barrier_capacity;
+  VkBufferCopy *regions;
+  uint32_t region_capacity;
+  VkCommandBuffer *cmds;
+  uint32_t cmd_capacity;
+  vk_submit_semaphore_t *semaphores;
+  uint32_t semaphore_capacity;
+} replay_t;
+
+/* Grow an array to hold at least count elements */
+static void *reserve(
+    void *array,
+    uint32_t *capacity,
+    uint32_t count,
+    size_t element_size
+) {
+  uint32_t new_capacity = *capacity ? *capacity : 16;
+  if (count <= *capacity) return array;
+  while (new_capacity < count) new_capacity *= 2;
+  array = realloc(array, element_size * new_capacity);
+  ASSERT(array);
+  *capacity = new_capacity;
+  return array;
+}
+/* Score physical device (a CPU device keeps results driver independent) */
+static uint32_t score_physical_device(const vk_phys_dev_info_t *info) {
+  if (!info->queue_families.graphics_supported) return 0;
+  if (!info->features12.timelineSemaphore) return 0;
+  switch (info->properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 1000;
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 250;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 125;
+    default:
+      return 1;
+  }
+}
+/* Get the object for an id, growing the table (NULL for id 0) */
+static replay_object_t *object(replay_t *replay, uint32_t id) {
+  if (id == 0) return NULL;
+  if (id >= replay->object_capacity) {
+    uint32_t capacity = replay->object_capacity;
+    replay->objects = (replay_object_t *)reserve(
+        replay->objects,
+        &replay->object_capacity,
+        id + 1,
+        sizeof(replay_object_t)
+    );
+    memset(
+        replay->objects + capacity,
+        0,
+        sizeof(replay_object_t) * (replay->object_capacity - capacity)
+    );
+  }
+  return &replay->objects[id];
+}
+/* Read the next record (false at the end or if truncated) */
+static bool stream_next(
+    replay_stream_t *stream,
+    vk_capture_record_t *record,
+    const uint8_t **payload
+) {
+  if (stream->size - stream->pos < sizeof(vk_capture_record_t)) return false;
+  memcpy(record, stream->data + stream->pos, sizeof(vk_capture_record_t));
+  if (
+      stream->size - stream->pos - sizeof(vk_capture_record_t)
+      < record->size
+  ) return false;
+  *payload = stream->data + stream->pos + sizeof(vk_capture_record_t);
+  stream->pos += sizeof(vk_capture_record_t) + record->size;
+  return true;
+}
+/* Check a record's payload is the size its counts say */
+static bool record_valid(const vk_capture_record_t *record, const void *data) {
+  vk_capture_data_op_t data_op;
+  vk_capture_barrier_op_t barrier;
+  vk_capture_copy_op_t copy;
+  vk_capture_submit_op_t submit;
+  switch (record->op) {
+    case VK_CAPTURE_OP_BUFFER:
+      return record->size == sizeof(vk_capture_buffer_op_t);
+    case VK_CAPTURE_OP_IMAGE:
+      return record->size == sizeof(vk_capture_image_op_t);
+    case VK_CAPTURE_OP_BUFFER_DATA:
+      if (record->size < sizeof(data_op)) return false;
+      memcpy(&data_op, data, sizeof(data_op));
+      return record->size - sizeof(data_op) == data_op.size;
+    case VK_CAPTURE_OP_CMD_BEGIN:
+    case VK_CAPTURE_OP_CMD_END:
+      return record->size == sizeof(vk_capture_cmd_op_t);
+    case VK_CAPTURE_OP_PIPELINE_BARRIER:
+      if (record->size < sizeof(barrier)) return false;
+      memcpy(&barrier, data, sizeof(barrier));
+      return record->size == sizeof(barrier)
+        + sizeof(vk_capture_memory_barrier_t) * (uint64_t)barrier.memory_count
+        + sizeof(vk_capture_buffer_barrier_t) * (uint64_t)barrier.buffer_count
+        + sizeof(vk_capture_image_barrier_t) * (uint64_t)barrier.image_count;
+    case VK_CAPTURE_OP_COPY_BUFFER:
+      if (record->size < sizeof(copy)) return false;
+      memcpy(&copy, data, sizeof(copy));
+      return record->size == sizeof(copy)
+        + sizeof(vk_capture_region_t) * (uint64_t)copy.region_count;
+    case VK_CAPTURE_OP_SUBMIT:
+      if (record->size < sizeof(submit)) return false;
+      memcpy(&submit, data, sizeof(submit));
+      return submit.kind < VK_SUBMIT_KIND_COUNT
+        && record->size == sizeof(submit)
+        + sizeof(uint32_t) * (uint64_t)submit.command_buffer_count
+        + sizeof(vk_capture_semaphore_t)
+        * ((uint64_t)submit.wait_count + submit.signal_count);
+    case VK_CAPTURE_OP_FRAME:
+      return record->size == 0;
+    default:
+      return false;
+  }
+}
+/* Create the instance, device and submission layer */
+static void replay_create(replay_t *replay, uint32_t frames) {
+  vk_inst_builder_t inst_builder = vk_inst_builder();
+  vk_dev_builder_t dev_builder = vk_dev_builder();
+  VkPhysicalDeviceVulkan12Features features12;
+  VkCommandPoolCreateInfo pool_info;
+
+  memset(replay, 0, sizeof(replay_t));
+  replay->frames = frames;
+  vk_inst_builder_set_app_name(&inst_builder, "vk-renderer replay");
+  vk_inst_builder_set_app_version(&inst_builder, 0, 0, 1);
+  replay->inst = vk_inst_create(&inst_builder);
+  replay->phys_dev = vk_phys_dev_choose(
+      score_physical_device,
+      &replay->inst,
+      NULL
+  );
+  vk_phys_dev_get_info(replay->phys_dev, &replay->info, NULL);
+  ASSERT(score_physical_device(&replay->info) > 0);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "Replaying on %s",
+      replay->info.properties.deviceName
+  );
+  memset(&features12, 0, sizeof(features12));
+  features12.timelineSemaphore = VK_TRUE;
+  vk_dev_builder_add_features12(&dev_builder, features12);
+  if (replay->info.synchronization2.synchronization2)
+    vk_dev_builder_add_synchronization2(&dev_builder);
+  vk_dev_builder_add_graphics_queue(&dev_builder, 1.0f);
+  replay->dev = vk_dev_create(&replay->phys_dev, &replay->info, &dev_builder);
+  vk_submit_create(&replay->submit, &replay->dev);
+
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.pNext = NULL;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = replay->info.queue_families.graphics_index;
+  for (uint32_t i = 0; i < frames; i++) VK_CHECK(vkCreateCommandPool(
+        replay->dev.device,
+        &pool_info,
+        NULL,
+        &replay->slots[i].pool
+  ));
+}
+/* Create an offscreen image standing in for a captured one */
+static void create_image(
+    replay_t *replay,
+    replay_object_t *object,
+    const vk_capture_image_op_t *op
+) {
+  VkImageCreateInfo image_info;
+  VkMemoryAllocateInfo alloc_info;
+  VkMemoryRequirements requirements;
+
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.pNext = NULL;
+  image_info.flags = 0;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = (VkFormat)op->format;
+  image_info.extent.width = op->width;
+  image_info.extent.height = op->height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = op->usage;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.queueFamilyIndexCount = 0;
+  image_info.pQueueFamilyIndices = NULL;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK(vkCreateImage(
+        replay->dev.device,
+        &image_info,
+        NULL,
+        &object->image
+  ));
+  vkGetImageMemoryRequirements(
+      replay->dev.device,
+      object->image,
+      &requirements
+  );
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = NULL;
+  alloc_info.allocationSize = requirements.size;
+  alloc_info.memoryTypeIndex = vk_phys_dev_find_memory_type(
+      &replay->info,
+      requirements.memoryTypeBits,
+      0,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+  ASSERT(alloc_info.memoryTypeIndex != UINT32_MAX);
+  VK_CHECK(vkAllocateMemory(
+        replay->dev.device,
+        &alloc_info,
+        NULL,
+        &object->memory
+  ));
+  VK_CHECK(vkBindImageMemory(
+        replay->dev.device,
+        object->image,
+        object->memory,
+        0
+  ));
+  object->kind = REPLAY_IMAGE;
+}
+/* Create every captured resource, counting frames (false if malformed) */
+static bool replay_prepare(
+    replay_t *replay,
+    replay_stream_t *stream,
+    size_t *frames_end,
+    uint32_t *frame_count
+) {
+  vk_capture_record_t record;
+  const uint8_t *payload;
+  vk_capture_header_t header;
+
+  *frames_end = 0;
+  *frame_count = 0;
+  if (stream->size < sizeof(header)) return false;
+  memcpy(&header, stream->data, sizeof(header));
+  if (
+      header.magic != VK_CAPTURE_MAGIC
+      || header.version != VK_CAPTURE_VERSION
+  ) return false;
+  stream->pos = sizeof(header);
+  while (stream_next(stream, &record, &payload)) {
+    if (!record_valid(&record, payload)) return false;
+    if (record.op == VK_CAPTURE_OP_BUFFER) {
+      vk_capture_buffer_op_t op;
+      replay_object_t *buffer;
+      memcpy(&op, payload, sizeof(op));
+      buffer = object(replay, op.id);
+      if (!buffer || buffer->kind != REPLAY_NONE) return false;
+      buffer->buffer = vk_buf_create(
+          &replay->dev,
+          &replay->info,
+          op.size,
+          op.usage,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+          | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          0
+      );
+      buffer->kind = REPLAY_BUFFER;
+    } else if (record.op == VK_CAPTURE_OP_IMAGE) {
+      vk_capture_image_op_t op;
+      replay_object_t *image;
+      memcpy(&op, payload, sizeof(op));
+      image = object(replay, op.id);
+      if (!image || image->kind != REPLAY_NONE) return false;
+      create_image(replay, image, &op);
+    } else if (record.op == VK_CAPTURE_OP_FRAME) {
+      *frames_end = stream->pos;
+      (*frame_count)++;
+    }
+  }
+  return stream->pos == stream->size;
+}
+/* Get a command buffer from the current slot's pool */
+static VkCommandBuffer slot_cmd(replay_t *replay) {
+  replay_slot_t *slot = &replay->slots[replay->slot];
+  if (slot->cmd_used == slot->cmd_count) {
+    VkCommandBufferAllocateInfo alloc_info;
+    slot->cmds = (VkCommandBuffer *)reserve(
+        slot->cmds,
+        &slot->cmd_capacity,
+        slot->cmd_count + 1,
+        sizeof(VkCommandBuffer)
+    );
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.pNext = NULL;
+    alloc_info.commandPool = slot->pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(
+          replay->dev.device,
+          &alloc_info,
+          &slot->cmds[slot->cmd_count++]
+    ));
+  }
+  return slot->cmds[slot->cmd_used++];
+}
+/* Get a captured layout as replayed (nothing is presented) */
+static VkImageLayout replay_layout(uint32_t layout) {
+  if (layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) return VK_IMAGE_LAYOUT_GENERAL;
+  return (VkImageLayout)layout;
+}
+/* Replay a pipeline barrier */
+static void replay_barrier(replay_t *replay, const uint8_t *payload) {
+  vk_capture_barrier_op_t op;
+  replay_object_t *cmd;
+  uint32_t buffer_count = 0, image_count = 0;
+
+  memcpy(&op, payload, sizeof(op));
+  payload += sizeof(op);
+  cmd = object(replay, op.cmd);
+  if (!cmd || !cmd->cmd) return;
+  replay->memory_barriers = (VkMemoryBarrier *)reserve(
+      replay->memory_barriers,
+      &replay->memory_barrier_capacity,
+      op.memory_count,
+      sizeof(VkMemoryBarrier)
+  );
+  replay->buffer_barriers = (VkBufferMemoryBarrier *)reserve(
+      replay->buffer_barriers,
+      &replay->buffer_barrier_capacity,
+      op.buffer_count,
+      sizeof(VkBufferMemoryBarrier)
+  );
+  replay->image_barriers = (VkImageMemoryBarrier *)reserve(
+      replay->image_barriers,
+      &replay->image_barrier_capacity,
+      op.image_count,
+      sizeof(VkImageMemoryBarrier)
+  );
+  for (uint32_t i = 0; i < op.memory_count; i++) {
+    VkMemoryBarrier *barrier = &replay->memory_barriers[i];
+    vk_capture_memory_barrier_t from;
+    memcpy(&from, payload, sizeof(from));
+    payload += sizeof(from);
+    barrier->sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier->pNext = NULL;
+    barrier->srcAccessMask = from.src_access;
+    barrier->dstAccessMask = from.dst_access;
+  }
+  /* Barriers on resources the stream never created are dropped */
+  for (uint32_t i = 0; i < op.buffer_count; i++) {
+    VkBufferMemoryBarrier *barrier = &replay->buffer_barriers[buffer_count];
+    vk_capture_buffer_barrier_t from;
+    replay_object_t *buffer;
+    memcpy(&from, payload, sizeof(from));
+    payload += sizeof(from);
+    buffer = object(replay, from.buffer);
+    if (!buffer || buffer->kind != REPLAY_BUFFER) continue;
+    barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier->pNext = NULL;
+    barrier->srcAccessMask = from.src_access;
+    barrier->dstAccessMask = from.dst_access;
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->buffer = buffer->buffer.buffer;
+    barrier->offset = from.offset;
+    barrier->size = from.size;
+    buffer_count++;
+  }
+  for (uint32_t i = 0; i < op.image_count; i++) {
+    VkImageMemoryBarrier *barrier = &replay->image_barriers[image_count];
+    vk_capture_image_barrier_t from;
+    replay_object_t *image;
+    memcpy(&from, payload, sizeof(from));
+    payload += sizeof(from);
+    image = object(replay, from.image);
+    if (!image || image->kind != REPLAY_IMAGE) continue;
+    barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier->pNext = NULL;
+    barrier->srcAccessMask = from.src_access;
+    barrier->dstAccessMask = from.dst_access;
+    barrier->oldLayout = replay_layout(from.old_layout);
+    barrier->newLayout = replay_layout(from.new_layout);
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->image = image->image;
+    barrier->subresourceRange.aspectMask = from.aspect;
+    barrier->subresourceRange.baseMipLevel = from.base_mip;
+    barrier->subresourceRange.levelCount = from.mip_count;
+    barrier->subresourceRange.baseArrayLayer = from.base_layer;
+    barrier->subresourceRange.layerCount = from.layer_count;
+    image_count++;
+  }
+  vkCmdPipelineBarrier(
+      cmd->cmd,
+      op.src_stages,
+      op.dst_stages,
+      op.dependency_flags,
+      op.memory_count, replay->memory_barriers,
+      buffer_count, replay->buffer_barriers,
+      image_count, replay->image_barriers
+  );
+}
+/* Replay a buffer copy */
+static void replay_copy(replay_t *replay, const uint8_t *payload) {
+  vk_capture_copy_op_t op;
+  replay_object_t *cmd, *src, *dst;
+
+  memcpy(&op, payload, sizeof(op));
+  payload += sizeof(op);
+  cmd = object(replay, op.cmd);
+  src = object(replay, op.src);
+  dst = object(replay, op.dst);
+  if (!cmd || !cmd->cmd || op.region_count == 0) return;
+  if (!src || src->kind != REPLAY_BUFFER) return;
+  if (!dst || dst->kind != REPLAY_BUFFER) return;
+  replay->regions = (VkBufferCopy *)reserve(
+      replay->regions,
+      &replay->region_capacity,
+      op.region_count,
+      sizeof(VkBufferCopy)
+  );
+  for (uint32_t i = 0; i < op.region_count; i++) {
+    vk_capture_region_t region;
+    memcpy(&region, payload, sizeof(region));
+    payload += sizeof(region);
+    replay->regions[i].srcOffset = region.src_offset;
+    replay->regions[i].dstOffset = region.dst_offset;
+    replay->regions[i].size = region.size;
+  }
+  vkCmdCopyBuffer(
+      cmd->cmd,
+      src->buffer.buffer,
+      dst->buffer.buffer,
+      op.region_count,
+      replay->regions
+  );
+}
+/* Get the timeline standing in for a captured semaphore */
+static replay_object_t *semaphore(replay_t *replay, uint32_t id) {
+  replay_object_t *semaphore = object(replay, id);
+  if (!semaphore || semaphore->timeline) return semaphore;
+  semaphore->timeline = (vk_timeline_t *)malloc(sizeof(vk_timeline_t));
+  ASSERT(semaphore->timeline);
+  vk_timeline_create(semaphore->timeline, &replay->dev);
+  return semaphore;
+}
+/* Replay a submission */
+static void replay_submit(replay_t *replay, const uint8_t *payload) {
+  vk_capture_submit_op_t op;
+  vk_submission_t submission;
+  uint32_t wait_count = 0, signal_count = 0;
+  vk_submit_semaphore_t *signals;
+
+  memcpy(&op, payload, sizeof(op));
+  payload += sizeof(op);
+  replay->cmds = (VkCommandBuffer *)reserve(
+      replay->cmds,
+      &replay->cmd_capacity,
+      op.command_buffer_count,
+      sizeof(VkCommandBuffer)
+  );
+  replay->semaphores = (vk_submit_semaphore_t *)reserve(
+      replay->semaphores,
+      &replay->semaphore_capacity,
+      op.wait_count + op.signal_count,
+      sizeof(vk_submit_semaphore_t)
+  );
+  submission.command_buffer_count = 0;
+  for (uint32_t i = 0; i < op.command_buffer_count; i++) {
+    uint32_t id;
+    replay_object_t *cmd;
+    memcpy(&id, payload, sizeof(id));
+    payload += sizeof(id);
+    cmd = object(replay, id);
+    if (cmd && cmd->cmd)
+      replay->cmds[submission.command_buffer_count++] = cmd->cmd;
+  }
+  /* Waits on semaphores only signalled outside the stream are dropped */
+  for (uint32_t i = 0; i < op.wait_count; i++) {
+    vk_capture_semaphore_t from;
+    replay_object_t *wait;
+    memcpy(&from, payload, sizeof(from));
+    payload += sizeof(from);
+    wait = semaphore(replay, from.semaphore);
+    if (!wait || wait->signalled == 0) continue;
+    replay->semaphores[wait_count].semaphore = wait->timeline->semaphore;
+    replay->semaphores[wait_count].value = wait->signalled;
+    replay->semaphores[wait_count].stages = from.stages;
+    wait_count++;
+  }
+  signals = replay->semaphores + wait_count;
+  for (uint32_t i = 0; i < op.signal_count; i++) {
+    vk_capture_semaphore_t from;
+    replay_object_t *signal;
+    memcpy(&from, payload, sizeof(from));
+    payload += sizeof(from);
+    signal = semaphore(replay, from.semaphore);
+    if (!signal) continue;
+    signal->signalled = vk_timeline_advance(signal->timeline);
+    signals[signal_count].semaphore = signal->timeline->semaphore;
+    signals[signal_count].value = signal->signalled;
+    signals[signal_count].stages = from.stages;
+    signal_count++;
+  }
+  submission.command_buffers = replay->cmds;
+  submission.waits = replay->semaphores;
+  submission.wait_count = wait_count;
+  submission.signals = signals;
+  submission.signal_count = signal_count;
+  submission.fence = VK_NULL_HANDLE;
+  replay->slots[replay->slot].done = vk_submit_enqueue(
+      &replay->submit,
+      (vk_submit_kind_t)op.kind,
+      &submission
+  );
+}
+/* Replay one record (creation records were handled up front) */
+static void replay_record(
+    replay_t *replay,
+    const vk_capture_record_t *record,
+    const uint8_t *payload
+) {
+  switch (record->op) {
+    case VK_CAPTURE_OP_BUFFER_DATA: {
+      vk_capture_data_op_t op;
+      replay_object_t *buffer;
+      memcpy(&op, payload, sizeof(op));
+      buffer = object(replay, op.id);
+      if (!buffer || buffer->kind != REPLAY_BUFFER) break;
+      if (op.offset > buffer->buffer.size) break;
+      if (op.size > buffer->buffer.size - op.offset) break;
+      memcpy(
+          (uint8_t *)buffer->buffer.mapped + op.offset,
+          payload + sizeof(op),
+          (size_t)op.size
+      );
+    } break;
+    case VK_CAPTURE_OP_CMD_BEGIN: {
+      vk_capture_cmd_op_t op;
+      VkCommandBufferBeginInfo begin_info;
+      replay_object_t *cmd;
+      memcpy(&op, payload, sizeof(op));
+      cmd = object(replay, op.cmd);
+      if (!cmd) break;
+      cmd->cmd = slot_cmd(replay);
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.pNext = NULL;
+      begin_info.flags = op.flags;
+      begin_info.pInheritanceInfo = NULL;
+      VK_CHECK(vkBeginCommandBuffer(cmd->cmd, &begin_info));
+    } break;
+    case VK_CAPTURE_OP_CMD_END: {
+      vk_capture_cmd_op_t op;
+      replay_object_t *cmd;
+      memcpy(&op, payload, sizeof(op));
+      cmd = object(replay, op.cmd);
+      if (cmd && cmd->cmd) VK_CHECK(vkEndCommandBuffer(cmd->cmd));
+    } break;
+    case VK_CAPTURE_OP_PIPELINE_BARRIER:
+      replay_barrier(replay, payload);
+      break;
+    case VK_CAPTURE_OP_COPY_BUFFER:
+      replay_copy(replay, payload);
+      break;
+    case VK_CAPTURE_OP_SUBMIT:
+      replay_submit(replay, payload);
+      break;
+    default: break;
+  }
+}
+/* Wait for the current slot's last frame, then reset its command buffers */
+static void slot_begin(replay_t *replay) {
+  replay_slot_t *slot = &replay->slots[replay->slot];
+  vk_sync_wait(slot->done, &replay->dev, UINT64_MAX);
+  VK_CHECK(vkResetCommandPool(replay->dev.device, slot->pool, 0));
+  slot->cmd_used = 0;
+}
+/* Destroy everything the replayer created */
+static void replay_destroy(replay_t *replay) {
+  vk_submit_wait_idle(&replay->submit);
+  for (uint32_t i = 0; i < replay->object_capacity; i++) {
+    replay_object_t *object = &replay->objects[i];
+    if (object->kind == REPLAY_BUFFER)
+      vk_buf_destroy(&object->buffer, &replay->dev);
+    if (object->kind == REPLAY_IMAGE) {
+      vkDestroyImage(replay->dev.device, object->image, NULL);
+      vkFreeMemory(replay->dev.device, object->memory, NULL);
+    }
+    if (object->timeline) {
+      vk_timeline_destroy(object->timeline, &replay->dev);
+      free(object->timeline);
+    }
+  }
+  for (uint32_t i = 0; i < replay->frames; i++) {
+    vkDestroyCommandPool(replay->dev.device, replay->slots[i].pool, NULL);
+    free(replay->slots[i].cmds);
+  }
+  free(replay->objects);
+  free(replay->memory_barriers);
+  free(replay->buffer_barriers);
+  free(replay->image_barriers);
+  free(replay->regions);
+  free(replay->cmds);
+  free(replay->semaphores);
+  vk_submit_destroy(&replay->submit, &replay->dev);
+  vk_dev_destroy(&replay->dev);
+  vk_phys_dev_info_free(&replay->info);
+  vk_inst_destroy(&replay->inst);
+  memset(replay, 0, sizeof(replay_t));
+}
+/* Compare frame times */
+static int compare_times(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Entry point */
+int main(int argc, char **argv) {
+  int loops = argc > 2 ? atoi(argv[2]) : 10;
+  int frames = argc > 3 ? atoi(argv[3]) : 2;
+  replay_t replay;
+  replay_stream_t stream;
+  vk_capture_record_t record;
+  const uint8_t *payload;
+  size_t frames_end;
+  uint32_t frame_count, total, measured = 0;
+  double *times, sum = 0.0, start;
+
+  if (argc < 2) {
+    log_msg(
+        LOG_LEVEL_ERROR,
+        "Usage: vk_replay <capture> [loops] [frames in flight]"
+    );
+    return 1;
+  }
+  if (loops < 1) loops = 1;
+  if (frames < 1) frames = 1;
+  if (frames > REPLAY_MAX_FRAMES) frames = REPLAY_MAX_FRAMES;
+  stream.data = (const uint8_t *)read_file(argv[1], &stream.size);
+  stream.pos = 0;
+  if (!stream.data) {
+    log_msg(LOG_LEVEL_ERROR, "Failed to read %s", argv[1]);
+    return 1;
+  }
+
+  replay_create(&replay, (uint32_t)frames);
+  if (!replay_prepare(&replay, &stream, &frames_end, &frame_count)) {
+    log_msg(LOG_LEVEL_ERROR, "%s is not a valid capture", argv[1]);
+    replay_destroy(&replay);
+    free((void *)stream.data);
+    return 1;
+  }
+  if (frame_count == 0) {
+    log_msg(LOG_LEVEL_ERROR, "%s holds no whole frames", argv[1]);
+    replay_destroy(&replay);
+    free((void *)stream.data);
+    return 1;
+  }
+  total = frame_count * (uint32_t)loops;
+  times = (double *)malloc(sizeof(double) * total);
+  ASSERT(times);
+
+  /* Replay the captured frames loops times, timing each frame's CPU work */
+  for (int loop = 0; loop < loops; loop++) {
+    stream.pos = sizeof(vk_capture_header_t);
+    slot_begin(&replay);
+    start = time_now();
+    while (stream.pos < frames_end && stream_next(&stream, &record, &payload)) {
+      if (record.op != VK_CAPTURE_OP_FRAME) {
+        replay_record(&replay, &record, payload);
+        continue;
+      }
+      vk_submit_flush(&replay.submit);
+      times[measured] = (time_now() - start) * 1e3;
+      telemetry_report("replay.frame_cpu", TELEMETRY_TIMING, times[measured]);
+      sum += times[measured++];
+      replay.slot = (replay.slot + 1) % replay.frames;
+      if (stream.pos < frames_end) {
+        slot_begin(&replay);
+        start = time_now();
+      }
+    }
+  }
+
+  qsort(times, measured, sizeof(double), compare_times);
+  log_msg(
+      LOG_LEVEL_INFO,
+      "%u frames (%u captured x %d): CPU per frame min %.3f ms, "
+      "avg %.3f ms, p99 %.3f ms, max %.3f ms",
+      measured,
+      frame_count,
+      loops,
+      times[0],
+      sum / measured,
+      times[(size_t)((measured - 1) * 0.99)],
+      times[measured - 1]
+  );
+  telemetry_dump();
+  free(times);
+  replay_destroy(&replay);
+  free((void *)stream.data);
+  return 0;
+}